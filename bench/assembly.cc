@@ -0,0 +1,67 @@
+/// Measure the throughput of x86_64 GNU assembly emission.
+///
+/// USAGE: asm-bench [FUNCTIONS] [LENGTH] [REPETITIONS] [OUTPUT]
+///
+/// This selects instructions and allocates registers for a module
+/// generated by bench::GenerateModule() that also loads through a
+/// pointer, and then emits the whole module as assembly into OUTPUT
+/// (by default, /dev/null) REPETITIONS times.
+#include <lcc/codegen/mir.hh>
+#include <lcc/codegen/x86_64/assembly.hh>
+#include <lcc/codegen/x86_64/x86_64.hh>
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/utils.hh>
+
+#include <bench.hh>
+
+#include <filesystem>
+#include <fmt/format.h>
+#include <string_view>
+#include <vector>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+constexpr std::string_view Operations[]{"add", "sub", "and"};
+constexpr std::string_view ImmediateOperations[]{"sub"};
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz functions = argc > 1 ? ParseCount(argv[1]) : 1000;
+    usz length = argc > 2 ? ParseCount(argv[2]) : 200;
+    usz repetitions = argc > 3 ? ParseCount(argv[3]) : 10;
+    fs::path output = argc > 4 ? argv[4] : "/dev/null";
+
+    ModuleShape shape{
+        .operations = Operations,
+        .immediate_operations = ImmediateOperations,
+        .load_through_pointer = true,
+    };
+
+    auto context = CreateContext(Format::gnu_as_att_assembly);
+
+    // Parse from a file, so that the debug locations the assembly refers
+    // to are valid.
+    auto ir = GenerateModule(functions, length, shape);
+    auto& file = context->create_file("asm-bench.lcc", std::vector<char>(ir.begin(), ir.end()));
+    auto module = Module::Parse(context.get(), file);
+    if (not module or context->has_error()) return 1;
+
+    auto desc = x86_64::machine_description(context.get());
+    auto machine_ir = AllocatedMIR(module.get(), desc);
+    auto instructions = InstructionCount(machine_ir);
+
+    // Emission rewrites some instructions in place, so give every
+    // repetition a fresh copy.
+    auto milliseconds = Time(
+        repetitions,
+        [&] { return machine_ir; },
+        [&](auto& copy) { x86_64::emit_gnu_att_assembly(output, module.get(), desc, copy); }
+    );
+
+    fmt::print("{} functions, {} instructions\n", machine_ir.size(), instructions);
+    fmt::print("{:.3f} ms per repetition, {:.2f} Minstructions/s\n", milliseconds, double(instructions) / milliseconds / 1e3);
+}
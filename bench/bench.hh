@@ -0,0 +1,190 @@
+#ifndef LCC_BENCH_HH
+#define LCC_BENCH_HH
+
+#include <lcc/codegen/isel.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/codegen/register_allocation.hh>
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/// Helpers shared by the benchmarks in `bench`.
+namespace lcc::bench {
+/// Parse a nonzero count from the command line, or exit with an error.
+inline auto ParseCount(const char* arg) -> usz {
+    std::string_view str{arg};
+    usz count{};
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), count);
+    if (ec != std::errc() or ptr != str.data() + str.size() or not count) {
+        fmt::print(stderr, "Invalid count {}\n", str);
+        std::exit(1);
+    }
+    return count;
+}
+
+/// Keep the compiler from optimising away what is being measured.
+inline volatile usz sink{};
+
+/// Keep the compiler from knowing what \p value is, so that a loop
+/// that sums up a range can't be turned into a formula.
+inline void Opaque(usz& value) {
+#if defined(__GNUC__)
+    asm volatile("" : "+r"(value));
+#else
+    sink = value;
+    value = sink;
+#endif
+}
+
+/// Run \p f \p repetitions times, and return the average time it took,
+/// in milliseconds. If \p f returns a value, it is added to `sink`.
+auto Time(usz repetitions, auto f) -> double {
+    double milliseconds = 0;
+    for (usz i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (std::is_void_v<decltype(f())>) f();
+        else sink = sink + usz(f());
+        auto end = std::chrono::steady_clock::now();
+        milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    return milliseconds / double(repetitions);
+}
+
+/// Like Time(), but call \p setup before every repetition, without
+/// timing it, and pass what it returns to \p f.
+auto Time(usz repetitions, auto setup, auto f) -> double {
+    double milliseconds = 0;
+    for (usz i = 0; i < repetitions; i++) {
+        auto input = setup();
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (std::is_void_v<decltype(f(input))>) f(input);
+        else sink = sink + usz(f(input));
+        auto end = std::chrono::steady_clock::now();
+        milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+    return milliseconds / double(repetitions);
+}
+
+/// Create a context for x86_64 Linux that emits \p format and prints
+/// nothing but diagnostics.
+inline auto CreateContext(const Format* format) -> std::unique_ptr<Context> {
+    return std::make_unique<Context>(
+        Target::x86_64_linux,
+        format,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR //
+        }
+    );
+}
+
+/// What the functions generated by GenerateModule() do, on top of
+/// combining a value kept in a local with the second parameter and
+/// with constants.
+struct ModuleShape {
+    /// The operations to combine the value with.
+    std::span<const std::string_view> operations;
+
+    /// The operations to combine the value with when the other operand
+    /// is a constant, if not the same as the above.
+    std::span<const std::string_view> immediate_operations{};
+
+    /// Make the first parameter a pointer, and add a value loaded
+    /// through it every third step.
+    bool load_through_pointer{};
+
+    /// Call the previous function every third step.
+    bool calls{};
+
+    /// Merge the result with the second parameter in a phi at the end.
+    bool phi{};
+};
+
+/// Generate IR for \p functions functions of about \p length
+/// instructions each. Each one stores its parameter in a local, and
+/// then repeatedly loads it, combines it with something, and stores it
+/// back. Block names are unique across the module, so that it can be
+/// emitted as a whole.
+inline auto GenerateModule(usz functions, usz length, const ModuleShape& shape) -> std::string {
+    std::string ir{};
+    for (usz f = 0; f < functions; f++) {
+        usz block = 4 * f;
+        ir += fmt::format("f{} : i64({} %0, i64 %1):\n  bb{}:\n", f, shape.load_through_pointer ? "ptr" : "i64", block);
+        ir += fmt::format("    %2 = alloca i64\n    store i64 %{} into %2\n", shape.load_through_pointer ? 1 : 0);
+
+        usz value = 3;
+        for (usz i = 0; i < length / 4; i++) {
+            auto operations = i % 2 or shape.immediate_operations.empty() ? shape.operations : shape.immediate_operations;
+            auto op = operations[(f + i) % operations.size()];
+            usz loaded = value++;
+            ir += fmt::format("    %{} = load i64 from %2\n", loaded);
+            if (i % 3 == 2 and shape.load_through_pointer) {
+                ir += fmt::format("    %{} = load i64 from %0\n", value);
+                ir += fmt::format("    %{} = add i64 %{}, %{}\n", value + 1, loaded, value);
+                value++;
+            } else if (i % 3 == 2 and shape.calls and f) {
+                ir += fmt::format("    %{} = call @f{}(i64 %{}, i64 %1) -> i64\n", value, f - 1, loaded);
+            } else if (i % 2) {
+                ir += fmt::format("    %{} = {} i64 %{}, %1\n", value, op, loaded);
+            } else {
+                ir += fmt::format("    %{} = {} i64 %{}, {}\n", value, op, loaded, i % 63 + 1);
+            }
+            ir += fmt::format("    store i64 %{} into %2\n", value++);
+        }
+
+        usz last = value++;
+        ir += fmt::format("    %{} = load i64 from %2\n", last);
+        if (not shape.phi) {
+            ir += fmt::format("    return i64 %{}\n", last);
+            continue;
+        }
+
+        usz cond = value++;
+        ir += fmt::format("    %{} = eq i64 %{}, 0\n", cond, last);
+        ir += fmt::format("    branch on %{} to %bb{} else %bb{}\n", cond, block + 1, block + 2);
+        ir += fmt::format("  bb{}:\n    branch to %bb{}\n", block + 1, block + 3);
+        ir += fmt::format("  bb{}:\n    %{} = add i64 %{}, 1\n    branch to %bb{}\n", block + 2, value, last, block + 3);
+        ir += fmt::format("  bb{}:\n    %{} = phi i64, [%bb{} : %1], [%bb{} : %{}]\n", block + 3, value + 1, block + 1, block + 2, value);
+        ir += fmt::format("    return i64 %{}\n", value + 1);
+    }
+    return ir;
+}
+
+/// Get the number of instructions in all of \p functions.
+inline auto InstructionCount(const std::vector<MFunction>& functions) -> usz {
+    usz count = 0;
+    for (auto& function : functions) count += function.instruction_count();
+    return count;
+}
+
+/// Lower \p module to MIR, and select instructions and allocate
+/// registers for all of it, leaving it ready to be emitted.
+inline auto AllocatedMIR(Module* module, const MachineDescription& desc) -> std::vector<MFunction> {
+    auto machine_ir = module->mir();
+    for (auto& function : machine_ir) {
+        select_instructions(module, function);
+        allocate_registers(desc, function);
+    }
+    return machine_ir;
+}
+} // namespace lcc::bench
+
+#endif // LCC_BENCH_HH
@@ -0,0 +1,423 @@
+/// Track how long compiling real inputs takes, and how much memory it
+/// uses, so that changes to the compiler can be compared.
+///
+/// USAGE: compile-perf-bench [-n RUNS] [-O LEVEL] [--csv FILE] [--json FILE]
+///                           [--baseline FILE] [--threshold PERCENT] [<path>...]
+///
+/// Every Glint (`.g`) and IR (`.lcc`) file among the given paths, which
+/// may be directories, is compiled to assembly (to /dev/null) RUNS times
+/// (default 5) at the given optimisation level (default 0), each time in
+/// a fresh context. Without paths, the inputs are examples/glint, tst/ir,
+/// and tst/opt, relative to the working directory. Inputs that fail to
+/// compile are skipped.
+///
+/// For every input, the time spent in each phase, as measured by the
+/// time report timers, is summarised as the median over all runs and its
+/// median absolute deviation (MAD). The bytes allocated for the AST and
+/// the IR in each phase are measured in one extra run, since recording
+/// them slows down the timers; they don’t vary between runs anyway.
+///
+/// --csv and --json write the results to a file; a CSV file written by
+/// an earlier run can be passed to --baseline to compare against it. A
+/// phase has regressed if its median time grew by more than the
+/// threshold (default 10%) and by more than three times the larger of
+/// the two MADs, or if its allocations grew by more than the threshold.
+/// The exit status is 1 if anything regressed.
+#include <lcc/context.hh>
+#include <lcc/file.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/mem_report.hh>
+#include <lcc/opt/opt.hh>
+#include <lcc/target.hh>
+#include <lcc/time_report.hh>
+#include <lcc/utils.hh>
+
+#include <glint/driver.hh>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace lcc;
+
+/// Time regressions in phases that take less than this many milliseconds
+/// in the baseline are ignored, as they are mostly noise.
+constexpr double MinMilliseconds = 0.05;
+
+/// The default inputs.
+constexpr std::string_view DefaultInputs[]{
+    "examples/glint",
+    "tst/ir",
+    "tst/opt",
+};
+
+struct Config {
+    usz runs = 5;
+    int optimisation = 0;
+    double threshold = 10;
+    std::string csv_path{};
+    std::string json_path{};
+    std::string baseline_path{};
+    std::vector<std::string> paths{};
+};
+
+/// How a phase of compiling one input performed.
+struct PhaseResult {
+    std::string phase;
+    double median_ms{};
+    double mad_ms{};
+    usz allocated_bytes{};
+};
+
+struct InputResult {
+    std::string path;
+    std::vector<PhaseResult> phases{};
+};
+
+/// The measurements of a single run.
+struct Run {
+    std::vector<std::pair<std::string, double>> times{};
+    std::vector<std::pair<std::string, usz>> allocated_bytes{};
+};
+
+[[noreturn]] void Usage(std::string_view error) {
+    fmt::print(stderr, "{}\n", error);
+    fmt::print(
+        stderr,
+        "USAGE: compile-perf-bench [-n RUNS] [-O LEVEL] [--csv FILE] [--json FILE]\n"
+        "                          [--baseline FILE] [--threshold PERCENT] [<path>...]\n"
+    );
+    std::exit(2);
+}
+
+template <typename Number>
+auto ParseNumber(std::string_view str) -> Number {
+    Number n{};
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), n);
+    if (ec != std::errc() or ptr != str.data() + str.size())
+        Usage(fmt::format("Invalid number {}", str));
+    return n;
+}
+
+auto ParseArgs(int argc, const char** argv) -> Config {
+    Config cfg{};
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        auto Next = [&]() -> std::string_view {
+            if (i + 1 >= argc) Usage(fmt::format("Expected argument after {}", arg));
+            return argv[++i];
+        };
+
+        if (arg == "-n") {
+            cfg.runs = ParseNumber<usz>(Next());
+            if (not cfg.runs) Usage("Need at least one run");
+        } else if (arg == "-O") cfg.optimisation = ParseNumber<int>(Next());
+        else if (arg == "--csv") cfg.csv_path = Next();
+        else if (arg == "--json") cfg.json_path = Next();
+        else if (arg == "--baseline") cfg.baseline_path = Next();
+        else if (arg == "--threshold") cfg.threshold = ParseNumber<double>(Next());
+        else if (arg.starts_with("-")) Usage(fmt::format("Unknown option {}", arg));
+        else cfg.paths.emplace_back(arg);
+    }
+
+    if (cfg.paths.empty())
+        for (auto p : DefaultInputs) cfg.paths.emplace_back(p);
+    return cfg;
+}
+
+/// Collect the inputs among the given paths, in a stable order.
+auto CollectInputs(const std::vector<std::string>& paths) -> std::vector<std::string> {
+    auto IsInput = [](const fs::path& p) {
+        return p.extension() == ".g" or p.extension() == ".lcc";
+    };
+
+    std::vector<std::string> inputs{};
+    for (auto& path : paths) {
+        std::error_code ec;
+        if (fs::is_directory(path, ec)) {
+            std::vector<std::string> found{};
+            for (auto& entry : fs::recursive_directory_iterator{path, ec})
+                if (entry.is_regular_file() and IsInput(entry.path()))
+                    found.push_back(entry.path().lexically_normal().string());
+            rgs::sort(found);
+            inputs.insert(inputs.end(), found.begin(), found.end());
+        } else if (fs::is_regular_file(path, ec)) {
+            inputs.push_back(fs::path{path}.lexically_normal().string());
+        } else {
+            fmt::print(stderr, "Skipping {}: not a file or directory\n", path);
+        }
+    }
+    return inputs;
+}
+
+/// Compile an input once in a fresh context.
+auto Compile(const Config& cfg, const std::string& path, const std::vector<char>& source, bool measure_memory) -> std::optional<Run> {
+    Context context{
+        Target::x86_64_linux,
+        Format::gnu_as_att_assembly,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR,
+            1,
+            Context::GraphColouringAllocator,
+            Context::DoNotUseFunctionSections,
+            Context::DoNotUseDataSections,
+            Context::ReportTime,
+            Context::DoNotRecordTrace,
+            measure_memory ? Context::ReportMemory : Context::DoNotReportMemory //
+        }
+    };
+
+    context.add_include_directory(".");
+    if (auto dir = fs::path{path}.parent_path(); not dir.empty())
+        context.add_include_directory(dir.string());
+    auto& file = context.create_file(path, source);
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Module> module{};
+    if (path.ends_with(".lcc")) module = Module::Parse(&context, file);
+    else module.reset(glint::produce_module(&context, file));
+    if (not module or context.has_error()) return std::nullopt;
+
+    if (cfg.optimisation) opt::Optimise(module.get(), cfg.optimisation);
+    else opt::RunPasses(module.get(), "inline");
+    module->lower();
+    module->emit("/dev/null");
+    if (context.has_error()) return std::nullopt;
+    auto end = std::chrono::steady_clock::now();
+
+    Run run{};
+    run.times.emplace_back("total", std::chrono::duration<double, std::milli>(end - start).count());
+    for (auto& [phase, time] : context.time_report()->times())
+        run.times.emplace_back(phase, std::chrono::duration<double, std::milli>(time).count());
+    if (auto* mem = context.mem_report()) run.allocated_bytes = mem->allocated_bytes();
+    return run;
+}
+
+auto Median(std::vector<double> values) -> double {
+    if (values.empty()) return 0;
+    rgs::sort(values);
+    auto mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+/// Compute the median absolute deviation of some values from their median.
+auto MAD(const std::vector<double>& values, double median) -> double {
+    std::vector<double> deviations{};
+    for (auto v : values) deviations.push_back(std::abs(v - median));
+    return Median(std::move(deviations));
+}
+
+/// Compile an input as often as requested and summarise the results.
+auto Measure(const Config& cfg, const std::string& path) -> std::optional<InputResult> {
+    auto source = File::Read(path);
+
+    /// Phases in the order in which they first appear.
+    std::vector<std::pair<std::string, std::vector<double>>> samples{};
+    for (usz i = 0; i < cfg.runs; i++) {
+        auto run = Compile(cfg, path, source, false);
+        if (not run) return std::nullopt;
+        for (auto& [phase, ms] : run->times) {
+            auto it = rgs::find(samples, phase, &decltype(samples)::value_type::first);
+            if (it == samples.end()) it = samples.emplace(samples.end(), phase, std::vector<double>{});
+            it->second.push_back(ms);
+        }
+    }
+
+    auto memory_run = Compile(cfg, path, source, true);
+    if (not memory_run) return std::nullopt;
+
+    InputResult result{path};
+    for (auto& [phase, values] : samples) {
+        auto median = Median(values);
+        auto& p = result.phases.emplace_back(phase, median, MAD(values, median));
+        auto bytes = rgs::find(memory_run->allocated_bytes, phase, &decltype(memory_run->allocated_bytes)::value_type::first);
+        if (bytes != memory_run->allocated_bytes.end()) p.allocated_bytes = bytes->second;
+    }
+
+    /// Every allocation happens in some phase, so the total is the sum of
+    /// the top-level phases.
+    for (auto& [phase, bytes] : memory_run->allocated_bytes)
+        if (phase.find('/') == std::string::npos) result.phases.front().allocated_bytes += bytes;
+    return result;
+}
+
+auto FormatCSV(const std::vector<InputResult>& results) -> std::string {
+    std::string out = "file,phase,median_ms,mad_ms,allocated_bytes\n";
+    for (auto& r : results)
+        for (auto& p : r.phases)
+            out += fmt::format("{},{},{:.4f},{:.4f},{}\n", r.path, p.phase, p.median_ms, p.mad_ms, p.allocated_bytes);
+    return out;
+}
+
+auto FormatJSON(const Config& cfg, const std::vector<InputResult>& results) -> std::string {
+    std::vector<std::string> files{};
+    for (auto& r : results) {
+        std::vector<std::string> phases{};
+        for (auto& p : r.phases) {
+            phases.push_back(fmt::format(
+                R"({{"phase":"{}","median_ms":{:.4f},"mad_ms":{:.4f},"allocated_bytes":{}}})",
+                utils::EscapeJSON(p.phase),
+                p.median_ms,
+                p.mad_ms,
+                p.allocated_bytes
+            ));
+        }
+        files.push_back(fmt::format(
+            R"({{"file":"{}","phases":[{}]}})",
+            utils::EscapeJSON(r.path),
+            fmt::join(phases, ",")
+        ));
+    }
+    return fmt::format(
+        R"({{"runs":{},"optimisation":{},"files":[{}]}})",
+        cfg.runs,
+        cfg.optimisation,
+        fmt::join(files, ",")
+    );
+}
+
+/// Results of an earlier run, by file and phase.
+using Baseline = std::map<std::pair<std::string, std::string>, PhaseResult>;
+
+/// Read a CSV file written by --csv.
+auto ReadBaseline(const std::string& path) -> Baseline {
+    auto contents = File::Read(path);
+    std::string_view text{contents.data(), contents.size()};
+
+    Baseline baseline{};
+    bool header = true;
+    for (auto line : text | vws::split('\n')) {
+        std::string_view l{line.begin(), line.end()};
+        if (l.empty()) continue;
+        if (std::exchange(header, false)) continue;
+
+        std::vector<std::string_view> fields{};
+        for (auto f : l | vws::split(',')) fields.emplace_back(f.begin(), f.end());
+        if (fields.size() != 5) Usage(fmt::format("Malformed line in baseline {}: {}", path, l));
+
+        baseline[{std::string{fields[0]}, std::string{fields[1]}}] = PhaseResult{
+            std::string{fields[1]},
+            ParseNumber<double>(fields[2]),
+            ParseNumber<double>(fields[3]),
+            ParseNumber<usz>(fields[4]),
+        };
+    }
+    return baseline;
+}
+
+auto Percent(double now, double before) -> double {
+    return before > 0 ? 100 * (now - before) / before : 0;
+}
+
+/// Print the results, compared against the baseline if there is one, and
+/// return whether anything regressed.
+auto Report(const Config& cfg, const std::vector<InputResult>& results, const Baseline* baseline) -> bool {
+    bool regressed = false;
+    for (auto& r : results) {
+        fmt::print("{}:\n", r.path);
+        fmt::print(
+            "  {:>10} {:>9} {:>14}{}  {}\n",
+            "median ms",
+            "MAD",
+            "alloc bytes",
+            baseline ? fmt::format(" {:>8} {:>8}", "time", "alloc") : "",
+            "phase"
+        );
+
+        for (auto& p : r.phases) {
+            std::string comparison{};
+            std::string_view flag{};
+            if (baseline) {
+                auto it = baseline->find({r.path, p.phase});
+                if (it == baseline->end()) {
+                    comparison = fmt::format(" {:>8} {:>8}", "new", "new");
+                } else {
+                    auto& b = it->second;
+                    auto limit = 1 + cfg.threshold / 100;
+                    bool slower = b.median_ms >= MinMilliseconds
+                              and p.median_ms > b.median_ms * limit
+                              and p.median_ms - b.median_ms > 3 * std::max(p.mad_ms, b.mad_ms);
+                    bool bigger = b.allocated_bytes and double(p.allocated_bytes) > double(b.allocated_bytes) * limit;
+                    if (slower or bigger) {
+                        regressed = true;
+                        flag = "  (!)";
+                    }
+
+                    comparison = fmt::format(
+                        " {:>+7.1f}% {:>+7.1f}%",
+                        Percent(p.median_ms, b.median_ms),
+                        Percent(double(p.allocated_bytes), double(b.allocated_bytes))
+                    );
+                }
+            }
+
+            auto depth = usz(rgs::count(p.phase, '/'));
+            fmt::print(
+                "  {:>10.3f} {:>9.3f} {:>14}{}  {:{}}{}{}\n",
+                p.median_ms,
+                p.mad_ms,
+                p.allocated_bytes,
+                comparison,
+                "",
+                2 * depth,
+                p.phase.substr(p.phase.rfind('/') + 1),
+                flag
+            );
+        }
+        fmt::print("\n");
+    }
+    return regressed;
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    auto cfg = ParseArgs(argc, argv);
+    auto inputs = CollectInputs(cfg.paths);
+    if (inputs.empty()) Usage("No inputs");
+
+    std::optional<Baseline> baseline{};
+    if (not cfg.baseline_path.empty()) baseline = ReadBaseline(cfg.baseline_path);
+
+    std::vector<InputResult> results{};
+    for (auto& input : inputs) {
+        auto result = Measure(cfg, input);
+        if (not result) {
+            fmt::print(stderr, "Skipping {}: failed to compile\n", input);
+            continue;
+        }
+        results.push_back(std::move(*result));
+    }
+
+    if (not cfg.csv_path.empty()) {
+        auto csv = FormatCSV(results);
+        File::WriteOrTerminate(csv.data(), csv.size(), cfg.csv_path);
+    }
+
+    if (not cfg.json_path.empty()) {
+        auto json = FormatJSON(cfg, results);
+        File::WriteOrTerminate(json.data(), json.size(), cfg.json_path);
+    }
+
+    bool regressed = Report(cfg, results, baseline ? &*baseline : nullptr);
+    if (regressed) fmt::print("Regressions above {}% are marked with (!)\n", cfg.threshold);
+    return regressed ? 1 : 0;
+}
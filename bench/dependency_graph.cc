@@ -0,0 +1,101 @@
+/// Measure the time it takes to order a dependency graph.
+///
+/// USAGE: depgraph-bench [ENTITIES] [REPETITIONS]
+///
+/// This builds a few shapes of dependency graph with ENTITIES entities
+/// each and resolves the order of each REPETITIONS times, measuring
+/// building the graph and resolving it separately.
+///
+/// The shapes are a single chain in which every entity depends on the
+/// next one, which is as deep as a graph can get; a wide graph in which
+/// every entity depends on a few picked at random from those after it;
+/// and a chain that closes into a cycle at the end.
+#include <lcc/utils.hh>
+#include <lcc/utils/dependency_graph.hh>
+
+#include <bench.hh>
+
+#include <chrono>
+#include <fmt/format.h>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+struct Entity {};
+
+/// Generate the edges of a graph in which entity `i` depends on the
+/// entities returned by `dependencies(i)`.
+auto GenerateEdges(usz entities, auto dependencies) -> std::vector<std::pair<usz, usz>> {
+    std::vector<std::pair<usz, usz>> edges{};
+    for (usz i = 0; i < entities; i++)
+        for (auto dep : dependencies(i)) edges.emplace_back(i, dep);
+    return edges;
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz entities = argc > 1 ? ParseCount(argv[1]) : 100'000;
+    usz repetitions = argc > 2 ? ParseCount(argv[2]) : 10;
+    if (entities < 2) entities = 2;
+    std::vector<Entity> storage(entities);
+
+    /// Use a fixed seed so the graph is the same every time.
+    u64 state = 0x2545f4914f6cdd1d;
+    auto Random = [&] {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    };
+
+    std::pair<std::string_view, std::vector<std::pair<usz, usz>>> shapes[]{
+        {"chain", GenerateEdges(entities, [&](usz i) {
+             std::vector<usz> deps{};
+             if (i + 1 < entities) deps.push_back(i + 1);
+             return deps;
+         })},
+        {"random", GenerateEdges(entities, [&](usz i) {
+             std::vector<usz> deps{};
+             for (usz k = 0; k < 4 and i + 1 < entities; k++)
+                 deps.push_back(i + 1 + usz(Random() % (entities - i - 1)));
+             return deps;
+         })},
+        {"cycle", GenerateEdges(entities, [&](usz i) {
+             return std::vector<usz>{(i + 1) % entities};
+         })},
+    };
+
+    fmt::print("{} entities per graph\n", entities);
+    fmt::print("{:<12} {:>12} {:>14}\n", "shape", "build (ms)", "resolve (ms)");
+    for (auto& [name, edges] : shapes) {
+        double build = 0, resolve = 0;
+        for (usz i = 0; i < repetitions; i++) {
+            auto start = std::chrono::steady_clock::now();
+            DependencyGraph<Entity> graph{};
+            for (auto [from, to] : edges) graph.add_dependency(&storage[from], &storage[to]);
+            auto built = std::chrono::steady_clock::now();
+            auto result = graph.get_resolved_order();
+            auto end = std::chrono::steady_clock::now();
+
+            bool cycle = result.kind == DependencyGraph<Entity>::Result::Kind::Cycle;
+            if (cycle != (name == "cycle") or (not cycle and result.order.size() != entities)) {
+                fmt::print(stderr, "Wrong result for {}\n", name);
+                return 1;
+            }
+
+            build += std::chrono::duration<double, std::milli>(built - start).count();
+            resolve += std::chrono::duration<double, std::milli>(end - built).count();
+        }
+
+        fmt::print(
+            "{:<12} {:>12.3f} {:>14.3f}\n",
+            name,
+            build / double(repetitions),
+            resolve / double(repetitions)
+        );
+    }
+}
@@ -0,0 +1,130 @@
+/// Measure the time it takes to build dominator trees.
+///
+/// USAGE: domtree-bench [BLOCKS] [REPETITIONS]
+///
+/// This generates a module with one function of BLOCKS blocks for each
+/// of a few shapes of control flow graph, and then builds the dominator
+/// tree of each function REPETITIONS times, both on its own and along
+/// with the dominance frontiers.
+///
+/// The shapes are a chain of blocks, a chain of diamonds, a chain of
+/// loops nested 16 deep, and a graph in which every block also branches
+/// to a block picked at random, forwards or backwards.
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/domtree.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <bench.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+/// Generate a function whose block `i` branches to the blocks returned
+/// by `successors(i)`; the last block returns. Conditional branches all
+/// test the same value, which is computed in the entry block.
+auto GenerateFunction(std::string_view name, usz blocks, auto successors) -> std::string {
+    std::string ir = fmt::format("{} : void(i64 %0):\n", name);
+    for (usz i = 0; i < blocks; i++) {
+        ir += fmt::format("  bb{}:\n", i);
+        if (i == 0) ir += "    %1 = eq i64 %0, 0\n";
+        if (i == blocks - 1) {
+            ir += "    return\n";
+            continue;
+        }
+
+        auto [then, otherwise] = successors(i);
+        if (then == otherwise) ir += fmt::format("    branch to %bb{}\n", then);
+        else ir += fmt::format("    branch on %1 to %bb{} else %bb{}\n", then, otherwise);
+    }
+    return ir;
+}
+
+auto GenerateModule(usz blocks) -> std::string {
+    std::string ir{};
+
+    ir += GenerateFunction("chain", blocks, [](usz i) {
+        return std::pair{i + 1, i + 1};
+    });
+
+    /// Every third block is the join of the two blocks before it.
+    ir += GenerateFunction("diamonds", blocks, [&](usz i) {
+        switch (i % 3) {
+            case 0: return std::pair{i + 1, std::min(i + 2, blocks - 1)};
+            case 1: return std::pair{std::min(i + 2, blocks - 1), std::min(i + 2, blocks - 1)};
+            default: return std::pair{i + 1, i + 1};
+        }
+    });
+
+    /// In each nest, the first half of the blocks are loop headers, and
+    /// the second half branch back to them, innermost loop first. Don’t
+    /// nest them any deeper: the size of the dominance frontiers grows
+    /// quadratically with the depth.
+    static constexpr usz depth = 16;
+    ir += GenerateFunction("nested", blocks, [&](usz i) {
+        auto k = i % (2 * depth);
+        if (k < depth) return std::pair{i + 1, i + 1};
+        return std::pair{i - k + 2 * depth - 1 - k, i + 1};
+    });
+
+    /// Use a fixed seed so the graph is the same every time.
+    u64 state = 0x2545f4914f6cdd1d;
+    ir += GenerateFunction("random", blocks, [&](usz i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return std::pair{i + 1, usz(state % blocks)};
+    });
+
+    return ir;
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz blocks = argc > 1 ? ParseCount(argv[1]) : 20'000;
+    usz repetitions = argc > 2 ? ParseCount(argv[2]) : 10;
+    if (blocks < 2) blocks = 2;
+
+    Context context{
+        Target::x86_64_linux,
+        Format::gnu_as_att_assembly,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR //
+        }
+    };
+
+    auto module = Module::Parse(&context, GenerateModule(blocks));
+    if (not module or context.has_error()) return 1;
+
+    fmt::print("{} blocks per function\n", blocks);
+    fmt::print("{:<12} {:>12} {:>16}\n", "shape", "tree (ms)", "frontiers (ms)");
+    for (auto* f : module->code()) {
+        auto Time = [&](bool compute_dominance_frontiers) {
+            double milliseconds = 0;
+            for (usz i = 0; i < repetitions; i++) {
+                auto start = std::chrono::steady_clock::now();
+                DomTree dom_tree{f, compute_dominance_frontiers};
+                auto end = std::chrono::steady_clock::now();
+                milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+            }
+            return milliseconds / double(repetitions);
+        };
+
+        fmt::print("{:<12} {:>12.3f} {:>16.3f}\n", f->names().at(0).name, Time(false), Time(true));
+    }
+}
@@ -0,0 +1,58 @@
+/// Measure the throughput of x86_64 machine code encoding.
+///
+/// USAGE: encode-bench [FUNCTIONS] [LENGTH] [REPETITIONS]
+///
+/// This selects instructions and allocates registers for a module
+/// generated by bench::GenerateModule() that also loads through a
+/// pointer, and then encodes the whole module into an object
+/// REPETITIONS times. Only operations the object file emitter knows
+/// how to encode are used.
+#include <lcc/codegen/mir.hh>
+#include <lcc/codegen/x86_64/object.hh>
+#include <lcc/codegen/x86_64/x86_64.hh>
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/utils.hh>
+
+#include <bench.hh>
+
+#include <fmt/format.h>
+#include <string_view>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+constexpr std::string_view Operations[]{"add", "sub", "and"};
+constexpr std::string_view ImmediateOperations[]{"sub"};
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz functions = argc > 1 ? ParseCount(argv[1]) : 1000;
+    usz length = argc > 2 ? ParseCount(argv[2]) : 200;
+    usz repetitions = argc > 3 ? ParseCount(argv[3]) : 10;
+
+    ModuleShape shape{
+        .operations = Operations,
+        .immediate_operations = ImmediateOperations,
+        .load_through_pointer = true,
+    };
+
+    auto context = CreateContext(Format::elf_object);
+    auto module = Module::Parse(context.get(), GenerateModule(functions, length, shape));
+    if (not module or context->has_error()) return 1;
+
+    auto desc = x86_64::machine_description(context.get());
+    auto machine_ir = AllocatedMIR(module.get(), desc);
+    auto instructions = InstructionCount(machine_ir);
+
+    usz bytes = 0;
+    auto milliseconds = Time(repetitions, [&] {
+        auto object = x86_64::emit_mcode_gobj(module.get(), desc, machine_ir);
+        bytes = object.section(".text").contents().size();
+    });
+
+    fmt::print("{} functions, {} instructions, {} bytes of code\n", machine_ir.size(), instructions, bytes);
+    fmt::print("{:.3f} ms per repetition, {:.2f} Minstructions/s\n", milliseconds, double(instructions) / milliseconds / 1e3);
+}
@@ -0,0 +1,131 @@
+/// Measure what it costs to iterate through a Generator rather than
+/// with a hand-written loop.
+///
+/// USAGE: generator-bench [ELEMENTS] [REPETITIONS]
+///
+/// This iterates over ELEMENTS integers in total, split into ranges of
+/// a few different lengths, each of which is produced by a generator of
+/// its own, and compares that to a plain loop over the same ranges; the
+/// difference per range is mostly the cost of creating, resuming, and
+/// destroying a coroutine, and the difference per element that of
+/// resuming one. It then does the same for visiting the successors of
+/// every block of a function with ELEMENTS blocks, through
+/// Block::successors() and by looking at the terminator directly.
+///
+/// Every measurement is the average over REPETITIONS runs.
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/ir.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+#include <lcc/utils/generator.hh>
+
+#include <bench.hh>
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+auto Range(usz n) -> Generator<usz> {
+    for (usz i = 0; i < n; i++) co_yield i;
+}
+
+/// A function in which every block branches conditionally to the next
+/// one and to the one after that; the last block returns.
+auto GenerateModule(usz blocks) -> std::string {
+    std::string ir = "f : void(i64 %0):\n";
+    for (usz i = 0; i < blocks; i++) {
+        ir += fmt::format("  bb{}:\n", i);
+        if (i == 0) ir += "    %1 = eq i64 %0, 0\n";
+        if (i == blocks - 1) ir += "    return\n";
+        else ir += fmt::format("    branch on %1 to %bb{} else %bb{}\n", i + 1, std::min(i + 2, blocks - 1));
+    }
+    return ir;
+}
+
+void PrintRow(std::string_view name, double generator, double loop) {
+    fmt::print("{:<20} {:>16.3f} {:>12.3f} {:>10.2f}x\n", name, generator, loop, generator / loop);
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz elements = argc > 1 ? ParseCount(argv[1]) : 10'000'000;
+    usz repetitions = argc > 2 ? ParseCount(argv[2]) : 10;
+    if (elements < 2) elements = 2;
+
+    fmt::print("{} elements\n", elements);
+    fmt::print("{:<20} {:>16} {:>12} {:>11}\n", "case", "generator (ms)", "loop (ms)", "ratio");
+
+    for (usz length : {1uz, 4uz, 64uz, 4096uz}) {
+        auto ranges = elements / length;
+        auto generator = Time(repetitions, [&] {
+            usz sum = 0;
+            for (usz r = 0; r < ranges; r++)
+                for (auto i : Range(length)) {
+                    Opaque(i);
+                    sum += i;
+                }
+            return sum;
+        });
+
+        auto loop = Time(repetitions, [&] {
+            usz sum = 0;
+            for (usz r = 0; r < ranges; r++)
+                for (usz i = 0; i < length; i++) {
+                    auto value = i;
+                    Opaque(value);
+                    sum += value;
+                }
+            return sum;
+        });
+
+        PrintRow(fmt::format("range of {}", length), generator, loop);
+    }
+
+    Context context{
+        Target::x86_64_linux,
+        Format::gnu_as_att_assembly,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR //
+        }
+    };
+
+    auto module = Module::Parse(&context, GenerateModule(elements));
+    if (not module or context.has_error()) return 1;
+    auto* f = module->code().front();
+
+    auto generator = Time(repetitions, [&] {
+        usz count = 0;
+        for (auto* b : f->blocks())
+            for (auto* s : b->successors()) count += usz(s != b);
+        return count;
+    });
+
+    auto loop = Time(repetitions, [&] {
+        usz count = 0;
+        for (auto* b : f->blocks()) {
+            if (not b->closed()) continue;
+            auto* t = b->terminator();
+            if (auto* br = cast<BranchInst>(t)) {
+                count += usz(br->target() != b);
+            } else if (auto* cond = cast<CondBranchInst>(t)) {
+                count += usz(cond->then_block() != b);
+                if (cond->else_block() != cond->then_block()) count += usz(cond->else_block() != b);
+            }
+        }
+        return count;
+    });
+
+    PrintRow("block successors", generator, loop);
+}
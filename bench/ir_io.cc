@@ -0,0 +1,96 @@
+/// Measure the time it takes to load and store IR as text and as bitcode.
+///
+/// USAGE: ir-io-bench [FUNCTIONS] [REPETITIONS] [JOBS]
+///
+/// This generates a module with FUNCTIONS functions, each of which does
+/// a bit of arithmetic through a stack slot, branches, and calls the
+/// function before it, and then parses and prints that module as text
+/// and as bitcode REPETITIONS times each. Text is parsed on JOBS threads.
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <bench.hh>
+
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+auto GenerateModule(usz functions) -> std::string {
+    std::string ir{};
+    for (usz i = 0; i < functions; i++) {
+        ir += fmt::format("f{} : i64(i64 %0):\n", i);
+        ir += "  bb0:\n";
+        ir += "    %1 = alloca i64\n";
+        ir += "    store i64 %0 into %1\n";
+        ir += "    %2 = load i64 from %1\n";
+        ir += fmt::format("    %3 = add i64 %2, {}\n", i);
+        ir += "    %4 = mul i64 %3, %0\n";
+        ir += "    %5 = eq i64 %4, 0\n";
+        ir += "    branch on %5 to %bb1 else %bb2\n";
+        ir += "  bb1:\n";
+        ir += "    return i64 %3\n";
+        ir += "  bb2:\n";
+        if (i == 0) ir += "    %6 = sub i64 %4, 1\n";
+        else ir += fmt::format("    %6 = call @f{}(i64 %4) -> i64\n", i - 1);
+        ir += "    %7 = xor i64 %6, %2\n";
+        ir += "    return i64 %7\n";
+    }
+    return ir;
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz functions = argc > 1 ? ParseCount(argv[1]) : 20'000;
+    usz repetitions = argc > 2 ? ParseCount(argv[2]) : 10;
+    usz jobs = argc > 3 ? ParseCount(argv[3]) : 1;
+
+    Context context{
+        Target::x86_64_linux,
+        Format::gnu_as_att_assembly,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR,
+            jobs,
+        }
+    };
+
+    auto module = Module::Parse(&context, GenerateModule(functions));
+    if (not module or context.has_error()) return 1;
+
+    /// Print the module once so both formats load the same input.
+    auto text = module->ir_string(false);
+    auto bitcode = module->bitcode();
+    std::string_view data{bitcode.data(), bitcode.size()};
+    if (not Module::IsBitcode(data)) return 1;
+
+    auto load_text = Time(repetitions, [&] {
+        auto m = Module::Parse(&context, text);
+        if (not m or context.has_error()) std::exit(1);
+    });
+
+    auto load_bitcode = Time(repetitions, [&] {
+        auto m = Module::ParseBitcode(&context, data);
+        if (not m or context.has_error()) std::exit(1);
+    });
+
+    auto store_text = Time(repetitions, [&] { (void) module->ir_string(false); });
+    auto store_bitcode = Time(repetitions, [&] { (void) module->bitcode(); });
+
+    fmt::print("{} functions, {} jobs\n", functions, jobs);
+    fmt::print("{:<10} {:>12} {:>12} {:>13}\n", "format", "size (B)", "load (ms)", "store (ms)");
+    fmt::print("{:<10} {:>12} {:>12.3f} {:>13.3f}\n", "text", text.size(), load_text, store_text);
+    fmt::print("{:<10} {:>12} {:>12.3f} {:>13.3f}\n", "bitcode", bitcode.size(), load_bitcode, store_bitcode);
+}
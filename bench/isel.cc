@@ -0,0 +1,51 @@
+/// Measure the throughput of instruction selection.
+///
+/// USAGE: isel-bench [FUNCTIONS] [LENGTH] [REPETITIONS]
+///
+/// This lowers a module generated by bench::GenerateModule() that uses
+/// arithmetic, bitwise, and shift operations to MIR, and then selects
+/// instructions for every function REPETITIONS times.
+#include <lcc/codegen/isel.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/utils.hh>
+
+#include <bench.hh>
+
+#include <fmt/format.h>
+#include <string_view>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+constexpr std::string_view Operations[]{"add", "sub", "mul", "and", "or", "shl", "shr", "sar"};
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz functions = argc > 1 ? ParseCount(argv[1]) : 1000;
+    usz length = argc > 2 ? ParseCount(argv[2]) : 200;
+    usz repetitions = argc > 3 ? ParseCount(argv[3]) : 10;
+
+    auto context = CreateContext(Format::gnu_as_att_assembly);
+    auto module = Module::Parse(context.get(), GenerateModule(functions, length, {.operations = Operations}));
+    if (not module or context->has_error()) return 1;
+
+    auto machine_ir = module->mir();
+    auto instructions = InstructionCount(machine_ir);
+
+    // Selection rewrites the MIR in place, so give every repetition a
+    // fresh copy.
+    auto milliseconds = Time(
+        repetitions,
+        [&] { return machine_ir; },
+        [&](auto& copy) {
+            for (auto& function : copy) select_instructions(module.get(), function);
+        }
+    );
+
+    fmt::print("{} functions, {} instructions\n", machine_ir.size(), instructions);
+    fmt::print("{:.3f} ms per repetition, {:.2f} Minstructions/s\n", milliseconds, double(instructions) / milliseconds / 1e3);
+}
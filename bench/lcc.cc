@@ -0,0 +1,419 @@
+/// Measure how the time spent in each phase of compilation grows with
+/// the size of its input.
+///
+/// USAGE: lcc-bench [SCALE] [STEPS] [REPETITIONS]
+///
+/// This generates inputs of a few shapes, each at STEPS sizes that
+/// double every time, starting at SCALE times the size of the smallest
+/// input of that shape. Every phase is timed on its own, REPETITIONS
+/// times, of which the fastest run counts:
+///
+///   - The Glint inputs are lexed, parsed, analysed, and lowered to IR;
+///     the IR inputs are parsed.
+///   - Every optimisation pass is run once, in the order the pipeline
+///     first runs them in, on the unoptimised IR.
+///   - The whole pipeline is run at -O3, after which the result is
+///     lowered, converted to MIR, and has instructions selected and
+///     registers allocated, and is emitted as assembly (to /dev/null).
+///   - The straight-line IR, which sticks to instructions the object
+///     file emitter knows how to encode, is compiled again without
+///     optimisation and encoded into an ELF object.
+///
+/// The shapes are many small functions, deeply nested control flow,
+/// many macros, a function with a large control flow graph, and a large
+/// IR module of straight-line code.
+///
+/// For each phase, the growth is the exponent `k` that best explains
+/// the time spent in it on the two largest inputs as being proportional
+/// to `size^k`. A phase is flagged if it grows faster than ~n log n,
+/// provided it takes long enough for this to not just be noise, and
+/// the exit status is 1 if any phase is flagged.
+#include <lcc/codegen/isel.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/codegen/register_allocation.hh>
+#include <lcc/codegen/x86_64/assembly.hh>
+#include <lcc/codegen/x86_64/object.hh>
+#include <lcc/codegen/x86_64/x86_64.hh>
+#include <lcc/context.hh>
+#include <lcc/file.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/opt/opt.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <glint/ir_gen.hh>
+#include <glint/lexer.hh>
+#include <glint/parser.hh>
+#include <glint/sema.hh>
+
+#include <bench.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+/// Phases that grow faster than this are flagged.
+constexpr double MaxGrowth = 1.3;
+
+/// Phases that take less than this many milliseconds on the largest
+/// input are never flagged.
+constexpr double MinMilliseconds = 10;
+
+/// The passes to time on their own, in the order the pipeline first
+/// runs them in.
+constexpr std::string_view Passes[]{
+    "icmb",
+    "sroa",
+    "sfwd",
+    "ssa",
+    "mfwd",
+    "dse",
+    "sccp",
+    "gvn",
+    "licm",
+    "cfgs",
+    "dce",
+    "gdce",
+    "inline",
+    "tailcall",
+};
+
+/// Generate functions that each call the one before them.
+auto GenerateFunctions(usz functions) -> std::string {
+    std::string source{};
+    for (usz f = 0; f < functions; f++) {
+        source += fmt::format("f{} : int(x:int) {{\n", f);
+        if (f) source += fmt::format("    y :int 1 + f{}(x);\n", f - 1);
+        else source += "    y :int x + 1;\n";
+        source += fmt::format(
+            "    if (y > {}) {{\n"
+            "        y := y - 3;\n"
+            "    }} else {{\n"
+            "        y := y * 2;\n"
+            "    }};\n"
+            "    while (y > 100) {{\n"
+            "        y := y / 2;\n"
+            "    }};\n"
+            "    return y;\n"
+            "}};\n",
+            f % 17
+        );
+    }
+    source += fmt::format("f{} 3;\n", functions - 1);
+    return source;
+}
+
+/// Generate a function with the given number of nested ifs. Parsing
+/// and analysing these recurses for every level, so keep this to a few
+/// hundred levels at most.
+auto GenerateNesting(usz depth) -> std::string {
+    std::string source = "g : int(x:int) {\n    y :int 0;\n";
+    for (usz d = 0; d < depth; d++)
+        source += fmt::format("if (x > {}) {{\n y := y + {};\n", d, d % 7 + 1);
+    for (usz d = 0; d < depth; d++) source += "};\n";
+    source += "    return y;\n};\ng 3;\n";
+    return source;
+}
+
+/// Generate a function that uses every one of the given number of macros.
+auto GenerateMacros(usz macros) -> std::string {
+    std::string source{};
+    for (usz m = 0; m < macros; m++)
+        source += fmt::format("macro m{} $x:token emits $x * 3 + {} endmacro\n", m, m % 13);
+    source += "h : int(x:int) {\n    y :int x;\n";
+    for (usz m = 0; m < macros; m++) source += fmt::format("    y := y + m{} {};\n", m, m % 5 + 1);
+    source += "    return y;\n};\nh 3;\n";
+    return source;
+}
+
+/// Generate a function in which every block keeps a value in a local
+/// up to date and branches to the next block and to a block picked at
+/// random, forwards or backwards.
+auto GenerateCFG(usz blocks) -> std::string {
+    std::string ir = "cfg : i64(i64 %0):\n  bb0:\n";
+    ir += "    %1 = alloca i64\n    store i64 %0 into %1\n    branch to %bb1\n";
+
+    /// Use a fixed seed so the graph is the same every time.
+    u64 state = 0x2545f4914f6cdd1d;
+    usz value = 2;
+    for (usz b = 1; b <= blocks; b++) {
+        ir += fmt::format("  bb{}:\n", b);
+        usz loaded = value++;
+        ir += fmt::format("    %{} = load i64 from %1\n", loaded);
+        if (b == blocks) {
+            ir += fmt::format("    return i64 %{}\n", loaded);
+            continue;
+        }
+
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        usz target = 1 + usz(state % blocks);
+        if (target == b) target = b + 1;
+
+        ir += fmt::format("    %{} = sub i64 %{}, 1\n", value, loaded);
+        ir += fmt::format("    store i64 %{} into %1\n", value++);
+        ir += fmt::format("    %{} = ult i64 %{}, {}\n", value, loaded, b);
+        ir += fmt::format("    branch on %{} to %bb{} else %bb{}\n", value++, target, b + 1);
+    }
+    return ir;
+}
+
+/// Generate functions of straight-line code that keep a value in a
+/// local and combine it with the parameters and with constants. Only
+/// operations the object file emitter knows how to encode are used.
+auto GenerateStraightLine(usz functions) -> std::string {
+    static constexpr std::string_view operations[]{"add", "sub", "and"};
+    static constexpr usz length = 200;
+
+    std::string ir{};
+    for (usz f = 0; f < functions; f++) {
+        ir += fmt::format("s{} : i64(ptr %0, i64 %1):\n  bb0:\n", f);
+        ir += "    %2 = alloca i64\n    store i64 %1 into %2\n";
+        usz value = 3;
+        for (usz i = 0; i < length / 4; i++) {
+            usz loaded = value++;
+            ir += fmt::format("    %{} = load i64 from %2\n", loaded);
+            switch (i % 3) {
+                case 0:
+                    ir += fmt::format("    %{} = sub i64 %{}, {}\n", value, loaded, i % 63 + 1);
+                    break;
+                case 1:
+                    ir += fmt::format("    %{} = {} i64 %{}, %1\n", value, operations[(f + i) % std::size(operations)], loaded);
+                    break;
+                default:
+                    ir += fmt::format("    %{} = load i64 from %0\n", value);
+                    ir += fmt::format("    %{} = add i64 %{}, %{}\n", value + 1, loaded, value);
+                    value++;
+                    break;
+            }
+            ir += fmt::format("    store i64 %{} into %2\n", value++);
+        }
+        ir += fmt::format("    %{} = load i64 from %2\n", value);
+        ir += fmt::format("    return i64 %{}\n", value);
+    }
+    return ir;
+}
+
+struct Shape {
+    std::string_view name;
+    bool glint;
+    bool encodable;
+    usz size;
+    std::string (*generate)(usz);
+};
+
+constexpr Shape Shapes[]{
+    {"functions", true, false, 100, GenerateFunctions},
+    {"nesting", true, false, 25, GenerateNesting},
+    {"macros", true, false, 250, GenerateMacros},
+    {"cfg", false, false, 250, GenerateCFG},
+    {"straight-line", false, true, 25, GenerateStraightLine},
+};
+
+/// Lexes a source to the end.
+class TokenCounter : public glint::Lexer {
+public:
+    TokenCounter(Context* ctx, std::string_view source) : Lexer(ctx, source) {}
+
+    void run() {
+        while (tok.kind != glint::TokenKind::Eof) NextToken();
+    }
+};
+
+/// The fastest time spent in each phase, at each size, in order of
+/// first appearance.
+class Timings {
+    std::vector<std::pair<std::string, std::vector<double>>> phases{};
+    usz step_count;
+
+public:
+    explicit Timings(usz steps) : step_count(steps) {}
+
+    /// Time `f` as the phase `name` at size `step`.
+    template <typename Func>
+    auto time(std::string_view name, usz step, Func&& f) -> decltype(auto) {
+        auto it = rgs::find(phases, name, &decltype(phases)::value_type::first);
+        if (it == phases.end()) {
+            phases.emplace_back(
+                std::string{name},
+                std::vector<double>(step_count, std::numeric_limits<double>::infinity())
+            );
+            it = phases.end() - 1;
+        }
+
+        auto& best = it->second[step];
+        auto start = std::chrono::steady_clock::now();
+        PhaseTimer timer{best, start};
+        return std::forward<Func>(f)();
+    }
+
+    /// Print a table of the timings, and return whether any phase is
+    /// flagged.
+    auto print(const std::vector<usz>& sizes) const -> bool {
+        bool flagged = false;
+        std::string header = fmt::format("{:<16}", "phase (ms)");
+        for (auto s : sizes) header += fmt::format(" {:>10}", fmt::format("n={}", s));
+        fmt::print("{}  growth\n", header);
+
+        for (auto& [name, times] : phases) {
+            std::string line = fmt::format("{:<16}", name);
+            for (auto t : times) line += fmt::format(" {:>10.3f}", t);
+
+            double growth = 0;
+            if (times.size() >= 2) {
+                auto last = times.back();
+                auto prev = times[times.size() - 2];
+                auto ratio = double(sizes.back()) / double(sizes[sizes.size() - 2]);
+                if (prev > 0) growth = std::log(last / prev) / std::log(ratio);
+            }
+
+            bool bad = growth > MaxGrowth and times.back() >= MinMilliseconds;
+            flagged |= bad;
+            fmt::print("{}  {:>6.2f}{}\n", line, growth, bad ? "  (!)" : "");
+        }
+        return flagged;
+    }
+
+private:
+    /// Record the time since `start` when the phase is done, however it
+    /// returns.
+    struct PhaseTimer {
+        double& best;
+        std::chrono::steady_clock::time_point start;
+
+        ~PhaseTimer() {
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+    };
+};
+
+void Fail(const Shape& shape, usz size) {
+    fmt::print(stderr, "Failed to compile the {} input of size {}\n", shape.name, size);
+    std::exit(2);
+}
+
+/// Produce the IR for an input, timing the frontend if `timings` isn’t
+/// null.
+auto Frontend(Context* ctx, const Shape& shape, File& source, Timings* timings, usz step) -> std::unique_ptr<Module> {
+    auto Time = [&](std::string_view name, auto f) -> decltype(auto) {
+        if (timings) return timings->time(name, step, f);
+        return f();
+    };
+
+    if (not shape.glint) return Time("ir parse", [&] { return Module::Parse(ctx, source); });
+
+    Time("lex", [&] { TokenCounter{ctx, {source.data(), source.size()}}.run(); });
+    auto ast = Time("parse", [&] { return glint::Parser::Parse(ctx, source); });
+    if (not ast or ctx->has_error()) return {};
+    Time("sema", [&] { glint::Sema::Analyse(ctx, *ast); });
+    if (ctx->has_error()) return {};
+    return std::unique_ptr<Module>{Time("irgen", [&] { return glint::IRGen::Generate(ctx, *ast); })};
+}
+
+/// Compile an input of a certain size, timing every phase.
+void Compile(Context* ctx, const Shape& shape, usz size, File& source, Timings& timings, usz step) {
+    /// Time the passes on their own on a module of their own.
+    {
+        auto module = Frontend(ctx, shape, source, &timings, step);
+        if (not module) Fail(shape, size);
+        for (auto pass : Passes)
+            timings.time(pass, step, [&] { opt::RunPasses(module.get(), pass); });
+    }
+
+    auto module = Frontend(ctx, shape, source, nullptr, step);
+    if (not module) Fail(shape, size);
+    timings.time("-O3", step, [&] { opt::Optimise(module.get(), 3); });
+    timings.time("lowering", step, [&] { module->lower(); });
+    auto machine_ir = timings.time("mir", step, [&] { return module->mir(); });
+    timings.time("isel", step, [&] {
+        for (auto& function : machine_ir) select_instructions(module.get(), function);
+    });
+
+    auto desc = x86_64::machine_description(ctx);
+    timings.time("ra", step, [&] {
+        for (auto& function : machine_ir) allocate_registers(desc, function);
+    });
+
+    auto copy = machine_ir;
+    timings.time("asm", step, [&] {
+        x86_64::emit_gnu_att_assembly("/dev/null", module.get(), desc, copy);
+    });
+
+    /// Optimisation introduces forms the object file emitter can't encode
+    /// yet, so encode an unoptimised module.
+    if (shape.encodable) {
+        auto unoptimised = Frontend(ctx, shape, source, nullptr, step);
+        if (not unoptimised) Fail(shape, size);
+        unoptimised->lower();
+        auto unoptimised_mir = unoptimised->mir();
+        for (auto& function : unoptimised_mir) {
+            select_instructions(unoptimised.get(), function);
+            allocate_registers(desc, function);
+        }
+        timings.time("encode", step, [&] {
+            (void) x86_64::emit_mcode_gobj(unoptimised.get(), desc, unoptimised_mir);
+        });
+    }
+
+    if (ctx->has_error()) Fail(shape, size);
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz scale = argc > 1 ? ParseCount(argv[1]) : 1;
+    usz steps = argc > 2 ? ParseCount(argv[2]) : 4;
+    usz repetitions = argc > 3 ? ParseCount(argv[3]) : 3;
+    if (steps < 2) steps = 2;
+
+    Context context{
+        Target::x86_64_linux,
+        Format::elf_object,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR //
+        }
+    };
+
+    bool flagged = false;
+    for (auto& shape : Shapes) {
+        Timings timings{steps};
+        std::vector<usz> sizes{};
+        for (usz step = 0; step < steps; step++) {
+            auto size = shape.size * scale << step;
+            auto source = shape.generate(size);
+            auto& file = context.create_file(
+                fmt::format("{}-{}.{}", shape.name, size, shape.glint ? "g" : "lcc"),
+                std::vector<char>{source.begin(), source.end()}
+            );
+            sizes.push_back(size);
+            for (usz i = 0; i < repetitions; i++) Compile(&context, shape, size, file, timings, step);
+        }
+
+        fmt::print("{}:\n", shape.name);
+        flagged |= timings.print(sizes);
+        fmt::print("\n");
+        std::fflush(stdout);
+    }
+
+    return flagged ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+/// Measure the throughput of the Glint lexer.
+///
+/// USAGE: lexer-bench [LINES] [MACROS] [REPETITIONS]
+///
+/// This generates a Glint source of LINES lines that mix keywords,
+/// identifiers, numbers and uses of MACROS macros (each of which takes
+/// an argument and defines a gensym), and lexes it REPETITIONS times.
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <glint/lexer.hh>
+
+#include <bench.hh>
+
+#include <chrono>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+auto GenerateSource(usz lines, usz macros) -> std::string {
+    std::string source{};
+    for (usz m = 0; m < macros; m++)
+        source += fmt::format("macro m{} $x defines tmp emits tmp :: $x + {}; tmp endmacro\n", m, m);
+    for (usz l = 0; l < lines; l++) {
+        source += fmt::format(
+            "if (not value{} and true) result{} := m{} value{} + 0x{:x} else while (cint) return sizeof value{};\n",
+            l,
+            l % 97,
+            l % macros,
+            l % 7,
+            l,
+            l % 13
+        );
+    }
+    return source;
+}
+
+/// Lexes a source to the end, counting tokens.
+class TokenCounter : public glint::Lexer {
+public:
+    TokenCounter(Context* ctx, std::string_view source) : Lexer(ctx, source) {}
+
+    auto count() -> usz {
+        usz count = 0;
+        for (; tok.kind != glint::TokenKind::Eof; NextToken()) count++;
+        return count;
+    }
+};
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz lines = argc > 1 ? ParseCount(argv[1]) : 100'000;
+    usz macros = argc > 2 ? ParseCount(argv[2]) : 500;
+    usz repetitions = argc > 3 ? ParseCount(argv[3]) : 5;
+
+    Context context{
+        Target::x86_64_linux,
+        Format::gnu_as_att_assembly,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR //
+        }
+    };
+
+    auto source = GenerateSource(lines, macros);
+    usz tokens = 0;
+    double seconds = 0;
+    for (usz i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        tokens = TokenCounter{&context, source}.count();
+        auto end = std::chrono::steady_clock::now();
+        seconds += std::chrono::duration<double>(end - start).count();
+    }
+    if (context.has_error()) return 1;
+
+    auto megabytes = double(source.size() * repetitions) / (1024 * 1024);
+    fmt::print("{} bytes, {} tokens, {} macros\n", source.size(), tokens, macros);
+    fmt::print("{:.2f} MB/s, {:.2f} Mtokens/s\n", megabytes / seconds, double(tokens * repetitions) / seconds / 1e6);
+}
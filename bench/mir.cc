@@ -0,0 +1,55 @@
+/// Measure the throughput of lowering IR to MIR.
+///
+/// USAGE: mir-bench [FUNCTIONS] [LENGTH] [REPETITIONS]
+///
+/// This lowers a freshly parsed copy of a module generated by
+/// bench::GenerateModule() whose functions also call each other and
+/// merge values from both sides of a branch with a phi to MIR
+/// REPETITIONS times. Only the lowering is timed.
+#include <lcc/codegen/mir.hh>
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/utils.hh>
+
+#include <bench.hh>
+
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+constexpr std::string_view Operations[]{"add", "sub", "mul", "and", "or", "xor", "shl", "shr"};
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz functions = argc > 1 ? ParseCount(argv[1]) : 1000;
+    usz length = argc > 2 ? ParseCount(argv[2]) : 200;
+    usz repetitions = argc > 3 ? ParseCount(argv[3]) : 10;
+
+    auto context = CreateContext(Format::gnu_as_att_assembly);
+    auto ir = GenerateModule(functions, length, {.operations = Operations, .calls = true, .phi = true});
+
+    auto Parse = [&] {
+        auto module = Module::Parse(context.get(), ir);
+        if (not module or context->has_error()) std::exit(1);
+        return module;
+    };
+
+    // Keep the MIR around until the repetition is over, so that freeing
+    // it is not timed.
+    auto instructions = InstructionCount(Parse()->mir());
+    auto milliseconds = Time(
+        repetitions,
+        [&] { return std::pair{Parse(), std::vector<MFunction>{}}; },
+        [&](auto& input) { input.second = input.first->mir(); }
+    );
+
+    fmt::print("{} functions, {} instructions\n", functions, instructions);
+    fmt::print("{:.3f} ms per repetition, {:.2f} Minstructions/s\n", milliseconds, double(instructions) / milliseconds / 1e3);
+}
@@ -0,0 +1,125 @@
+/// Compare the register allocators on compile time and spill count.
+///
+/// USAGE: regalloc-bench [FUNCTIONS] [MAX WIDTH] [REPETITIONS]
+///
+/// This generates a module of FUNCTIONS functions, each of which keeps
+/// between one and MAX WIDTH values live across a branch, selects
+/// instructions for it, and then allocates registers for it REPETITIONS
+/// times with each allocator.
+#include <lcc/codegen/isel.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/codegen/register_allocation.hh>
+#include <lcc/codegen/x86_64/x86_64.hh>
+#include <lcc/context.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <bench.hh>
+
+#include <chrono>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace lcc;
+using namespace lcc::bench;
+
+/// Generate functions that define `width` values, branch, and then
+/// fold all of them into the second parameter on either side.
+auto GenerateModule(usz functions, usz max_width) -> std::string {
+    std::string ir{};
+    for (usz f = 0; f < functions; f++) {
+        usz width = 1 + f % max_width;
+        usz value = 2;
+        ir += fmt::format("f{} : i64(i64 %0, i64 %1):\n  bb0:\n", f);
+
+        std::vector<usz> values{};
+        for (usz i = 0; i < width; i++) {
+            ir += fmt::format("    %{} = add i64 %0, {}\n", value, i + 1);
+            values.push_back(value++);
+        }
+        ir += fmt::format("    %{} = eq i64 %0, %1\n", value);
+        ir += fmt::format("    branch on %{} to %bb1 else %bb2\n", value++);
+
+        for (auto [block, op] : {std::pair{1, "add"}, std::pair{2, "sub"}}) {
+            ir += fmt::format("  bb{}:\n", block);
+            usz accumulator = 1;
+            for (auto v : values) {
+                ir += fmt::format("    %{} = {} i64 %{}, %{}\n", value, op, accumulator, v);
+                accumulator = value++;
+            }
+            ir += fmt::format("    return i64 %{}\n", accumulator);
+        }
+    }
+    return ir;
+}
+
+struct Result {
+    double milliseconds{};
+    usz spills{};
+};
+
+auto Run(
+    const MachineDescription& desc,
+    const std::vector<MFunction>& functions,
+    usz repetitions,
+    auto allocate
+) -> Result {
+    Result result{};
+    for (usz i = 0; i < repetitions; i++) {
+        auto copy = functions;
+        auto start = std::chrono::steady_clock::now();
+        usz spills = 0;
+        for (auto& function : copy) spills += allocate(desc, function).spills;
+        auto end = std::chrono::steady_clock::now();
+        result.milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+        result.spills = spills;
+    }
+    result.milliseconds /= double(repetitions);
+    return result;
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    usz functions = argc > 1 ? ParseCount(argv[1]) : 1000;
+    usz max_width = argc > 2 ? ParseCount(argv[2]) : 12;
+    usz repetitions = argc > 3 ? ParseCount(argv[3]) : 10;
+
+    Context context{
+        Target::x86_64_linux,
+        Format::gnu_as_att_assembly,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::DoNotStopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR //
+        }
+    };
+
+    auto module = Module::Parse(&context, GenerateModule(functions, max_width));
+    if (not module or context.has_error()) return 1;
+
+    auto machine_ir = module->mir();
+    for (auto& function : machine_ir) select_instructions(module.get(), function);
+
+    usz instructions = 0;
+    for (auto& function : machine_ir)
+        for (auto& block : function.blocks())
+            instructions += block.instructions().size();
+
+    auto desc = x86_64::machine_description(&context);
+    auto graph = Run(desc, machine_ir, repetitions, allocate_registers);
+    auto linear = Run(desc, machine_ir, repetitions, allocate_registers_linear_scan);
+
+    fmt::print("{} functions, {} instructions, {} registers\n", machine_ir.size(), instructions, desc.registers.size());
+    fmt::print("{:<16} {:>12} {:>8}\n", "allocator", "time (ms)", "spills");
+    fmt::print("{:<16} {:>12.3f} {:>8}\n", "graph colouring", graph.milliseconds, graph.spills);
+    fmt::print("{:<16} {:>12.3f} {:>8}\n", "linear scan", linear.milliseconds, linear.spills);
+}
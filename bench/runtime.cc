@@ -0,0 +1,291 @@
+/// Measure how fast the code the x86_64 backend generates runs, and how
+/// far it is from what LLVM makes of the same programs.
+///
+/// USAGE: runtime-bench [--lcc PATH] [--clang PATH] [--cc PATH] [-n RUNS] [<program.g>...]
+///
+/// Every program (by default, the ones in bench/runtime) is compiled by
+/// LCC at -O0 through -O3 and linked with `cc`; as a reference, it is
+/// also emitted as LLVM IR (`-f llvm`) and compiled by `clang -O2`. Each
+/// executable is run RUNS times (default 5), counting the cycles and
+/// instructions it spends in user space with the perf counters, and the
+/// run with the fewest cycles counts. If perf counters are unavailable,
+/// e.g. because of `perf_event_paranoid`, only wall time is reported.
+///
+/// The programs return a checksum of what they computed; every build
+/// of a program must return the same one. The exit status is 1 if any
+/// build failed or disagreed with the others.
+///
+/// This only works on Linux.
+#include <lcc/utils.hh>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <linux/perf_event.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using namespace lcc;
+
+struct Config {
+    std::string lcc = LCC_RUNTIME_BENCH_LCC;
+    std::string clang = "clang";
+    std::string cc = "cc";
+    usz runs = 5;
+    std::vector<std::string> programs{};
+};
+
+/// A way of building a program.
+struct Build {
+    std::string_view name;
+
+    /// Optimisation level to pass to LCC, or -1 to go through LLVM.
+    int optimisation;
+};
+
+constexpr Build Builds[]{
+    {"lcc -O0", 0},
+    {"lcc -O1", 1},
+    {"lcc -O2", 2},
+    {"lcc -O3", 3},
+    {"clang -O2", -1},
+};
+
+/// The result of running a process.
+struct Process {
+    /// Exit code, or -1 if the process did not exit normally.
+    int status = -1;
+    double ms{};
+    std::optional<u64> cycles{};
+    std::optional<u64> instructions{};
+};
+
+[[noreturn]] void Usage(std::string_view error) {
+    fmt::print(stderr, "{}\n", error);
+    fmt::print(stderr, "USAGE: runtime-bench [--lcc PATH] [--clang PATH] [--cc PATH] [-n RUNS] [<program.g>...]\n");
+    std::exit(2);
+}
+
+auto ParseArgs(int argc, const char** argv) -> Config {
+    Config cfg{};
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        auto Next = [&]() -> std::string_view {
+            if (i + 1 >= argc) Usage(fmt::format("Expected argument after {}", arg));
+            return argv[++i];
+        };
+
+        if (arg == "--lcc") cfg.lcc = Next();
+        else if (arg == "--clang") cfg.clang = Next();
+        else if (arg == "--cc") cfg.cc = Next();
+        else if (arg == "-n") {
+            auto str = Next();
+            auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), cfg.runs);
+            if (ec != std::errc() or ptr != str.data() + str.size() or not cfg.runs)
+                Usage(fmt::format("Invalid number of runs {}", str));
+        } else if (arg.starts_with("-")) Usage(fmt::format("Unknown option {}", arg));
+        else cfg.programs.emplace_back(arg);
+    }
+
+    if (cfg.programs.empty()) {
+        for (auto& entry : fs::directory_iterator{LCC_RUNTIME_BENCH_PROGRAMS})
+            if (entry.path().extension() == ".g")
+                cfg.programs.push_back(entry.path().string());
+        rgs::sort(cfg.programs);
+    }
+    return cfg;
+}
+
+/// Open a counter for a hardware event in the process `pid`, which is
+/// enabled once that process calls exec().
+auto OpenCounter(pid_t pid, u64 config) -> int {
+    perf_event_attr attr{};
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return int(syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0));
+}
+
+auto ReadCounter(int fd) -> std::optional<u64> {
+    if (fd < 0) return std::nullopt;
+    u64 value{};
+    auto n = read(fd, &value, sizeof value);
+    close(fd);
+    if (n != sizeof value) return std::nullopt;
+    return value;
+}
+
+/// Run a command and wait for it to finish, counting cycles and
+/// instructions if `count` is true. The output of the command is
+/// discarded unless `quiet` is false.
+auto Run(const std::vector<std::string>& args, bool count, bool quiet = true) -> Process {
+    std::vector<char*> argv{};
+    for (auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    /// The child waits for the parent to attach the counters before it
+    /// calls exec().
+    int go[2];
+    if (pipe(go) != 0) return {};
+
+    auto start = std::chrono::steady_clock::now();
+    auto pid = fork();
+    if (pid < 0) return {};
+    if (pid == 0) {
+        close(go[1]);
+        char c;
+        (void) read(go[0], &c, 1);
+        close(go[0]);
+        if (quiet) {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+        execvp(argv[0], argv.data());
+        std::_Exit(127);
+    }
+
+    close(go[0]);
+    int cycles = count ? OpenCounter(pid, PERF_COUNT_HW_CPU_CYCLES) : -1;
+    int instructions = count ? OpenCounter(pid, PERF_COUNT_HW_INSTRUCTIONS) : -1;
+    (void) write(go[1], "", 1);
+    close(go[1]);
+
+    int wstatus{};
+    waitpid(pid, &wstatus, 0);
+    auto end = std::chrono::steady_clock::now();
+
+    Process p{};
+    if (WIFEXITED(wstatus)) p.status = WEXITSTATUS(wstatus);
+    p.ms = std::chrono::duration<double, std::milli>(end - start).count();
+    p.cycles = ReadCounter(cycles);
+    p.instructions = ReadCounter(instructions);
+    return p;
+}
+
+/// Build a program, returning the path to the executable if it worked.
+auto Compile(const Config& cfg, const fs::path& program, const Build& build, const fs::path& dir) -> std::optional<fs::path> {
+    auto stem = program.stem().string();
+    auto Try = [](const std::vector<std::string>& args) {
+        auto p = Run(args, false, false);
+        if (p.status == 0) return true;
+        fmt::print(stderr, "Command failed: {}\n", fmt::join(args, " "));
+        return false;
+    };
+
+    if (build.optimisation < 0) {
+        auto ll = (dir / (stem + ".ll")).string();
+        auto exe = dir / (stem + "-llvm");
+        if (not Try({cfg.lcc, "-f", "llvm", program.string(), "-o", ll})) return std::nullopt;
+        if (not Try({cfg.clang, "-O2", ll, "-o", exe.string()})) return std::nullopt;
+        return exe;
+    }
+
+    auto level = fmt::format("{}", build.optimisation);
+    auto s = (dir / fmt::format("{}-O{}.s", stem, level)).string();
+    auto exe = dir / fmt::format("{}-O{}", stem, level);
+    if (not Try({cfg.lcc, "-O", level, program.string(), "-o", s})) return std::nullopt;
+    if (not Try({cfg.cc, s, "-o", exe.string()})) return std::nullopt;
+    return exe;
+}
+
+auto FormatCount(std::optional<u64> n) -> std::string {
+    return n ? fmt::format("{}", *n) : "-";
+}
+
+/// Benchmark every build of a program, and return whether they all
+/// worked and agreed.
+auto Benchmark(const Config& cfg, const fs::path& program, const fs::path& dir) -> bool {
+    struct Result {
+        const Build* build;
+        Process best;
+    };
+
+    bool ok = true;
+    std::vector<Result> results{};
+    for (auto& build : Builds) {
+        auto exe = Compile(cfg, program, build, dir);
+        if (not exe) {
+            ok = false;
+            continue;
+        }
+
+        auto Cost = [](const Process& proc) { return proc.cycles ? double(*proc.cycles) : proc.ms; };
+        std::optional<Process> best{};
+        for (usz i = 0; i < cfg.runs; i++) {
+            auto p = Run({exe->string()}, true);
+            if (not best or Cost(p) < Cost(*best)) best = p;
+        }
+        results.push_back({&build, *best});
+    }
+
+    /// Compare against the LLVM build, if there is one.
+    auto reference = rgs::find_if(results, [](auto& r) { return r.build->optimisation < 0; });
+
+    fmt::print("{}:\n", program.filename().string());
+    fmt::print("  {:<10} {:>14} {:>14} {:>6} {:>10} {:>10} {:>6}\n", "build", "cycles", "instructions", "IPC", "time (ms)", "vs clang", "exit");
+    for (auto& r : results) {
+        auto& p = r.best;
+        std::string ipc = "-";
+        if (p.cycles and p.instructions and *p.cycles)
+            ipc = fmt::format("{:.2f}", double(*p.instructions) / double(*p.cycles));
+
+        std::string ratio = "-";
+        if (reference != results.end()) {
+            auto& ref = reference->best;
+            if (p.cycles and ref.cycles and *ref.cycles)
+                ratio = fmt::format("{:.2f}x", double(*p.cycles) / double(*ref.cycles));
+            else if (ref.ms > 0)
+                ratio = fmt::format("{:.2f}x", p.ms / ref.ms);
+        }
+
+        bool disagrees = p.status != results.front().best.status;
+        if (disagrees or p.status < 0) ok = false;
+        fmt::print(
+            "  {:<10} {:>14} {:>14} {:>6} {:>10.2f} {:>10} {:>6}{}\n",
+            r.build->name,
+            FormatCount(p.cycles),
+            FormatCount(p.instructions),
+            ipc,
+            p.ms,
+            ratio,
+            p.status,
+            disagrees ? "  (wrong result)" : ""
+        );
+    }
+    fmt::print("\n");
+    std::fflush(stdout);
+    return ok;
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    auto cfg = ParseArgs(argc, argv);
+    if (cfg.programs.empty()) Usage("No programs");
+
+    auto dir = fs::temp_directory_path() / fmt::format("lcc-runtime-bench-{}", getpid());
+    fs::create_directories(dir);
+
+    bool ok = true;
+    for (auto& program : cfg.programs) ok &= Benchmark(cfg, program, dir);
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+;; Hashing: 32-bit FNV-1a over a 4 KiB buffer, many times over, with
+;; every round seeded by the hash of the one before.
+
+fnv1a : int(data: [byte 4096].ref, seed: int) {
+    h :: (2166136261 | seed) - (2166136261 & seed);
+    i :int 0;
+    while (i < 4096) {
+        c :: int @data[i];
+        h := (((h | c) - (h & c)) * 16777619) & 4294967295;
+        i += 1;
+    };
+    return h;
+};
+
+data :[byte 4096];
+i :int 0;
+while (i < 4096) {
+    v :: i * 31 + 7;
+    @data[i] := byte v;
+    i += 1;
+};
+
+hash :int 0;
+round :int 0;
+while (round < 20000) {
+    hash := fnv1a data (hash & 255);
+    round += 1;
+};
+
+;; Fold every bit of the checksum into the exit code.
+(hash + (hash >> 7) + (hash >> 14)) & 127;
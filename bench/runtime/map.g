@@ -0,0 +1,36 @@
+;; Mapping: transforming every element of a 32 KiB buffer in place, many
+;; times over, with a different key every round.
+
+scramble : void(data: [i32 8192].ref, key: i32) {
+    i :int 0;
+    while (i < 8192) {
+        x :: @data[i];
+        @data[i] := ((x | key) - (x & key) + 12345) & 16777215;
+        i += 1;
+    };
+};
+
+data :[i32 8192];
+i :int 0;
+while (i < 8192) {
+    v :: (i * 13 + 5) & 4095;
+    @data[i] := i32 v;
+    i += 1;
+};
+
+round :int 0;
+while (round < 20000) {
+    key :: i32 round;
+    scramble data key;
+    round += 1;
+};
+
+checksum :int 0;
+i := 0;
+while (i < 8192) {
+    checksum := (checksum + int @data[i]) & 1048575;
+    i += 1;
+};
+
+;; Fold every bit of the checksum into the exit code.
+(checksum + (checksum >> 7) + (checksum >> 14)) & 127;
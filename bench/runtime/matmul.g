@@ -0,0 +1,47 @@
+;; Matrix multiplication: 64x64 integer matrices, stored row-major, with
+;; every product folded and truncated so the values stay small.
+
+matmul : void(a: [int 4096].ref, b: [int 4096].ref, c: [int 4096].ref) {
+    i :int 0;
+    while (i < 64) {
+        j :int 0;
+        while (j < 64) {
+            acc :int 0;
+            k :int 0;
+            while (k < 64) {
+                acc += @a[i * 64 + k] * @b[k * 64 + j];
+                k += 1;
+            };
+            @c[i * 64 + j] := (acc + (acc >> 16)) & 65535;
+            j += 1;
+        };
+        i += 1;
+    };
+};
+
+a :[int 4096];
+b :[int 4096];
+c :[int 4096];
+i :int 0;
+while (i < 4096) {
+    @a[i] := (i * 7 + 1) & 127;
+    @b[i] := (i * 13 + 5) & 127;
+    i += 1;
+};
+
+round :int 0;
+while (round < 300) {
+    matmul a b c;
+    matmul c b a;
+    round += 1;
+};
+
+checksum :int 0;
+i := 0;
+while (i < 4096) {
+    checksum := (checksum + @a[i]) & 1048575;
+    i += 1;
+};
+
+;; Fold every bit of the checksum into the exit code.
+(checksum + (checksum >> 7) + (checksum >> 14)) & 127;
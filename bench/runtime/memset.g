@@ -0,0 +1,22 @@
+;; Filling memory: storing the same value into every element of a
+;; 32 KiB buffer, many times over, with a different value every round.
+
+fill : void(data: [i32 8192].ref, value: i32) {
+    i :int 0;
+    while (i < 8192) {
+        @data[i] := value;
+        i += 1;
+    };
+};
+
+data :[i32 8192];
+checksum :int 0;
+round :int 0;
+while (round < 20000) {
+    value :: i32 round;
+    fill data value;
+    checksum := (checksum + int @data[(round * 31) & 8191]) & 1048575;
+    round += 1;
+};
+
+checksum & 127;
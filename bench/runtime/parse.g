@@ -0,0 +1,83 @@
+;; Recursive descent: parse and evaluate a large generated arithmetic
+;; expression of digits, +, *, and parentheses, over and over.
+;;
+;; Characters are written as their codes: 40 is "(", 41 is ")", 42 is
+;; "*", 43 is "+" and 48 is "0".
+
+next_random : int(seed: int.ptr) {
+    @seed := (@seed * 1103515245 + 12345) & 2147483647;
+    return @seed >> 16;
+};
+
+put : void(text: byte.ptr, pos: int.ptr, c: int) {
+    b :: byte c;
+    @text[@pos] := b;
+    @pos := @pos + 1;
+};
+
+;; Emit a random expression at most `depth` levels deep into `text`.
+generate : void(text: byte.ptr, pos: int.ptr, seed: int.ptr, depth: int) {
+    r :: (next_random seed) & 7;
+    if (depth = 0 or @pos > 60000) {
+        put text pos (48 + ((next_random seed) & 7));
+    } else if (r < 3) {
+        put text pos 40;
+        generate text pos seed (depth - 1);
+        put text pos 41;
+    } else {
+        generate text pos seed (depth - 1);
+        if (r < 7) {
+            put text pos 43;
+        } else {
+            put text pos 42;
+        };
+        generate text pos seed (depth - 1);
+    };
+};
+
+parse_factor : int(text: byte.ptr, pos: int.ptr) {
+    c :: int @text[@pos];
+    @pos := @pos + 1;
+    if (c = 40) {
+        value :: parse_expr text pos;
+        ;; Skip ")".
+        @pos := @pos + 1;
+        return value;
+    };
+    return c - 48;
+};
+
+parse_term : int(text: byte.ptr, pos: int.ptr) {
+    value :: parse_factor text pos;
+    while ((int @text[@pos]) = 42) {
+        @pos := @pos + 1;
+        value := (value * parse_factor text pos) & 1048575;
+    };
+    return value;
+};
+
+parse_expr : int(text: byte.ptr, pos: int.ptr) {
+    value :: parse_term text pos;
+    while ((int @text[@pos]) = 43) {
+        @pos := @pos + 1;
+        value := (value + parse_term text pos) & 1048575;
+    };
+    return value;
+};
+
+text :[byte 65536];
+pos :int 0;
+seed :int 42;
+generate text[0] (&pos) (&seed) 18;
+put text[0] (&pos) 0;
+
+checksum :int 0;
+round :int 0;
+while (round < 2000) {
+    p :int 0;
+    checksum := (checksum + parse_expr text[0] (&p)) & 1048575;
+    round += 1;
+};
+
+;; Fold every bit of the checksum into the exit code.
+(checksum + (checksum >> 7) + (checksum >> 14)) & 127;
@@ -0,0 +1,54 @@
+;; Sorting: quicksort on pseudo-random integers, refilled every round.
+
+quicksort : void(a: int.ptr, lo: int, hi: int) {
+    while (lo < hi) {
+        pivot :: @a[(lo + hi) >> 1];
+        i :int lo;
+        j :int hi;
+        while (i <= j) {
+            while (@a[i] < pivot) { i += 1; };
+            while (@a[j] > pivot) { j -= 1; };
+            if (i <= j) {
+                t :: @a[i];
+                @a[i] := @a[j];
+                @a[j] := t;
+                i += 1;
+                j -= 1;
+            };
+        };
+
+        ;; Recurse into the left part, loop on the right one.
+        quicksort a lo j;
+        lo := i;
+    };
+};
+
+;; Count the elements that are smaller than the one before them.
+inversions : int(a: int.ptr) {
+    count :int 0;
+    i :int 1;
+    while (i < 16384) {
+        if (@a[i] < @a[i - 1]) { count += 1; };
+        i += 1;
+    };
+    return count;
+};
+
+data :[int 16384];
+seed :int 12345;
+checksum :int 0;
+round :int 0;
+while (round < 200) {
+    i :int 0;
+    while (i < 16384) {
+        seed := (seed * 1103515245 + 12345) & 2147483647;
+        @data[i] := seed >> 8;
+        i += 1;
+    };
+
+    quicksort data[0] 0 16383;
+    checksum := (checksum + @data[round * 13] + 1000 * (inversions data[0])) & 1048575;
+    round += 1;
+};
+
+checksum & 127;
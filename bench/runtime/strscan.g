@@ -0,0 +1,68 @@
+;; String scanning: count the words in, and the occurrences of "the" in,
+;; 64 KiB of generated text.
+;;
+;; Characters are written as their codes: 10 is a newline, 32 a space,
+;; 97 is "a", and 101, 104 and 116 are "e", "h" and "t".
+
+count_words : int(text: [byte 65536].ref) {
+    words :int 0;
+    in_word :bool false;
+    i :int 0;
+    while (i < 65536) {
+        c :: int @text[i];
+        if (c = 32 or c = 10) {
+            in_word := false;
+        } else if (not in_word) {
+            in_word := true;
+            words += 1;
+        };
+        i += 1;
+    };
+    return words;
+};
+
+count_matches : int(text: [byte 65536].ref) {
+    matches :int 0;
+    i :int 0;
+    while (i < 65534) {
+        if ((int @text[i]) = 116 and (int @text[i + 1]) = 104 and (int @text[i + 2]) = 101) {
+            matches += 1;
+        };
+        i += 1;
+    };
+    return matches;
+};
+
+;; Mostly letters, skewed towards the ones in "the", with the occasional
+;; space or newline.
+text :[byte 65536];
+seed :int 7;
+i :int 0;
+while (i < 65536) {
+    seed := (seed * 1103515245 + 12345) & 2147483647;
+    r :: (seed >> 16) & 63;
+    c :int 10;
+    if (r < 26) {
+        c := 97 + r;
+    } else if (r < 32) {
+        c := 116;
+    } else if (r < 38) {
+        c := 104;
+    } else if (r < 44) {
+        c := 101;
+    } else if (r < 60) {
+        c := 32;
+    };
+    b :: byte c;
+    @text[i] := b;
+    i += 1;
+};
+
+checksum :int 0;
+round :int 0;
+while (round < 2000) {
+    checksum := (checksum + (count_words text) + (count_matches text)) & 1048575;
+    round += 1;
+};
+
+checksum & 127;
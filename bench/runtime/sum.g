@@ -0,0 +1,32 @@
+;; Summing: adding up every element of a 32 KiB buffer many times over,
+;; changing one element between rounds.
+
+add_up : int(data: [i32 8192].ref) {
+    total :i32 0;
+    i :int 0;
+    while (i < 8192) {
+        total += @data[i];
+        i += 1;
+    };
+    return total;
+};
+
+data :[i32 8192];
+i :int 0;
+while (i < 8192) {
+    v :: (i * 7 + 3) & 1023;
+    @data[i] := i32 v;
+    i += 1;
+};
+
+checksum :int 0;
+round :int 0;
+while (round < 20000) {
+    checksum := (checksum + add_up data) & 1048575;
+    v :: round & 1023;
+    @data[(round * 31) & 8191] := i32 v;
+    round += 1;
+};
+
+;; Fold every bit of the checksum into the exit code.
+(checksum + (checksum >> 7) + (checksum >> 14)) & 127;
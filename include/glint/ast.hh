@@ -3,15 +3,27 @@
 
 #include <lcc/core.hh>
 #include <lcc/diags.hh>
+#include <lcc/file.hh>
+#include <lcc/forward.hh>
 #include <lcc/syntax/token.hh>
 #include <lcc/utils.hh>
 #include <lcc/utils/aint.hh>
+#include <lcc/utils/arena.hh>
+#include <lcc/utils/bk_tree.hh>
 #include <lcc/utils/result.hh>
+#include <lcc/utils/interned_string.hh>
 
 #include <glint/eval.hh>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -22,6 +34,7 @@ static constexpr std::string_view metadata_section_name{".glint"};
 static constexpr std::string_view metadata_file_extension{".gmeta"};
 
 // Forward declaration
+class FuncDecl;
 class Init;
 
 enum struct IntrinsicKind {
@@ -167,6 +180,32 @@ enum class CastKind {
 /// Convert a token kind to a string representation.
 auto ToString(TokenKind kind) -> std::string_view;
 
+/// Metadata of an imported module, as read from a gmeta or object file.
+///
+/// This is never modified once read, so every module compiled with the
+/// same context can share the metadata of an import.
+class ModuleMetadata {
+    /// Whichever of these owns the metadata.
+    std::optional<MappedFile> _mapping{};
+    std::vector<u8> _contents{};
+
+    std::span<const u8> _blob{};
+
+public:
+    explicit ModuleMetadata(std::vector<u8> contents)
+        : _contents(std::move(contents)), _blob(_contents) {}
+
+    explicit ModuleMetadata(MappedFile mapping)
+        : _mapping(std::move(mapping)),
+          _blob(reinterpret_cast<const u8*>(_mapping->data()), _mapping->size()) {}
+
+    ModuleMetadata(const ModuleMetadata&) = delete;
+    auto operator=(const ModuleMetadata&) -> ModuleMetadata& = delete;
+
+    [[nodiscard]]
+    auto blob() const -> std::span<const u8> { return _blob; }
+};
+
 class Module {
 public:
     struct Ref {
@@ -197,8 +236,100 @@ private:
     std::vector<Decl*> exports{};
     std::vector<FuncDecl*> _functions{};
 
+    /// Offset in the source at which each top-level expression starts,
+    /// in the order in which they were parsed.
+    std::vector<std::pair<Expr*, u32>> _top_level_offsets{};
+
+    /// Metadata of an imported module whose declarations are only
+    /// deserialised once something refers to them by name.
+    struct LazyImport {
+        lcc::Context* context;
+        std::shared_ptr<const ModuleMetadata> metadata{};
+        std::span<const u8> blob{};
+
+        /// Index of the first type of this import in `types`.
+        usz types_zero_index{};
+        u16 declaration_count{};
+
+        /// Whether each declaration in the index has been deserialised.
+        std::vector<bool> loaded{};
+    };
+
+    std::vector<LazyImport> _lazy_imports{};
+
+    /// Names load_imported_declarations() has already been called with.
+    std::unordered_set<InternedString> _lazy_names_loaded{};
+
+    /// Whether load_all_imported_declarations() has been called. Sema
+    /// may call it again on several threads at once.
+    std::atomic<bool> _all_imports_loaded = false;
+
+    /// Nodes, types, and scopes created by one thread while several
+    /// threads work on the module at once. \see ThreadAllocation.
+    struct ThreadStorage {
+        Arena node_arena{64 * 1024};
+        Arena type_arena{4 * 1024};
+        Arena scope_arena{4 * 1024};
+        std::vector<Expr*> nodes;
+        std::vector<Type*> types;
+        std::vector<Scope*> scopes;
+    };
+
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadStorage>> _thread_storage{};
+    std::mutex _thread_storage_mutex{};
+    AllocationCounter* _allocation_counter{};
+
+    /// The storage of the current thread for this module, if it has any.
+    [[nodiscard]]
+    auto thread_storage() -> ThreadStorage*;
+
     usz _lambda_counter = 0;
 
+    struct OverloadSetKey {
+        const Scope* scope;
+        InternedString name;
+        auto operator==(const OverloadSetKey&) const -> bool = default;
+    };
+
+    struct OverloadSetKeyHash {
+        auto operator()(const OverloadSetKey& key) const -> usz;
+    };
+
+    /// Hash for keys that are made up of pointers and integers.
+    struct KeyHash {
+        auto operator()(const std::vector<uptr>& key) const -> usz;
+    };
+
+    /// Overload sets, by the scope that declares the functions and their
+    /// name. \see overload_set()
+    std::unordered_map<OverloadSetKey, std::vector<FuncDecl*>, OverloadSetKeyHash> _overload_sets{};
+
+    /// Overload sets that another overload has been added to since; kept
+    /// so that the nodes that refer to them stay valid.
+    std::vector<std::vector<FuncDecl*>> _stale_overload_sets{};
+
+    /// Callees chosen by overload resolution. \see resolved_overload()
+    std::unordered_map<std::vector<uptr>, FuncDecl*, KeyHash> _resolved_overloads{};
+    std::mutex _overload_mutex{};
+
+    /// Results of calls evaluated at compile time. \see evaluated_call()
+    std::unordered_map<std::vector<uptr>, std::optional<EvalResult>, KeyHash> _evaluated_calls{};
+    std::mutex _evaluated_calls_mutex{};
+
+    auto deserialise(LazyImport import) -> bool;
+
+    /// Deserialise the declaration at an offset into the metadata of an
+    /// import, and return the offset of the declaration after it.
+    auto deserialise_declaration(const LazyImport& import, usz offset) -> usz;
+
+    /// Report every declaration in the index of \p import that clashes
+    /// with something declared in the global scope or by an import before
+    /// it, and mark it as loaded so that it is never declared. This is
+    /// done when the module is imported, rather than when the declaration
+    /// would be loaded, so that the diagnostics do not depend on which
+    /// names are looked up, or whether everything is loaded up front.
+    void report_import_clashes(LazyImport& import);
+
 public:
     enum ModuleStatus : bool {
         IsNotAModule = false,
@@ -229,6 +360,14 @@ public:
     /// Add a top-level expression.
     void add_top_level_expr(Expr* node);
 
+    /// Record the offset in the source at which a top-level expression starts.
+    void add_top_level_offset(Expr* node, u32 offset) { _top_level_offsets.emplace_back(node, offset); }
+
+    /// Get the top-level expressions that were parsed from the source, with
+    /// the offset at which each starts.
+    [[nodiscard]]
+    auto top_level_offsets() const -> const std::vector<std::pair<Expr*, u32>>& { return _top_level_offsets; }
+
     /// Get the functions that are part of this module.
     auto functions() -> std::vector<FuncDecl*>& { return _functions; }
 
@@ -277,18 +416,115 @@ public:
     /// Deserialise a module metadata blob into `this`.
     /// \return a boolean value denoting `true` iff deserialisation succeeded.
     /// NOTE: Does not clear out old module before deserialising into `this`.
+    ///
+    /// The types are deserialised right away. If the metadata has an index,
+    /// the declarations are only deserialised once they are looked up via
+    /// load_imported_declarations(); otherwise, they are all deserialised
+    /// right away as well. Either way, declarations that clash with what
+    /// is already declared are reported right away.
     [[nodiscard]]
     auto deserialise(lcc::Context*, std::vector<u8> module_metadata_blob) -> bool;
+    [[nodiscard]]
+    auto deserialise(lcc::Context*, MappedFile module_metadata) -> bool;
+    [[nodiscard]]
+    auto deserialise(lcc::Context*, std::shared_ptr<const ModuleMetadata> module_metadata) -> bool;
+
+    /// Deserialise the declarations called \p name of imported modules
+    /// into the global scope, unless that has already been done.
+    void load_imported_declarations(InternedString name);
+
+    /// Deserialise all declarations of imported modules that have not
+    /// been deserialised yet.
+    void load_all_imported_declarations();
 
     std::vector<Expr*> nodes;
     std::vector<Type*> types;
     std::vector<Scope*> scopes;
     std::vector<std::string> strings;
+
+    /// Backing storage for nodes, types, and scopes. Each kind of object
+    /// gets its own arena so that objects of the same kind (which tend to
+    /// be visited together) end up next to each other in memory.
+    ///
+    /// The containers above are still what owns the objects in the sense
+    /// that they are what is used to run their destructors; the arenas
+    /// only own the memory.
+    Arena node_arena{256 * 1024};
+    Arena type_arena{16 * 1024};
+    Arena scope_arena{16 * 1024};
+
+    /// Report every allocation of a node, type, or scope to \p counter
+    /// as well, e.g. for a memory report.
+    void count_allocations_into(AllocationCounter* counter);
+
+    /// Allocate memory for a node, type, or scope of this module.
+    [[nodiscard]]
+    auto allocate_node(usz size) -> void*;
+    [[nodiscard]]
+    auto allocate_type(usz size) -> void*;
+    [[nodiscard]]
+    auto allocate_scope(usz size) -> void*;
+
+    /// Number of nodes in the module.
+    [[nodiscard]]
+    auto node_count() -> usz;
+
+    /// Get the functions called \p name declared in \p scope, all of which
+    /// must be functions.
+    ///
+    /// This returns the same storage for as long as no other function of
+    /// that name is declared in the scope, so the address of the first
+    /// element identifies the overload set, e.g. in resolved_overload().
+    [[nodiscard]]
+    auto overload_set(const Scope* scope, InternedString name) -> std::span<FuncDecl* const>;
+
+    /// Get the callee that overload resolution chose for a call before,
+    /// or nullptr if it hasn't seen one like it yet.
+    ///
+    /// The key is up to Sema, but must contain everything the choice of
+    /// callee depends on, i.e. the overload set and what matters about
+    /// the arguments.
+    [[nodiscard]]
+    auto resolved_overload(const std::vector<uptr>& key) -> FuncDecl*;
+
+    /// Record the callee that overload resolution chose for a call.
+    void resolved_overload(std::vector<uptr> key, FuncDecl* callee);
+
+    /// Get the result of evaluating a call at compile time, if such a call
+    /// has been evaluated before; the result is empty if the call turned out
+    /// not to be a constant expression. The key identifies the callee and
+    /// the values of the arguments.
+    [[nodiscard]]
+    auto evaluated_call(const std::vector<uptr>& key) -> const std::optional<EvalResult>*;
+
+    /// Record the result of evaluating a call at compile time.
+    void evaluated_call(std::vector<uptr> key, std::optional<EvalResult> result);
+
+    /// While this exists, the nodes, types, and scopes that its thread
+    /// creates for a module come from storage of that thread's own, so
+    /// several threads can create them for the same module at once.
+    ///
+    /// Each thread keeps its storage for as long as the module lives, so
+    /// a thread that works on several things in turn reuses it.
+    class ThreadAllocation {
+        Module* outer_module;
+        ThreadStorage* outer_storage;
+
+    public:
+        explicit ThreadAllocation(Module& mod);
+        ~ThreadAllocation();
+
+        ThreadAllocation(const ThreadAllocation&) = delete;
+        auto operator=(const ThreadAllocation&) -> ThreadAllocation& = delete;
+    };
 };
 
 struct GlintToken : public syntax::Token<TokenKind> {
     Expr* expression{};
 
+    /// The interned text of an identifier.
+    InternedString symbol{};
+
     /// Whether the expression bound by this token should
     /// only be evaluated once.
     bool eval_once = true;
@@ -308,22 +544,54 @@ struct Macro {
 };
 
 class Scope {
+    using SymbolMap = std::unordered_multimap<InternedString, Decl*>;
+
+    /// Where a lookup that started in this scope found a name, as of
+    /// some value of the declaration epoch.
+    struct CachedLookup {
+        const Scope* scope;
+        u64 epoch;
+    };
+
     Scope* _parent;
     // This has to be a multimap to support function overloads having the same
     // name yet resolving to different declarations.
-    std::unordered_multimap<std::string, Decl*, detail::StringHash, std::equal_to<>> symbols;
+    SymbolMap symbols;
     bool is_function_scope = false;
 
+    /// Memoised results of scope_of() for names that aren't declared in
+    /// this scope itself.
+    ///
+    /// This is only ever written to by lookups that start in this scope.
+    /// Those come from the code in the scope, which is analysed by one
+    /// thread at a time, even if several functions are analysed at once.
+    mutable std::unordered_map<InternedString, CachedLookup> lookup_cache;
+
+    /// Incremented whenever anything is declared in any scope, which may
+    /// shadow the result of a lookup that is cached in a scope below it.
+    static inline std::atomic<u64> declaration_epoch{};
+
+    /// Scopes with at least this many symbols index them for closest_symbol().
+    static constexpr usz FuzzyIndexThreshold = 64;
+
+    /// Index of the symbols in this scope by spelling; built on the first
+    /// call to closest_symbol() and kept up to date by declare() after that.
+    mutable std::unique_ptr<BKTree<Decl*>> fuzzy_index;
+    mutable std::mutex fuzzy_index_mutex;
+
+    static auto View(SymbolMap::const_iterator begin, SymbolMap::const_iterator end) {
+        return rgs::subrange(begin, end) | vws::values;
+    }
+
 public:
     Scope(Scope* parent) : _parent(parent) {}
 
     /// Disallow creating scopes without a module reference.
     void* operator new(size_t) = delete;
-    void* operator new(size_t sz, Module& mod) {
-        auto ptr = ::operator new(sz);
-        mod.scopes.push_back(static_cast<Scope*>(ptr));
-        return ptr;
-    }
+    void* operator new(size_t sz, Module& mod) { return mod.allocate_scope(sz); }
+
+    /// The memory is owned by the module’s arena.
+    void operator delete(void*) {}
 
     /// Get the parent scope.
     auto parent() const { return _parent; }
@@ -340,55 +608,96 @@ public:
     /// \return The same declaration, or an error.
     auto declare(
         const Context* ctx,
-        std::string&& name,
+        InternedString name,
         Decl* decl
     ) -> Result<Decl*>;
 
+    auto declare(
+        const Context* ctx,
+        std::string_view name,
+        Decl* decl
+    ) -> Result<Decl*> { return declare(ctx, InternedString{name}, decl); }
+
+    /// Look up a symbol in this scope.
+    ///
+    /// This returns a view of the declarations in the scope rather than a
+    /// copy of them, which is invalidated by declaring anything else here.
+    [[nodiscard]]
+    auto lookup(InternedString name) const {
+        auto [begin, end] = symbols.equal_range(name);
+        return View(begin, end);
+    }
+
+    /// Look up a symbol in the innermost scope, starting at this one, that
+    /// declares it. \see lookup()
+    [[nodiscard]]
+    auto lookup_recursive(InternedString name) const {
+        if (auto* scope = scope_of(name)) return scope->lookup(name);
+        return View(symbols.end(), symbols.end());
+    }
+
+    /// Get the innermost scope, starting at this one, that declares a
+    /// symbol, or nullptr if there is none.
+    [[nodiscard]]
+    auto scope_of(InternedString name) const -> const Scope*;
+
+    /// Find the symbol in this scope whose name is closest to \p name, if
+    /// it is within \p max_distance of it, and return it along with its
+    /// distance. The distance is the optimal string alignment distance;
+    /// see utils::EditDistance().
+    ///
+    /// Of several equally close symbols, any may be returned.
+    [[nodiscard]]
+    auto closest_symbol(std::string_view name, usz max_distance) const -> std::pair<Decl*, usz>;
+
+    /// Like closest_symbol(), but also consider the symbols in the parents
+    /// of this scope. If symbols in several scopes are equally close, the
+    /// one in the innermost scope is returned.
+    [[nodiscard]]
+    auto closest_symbol_recursive(std::string_view name, usz max_distance) const -> std::pair<Decl*, usz>;
+
     // Look up a symbol in this scope.
+    std::vector<Decl*> find(InternedString name) const {
+        auto decls = lookup(name);
+        return {decls.begin(), decls.end()};
+    }
+
     std::vector<Decl*> find(std::string_view name) const {
-        // std::pair can go die in a fucking hole. If you want to be a LISP so bad
-        // just fucking be one, loser.
-        auto it = symbols.equal_range(name);
-        // From the standard:
-        // "If there are no such elements, past-the-end (see end()) iterators are
-        // returned as both elements of the pair."
-        if (it.first == it.second) return {};
-        std::vector<Decl*> out{};
-        for (auto decl = it.first; decl != it.second; ++decl)
-            out.push_back(decl->second);
-        return out;
+        auto sym = InternedString::Find(name);
+        if (not sym) return {};
+        return find(*sym);
+    }
+
+    std::vector<Decl*> find_recursive(InternedString name) const {
+        auto decls = lookup_recursive(name);
+        return {decls.begin(), decls.end()};
     }
 
     std::vector<Decl*> find_recursive(std::string_view name) const {
-        auto f = find(name);
-        if (f.empty() and parent())
-            return parent()->find_recursive(name);
-        return f;
+        auto sym = InternedString::Find(name);
+        if (not sym) return {};
+        return find_recursive(*sym);
     }
 
-    // Get a list of symbols defined in this scope (for calculating
+    // Get a view of the symbols defined in this scope (for calculating
     // levenshtein distance on an unknown symbol, for example).
-    // NOTE: This returns a view of the data in the symbols, so if you alter
-    // those you may very well have a bad time.
-    auto all_symbols() const -> const std::unordered_set<Decl*> {
-        std::unordered_set<Decl*> out{};
-        for (auto& [_, decl] : symbols)
-            out.emplace(decl);
-        return out;
-    }
+    auto all_symbols() const { return View(symbols.begin(), symbols.end()); }
 
-    // \see all_symbols()
-    auto all_symbols_recursive() const -> const std::unordered_set<Decl*> {
-        auto out = all_symbols();
-        if (parent()) {
-            auto parent_symbols = parent()->all_symbols_recursive();
-            out.insert(parent_symbols.begin(), parent_symbols.end());
-        }
-        return out;
+    /// Call \p func with every symbol defined in this scope and its parents,
+    /// innermost scope first. \see all_symbols()
+    template <typename Func>
+    void for_each_symbol_recursive(Func&& func) const {
+        for (auto* scope = this; scope; scope = scope->parent())
+            for (auto* decl : scope->all_symbols())
+                func(decl);
     }
 
     /// Mark this scope as a function scope.
     void set_function_scope() { is_function_scope = true; }
+
+    /// Whether this is the scope of a function body.
+    [[nodiscard]]
+    auto is_function() const -> bool { return is_function_scope; }
 };
 
 // Base class for nodes and types, i.e. for anything that
@@ -508,6 +817,9 @@ public:
 private:
     Kind _kind;
 
+    /// The IR type this was lowered to. \see ir_type()
+    lcc::Type* _ir_type{};
+
 protected:
     constexpr Type(Kind kind, Location location)
         : SemaNode(location), _kind(kind) {}
@@ -515,12 +827,18 @@ protected:
 public:
     virtual ~Type() = default;
 
+    /// Get the IR type that IRGen lowered this type to, if it has done so
+    /// before. This is only recorded for types that belong to a module,
+    /// not for the builtin ones, which are shared by every module.
+    [[nodiscard]]
+    auto ir_type() const -> lcc::Type* { return _ir_type; }
+    void ir_type(lcc::Type* type) { _ir_type = type; }
+
     void* operator new(size_t) = delete;
-    void* operator new(size_t sz, Module& mod) {
-        auto* ptr = ::operator new(sz);
-        mod.types.push_back(static_cast<Type*>(ptr));
-        return ptr;
-    }
+    void* operator new(size_t sz, Module& mod) { return mod.allocate_type(sz); }
+
+    /// The memory is owned by the module’s arena.
+    void operator delete(void*) {}
 
     /// Get the alignment of this type. It may be target-dependent,
     /// which is why this takes a context parameter.
@@ -848,15 +1166,18 @@ public:
 };
 
 class NamedType : public Type {
-    std::string _name;
+    InternedString _name;
     Scope* _scope;
 
 public:
-    NamedType(std::string name, Scope* name_scope, Location location)
-        : Type(Kind::Named, location), _name(std::move(name)), _scope(name_scope) {}
+    NamedType(InternedString name, Scope* name_scope, Location location)
+        : Type(Kind::Named, location), _name(name), _scope(name_scope) {}
+
+    [[nodiscard]]
+    auto name() const -> std::string_view { return _name.str(); }
 
     [[nodiscard]]
-    auto name() const { return _name; }
+    auto symbol() const -> InternedString { return _name; }
 
     [[nodiscard]]
     auto scope() const { return _scope; }
@@ -1016,11 +1337,12 @@ public:
 
         Type* type;
         std::string name;
+        InternedString symbol;
         Location location;
         usz byte_offset{};
 
         Member(std::string name_, Type* type_, Location location_)
-            : type(type_), name(std::move(name_)), location(location_) {}
+            : type(type_), name(std::move(name_)), symbol(name), location(location_) {}
     };
 
 private:
@@ -1047,32 +1369,32 @@ public:
 
     /// Caller should check return value is not nullptr.
     [[nodiscard]]
-    auto member_by_name(std::string_view name) -> Member* {
-        auto found = rgs::find_if(_members, [name](const Member& m) {
-            return m.name == name;
-        });
+    auto member_by_name(InternedString name) -> Member* {
+        auto found = rgs::find(_members, name, &Member::symbol);
         if (found == _members.end()) return nullptr;
         return &*found;
     }
     /// Caller should check return value is not nullptr.
     [[nodiscard]]
-    auto member_by_name(std::string_view name) const -> const Member* {
-        return member_by_name(name);
+    auto member_by_name(std::string_view name) -> Member* {
+        auto sym = InternedString::Find(name);
+        if (not sym) return nullptr;
+        return member_by_name(*sym);
     }
 
     /// Caller should check return value is not negative.
     [[nodiscard]]
-    auto member_index_by_name(std::string_view name) -> isz {
-        auto found = rgs::find_if(_members, [name](const Member& m) {
-            return m.name == name;
-        });
-        if (found == _members.end()) return -1;
+    auto member_index_by_name(InternedString name) -> isz {
+        auto found = rgs::find(_members, name, &Member::symbol);
+        if (found == _members.end()) return Member::BadIndex;
         return std::abs(std::distance(_members.begin(), found));
     }
-    /// Caller should check return value is not nullptr.
+    /// Caller should check return value is not negative.
     [[nodiscard]]
-    auto member_index_by_name(std::string_view name) const -> const Member* {
-        return member_index_by_name(name);
+    auto member_index_by_name(std::string_view name) -> isz {
+        auto sym = InternedString::Find(name);
+        if (not sym) return Member::BadIndex;
+        return member_index_by_name(*sym);
     }
 
     [[nodiscard]]
@@ -1082,6 +1404,10 @@ public:
 class ArrayType : public TypeWithOneElement {
     Expr* _size;
 
+    /// Size and alignment in bits, or 0 if Sema hasn't computed them.
+    usz _bit_size{};
+    usz _bit_alignment{};
+
 public:
     ArrayType(Type* element_type, Expr* size, Location location = {})
         : TypeWithOneElement(Kind::Array, location, element_type), _size(size) {}
@@ -1090,6 +1416,19 @@ public:
     [[nodiscard]]
     auto dimension() const -> usz;
 
+    /// Get the size and alignment of this array, in bits, if they have
+    /// been computed. \see Type::size(), Type::align()
+    [[nodiscard]]
+    auto bit_size() const -> usz { return _bit_size; }
+    [[nodiscard]]
+    auto bit_alignment() const -> usz { return _bit_alignment; }
+
+    /// Record the size and alignment of this array, in bits.
+    void layout(usz bit_size, usz bit_alignment) {
+        _bit_size = bit_size;
+        _bit_alignment = bit_alignment;
+    }
+
     [[nodiscard]]
     auto size() -> Expr*& { return _size; }
     [[nodiscard]]
@@ -1189,10 +1528,11 @@ public:
         Type* type;
         Expr* expr;
         std::string name;
+        InternedString symbol;
         Location location;
 
         Member(std::string name_, Type* type_, Expr* expr_, Location location_)
-            : type(type_), expr(expr_), name(std::move(name_)), location(location_) {}
+            : type(type_), expr(expr_), name(std::move(name_)), symbol(name), location(location_) {}
     };
 
 private:
@@ -1236,10 +1576,11 @@ public:
     struct Member {
         Type* type;
         std::string name;
+        InternedString symbol;
         Location location;
 
         Member(std::string name_, Type* type_, Location location_)
-            : type(type_), name(std::move(name_)), location(location_) {}
+            : type(type_), name(std::move(name_)), symbol(name), location(location_) {}
     };
 
 private:
@@ -1356,11 +1697,10 @@ public:
     virtual ~Expr() = default;
 
     [[nodiscard]] auto operator new(size_t) -> void* = delete;
-    [[nodiscard]] auto operator new(size_t sz, Module& mod) -> void* {
-        auto* ptr = ::operator new(sz);
-        mod.nodes.push_back(static_cast<Expr*>(ptr));
-        return ptr;
-    }
+    [[nodiscard]] auto operator new(size_t sz, Module& mod) -> void* { return mod.allocate_node(sz); }
+
+    /// The memory is owned by the module’s arena.
+    void operator delete(void*) {}
 
     /// Try to evaluate this expression.
     ///
@@ -1630,6 +1970,10 @@ class FuncDecl : public ObjectDecl {
     // NOTE: For warnings in sema
     std::vector<Decl*> _dangling_dynarrays{};
 
+    /// Set once Sema is done with the body, after which it may be evaluated
+    /// at compile time, even while other functions are still being analysed.
+    std::atomic<bool> _body_analysed{false};
+
 public:
     FuncDecl(
         std::string name,
@@ -1697,6 +2041,11 @@ public:
     [[nodiscard]]
     auto dangling_dynarrays() const -> std::vector<Decl*> { return _dangling_dynarrays; }
 
+    /// Whether Sema has finished analysing the body of this function.
+    [[nodiscard]]
+    auto body_analysed() const -> bool { return _body_analysed.load(std::memory_order_acquire); }
+    void set_body_analysed() { _body_analysed.store(true, std::memory_order_release); }
+
     static auto classof(const Expr* expr) -> bool { return expr->kind() == Kind::FuncDecl; }
 };
 
@@ -1739,14 +2088,15 @@ public:
 
 /// A set of function overloads.
 class OverloadSet : public TypedExpr {
-    std::vector<FuncDecl*> _overloads;
+    /// Owned by the module. \see Module::overload_set()
+    std::span<FuncDecl* const> _overloads;
 
 public:
-    OverloadSet(std::vector<FuncDecl*> overloads, Location location)
-        : TypedExpr(Kind::OverloadSet, location), _overloads(std::move(overloads)) {}
+    OverloadSet(std::span<FuncDecl* const> overloads, Location location)
+        : TypedExpr(Kind::OverloadSet, location), _overloads(overloads) {}
 
     [[nodiscard]]
-    auto overloads() const -> const std::vector<FuncDecl*>& { return _overloads; }
+    auto overloads() const -> std::span<FuncDecl* const> { return _overloads; }
 
     [[nodiscard]]
     static auto classof(const Expr* expr) -> bool {
@@ -2060,16 +2410,19 @@ public:
 };
 
 class NameRefExpr : public TypedExpr {
-    std::string _name;
+    InternedString _name;
     Scope* _scope;
     Expr* _target{};
 
 public:
-    NameRefExpr(std::string name, Scope* name_scope, Location location)
-        : TypedExpr(Kind::NameRef, location), _name(std::move(name)), _scope(name_scope) {}
+    NameRefExpr(InternedString name, Scope* name_scope, Location location)
+        : TypedExpr(Kind::NameRef, location), _name(name), _scope(name_scope) {}
 
     [[nodiscard]]
-    auto name() const -> const std::string& { return _name; }
+    auto name() const -> std::string_view { return _name.str(); }
+
+    [[nodiscard]]
+    auto symbol() const -> InternedString { return _name; }
 
     [[nodiscard]]
     auto scope() const -> Scope* { return _scope; }
@@ -2095,13 +2448,13 @@ public:
 
 class MemberAccessExpr : public TypedExpr {
     Expr* _object;
-    std::string _name;
+    InternedString _name;
     StructType* _struct{};
     usz _member_index{};
 
 public:
-    MemberAccessExpr(Expr* object, std::string name, Location location)
-        : TypedExpr(Kind::MemberAccess, location), _object(object), _name(std::move(name)) {}
+    MemberAccessExpr(Expr* object, InternedString name, Location location)
+        : TypedExpr(Kind::MemberAccess, location), _object(object), _name(name) {}
 
     void finalise(StructType* type, usz member_index) {
         _member_index = member_index;
@@ -2112,7 +2465,10 @@ public:
     auto member() const -> usz { return _member_index; }
 
     [[nodiscard]]
-    auto name() const -> const std::string& { return _name; }
+    auto name() const -> std::string_view { return _name.str(); }
+
+    [[nodiscard]]
+    auto symbol() const -> InternedString { return _name; }
 
     [[nodiscard]]
     auto object() -> Expr*& { return _object; }
@@ -31,7 +31,7 @@ public:
     EvalResult(std::nullptr_t) : _data(nullptr) {}
     EvalResult(StringLiteral* data) : _data(data) {}
     EvalResult(aint data) : _data(data) {}
-    EvalResult(std::same_as<bool> auto data) : EvalResult(aint(1)) {}
+    EvalResult(std::same_as<bool> auto data) : EvalResult(aint(data)) {}
 
     /// Requires rather annoying explicit disabmiguation due to subsumption rules
     EvalResult(std::integral auto data)
@@ -41,6 +41,7 @@ public:
     bool is_int() const { return std::holds_alternative<aint>(_data); }
     bool is_null() const { return std::holds_alternative<std::nullptr_t>(_data); }
     bool is_string() const { return std::holds_alternative<StringLiteral*>(_data); }
+    bool is_void() const { return std::holds_alternative<std::monostate>(_data); }
 
     aint as_int() const { return std::get<aint>(_data); }
     StringLiteral* as_string() const { return std::get<StringLiteral*>(_data); }
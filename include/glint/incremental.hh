@@ -0,0 +1,134 @@
+#ifndef GLINT_INCREMENTAL_HH
+#define GLINT_INCREMENTAL_HH
+
+#include <lcc/context.hh>
+#include <lcc/diags.hh>
+#include <lcc/utils.hh>
+
+#include <glint/ast.hh>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace lcc::glint {
+/// Checks a source file over and over as it is edited, e.g. for an
+/// editor that wants diagnostics after every keystroke, redoing as
+/// little of the analysis as it can each time.
+///
+/// The file is split into its top-level expressions, which are matched
+/// against those of the previous check by their text. The body of a
+/// function declared at the top level is only analysed again if its
+/// text changed or if it mentions a name whose declaration changed;
+/// otherwise, the diagnostics it issued last time are reused, moved to
+/// wherever the function is now.
+///
+/// A declaration changes if its text, other than the body of a function,
+/// changes, or if that text mentions a name whose declaration changed,
+/// so a change to a type also changes the functions that return it and,
+/// in turn, everything that calls those. A body that changes may also
+/// free a global variable, so the other bodies that mention the global
+/// variables it mentions are analysed again as well.
+///
+/// The file is still parsed as a whole, since the parser resolves names
+/// as it goes and so can't parse an expression without everything before
+/// it. The top-level function, which declares the global variables, is
+/// always analysed in full as well.
+class IncrementalChecker {
+public:
+    /// Creates the context that a check runs in.
+    using ContextFactory = std::function<std::unique_ptr<Context>()>;
+
+private:
+    /// Diagnostics kept from one check to the next. Unlike diagnostics
+    /// that are merely dropped, these are never printed.
+    struct SavedDiags {
+        std::vector<Diag> diags{};
+
+        /// Whether the body these were issued in frees a global variable.
+        bool frees_globals{};
+
+        SavedDiags() = default;
+        SavedDiags(SavedDiags&&) = default;
+        auto operator=(SavedDiags&&) -> SavedDiags& = delete;
+        ~SavedDiags();
+    };
+
+    /// A top-level expression.
+    struct Item {
+        /// Where it is in the source, including the separators and
+        /// whitespace up to the next one.
+        u32 begin{};
+        u32 end{};
+
+        /// Hashes of the text, and of the text without the body if this
+        /// declares a function.
+        usz hash{};
+        usz signature_hash{};
+
+        /// Where the body starts, or the end if there is none.
+        u32 body_begin{};
+
+        /// The global names this may declare.
+        std::vector<std::string> declares{};
+
+        /// The identifiers in the text outside of and in the body.
+        std::unordered_set<std::string> signature_words{};
+        std::unordered_set<std::string> body_words{};
+
+        /// Whether this declares a function whose body can be reused.
+        bool reusable{};
+
+        /// Diagnostics issued in the bodies of the functions declared
+        /// here, in the order in which they are declared.
+        std::vector<SavedDiags> functions{};
+    };
+
+    ContextFactory make_context;
+    fs::path path;
+
+    /// The context of the last check, which its diagnostics refer to.
+    std::unique_ptr<Context> ctx{};
+
+    /// The module of the last check, if the file could be parsed.
+    std::unique_ptr<Module> mod{};
+
+    /// What the last check that parsed knew about the file.
+    std::string source{};
+    std::vector<Item> items{};
+    u16 file_id{};
+    bool have_items = false;
+
+    /// How many bodies the last check skipped.
+    usz reused = 0;
+
+public:
+    /// Create a checker for the file at \p file_path; every check runs in
+    /// a new context from \p context_factory.
+    IncrementalChecker(fs::path file_path, ContextFactory context_factory);
+
+    /// Check the file again with new contents, and return the diagnostics.
+    ///
+    /// The diagnostics refer to the context of this check, so they must be
+    /// printed or dropped before the next one.
+    [[nodiscard]]
+    auto check(std::string_view contents) -> std::vector<Diag>;
+
+    /// Get the context of the last check, if any.
+    [[nodiscard]]
+    auto context() const -> Context* { return ctx.get(); }
+
+    /// Get the module of the last check, if the file could be parsed.
+    [[nodiscard]]
+    auto module() const -> Module* { return mod.get(); }
+
+    /// Get the number of function bodies the last check did not analyse.
+    [[nodiscard]]
+    auto reused_bodies() const -> usz { return reused; }
+};
+} // namespace lcc::glint
+
+#endif // GLINT_INCREMENTAL_HH
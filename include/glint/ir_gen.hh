@@ -23,6 +23,8 @@ class IRGen {
     usz total_while = 0;
     usz total_for = 0;
     usz total_if = 0;
+    usz total_sum_access = 0;
+    usz total_append = 0;
 
     usz total_string = 0;
 
@@ -35,6 +37,14 @@ class IRGen {
     std::unordered_map<glint::Expr*, lcc::Value*> generated_ir;
     std::vector<lcc::GlobalVariable*> string_literals;
 
+    /// Out-of-line parts of the dynamic array runtime. These are only
+    /// created once a module uses dynamic arrays.
+    struct DynamicArrayRuntime {
+        lcc::Function* init{};
+        lcc::Function* grow{};
+        lcc::Function* free{};
+    } dynamic_array_runtime;
+
     IRGen(Context* c, glint::Module& m) : ctx(c), int_module(m) {
         module = new lcc::Module(ctx);
     }
@@ -46,6 +56,9 @@ class IRGen {
     void create_function(glint::FuncDecl* f);
     void generate_function(glint::FuncDecl*);
 
+    auto dynamic_array_builtins() -> const DynamicArrayRuntime&;
+    void call(lcc::Function* f, std::vector<lcc::Value*> args);
+
 public:
     /// NOTE: I would name this module(), but C++ doesn't have properties.
     auto mod() -> lcc::Module* {
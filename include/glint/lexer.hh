@@ -22,23 +22,31 @@ class Lexer : public syntax::Lexer<GlintToken> {
         ExprOnce,
     };
 
+    /// A macro is compiled when it is defined: every macro argument
+    /// in its expansion stores the index of the argument it refers to
+    /// in `integer_value`, and every gensym the index of its name in
+    /// `definitions`, so expanding it never has to look up a name.
     struct Macro {
+        static constexpr u64 UnboundArgument = u64(-1);
+
         std::string name{};
         std::vector<std::string> definitions{};
         std::vector<Token> expansion{};
         std::vector<Token> parameters{};
+        usz argument_count{};
         Location location{};
     };
 
     class MacroExpansion {
         Macro* m;
         decltype(m->expansion.begin()) it;
-        StringMap<Token> bound_arguments{};
+        std::vector<Token> arguments{};
         Location location{};
-        std::vector<std::string> gensyms{};
+        usz first_gensym{};
 
     public:
-        MacroExpansion(Lexer&, Macro&, StringMap<Token> args, Location);
+        /// \p args are the bound arguments, in order of parameters.
+        MacroExpansion(Lexer&, Macro&, std::vector<Token> args, Location);
 
         /// Check if the macro is done expanding.
         auto done() const -> bool { return it == m->expansion.end(); }
@@ -47,11 +55,14 @@ class Lexer : public syntax::Lexer<GlintToken> {
         auto operator++() -> Token;
     };
 
-    std::deque<Token> lookahead_tokens{};
+    /// Macros are never removed, and a deque never moves its elements
+    /// when appending, so expansions may hold on to them.
     std::deque<Macro> macros{};
+
+    /// Macros by name.
+    StringMap<Macro*> macro_table{};
     std::vector<MacroExpansion> macro_expansion_stack{};
     bool raw_mode = false;
-    bool looking_ahead = false;
     usz gensym_counter = 0;
 
     void NextIdentifier();
@@ -76,6 +87,9 @@ protected:
     /// parsed.
     ///
     /// LookAhead(0) returns the current token.
+    ///
+    /// This lexer cannot tokenize in bulk because expanding a
+    /// macro may invoke the parser.
     auto LookAhead(usz n) -> Token*;
 
     void NextToken();
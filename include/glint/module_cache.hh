@@ -0,0 +1,101 @@
+#ifndef LCC_GLINT_MODULE_CACHE_HH
+#define LCC_GLINT_MODULE_CACHE_HH
+
+#include <lcc/file.hh>
+#include <lcc/utils.hh>
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace lcc::glint {
+/// On-disk cache of the module metadata extracted from imported object
+/// files and archives, so that later compilations can map it directly
+/// instead of reading and picking apart the object file again.
+///
+/// There is one entry per object file, named after its module and a
+/// hash of its absolute path. Next to each entry is a stamp holding the
+/// size, modification time, and content hash of the object file it was
+/// extracted from. An entry is used if the size and modification time
+/// still match; if only the modification time differs, the contents
+/// are hashed, and the entry is used (and its stamp refreshed) if the
+/// hash still matches.
+///
+/// Entries are written to a temporary file and renamed into place, so
+/// concurrent compilations sharing a cache never see partial entries.
+class ModuleCache {
+    fs::path _directory;
+
+public:
+    explicit ModuleCache(fs::path directory) : _directory(std::move(directory)) {}
+
+    /// Map the cached metadata of module \p name extracted from the
+    /// object file at \p source, if there is a valid entry for it.
+    [[nodiscard]]
+    auto lookup(std::string_view name, const fs::path& source) const -> std::optional<MappedFile>;
+
+    /// The size and modification time of an object file.
+    struct SourceStat {
+        u64 size{};
+        i64 mtime{};
+    };
+
+    /// Get the size and modification time of the object file at
+    /// \p source. Take this before reading the file, so that a change
+    /// while reading it makes the entry stale rather than wrong.
+    [[nodiscard]]
+    static auto stat(const fs::path& source) -> std::optional<SourceStat>;
+
+    /// Cache the metadata of module \p name extracted from the object
+    /// file at \p source, whose contents are \p source_contents, and
+    /// whose size and modification time were \p source_stat before it
+    /// was read.
+    ///
+    /// Failing to write to the cache is not an error.
+    void store(
+        std::string_view name,
+        const fs::path& source,
+        SourceStat source_stat,
+        std::span<const char> source_contents,
+        std::span<const u8> metadata
+    ) const;
+};
+
+class ModuleMetadata;
+
+/// In-memory cache of the metadata of imported modules, by the path of
+/// the gmeta or object file it was read from, shared by every context
+/// in this process. An entry is only used while the size and
+/// modification time of its file still match what they were when it
+/// was read.
+///
+/// The compile server keeps this filled with the imports of earlier
+/// requests, so that the processes it forks for later ones start out
+/// with them already read.
+class ImportCache {
+public:
+    /// Get the metadata in the file at \p path. If the cache does not
+    /// hold it, or the file changed since it was read, it is read with
+    /// \p read, and this process remembers that it read it.
+    [[nodiscard]]
+    static auto get(
+        const fs::path& path,
+        const std::function<std::shared_ptr<const ModuleMetadata>()>& read
+    ) -> std::shared_ptr<const ModuleMetadata>;
+
+    /// The paths of the files read by this process since the last call.
+    [[nodiscard]]
+    static auto take_stored_paths() -> std::vector<std::string>;
+
+    /// Read the metadata in the gmeta or object file at \p path into the
+    /// cache, e.g. after another process reported it as stored. Unlike
+    /// compilations, this never aborts; it returns false if the file is
+    /// not there or does not contain valid metadata.
+    static auto warm(const fs::path& path) -> bool;
+};
+} // namespace lcc::glint
+
+#endif /* LCC_GLINT_MODULE_CACHE_HH */
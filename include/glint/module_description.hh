@@ -9,11 +9,16 @@ namespace glint {
 /// If you know how ELF works, you'll find this familiar and pretty
 /// easy-going. If not, hopefully the comments help you out along the way.
 ///
-/// OVERALL STRUCTURE of BINARY METADATA BLOB version 1:
+/// OVERALL STRUCTURE of BINARY METADATA BLOB version 2:
 ///
-/// Beginning of file       type_table_offset  name_offset
-/// V                       V                  V
-/// Header { Declarations } { Types }          [ Module Name ]
+/// Beginning of file                type_table_offset  name_offset
+/// V                                V                  V
+/// Header { Index } { Declarations } { Types }         [ Module Name ]
+///
+/// The index has one IndexEntry per declaration, sorted by the hash of
+/// the name of the declaration, so that a reader can find the
+/// declarations with a given name by binary search and deserialise
+/// only the ones it needs. Version 1 is the same, minus the index.
 ///
 /// A declaration is encoded as a DeclarationHeader + N amount of bytes
 /// determined by the values in the declaration header.
@@ -21,7 +26,7 @@ struct ModuleDescription {
     using TypeIndex = u16;
 
     // Default/expected values.
-    static constexpr u8 default_version = 1;
+    static constexpr u8 default_version = 2;
     static constexpr u8 magic_byte0 = 'G';
     static constexpr u8 magic_byte1 = 'N';
     static constexpr u8 magic_byte2 = 'T';
@@ -57,6 +62,32 @@ struct ModuleDescription {
         u16 type_count;
     };
 
+    struct IndexEntry {
+        /// HashName() of the name of the declaration.
+        u32 name_hash;
+
+        /// The offset within this binary metadata blob at which you will
+        /// find the DeclarationHeader of the declaration.
+        u32 declaration_offset;
+    };
+
+    /// Hash of a declaration name in the index. This is part of the
+    /// format, so it must not change (32-bit FNV-1a).
+    static constexpr auto HashName(std::string_view name) -> u32 {
+        u32 hash = 2166136261u;
+        for (char c : name) {
+            hash ^= u8(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    /// Offset of the first declaration in a blob of the given version.
+    static constexpr auto DeclarationsOffset(u8 version, u16 declaration_count) -> usz {
+        if (version == 1) return sizeof(Header);
+        return sizeof(Header) + declaration_count * sizeof(IndexEntry);
+    }
+
     struct DeclarationHeader {
         enum struct Kind : u16 {
             INVALID,
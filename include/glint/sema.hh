@@ -6,7 +6,11 @@
 
 #include <glint/ast.hh>
 
+#include <functional>
+#include <memory>
+#include <span>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -37,7 +41,42 @@ public:
     /// \param use_colours Whether to use colours in diagnostics.
     static void Analyse(Context* ctx, Module& m, bool use_colours = false);
 
+    /// Lets the caller of Analyse() skip the bodies of some functions,
+    /// e.g. because nothing they depend on has changed since the last
+    /// time they were analysed.
+    struct BodyHooks {
+        /// Whether to analyse the body of a function. This may be called
+        /// on several threads at once.
+        std::function<bool(FuncDecl*)> analyse;
+
+        /// Called for every function once all bodies are done, in order,
+        /// with the diagnostics issued in its body before they are printed.
+        /// If the body was skipped, this may add what it issued last time.
+        ///
+        /// The last argument is whether the body frees a global variable.
+        /// Such a body must not be skipped the next time, since what it
+        /// frees decides the diagnostics of the functions after it.
+        std::function<void(FuncDecl*, Diag::Buffer&, bool)> finish;
+    };
+
+    /// Like Analyse(), but let \p hooks decide which bodies to analyse.
+    static void Analyse(Context* ctx, Module& m, const BodyHooks& hooks, bool use_colours = false);
+
 private:
+    /// \see BodyHooks
+    const BodyHooks* body_hooks{};
+
+    /// The global variables freed in the body of the function we're
+    /// analysing, if it isn't the top-level function.
+    ///
+    /// \see AnalyseFunctionBodies()
+    std::unordered_set<Expr*> freed_globals{};
+
+    /// References to global dynamic arrays in the body of the function
+    /// we're analysing, if it isn't the top-level function, and unless
+    /// it freed them itself before.
+    std::vector<NameRefExpr*> global_references{};
+
     /// \see Error()
     template <typename Ty>
     struct format_type {
@@ -62,7 +101,34 @@ private:
     // expr_ptr points to call expression `expr`
     void AnalyseCall(Expr** expr_ptr, CallExpr* expr);
     void AnalyseCast(CastExpr* expr);
-    void AnalyseFunctionBody(FuncDecl* decl);
+    /// Analyse the body of a function.
+    ///
+    /// \return Whether the parameters of the function are well-formed. If
+    ///     not, the caller has to mark the function as errored, once no
+    ///     other function is being analysed that might look at it.
+    [[nodiscard]]
+    auto AnalyseFunctionBody(FuncDecl* decl) -> bool;
+
+    /// Analyse the bodies of all functions, on several threads if the
+    /// context allows it.
+    ///
+    /// Once the signatures are known, the body of a function only affects
+    /// other functions through what it declares, i.e. through the top-level
+    /// function, which declares global variables and types, and through the
+    /// functions it is nested in. So the top-level function is analysed
+    /// first, then every function that isn't nested in another one, in
+    /// parallel, and then the nested ones.
+    ///
+    /// Each function is analysed by a Sema of its own, as `curr_func` is
+    /// per function. Its diagnostics are buffered and printed in the order
+    /// of the functions in the module at the end, so the output does not
+    /// depend on the number of threads.
+    ///
+    /// A global variable freed in a function is no longer viable in the
+    /// functions after it in the module. Each Sema records the globals it
+    /// frees and references, and those are checked against each other in
+    /// the order of the functions once all bodies are done.
+    void AnalyseFunctionBodies();
     void AnalyseFunctionSignature(FuncDecl* decl);
     // expr_ptr points to intrinsic call expression `expr`
     void AnalyseIntrinsicCall(Expr** expr_ptr, IntrinsicCallExpr* expr);
@@ -219,6 +285,13 @@ private:
     /// Create a (type-checked) reference to a type.
     auto Ref(Type* type) -> ReferenceType*;
 
+    /// Choose which of \p overloads a call expression calls, or issue
+    /// an error and return nullptr if that isn't exactly one of them.
+    ///
+    /// The arguments of the call must have been analysed already.
+    [[nodiscard]]
+    auto ResolveOverload(CallExpr* expr, std::span<FuncDecl* const> overloads) -> FuncDecl*;
+
     /// Attempt to convert an expression to a given type.
     ///
     /// This is similar to \c Convert(), except that it does not perform
@@ -251,17 +324,17 @@ private:
         const Module::Ref& import,
         const std::string& include_dir,
         std::vector<std::string>& paths_tried
-    ) -> bool;
+    ) -> std::shared_ptr<const ModuleMetadata>;
     auto try_get_metadata_blob_from_object(
         const Module::Ref& import,
         const std::string& include_dir,
         std::vector<std::string>& paths_tried
-    ) -> bool;
+    ) -> std::shared_ptr<const ModuleMetadata>;
     auto try_get_metadata_blob_from_assembly(
         const Module::Ref& import,
         const std::string& include_dir,
         std::vector<std::string>& paths_tried
-    ) -> bool;
+    ) -> std::shared_ptr<const ModuleMetadata>;
 };
 } // namespace lcc::glint
 
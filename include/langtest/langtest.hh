@@ -3,9 +3,11 @@
 #include <lcc/format.hh>
 #include <lcc/target.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/parallel.hh>
 
 #include <concepts>
 #include <filesystem>
+#include <iterator>
 #include <span>
 #include <string>
 #include <string_view>
@@ -44,11 +46,25 @@ struct Test {
     std::string_view source;
     std::string_view ir;
     MatchTree matcher;
+
+    /// Whether the test passed; set by the runner once run() returns.
+    bool passed{false};
+
+    /// Everything the test wants to report. Tests may run on several
+    /// threads at once, so they must write here instead of to stdout;
+    /// the runner prints it once all tests have finished, in the order
+    /// the tests appear in the file.
+    std::string log{};
+
+    template <typename... Args>
+    void print(fmt::format_string<Args...> fmt, Args&&... args) {
+        fmt::format_to(std::back_inserter(log), fmt, std::forward<Args>(args)...);
+    }
 };
 
 class TestContext {
-    size_t _count;
-    size_t _count_failed;
+    size_t _count{};
+    size_t _count_failed{};
 
 public:
     [[nodiscard]]
@@ -103,18 +119,17 @@ auto print_node(TNode* e) -> std::string {
 template <typename TNode>
 requires langtest_node_requirements<TNode>
 [[nodiscard]]
-auto perform_match(TNode* e, MatchTree& t) -> bool {
+auto perform_match(Test& test, TNode* e, MatchTree& t) -> bool {
     auto name = e->langtest_name();
     if (name != t.name) {
-        // TODO: Record test failure, somewhere/somehow
-        fmt::print("\nMISMATCH: node name\n");
-        fmt::print("Expected {} but got {}\n", t.name, name);
+        test.print("\nMISMATCH: node name\n");
+        test.print("Expected {} but got {}\n", t.name, name);
         return false;
     }
 
     auto children = e->langtest_children();
     if (children.size() != t.children.size()) {
-        fmt::print("\nMISMATCH: child count\n");
+        test.print("\nMISMATCH: child count\n");
         return false;
     }
 
@@ -125,7 +140,7 @@ auto perform_match(TNode* e, MatchTree& t) -> bool {
 
     bool children_match{true};
     for (size_t i = 0; i < children.size(); ++i) {
-        if (not perform_match<TNode>(children.at(i), t.children.at(i)))
+        if (not perform_match<TNode>(test, children.at(i), t.children.at(i)))
             children_match = false;
     }
 
@@ -341,12 +356,13 @@ template <typename TTest>
 concept langtest_test_requirements
     = langtest_test_has_run<TTest> and langtest_test_derived_from_test<TTest>;
 
+/// Parse every test in \p contents.
+///
+/// The tests refer to \p contents, so it must outlive them.
 template <typename TTest>
 requires langtest_test_requirements<TTest>
-auto parse_and_run_tests(
-    std::span<char> contents
-) -> TestContext {
-    TestContext context{};
+auto parse_tests(std::span<char> contents) -> std::vector<TTest> {
+    std::vector<TTest> tests{};
 
     auto fsize = contents.size();
     bool bol = true;
@@ -357,20 +373,56 @@ auto parse_and_run_tests(
         if (bol and c == '=') {
             TTest test{};
             if (parse_test(contents, fsize, i, test))
-                context.record_test(test.run());
+                tests.push_back(std::move(test));
             bol = true;
         } else bol = c == '\n';
     }
 
+    return tests;
+}
+
+/// Run \p tests on up to \p jobs threads (zero means one per hardware
+/// thread), and record whether each one passed.
+///
+/// Each test runs in-process with its own Context, so tests never share
+/// state. Nothing is printed here; use report_tests() afterwards to print
+/// the results in a deterministic order.
+template <typename TTest>
+requires langtest_test_requirements<TTest>
+void run_tests(std::span<TTest> tests, lcc::usz jobs = 1) {
+    lcc::ParallelFor(tests.size(), jobs, [&](lcc::usz i) {
+        tests[i].passed = tests[i].run();
+    });
+}
+
+/// Print the log of every test in \p tests, in order, and count the
+/// results.
+template <typename TTest>
+requires langtest_test_requirements<TTest>
+auto report_tests(std::span<TTest> tests) -> TestContext {
+    TestContext context{};
+    for (auto& test : tests) {
+        if (not test.log.empty()) fmt::print("{}", test.log);
+        context.record_test(test.passed);
+    }
     return context;
 }
 
 template <typename TTest>
 requires langtest_test_requirements<TTest>
-auto process_ast_test_file(
-    const std::filesystem::path& path
+auto parse_and_run_tests(
+    std::span<char> contents,
+    lcc::usz jobs = 1
 ) -> TestContext {
-    // Read file
+    auto tests = parse_tests<TTest>(contents);
+    run_tests<TTest>(tests, jobs);
+    return report_tests<TTest>(tests);
+}
+
+/// Read a test file into memory.
+inline auto read_test_file(
+    const std::filesystem::path& path
+) -> std::vector<char> {
     auto path_str = path.string();
     auto* f = fopen(path_str.data(), "rb");
     if (not f) {
@@ -396,7 +448,17 @@ auto process_ast_test_file(
     }
     fclose(f);
 
-    return parse_and_run_tests<TTest>(contents);
+    return contents;
+}
+
+template <typename TTest>
+requires langtest_test_requirements<TTest>
+auto process_ast_test_file(
+    const std::filesystem::path& path,
+    lcc::usz jobs = 1
+) -> TestContext {
+    auto contents = read_test_file(path);
+    return parse_and_run_tests<TTest>(contents, jobs);
 }
 
 } // namespace langtest
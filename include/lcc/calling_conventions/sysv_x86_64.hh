@@ -3,6 +3,10 @@
 
 #include <lcc/codegen/x86_64/x86_64.hh>
 #include <lcc/ir/ir.hh>
+#include <lcc/ir/type.hh>
+
+#include <algorithm>
+#include <vector>
 
 namespace lcc::cconv::sysv {
 
@@ -17,6 +21,16 @@ constexpr const std::array<usz, 6> arg_regs = {
     +x86_64::RegisterId::R9 //
 };
 
+/// Registers that values of the REGISTER class are returned in, one per
+/// eightbyte.
+constexpr const std::array<usz, 2> return_regs = {
+    +x86_64::RegisterId::RAX,
+    +x86_64::RegisterId::RDX //
+};
+
+/// REGISTER is what the ABI calls INTEGER: each eightbyte of the value
+/// goes in a general purpose register. We have no floating point types,
+/// so nothing is ever of class SSE.
 enum class ParameterClass {
     INVALID,
 
@@ -26,6 +40,54 @@ enum class ParameterClass {
     COUNT
 };
 
+struct Classification {
+    ParameterClass kind{ParameterClass::INVALID};
+    /// The amount of registers a value of the REGISTER class takes up.
+    usz eightbytes{};
+};
+
+namespace detail {
+/// Whether every integer and pointer within \p type is naturally aligned
+/// if \p type starts \p offset bits into an aggregate.
+inline auto is_aligned(const Type* type, usz offset) -> bool {
+    if (offset % type->align()) return false;
+    if (auto* s = cast<StructType>(type)) {
+        for (auto* member : s->members()) {
+            if (not is_aligned(member, offset)) return false;
+            offset += member->bits();
+        }
+    } else if (auto* a = cast<ArrayType>(type)) {
+        for (usz i = 0; i < a->length(); ++i) {
+            if (not is_aligned(a->element_type(), offset)) return false;
+            offset += a->element_type()->bits();
+        }
+    }
+    return true;
+}
+} // namespace detail
+
+/// Classify a value of type \p type, ignoring how many registers are left.
+///
+/// Anything larger than two eightbytes, or with a member that isn't
+/// naturally aligned, is passed in memory. Everything else is split into
+/// eightbytes, each of which goes in a register of its own.
+inline auto classify(const Type* type) -> Classification {
+    auto bytes = type->bytes();
+    if (bytes == 0) return {ParameterClass::REGISTER, 0};
+    if (bytes > 2 * x86_64::GeneralPurposeBytewidth or not detail::is_aligned(type, 0))
+        return {ParameterClass::MEMORY, 0};
+    return {
+        ParameterClass::REGISTER,
+        (bytes + x86_64::GeneralPurposeBytewidth - 1) / x86_64::GeneralPurposeBytewidth,
+    };
+}
+
+/// Get the size of the register that holds eightbyte \p index of a value
+/// of type \p type, in bits.
+inline auto eightbyte_bits(const Type* type, usz index) -> uint {
+    return uint(std::min(type->bits() - index * x86_64::GeneralPurposeBitwidth, usz(x86_64::GeneralPurposeBitwidth)));
+}
+
 struct ParameterDescription {
     struct Parameter {
         ParameterClass kind{ParameterClass::INVALID};
@@ -35,50 +97,69 @@ struct ParameterDescription {
         /// The amount of argument registers taken up by this parameter.
         usz arg_regs{};
         usz stack_slot_index{};
+        /// Offset of a MEMORY parameter from the first one; every one of them
+        /// takes up a whole number of eightbytes.
         usz stack_byte_offset{};
+        /// The amount of stack taken up by this parameter.
+        usz stack_bytes{};
     };
     std::vector<Parameter> info;
+    /// The amount of stack taken up by all MEMORY parameters.
+    usz stack_bytes{};
 };
 
-auto parameter_description(Function* function) -> ParameterDescription {
-    // If we super-cared or measured this function as being really slow or
-    // called over and over (which won't happen), we could implement a cache
-    // on Function* here, or a name-based one.
-
+inline auto parameter_description(const std::vector<Type*>& types) -> ParameterDescription {
     ParameterDescription out{};
     ParameterDescription::Parameter working_param{};
 
-    out.info.reserve(function->params().size());
+    out.info.reserve(types.size());
 
     usz next_stack_slot_index{};
-    for (const auto* param : function->params()) {
+    for (const auto* type : types) {
         working_param.arg_regs_used += working_param.arg_regs;
-        working_param.stack_slot_index = next_stack_slot_index;
-
-        working_param.kind = ParameterClass::REGISTER;
+        working_param.stack_byte_offset += working_param.stack_bytes;
         working_param.arg_regs = 0;
+        working_param.stack_bytes = 0;
 
+        // A value that needs more registers than there are left goes in
+        // memory as a whole; any registers that are left may still be used
+        // by the parameters that follow.
+        auto classification = classify(type);
         if (
-            param->type()->bytes() <= x86_64::GeneralPurposeBytewidth
-            and working_param.arg_regs_used < arg_regs.size()
-        ) ++working_param.arg_regs;
-
-        else if (
-            param->type()->bytes() <= 2 * x86_64::GeneralPurposeBytewidth
-            and working_param.arg_regs_used < arg_regs.size() - 1
-        ) working_param.arg_regs += 2;
-
-        else {
+            classification.kind == ParameterClass::REGISTER
+            and working_param.arg_regs_used + classification.eightbytes <= arg_regs.size()
+        ) {
+            working_param.kind = ParameterClass::REGISTER;
+            working_param.arg_regs = classification.eightbytes;
+        } else {
             working_param.kind = ParameterClass::MEMORY;
-            ++next_stack_slot_index;
-            working_param.stack_byte_offset += param->type()->bytes();
+            working_param.stack_slot_index = next_stack_slot_index++;
+            working_param.stack_bytes = utils::AlignTo(type->bytes(), usz(x86_64::GeneralPurposeBytewidth));
         }
 
         out.info.emplace_back(working_param);
     }
 
+    out.stack_bytes = working_param.stack_byte_offset + working_param.stack_bytes;
     return out;
-};
+}
+
+inline auto parameter_description(Function* function) -> ParameterDescription {
+    // If we super-cared or measured this function as being really slow or
+    // called over and over (which won't happen), we could implement a cache
+    // on Function* here, or a name-based one.
+    std::vector<Type*> types{};
+    types.reserve(function->params().size());
+    for (auto* param : function->params()) types.push_back(param->type());
+    return parameter_description(types);
+}
+
+inline auto parameter_description(CallInst* call) -> ParameterDescription {
+    std::vector<Type*> types{};
+    types.reserve(call->args().size());
+    for (auto* arg : call->args()) types.push_back(arg->type());
+    return parameter_description(types);
+}
 
 } // namespace lcc::cconv::sysv
 
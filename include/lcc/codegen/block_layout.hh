@@ -0,0 +1,26 @@
+#ifndef LCC_CODEGEN_BLOCK_LAYOUT_HH
+#define LCC_CODEGEN_BLOCK_LAYOUT_HH
+
+#include <lcc/forward.hh>
+
+namespace lcc {
+
+/// Reorder the blocks of \p function so that each block is followed by
+/// its most likely successor wherever possible, which lets the branch
+/// to that successor fall through instead of jumping.
+///
+/// How likely an edge is taken is estimated statically: blocks nested
+/// more deeply in loops run more often, loop exits and paths that end
+/// in `unreachable` are unlikely to be taken. If every block carries a
+/// profile count, those counts are used instead. The entry block stays
+/// first, and blocks keep their original order where nothing suggests
+/// otherwise.
+///
+/// This only moves blocks around; removing the branches that have
+/// become redundant is up to the target, since that depends on what
+/// branch instructions it has.
+void layout_blocks(MFunction& function);
+
+} // namespace lcc
+
+#endif /* LCC_CODEGEN_BLOCK_LAYOUT_HH */
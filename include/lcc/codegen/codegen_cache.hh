@@ -0,0 +1,55 @@
+#ifndef LCC_CODEGEN_CODEGEN_CACHE_HH
+#define LCC_CODEGEN_CODEGEN_CACHE_HH
+
+#include <lcc/codegen/x86_64/object.hh>
+#include <lcc/file.hh>
+#include <lcc/forward.hh>
+#include <lcc/utils.hh>
+
+#include <optional>
+#include <string>
+
+namespace lcc {
+/// On-disk cache of the machine code of functions emitted into object
+/// files, so that functions which did not change since an earlier
+/// compilation skip instruction selection, register allocation, and
+/// encoding altogether.
+///
+/// A function is keyed on its IR as it is printed, which numbers its
+/// values and blocks from zero and refers to everything else by name,
+/// along with the names of its blocks, their profile counts, the
+/// layout of every struct type it refers to by name, and whatever else
+/// code generation depends on: the target, the object format, and the
+/// options that change the code we generate. There is
+/// one entry per key, named after a hash of it; an entry also holds the
+/// whole key, and is only used if that matches, so a hash collision
+/// can't ever splice in the wrong code.
+///
+/// Entries are written to a temporary file and renamed into place, so
+/// concurrent compilations sharing a cache never see partial entries.
+class CodegenCache {
+    fs::path _directory;
+
+    /// Everything besides the IR that the key depends on.
+    std::string _configuration;
+
+public:
+    CodegenCache(Context* ctx, fs::path directory);
+
+    /// Get the key of \p f, which must be defined in the module.
+    [[nodiscard]]
+    auto key(Function* f) const -> std::string;
+
+    /// Get what the function with key \p key was encoded to, if there is
+    /// a valid entry for it.
+    [[nodiscard]]
+    auto lookup(const std::string& key) const -> std::optional<x86_64::EncodedFunction>;
+
+    /// Cache what the function with key \p key was encoded to.
+    ///
+    /// Failing to write to the cache is not an error.
+    void store(const std::string& key, const x86_64::EncodedFunction& encoded) const;
+};
+} // namespace lcc
+
+#endif /* LCC_CODEGEN_CODEGEN_CACHE_HH */
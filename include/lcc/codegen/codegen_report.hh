@@ -0,0 +1,57 @@
+#ifndef LCC_CODEGEN_REPORT_HH
+#define LCC_CODEGEN_REPORT_HH
+
+#include <lcc/utils.hh>
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace lcc {
+/// What code generation made of each function, for `--codegen-report`.
+///
+/// This is meant to point out the functions in which improvements to
+/// the backend would pay off most, e.g. the ones that grow the most in
+/// instruction selection, that spill, or that are simply the largest.
+class CodegenReport {
+public:
+    struct Function {
+        std::string name;
+
+        /// Number of MIR instructions before and after instruction
+        /// selection.
+        usz mir_instructions{};
+        usz selected_instructions{};
+
+        /// From the register allocator.
+        usz virtual_registers{};
+        usz interference_edges{};
+        usz removed_moves{};
+        usz spills{};
+
+        /// Bytes of stack below the saved frame pointer, i.e. locals,
+        /// padding, and saved callee-saved registers.
+        usz frame_size{};
+
+        /// Size of the encoded machine code. This is only known if an
+        /// object file is emitted, since the assembler does the encoding
+        /// otherwise.
+        std::optional<usz> code_size{};
+    };
+
+private:
+    std::vector<Function> functions{};
+    std::mutex mutex{};
+
+public:
+    /// Add the functions of a module.
+    void add(std::vector<Function> module_functions);
+
+    /// Format the report as a table, largest functions first.
+    [[nodiscard]]
+    auto str() -> std::string;
+};
+} // namespace lcc
+
+#endif // LCC_CODEGEN_REPORT_HH
@@ -4,25 +4,19 @@
 #include <lcc/codegen/mir.hh>
 #include <lcc/ir/module.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/arena.hh>
 #include <lcc/utils/result.hh>
-#include <unordered_map>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <span>
+#include <type_traits>
 #include <variant>
 
 namespace lcc {
 namespace isel {
 
-/// `while`-like iteration over a template parameter pack.
-template <typename... pack>
-constexpr void While(bool& cond, auto&& lambda) {
-    auto impl = [&]<typename t>() {
-        if (not cond) return false;
-        lambda.template operator()<t>();
-        return true;
-    };
-
-    (impl.template operator()<pack>() and ...);
-}
-
 template <typename... pack>
 constexpr void Foreach(auto&& lambda) {
     (lambda.template operator()<pack>(), ...);
@@ -256,6 +250,9 @@ struct r {
     static constexpr usz value = register_value;
 };
 
+/// Marks a v<index> that has not been assigned a virtual register yet.
+inline constexpr usz no_virtual = usz(-1);
+
 template <typename clobbers_, usz opcode_, typename... operands>
 struct Inst {
     using clobbers = clobbers_;
@@ -271,23 +268,18 @@ struct Inst {
     template <typename operand>
     static constexpr auto get_operand(
         Module* mod,
-        MFunction& function,       // for locals lookup
-        std::vector<MInst*> input, // for Input*Reference,
-        std::unordered_map<usz, usz>& new_virtuals
+        MFunction& function,             // for locals lookup
+        std::span<MInst* const> input,   // for Input*Reference,
+        std::span<usz> new_virtuals      // indexed by v<index>
     ) -> MOperand {
-        const auto input_operand_by_index = [&](usz index) -> Result<MOperand> {
-            // Current operand index.
-            usz i = 0;
-            for (auto instruction : input) {
-                for (auto op_candidate : instruction->all_operands()) {
-                    // This is the instruction we are looking for!
-                    if (i == index) return op_candidate;
-
-                    // Increment operand index for the next operand.
-                    ++i;
-                }
+        // Operands are numbered across all input instructions, in order.
+        const auto input_operand_by_index = [&](usz index) -> const MOperand* {
+            for (auto* instruction : input) {
+                const auto& ops = instruction->all_operands();
+                if (index < ops.size()) return &ops[index];
+                index -= ops.size();
             }
-            return {};
+            return nullptr;
         };
 
         switch (operand::kind) {
@@ -354,37 +346,14 @@ struct Inst {
             }
 
             case OperandKind::NewVirtual: {
-                if (not new_virtuals.contains(operand::index)) {
-                    new_virtuals[operand::index] = mod->next_vreg();
-                }
-
-                MOperand op{};
-                // Current operand index.
-                usz i = 0;
-                // Operand index we need to find.
-                usz needle = operand::size;
-                // Whether or not we've found the operand we are looking for.
-                bool found = false;
-                for (auto* instruction : input) {
-                    for (auto op_candidate : instruction->all_operands()) {
-                        // This is the instruction we are looking for!
-                        if (i == needle) {
-                            found = true;
-                            op = op_candidate;
-                        }
-
-                        // We can stop looking at operands if we found the one we needed.
-                        if (found) break;
-
-                        // Increment operand index for the next operand.
-                        ++i;
-                    }
-                    // We can stop looking at instructions if we found the operand we needed.
-                    if (found) break;
-                }
+                LCC_ASSERT(operand::index < new_virtuals.size());
+                if (new_virtuals[operand::index] == no_virtual)
+                    new_virtuals[operand::index] = function.next_vreg();
 
+                auto op_result = input_operand_by_index(operand::size);
                 // FIXME: Which pattern? Possible to include it in error message somehow?
-                LCC_ASSERT(found, "Pattern has ill-formed o<{}> operand: index greater than amount of operands in input.", needle);
+                LCC_ASSERT(op_result, "Pattern has ill-formed o<{}> operand: index greater than amount of operands in input.", operand::size);
+                auto op = *op_result;
 
                 usz size = 0;
                 if (std::holds_alternative<MOperandRegister>(op))
@@ -425,25 +394,9 @@ struct Inst {
             }
 
             case OperandKind::InputInstructionReference: {
-                MOperand op{};
-                // Current instruction index.
-                usz i = 0;
-                // Instruction index we need to find.
-                usz needle = operand::index;
-                // Whether or not we've found the instruction we are looking for.
-                bool found = false;
-                for (auto instruction : input) {
-                    if (i == needle) {
-                        found = true;
-                        op = MOperandRegister(instruction->reg(), uint(instruction->regsize()));
-                    }
-                    if (found) break;
-                    ++i;
-                }
-
-                LCC_ASSERT(found, "Pattern has ill-formed i<{}> operand: index greater than amount of instructions in input.", needle);
-
-                return op;
+                LCC_ASSERT(operand::index < input.size(), "Pattern has ill-formed i<{}> operand: index greater than amount of instructions in input.", operand::index);
+                auto* instruction = input[operand::index];
+                return MOperandRegister(instruction->reg(), uint(instruction->regsize()));
             }
         }
         LCC_UNREACHABLE();
@@ -461,173 +414,340 @@ struct InstList {
     }
 };
 
-template <typename in, typename out>
+/// The condition of a pattern that matches whenever the opcodes and the
+/// kinds of the operands of its input do.
+struct Always {
+    static auto matches(std::span<MInst* const>, const MInst*) -> bool { return true; }
+};
+
+/// A pattern may have a condition on the actual operands of the input
+/// instructions, which is checked after their opcodes and operand kinds
+/// match: `condition::matches(input, next)`, where \p next is the
+/// instruction after the input, or null if the input is at the end of
+/// the block.
+template <typename in, typename out, typename cond = Always>
 struct Pattern {
     using input = in;
     using output = out;
+    using condition = cond;
 };
 
 template <typename... Patterns>
 struct PatternList {
-    static MFunction rewrite(lcc::Module* mod, MFunction& function) {
-        MFunction out{function.calling_convention()};
-        out.names() = function.names();
-        out.locals() = function.locals();
-        out.location(function.location());
+    static_assert(sizeof...(Patterns), "Cannot do instruction selection with no input patterns to match");
+
+    /// The opcode and the kinds of all operands of an instruction, which
+    /// is all that needs to match for a pattern instruction to match an
+    /// instruction.
+    ///
+    /// The lowest byte is the operand count, followed by three bits for
+    /// each operand. Instructions with too many operands for that have
+    /// no valid signature, and thus never match.
+    struct Signature {
+        static constexpr usz max_operands = (64 - 8) / 3;
+        static constexpr u64 invalid = u64(-1);
+
+        usz opcode;
+        u64 operands;
+
+        [[nodiscard]]
+        constexpr auto operator<=>(const Signature&) const = default;
+    };
+
+    [[nodiscard]]
+    static auto signature(const MInst& instruction) -> Signature {
+        static_assert(
+            std::variant_size_v<MOperand> == 6,
+            "Exhaustive handling of MOperand alternatives in instruction selection"
+        );
+
+        const auto& operands = instruction.all_operands();
+        if (operands.size() > Signature::max_operands) return {instruction.opcode(), Signature::invalid};
+
+        u64 kinds = operands.size();
+        usz shift = 8;
+        for (const auto& operand : operands) {
+            kinds |= u64(operand.index() + 1) << shift;
+            shift += 3;
+        }
+        return {instruction.opcode(), kinds};
+    }
 
-        // Get the longest input pattern length
-        usz longest_pattern_length = 0;
-        Foreach<Patterns...>([&]<typename _> {
-            ++longest_pattern_length;
+    template <typename inst>
+    [[nodiscard]]
+    static constexpr auto signature() -> Signature {
+        static_assert(inst::operand_count <= Signature::max_operands, "Too many operands in input pattern instruction");
+
+        u64 kinds = inst::operand_count;
+        usz shift = 8;
+        inst::foreach_operand([&]<typename op> {
+            // Map each operand kind to the index of the MOperand alternative
+            // it matches, plus one; other kinds never match anything.
+            u64 kind = 7;
+            switch (op::kind) {
+                case OperandKind::Register: kind = 1; break;
+                case OperandKind::Immediate: kind = 2; break;
+                case OperandKind::Local: kind = 3; break;
+                case OperandKind::Global: kind = 4; break;
+                case OperandKind::Function: kind = 5; break;
+                case OperandKind::Block: kind = 6; break;
+                default: break;
+            }
+            kinds |= kind << shift;
+            shift += 3;
         });
-        LCC_ASSERT(longest_pattern_length, "Cannot do instruction selection with no input patterns to match");
+        return {inst::opcode, kinds};
+    }
 
-        // NOTE: If you modify block.instructions() in any way, you are going to
-        // have a bad time.
-        std::vector<MInst*> instructions{};
-        // Any instructions we allocate are stored here, so that we can free them
-        // after everything has been inserted as a value. Ideally we wouldn't have
-        // to do this, but I can't make a vector of references, sadly.
-        std::vector<MInst*> pool{};
+    /// Which pattern to try for instructions with a given signature.
+    struct DispatchEntry {
+        Signature first;
+        usz pattern;
+    };
 
-        for (auto& old_block : function.blocks()) {
-            out.add_block(MBlock(old_block));
-            auto& new_block = out.blocks().back();
-            new_block.instructions().clear();
+    /// Every pattern, keyed on the signature of its first instruction, in
+    /// order of priority among patterns with the same key.
+    static constexpr auto dispatch_table = [] {
+        std::array<DispatchEntry, sizeof...(Patterns)> table{};
+        usz index = 0;
+        Foreach<Patterns...>([&]<typename pattern> {
+            static_assert(pattern::input::size(), "Input pattern must not be empty");
+            bool first = true;
+            pattern::input::foreach ([&]<typename inst> {
+                if (first) table[index] = {signature<inst>(), index};
+                first = false;
+            });
+            ++index;
+        });
+        std::sort(table.begin(), table.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first < b.first : a.pattern < b.pattern;
+        });
+        return table;
+    }();
 
-            usz instructions_handled = 0;
-            do {
-                for (; instructions_handled < old_block.instructions().size(); ++instructions_handled) {
-                    // Add (up to) `longest_pattern_length` instructions to the instructions vector.
-                    if (instructions.size() >= longest_pattern_length) break;
-                    instructions.push_back(old_block.instructions().data() + instructions_handled);
-                }
+    /// The length of the longest input pattern.
+    static constexpr usz longest_pattern_length = std::max({Patterns::input::size()...});
 
-                bool to_be_handled = true;
-                While<Patterns...>(to_be_handled, [&]<typename pattern>() {
-                    // If the input pattern is longer than the current amount of instructions,
-                    // skip this pattern.
-                    if (pattern::input::size() > instructions.size()) return;
-
-                    // Ensure all opcodes and operand types match from the input pattern.
-                    usz input_i = 0;
-                    bool pattern_matches = true;
-                    pattern::input::foreach ([&]<typename inst> {
-                        // If the pattern has failed to match, skip the rest of the instructions
-                        // in the pattern.
-                        if (not pattern_matches) return;
-
-                        auto& instruction = instructions[input_i];
-
-                        // If the `i`th input instruction's opcode doesn't match the `i`th
-                        // instruction window's opcode, the pattern does not match.
-                        if (instruction->opcode() != inst::opcode) {
-                            pattern_matches = false;
-                            return;
-                        }
+    /// The length of the longest output pattern.
+    static constexpr usz longest_output_length = std::max({Patterns::output::size()...});
 
-                        // Ensure operand amount and kinds match the input pattern.
-                        bool operands_match = false;
-                        if (inst::operand_count == instruction->all_operands().size()) {
-                            operands_match = true;
-
-                            usz op_i = 0;
-                            inst::foreach_operand([&]<typename op> {
-                                // If the operands have failed to match, skip the rest of the operands.
-                                if (not operands_match) return;
-
-                                auto& operand = instruction->all_operands().at(op_i);
-                                static_assert(
-                                    std::variant_size_v<MOperand> == 6,
-                                    "Exhaustive handling of MOperand alternatives in instruction selection"
-                                );
-                                if (std::holds_alternative<MOperandImmediate>(operand)) {
-                                    operands_match = op::kind == OperandKind::Immediate;
-                                } else if (std::holds_alternative<MOperandRegister>(operand)) {
-                                    operands_match = op::kind == OperandKind::Register;
-                                } else if (std::holds_alternative<MOperandLocal>(operand)) {
-                                    operands_match = op::kind == OperandKind::Local;
-                                } else if (std::holds_alternative<MOperandGlobal>(operand)) {
-                                    operands_match = op::kind == OperandKind::Global;
-                                } else if (std::holds_alternative<MOperandFunction>(operand)) {
-                                    operands_match = op::kind == OperandKind::Function;
-                                } else if (std::holds_alternative<MOperandBlock>(operand)) {
-                                    operands_match = op::kind == OperandKind::Block;
-                                } else LCC_ASSERT(false, "Unhandled MIR Operand Kind in ISel...");
-                                ++op_i;
-                            });
-                        }
+    /// The number of instructions after the longest input pattern that
+    /// are in the window, for the conditions of patterns to look at.
+    static constexpr usz lookahead = 1;
+
+    /// An instruction in the window, which is either one of the input
+    /// instructions or an output instruction of a pattern that lives in
+    /// the arena of the function.
+    struct Slot {
+        MInst* instruction;
+        bool in_arena;
+    };
+
+    /// The instructions patterns are matched against.
+    ///
+    /// This is only ever topped off to longest_pattern_length + lookahead
+    /// instructions, and a pattern that matches replaces at least one of
+    /// them with at most longest_output_length ones, so there is room for
+    /// everything unless patterns keep expanding each other's outputs.
+    struct Window {
+        static constexpr usz capacity = longest_pattern_length + longest_output_length + lookahead;
+
+        std::array<Slot, capacity> slots{};
+        usz size{};
 
-                        pattern_matches = operands_match;
+        [[nodiscard]]
+        auto operator[](usz index) const -> MInst* { return slots[index].instruction; }
 
-                        ++input_i;
-                    });
+        void push_back(Slot slot) {
+            LCC_ASSERT(size < capacity, "ISel window overflow");
+            slots[size++] = slot;
+        }
+
+        /// Remove the first \p count slots and return them.
+        template <usz count>
+        auto pop_front() -> std::array<Slot, count> {
+            std::array<Slot, count> front{};
+            std::copy_n(slots.begin(), count, front.begin());
+            std::copy(slots.begin() + count, slots.begin() + isz(size), slots.begin());
+            size -= count;
+            return front;
+        }
+
+        /// Insert slots at the front.
+        void push_front(std::span<const Slot> front) {
+            LCC_ASSERT(size + front.size() <= capacity, "ISel window overflow; patterns keep expanding each other's outputs");
+            std::copy_backward(slots.begin(), slots.begin() + isz(size), slots.begin() + isz(size + front.size()));
+            std::copy(front.begin(), front.end(), slots.begin());
+            size += front.size();
+        }
+    };
 
-                    // If pattern does not match, continue trying more patterns.
-                    if (not pattern_matches) return;
+    /// The number of distinct v<index> operands in the output of a pattern.
+    template <typename pattern>
+    [[nodiscard]]
+    static constexpr auto new_virtual_count() -> usz {
+        usz count = 0;
+        pattern::output::foreach ([&]<typename inst> {
+            inst::foreach_operand([&]<typename op> {
+                if constexpr (op::kind == OperandKind::NewVirtual)
+                    count = std::max(count, op::index + 1);
+            });
+        });
+        return count;
+    }
 
-                    // Remove pattern input instruction(s) from instruction window,
-                    // keeping references to it/them.
-                    std::vector<MInst*> input{};
-                    input.insert(input.begin(), instructions.begin(), instructions.begin() + pattern::input::size());
-                    instructions.erase(instructions.begin(), instructions.begin() + pattern::input::size());
+    /// If \p pattern matches the front of \p window, replace its input
+    /// instructions there with its output instructions, which are
+    /// allocated in \p arena.
+    template <typename pattern>
+    static auto try_pattern(
+        lcc::Module* mod,
+        MFunction& function,
+        Window& window,
+        Arena& arena
+    ) -> bool {
+        // If the input pattern is longer than the current amount of instructions,
+        // it cannot match.
+        if (pattern::input::size() > window.size) return false;
+
+        // Ensure all opcodes and operand kinds match the input pattern.
+        usz input_i = 0;
+        bool pattern_matches = true;
+        pattern::input::foreach ([&]<typename inst> {
+            if (not pattern_matches) return;
+            pattern_matches = signature(*window[input_i]) == signature<inst>();
+            ++input_i;
+        });
+        if (not pattern_matches) return false;
+
+        // Check the condition before anything is removed from the window.
+        if constexpr (not std::is_same_v<typename pattern::condition, Always>) {
+            std::array<MInst*, pattern::input::size()> candidates{};
+            std::transform(
+                window.slots.begin(),
+                window.slots.begin() + isz(candidates.size()),
+                candidates.begin(),
+                [](const Slot& slot) { return slot.instruction; }
+            );
+            auto* next = window.size > candidates.size() ? window[candidates.size()] : nullptr;
+            if (not pattern::condition::matches(candidates, next)) return false;
+        }
 
-                    // Add pattern output instruction(s) to instruction window, fixing
-                    // up reference-type operands (operand references get updated to the
-                    // operand they reference).
+        // Remove pattern input instruction(s) from instruction window,
+        // keeping references to it/them.
+        auto input_slots = window.template pop_front<pattern::input::size()>();
+        std::array<MInst*, pattern::input::size()> input{};
+        rgs::transform(input_slots, input.begin(), &Slot::instruction);
+
+        // Build the pattern output instruction(s), fixing up reference-type
+        // operands (operand references get updated to the operand they
+        // reference).
+
+        // The id of the new virtual register each v<index> should be replaced
+        // with.
+        std::array<usz, new_virtual_count<pattern>()> new_virtuals{};
+        new_virtuals.fill(no_virtual);
+
+        std::array<Slot, pattern::output::size()> output{};
+        usz output_i = 0;
+        pattern::output::foreach ([&]<typename inst> {
+            // Use instruction's vreg from input of pattern.
+            auto* out = arena.make<MInst>(inst::opcode, MOperandRegister{input.back()->reg(), uint(input.back()->regsize())});
+            // Use instruction's location from input of pattern.
+            out->location(input.back()->location());
+
+            inst::clobbers::foreach ([&]<typename clobber> {
+                if constexpr (clobber::kind == ClobberKind::Operand)
+                    out->add_operand_clobber(clobber::index);
+                else if constexpr (clobber::kind == ClobberKind::RegisterValue)
+                    LCC_ASSERT(false, "TODO: Register clobbers member in MIR");
+            });
+
+            out->all_operands().reserve(inst::operand_count);
+            inst::foreach_operand([&]<typename op> {
+                out->add_operand(inst::template get_operand<op>(mod, function, input, new_virtuals));
+            });
+
+            // Stupidly match use count (not sure if even necessary).
+            usz use_count = input.back()->use_count();
+            while (use_count--) out->add_use();
+
+            output[output_i++] = {out, true};
+        });
 
-                    // Map of the index from v<index> to the id of the new virtual register it
-                    // should be replaced with.
-                    std::unordered_map<usz, usz> new_virtuals{};
+        // Add pattern output instruction(s) to the instruction window. Any
+        // input that was itself the output of a pattern is no longer needed.
+        window.push_front(output);
+        for (auto slot : input_slots)
+            if (slot.in_arena)
+                std::destroy_at(slot.instruction);
 
-                    isz output_i = 0;
-                    pattern::output::foreach ([&]<typename inst> {
-                        // Use instruction's vreg from input of pattern.
-                        auto* output = new MInst(inst::opcode, {input.back()->reg(), uint(input.back()->regsize())});
-                        // Use instruction's location from input of pattern.
-                        output->location(input.back()->location());
+        return true;
+    }
 
-                        // Keep track of newly allocated machine instructions.
-                        pool.push_back(output);
-                        instructions.insert(instructions.begin() + output_i, output);
+    static constexpr std::array patterns{&try_pattern<Patterns>...};
 
-                        inst::clobbers::foreach ([&]<typename clobber> {
-                            if constexpr (clobber::kind == ClobberKind::Operand)
-                                output->add_operand_clobber(clobber::index);
-                            else if constexpr (clobber::kind == ClobberKind::RegisterValue)
-                                LCC_ASSERT(false, "TODO: Register clobbers member in MIR");
-                        });
+    /// Rewrite the instructions of \p function, which are moved into the
+    /// result. This is used both to select instructions and to optimise
+    /// them once registers have been allocated.
+    static MFunction rewrite(lcc::Module* mod, MFunction& function) {
+        MFunction out{function.calling_convention()};
+        out.names() = function.names();
+        out.locals() = function.locals();
+        if (not function.local_offsets().empty())
+            out.assign_local_offsets(function.local_offsets(), function.locals_size());
+        out.location(function.location());
+        out.registers_used() = function.registers_used();
+        out.sysv_integer_parameters_seen = function.sysv_integer_parameters_seen;
 
-                        inst::foreach_operand([&]<typename op> {
-                            output->add_operand(inst::template get_operand<op>(mod, function, input, new_virtuals));
-                        });
+        // Output instructions of patterns live here until they are moved into
+        // a block (or replaced by the output of another pattern).
+        Arena arena{};
+        Window window{};
 
-                        // Stupidly match use count (not sure if even necessary).
-                        usz use_count = input.back()->use_count();
-                        while (use_count--) output->add_use();
+        for (auto& old_block : function.blocks()) {
+            MBlock block{old_block.name()};
+            block.successors() = old_block.successors();
+            block.predecessors() = old_block.predecessors();
+            block.location(old_block.location());
+            block.profile_count(old_block.profile_count());
+            block.instructions().reserve(old_block.instructions().size());
+            out.add_block(std::move(block));
+            auto& new_block = out.blocks().back();
 
-                        ++output_i;
-                    });
+            usz instructions_handled = 0;
+            do {
+                for (; instructions_handled < old_block.instructions().size(); ++instructions_handled) {
+                    // Add (up to) `longest_pattern_length + lookahead` instructions to the instruction window.
+                    if (window.size >= longest_pattern_length + lookahead) break;
+                    window.push_back({old_block.instructions().data() + instructions_handled, false});
+                }
 
-                    to_be_handled = false; // break
-                });
+                // Only try the patterns whose first instruction matches the first
+                // instruction in the window, in order.
+                bool to_be_handled = true;
+                if (window.size) {
+                    auto [first, last] = std::equal_range(
+                        dispatch_table.begin(),
+                        dispatch_table.end(),
+                        DispatchEntry{signature(*window[0]), 0},
+                        [](const auto& a, const auto& b) { return a.first < b.first; }
+                    );
+                    for (auto entry = first; entry != last; ++entry) {
+                        if (patterns[entry->pattern](mod, function, window, arena)) {
+                            to_be_handled = false;
+                            break;
+                        }
+                    }
+                }
 
                 // If we get through *all* of the patterns, and none of them matched, we
                 // can pop an instruction off the front and emit it into the output,
                 // before going back to the "add instructions" bit.
-                if (to_be_handled) {
-                    if (instructions.size()) {
-                        // Add front of `instructions` to emission output.
-                        auto inst = instructions.front();
-                        new_block.insert(*inst);
-                        // Pop instruction from front of instruction window.
-                        instructions.erase(instructions.begin());
-                        // If instruction was a temporary allocation, free it.
-                        if (auto found = rgs::find(pool, inst) != pool.end()) {
-                            std::erase(pool, inst);
-                            delete inst;
-                        }
-                    }
+                if (to_be_handled and window.size) {
+                    auto [slot] = window.template pop_front<1>();
+                    new_block.insert(std::move(*slot.instruction));
+                    if (slot.in_arena) std::destroy_at(slot.instruction);
                 }
 
                 // If there are still instructions in the window to be handled, go back
@@ -635,9 +755,11 @@ struct PatternList {
                 // instructions that there may be). If the window is empty, but there are
                 // still more instructions to handle in this block, also go back and
                 // handle them.
-            } while (not instructions.empty() or instructions_handled < old_block.instructions().size());
+            } while (window.size or instructions_handled < old_block.instructions().size());
         }
 
+        // Patterns allocate their new virtual registers in the input.
+        out.vreg_end(function.vreg_end());
         return out;
     }
 };
@@ -0,0 +1,142 @@
+#ifndef LCC_CODEGEN_LIVENESS_HH
+#define LCC_CODEGEN_LIVENESS_HH
+
+#include <lcc/codegen/mir.hh>
+#include <lcc/utils.hh>
+
+#include <bit>
+#include <variant>
+#include <vector>
+
+namespace lcc {
+
+/// Set of registers of a function, by index into its register list.
+class RegisterSet {
+    std::vector<u64> words;
+
+public:
+    explicit RegisterSet(usz size = 0) : words((size + 63) / 64) {}
+
+    void insert(usz i) { words[i / 64] |= u64(1) << (i % 64); }
+    void erase(usz i) { words[i / 64] &= ~(u64(1) << (i % 64)); }
+
+    [[nodiscard]]
+    auto contains(usz i) const -> bool { return words[i / 64] & (u64(1) << (i % 64)); }
+
+    /// Add all registers in another set.
+    auto operator|=(const RegisterSet& other) -> RegisterSet& {
+        for (usz i = 0; i < words.size(); i++) words[i] |= other.words[i];
+        return *this;
+    }
+
+    /// Remove all registers in another set.
+    auto operator-=(const RegisterSet& other) -> RegisterSet& {
+        for (usz i = 0; i < words.size(); i++) words[i] &= ~other.words[i];
+        return *this;
+    }
+
+    [[nodiscard]]
+    auto operator==(const RegisterSet& other) const -> bool = default;
+
+    /// Call a function with the index of every register in the set.
+    template <typename Callback>
+    void for_each(Callback cb) const {
+        for (usz w = 0; w < words.size(); w++) {
+            for (u64 bits = words[w]; bits; bits &= bits - 1)
+                cb(w * 64 + usz(std::countr_zero(bits)));
+        }
+    }
+};
+
+/// Maps register values to their index in the register list of a function.
+///
+/// Hardware registers are numbered below MInst::Kind::ArchStart, and
+/// virtual registers densely per function above it, so this is a flat
+/// table indexed by register value.
+class RegisterIndex {
+    static constexpr usz absent = usz(-1);
+    std::vector<usz> indices;
+
+public:
+    /// Make room for registers below \p end.
+    explicit RegisterIndex(usz end = 0) : indices(end, absent) {}
+
+    /// Add a register; returns false if it was already present.
+    auto add(usz value, usz index) -> bool {
+        if (value >= indices.size()) indices.resize(value + 1, absent);
+        if (indices[value] != absent) return false;
+        indices[value] = index;
+        return true;
+    }
+
+    [[nodiscard]]
+    auto operator[](usz value) const -> usz {
+        LCC_ASSERT(
+            value < indices.size() and indices[value] != absent,
+            "Did not find referenced register in register list"
+        );
+        return indices[value];
+    }
+};
+
+/// Walking backwards over an instruction, remove the registers it
+/// defines from a live set. This happens before the instruction
+/// itself is considered, i.e. these registers are not live during it.
+template <typename Set>
+void KillDefinitions(const MInst& inst, const RegisterIndex& indices, Set& live) {
+    if (inst.is_defining()) live.erase(indices[inst.reg()]);
+    for (auto& op : inst.all_operands()) {
+        if (std::holds_alternative<MOperandRegister>(op)) {
+            auto reg = std::get<MOperandRegister>(op);
+            if (reg.defining_use) live.erase(indices[reg.value]);
+        }
+    }
+}
+
+/// Walking backwards over an instruction, add the virtual registers it
+/// uses to a live set, after the instruction has been considered.
+template <typename Set>
+void AddUses(const MInst& inst, const RegisterIndex& indices, Set& live) {
+    constexpr usz first_virtual = +MInst::Kind::ArchStart;
+    if (inst.reg() >= first_virtual) live.insert(indices[inst.reg()]);
+    for (auto& op : inst.all_operands()) {
+        if (std::holds_alternative<MOperandRegister>(op)) {
+            auto reg = std::get<MOperandRegister>(op);
+            if (reg.value >= first_virtual and not reg.defining_use)
+                live.insert(indices[reg.value]);
+        }
+    }
+
+    // Handle the case of a non-defining register operand in use of the
+    // instruction that defines that register.
+    if (inst.is_defining()) live.erase(indices[inst.reg()]);
+}
+
+/// Registers live on entry to and exit from every block of a machine
+/// function.
+///
+/// This is computed by the usual backwards dataflow analysis: each block
+/// is summarised by the registers it uses before defining them and the
+/// registers it defines; the live-in and live-out sets are then iterated
+/// to a fixpoint over the blocks in post-order.
+class Liveness {
+    std::vector<RegisterSet> _live_in;
+    std::vector<RegisterSet> _live_out;
+
+public:
+    /// Compute liveness for \p function, whose registers are numbered
+    /// by \p indices, and of which there are \p register_count.
+    Liveness(const MFunction& function, const RegisterIndex& indices, usz register_count);
+
+    /// Registers live on entry to the block at this index.
+    [[nodiscard]]
+    auto live_in(usz block) const -> const RegisterSet& { return _live_in.at(block); }
+
+    /// Registers live on exit from the block at this index.
+    [[nodiscard]]
+    auto live_out(usz block) const -> const RegisterSet& { return _live_out.at(block); }
+};
+
+} // namespace lcc
+
+#endif // LCC_CODEGEN_LIVENESS_HH
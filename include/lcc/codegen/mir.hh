@@ -4,9 +4,14 @@
 #include <lcc/ir/ir.hh>
 #include <lcc/ir/module.hh>
 #include <lcc/location.hh>
+#include <lcc/mem_report.hh>
+#include <lcc/trace.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/small_vector.hh>
 
+#include <optional>
 #include <set>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -68,6 +73,7 @@ public:
         Branch,
         CondBranch,
         Return,
+        TailCall,
         Unreachable,
 
         /// Unary instructions
@@ -117,9 +123,9 @@ private:
 
     usz _use_count{0};
 
-    // Possible Performance TODO: Do small string optimisation, basically.
-    // For operands, instructions in MBlocks, and blocks in MFunctions.
-    std::vector<MOperand> operands{};
+    // Nearly all instructions have at most three operands, which are stored
+    // inline, so most instructions don't allocate at all.
+    SmallVector<MOperand, 3> operands{};
 
     // Indices of operands of this instruction that this instruction clobbers.
     // An instruction is said to clobber an operand iff that instruction will
@@ -128,7 +134,7 @@ private:
     // that all live values will interfere with the clobber.
     // If multiple register operands appear in an instruction, they usually
     // interfere with each other, but clobbering alters that behaviour.
-    std::vector<usz> _operand_clobbers{};
+    SmallVector<usz, 1> _operand_clobbers{};
 
     Location _location;
 
@@ -188,25 +194,32 @@ public:
     }
 
     [[nodiscard]]
-    std::vector<MOperand>& all_operands() {
+    SmallVector<MOperand, 3>& all_operands() {
         return operands;
     }
 
     [[nodiscard]]
-    const std::vector<MOperand>& all_operands() const {
+    const SmallVector<MOperand, 3>& all_operands() const {
         return operands;
     }
 
     [[nodiscard]]
-    std::vector<usz>& operand_clobbers() {
+    SmallVector<usz, 1>& operand_clobbers() {
         return _operand_clobbers;
     }
 
     [[nodiscard]]
-    std::vector<usz> operand_clobbers() const {
+    const SmallVector<usz, 1>& operand_clobbers() const {
         return _operand_clobbers;
     }
 
+    /// Get the number of bytes of heap memory used by the operands of
+    /// this instruction.
+    [[nodiscard]]
+    auto operand_storage() const -> usz {
+        return operands.heap_bytes() + _operand_clobbers.heap_bytes();
+    }
+
     void add_operand_clobber(usz operand_index) {
         _operand_clobbers.push_back(operand_index);
     }
@@ -216,6 +229,7 @@ public:
         // TODO: noreturn calls?
         // clang-format off
         return k == Kind::Return
+            or k == Kind::TailCall
             or k == Kind::Branch
             or k == Kind::CondBranch
             or k == Kind::Unreachable;
@@ -235,8 +249,10 @@ class MBlock {
 
     Location _location;
 
+    std::optional<u64> _profile_count;
+
 public:
-    MBlock(std::string name) : _name(name){};
+    MBlock(std::string name) : _name(std::move(name)){};
 
     [[nodiscard]]
     auto instructions() -> std::vector<MInst>& {
@@ -262,6 +278,12 @@ public:
     auto location() const -> Location { return _location; }
     void location(Location location) { _location = location; }
 
+    /// How often the IR block this was generated from was executed in
+    /// a profiling run, if a profile was supplied.
+    [[nodiscard]]
+    auto profile_count() const -> std::optional<u64> { return _profile_count; }
+    void profile_count(std::optional<u64> count) { _profile_count = count; }
+
     [[nodiscard]]
     auto successors() -> std::vector<std::string>& {
         return _successors;
@@ -283,11 +305,11 @@ public:
     }
 
     void add_successor(std::string block_name) {
-        _successors.push_back(block_name);
+        _successors.push_back(std::move(block_name));
     }
 
     void add_predecessor(std::string block_name) {
-        _predecessors.push_back(block_name);
+        _predecessors.push_back(std::move(block_name));
     }
 
     bool closed() {
@@ -295,15 +317,26 @@ public:
         return MInst::is_terminator(_instructions.back().kind());
     }
 
-    void add_instruction(const MInst& inst, bool forced = false) {
+    /// Append an instruction. If \p forced, the block may already be
+    /// closed, in which case the instruction goes right before the
+    /// terminator; only the terminator is moved to make room for it.
+    void add_instruction(MInst inst, bool forced = false) {
         LCC_ASSERT(forced or not closed(), "Cannot insert into MBlock that has already been closed.");
         if (forced and closed()) {
-            _instructions.insert(_instructions.end() - 1, inst);
+            _instructions.insert(_instructions.end() - 1, std::move(inst));
             return;
         }
-        _instructions.push_back(inst);
+        _instructions.push_back(std::move(inst));
+    }
+
+    /// Construct an instruction in place at the end of this block.
+    template <typename... Args>
+    auto emplace_instruction(Args&&... args) -> MInst& {
+        LCC_ASSERT(not closed(), "Cannot insert into MBlock that has already been closed.");
+        return _instructions.emplace_back(std::forward<Args>(args)...);
     }
-    void insert(const MInst& inst) { add_instruction(inst); }
+
+    void insert(MInst inst) { add_instruction(std::move(inst)); }
 
     void remove_inst_by_reg(usz regvalue) {
         std::erase_if(_instructions, [&](const MInst& minst) -> bool {
@@ -319,8 +352,19 @@ class MFunction {
 
     std::vector<AllocaInst*> _locals{};
 
+    /// Offsets of the locals from the frame pointer, and the size of the
+    /// area they take up, once locals have been assigned stack slots that
+    /// they may share with one another. Until then, every local gets a
+    /// slot of its own.
+    std::vector<isz> _local_offsets{};
+    usz _locals_size{};
+
     std::set<u8> _registers_used{};
 
+    /// Virtual registers are numbered per function, right above the
+    /// hardware registers, so that they can index flat tables.
+    usz _next_vreg{+MInst::Kind::ArchStart};
+
     Location _location;
 
     CallConv cc;
@@ -335,7 +379,7 @@ public:
         return _names;
     }
 
-    auto names() const -> const std::vector<IRName> {
+    auto names() const -> const std::vector<IRName>& {
         return _names;
     }
 
@@ -355,8 +399,8 @@ public:
     auto location() const -> Location { return _location; }
     void location(Location location) { _location = location; }
 
-    void add_block(const MBlock& block) {
-        _blocks.push_back(block);
+    void add_block(MBlock block) {
+        _blocks.push_back(std::move(block));
     }
 
     auto locals() -> std::vector<AllocaInst*>& {
@@ -380,6 +424,8 @@ public:
         // Absolute local operand (see definition of MOperand's base type).
         if (needle == MOperandLocal::absolute_index) return 0;
 
+        if (not _local_offsets.empty()) return _local_offsets.at(needle);
+
         isz offset = 0;
         for (usz index = 0; index <= needle; ++index)
             offset -= isz(_locals.at(index)->allocated_type()->bytes());
@@ -395,6 +441,28 @@ public:
         _locals.push_back(local);
     }
 
+    /// Place the locals at the given offsets from the frame pointer, in
+    /// an area of \p size bytes below it.
+    void assign_local_offsets(std::vector<isz> offsets, usz size) {
+        LCC_ASSERT(offsets.size() == _locals.size(), "Every local needs an offset");
+        _local_offsets = std::move(offsets);
+        _locals_size = size;
+    }
+
+    /// Get the offsets assigned to the locals, if any.
+    [[nodiscard]]
+    auto local_offsets() const -> const std::vector<isz>& { return _local_offsets; }
+
+    /// Get the number of bytes below the frame pointer taken up by the
+    /// locals of this function.
+    [[nodiscard]]
+    auto locals_size() const -> usz {
+        if (not _local_offsets.empty()) return _locals_size;
+        usz size = 0;
+        for (auto* local : _locals) size += local->allocated_type()->bytes();
+        return size;
+    }
+
     auto registers_used() -> std::set<u8>& {
         return _registers_used;
     }
@@ -403,6 +471,23 @@ public:
         return _registers_used;
     }
 
+    /// Get a new virtual register.
+    [[nodiscard]]
+    auto next_vreg() -> usz { return _next_vreg++; }
+
+    /// Get one past the highest virtual register of this function.
+    [[nodiscard]]
+    auto vreg_end() const -> usz { return _next_vreg; }
+    void vreg_end(usz end) { _next_vreg = end; }
+
+    /// Get the number of instructions in all blocks of this function.
+    [[nodiscard]]
+    auto instruction_count() const -> usz {
+        usz count = 0;
+        for (auto& block : _blocks) count += block.instructions().size();
+        return count;
+    }
+
     auto block_by_name(std::string_view name) -> MBlock* {
         auto found = std::find_if(_blocks.begin(), _blocks.end(), [&](const MBlock& b) {
             return b.name() == name;
@@ -426,6 +511,7 @@ inline std::string ToString(MInst::Kind k) {
         case MInst::Kind::Branch: return "M.Branch";
         case MInst::Kind::CondBranch: return "M.CondBranch";
         case MInst::Kind::Return: return "M.Return";
+        case MInst::Kind::TailCall: return "M.TailCall";
         case MInst::Kind::Unreachable: return "M.Unreachable";
         case MInst::Kind::ZExt: return "M.ZExt";
         case MInst::Kind::SExt: return "M.SExt";
@@ -480,6 +566,13 @@ auto PrintMFunction(const MFunction& function) -> std::string;
 [[nodiscard]]
 auto PrintMIR(std::vector<GlobalVariable*>& vars, std::vector<MFunction>& mcode) -> std::string;
 
+/// Record the function an event is about in a trace.
+void TraceMFunction(Trace::Event& event, const MFunction& function);
+
+/// Record the number of MIR instructions in a memory report, along with
+/// how much memory they take up, in the phase running on this thread.
+void CountMInstructions(MemReport* report, const std::vector<MFunction>& functions);
+
 } // namespace lcc
 
 #endif // LCC_CODEGEN_MIR_HH
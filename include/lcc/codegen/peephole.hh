@@ -0,0 +1,16 @@
+#ifndef LCC_CODEGEN_PEEPHOLE_HH
+#define LCC_CODEGEN_PEEPHOLE_HH
+
+#include <lcc/forward.hh>
+
+namespace lcc {
+
+/// Replace short sequences of machine instructions of \p function with
+/// cheaper ones, e.g. moves whose result is overwritten right away, or
+/// `mov $0` with `xor`. This must run after register allocation, since
+/// most of these depend on which registers were assigned.
+void peephole_optimise(Module* mod, MFunction& function);
+
+} // namespace lcc
+
+#endif /* LCC_CODEGEN_PEEPHOLE_HH */
@@ -2,6 +2,7 @@
 #define LCC_REGISTER_ALLOCATION_HH
 
 #include <lcc/forward.hh>
+#include <lcc/utils.hh>
 
 #include <vector>
 
@@ -10,10 +11,88 @@ namespace lcc {
 struct MachineDescription {
     usz return_register;
     usz return_register_to_replace;
+
+    /// Registers available for allocation, in order of preference.
     std::vector<usz> registers;
+
+    /// Those of the allocatable registers that a function must preserve
+    /// for its caller; using one costs a save and restore.
+    std::vector<usz> callee_saved_registers;
+
+    /// Registers available for values wider than a general purpose
+    /// register, i.e. vectors, in order of preference. A virtual register
+    /// is allocated from these or from `registers` depending on its size.
+    std::vector<usz> vector_registers;
+
+    /// Width of the general purpose registers, in bits.
+    usz general_purpose_bits{64};
+
+    /// Opcode of a move from one register into another, which the
+    /// allocator tries to get rid of.
+    usz move_opcode;
+
+    /// Opcode of a call, which clobbers every allocatable register that
+    /// is not callee-saved.
+    usz call_opcode;
+
+    /// Get a mask of the allocatable registers that a call clobbers.
+    [[nodiscard]]
+    auto caller_saved_mask() const -> usz {
+        usz mask{};
+        for (auto reg : registers) mask |= usz(1) << reg;
+        for (auto reg : vector_registers) mask |= usz(1) << reg;
+        for (auto reg : callee_saved_registers) mask &= ~(usz(1) << reg);
+        return mask;
+    }
+
+    /// Get the registers that a value of \p size bits may be allocated.
+    [[nodiscard]]
+    auto registers_for(usz size) const -> const std::vector<usz>& {
+        return size > general_purpose_bits ? vector_registers : registers;
+    }
+
+    /// Whether functions address their stack frame relative to the stack
+    /// pointer rather than keeping a frame pointer, which is then one of
+    /// the callee-saved registers.
+    bool omit_frame_pointer{};
+
+    /// How many bytes below the stack pointer a function that calls
+    /// nothing may use without lowering it.
+    usz red_zone_size{};
+};
+
+/// What a register allocator did to a function.
+struct RegisterAllocationStats {
+    /// Number of virtual registers that could not be given a hardware
+    /// register. Since spilling is not implemented yet, any nonzero
+    /// count is reported as an error.
+    usz spills{};
+
+    /// Number of virtual registers that were allocated.
+    usz virtual_registers{};
+
+    /// Number of edges in the interference graph, if one was built.
+    usz interference_edges{};
+
+    /// Number of moves that were deleted because both of their operands
+    /// were assigned the same register.
+    usz removed_moves{};
 };
 
-void allocate_registers(const MachineDescription& desc, MFunction& function);
+/// Allocate registers by colouring an interference graph.
+///
+/// Registers related by a move are coalesced before colouring if that
+/// is known not to make the graph harder to colour, so that the move
+/// can be deleted.
+auto allocate_registers(const MachineDescription& desc, MFunction& function) -> RegisterAllocationStats;
+
+/// Allocate registers by a linear scan over live intervals.
+///
+/// This is much cheaper than graph colouring, but since each virtual
+/// register is given a single interval spanning every instruction in
+/// which it may be live (in block order), it can run out of registers
+/// in functions that graph colouring handles just fine.
+auto allocate_registers_linear_scan(const MachineDescription& desc, MFunction& function) -> RegisterAllocationStats;
 
 }
 
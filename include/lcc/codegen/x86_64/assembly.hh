@@ -17,6 +17,15 @@ void emit_gnu_att_assembly(
     std::vector<MFunction>&
 );
 
+/// Like the above, but write the assembly into \p output, replacing its
+/// contents.
+void emit_gnu_att_assembly(
+    std::vector<u8>& output,
+    lcc::Module*,
+    const MachineDescription&,
+    std::vector<MFunction>&
+);
+
 } // namespace lcc::x86_64
 
 #endif /* LCC_CODEGEN_X86_64_ASSEMBLY_HH */
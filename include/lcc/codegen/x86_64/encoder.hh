@@ -0,0 +1,88 @@
+#ifndef LCC_CODEGEN_X86_64_ENCODER_HH
+#define LCC_CODEGEN_X86_64_ENCODER_HH
+
+#include <lcc/codegen/mir.hh>
+#include <lcc/utils.hh>
+#include <object/generic.hh>
+
+#include <array>
+#include <concepts>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace lcc {
+namespace x86_64 {
+
+/// Appends machine code to the contents of a section.
+///
+/// Multi-byte fields (immediates, displacements) are laid out in
+/// little-endian order in a fixed-size buffer on the stack and then
+/// appended in one go, so encoding an instruction never allocates
+/// unless the section itself has to grow; call `reserve()` up front to
+/// avoid that as well.
+class Encoder {
+    Section& _section;
+    std::vector<u8>& _bytes;
+
+public:
+    explicit Encoder(Section& section)
+        : _section{section}, _bytes{section.contents()} {}
+
+    /// The name of the section being written to.
+    [[nodiscard]]
+    auto section_name() const -> const std::string& { return _section.name; }
+
+    /// The offset of the next byte that will be written.
+    [[nodiscard]]
+    auto offset() const -> usz { return _bytes.size(); }
+
+    /// Make room for at least \p bytes more bytes.
+    void reserve(usz bytes) { _bytes.reserve(_bytes.size() + bytes); }
+
+    auto operator+=(u8 byte) -> Encoder& {
+        _bytes.push_back(byte);
+        return *this;
+    }
+
+    // use like <encoder> += {0x32, 0x4}, etc.
+    auto operator+=(std::initializer_list<u8> bytes) -> Encoder& {
+        _bytes.insert(_bytes.end(), bytes.begin(), bytes.end());
+        return *this;
+    }
+
+    /// Append \p value in little-endian order.
+    template <std::unsigned_integral T>
+    void append(T value) {
+        std::array<u8, sizeof(T)> bytes{};
+        for (usz i = 0; i < sizeof(T); i++)
+            bytes[i] = u8(value >> (8 * i));
+        _bytes.insert(_bytes.end(), bytes.begin(), bytes.end());
+    }
+
+    void append16(u16 value) { append(value); }
+    void append32(u32 value) { append(value); }
+    void append64(u64 value) { append(value); }
+
+    /// Append an immediate, using the smallest of 1, 2, 4, or 8 bytes
+    /// that holds its size.
+    void immediate(MOperandImmediate imm) {
+        if (imm.size <= 8) append(u8(imm.value));
+        else if (imm.size <= 16) append(u16(imm.value));
+        else if (imm.size <= 32) append(u32(imm.value));
+        else if (imm.size <= 64) append(u64(imm.value));
+        else LCC_UNREACHABLE();
+    }
+
+    /// Append an immediate, but as at most 4 bytes, for instructions
+    /// whose 64-bit forms take a sign-extended 32-bit immediate.
+    void immediate_cap32(MOperandImmediate imm) {
+        if (imm.size > 32) imm.size = 32;
+        immediate(imm);
+    }
+};
+
+} // namespace x86_64
+} // namespace lcc
+
+#endif /* LCC_CODEGEN_X86_64_ENCODER_HH */
@@ -5,6 +5,9 @@
 #include <lcc/codegen/mir.hh>
 #include <lcc/codegen/x86_64/x86_64.hh>
 
+#include <span>
+#include <variant>
+
 namespace lcc::isel::x86_64 {
 // Just a NOTE: I don't like having lcc::x86_64 /and/ lcc::isel::x86_64,
 // but I don't like having isel split up across all the arch namespaces
@@ -72,6 +75,38 @@ using store_reg_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Store), Register<>, Register<>>>,
     InstList<Inst<Clobbers<c<1>>, usz(Opcode::MoveDereferenceRHS), o<0>, o<1>>>>;
 
+// Loads and stores with the address computation folded in by the
+// AddressFolder in isel.cc: base register, displacement, and optionally
+// index register and scale.
+//   mov disp(%base, %index, scale), %dst
+using load_reg_disp = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Load), Register<>, Immediate<>>>,
+    InstList<Inst<Clobbers<c<1>>, usz(Opcode::MoveDereferenceLHS), o<0>, i<0>, o<1>>>>;
+
+using load_reg_indexed = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Load), Register<>, Immediate<>, Register<>, Immediate<>>>,
+    InstList<Inst<Clobbers<c<1>>, usz(Opcode::MoveDereferenceLHS), o<0>, i<0>, o<1>, o<2>, o<3>>>>;
+
+using store_reg_reg_disp = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Store), Register<>, Register<>, Immediate<>>>,
+    InstList<Inst<Clobbers<>, usz(Opcode::MoveDereferenceRHS), o<0>, o<1>, o<2>>>>;
+
+using store_reg_reg_indexed = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Store), Register<>, Register<>, Immediate<>, Register<>, Immediate<>>>,
+    InstList<Inst<Clobbers<>, usz(Opcode::MoveDereferenceRHS), o<0>, o<1>, o<2>, o<3>, o<4>>>>;
+
+using store_imm_reg_disp = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Store), Immediate<>, Register<>, Immediate<>>>,
+    InstList<
+        Inst<Clobbers<>, usz(Opcode::Move), o<0>, v<0, 0>>,
+        Inst<Clobbers<>, usz(Opcode::MoveDereferenceRHS), v<0, 0>, o<1>, o<2>>>>;
+
+using store_imm_reg_indexed = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Store), Immediate<>, Register<>, Immediate<>, Register<>, Immediate<>>>,
+    InstList<
+        Inst<Clobbers<>, usz(Opcode::Move), o<0>, v<0, 0>>,
+        Inst<Clobbers<>, usz(Opcode::MoveDereferenceRHS), v<0, 0>, o<1>, o<2>, o<3>, o<4>>>>;
+
 template <typename copy_op>
 using copy_some_op = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Copy), copy_op>>,
@@ -95,6 +130,14 @@ using simple_call = Pattern<
 
 using simple_function_call = simple_call<Function<>>;
 
+// The frame is torn down before the jump when emitting the function.
+template <typename callee>
+using simple_tail_call = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::TailCall), callee>>,
+    InstList<Inst<Clobbers<>, usz(Opcode::Jump), o<0>>>>;
+
+using simple_function_tail_call = simple_tail_call<Function<>>;
+
 template <typename callee>
 using simple_branch = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Branch), callee>>,
@@ -109,8 +152,8 @@ using s_ext_reg = Pattern<
 using not_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Compl), Register<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::Not), o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::Not), i<0>>>>;
 
 using sar_imm_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Sar), Immediate<>, Immediate<>>>,
@@ -161,62 +204,83 @@ using shl_imm_reg = Pattern<
 using sar_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Sar), Register<>, Immediate<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::ShiftRightArithmetic), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::ShiftRightArithmetic), o<1>, i<0>>>>;
 
 using shr_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Shr), Register<>, Immediate<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::ShiftRightLogical), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::ShiftRightLogical), o<1>, i<0>>>>;
 
 using shl_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Shl), Register<>, Immediate<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::ShiftLeft), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::ShiftLeft), o<1>, i<0>>>>;
 
 using sar_reg_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Sar), Register<>, Register<>>>,
     InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
         Inst<Clobbers<>, usz(Opcode::Move), o<1>, Register<usz(RegId::RCX), Immediate<32>>>, // 32 bits to clear dependencies
-        Inst<Clobbers<>, usz(Opcode::ShiftRightArithmetic), Register<usz(RegId::RCX), Immediate<8>>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<>, usz(Opcode::ShiftRightArithmetic), Register<usz(RegId::RCX), Immediate<8>>, i<0>>>>;
 
 using shr_reg_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Shr), Register<>, Register<>>>,
     InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
         Inst<Clobbers<>, usz(Opcode::Move), o<1>, Register<usz(RegId::RCX), Immediate<32>>>, // 32 bits to clear dependencies
-        Inst<Clobbers<>, usz(Opcode::ShiftRightLogical), Register<usz(RegId::RCX), Immediate<8>>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<>, usz(Opcode::ShiftRightLogical), Register<usz(RegId::RCX), Immediate<8>>, i<0>>>>;
 
 using shl_reg_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Shl), Register<>, Register<>>>,
     InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
         Inst<Clobbers<>, usz(Opcode::Move), o<1>, Register<usz(RegId::RCX), Immediate<32>>>, // 32 bits to clear dependencies
-        Inst<Clobbers<>, usz(Opcode::ShiftLeft), Register<usz(RegId::RCX), Immediate<8>>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<>, usz(Opcode::ShiftLeft), Register<usz(RegId::RCX), Immediate<8>>, i<0>>>>;
 
+// Two-operand instructions overwrite one of their operands, which may
+// still be used afterwards, so copy it into the result and operate on
+// that instead.
 template <usz inst_kind, usz out_opcode>
 using binary_commutative_reg_reg = Pattern<
     InstList<Inst<Clobbers<>, inst_kind, Register<>, Register<>>>,
     InstList<
-        Inst<Clobbers<>, out_opcode, o<0>, o<1>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>,
+        Inst<Clobbers<>, out_opcode, o<0>, i<0>>>>;
 
 using and_reg_reg = binary_commutative_reg_reg<usz(MKind::And), usz(Opcode::And)>;
 using and_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::And), Register<>, Immediate<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::And), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::And), o<1>, i<0>>>>;
 
 using or_reg_reg = binary_commutative_reg_reg<usz(MKind::Or), usz(Opcode::Or)>;
 using or_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Or), Register<>, Immediate<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::Or), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::Or), o<1>, i<0>>>>;
+
+using xor_reg_reg = binary_commutative_reg_reg<usz(MKind::Xor), usz(Opcode::Xor)>;
+using xor_reg_imm = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Xor), Register<>, Immediate<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::Xor), o<1>, i<0>>>>;
+
+template <usz inst_kind, usz out_opcode>
+using binary_commutative_imm_reg = Pattern<
+    InstList<Inst<Clobbers<>, inst_kind, Immediate<>, Register<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>,
+        Inst<Clobbers<>, out_opcode, o<0>, i<0>>>>;
+
+using and_imm_reg = binary_commutative_imm_reg<usz(MKind::And), usz(Opcode::And)>;
+using or_imm_reg = binary_commutative_imm_reg<usz(MKind::Or), usz(Opcode::Or)>;
+using xor_imm_reg = binary_commutative_imm_reg<usz(MKind::Xor), usz(Opcode::Xor)>;
 
 using add_local_imm_1 = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Add), Local<>, Immediate<>>>,
@@ -228,44 +292,144 @@ using add_local_imm_2 = Pattern<
         Inst<Clobbers<>, usz(Opcode::LoadEffectiveAddress), o<0>, i<0>>,
         Inst<Clobbers<c<1>>, usz(Opcode::Add), o<1>, i<0>>>>;
 
+// The register operand is often the result register itself, e.g. when
+// indexing into a local array, so take the address of the local into a
+// temporary rather than into the result.
+using add_local_reg = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Add), Local<>, Register<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::LoadEffectiveAddress), o<0>, v<0, 1>>,
+        Inst<Clobbers<>, usz(Opcode::Add), v<0, 1>, i<0>>>>;
+
 using add_reg_reg = binary_commutative_reg_reg<usz(MKind::Add), usz(Opcode::Add)>;
 using add_imm_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Add), Immediate<>, Register<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::Add), o<0>, o<1>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::Add), o<0>, i<0>>>>;
 
 using add_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Add), Register<>, Immediate<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::Add), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::Add), o<1>, i<0>>>>;
 
+using mul_reg_reg = binary_commutative_reg_reg<usz(MKind::Mul), usz(Opcode::Multiply)>;
 using mul_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Mul), Register<>, Immediate<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::Multiply), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::Multiply), o<1>, i<0>>>>;
 
 using mul_imm_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Mul), Immediate<>, Register<>>>,
     InstList<
-        Inst<Clobbers<>, usz(Opcode::Multiply), o<0>, o<1>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>>>;
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::Multiply), o<0>, i<0>>>>;
 
 using sub_reg_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Sub), Register<>, Register<>>>,
     InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
         // NOTE: GNU ordering of operands
-        Inst<Clobbers<>, usz(Opcode::Sub), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>>>;
+        Inst<Clobbers<>, usz(Opcode::Sub), o<1>, i<0>>>>;
 
 using sub_reg_imm = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::Sub), Register<>, Immediate<>>>,
     InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
         // NOTE: GNU ordering of operands
-        Inst<Clobbers<>, usz(Opcode::Sub), o<1>, o<0>>,
-        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>>>;
+        Inst<Clobbers<>, usz(Opcode::Sub), o<1>, i<0>>>>;
+
+using sub_imm_reg = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Sub), Immediate<>, Register<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        // NOTE: GNU ordering of operands
+        Inst<Clobbers<>, usz(Opcode::Sub), o<1>, i<0>>>>;
+
+// Element-wise operations on vectors have the width of their elements
+// as a third, immediate operand, which picks the instruction. If
+// \p vector_bits is given, the vector must also be that wide.
+template <usz bits, usz vector_bits = 0>
+struct ElementBits {
+    static auto matches(std::span<MInst* const> input, const MInst*) -> bool {
+        if (vector_bits and input[0]->regsize() != vector_bits) return false;
+        return std::get<MOperandImmediate>(input[0]->get_operand(2)).value == bits;
+    }
+};
+
+template <MKind kind, Opcode out_opcode, usz bits, usz vector_bits = 0>
+using vector_commutative_reg_reg = Pattern<
+    InstList<Inst<Clobbers<>, usz(kind), Register<>, Register<>, Immediate<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>,
+        Inst<Clobbers<>, usz(out_opcode), o<0>, i<0>>>,
+    ElementBits<bits, vector_bits>>;
+
+template <Opcode out_opcode, usz bits>
+using vector_sub_reg_reg = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Sub), Register<>, Register<>, Immediate<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        // NOTE: GNU ordering of operands
+        Inst<Clobbers<>, usz(out_opcode), o<1>, i<0>>>,
+    ElementBits<bits>>;
+
+// Bitwise operations don't care about the width of the elements.
+template <MKind kind, Opcode out_opcode>
+using vector_bitwise_reg_reg = Pattern<
+    InstList<Inst<Clobbers<>, usz(kind), Register<>, Register<>, Immediate<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, i<0>>,
+        Inst<Clobbers<>, usz(out_opcode), o<0>, i<0>>>>;
+
+using vector_add_8 = vector_commutative_reg_reg<MKind::Add, Opcode::PackedAdd8, 8>;
+using vector_add_16 = vector_commutative_reg_reg<MKind::Add, Opcode::PackedAdd16, 16>;
+using vector_add_32 = vector_commutative_reg_reg<MKind::Add, Opcode::PackedAdd32, 32>;
+using vector_add_64 = vector_commutative_reg_reg<MKind::Add, Opcode::PackedAdd64, 64>;
+using vector_sub_8 = vector_sub_reg_reg<Opcode::PackedSub8, 8>;
+using vector_sub_16 = vector_sub_reg_reg<Opcode::PackedSub16, 16>;
+using vector_sub_32 = vector_sub_reg_reg<Opcode::PackedSub32, 32>;
+using vector_sub_64 = vector_sub_reg_reg<Opcode::PackedSub64, 64>;
+using vector_mul_16 = vector_commutative_reg_reg<MKind::Mul, Opcode::PackedMultiply16, 16>;
+using vector_mul_32_256 = vector_commutative_reg_reg<MKind::Mul, Opcode::PackedMultiply32, 32, 256>;
+
+// SSE2 has no `pmulld`, but `pmuludq` multiplies the even elements into
+// 64-bit products, whose low halves are what we want; shifting both
+// operands right by 32 bits gets the odd ones. Shift the odd products
+// into the high halves of their elements, clear the high halves of the
+// even ones, and combine them:
+//   movdqa %a, %out
+//   pmuludq %b, %out
+//   movdqa %a, %odd
+//   psrlq $32, %odd
+//   movdqa %b, %tmp
+//   psrlq $32, %tmp
+//   pmuludq %tmp, %odd
+//   psllq $32, %odd
+//   psllq $32, %out
+//   psrlq $32, %out
+//   por %odd, %out
+using vector_mul_32_128 = Pattern<
+    InstList<Inst<Clobbers<>, usz(MKind::Mul), Register<>, Register<>, Immediate<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedMultiplyEven32), o<1>, i<0>>,
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<0>, v<0, 0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedShiftRight64), Immediate<32>, v<0, 0>>,
+        Inst<Clobbers<c<1>>, usz(Opcode::Move), o<1>, v<1, 0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedShiftRight64), Immediate<32>, v<1, 0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedMultiplyEven32), v<1, 0>, v<0, 0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedShiftLeft64), Immediate<32>, v<0, 0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedShiftLeft64), Immediate<32>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedShiftRight64), Immediate<32>, i<0>>,
+        Inst<Clobbers<>, usz(Opcode::PackedOr), v<0, 0>, i<0>>>,
+    ElementBits<32, 128>>;
+using vector_and = vector_bitwise_reg_reg<MKind::And, Opcode::PackedAnd>;
+using vector_or = vector_bitwise_reg_reg<MKind::Or, Opcode::PackedOr>;
+using vector_xor = vector_bitwise_reg_reg<MKind::Xor, Opcode::PackedXor>;
 
 using cond_branch_reg = Pattern<
     InstList<Inst<Clobbers<>, usz(MKind::CondBranch), Register<>, Block<>, Block<>>>,
@@ -378,6 +542,12 @@ using AllPatterns = PatternList<
     store_imm_local,
     store_imm_reg,
     store_reg_reg,
+    load_reg_disp,
+    load_reg_indexed,
+    store_reg_reg_disp,
+    store_reg_reg_indexed,
+    store_imm_reg_disp,
+    store_imm_reg_indexed,
     copy_reg,
     copy_global,
     copy_local,
@@ -406,25 +576,50 @@ using AllPatterns = PatternList<
 
     and_reg_reg,
     and_reg_imm,
+    and_imm_reg,
 
     or_reg_reg,
     or_reg_imm,
+    or_imm_reg,
+
+    xor_reg_reg,
+    xor_reg_imm,
+    xor_imm_reg,
 
     add_local_imm_1,
     add_local_imm_2,
+    add_local_reg,
     add_reg_reg,
     add_imm_reg,
     add_reg_imm,
 
+    mul_reg_reg,
     mul_imm_reg,
     mul_reg_imm,
 
     sub_reg_reg,
     sub_reg_imm,
+    sub_imm_reg,
+
+    vector_add_8,
+    vector_add_16,
+    vector_add_32,
+    vector_add_64,
+    vector_sub_8,
+    vector_sub_16,
+    vector_sub_32,
+    vector_sub_64,
+    vector_mul_16,
+    vector_mul_32_128,
+    vector_mul_32_256,
+    vector_and,
+    vector_or,
+    vector_xor,
 
     bitcast_imm,
 
     simple_function_call,
+    simple_function_tail_call,
     simple_block_branch,
     cond_branch_reg,
     cond_branch_imm,
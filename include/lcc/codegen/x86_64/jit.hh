@@ -0,0 +1,56 @@
+#ifndef LCC_CODEGEN_X86_64_JIT_HH
+#define LCC_CODEGEN_X86_64_JIT_HH
+
+#include <lcc/forward.hh>
+#include <lcc/utils.hh>
+#include <object/generic.hh>
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace lcc::x86_64 {
+
+/// The machine code and data of an object, loaded into the memory of this
+/// process with its relocations applied, so that it can be called directly.
+///
+/// Symbols the object does not define are looked up in the process, e.g.
+/// in libc. Those may be too far away to be reached with the 32-bit
+/// displacements our code uses, so calls to them go through stubs that
+/// are loaded along with the code.
+class JITImage {
+    std::byte* _memory{};
+    usz _size{};
+    StringMap<void*> _symbols{};
+
+    JITImage() = default;
+
+public:
+    JITImage(const JITImage&) = delete;
+    auto operator=(const JITImage&) -> JITImage& = delete;
+    ~JITImage();
+
+    /// Load \p object into memory. Issues an error and returns null if it
+    /// refers to a symbol that cannot be found or reached.
+    [[nodiscard]]
+    static auto Load(Context* ctx, GenericObject& object) -> std::unique_ptr<JITImage>;
+
+    /// Get the address of a symbol defined in the image, or null if there
+    /// is no such symbol.
+    [[nodiscard]]
+    auto symbol(std::string_view name) const -> void*;
+};
+
+/// Generate machine code for \p module, load it into this process, and
+/// call its `main` function with \p args as its arguments. The output
+/// format of the context must be an object file format.
+///
+/// \return The value returned by `main`, or nothing if the module could
+///     not be loaded.
+auto RunMain(Module* module, std::span<const std::string> args) -> std::optional<int>;
+
+} // namespace lcc::x86_64
+
+#endif /* LCC_CODEGEN_X86_64_JIT_HH */
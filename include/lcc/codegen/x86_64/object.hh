@@ -5,10 +5,44 @@
 #include <lcc/codegen/register_allocation.hh>
 #include <object/generic.hh>
 
+#include <optional>
+#include <vector>
+
 namespace lcc {
 namespace x86_64 {
 
-GenericObject emit_mcode_gobj(Module*, const MachineDescription&, std::vector<MFunction>&);
+/// A change in how an unwinder finds the caller's frame, for the
+/// .eh_frame entry of a function: DWARF call frame instructions that
+/// take effect at \p offset into the function.
+struct FrameEvent {
+    usz offset;
+    std::vector<u8> instructions;
+};
+
+/// What a single function is encoded to: its machine code, and the
+/// symbols, relocations, and frame events within it, at offsets from
+/// the start of the function.
+struct EncodedFunction {
+    std::vector<u8> code;
+    std::vector<Symbol> symbols;
+    std::vector<Relocation> relocations;
+    std::vector<FrameEvent> frame;
+};
+
+/// Encode a module into an object. If `function_sizes` isn't null, it
+/// is set to the size of the machine code of every function.
+///
+/// If `encoded` isn't null, it has an entry for every function. Functions
+/// whose entry is set are not encoded; their entry is spliced into the
+/// object as is. The entry of every other function defined here is set
+/// to what that function was encoded to.
+GenericObject emit_mcode_gobj(
+    Module*,
+    const MachineDescription&,
+    std::vector<MFunction>&,
+    std::vector<usz>* function_sizes = nullptr,
+    std::vector<std::optional<EncodedFunction>>* encoded = nullptr
+);
 
 } // namespace x86_64
 } // namespace lcc
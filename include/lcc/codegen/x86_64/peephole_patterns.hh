@@ -0,0 +1,205 @@
+#ifndef LCC_CODEGEN_PEEPHOLE_X86_64_PATTERNS_HH
+#define LCC_CODEGEN_PEEPHOLE_X86_64_PATTERNS_HH
+
+#include <lcc/codegen/isel.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/codegen/x86_64/x86_64.hh>
+
+#include <span>
+#include <variant>
+
+/// Patterns that are matched against x86_64 instructions once registers
+/// have been allocated, to clean up after instruction selection and the
+/// register allocator.
+///
+/// Flags are only ever live from a `cmp` or `test` to the `setcc` or `jz`
+/// that follows it, with at most the `mov $0` that clears the register of
+/// the `setcc` in between, so instructions that only change the flags
+/// can be removed or introduced as long as they aren't followed by one
+/// that reads them.
+namespace lcc::isel::x86_64::peephole {
+using Opcode = lcc::x86_64::Opcode;
+
+inline auto reg(const MInst* inst, usz index) -> MOperandRegister {
+    return std::get<MOperandRegister>(inst->get_operand(index));
+}
+
+inline auto imm(const MInst* inst, usz index) -> MOperandImmediate {
+    return std::get<MOperandImmediate>(inst->get_operand(index));
+}
+
+inline auto reads_flags(const MInst* inst) -> bool {
+    if (not inst) return false;
+    return inst->opcode() == +Opcode::JumpIfZeroFlag
+        or inst->opcode() == +Opcode::JumpIfNotZeroFlag
+        or (inst->opcode() >= +Opcode::SetByteIfEqual and inst->opcode() <= +Opcode::SetByteIfGreaterSigned);
+}
+
+/// A move of a register into itself, e.g. where the allocator assigned
+/// both sides of a copy the same register.
+struct SelfMove {
+    static auto matches(std::span<MInst* const> input, const MInst*) -> bool {
+        auto src = reg(input[0], 0);
+        auto dst = reg(input[0], 1);
+        return src.value == dst.value and src.size == dst.size;
+    }
+};
+
+/// A move into a register that the next move overwrites entirely
+/// without reading it. Moves into the 8- and 16-bit parts of a register
+/// leave the rest of it alone, so only 32- and 64-bit ones count.
+struct OverwrittenMove {
+    static auto matches(std::span<MInst* const> input, const MInst*) -> bool {
+        auto first = reg(input[0], 1);
+        auto second = reg(input[1], 1);
+        if (first.value != second.value) return false;
+        if (second.size != 32 and second.size != 64) return false;
+        auto source = input[1]->get_operand(0);
+        return not std::holds_alternative<MOperandRegister>(source)
+            or std::get<MOperandRegister>(source).value != second.value;
+    }
+};
+
+/// Adding or subtracting zero only changes the flags.
+struct ZeroOperand {
+    static auto matches(std::span<MInst* const> input, const MInst* next) -> bool {
+        return imm(input[0], 0).value == 0 and not reads_flags(next);
+    }
+};
+
+/// Comparing with zero sets the flags the same way as testing a
+/// register against itself, which is shorter.
+struct CompareWithZero {
+    static auto matches(std::span<MInst* const> input, const MInst*) -> bool {
+        return imm(input[0], 0).value == 0;
+    }
+};
+
+/// `xor` is shorter than moving zero into a register, but clobbers the
+/// flags.
+struct MoveZero {
+    static auto matches(std::span<MInst* const> input, const MInst* next) -> bool {
+        return imm(input[0], 0).value == 0 and not reads_flags(next);
+    }
+};
+
+/// The register a `setcc` writes to is cleared between the comparison
+/// and the `setcc`, where the flags are live; clearing it before the
+/// comparison instead allows that to be an `xor`, as long as the
+/// comparison doesn't read the register.
+struct ZeroBeforeCompare {
+    static auto matches(std::span<MInst* const> input, const MInst*) -> bool {
+        if (imm(input[1], 0).value != 0) return false;
+        auto result = reg(input[1], 1);
+        if (reg(input[2], 0).value != result.value) return false;
+        for (const auto& op : input[0]->all_operands())
+            if (std::holds_alternative<MOperandRegister>(op) and std::get<MOperandRegister>(op).value == result.value)
+                return false;
+        return true;
+    }
+};
+
+using self_move = Pattern<
+    InstList<Inst<Clobbers<>, usz(Opcode::Move), Register<>, Register<>>>,
+    InstList<>,
+    SelfMove>;
+
+template <typename first, typename second>
+using overwritten_move = Pattern<
+    InstList<
+        Inst<Clobbers<>, usz(Opcode::Move), first, Register<>>,
+        Inst<Clobbers<>, usz(Opcode::Move), second, Register<>>>,
+    InstList<Inst<Clobbers<c<1>>, usz(Opcode::Move), o<2>, o<3>>>,
+    OverwrittenMove>;
+
+using overwritten_move_reg_reg = overwritten_move<Register<>, Register<>>;
+using overwritten_move_reg_imm = overwritten_move<Register<>, Immediate<>>;
+using overwritten_move_imm_reg = overwritten_move<Immediate<>, Register<>>;
+using overwritten_move_imm_imm = overwritten_move<Immediate<>, Immediate<>>;
+
+template <Opcode opcode>
+using zero_operand = Pattern<
+    InstList<Inst<Clobbers<>, usz(opcode), Immediate<>, Register<>>>,
+    InstList<>,
+    ZeroOperand>;
+
+using add_zero = zero_operand<Opcode::Add>;
+using sub_zero = zero_operand<Opcode::Sub>;
+
+using compare_zero = Pattern<
+    InstList<Inst<Clobbers<>, usz(Opcode::Compare), Immediate<>, Register<>>>,
+    InstList<Inst<Clobbers<>, usz(Opcode::Test), o<1>, o<1>>>,
+    CompareWithZero>;
+
+using move_zero = Pattern<
+    InstList<Inst<Clobbers<>, usz(Opcode::Move), Immediate<>, Register<>>>,
+    InstList<Inst<Clobbers<c<1>>, usz(Opcode::Xor), ResizedRegister<1, 32>, ResizedRegister<1, 32>>>,
+    MoveZero>;
+
+template <Opcode compare, typename lhs, Opcode set>
+using zero_before_compare = Pattern<
+    InstList<
+        Inst<Clobbers<>, usz(compare), lhs, Register<>>,
+        Inst<Clobbers<>, usz(Opcode::Move), Immediate<>, Register<>>,
+        Inst<Clobbers<>, usz(set), Register<>>>,
+    InstList<
+        Inst<Clobbers<c<1>>, usz(Opcode::Xor), ResizedRegister<3, 32>, ResizedRegister<3, 32>>,
+        Inst<Clobbers<>, usz(compare), o<0>, o<1>>,
+        Inst<Clobbers<c<0>>, usz(set), o<4>>>,
+    ZeroBeforeCompare>;
+
+template <Opcode set>
+using zero_before_cmp_reg = zero_before_compare<Opcode::Compare, Register<>, set>;
+template <Opcode set>
+using zero_before_cmp_imm = zero_before_compare<Opcode::Compare, Immediate<>, set>;
+template <Opcode set>
+using zero_before_test = zero_before_compare<Opcode::Test, Register<>, set>;
+
+using AllPatterns = PatternList<
+    zero_before_cmp_reg<Opcode::SetByteIfEqual>,
+    zero_before_cmp_reg<Opcode::SetByteIfNotEqual>,
+    zero_before_cmp_reg<Opcode::SetByteIfLessUnsigned>,
+    zero_before_cmp_reg<Opcode::SetByteIfLessSigned>,
+    zero_before_cmp_reg<Opcode::SetByteIfGreaterUnsigned>,
+    zero_before_cmp_reg<Opcode::SetByteIfGreaterSigned>,
+    zero_before_cmp_reg<Opcode::SetByteIfEqualOrLessUnsigned>,
+    zero_before_cmp_reg<Opcode::SetByteIfEqualOrLessSigned>,
+    zero_before_cmp_reg<Opcode::SetByteIfEqualOrGreaterUnsigned>,
+    zero_before_cmp_reg<Opcode::SetByteIfEqualOrGreaterSigned>,
+
+    zero_before_cmp_imm<Opcode::SetByteIfEqual>,
+    zero_before_cmp_imm<Opcode::SetByteIfNotEqual>,
+    zero_before_cmp_imm<Opcode::SetByteIfLessUnsigned>,
+    zero_before_cmp_imm<Opcode::SetByteIfLessSigned>,
+    zero_before_cmp_imm<Opcode::SetByteIfGreaterUnsigned>,
+    zero_before_cmp_imm<Opcode::SetByteIfGreaterSigned>,
+    zero_before_cmp_imm<Opcode::SetByteIfEqualOrLessUnsigned>,
+    zero_before_cmp_imm<Opcode::SetByteIfEqualOrLessSigned>,
+    zero_before_cmp_imm<Opcode::SetByteIfEqualOrGreaterUnsigned>,
+    zero_before_cmp_imm<Opcode::SetByteIfEqualOrGreaterSigned>,
+
+    zero_before_test<Opcode::SetByteIfEqual>,
+    zero_before_test<Opcode::SetByteIfNotEqual>,
+    zero_before_test<Opcode::SetByteIfLessUnsigned>,
+    zero_before_test<Opcode::SetByteIfLessSigned>,
+    zero_before_test<Opcode::SetByteIfGreaterUnsigned>,
+    zero_before_test<Opcode::SetByteIfGreaterSigned>,
+    zero_before_test<Opcode::SetByteIfEqualOrLessUnsigned>,
+    zero_before_test<Opcode::SetByteIfEqualOrLessSigned>,
+    zero_before_test<Opcode::SetByteIfEqualOrGreaterUnsigned>,
+    zero_before_test<Opcode::SetByteIfEqualOrGreaterSigned>,
+
+    self_move,
+    overwritten_move_reg_reg,
+    overwritten_move_reg_imm,
+    overwritten_move_imm_reg,
+    overwritten_move_imm_imm,
+    move_zero,
+
+    add_zero,
+    sub_zero,
+    compare_zero>;
+
+} // namespace lcc::isel::x86_64::peephole
+
+#endif /* LCC_CODEGEN_PEEPHOLE_X86_64_PATTERNS_HH */
@@ -2,10 +2,13 @@
 #define LCC_CODEGEN_X86_64_HH
 
 #include <lcc/codegen/mir.hh>
+#include <lcc/codegen/register_allocation.hh>
+#include <lcc/forward.hh>
 #include <lcc/utils.hh>
 
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace lcc::x86_64 {
 
@@ -23,9 +26,10 @@ enum struct Opcode : u32 {
     MoveSignExtended, // movsx
     MoveZeroExtended, // movzx
 
-    // Optional third offset operand (default zero).
-    MoveDereferenceRHS, // mov <any>, [offset](%register).
-    MoveDereferenceLHS, // mov [offset](%register), <any>
+    // Optional third offset operand (default zero), followed by optional
+    // index register and scale operands.
+    MoveDereferenceRHS, // mov <any>, [offset](%register[, %index, scale]).
+    MoveDereferenceLHS, // mov [offset](%register[, %index, scale]), <any>
 
     LoadEffectiveAddress, // lea
 
@@ -33,6 +37,7 @@ enum struct Opcode : u32 {
     Not, // One's Complement Negation
     And,
     Or,
+    Xor,
     ShiftRightArithmetic,
     ShiftRightLogical,
     ShiftLeft,
@@ -42,9 +47,10 @@ enum struct Opcode : u32 {
 
     Sub, // sub
 
-    Compare,        // cmp
-    Test,           // test
-    JumpIfZeroFlag, // jz
+    Compare,           // cmp
+    Test,              // test
+    JumpIfZeroFlag,    // jz
+    JumpIfNotZeroFlag, // jnz
 
     SetByteIfEqual,                  // sete (set if equal)
     SetByteIfNotEqual,               // setne (set if not equal)
@@ -56,6 +62,31 @@ enum struct Opcode : u32 {
     SetByteIfLessSigned,             // setl (set if less)
     SetByteIfGreaterUnsigned,        // seta (set if above)
     SetByteIfGreaterSigned,          // setg (set if greater)
+
+    // Element-wise integer arithmetic on vector registers: SSE2 on 128-bit
+    // operands, AVX2 (with a `v` prefix) on 256-bit ones. The number is
+    // the width of an element in bits. Moves of vectors use the regular
+    // move opcodes, which become `movdqa`/`movdqu`.
+    PackedAdd8,       // paddb
+    PackedAdd16,      // paddw
+    PackedAdd32,      // paddd
+    PackedAdd64,      // paddq
+    PackedSub8,       // psubb
+    PackedSub16,      // psubw
+    PackedSub32,      // psubd
+    PackedSub64,      // psubq
+    PackedMultiply16, // pmullw
+    PackedMultiply32, // pmulld; SSE4.1, so only used on 256-bit operands
+    PackedAnd,        // pand
+    PackedOr,         // por
+    PackedXor,        // pxor
+
+    // What 128-bit multiplies of 32-bit elements are made of, since SSE2
+    // has no `pmulld`. The shifts shift each 64-bit element by an
+    // immediate.
+    PackedMultiplyEven32, // pmuludq (low halves of 64-bit elements into 64-bit products)
+    PackedShiftLeft64,    // psllq
+    PackedShiftRight64,   // psrlq
 };
 
 enum struct RegisterId : u32 {
@@ -78,12 +109,113 @@ enum struct RegisterId : u32 {
     RSP,
     RIP,
 
+    // Vector registers. At 128 bits these are XMM registers, at 256 bits
+    // YMM registers.
+    XMM0,
+    XMM1,
+    XMM2,
+    XMM3,
+    XMM4,
+    XMM5,
+    XMM6,
+    XMM7,
+    XMM8,
+    XMM9,
+    XMM10,
+    XMM11,
+    XMM12,
+    XMM13,
+    XMM14,
+    XMM15,
+
     // The function value return register: most likely RAX, but sometimes not.
     RETURN = 0x210,
 };
 
 auto opcode_to_string(usz opcode) -> std::string;
 
+/// Check whether an opcode is an element-wise operation on vectors.
+constexpr auto is_packed(Opcode op) -> bool {
+    return op >= Opcode::PackedAdd8 and op <= Opcode::PackedShiftRight64;
+}
+
+/// Get the width of the vector registers an instruction operates on, or
+/// zero if it uses none.
+auto vector_bits(const MInst& inst) -> usz;
+
+/// Get the registers available to the register allocator for the
+/// calling convention of the target of a context.
+auto machine_description(const Context* ctx) -> MachineDescription;
+
+/// How a function sets up its stack frame.
+enum struct FrameKind {
+    /// Push RBP, point RBP at it, and lower RSP past the locals and the
+    /// saved registers. Locals are addressed relative to RBP.
+    Full,
+
+    /// A function that calls nothing and saves no registers, whose locals
+    /// fit in the red zone below RSP: RBP is set up as in a full frame,
+    /// but RSP is never lowered.
+    RedZone,
+
+    /// A function that calls nothing, saves no registers, and has nothing
+    /// on the stack: no prologue or epilogue at all.
+    None,
+
+    /// Like a full frame, but RSP is lowered in place of pushing RBP and
+    /// locals are addressed relative to RSP, so RBP can be allocated.
+    NoFramePointer,
+};
+
+/// The register that locals are addressed relative to, and what to add
+/// to their offsets (which are relative to where RBP points in a full
+/// frame) to address them.
+struct FrameBase {
+    RegisterId reg = RegisterId::RBP;
+    isz offset{};
+};
+
+/// The part of the stack frame of a function below the saved RBP.
+struct StackFrame {
+    FrameKind kind{};
+
+    /// Callee-saved registers the function uses, in the order in which
+    /// they are pushed after the locals have been allocated.
+    std::vector<usz> saved_registers;
+
+    /// Amount to subtract from RSP for the locals of the function. This
+    /// includes padding so that RSP is 16-byte aligned again once the
+    /// saved registers have been pushed. Zero if the locals are in the
+    /// red zone.
+    usz locals_size;
+
+    /// Get the base to address locals relative to, once the prologue is
+    /// done and RSP has been lowered by another \p adjustment bytes, e.g.
+    /// for arguments passed in memory.
+    [[nodiscard]]
+    auto base(isz adjustment = 0) const -> FrameBase;
+};
+
+/// Lay out the stack frame of a function after register allocation.
+auto stack_frame(const MachineDescription& desc, const MFunction& function) -> StackFrame;
+
+/// Get by how much an instruction lowers RSP, e.g. to make room for
+/// arguments passed in memory; negative if it raises it.
+auto stack_adjustment(const MInst& inst) -> isz;
+
+/// Assign the locals of a function stack slots, so that locals that are
+/// never in use at the same time share one.
+///
+/// A local is in use from any instruction that accesses it to any
+/// instruction that may access it again. Locals whose address is taken
+/// may be accessed anywhere, so they keep a slot of their own.
+void assign_stack_slots(MFunction& function);
+
+/// Remove the jumps of a function that only go to the block right after
+/// them, once its blocks have been laid out. A `jz` to the next block
+/// followed by a `jmp` elsewhere becomes a single `jnz`.
+void simplify_branches(MFunction& function);
+
 namespace regs {
 template <char r>
 constexpr auto LegacyGPR(usz size) -> std::string_view {
@@ -107,6 +239,14 @@ constexpr auto ExtendedGPR(usz size) -> std::string_view {
     }
 }
 
+/// Vector registers are named by their 128-bit part unless they are
+/// used as a whole 256-bit register.
+template <int r>
+constexpr auto Vector(usz size) -> std::string_view {
+    if (size == 256) return ConstexprFormat<"ymm{}", r>();
+    return ConstexprFormat<"xmm{}", r>();
+}
+
 template <detail::static_string s>
 constexpr auto Special(usz size) -> std::string_view {
     switch (size) {
@@ -134,6 +274,7 @@ constexpr auto ToString(Opcode op) -> std::string_view {
         case Opcode::Not: return "not";
         case Opcode::And: return "and";
         case Opcode::Or: return "or";
+        case Opcode::Xor: return "xor";
         case Opcode::ShiftLeft: return "shl";
         case Opcode::ShiftRightLogical: return "shr";
         case Opcode::ShiftRightArithmetic: return "sar";
@@ -144,6 +285,7 @@ constexpr auto ToString(Opcode op) -> std::string_view {
         case Opcode::Pop: return "pop";
         case Opcode::Test: return "test";
         case Opcode::JumpIfZeroFlag: return "jz";
+        case Opcode::JumpIfNotZeroFlag: return "jnz";
         case Opcode::Compare: return "cmp";
         case Opcode::SetByteIfEqual: return "sete";
         case Opcode::SetByteIfNotEqual: return "setne";
@@ -155,6 +297,22 @@ constexpr auto ToString(Opcode op) -> std::string_view {
         case Opcode::SetByteIfEqualOrLessSigned: return "setle";
         case Opcode::SetByteIfEqualOrGreaterUnsigned: return "setae";
         case Opcode::SetByteIfEqualOrGreaterSigned: return "setge";
+        case Opcode::PackedAdd8: return "paddb";
+        case Opcode::PackedAdd16: return "paddw";
+        case Opcode::PackedAdd32: return "paddd";
+        case Opcode::PackedAdd64: return "paddq";
+        case Opcode::PackedSub8: return "psubb";
+        case Opcode::PackedSub16: return "psubw";
+        case Opcode::PackedSub32: return "psubd";
+        case Opcode::PackedSub64: return "psubq";
+        case Opcode::PackedMultiply16: return "pmullw";
+        case Opcode::PackedMultiply32: return "pmulld";
+        case Opcode::PackedAnd: return "pand";
+        case Opcode::PackedOr: return "por";
+        case Opcode::PackedXor: return "pxor";
+        case Opcode::PackedMultiplyEven32: return "pmuludq";
+        case Opcode::PackedShiftLeft64: return "psllq";
+        case Opcode::PackedShiftRight64: return "psrlq";
     }
     LCC_UNREACHABLE();
 }
@@ -182,6 +340,22 @@ constexpr auto ToString(RegisterId id, usz size) -> std::string_view {
         case RegisterId::RBP: return Special<"bp">(size);
         case RegisterId::RSP: return Special<"sp">(size);
         case RegisterId::RIP: return Special<"ip">(size);
+        case RegisterId::XMM0: return Vector<0>(size);
+        case RegisterId::XMM1: return Vector<1>(size);
+        case RegisterId::XMM2: return Vector<2>(size);
+        case RegisterId::XMM3: return Vector<3>(size);
+        case RegisterId::XMM4: return Vector<4>(size);
+        case RegisterId::XMM5: return Vector<5>(size);
+        case RegisterId::XMM6: return Vector<6>(size);
+        case RegisterId::XMM7: return Vector<7>(size);
+        case RegisterId::XMM8: return Vector<8>(size);
+        case RegisterId::XMM9: return Vector<9>(size);
+        case RegisterId::XMM10: return Vector<10>(size);
+        case RegisterId::XMM11: return Vector<11>(size);
+        case RegisterId::XMM12: return Vector<12>(size);
+        case RegisterId::XMM13: return Vector<13>(size);
+        case RegisterId::XMM14: return Vector<14>(size);
+        case RegisterId::XMM15: return Vector<15>(size);
     }
     LCC_UNREACHABLE();
 }
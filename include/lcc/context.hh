@@ -6,6 +6,12 @@
 #include <lcc/location.hh>
 #include <lcc/utils.hh>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #    define LCC_PLATFORM_WINDOWS 1
 #endif
@@ -13,8 +19,16 @@
 namespace lcc {
 class Target;
 class Format;
+class CodegenReport;
+class MemReport;
+class TimeReport;
+class Trace;
+struct Diag;
 
 class Context {
+    /// Diagnostics count the errors issued in their context.
+    friend Diag;
+
 public:
     enum OptionColour : bool {
         DoNotUseColour,
@@ -42,6 +56,45 @@ public:
         StopatMIR = true,
     };
 
+    enum OptionRegisterAllocator : bool {
+        GraphColouringAllocator,
+        LinearScanAllocator = true,
+    };
+
+    enum OptionFunctionSections : bool {
+        DoNotUseFunctionSections,
+        FunctionSections = true,
+    };
+    enum OptionDataSections : bool {
+        DoNotUseDataSections,
+        DataSections = true,
+    };
+
+    enum OptionTimeReport : bool {
+        DoNotReportTime,
+        ReportTime = true,
+    };
+
+    enum OptionTrace : bool {
+        DoNotRecordTrace,
+        RecordTrace = true,
+    };
+
+    enum OptionMemReport : bool {
+        DoNotReportMemory,
+        ReportMemory = true,
+    };
+
+    enum OptionCodegenReport : bool {
+        DoNotReportCodegen,
+        ReportCodegen = true,
+    };
+
+    enum OptionFramePointer : bool {
+        KeepFramePointer,
+        OmitFramePointer = true,
+    };
+
     struct Options {
         OptionColour _colour_diagnostics;
 
@@ -51,6 +104,35 @@ public:
 
         OptionPrintMIR _should_print_mir;
         OptionStopatMIR _stopat_mir;
+
+        /// Number of threads the backend may use; zero means one per
+        /// hardware thread.
+        usz _jobs{1};
+
+        OptionRegisterAllocator _register_allocator{};
+
+        /// Whether to put every function and global variable into a
+        /// section of its own, so that the linker can garbage-collect
+        /// them individually.
+        OptionFunctionSections _function_sections{};
+        OptionDataSections _data_sections{};
+
+        /// Whether to measure how long each phase of compilation takes.
+        OptionTimeReport _time_report{};
+
+        /// Whether to record a trace of every phase of compilation.
+        OptionTrace _trace{};
+
+        /// Whether to measure how much memory each phase of compilation
+        /// uses.
+        OptionMemReport _mem_report{};
+
+        /// Whether to report what code generation made of each function.
+        OptionCodegenReport _codegen_report{};
+
+        /// Whether functions address their stack frame relative to the
+        /// stack pointer, which frees the frame pointer for allocation.
+        OptionFramePointer _frame_pointer{};
     };
 
 private:
@@ -59,7 +141,17 @@ private:
         owned_files;
 
     /// Error flag. This is set-only.
-    mutable bool error_flag = false;
+    ///
+    /// Diagnostics may be issued from backend worker threads.
+    mutable std::atomic<bool> error_flag = false;
+
+    /// Number of errors issued, including those that are still held back
+    /// in a diagnostic buffer, and number of errors printed.
+    mutable std::atomic<usz> errors_issued = 0;
+    mutable std::atomic<usz> errors_printed = 0;
+
+    /// Maximum number of errors to print; zero if there is no limit.
+    usz _error_limit{};
 
     /// Called once the first time a context is created.
     static void InitialiseLCCData();
@@ -69,16 +161,50 @@ private:
     const Target* _target{};
     const Format* _format{};
 
+    /// Null unless a time report was requested.
+    std::unique_ptr<TimeReport> _time_report;
+
+    /// Null unless a trace was requested.
+    std::unique_ptr<Trace> _trace;
+
+    /// Null unless a memory report was requested.
+    std::unique_ptr<MemReport> _mem_report;
+
+    /// Null unless a code generation report was requested.
+    std::unique_ptr<CodegenReport> _codegen_report;
+
     std::vector<std::string> _include_directories{};
+    std::string _module_cache_directory{};
+    std::string _codegen_cache_directory{};
 
 public:
     /// IR type caches.
     // TODO: Could these be smart pointers? If not, why?
     std::unordered_map<usz, Type*> integer_types;
     std::vector<Type*> array_types;
+    std::vector<Type*> vector_types;
     std::vector<Type*> function_types;
     std::vector<Type*> struct_types;
 
+    /// Structural hash-consing table for array, vector, function, and struct
+    /// types, keyed on the structural hash of the type. Types with the
+    /// same hash are compared member-wise on lookup, so structurally
+    /// equal types always share a single instance.
+    std::unordered_multimap<usz, Type*> type_table;
+
+    /// Guards the type caches above; types may be looked up from
+    /// several threads at once.
+    std::mutex type_mutex;
+
+    /// Metadata of imported modules, by module name. Every module compiled
+    /// with this context shares these, so that each import is only located
+    /// and read once; what the metadata looks like is up to the language
+    /// doing the importing.
+    std::unordered_map<std::string, std::shared_ptr<const void>> imported_modules;
+
+    /// Guards the imported modules above.
+    std::mutex imported_modules_mutex;
+
     /// Create a new context.
     explicit Context(
         const Target* target,
@@ -129,9 +255,23 @@ public:
     ///
     /// \return The previous value of the error flag.
     auto set_error() const -> bool {
-        auto old = error_flag;
-        error_flag = true;
-        return old;
+        return error_flag.exchange(true);
+    }
+
+    /// Get the maximum number of errors to print before giving up on
+    /// the compilation; zero if there is no limit.
+    [[nodiscard]]
+    auto error_limit() const -> usz { return _error_limit; }
+
+    /// Set the maximum number of errors to print; zero means no limit.
+    void error_limit(usz limit) { _error_limit = limit; }
+
+    /// Check if enough errors have been issued that any more would not be
+    /// printed anymore. Work that could only find more errors by now may
+    /// be skipped.
+    [[nodiscard]]
+    auto error_limit_reached() const -> bool {
+        return _error_limit and errors_issued >= _error_limit;
     }
 
     /// Get the target.
@@ -170,6 +310,58 @@ public:
         return _options._stopat_mir;
     }
 
+    [[nodiscard]]
+    auto option_jobs() const {
+        return _options._jobs;
+    }
+
+    [[nodiscard]]
+    auto option_register_allocator() const {
+        return _options._register_allocator;
+    }
+
+    [[nodiscard]]
+    auto option_function_sections() const {
+        return _options._function_sections;
+    }
+    [[nodiscard]]
+    auto option_data_sections() const {
+        return _options._data_sections;
+    }
+
+    [[nodiscard]]
+    auto option_frame_pointer() const {
+        return _options._frame_pointer;
+    }
+
+    /// The time report to add the time spent in each phase of compilation
+    /// to, or null if we’re not keeping track of that.
+    [[nodiscard]]
+    auto time_report() const -> TimeReport* {
+        return _time_report.get();
+    }
+
+    /// The trace to record the phases of compilation in, or null if
+    /// we’re not recording one.
+    [[nodiscard]]
+    auto trace() const -> Trace* {
+        return _trace.get();
+    }
+
+    /// The memory report to add the memory used by each phase of
+    /// compilation to, or null if we’re not keeping track of that.
+    [[nodiscard]]
+    auto mem_report() const -> MemReport* {
+        return _mem_report.get();
+    }
+
+    /// The report to add what code generation made of each function to,
+    /// or null if we’re not keeping track of that.
+    [[nodiscard]]
+    auto codegen_report() const -> CodegenReport* {
+        return _codegen_report.get();
+    }
+
     auto include_directories() const -> const decltype(_include_directories)& {
         return _include_directories;
     }
@@ -178,9 +370,31 @@ public:
         _include_directories.push_back(std::move(dir));
     }
 
+    /// Directory in which to cache metadata of imported modules; empty
+    /// if there is no module cache.
+    auto module_cache_directory() const -> const std::string& {
+        return _module_cache_directory;
+    }
+
+    void module_cache_directory(std::string dir) {
+        _module_cache_directory = std::move(dir);
+    }
+
+    /// Directory in which to cache the machine code of every function
+    /// emitted into an object file; empty if there is no codegen cache.
+    auto codegen_cache_directory() const -> const std::string& {
+        return _codegen_cache_directory;
+    }
+
+    void codegen_cache_directory(std::string dir) {
+        _codegen_cache_directory = std::move(dir);
+    }
+
 private:
     /// Register a file in the context.
     auto make_file(fs::path name, std::vector<char>&& contents) -> File&;
+    auto make_file(fs::path name, MappedFile&& mapping) -> File&;
+    auto add_file(File* file) -> File&;
 };
 } // namespace lcc
 
@@ -5,7 +5,9 @@
 #include <lcc/location.hh>
 #include <lcc/utils.hh>
 
+#include <atomic>
 #include <exception>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -31,12 +33,29 @@ struct Diag {
         ICError, ///< Internal Compiler error (bug in compiler).
     };
 
+    /// How diagnostics are printed.
+    enum struct OutputFormat {
+        /// For humans: the message, followed by the line of source code it
+        /// refers to with the location underlined.
+        Text,
+
+        /// For tools: one JSON object per line, with the severity, message,
+        /// and, if known, file, line, column, byte offset, and length of
+        /// the location. Lines and columns start at 1. Attached diagnostics
+        /// are printed as objects of their own, in the same order as text.
+        JSON,
+    };
+
 private:
     Kind kind;
     const Context* context{};
     Location where{};
     std::string message{};
 
+    /// Whether this has been counted towards the errors issued in its
+    /// context already, e.g. when it was buffered.
+    bool counted{};
+
     /// Attached diagnostics.
     std::vector<std::pair<Diag, bool>> attached;
 
@@ -46,6 +65,9 @@ private:
     /// Print a diagnostic with no (valid) location info.
     void PrintDiagWithoutLocation();
 
+    /// Print a diagnostic as a line of JSON.
+    void PrintJSON();
+
     /// Determine whether we should use colours at all.
     [[nodiscard]]
     auto ShouldUseColour() const -> bool;
@@ -60,6 +82,7 @@ public:
           context(other.context),
           where(other.where),
           message(std::move(other.message)),
+          counted(other.counted),
           attached(std::move(other.attached)) {
         other.kind = Kind::None;
     }
@@ -70,6 +93,7 @@ public:
         kind = other.kind;
         where = other.where;
         message = std::move(other.message);
+        counted = other.counted;
         attached = std::move(other.attached);
         other.kind = Kind::None;
         return *this;
@@ -118,6 +142,103 @@ public:
         attached.emplace_back(std::move(diag), print_before);
     }
 
+    /// Diagnostics that are held back instead of being printed when they
+    /// are issued, e.g. so that diagnostics issued on several threads can
+    /// be printed in an order that doesn't depend on scheduling.
+    class Buffer {
+        std::vector<Diag> diags;
+
+        /// Number of errors added; this may be read on other threads.
+        std::atomic<usz> error_count{};
+
+        friend Diag;
+
+    public:
+        /// While a capture exists, diagnostics issued on its thread go into
+        /// its buffer rather than being printed. Fatal errors and ICEs are
+        /// still printed right away since they exit.
+        class Capture {
+            Buffer* outer;
+
+        public:
+            explicit Capture(Buffer& buffer);
+            ~Capture();
+
+            Capture(const Capture&) = delete;
+            auto operator=(const Capture&) -> Capture& = delete;
+        };
+
+        Buffer() = default;
+        Buffer(const Buffer&) = delete;
+        auto operator=(const Buffer&) -> Buffer& = delete;
+
+        /// Anything that hasn't been flushed is printed now.
+        ~Buffer() { flush(); }
+
+        /// Add a diagnostic to the end of the buffer.
+        void add(Diag diag) {
+            if (diag.kind == Kind::Error) error_count++;
+            diags.push_back(std::move(diag));
+        }
+
+        /// Get the buffered diagnostics, in the order they were issued.
+        [[nodiscard]]
+        auto diagnostics() const -> const std::vector<Diag>& { return diags; }
+
+        /// Print the buffered diagnostics in the order they were issued.
+        void flush();
+
+        /// Get the number of errors in the buffer.
+        [[nodiscard]]
+        auto errors() const -> usz { return error_count; }
+
+        /// Remove the buffered diagnostics without printing them.
+        [[nodiscard]]
+        auto take() -> std::vector<Diag> {
+            error_count = 0;
+            return std::exchange(diags, {});
+        }
+
+        /// Check if, once the buffers before \p buffers[i] are flushed,
+        /// in order, enough errors will have been printed in \p ctx that
+        /// none of what goes into this buffer would be. The task that this
+        /// buffer is for may be skipped then; this never depends on the
+        /// order in which tasks are run, even if they are run in parallel,
+        /// so neither does what is printed.
+        [[nodiscard]]
+        static auto LimitReachedBefore(const Context* ctx, std::span<const Buffer> buffers, usz i) -> bool;
+    };
+
+    /// Set how diagnostics are printed from now on, in every context.
+    static void SetOutputFormat(OutputFormat format);
+
+    /// Make a copy of this diagnostic and those attached to it, issued in
+    /// \p ctx, with every location passed through \p relocate.
+    template <typename Relocate>
+    [[nodiscard]]
+    auto copy(const Context* ctx, Relocate&& relocate) const -> Diag {
+        Diag d{context ? ctx : nullptr, kind, relocate(where), message};
+        for (const auto& [diag, print_before] : attached)
+            d.attach(diag.copy(ctx, relocate), print_before);
+        return d;
+    }
+
+    /// Get the severity of this diagnostic.
+    [[nodiscard]]
+    auto severity() const -> Kind { return kind; }
+
+    /// Get the location this diagnostic refers to.
+    [[nodiscard]]
+    auto location() const -> Location { return where; }
+
+    /// Get the message of this diagnostic.
+    [[nodiscard]]
+    auto text() const -> const std::string& { return message; }
+
+    /// Get the attached diagnostics, and whether each is printed before this one.
+    [[nodiscard]]
+    auto attachments() const -> const std::vector<std::pair<Diag, bool>>& { return attached; }
+
     /// Print this diagnostic now. This resets the diagnostic.
     void print();
 
@@ -132,6 +253,7 @@ public:
     /// Suppress this and all attached diagnostics (it will not be printed).
     void suppress(bool issue_attached_diagnostics = false) {
         if (issue_attached_diagnostics) print_attached();
+        else for (auto& [diag, _] : attached) diag.suppress();
         kind = Kind::None;
     }
 
@@ -5,11 +5,48 @@
 #include <lcc/utils.hh>
 
 #include <filesystem>
+#include <mutex>
+#include <optional>
 #include <string_view>
 #include <vector>
 
 namespace lcc {
 
+/// A read-only view of a file mapped into memory.
+class MappedFile {
+    const char* _data{};
+    usz _size{};
+
+#ifdef _WIN32
+    /// The file mapping object backing the view.
+    void* _mapping{};
+#endif
+
+    MappedFile() = default;
+
+public:
+    /// Map a file into memory.
+    ///
+    /// This fails for anything that is not a regular file (e.g. if it
+    /// is a pipe), as well as for empty files, in which case the file
+    /// has to be read instead.
+    static auto Map(const fs::path& path) -> std::optional<MappedFile>;
+
+    MappedFile(MappedFile&& other) noexcept;
+    auto operator=(MappedFile&& other) noexcept -> MappedFile&;
+    MappedFile(const MappedFile&) = delete;
+    auto operator=(const MappedFile&) -> MappedFile& = delete;
+    ~MappedFile();
+
+    /// Get the mapped data.
+    [[nodiscard]]
+    auto data() const -> const char* { return _data; }
+
+    /// Get the size of the mapped data.
+    [[nodiscard]]
+    auto size() const -> usz { return _size; }
+};
+
 /// A file in the context.
 class File {
     static constexpr u32 invalid_id{u32(-1)};
@@ -20,9 +57,19 @@ class File {
     /// The name of the file.
     fs::path _file_path;
 
-    /// The contents of the file.
+    /// The contents of the file, if they were read into memory.
     std::vector<char> _contents;
 
+    /// The contents of the file, if it was mapped into memory.
+    std::optional<MappedFile> _mapping;
+
+    /// Whichever of the above holds the contents of the file.
+    std::string_view _view;
+
+    /// Offsets at which the lines of the file start; built on first use.
+    mutable std::vector<usz> _line_starts;
+    mutable std::once_flag _line_starts_built;
+
     /// The id of the file.
     u32 _id{invalid_id};
 
@@ -48,15 +95,15 @@ public:
 
     /// Get an iterator to the beginning of the file.
     [[nodiscard]]
-    auto begin() const { return _contents.begin(); }
+    auto begin() const { return _view.begin(); }
 
     /// Get the file data.
     [[nodiscard]]
-    auto data() const -> const char* { return _contents.data(); }
+    auto data() const -> const char* { return _view.data(); }
 
     /// Get an iterator to the end of the file.
     [[nodiscard]]
-    auto end() const { return _contents.end(); }
+    auto end() const { return _view.end(); }
 
     /// Get the id of this file.
     [[nodiscard]]
@@ -68,12 +115,24 @@ public:
 
     /// Get the size of the file.
     [[nodiscard]]
-    auto size() const -> usz { return _contents.size(); }
+    auto size() const -> usz { return _view.size(); }
+
+    /// Get the offsets at which the lines of the file start. The first
+    /// line always starts at offset zero.
+    [[nodiscard]]
+    auto line_starts() const -> const std::vector<usz>&;
+
+    /// Get the zero-based index of the line that contains an offset.
+    [[nodiscard]]
+    auto line_index(usz offset) const -> usz;
 
 private:
     /// Construct a file from a name and source.
     explicit File(Context& context, fs::path name, std::vector<char>&& contents);
 
+    /// Construct a file from a name and a mapping of its source.
+    explicit File(Context& context, fs::path name, MappedFile&& mapping);
+
     /// Load a file from disk.
     static auto LoadFileData(const fs::path& path) -> std::vector<char>;
 
@@ -32,6 +32,10 @@ public:
 
         // COFF object file; the Common Object File Format
         COFF_OBJECT,
+
+        // Lensor Compiler Collection Intermediate Representation, in its
+        // binary form. Emits `.lccb` files.
+        LCC_BITCODE,
     };
 
 private:
@@ -48,6 +52,7 @@ public:
     static const Format* const gnu_as_att_assembly;
     static const Format* const elf_object;
     static const Format* const coff_object;
+    static const Format* const lcc_bitcode;
 };
 
 namespace detail {
@@ -81,6 +86,12 @@ struct Formats {
         f._format = Format::COFF_OBJECT;
         return f;
     }();
+
+    static constexpr Format lcc_bitcode = [] {
+        auto f = Format();
+        f._format = Format::LCC_BITCODE;
+        return f;
+    }();
 };
 } // namespace detail
 
@@ -89,6 +100,7 @@ constexpr inline const Format* const Format::llvm_textual_ir = &detail::Formats:
 constinit inline const Format* const Format::gnu_as_att_assembly = &detail::Formats::gnu_as_att_assembly;
 constinit inline const Format* const Format::elf_object = &detail::Formats::elf_object;
 constinit inline const Format* const Format::coff_object = &detail::Formats::coff_object;
+constinit inline const Format* const Format::lcc_bitcode = &detail::Formats::lcc_bitcode;
 
 } // namespace lcc
 
@@ -3,6 +3,9 @@
 
 #include <lcc/ir/ir.hh>
 
+#include <unordered_map>
+#include <vector>
+
 namespace lcc {
 class DomTree {
     static constexpr usz RootId = 0;
@@ -19,6 +22,10 @@ class DomTree {
     /// Children of each node.
     Buffer<std::vector<usz>> children{f->blocks().size()};
 
+    /// Index of each block in the function; looking that up in the
+    /// function itself takes time linear in the number of blocks.
+    std::unordered_map<Block*, usz> ids{};
+
 public:
     /// Compute the dominator tree for a function.
     DomTree(Function* f, bool compute_dominance_frontiers = true);
@@ -36,7 +43,7 @@ public:
             auto b = stack.back();
             stack.pop_back();
             co_yield b;
-            for (auto c : children[b->id()]) {
+            for (auto c : children[index(b)]) {
                 if (not visited[c]) {
                     stack.push_back(f->blocks()[c]);
                     visited[c] = true;
@@ -46,7 +53,7 @@ public:
     }
 
     /// Get the dominance frontier of a block.
-    auto dom_frontier(Block* b) const -> const std::vector<Block*>& { return df[b->id()]; }
+    auto dom_frontier(Block* b) const -> const std::vector<Block*>& { return df[index(b)]; }
 
     /// Check if a block dominates another.
     auto dominates(Block* dominator, Block* b) const -> bool {
@@ -54,27 +61,46 @@ public:
         return strictly_dominates(dominator, b);
     }
 
-    /// Get the iterated dominance frontier of a set of blocks.
-    auto iterated_dom_frontier(rgs::range auto&& blocks) const -> std::unordered_set<Block*> {
-        std::unordered_set<Block*> visited;
-        std::unordered_set<Block*> idf;
-
-        auto Add = [&](auto& self, Block* x) {
-            if (visited.contains(x)) return;
-            visited.insert(x);
-            auto frontier = dom_frontier(x);
-            idf.insert(frontier.begin(), frontier.end());
-            for (auto b : frontier) { self(self, b); }
+    /// Get the blocks immediately dominated by a block.
+    auto immediately_dominated(Block* b) const -> Generator<Block*> {
+        for (auto c : children[index(b)]) co_yield f->blocks()[c];
+    }
+
+    /// Get the iterated dominance frontier of a set of blocks, each
+    /// block in it once.
+    auto iterated_dom_frontier(rgs::range auto&& blocks) const -> std::vector<Block*> {
+        Buffer<bool> queued{f->blocks().size()};
+        Buffer<bool> in_idf{f->blocks().size()};
+        std::vector<Block*> worklist;
+        std::vector<Block*> idf;
+
+        auto Queue = [&](Block* b) {
+            auto i = index(b);
+            if (queued[i]) return;
+            queued[i] = true;
+            worklist.push_back(b);
         };
 
-        for (auto b : std::forward<decltype(blocks)>(blocks)) Add(Add, b);
+        for (auto b : std::forward<decltype(blocks)>(blocks)) Queue(b);
+        while (not worklist.empty()) {
+            auto x = worklist.back();
+            worklist.pop_back();
+            for (auto b : dom_frontier(x)) {
+                auto i = index(b);
+                if (in_idf[i]) continue;
+                in_idf[i] = true;
+                idf.push_back(b);
+                Queue(b);
+            }
+        }
+
         return idf;
     }
 
     /// Walk the parents of a block in the dominator tree. If the
     /// block is the root, no values are returned.
     auto parents(Block* of) -> Generator<Block*> {
-        for (auto i = of->id(); i != RootId; ) {
+        for (auto i = index(of); i != RootId; ) {
             i = idoms[i];
             co_yield f->blocks()[i];
         }
@@ -91,14 +117,18 @@ public:
 
         /// Walk up the dominator tree starting at b’s idom until
         /// we find the dominator or reach the root.
-        usz d = dominator->id();
-        usz i = b->id();
+        usz d = index(dominator);
+        usz i = index(b);
         do {
             i = idoms[i];
             if (i == d) return true;
         } while (i != RootId);
         return false;
     }
+
+private:
+    /// Get the index of a block in the function.
+    auto index(Block* b) const -> usz { return ids.at(b); }
 };
 } // namespace lcc
 
@@ -10,23 +10,32 @@
 #include <lcc/utils/generator.hh>
 #include <lcc/utils/iterator.hh>
 #include <lcc/utils/rtti.hh>
+#include <lcc/utils/small_vector.hh>
 
 #include <algorithm>
 #include <concepts>
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
 #include <span>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace lcc {
+class InstList;
 class Parameter;
 class PhiInst;
 
 namespace parser {
 class Parser;
+class BitcodeReader;
 }
 
 /// An IR value.
@@ -117,9 +126,10 @@ public:
 
     /// Disallow allocating these directly.
     auto operator new(size_t) -> void* = delete;
-    auto operator new(size_t sz, Module& /*_*/) -> void* {
-        return ::operator new(sz);
-    }
+    auto operator new(size_t sz, Module& mod) -> void*;
+
+    /// The memory is owned by the module’s arena.
+    void operator delete(void*) {}
 
     /// Get the kind of this value for RTTI.
     [[nodiscard]]
@@ -132,6 +142,10 @@ public:
     /// Print this value for debugging.
     void print() const;
 
+    /// Get the printed form of this value as a string.
+    [[nodiscard]]
+    auto string(bool use_colour = true) const -> std::string;
+
     [[nodiscard]]
     static auto ToString(Value::Kind v) -> std::string {
         using VK = Value::Kind;
@@ -207,16 +221,76 @@ public:
 class UseTrackingValue : public Value {
     friend Inst;
 
-    /// Users of this value.
-    std::vector<Inst*> user_list;
+    /// Users of this value. Most values have one or two users, which are
+    /// stored inline.
+    SmallVector<Inst*, 2> user_list;
+
+    /// Values with more users than this also keep the position of each
+    /// user in the user list, so that adding and removing users stays
+    /// O(1) for e.g. heavily used globals.
+    static constexpr usz indexed_user_count = 16;
+    std::unique_ptr<std::unordered_map<Inst*, usz>> user_positions;
+
+    /// Functions and global variables are used by instructions in every
+    /// function of the module, so their user lists may be updated by
+    /// several threads at once when functions are optimised in parallel.
+    static inline std::mutex shared_user_list_mutex;
+
+    /// Lock the user list of this value if it can be shared between functions.
+    [[nodiscard]]
+    auto lock_users() -> std::unique_lock<std::mutex> {
+        if (kind() == Kind::Function or kind() == Kind::GlobalVariable)
+            return std::unique_lock{shared_user_list_mutex};
+        return {};
+    }
+
+    /// Add a user if it isn't one already.
+    void add_user(Inst* user) {
+        if (user_positions) {
+            if (user_positions->try_emplace(user, user_list.size()).second)
+                user_list.push_back(user);
+            return;
+        }
+
+        if (rgs::find(user_list, user) != user_list.end()) return;
+        user_list.push_back(user);
+        if (user_list.size() > indexed_user_count) {
+            user_positions = std::make_unique<std::unordered_map<Inst*, usz>>();
+            for (usz i = 0; i < user_list.size(); i++) user_positions->emplace(user_list[i], i);
+        }
+    }
+
+    /// Remove a user, if present.
+    ///
+    /// Small user lists keep their order; in indexed ones, the last user
+    /// takes the place of the removed one.
+    void remove_user(Inst* user) {
+        if (not user_positions) {
+            auto it = rgs::find(user_list, user);
+            if (it == user_list.end()) return;
+            std::move(it + 1, user_list.end(), it);
+            user_list.pop_back();
+            return;
+        }
+
+        auto it = user_positions->find(user);
+        if (it == user_positions->end()) return;
+        auto index = it->second;
+        user_positions->erase(it);
+        auto* last = user_list.back();
+        user_list.pop_back();
+        if (index == user_list.size()) return;
+        user_list[index] = last;
+        (*user_positions)[last] = index;
+    }
 
 protected:
     explicit UseTrackingValue(Kind k, Type* t = Type::UnknownTy) : Value(k, t) {}
 
 public:
-    /// Get the users of this value.
+    /// Get the users of this value, in no particular order.
     [[nodiscard]]
-    auto users() const -> const std::vector<Inst*>& { return user_list; }
+    auto users() const -> const SmallVector<Inst*, 2>& { return user_list; }
 
     /// RTTI.
     static auto classof(const Value* v) -> bool { return v->kind() >= Value::Kind::Block; }
@@ -228,6 +302,12 @@ struct IRName {
 };
 
 class GlobalVariable : public UseTrackingValue {
+    /// The bitcode reader sets the initialiser once every global exists.
+    friend parser::BitcodeReader;
+
+    /// Linking modules renames globals whose names clash.
+    friend Module;
+
     std::vector<IRName> _names;
     Value* _init;
     Type* _allocated_type;
@@ -240,30 +320,130 @@ public:
     [[nodiscard]]
     auto init() -> Value* { return _init; }
     [[nodiscard]]
-    auto names() const -> std::vector<IRName> { return _names; }
+    auto names() const -> const std::vector<IRName>& { return _names; }
+
+    /// Whether this is initialised with a string literal. String literals
+    /// are never written to, so this may go into read-only memory.
+    [[nodiscard]]
+    auto is_string_literal() -> bool;
+
+    /// Whether this is a string literal, local to the module, that holds
+    /// a single NUL-terminated string, which the linker may merge with
+    /// identical ones.
+    [[nodiscard]]
+    auto is_mergeable_string() -> bool;
 
     /// RTTI.
     [[nodiscard]]
-    static auto classof(Value* v) -> bool { return +v->kind() >= +Kind::GlobalVariable; }
+    static auto classof(Value* v) -> bool { return v->kind() == Kind::GlobalVariable; }
 
     [[nodiscard]]
     static auto CreateStringPtr(Module* mod, std::string name, std::string_view string_value) -> GlobalVariable*;
 };
 
+/// The instructions in a block.
+///
+/// This is an intrusive doubly-linked list threaded through the
+/// instructions themselves, so inserting or erasing an instruction
+/// whose position is known is O(1) and never invalidates iterators
+/// to other instructions.
+class InstList {
+    friend Block;
+
+    Inst* head{};
+    Inst* tail{};
+    usz count{};
+
+public:
+    class Iterator {
+        friend InstList;
+
+        const InstList* list{};
+        Inst* inst{};
+
+        Iterator(const InstList* l, Inst* i) : list(l), inst(i) {}
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Inst*;
+        using difference_type = std::ptrdiff_t;
+        using reference = Inst*;
+        using pointer = void;
+
+        Iterator() = default;
+
+        auto operator*() const -> Inst* { return inst; }
+        auto operator++() -> Iterator&;
+        auto operator++(int) -> Iterator {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        /// Decrementing the end iterator yields the last instruction.
+        auto operator--() -> Iterator&;
+        auto operator--(int) -> Iterator {
+            auto copy = *this;
+            --*this;
+            return copy;
+        }
+
+        bool operator==(const Iterator&) const = default;
+    };
+
+    InstList() = default;
+    InstList(const InstList&) = delete;
+    auto operator=(const InstList&) -> InstList& = delete;
+
+    [[nodiscard]] auto begin() const -> Iterator { return {this, head}; }
+    [[nodiscard]] auto end() const -> Iterator { return {this, nullptr}; }
+
+    /// Get the first instruction; may return nullptr.
+    [[nodiscard]] auto front() const -> Inst* { return head; }
+
+    /// Get the last instruction; may return nullptr.
+    [[nodiscard]] auto back() const -> Inst* { return tail; }
+
+    [[nodiscard]] auto empty() const -> bool { return count == 0; }
+    [[nodiscard]] auto size() const -> usz { return count; }
+
+    /// Get an iterator pointing to an instruction in this list.
+    [[nodiscard]] auto iterator_to(Inst* i) const -> Iterator { return {this, i}; }
+
+    /// Insert an instruction before \p pos.
+    void insert(Iterator pos, Inst* i);
+
+    /// Insert an instruction at the end of the list.
+    void push_back(Inst* i) { insert(end(), i); }
+
+    /// Unlink an instruction from this list.
+    void erase(Inst* i);
+
+    /// Move all instructions from another list to the end of this one.
+    void splice(InstList& other);
+};
+
 /// IR instruction.
 class Inst : public UseTrackingValue {
     /// So that parent can be set upon insertion.
     friend Block;
+    friend InstList;
 
-    /// IR Parser needs to update uses.
+    /// The IR parsers need to update uses.
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
-    /// Associated machine instruction during early codegen.
-    MInst* minst{};
+    /// Virtual register of the result during MIR generation; these are
+    /// numbered densely per function. Zero if there is none.
+    usz virtual_register{};
 
     /// The parent block that this instruction is inserted in.
     Block* parent{};
 
+    /// Neighbouring instructions in the parent block.
+    Inst* prev_inst{};
+    Inst* next_inst{};
+
     /// Source location of this instruction.
     Location _location;
 
@@ -275,9 +455,8 @@ protected:
     static void AddUse(Value* of_value, Inst* by) {
         if (not is<UseTrackingValue>(of_value)) return;
         auto* of = as<UseTrackingValue>(of_value);
-        auto it = rgs::find(of->user_list, by);
-        if (it != of->user_list.end()) return;
-        of->user_list.emplace_back(by);
+        auto lock = of->lock_users();
+        of->add_user(by);
     }
 
     /// Iterate the children of an instruction. This is only
@@ -301,9 +480,8 @@ protected:
     static void RemoveUse(Value* of_value, Inst* by) {
         if (not is<UseTrackingValue>(of_value)) return;
         auto* of = as<UseTrackingValue>(of_value);
-        auto it = rgs::find(of->user_list, by);
-        if (it == of->user_list.end()) return;
-        of->user_list.erase(it);
+        auto lock = of->lock_users();
+        of->remove_user(by);
     }
 
     /// Replace an operand with another operand and update uses.
@@ -342,7 +520,7 @@ public:
     void erase_cascade();
 
     /// Iterate over all instructions before (and not including) this one.
-    auto instructions_before_this() -> std::span<Inst*>;
+    auto instructions_before_this() -> rgs::subrange<InstList::Iterator>;
 
     /// Check if this is a terminator instruction.
     [[nodiscard]]
@@ -354,12 +532,20 @@ public:
     [[nodiscard]]
     auto location() const -> Location { return _location; }
 
-    /// Get the associated machine instruction.
+    /// Get the next instruction in the parent block; may return nullptr.
+    [[nodiscard]]
+    auto next() const -> Inst* { return next_inst; }
+
+    /// Get the previous instruction in the parent block; may return nullptr.
+    [[nodiscard]]
+    auto prev() const -> Inst* { return prev_inst; }
+
+    /// Get the virtual register of the result of this instruction.
     [[nodiscard]]
-    auto machine_inst() const -> MInst* { return minst; }
+    auto vreg() const -> usz { return virtual_register; }
 
-    /// Set the associated machine instruction.
-    void machine_inst(MInst* m) { minst = m; }
+    /// Set the virtual register of the result of this instruction.
+    void vreg(usz reg) { virtual_register = reg; }
 
     /// Replace children of this instruction.
     ///
@@ -396,10 +582,50 @@ static_assert(
     "IR Inst type must have virtual destructor (so that derived class allocated members may be freed)"
 );
 
+inline auto InstList::Iterator::operator++() -> Iterator& {
+    inst = inst->next_inst;
+    return *this;
+}
+
+inline auto InstList::Iterator::operator--() -> Iterator& {
+    inst = inst ? inst->prev_inst : list->tail;
+    return *this;
+}
+
+inline void InstList::insert(Iterator pos, Inst* i) {
+    auto* next = pos.inst;
+    auto* prev = next ? next->prev_inst : tail;
+    i->prev_inst = prev;
+    i->next_inst = next;
+    (prev ? prev->next_inst : head) = i;
+    (next ? next->prev_inst : tail) = i;
+    count++;
+}
+
+inline void InstList::erase(Inst* i) {
+    (i->prev_inst ? i->prev_inst->next_inst : head) = i->next_inst;
+    (i->next_inst ? i->next_inst->prev_inst : tail) = i->prev_inst;
+    i->prev_inst = i->next_inst = nullptr;
+    count--;
+}
+
+inline void InstList::splice(InstList& other) {
+    if (other.empty()) return;
+    if (tail) {
+        tail->next_inst = other.head;
+        other.head->prev_inst = tail;
+    } else {
+        head = other.head;
+    }
+    tail = other.tail;
+    count += other.count;
+    other.head = other.tail = nullptr;
+    other.count = 0;
+}
+
 /// A basic block.
 class Block : public UseTrackingValue {
-    using Iterator = utils::VectorIterator<Inst*>;
-    using ConstIterator = utils::VectorConstIterator<Inst*>;
+    using Iterator = InstList::Iterator;
 
     /// Associated machine instruction block.
     MBlock* mblock{};
@@ -408,11 +634,14 @@ class Block : public UseTrackingValue {
     Function* parent{};
 
     /// The instructions in this block.
-    std::vector<Inst*> inst_list;
+    InstList inst_list;
 
     /// The name of this block.
     std::string block_name;
 
+    /// How often this block was executed in a profiling run, if known.
+    std::optional<u64> count;
+
     /// TODO: Blocks and functions should also keep track of their users
     /// to simplify dead code elimination and computing predecessors.
 
@@ -423,11 +652,11 @@ public:
 
     /// Get an iterator to the first instruction in this block.
     [[nodiscard]]
-    auto begin() const -> ConstIterator { return {inst_list, inst_list.begin()}; }
+    auto begin() const -> Iterator { return inst_list.begin(); }
 
     /// Get an iterator to the last instruction in this block.
     [[nodiscard]]
-    auto end() const -> ConstIterator { return {inst_list, inst_list.end()}; }
+    auto end() const -> Iterator { return inst_list.end(); }
 
     /// Check whether this block has a terminator.
     [[nodiscard]]
@@ -476,7 +705,11 @@ public:
 
     /// Get the instructions in this block.
     [[nodiscard]]
-    auto instructions() -> std::vector<Inst*>& { return inst_list; }
+    auto instructions() -> InstList& { return inst_list; }
+
+    /// Get the instructions in this block.
+    [[nodiscard]]
+    auto instructions() const -> const InstList& { return inst_list; }
 
     /// Get the associated machine block.
     [[nodiscard]]
@@ -513,6 +746,14 @@ public:
     [[nodiscard]]
     auto predecessor_count() const -> usz;
 
+    /// Get how often this block was executed in a profiling run, if a
+    /// profile was supplied; see `profile::Apply()`.
+    [[nodiscard]]
+    auto profile_count() const -> std::optional<u64> { return count; }
+
+    /// Set how often this block was executed in a profiling run.
+    void profile_count(std::optional<u64> c) { count = c; }
+
     /// Get the successors of this block.
     ///
     /// If the block’s terminator is a conditional branch whose
@@ -528,9 +769,8 @@ public:
     /// Get the terminator instruction of this block; may return nullptr.
     [[nodiscard]]
     auto terminator() const -> Inst* {
-        if (inst_list.empty()) return nullptr;
         auto* i = inst_list.back();
-        if (not i->is_terminator()) return nullptr;
+        if (not i or not i->is_terminator()) return nullptr;
         return i;
     }
 
@@ -541,6 +781,10 @@ public:
 
 /// An IR function.
 class Function : public UseTrackingValue {
+    /// Linking modules moves functions between them, and renames those
+    /// whose names clash.
+    friend Module;
+
 private:
     using Iterator = utils::VectorIterator<Block*>;
     using ConstIterator = utils::VectorConstIterator<Block*>;
@@ -629,7 +873,7 @@ public:
 
     // Get the names of this function.
     [[nodiscard]]
-    auto names() const -> std::vector<IRName> { return func_names; }
+    auto names() const -> const std::vector<IRName>& { return func_names; }
 
     [[nodiscard]]
     auto has_name(std::string_view name) const {
@@ -649,9 +893,7 @@ public:
     }
 
     // Add a name to this function.
-    void add_name(std::string n, Linkage l) {
-        func_names.push_back({std::move(n), l});
-    }
+    void add_name(std::string n, Linkage l);
 
     /// Get a parameter value.
     ///
@@ -709,6 +951,7 @@ public:
 class AllocaInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     Type* _allocated_type{};
 
@@ -728,6 +971,7 @@ public:
 class CallInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The value being called.
     Value* callee_value{};
@@ -815,6 +1059,7 @@ public:
 class IntrinsicInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The intrinsic ID.
     IntrinsicKind intrinsic;
@@ -899,6 +1144,7 @@ public:
 class GEPInst : public GEPBaseInst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit GEPInst(Type* elem, Location location)
@@ -923,6 +1169,7 @@ public:
 class GetMemberPtrInst : public GEPBaseInst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     // NOTE: Used by the IR parser.
     explicit GetMemberPtrInst(Type* structType, Location location)
@@ -951,6 +1198,7 @@ public:
 class LoadInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The pointer to load from.
     Value* pointer{};
@@ -981,6 +1229,7 @@ public:
 class StoreInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The value to store.
     Value* value{};
@@ -1022,6 +1271,7 @@ public:
 class PhiInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
 public:
     /// An incoming value.
@@ -1155,6 +1405,7 @@ public:
 class BranchInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The block to branch to.
     Block* target_block{};
@@ -1184,6 +1435,7 @@ public:
 class CondBranchInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The condition.
     Value* condition{};
@@ -1240,6 +1492,7 @@ public:
 class ReturnInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The value to return.
     Value* value{};
@@ -1270,6 +1523,7 @@ public:
 class UnreachableInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
 public:
     explicit UnreachableInst(Location location = {})
@@ -1287,6 +1541,7 @@ public:
 class BinaryInst : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// The left operand.
     Value* left{};
@@ -1330,6 +1585,11 @@ public:
     /// Swap the LHS and RHS.
     void swap_operands() { std::swap(left, right); }
 
+    /// Whether code can be generated for the operation \p kind applied
+    /// element-wise to two vectors of type \p type.
+    [[nodiscard]]
+    static auto SupportsVector(Kind kind, const VectorType* type) -> bool;
+
     /// RTTI.
     [[nodiscard]]
     static auto classof(Value* v) -> bool { return +v->kind() >= +Kind::Add; }
@@ -1338,6 +1598,7 @@ public:
 /// An add instruction.
 class AddInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit AddInst(Type* ty, Location location = {}) : BinaryInst(Kind::Add, nullptr, nullptr, ty, location) {}
@@ -1356,6 +1617,7 @@ public:
 /// A subtract instruction.
 class SubInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SubInst(Type* ty, Location location = {}) : BinaryInst(Kind::Sub, nullptr, nullptr, ty, location) {}
@@ -1374,6 +1636,7 @@ public:
 /// A multiply instruction.
 class MulInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit MulInst(Type* ty, Location location = {}) : BinaryInst(Kind::Mul, nullptr, nullptr, ty, location) {}
@@ -1392,6 +1655,7 @@ public:
 /// A signed divide instruction.
 class SDivInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SDivInst(Type* ty, Location location = {}) : BinaryInst(Kind::SDiv, nullptr, nullptr, ty, location) {}
@@ -1410,6 +1674,7 @@ public:
 /// A signed remainder instruction.
 class SRemInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SRemInst(Type* ty, Location location = {}) : BinaryInst(Kind::SRem, nullptr, nullptr, ty, location) {}
@@ -1428,6 +1693,7 @@ public:
 /// An unsigned divide instruction.
 class UDivInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit UDivInst(Type* ty, Location location = {}) : BinaryInst(Kind::UDiv, nullptr, nullptr, ty, location) {}
@@ -1446,6 +1712,7 @@ public:
 /// An unsigned remainder instruction.
 class URemInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit URemInst(Type* ty, Location location = {}) : BinaryInst(Kind::URem, nullptr, nullptr, ty, location) {}
@@ -1464,6 +1731,7 @@ public:
 /// A left shift instruction.
 class ShlInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit ShlInst(Type* ty, Location location = {}) : BinaryInst(Kind::Shl, nullptr, nullptr, ty, location) {}
@@ -1482,6 +1750,7 @@ public:
 /// An arithmetic right shift.
 class SarInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SarInst(Type* ty, Location location = {}) : BinaryInst(Kind::Sar, nullptr, nullptr, ty, location) {}
@@ -1500,6 +1769,7 @@ public:
 /// A logical right shift.
 class ShrInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit ShrInst(Type* ty, Location location = {}) : BinaryInst(Kind::Shr, nullptr, nullptr, ty, location) {}
@@ -1518,6 +1788,7 @@ public:
 /// A bitwise and instruction.
 class AndInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit AndInst(Type* ty, Location location = {}) : BinaryInst(Kind::And, nullptr, nullptr, ty, location) {}
@@ -1536,6 +1807,7 @@ public:
 /// A bitwise or instruction.
 class OrInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit OrInst(Type* ty, Location location = {}) : BinaryInst(Kind::Or, nullptr, nullptr, ty, location) {}
@@ -1554,13 +1826,14 @@ public:
 /// A bitwise xor instruction.
 class XorInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit XorInst(Type* ty, Location location = {}) : BinaryInst(Kind::Xor, nullptr, nullptr, ty, location) {}
 
 public:
     explicit XorInst(Value* lhs, Value* rhs, Location location = {})
-        : BinaryInst(Kind::Or, lhs, rhs, lhs->type(), location) {
+        : BinaryInst(Kind::Xor, lhs, rhs, lhs->type(), location) {
         AssertSameType(lhs, rhs);
     }
 
@@ -1573,6 +1846,7 @@ public:
 /// can do is<CompareInst> and because the type is always i1.
 class CompareInst : public BinaryInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
 protected:
     explicit CompareInst(Kind k, Value* lhs, Value* rhs, Location location = {})
@@ -1587,6 +1861,7 @@ public:
 /// Instruction that compares two values for equality.
 class EqInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit EqInst(Location location = {}) : CompareInst(Kind::Eq, nullptr, nullptr, location) {}
@@ -1605,6 +1880,7 @@ public:
 /// Instruction that compares two values for inequality.
 class NeInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit NeInst(Location location = {}) : CompareInst(Kind::Ne, nullptr, nullptr, location) {}
@@ -1623,6 +1899,7 @@ public:
 /// Instruction that compares two values for less-than.
 class SLtInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SLtInst(Location location = {}) : CompareInst(Kind::SLt, nullptr, nullptr, location) {}
@@ -1640,6 +1917,7 @@ public:
 
 class ULtInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit ULtInst(Location location = {}) : CompareInst(Kind::ULt, nullptr, nullptr, location) {}
@@ -1658,6 +1936,7 @@ public:
 /// Instruction that compares two values for less-than-or-equal.
 class SLeInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SLeInst(Location location = {}) : CompareInst(Kind::SLe, nullptr, nullptr, location) {}
@@ -1674,6 +1953,7 @@ public:
 
 class ULeInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit ULeInst(Location location = {}) : CompareInst(Kind::ULe, nullptr, nullptr, location) {}
@@ -1691,6 +1971,7 @@ public:
 /// Instruction that compares two values for greater-than.
 class SGtInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SGtInst(Location location = {}) : CompareInst(Kind::SGt, nullptr, nullptr, location) {}
@@ -1708,6 +1989,7 @@ public:
 
 class UGtInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit UGtInst(Location location = {}) : CompareInst(Kind::UGt, nullptr, nullptr, location) {}
@@ -1726,6 +2008,7 @@ public:
 /// Instruction that compares two values for greater-than-or-equal.
 class SGeInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SGeInst(Location location = {}) : CompareInst(Kind::SGe, nullptr, nullptr, location) {}
@@ -1743,6 +2026,7 @@ public:
 
 class UGeInst : public CompareInst {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit UGeInst(Location location = {}) : CompareInst(Kind::UGe, nullptr, nullptr, location) {}
@@ -1762,6 +2046,7 @@ public:
 class UnaryInstBase : public Inst {
     friend Inst;
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     Value* op{};
 
@@ -1789,6 +2074,7 @@ public:
 /// SSA copy. Used during lowering only.
 class CopyInst : public UnaryInstBase {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit CopyInst(Type* ty, Location location = {}) : UnaryInstBase(Kind::Copy, nullptr, ty, location) {}
@@ -1805,6 +2091,7 @@ public:
 /// Zero-extend an integer value.
 class ZExtInst : public UnaryInstBase {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit ZExtInst(Type* ty, Location location = {}) : UnaryInstBase(Kind::ZExt, nullptr, ty, location) {}
@@ -1821,6 +2108,7 @@ public:
 /// Sign-extend an integer value.
 class SExtInst : public UnaryInstBase {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit SExtInst(Type* ty, Location location = {}) : UnaryInstBase(Kind::SExt, nullptr, ty, location) {}
@@ -1837,6 +2125,7 @@ public:
 /// Truncate an integer value.
 class TruncInst : public UnaryInstBase {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit TruncInst(Type* ty, Location location = {}) : UnaryInstBase(Kind::Trunc, nullptr, ty, location) {}
@@ -1853,6 +2142,7 @@ public:
 /// Bitcast a value to another type.
 class BitcastInst : public UnaryInstBase {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit BitcastInst(Type* ty, Location location = {}) : UnaryInstBase(Kind::Bitcast, nullptr, ty, location) {}
@@ -1873,6 +2163,7 @@ public:
 /// Negate an integer value.
 class NegInst : public UnaryInstBase {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit NegInst(Type* ty, Location location = {}) : UnaryInstBase(Kind::Neg, nullptr, ty, location) {}
@@ -1889,6 +2180,7 @@ public:
 /// Bitwise complement of an integer value.
 class ComplInst : public UnaryInstBase {
     friend parser::Parser;
+    friend parser::BitcodeReader;
 
     /// Used by the IR parser.
     explicit ComplInst(Type* ty, Location location = {}) : UnaryInstBase(Kind::Compl, nullptr, ty, location) {}
@@ -1953,8 +2245,8 @@ public:
 
     /// Whether this is a string literal.
     ///
-    /// This only affects how this array constant is printed
-    /// and should not be used for anything else.
+    /// This affects how this array constant is printed, and makes
+    /// a global variable it initialises read-only.
     [[nodiscard]]
     auto is_string_literal() const -> bool { return _is_string_literal; }
 
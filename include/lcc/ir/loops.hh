@@ -0,0 +1,116 @@
+#ifndef LCC_IR_LOOPS_HH
+#define LCC_IR_LOOPS_HH
+
+#include <lcc/ir/domtree.hh>
+#include <lcc/ir/ir.hh>
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace lcc {
+/// A natural loop.
+///
+/// A loop is identified by its header, which dominates every other
+/// block in the loop; for every back edge to the header, the blocks
+/// from which the source of that edge can be reached without going
+/// through the header are part of the loop. Back edges to the same
+/// header all belong to the same loop.
+class Loop {
+    friend class LoopInfo;
+
+    /// The loop header.
+    Block* head;
+
+    /// The loop immediately containing this one, if any.
+    Loop* outer{};
+
+    /// The loops immediately contained in this one.
+    std::vector<Loop*> inner{};
+
+    /// The blocks in this loop, including those of inner loops.
+    std::vector<Block*> block_list{};
+    std::unordered_set<Block*> block_set{};
+
+    /// Blocks that branch back to the header.
+    std::vector<Block*> latch_list{};
+
+    explicit Loop(Block* header) : head(header) {}
+
+public:
+    /// Get the blocks in this loop; the header comes first.
+    [[nodiscard]]
+    auto blocks() const -> const std::vector<Block*>& { return block_list; }
+
+    /// Get the loops immediately contained in this one.
+    [[nodiscard]]
+    auto children() const -> const std::vector<Loop*>& { return inner; }
+
+    /// Check if a block is part of this loop.
+    [[nodiscard]]
+    auto contains(Block* b) const -> bool { return block_set.contains(b); }
+
+    /// Get the nesting depth of this loop; outermost loops have depth 1.
+    [[nodiscard]]
+    auto depth() const -> usz {
+        usz d = 1;
+        for (auto* l = outer; l; l = l->outer) d++;
+        return d;
+    }
+
+    /// Get the loop header.
+    [[nodiscard]]
+    auto header() const -> Block* { return head; }
+
+    /// Get the blocks that branch back to the header.
+    [[nodiscard]]
+    auto latches() const -> const std::vector<Block*>& { return latch_list; }
+
+    /// Get the loop immediately containing this one; may return nullptr.
+    [[nodiscard]]
+    auto parent() const -> Loop* { return outer; }
+
+    /// Get the preheader of this loop, i.e. the only block outside
+    /// the loop that branches to the header, provided that the header
+    /// is its only successor; may return nullptr.
+    [[nodiscard]]
+    auto preheader() const -> Block*;
+};
+
+/// The loop nesting forest of a function.
+class LoopInfo {
+    /// All loops, ordered by size, so inner loops come before the
+    /// loops containing them.
+    std::vector<std::unique_ptr<Loop>> all;
+
+    /// Loops that are not contained in any other loop.
+    std::vector<Loop*> roots;
+
+    /// The innermost loop containing each block.
+    std::unordered_map<Block*, Loop*> innermost;
+
+public:
+    /// Find the loops in a function. Unreachable blocks are ignored.
+    LoopInfo(Function* f, const DomTree& dom);
+
+    /// Get the innermost loop containing a block; may return nullptr.
+    [[nodiscard]]
+    auto loop_for(Block* b) const -> Loop* {
+        auto it = innermost.find(b);
+        return it == innermost.end() ? nullptr : it->second;
+    }
+
+    /// Get all loops; inner loops come before the loops containing them.
+    [[nodiscard]]
+    auto loops() const -> Generator<Loop*> {
+        for (const auto& l : all) co_yield l.get();
+    }
+
+    /// Get the loops that are not contained in any other loop.
+    [[nodiscard]]
+    auto top_level() const -> const std::vector<Loop*>& { return roots; }
+};
+} // namespace lcc
+
+#endif // LCC_IR_LOOPS_HH
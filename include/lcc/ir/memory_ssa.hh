@@ -0,0 +1,181 @@
+#ifndef LCC_IR_MEMORY_SSA_HH
+#define LCC_IR_MEMORY_SSA_HH
+
+#include <lcc/ir/domtree.hh>
+#include <lcc/ir/ir.hh>
+
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+/// A range of bytes that a load or store accesses.
+///
+/// The base is the object the pointer was derived from by following
+/// GEPs and GMPs: an alloca, a global variable, or, if the pointer
+/// comes from anywhere else, that pointer itself. The offset is only
+/// known if every index on the way there is a constant.
+struct MemoryLocation {
+    Value* base{};
+    std::optional<usz> offset{};
+    usz size{};
+};
+
+enum struct AliasResult {
+    /// The two locations never overlap.
+    NoAlias,
+
+    /// The two locations may overlap.
+    MayAlias,
+
+    /// The two locations are exactly the same bytes.
+    MustAlias,
+};
+
+/// A node in the memory SSA graph.
+///
+/// All of memory is treated as a single variable in SSA form: every
+/// instruction that may write to memory defines a new version of it,
+/// every instruction that may read from it uses the version that was
+/// current at that point, and a PHI merges the versions coming in from
+/// the predecessors of a block wherever they may differ.
+class MemoryAccess {
+    friend class MemorySSA;
+
+public:
+    enum struct Kind {
+        /// Memory as it was when the function was entered.
+        LiveOnEntry,
+
+        /// A store, call, or intrinsic.
+        Def,
+
+        /// A load, or a return, after which everything that isn’t
+        /// local to the function may be read by the caller.
+        Use,
+
+        /// Merges the versions that reach the start of a block.
+        Phi,
+    };
+
+private:
+    Kind access_kind;
+    Block* parent;
+    Inst* instruction;
+
+    /// The version this is based on, for defs and uses.
+    MemoryAccess* defining{};
+
+    /// The version coming in from each predecessor, for PHIs.
+    std::vector<std::pair<Block*, MemoryAccess*>> incoming{};
+
+    /// Accesses whose defining access or one of whose incoming
+    /// versions this is.
+    std::vector<MemoryAccess*> user_list{};
+
+    MemoryAccess(Kind k, Block* b, Inst* i = nullptr)
+        : access_kind(k), parent(b), instruction(i) {}
+
+public:
+    /// Get the block this is in; null for LiveOnEntry.
+    [[nodiscard]]
+    auto block() const -> Block* { return parent; }
+
+    /// Get the version of memory this def or use is based on.
+    [[nodiscard]]
+    auto defining_access() const -> MemoryAccess* { return defining; }
+
+    /// Get the versions a PHI merges.
+    [[nodiscard]]
+    auto incoming_values() const -> const std::vector<std::pair<Block*, MemoryAccess*>>& { return incoming; }
+
+    /// Get the instruction of a def or use.
+    [[nodiscard]]
+    auto inst() const -> Inst* { return instruction; }
+
+    /// Get the kind of this access.
+    [[nodiscard]]
+    auto kind() const -> Kind { return access_kind; }
+
+    /// Get the accesses that are based on this one.
+    [[nodiscard]]
+    auto users() const -> const std::vector<MemoryAccess*>& { return user_list; }
+};
+
+/// Memory SSA form of a function.
+///
+/// Unreachable blocks are ignored. This does not change the function
+/// itself; passes that erase loads or stores must call `remove()` for
+/// them so the graph stays up to date.
+class MemorySSA {
+    std::vector<std::unique_ptr<MemoryAccess>> all;
+    MemoryAccess* entry;
+    std::unordered_map<Inst*, MemoryAccess*> by_inst;
+    std::unordered_map<Block*, MemoryAccess*> phis;
+
+    /// Whether the address of each alloca that was asked about may be
+    /// known to anything other than loads and stores.
+    mutable std::unordered_map<Value*, bool> escaped_allocas;
+
+public:
+    /// Build memory SSA form for a function.
+    MemorySSA(Function* f, const DomTree& dom);
+
+    /// Get the access for an instruction; null if it doesn’t touch
+    /// memory or is unreachable.
+    [[nodiscard]]
+    auto access(Inst* i) const -> MemoryAccess* {
+        auto it = by_inst.find(i);
+        return it == by_inst.end() ? nullptr : it->second;
+    }
+
+    /// Check how two locations overlap.
+    [[nodiscard]]
+    auto alias(const MemoryLocation& a, const MemoryLocation& b) const -> AliasResult;
+
+    /// Check if the first location contains all of the second.
+    [[nodiscard]]
+    static auto covers(const MemoryLocation& outer, const MemoryLocation& inner) -> bool;
+
+    /// Check if an alloca is used in any way other than as the address
+    /// of a load or store, possibly after offsetting it.
+    [[nodiscard]]
+    auto escapes(AllocaInst* a) const -> bool;
+
+    /// Get the access that stands for memory on entry to the function.
+    [[nodiscard]]
+    auto live_on_entry() const -> MemoryAccess* { return entry; }
+
+    /// Get the location a load or store accesses.
+    [[nodiscard]]
+    static auto location(Inst* load_or_store) -> MemoryLocation;
+
+    /// Check if an access may read from a location.
+    [[nodiscard]]
+    auto may_read(MemoryAccess* a, const MemoryLocation& loc) const -> bool;
+
+    /// Check if an access may write to a location.
+    [[nodiscard]]
+    auto may_write(MemoryAccess* a, const MemoryLocation& loc) const -> bool;
+
+    /// Get the PHI at the start of a block, if there is one.
+    [[nodiscard]]
+    auto phi(Block* b) const -> MemoryAccess* {
+        auto it = phis.find(b);
+        return it == phis.end() ? nullptr : it->second;
+    }
+
+    /// Remove the access for an instruction that is about to be erased;
+    /// everything based on it is based on what it was based on instead.
+    void remove(Inst* i);
+
+private:
+    /// Check if calls and the caller may access a location.
+    [[nodiscard]]
+    auto visible_outside(const MemoryLocation& loc) const -> bool;
+};
+} // namespace lcc
+
+#endif // LCC_IR_MEMORY_SSA_HH
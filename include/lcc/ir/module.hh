@@ -5,13 +5,18 @@
 #include <lcc/forward.hh>
 #include <lcc/ir/ir.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/arena.hh>
 #include <lcc/utils/result.hh>
 #include <object/generic.hh>
 
 #include <algorithm>
+#include <cstdio>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -25,7 +30,42 @@ class Module {
     std::vector<GlobalVariable*> _vars;
     std::vector<Section> _extra_sections;
 
-    usz _virtual_register{0x420};
+    /// Functions and global variables by each of their names. If several
+    /// share a name, the one added first wins.
+    StringMap<Function*> _functions_by_name;
+    StringMap<GlobalVariable*> _vars_by_name;
+
+    /// Backing storage for all values created in this module.
+    Arena _arena{256 * 1024};
+
+    /// Every value allocated in this module, so their destructors can be
+    /// run when the module is destroyed.
+    std::vector<Value*> _values;
+
+    /// Values created by one thread while several threads create values
+    /// for the module at once. \see ThreadAllocation.
+    struct ThreadStorage {
+        Arena arena{256 * 1024};
+        std::vector<Value*> values;
+    };
+
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadStorage>> _thread_storage;
+
+    /// Modules that have been linked into this one. Their values are now
+    /// part of this module, but they still own the memory of them.
+    std::vector<std::unique_ptr<Module>> _linked_modules;
+
+    /// Guards the arena, the value list, and the thread storage map;
+    /// functions may be optimised on several threads at once.
+    std::mutex _allocation_mutex;
+
+    /// The storage of the current thread for this module, if it has any.
+    [[nodiscard]]
+    auto thread_storage() -> ThreadStorage*;
+
+    /// Emit the module to \p output_file_path, or into \p buffer or as
+    /// \p object if either is not null.
+    void emit(const std::filesystem::path& output_file_path, std::vector<u8>* buffer, GenericObject* object);
 
 public:
     Module(Module&) = delete;
@@ -40,12 +80,27 @@ public:
     explicit Module(
         Context* ctx,
         std::string name = "<Peanut Butter Banana Pants Module (Unnamed)>"
-    ) : _ctx(ctx), _name(std::move(name)) {}
+    );
+
+    /// Destroy all values created in this module.
+    ~Module();
+
+    /// Allocate memory for a value owned by this module.
+    [[nodiscard]]
+    auto allocate(usz size) -> void*;
+
+    /// Get the arena that backs the values of this module.
+    [[nodiscard]]
+    auto arena() const -> const Arena& { return _arena; }
 
     /// Get the context that owns the module.
     [[nodiscard]]
     auto context() const -> Context* { return _ctx; }
 
+    /// Get the number of instructions in all functions of this module.
+    [[nodiscard]]
+    auto instruction_count() const -> usz;
+
     /// Get the name of this module.
     [[nodiscard]]
     auto name() const -> const std::string& { return _name; }
@@ -58,68 +113,160 @@ public:
     [[nodiscard]]
     auto llvm() -> std::string;
 
+    /// Write the module as LLVM IR to \p file as it is generated.
+    void write_llvm(std::FILE* file);
+
+    /// Serialise the module in the binary IR format.
+    [[nodiscard]]
+    auto bitcode() -> std::vector<char>;
+
+    /// Get the IR of this module as a string.
+    [[nodiscard]]
+    auto ir_string(bool use_colour) -> std::string;
+
     /// Print the IR of this module.
-    // TODO: return string
     void print_ir(bool use_colour);
 
+    /// Write the IR of this module to \p file as it is printed.
+    void write_ir(std::FILE* file, bool use_colour);
+
+    /// Get the functions of this module.
+    ///
+    /// Don't add or remove functions through this; use add_function() and
+    /// remove_functions_if() so they can be found by name.
     [[nodiscard]]
     auto code() -> std::vector<Function*>& { return _code; }
     [[nodiscard]]
-    auto code() const -> std::vector<Function*> { return _code; }
+    auto code() const -> const std::vector<Function*>& { return _code; }
+
+    /// Get the global variables of this module. The same goes as for code().
     [[nodiscard]]
     auto vars() -> std::vector<GlobalVariable*>& { return _vars; }
     [[nodiscard]]
-    auto vars() const -> std::vector<GlobalVariable*> { return _vars; }
+    auto vars() const -> const std::vector<GlobalVariable*>& { return _vars; }
 
     [[nodiscard]]
     auto extra_sections() -> std::vector<Section>& {
         return _extra_sections;
     }
     [[nodiscard]]
-    auto extra_sections() const -> std::vector<Section> {
+    auto extra_sections() const -> const std::vector<Section>& {
         return _extra_sections;
     }
 
-    void add_function(Function* func) { _code.push_back(func); }
-    void add_var(GlobalVariable* var) { _vars.push_back(var); }
+    void add_function(Function* func);
+    void add_var(GlobalVariable* var);
+
+    /// Make room for \p count more functions or variables, so adding
+    /// many of them does not keep growing the lists and name indices.
+    void reserve_functions(usz count);
+    void reserve_vars(usz count);
 
-    void add_extra_section(const Section& section) {
-        _extra_sections.push_back(section);
+    /// Make \p func findable by \p name; Function::add_name() calls this.
+    void add_function_name(Function* func, std::string_view name) {
+        _functions_by_name.try_emplace(std::string{name}, func);
     }
 
+    /// Remove the functions for which \p pred returns true, and return
+    /// how many were removed.
+    template <typename Predicate>
+    auto remove_functions_if(Predicate pred) -> usz {
+        return usz(std::erase_if(_code, [&](Function* f) {
+            if (not pred(f)) return false;
+            for (const auto& n : f->names()) {
+                auto it = _functions_by_name.find(n.name);
+                if (it != _functions_by_name.end() and it->second == f)
+                    _functions_by_name.erase(it);
+            }
+            return true;
+        }));
+    }
+
+    void add_extra_section(Section section) {
+        _extra_sections.push_back(std::move(section));
+    }
+
+    /// Move every function, global variable, and extra section of \p other
+    /// into this module, as a linker would combine their objects.
+    ///
+    /// A function or variable that \p other declares but does not define
+    /// is resolved to the definition of the same name in this module, and
+    /// vice versa, and declarations of the same name are merged. Internal
+    /// ones whose names clash are renamed. Defining the same exported name
+    /// in both modules is an error.
+    void link(std::unique_ptr<Module> other);
+
     void lower();
     void emit(std::filesystem::path output_file_path);
 
+    /// Emit the module in the output format of the context, but into
+    /// memory instead of a file, and return the bytes: assembly text, IR,
+    /// bitcode, or an object file.
     [[nodiscard]]
-    auto next_vreg() -> usz {
-        return _virtual_register++;
-    }
+    auto emit_to_buffer() -> std::vector<u8>;
+
+    /// Generate machine code for the module, and return it as an object
+    /// without writing it anywhere. The output format of the context must
+    /// be an object file format.
+    [[nodiscard]]
+    auto emit_object() -> GenericObject;
 
     [[nodiscard]]
     auto function_by_name(std::string_view function_name) -> Result<Function*> {
-        for (auto* f : code()) {
-            if (f->has_name(function_name)) {
-                return f;
-            }
-        }
+        auto it = _functions_by_name.find(function_name);
+        if (it != _functions_by_name.end()) return it->second;
         return Diag::Note("not found");
     }
 
     [[nodiscard]]
     auto function_by_one_of_names(const std::vector<IRName>& function_names) -> Result<Function*> {
-        for (auto* f : code()) {
-            if (f->has_one_of_names(function_names))
-                return f;
+        for (const auto& n : function_names) {
+            auto it = _functions_by_name.find(n.name);
+            if (it != _functions_by_name.end()) return it->second;
         }
         return Diag::Note("not found");
     }
 
+    [[nodiscard]]
+    auto var_by_name(std::string_view var_name) -> Result<GlobalVariable*> {
+        auto it = _vars_by_name.find(var_name);
+        if (it != _vars_by_name.end()) return it->second;
+        return Diag::Note("not found");
+    }
+
     /// Parse a module from a source span.
     [[nodiscard]]
     static auto Parse(Context* ctx, std::string_view source) -> std::unique_ptr<Module>;
     /// Parse a module from a file.
     [[nodiscard]]
     static auto Parse(Context* ctx, File& file) -> std::unique_ptr<Module>;
+
+    /// Check whether some data is in the binary IR format.
+    [[nodiscard]]
+    static auto IsBitcode(std::string_view data) -> bool;
+
+    /// Read a module in the binary IR format.
+    [[nodiscard]]
+    static auto ParseBitcode(Context* ctx, std::string_view data) -> std::unique_ptr<Module>;
+
+    /// While this exists, the values that its thread creates for a module
+    /// come from storage of that thread's own, so several threads can
+    /// create them for the same module at once without contending for
+    /// the module's arena.
+    ///
+    /// Each thread keeps its storage for as long as the module lives, so
+    /// a thread that works on several things in turn reuses it.
+    class ThreadAllocation {
+        Module* outer_module;
+        ThreadStorage* outer_storage;
+
+    public:
+        explicit ThreadAllocation(Module& mod);
+        ~ThreadAllocation();
+
+        ThreadAllocation(const ThreadAllocation&) = delete;
+        auto operator=(const ThreadAllocation&) -> ThreadAllocation& = delete;
+    };
 };
 } // namespace lcc
 
@@ -0,0 +1,44 @@
+#ifndef LCC_IR_PROFILE_HH
+#define LCC_IR_PROFILE_HH
+
+#include <lcc/forward.hh>
+#include <lcc/utils.hh>
+
+#include <string_view>
+
+/// Profile-guided optimisation.
+///
+/// A module compiled with `-fprofile-generate` counts how often each of
+/// its blocks is executed; `-fprofile-use` attaches those counts to the
+/// blocks of the same module when it is compiled again. Both happen
+/// right after IR generation, before any optimisation, so the blocks
+/// counted are the same blocks the counts are later attached to.
+///
+/// A profile is a sequence of records, one per run of an instrumented
+/// module, each of which consists of
+///
+///     "LCCPROF\0"                 | magic
+///     u64 functions               | number of functions
+///     for each function:
+///         u64 length, name        | name of the function
+///         u64 blocks              | number of blocks
+///         u64 hash                | hash of the shape of the function
+///     u64 counts[]                | one per block of every function
+///
+/// in host byte order. Counts of functions that appear in more than one
+/// record are added up, unless the shape of the function differs between
+/// them; then only the later records count.
+namespace lcc::profile {
+/// Add a counter to every block of every function defined in \p mod, and
+/// make `main` append the counters to the profile at \p path whenever it
+/// returns. Counters of a module that does not define `main` are never
+/// written.
+void Instrument(Module* mod, std::string_view path);
+
+/// Attach the counts of the profile at \p path to the blocks of \p mod.
+/// Functions whose shape has changed since the profile was recorded are
+/// skipped with a warning.
+void Apply(Module* mod, std::string_view path);
+} // namespace lcc::profile
+
+#endif // LCC_IR_PROFILE_HH
@@ -27,6 +27,7 @@ public:
         Function,
         Integer,
         Struct,
+        Vector,
     };
 
     const Kind kind;
@@ -96,6 +97,38 @@ public:
     static bool classof(const Type* t) { return t->kind == Kind::Array; }
 };
 
+/// A fixed-width vector of integers, e.g. `<4 x i32>`.
+///
+/// Binary instructions on operands of vector type operate on each
+/// element separately.
+class VectorType : public Type {
+    friend class lcc::Init;
+    friend class lcc::Context;
+
+    usz _length;
+    Type* _element_type;
+
+private:
+    VectorType(usz length, Type* element_type) : Type(Kind::Vector), _length(length), _element_type(element_type) {}
+
+public:
+    static auto Get(Context* ctx, usz length, Type* element_type) -> VectorType*;
+
+    /// Return the element count.
+    usz length() const { return _length; }
+
+    /// Return the element type; this is always an integer type.
+    Type* element_type() const { return _element_type; }
+
+    /// Whether code can be generated for values of this type: vectors
+    /// live in 128- or 256-bit registers, and their elements must be 8,
+    /// 16, 32, or 64 bits wide.
+    bool supported() const;
+
+    /// RTTI.
+    static bool classof(const Type* t) { return t->kind == Kind::Vector; }
+};
+
 /// A function type.
 class FunctionType : public Type {
     friend class lcc::Init;
@@ -16,6 +16,13 @@ typedef struct LccStringView {
     int64_t length;
 } LccStringView;
 
+/// Bytes produced by LCC. Free them with lcc_buffer_free().
+typedef struct LccBuffer {
+    const uint8_t* data;
+    int64_t size;
+    void* handle;
+} LccBuffer;
+
 typedef struct LccLocation {
     uint32_t position;
     uint16_t length;
@@ -167,12 +174,32 @@ LccTargetRef lcc_target_x86_64_windows();
 LccFormatRef lcc_format_llvm_textual_ir();
 /// Gets the emission format for AT&T assembly targeting GNU's as.
 LccFormatRef lcc_format_gnu_as_att_assembly();
+/// Gets the emission format for LCC's binary IR.
+LccFormatRef lcc_format_lcc_bitcode();
+/// Gets the emission format for ELF object files.
+LccFormatRef lcc_format_elf_object();
+/// Gets the emission format for COFF object files.
+LccFormatRef lcc_format_coff_object();
 
 /// Create an LCC context.
 LccContextRef lcc_context_create(LccTargetRef target, LccFormatRef format);
 /// Create an LCC module in the given context.
 LccModuleRef lcc_module_create(LccContextRef context);
 
+/// Parse an LCC module from IR, either textual or binary. Returns null if
+/// there was an error.
+LccModuleRef lcc_module_parse(LccContextRef context, LccStringView source);
+
+/// Lower this LCC module for the target of its context. This must be done
+/// before emitting it.
+void lcc_module_lower(LccModuleRef module);
+
+/// Emit this LCC module in the format of its context into memory: assembly
+/// text, IR, or an object file. Nothing is written to disk.
+LccBuffer lcc_module_emit_to_buffer(LccModuleRef module);
+/// Free bytes returned by LCC.
+void lcc_buffer_free(LccBuffer buffer);
+
 /// Get the context associated with this LCC module.
 LccContextRef lcc_module_get_context(LccModuleRef module);
 
@@ -191,6 +218,11 @@ void lcc_module_add_function(LccModuleRef module, LccValueRef function);
 /// Add a (global) variable to this LCC module.
 void lcc_module_add_variable(LccModuleRef module, LccValueRef variable);
 
+/// Make room for this many more functions in this LCC module.
+void lcc_module_reserve_functions(LccModuleRef module, int64_t count);
+/// Make room for this many more (global) variables in this LCC module.
+void lcc_module_reserve_variables(LccModuleRef module, int64_t count);
+
 // ==== Values
 
 // TODO: allocate values
@@ -269,6 +301,12 @@ LccValueRef lcc_get_function_parameter_at_index(LccValueRef function, int64_t in
 /// Append the given block to the given function.
 void lcc_function_append_block(LccValueRef function, LccValueRef block);
 
+/// Create this many empty blocks and append them to the given function.
+/// If `blocks` is not null, the i-th new block is stored in `blocks[i]`.
+void lcc_function_append_new_blocks(LccValueRef function, int64_t count, LccValueRef* blocks);
+/// Make room for this many more blocks in the given function.
+void lcc_function_reserve_blocks(LccValueRef function, int64_t count);
+
 /// Gets the calling convention for this function.
 LccCallingConvention lcc_get_function_calling_convention(LccValueRef function);
 
@@ -413,6 +451,143 @@ LccValueRef lcc_build_bitcast(LccValueRef operand, LccLocation location);
 LccValueRef lcc_build_negate(LccValueRef operand, LccLocation location);
 LccValueRef lcc_build_(LccLocation location);
 
+// ==== Bulk Construction
+//
+// These create a whole batch of instructions per call, so frontends that
+// build large modules don't cross the C API, and take the module's
+// allocation lock, once per instruction.
+
+// Keep this in the same order as the instructions in lcc::Value::Kind for
+// easy conversions
+typedef enum LccOpcode {
+    LCC_OP_ALLOCA,
+    LCC_OP_CALL,
+    LCC_OP_GET_ELEMENT_PTR,
+    LCC_OP_GET_MEMBER_PTR,
+    LCC_OP_INTRINSIC,
+    LCC_OP_LOAD,
+    LCC_OP_PHI,
+    LCC_OP_STORE,
+
+    /// TERMINATORS.
+    LCC_OP_BRANCH,
+    LCC_OP_COND_BRANCH,
+    LCC_OP_RETURN,
+    LCC_OP_UNREACHABLE,
+
+    /// UNARY INSTRUCTIONS.
+    LCC_OP_ZEXT,
+    LCC_OP_SEXT,
+    LCC_OP_TRUNC,
+    LCC_OP_BITCAST,
+    LCC_OP_NEG,
+    LCC_OP_COPY,
+    LCC_OP_COMPL,
+
+    /// BINARY INSTRUCTIONS.
+    LCC_OP_ADD,
+    LCC_OP_SUB,
+    LCC_OP_MUL,
+    LCC_OP_SDIV,
+    LCC_OP_UDIV,
+    LCC_OP_SREM,
+    LCC_OP_UREM,
+    LCC_OP_SHL,
+    LCC_OP_SAR,
+    LCC_OP_SHR,
+    LCC_OP_AND,
+    LCC_OP_OR,
+    LCC_OP_XOR,
+
+    /// COMPARE INSTRUCTIONS.
+    LCC_OP_EQ,
+    LCC_OP_NE,
+    LCC_OP_SLT,
+    LCC_OP_SLE,
+    LCC_OP_SGT,
+    LCC_OP_SGE,
+    LCC_OP_ULT,
+    LCC_OP_ULE,
+    LCC_OP_UGT,
+    LCC_OP_UGE,
+} LccOpcode;
+
+/// An operand of an instruction created in bulk.
+///
+/// A non-negative operand is the index of an instruction created earlier
+/// in the same call. A negative operand refers to an entry of the table of
+/// values passed to the call, for anything else: constants, parameters,
+/// blocks, functions, globals, or instructions from earlier calls.
+typedef int64_t LccOperand;
+
+/// The operand that refers to the instruction at this index in the batch.
+#define LCC_OPERAND_RESULT(index) ((LccOperand) (index))
+/// The operand that refers to the value at this index in the value table.
+#define LCC_OPERAND_VALUE(index) (-(LccOperand) (index) - 1)
+
+/// An instruction to create in bulk.
+///
+/// The operands and other fields each opcode uses are:
+///
+///   ALLOCA             none; `type` is the allocated type
+///   CALL               callee, arguments...; `type` is the callee's function type
+///   GET_ELEMENT_PTR    pointer, index; `type` is the element type
+///   GET_MEMBER_PTR     pointer, member index; `type` is the struct type
+///   INTRINSIC          operands...; `immediate` is the LccIntrinsicKind
+///   LOAD               address; `type` is the loaded type
+///   PHI                block, value, block, value, ...; `type` is the result type
+///   STORE              value, address
+///   BRANCH             target block
+///   COND_BRANCH        condition, then block, else block
+///   RETURN             value, or none for a void return
+///   UNREACHABLE        none
+///   ZEXT..BITCAST      operand; `type` is the result type
+///   NEG, COPY, COMPL   operand
+///   ADD..UGE           lhs, rhs
+typedef struct LccInstructionDesc {
+    LccOpcode opcode;
+    uint32_t immediate;
+    LccTypeRef type;
+    const LccOperand* operands;
+    int64_t operand_count;
+    LccLocation location;
+} LccInstructionDesc;
+
+/// Create `count` instructions and append them to the given block in order.
+///
+/// Negative operands index `values`, which may be null if there are none.
+/// If `results` is not null, the i-th new instruction is stored in
+/// `results[i]`. Returns the number of instructions created.
+int64_t lcc_block_append_instructions(
+    LccModuleRef module,
+    LccValueRef block,
+    const LccInstructionDesc* instructions,
+    int64_t count,
+    const LccValueRef* values,
+    LccValueRef* results
+);
+
+/// Like lcc_block_append_instructions(), but read the instructions from
+/// an op-coded buffer, which needs no operand arrays of its own. Each
+/// instruction takes 3 words plus one per operand:
+///
+///   opcode | operand count << 8 | immediate << 32
+///   index of its type in `types`, or UINT64_MAX if it has none
+///   location: position | length << 32 | file id << 48
+///   its operands, each an LccOperand cast to uint64_t
+///
+/// `word_count` is the size of the whole buffer, and `results`, if not
+/// null, must have room for every instruction in it.
+int64_t lcc_block_append_buffer(
+    LccModuleRef module,
+    LccValueRef block,
+    const uint64_t* buffer,
+    int64_t word_count,
+    const LccTypeRef* types,
+    const LccValueRef* values,
+    LccValueRef* results
+);
+
 // ==== Constants
 
 /// Creates a constant integer value.
@@ -0,0 +1,117 @@
+#ifndef LCC_MEM_REPORT_HH
+#define LCC_MEM_REPORT_HH
+
+#include <lcc/utils.hh>
+#include <lcc/utils/arena.hh>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+class Context;
+
+/// Memory used by each phase of compilation, for `--mem-report`.
+///
+/// For every phase, this records the resident set size of the process
+/// and how much was allocated for the AST and the IR while it ran, as
+/// well as the sizes of the data structures it built, e.g. how many IR
+/// instructions or interference graph edges there were, so that a
+/// blowup can be pinned to the phase it happens in.
+///
+/// Phases nest the same way time report timers do; in fact, every timer
+/// started from a context is also a phase. The allocation counters are
+/// shared by everything that runs in the context, so phases that run
+/// at the same time on different threads see each other’s allocations.
+class MemReport {
+public:
+    /// Where allocations are counted.
+    enum struct Source {
+        /// Glint AST nodes, types, and scopes.
+        AST,
+
+        /// IR values created with `new (Module&)`.
+        IR,
+
+        Count,
+    };
+
+    /// Measures the memory used from its construction to its destruction.
+    ///
+    /// This does nothing if the context isn’t collecting a memory report.
+    class Phase {
+        MemReport* report{};
+        const Phase* outer{};
+        std::string path{};
+        usz rss{};
+        usz counts[usz(Source::Count)]{};
+        usz bytes[usz(Source::Count)]{};
+
+        friend MemReport;
+
+    public:
+        Phase() = default;
+
+        /// Start the phase `name`, nested in the phase that is running on
+        /// this thread, if any.
+        Phase(const Context* ctx, std::string_view name);
+
+        ~Phase();
+
+        Phase(const Phase&) = delete;
+        auto operator=(const Phase&) -> Phase& = delete;
+    };
+
+private:
+    struct Entry {
+        /// Largest resident set size the process had when the phase ended.
+        usz peak_rss{};
+
+        /// Change in resident set size over the phase.
+        isz rss_delta{};
+
+        usz counts[usz(Source::Count)]{};
+        usz bytes[usz(Source::Count)]{};
+        usz runs{};
+
+        /// Largest size of each data structure recorded in the phase.
+        std::vector<std::pair<std::string, usz>> structures{};
+    };
+
+    AllocationCounter counters[usz(Source::Count)]{};
+
+    /// Entries by path, whose components are separated by slashes, in
+    /// the order in which the phases were first entered.
+    std::vector<std::pair<std::string, Entry>> entries{};
+    std::unordered_map<std::string, usz> entry_indices{};
+    std::mutex mutex{};
+
+    auto entry(const std::string& path) -> Entry&;
+
+public:
+    /// Get the counter that allocations for `source` are reported to.
+    [[nodiscard]]
+    auto counter(Source source) -> AllocationCounter* { return &counters[usz(source)]; }
+
+    /// Record the size of a data structure, e.g. the number of IR
+    /// instructions, in the phase that is running on this thread.
+    ///
+    /// If the same structure is recorded several times in a phase,
+    /// the largest size is kept.
+    void count(std::string_view structure, usz n);
+
+    /// Format the report as a table.
+    [[nodiscard]]
+    auto str() -> std::string;
+
+    /// Get the number of bytes allocated for the AST and the IR in each
+    /// phase, by path, in the order in which the phases were entered.
+    [[nodiscard]]
+    auto allocated_bytes() -> std::vector<std::pair<std::string, usz>>;
+};
+} // namespace lcc
+
+#endif // LCC_MEM_REPORT_HH
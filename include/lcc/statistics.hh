@@ -0,0 +1,56 @@
+#ifndef LCC_STATISTICS_HH
+#define LCC_STATISTICS_HH
+
+#include <lcc/utils.hh>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+
+namespace lcc {
+/// A counter of something the compiler did, e.g. how many instructions
+/// a pass erased, for `--stats`.
+///
+/// Statistics are meant to be declared at namespace scope or as static
+/// members, and register themselves on construction, so they can all
+/// be printed at the end of compilation. A statistic is shared by all
+/// threads and all contexts in a process; incrementing it is a single
+/// relaxed atomic addition, so there is no need to check whether it is
+/// going to be printed before counting something.
+class Statistic {
+    std::string_view _group;
+    std::string_view _name;
+    std::string_view _description;
+    std::atomic<usz> _count{};
+    const Statistic* _next{};
+
+public:
+    /// Create a statistic `name` in `group`, which is usually the name
+    /// of the pass that keeps track of it.
+    Statistic(std::string_view group, std::string_view name, std::string_view description);
+
+    Statistic(const Statistic&) = delete;
+    auto operator=(const Statistic&) -> Statistic& = delete;
+
+    auto operator++() -> Statistic& {
+        _count.fetch_add(1, std::memory_order_relaxed);
+        return *this;
+    }
+
+    auto operator+=(usz n) -> Statistic& {
+        _count.fetch_add(n, std::memory_order_relaxed);
+        return *this;
+    }
+
+    /// Get the current value of this statistic.
+    [[nodiscard]]
+    auto value() const -> usz { return _count.load(std::memory_order_relaxed); }
+
+    /// Format every statistic that has counted anything as a table,
+    /// sorted by group and name.
+    [[nodiscard]]
+    static auto Format() -> std::string;
+};
+} // namespace lcc
+
+#endif // LCC_STATISTICS_HH
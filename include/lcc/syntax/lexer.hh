@@ -4,9 +4,14 @@
 #include <lcc/diags.hh>
 #include <lcc/file.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/macros.hh>
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 namespace lcc::syntax {
 namespace detail {
@@ -38,6 +43,13 @@ public:
           end(s.data() + s.size()),
           begin(s.data()) {}
 
+    /// Only go over \p part, which is a span of \p s, but keep offsets
+    /// relative to the start of \p s.
+    CharacterRange(std::string_view s, std::string_view part)
+        : curr(part.data()),
+          end(part.data() + part.size()),
+          begin(s.data()) {}
+
     /// Get the current offset in the file.
     auto current_offset() const -> u32 {
         return u32(curr - begin) - 1;
@@ -76,6 +88,50 @@ public:
 };
 } // namespace detail
 
+/// Fixed-capacity queue of tokens that have been lexed past the
+/// current one.
+///
+/// Parsers only ever look a token or two ahead, so this is a ring
+/// buffer in place of a deque; tokens are moved in and out of it.
+template <typename TToken, usz capacity = 4>
+class LookaheadBuffer {
+    static_assert(std::has_single_bit(capacity), "Capacity must be a power of two");
+    static constexpr usz mask = capacity - 1;
+
+    std::array<TToken, capacity> _tokens{};
+    usz _head{};
+    usz _size{};
+
+public:
+    [[nodiscard]]
+    auto empty() const -> bool { return _size == 0; }
+
+    [[nodiscard]]
+    auto size() const -> usz { return _size; }
+
+    /// Get the token \p i places after the front.
+    [[nodiscard]]
+    auto operator[](usz i) -> TToken& {
+        LCC_ASSERT(i < _size, "Lookahead index out of bounds");
+        return _tokens[(_head + i) & mask];
+    }
+
+    /// Append a token.
+    void push_back(TToken&& t) {
+        LCC_ASSERT(_size < capacity, "Cannot look ahead more than {} tokens", capacity);
+        _tokens[(_head + _size++) & mask] = std::move(t);
+    }
+
+    /// Remove the front token and return it.
+    auto pop_front() -> TToken {
+        LCC_ASSERT(_size, "Lookahead buffer is empty");
+        auto t = std::move(_tokens[_head]);
+        _head = (_head + 1) & mask;
+        _size--;
+        return t;
+    }
+};
+
 template <typename TToken>
 struct Lexer {
     detail::CharacterRange chars;
@@ -83,6 +139,16 @@ struct Lexer {
     Context* context{};
     char lastc = ' ';
 
+    /// Tokens lexed past `tok` by LookAhead().
+    LookaheadBuffer<TToken> lookahead_tokens{};
+    bool looking_ahead = false;
+
+    /// In bulk mode, every token of the source, ending with EOF. The
+    /// current token was moved out of `tokens[next_token - 1]`.
+    std::vector<TToken> tokens{};
+    usz next_token{};
+    bool bulk_mode = false;
+
     Lexer(detail::CharacterRange chs) : chars(chs) {}
     Lexer(Context* ctx, detail::CharacterRange chs)
         : chars(chs), context(ctx) {}
@@ -93,6 +159,74 @@ struct Lexer {
         lastc = chars.next();
     }
 
+    /// If the next token has already been lexed, make it the current
+    /// token and return true. Lexers call this at the start of their
+    /// NextToken().
+    auto NextBufferedToken() -> bool {
+        if (looking_ahead) return false;
+        if (bulk_mode) {
+            // Keep returning EOF once we get there.
+            if (next_token == tokens.size()) tok = tokens.back();
+            else tok = std::move(tokens[next_token++]);
+            return true;
+        }
+
+        if (lookahead_tokens.empty()) return false;
+        tok = lookahead_tokens.pop_front();
+        return true;
+    }
+
+    /// Get the token \p n places after the current one, calling \p lex
+    /// to lex more tokens into `tok` as needed.
+    ///
+    /// Note: This invalidates the addresses of previous lookaheads
+    /// if it needs to lex more tokens.
+    ///
+    /// LookAhead(0) returns the current token.
+    template <typename Callback>
+    auto LookAhead(usz n, Callback lex) -> TToken* {
+        if (n == 0) return &tok;
+        if (bulk_mode) return &tokens[std::min(next_token + n - 1, tokens.size() - 1)];
+
+        /// If we already have enough tokens, just return the nth token.
+        const auto idx = n - 1;
+        if (idx < lookahead_tokens.size()) return &lookahead_tokens[idx];
+
+        /// Otherwise, lex enough tokens.
+        tempset looking_ahead = true;
+        auto current = std::move(tok);
+        for (usz i = lookahead_tokens.size(); i < n; i++) {
+            tok = {};
+            lex();
+            lookahead_tokens.push_back(std::move(tok));
+        }
+        tok = std::move(current);
+        return &lookahead_tokens[idx];
+    }
+
+    /// Lex the rest of the source up front, calling \p lex to lex each
+    /// token into `tok`. Afterwards, NextToken() and LookAhead() only
+    /// index into `tokens`.
+    ///
+    /// This is only valid if lexing does not depend on the parser.
+    template <typename Callback>
+    void Tokenize(Callback lex) {
+        LCC_ASSERT(not bulk_mode, "Source already tokenized");
+        using Kind = decltype(tok.kind);
+        tempset looking_ahead = true;
+        auto current = std::move(tok);
+        while (not lookahead_tokens.empty()) tokens.push_back(lookahead_tokens.pop_front());
+        const auto AtEof = [&] { return (tokens.empty() ? current : tokens.back()).kind == Kind::Eof; };
+        while (not AtEof()) {
+            tok = {};
+            lex();
+            tokens.push_back(std::move(tok));
+        }
+        if (tokens.empty()) tokens.push_back(current);
+        tok = std::move(current);
+        bulk_mode = true;
+    }
+
     template <typename... Args>
     Diag Error(fmt::format_string<Args...> fmt, Args&&... args) {
         return Diag::Error(context, tok.location, fmt, std::forward<Args>(args)...);
@@ -0,0 +1,96 @@
+#ifndef LCC_TIME_REPORT_HH
+#define LCC_TIME_REPORT_HH
+
+#include <lcc/mem_report.hh>
+#include <lcc/trace.hh>
+#include <lcc/utils.hh>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+class Context;
+
+/// Time spent in each phase of compilation, for `--time-report`.
+///
+/// Phases are measured by timers, which nest: a timer started while
+/// another one is running on the same thread is a child of that one.
+/// Timers with the same path are merged into a single entry, so e.g.
+/// an optimisation pass adds up the time it spends on every function,
+/// on every thread. As a consequence, the children of a phase that
+/// runs in parallel may add up to more than the phase itself.
+class TimeReport {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Measures the time from its construction to its destruction.
+    ///
+    /// This does nothing if the context isn’t collecting a time report.
+    /// Every timer is also recorded as an event if the context is
+    /// recording a trace, and timers started from a context are also
+    /// phases of the memory report, if there is one.
+    class Timer {
+        TimeReport* report{};
+        const Timer* outer{};
+        std::string path{};
+        Clock::time_point start{};
+        Trace::Event trace_event;
+        MemReport::Phase mem_phase{};
+
+    public:
+        /// Start a timer for the phase `name`, nested in the timer that is
+        /// running on this thread, if any.
+        Timer(const Context* ctx, std::string_view name);
+
+        /// Start a timer for the phase `name`, nested in `parent`, which may
+        /// be running on another thread, e.g. one that is waiting for this
+        /// one to finish some work for it.
+        Timer(std::string_view name, const Timer& parent);
+
+        ~Timer();
+
+        Timer(const Timer&) = delete;
+        auto operator=(const Timer&) -> Timer& = delete;
+
+        /// Get the trace event for this phase, e.g. to attach arguments.
+        [[nodiscard]]
+        auto event() -> Trace::Event& { return trace_event; }
+    };
+
+private:
+    struct Entry {
+        Clock::duration time{};
+        usz count{};
+    };
+
+    /// Entries by path, whose components are separated by slashes.
+    std::unordered_map<std::string, Entry> entries{};
+    std::mutex mutex{};
+
+    /// When the report was created; everything before is not included.
+    Clock::time_point created = Clock::now();
+
+    void add(const std::string& path, Clock::duration time);
+
+public:
+    /// Format the report as a table, in which the children of every phase
+    /// are sorted by the time spent in them.
+    [[nodiscard]]
+    auto str() -> std::string;
+
+    /// Format the report as a JSON object.
+    [[nodiscard]]
+    auto json() -> std::string;
+
+    /// Get the total time spent in each phase, by path, sorted by path.
+    [[nodiscard]]
+    auto times() -> std::vector<std::pair<std::string, Clock::duration>>;
+};
+} // namespace lcc
+
+#endif // LCC_TIME_REPORT_HH
@@ -0,0 +1,82 @@
+#ifndef LCC_TRACE_HH
+#define LCC_TRACE_HH
+
+#include <lcc/utils.hh>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lcc {
+class Context;
+
+/// A trace of compilation, for `--trace`, in the Chrome trace event
+/// format, which can be viewed in Perfetto or `chrome://tracing`.
+///
+/// Unlike a time report, a trace records every event separately, along
+/// with the thread it happened on, so it shows how the work is spread
+/// out across threads and which functions are expensive to compile.
+class Trace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Records an event from its construction to its destruction.
+    ///
+    /// This does nothing if the context isn’t recording a trace, so
+    /// check whether it is before computing expensive arguments.
+    class Event {
+        Trace* trace_{};
+        std::string event_name{};
+        std::string args{};
+        Clock::time_point start{};
+
+    public:
+        /// Record an event called `name`.
+        Event(const Context* ctx, std::string_view name);
+        Event(Trace* trace, std::string_view name);
+
+        ~Event();
+
+        Event(const Event&) = delete;
+        auto operator=(const Event&) -> Event& = delete;
+
+        /// Attach an argument to this event.
+        void arg(std::string_view key, std::string_view value);
+        void arg(std::string_view key, usz value);
+
+        /// Get the trace this is recorded in, if any.
+        [[nodiscard]]
+        auto trace() const -> Trace* { return trace_; }
+
+        /// Check whether this event is being recorded.
+        [[nodiscard]]
+        explicit operator bool() const { return trace_ != nullptr; }
+    };
+
+private:
+    struct Record {
+        std::string name;
+        std::string args;
+        usz thread;
+        Clock::duration start;
+        Clock::duration duration;
+    };
+
+    std::vector<Record> records{};
+    std::mutex mutex{};
+
+    /// When the trace was created; timestamps are relative to this.
+    Clock::time_point created = Clock::now();
+
+    void add(Record record);
+
+public:
+    /// Format the trace as a JSON object.
+    [[nodiscard]]
+    auto json() -> std::string;
+};
+} // namespace lcc
+
+#endif // LCC_TRACE_HH
@@ -14,6 +14,7 @@
 #include <filesystem>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <new>
 #include <numeric>
@@ -335,6 +336,25 @@ constexpr usz MaxBitValue(usz bits) {
     return b | (b - usz(1));
 }
 
+/// Compute the edit distance between two strings, i.e. how many
+/// characters must be inserted, deleted, or substituted to turn one
+/// into the other. If \p transpositions is true, swapping two adjacent
+/// characters also counts as one edit (the “optimal string alignment”
+/// distance; note that this one is not a metric).
+///
+/// If the distance is greater than \p limit, some value greater than
+/// \p limit is returned instead, which is cheaper to compute. This does
+/// not allocate unless one of the strings is very long.
+auto EditDistance(
+    std::string_view a,
+    std::string_view b,
+    bool transpositions = false,
+    usz limit = std::numeric_limits<usz>::max()
+) -> usz;
+
+/// Escape a string so it can be embedded in a JSON string literal.
+auto EscapeJSON(std::string_view str) -> std::string;
+
 /// Determine the width of a number.
 auto NumberWidth(usz number, usz base = 10) -> usz;
 
@@ -27,7 +27,7 @@ private:
 
     static constexpr Word Bits = sizeof(Word) * CHAR_BIT;
 
-    constexpr auto SExt() const -> SWord { return SWord(sign_bit() ? ~Word(0) & w : w); }
+    constexpr auto SExt() const -> SWord { return SWord(w << (Bits - bit_width)) >> (Bits - bit_width); }
 
 public:
     constexpr aint() = default;
@@ -0,0 +1,114 @@
+#ifndef LCC_ARENA_HH
+#define LCC_ARENA_HH
+
+#include <lcc/utils.hh>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace lcc {
+
+/// Number and size of allocations made for some kind of data, e.g. AST
+/// nodes, across every arena that reports to it, for `--mem-report`.
+///
+/// Arenas of different modules may be filled on different threads, so
+/// this is atomic.
+struct AllocationCounter {
+    std::atomic<usz> count{};
+    std::atomic<usz> bytes{};
+
+    void add(usz size) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+};
+
+/// Bump-pointer allocator that hands out memory from large slabs.
+///
+/// Memory is only ever released all at once, when the arena is
+/// destroyed. The arena does not run destructors; objects that own
+/// resources must be destroyed by whoever created them before the
+/// arena goes away.
+class Arena {
+    /// Every allocation is aligned to this.
+    static constexpr usz alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    std::vector<std::unique_ptr<std::byte[]>> slabs{};
+    std::byte* ptr{};
+    std::byte* end{};
+    usz _slab_size;
+
+    /// Statistics.
+    usz _bytes_allocated{};
+    usz _bytes_reserved{};
+    usz _allocation_count{};
+
+    /// Also report every allocation here, if set.
+    AllocationCounter* _counter{};
+
+    auto new_slab(usz size) -> std::byte* {
+        _bytes_reserved += size;
+        return slabs.emplace_back(new std::byte[size]).get();
+    }
+
+public:
+    /// Create an arena whose slabs are (at least) \p slab_size bytes.
+    explicit Arena(usz slab_size = 64 * 1024) : _slab_size(slab_size) {}
+
+    /// Arenas hand out pointers into themselves and must not move.
+    Arena(const Arena&) = delete;
+    Arena(Arena&&) = delete;
+    auto operator=(const Arena&) -> Arena& = delete;
+    auto operator=(Arena&&) -> Arena& = delete;
+
+    /// Allocate \p size bytes of uninitialised memory.
+    [[nodiscard]]
+    auto allocate(usz size) -> void* {
+        size = (size + alignment - 1) & ~(alignment - 1);
+        _bytes_allocated += size;
+        _allocation_count++;
+        if (_counter) _counter->add(size);
+
+        /// Requests larger than a slab get a slab of their own so we
+        /// don’t throw away the rest of the current one.
+        if (size > _slab_size) return new_slab(size);
+
+        if (usz(end - ptr) < size) {
+            ptr = new_slab(_slab_size);
+            end = ptr + _slab_size;
+        }
+
+        auto* mem = ptr;
+        ptr += size;
+        return mem;
+    }
+
+    /// Report every allocation from now on to \p counter as well.
+    void count_into(AllocationCounter* counter) { _counter = counter; }
+
+    /// Allocate and construct an object of type T.
+    template <typename T, typename... Args>
+    auto make(Args&&... args) -> T* {
+        static_assert(alignof(T) <= alignment, "Over-aligned types are not supported by Arena");
+        return ::new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// Total number of bytes handed out by this arena.
+    [[nodiscard]]
+    auto bytes_allocated() const -> usz { return _bytes_allocated; }
+
+    /// Total number of allocations made from this arena.
+    [[nodiscard]]
+    auto allocation_count() const -> usz { return _allocation_count; }
+
+    /// Number of bytes reserved from the system by this arena.
+    [[nodiscard]]
+    auto bytes_reserved() const -> usz { return _bytes_reserved; }
+};
+
+} // namespace lcc
+
+#endif // LCC_ARENA_HH
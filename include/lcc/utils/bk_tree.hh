@@ -0,0 +1,81 @@
+#ifndef LCC_BK_TREE_HH
+#define LCC_BK_TREE_HH
+
+#include <lcc/utils.hh>
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+
+/// Burkhard-Keller tree of strings, for finding the strings that are
+/// within some edit distance of another one without comparing it to
+/// every string in the tree.
+///
+/// Every child of a node is filed under its distance from that node, so
+/// by the triangle inequality, a search only has to descend into the
+/// children whose distance is within the search radius of the distance
+/// between the string searched for and the node. The distance used is
+/// the Levenshtein distance, since the tree relies on it being a metric.
+///
+/// The tree does not own the strings; they must outlive it.
+template <typename Value>
+class BKTree {
+    struct Node {
+        std::string_view key;
+        Value value;
+
+        /// Indices of the children, with their distances from this node.
+        std::vector<std::pair<usz, usz>> children{};
+    };
+
+    std::vector<Node> nodes;
+
+    template <typename Visit>
+    void search(usz index, std::string_view key, usz& radius, Visit& visit) const {
+        auto& node = nodes[index];
+        auto d = utils::EditDistance(key, node.key);
+        if (d <= radius) visit(node.key, node.value, d);
+        for (auto [edge, child] : node.children)
+            if (edge + radius >= d and edge <= d + radius)
+                search(child, key, radius, visit);
+    }
+
+public:
+    /// Add a string to the tree; the same string may be added more than once.
+    void insert(std::string_view key, Value value) {
+        if (nodes.empty()) {
+            nodes.emplace_back(key, std::move(value));
+            return;
+        }
+
+        for (usz index = 0;;) {
+            auto d = utils::EditDistance(key, nodes[index].key);
+            auto& children = nodes[index].children;
+            auto child = rgs::find(children, d, &std::pair<usz, usz>::first);
+            if (child == children.end()) {
+                children.emplace_back(d, nodes.size());
+                nodes.emplace_back(key, std::move(value));
+                return;
+            }
+
+            index = child->second;
+        }
+    }
+
+    /// Call `visit(key, value, distance)` for every string whose distance from
+    /// \p key is at most \p radius. \p visit may lower \p radius to narrow
+    /// the rest of the search, e.g. once it has found a close match.
+    template <typename Visit>
+    void search(std::string_view key, usz& radius, Visit&& visit) const {
+        if (not nodes.empty()) search(0, key, radius, visit);
+    }
+
+    [[nodiscard]]
+    auto size() const -> usz { return nodes.size(); }
+};
+
+} // namespace lcc
+
+#endif // LCC_BK_TREE_HH
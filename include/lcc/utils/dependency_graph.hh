@@ -1,6 +1,8 @@
 #ifndef LCC_DEPENDENCY_GRAPH_HH
 #define LCC_DEPENDENCY_GRAPH_HH
 
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <lcc/utils.hh>
 
@@ -10,12 +12,21 @@ template <typename Entity>
 class DependencyGraph {
     struct Node {
         Entity* entity;
-        std::vector<Entity*> dependencies{};
+        std::vector<usz> dependencies{};
 
-        Node(Entity* entity) : entity(entity) {}
+        Node(Entity* e) : entity(e) {}
     };
 
-    std::vector<Node*> nodes;
+    /// Nodes in the order in which they were first mentioned, and the
+    /// index of each entity's node.
+    std::vector<Node> nodes;
+    std::unordered_map<Entity*, usz> indices;
+
+    auto index_of(Entity* entity) -> usz {
+        auto [it, inserted] = indices.try_emplace(entity, nodes.size());
+        if (inserted) nodes.emplace_back(entity);
+        return it->second;
+    }
 
 public:
     struct Result {
@@ -33,65 +44,60 @@ public:
     DependencyGraph() {}
 
     auto add_dependency(Entity* entity, Entity* dependency) {
-        Node* node;
-
-        auto it = rgs::find_if(nodes, [&](Node* node) { return node->entity == entity; });
-        if (it != nodes.end()) {
-            node = *it;
-        } else {
-            node = new Node(entity);
-            nodes.push_back(node);
+        LCC_ASSERT(entity);
+        auto node = index_of(entity);
+        if (dependency) {
+            auto dep = index_of(dependency);
+            nodes[node].dependencies.push_back(dep);
         }
-
-        LCC_ASSERT(node);
-        if (dependency) node->dependencies.push_back(dependency);
     }
 
     auto ensure_tracked(Entity* entity) { add_dependency(entity, nullptr); }
 
+    /// Order the entities so that every entity comes after everything it
+    /// depends on, or find a cycle.
+    ///
+    /// This is a depth-first search with an explicit stack, so that deep
+    /// chains of dependencies can't overflow the call stack.
     Result get_resolved_order() {
+        enum struct State : u8 {
+            Unvisited,
+            OnStack,
+            Resolved,
+        };
+
         std::vector<Entity*> resolved{};
-        std::vector<Entity*> seen{};
-
-        std::function<Result(Entity*)> ResolveDependencies;
-        ResolveDependencies = [&](Entity* entity) -> Result {
-            auto resolved_it = rgs::find(resolved, entity);
-            if (resolved_it != resolved.end())
-                return Result{Result::Kind::Ok};
-
-            seen.push_back(entity);
-
-            auto it = rgs::find_if(nodes, [&](Node* node) { return node->entity == entity; });
-            bool is_resolved = it == nodes.end() or (*it)->dependencies.empty();
-
-            if (not is_resolved) {
-                const std::vector<Entity*>& dependencies = (*it)->dependencies;
-                for (Entity* dep : dependencies) {
-                    auto dep_resolved_it = rgs::find(resolved, dep);
-                    if (dep_resolved_it != resolved.end())
-                        return Result{Result::Kind::Ok};
-
-                    auto dep_seen_it = rgs::find(seen, dep);
-                    if (dep_seen_it != seen.end())
-                        return Result{Result::Kind::Cycle, {}, entity, *dep_seen_it};
-
-                    Result result = ResolveDependencies(dep);
-                    if (result.kind != Result::Kind::Ok) {
-                        return result;
-                    }
+        resolved.reserve(nodes.size());
+        std::vector<State> state(nodes.size(), State::Unvisited);
+
+        /// Each entry is a node and the index of the next dependency of
+        /// it to look at.
+        std::vector<std::pair<usz, usz>> stack{};
+        for (usz root = 0; root < nodes.size(); root++) {
+            if (state[root] != State::Unvisited) continue;
+            state[root] = State::OnStack;
+            stack.emplace_back(root, 0);
+
+            while (not stack.empty()) {
+                auto& [node, next] = stack.back();
+                auto& dependencies = nodes[node].dependencies;
+                if (next == dependencies.size()) {
+                    state[node] = State::Resolved;
+                    resolved.push_back(nodes[node].entity);
+                    stack.pop_back();
+                    continue;
                 }
-            }
-
-            resolved.push_back(entity);
-            seen.erase(rgs::find(seen, entity));
 
-            return Result{Result::Kind::Ok};
-        };
-
-        for (Node* node : nodes) {
-            Result result = ResolveDependencies(node->entity);
-            if (result.kind != Result::Kind::Ok) {
-                return result;
+                auto dep = dependencies[next++];
+                switch (state[dep]) {
+                    case State::Resolved: break;
+                    case State::OnStack:
+                        return Result{Result::Kind::Cycle, {}, nodes[node].entity, nodes[dep].entity};
+                    case State::Unvisited:
+                        state[dep] = State::OnStack;
+                        stack.emplace_back(dep, 0);
+                        break;
+                }
             }
         }
 
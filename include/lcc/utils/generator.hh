@@ -2,14 +2,104 @@
 #define LCC_GENERATOR_HH
 
 #include <lcc/diags.hh>
+#include <lcc/utils.hh>
 
 #include <coroutine>
 #include <iterator>
+#include <new>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
 
 namespace lcc {
+namespace detail {
+/// Recycles the memory of coroutine frames.
+///
+/// Generators are mostly short-lived and created over and over in
+/// loops, so rather than going to the heap for every frame, freed
+/// frames are kept on a free list per size class, per thread, and
+/// handed out again to the next coroutine of that size class. A frame
+/// may be freed on a different thread than the one that allocated it;
+/// it then simply goes to the free lists of the former.
+class FramePool {
+    /// Frame sizes are rounded up to a multiple of this.
+    static constexpr usz Granularity = 64;
+
+    /// Frames larger than this many multiples of Granularity aren't
+    /// recycled.
+    static constexpr usz SizeClasses = 32;
+
+    /// The number of free frames kept per size class; the memory of any
+    /// more than that is freed.
+    static constexpr usz MaxFreeFrames = 64;
+
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+
+    /// This is trivially destructible, so it stays valid as long as the
+    /// thread does, even while other thread-local objects, which may
+    /// still free frames, are destroyed.
+    struct FreeLists {
+        FreeFrame* heads[SizeClasses]{};
+        usz counts[SizeClasses]{};
+        bool closed{};
+    };
+    static thread_local FreeLists lists;
+
+    /// Frees whatever is left on the free lists once the thread exits;
+    /// any frame freed after that isn't recycled anymore.
+    struct Closer {
+        Closer() = default;
+        Closer(const Closer&) = delete;
+        Closer& operator=(const Closer&) = delete;
+        ~Closer() {
+            for (auto& head : lists.heads) {
+                while (auto* frame = head) {
+                    head = frame->next;
+                    ::operator delete(frame);
+                }
+            }
+            lists.closed = true;
+        }
+    };
+    static thread_local Closer closer;
+
+    static auto SizeClass(usz size) -> usz { return (size - 1) / Granularity; }
+
+public:
+    static auto Allocate(usz size) -> void* {
+        auto size_class = SizeClass(size);
+        if (size_class >= SizeClasses) return ::operator new(size);
+        if (auto* frame = lists.heads[size_class]) {
+            lists.heads[size_class] = frame->next;
+            lists.counts[size_class]--;
+            return frame;
+        }
+        return ::operator new((size_class + 1) * Granularity);
+    }
+
+    /// \p size must be what the frame was allocated with.
+    static void Deallocate(void* ptr, usz size) {
+        auto size_class = SizeClass(size);
+        if (size_class >= SizeClasses or lists.closed or lists.counts[size_class] == MaxFreeFrames) {
+            ::operator delete(ptr);
+            return;
+        }
+
+        // Make sure the free lists are emptied when the thread exits.
+        [[maybe_unused]] auto& c = closer;
+
+        auto* frame = ::new (ptr) FreeFrame{lists.heads[size_class]};
+        lists.heads[size_class] = frame;
+        lists.counts[size_class]++;
+    }
+};
+
+inline thread_local constinit FramePool::FreeLists FramePool::lists{};
+inline thread_local FramePool::Closer FramePool::closer{};
+} // namespace detail
+
 template <typename T>
 concept GeneratableValue = std::is_move_assignable_v<T> and std::is_default_constructible_v<T>;
 
@@ -56,6 +146,11 @@ public:
 
     struct promise_type {
         T current_value{};
+
+        /// Frames are recycled rather than freed; see detail::FramePool.
+        static auto operator new(usz size) -> void* { return detail::FramePool::Allocate(size); }
+        static void operator delete(void* frame, usz size) { detail::FramePool::Deallocate(frame, size); }
+
         auto get_return_object() -> Generator { return {handle_type::from_promise(*this)}; }
         auto final_suspend() noexcept -> std::suspend_always { return {}; }
         auto initial_suspend() noexcept -> std::suspend_never { return {}; };
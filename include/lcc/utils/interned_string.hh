@@ -0,0 +1,89 @@
+#ifndef LCC_INTERNED_STRING_HH
+#define LCC_INTERNED_STRING_HH
+
+#include <lcc/utils.hh>
+
+#include <functional>
+#include <optional>
+#include <string_view>
+
+namespace lcc {
+
+/// Handle for an interned string.
+///
+/// Every distinct string is interned exactly once, so two handles are
+/// equal iff their text is, and comparing or hashing them is as cheap
+/// as doing so for an integer. The table is shared by every module in
+/// the process, which is what lets the scopes of an imported module be
+/// searched with names from the module importing it.
+///
+/// Interned strings are never freed, so the table holds every distinct
+/// string interned since the process started: in practice, the distinct
+/// identifiers in all the source and metadata the process has read.
+/// The compile server handles each request in a forked process, so its
+/// table does not grow with the requests it serves. The language server
+/// lexes every document it is sent itself, so its table grows with the
+/// distinct identifiers in the files edited during a session; lexing
+/// an edited file again only adds the identifiers that are new.
+///
+/// Handles also hold the text, so getting it does not touch the table.
+///
+/// The default-constructed handle is the empty string.
+class InternedString {
+    const char* _data = "";
+    u32 _size{};
+    u32 _id{};
+
+    constexpr InternedString(std::string_view text, u32 id)
+        : _data(text.data()), _size(u32(text.size())), _id(id) {}
+
+public:
+    constexpr InternedString() = default;
+
+    /// Intern a string.
+    explicit InternedString(std::string_view text);
+
+    /// Get the handle for a string only if it has already been interned.
+    ///
+    /// This is for lookups: if a string was never interned, then nothing
+    /// can have been declared with it as its name.
+    [[nodiscard]]
+    static auto Find(std::string_view text) -> std::optional<InternedString>;
+
+    /// The index of this string in the table.
+    [[nodiscard]]
+    constexpr auto id() const -> u32 { return _id; }
+
+    /// Whether this is the empty string.
+    [[nodiscard]]
+    constexpr auto empty() const -> bool { return _id == 0; }
+
+    /// The text of this string. This remains valid for the lifetime
+    /// of the process.
+    [[nodiscard]]
+    constexpr auto str() const -> std::string_view { return {_data, _size}; }
+
+    [[nodiscard]]
+    constexpr auto operator==(const InternedString& other) const -> bool {
+        return _id == other._id;
+    }
+};
+
+} // namespace lcc
+
+template <>
+struct std::hash<lcc::InternedString> {
+    auto operator()(lcc::InternedString sym) const noexcept -> std::size_t {
+        return std::hash<lcc::u32>{}(sym.id());
+    }
+};
+
+template <>
+struct fmt::formatter<lcc::InternedString> : formatter<std::string_view> {
+    template <typename FormatContext>
+    auto format(lcc::InternedString sym, FormatContext& ctx) const {
+        return formatter<std::string_view>::format(sym.str(), ctx);
+    }
+};
+
+#endif // LCC_INTERNED_STRING_HH
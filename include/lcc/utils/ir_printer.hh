@@ -2,31 +2,55 @@
 #define LCC_UTILS_IR_PRINTER_HH
 
 #include <lcc/context.hh>
+#include <lcc/diags.hh>
 #include <lcc/ir/ir.hh>
 #include <lcc/ir/module.hh>
 #include <lcc/utils.hh>
 
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <iterator>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 namespace lcc {
 template <typename Derived, usz block_indent>
 class IRPrinter {
 private:
+    /// When writing to a file, this much output is collected before it
+    /// is written out.
+    static constexpr usz chunk_size = usz(64) * 1024;
+
     std::string s{};
     isz tmp = 0;
 
+    /// If set, the output is written here a chunk at a time instead of
+    /// being collected in `s`.
+    std::FILE* out{};
+
     /// Map from blocks and instructions to their indices.
     std::unordered_map<Block*, isz> block_indices{};
     std::unordered_map<Inst*, isz> inst_indices{};
 
-
 public:
     /// Entry point.
     static auto Print(Module* mod, bool use_colour) -> std::string {
-        return IRPrinter{use_colour}.PrintModule(mod);
+        IRPrinter p{use_colour};
+        p.PrintModule(mod);
+        return std::move(p.s);
+    }
+
+    /// Entry point. Write the module to \p file as it is printed, so that
+    /// output starts right away and only a chunk of it is ever in memory.
+    static void Print(Module* mod, bool use_colour, std::FILE* file) {
+        IRPrinter p{use_colour};
+        p.out = file;
+        p.PrintModule(mod);
+        p.Flush();
     }
 
 protected:
@@ -67,6 +91,21 @@ protected:
         fmt::format_to(It(s), fmt, std::forward<Args>(args)...);
     }
 
+    /// Write out what has been printed so far, if we're writing to a file.
+    void Flush() {
+        if (not out) return;
+        if (std::fwrite(s.data(), 1, s.size(), out) != s.size())
+            Diag::Fatal("Failed to write IR: {}", std::strerror(errno));
+        s.clear();
+    }
+
+    /// Write out what has been printed so far once it's a chunk's worth.
+    /// This is called between instructions and top-level entities, so a
+    /// chunk may be a bit longer than the chunk size.
+    void FlushIfFull() {
+        if (s.size() >= chunk_size) Flush();
+    }
+
     /// Emit a block and its containing instructions.
     void PrintBlock(Block* b) {
         for (usz i = 0; i < block_indent; i++) s += ' ';
@@ -74,6 +113,7 @@ protected:
         for (auto inst : b->instructions()) {
             This()->PrintInst(inst);
             s += '\n';
+            FlushIfFull();
         }
     }
 
@@ -95,20 +135,77 @@ protected:
         This()->ExitFunctionBody(f);
     }
 
-    auto PrintModule(Module* mod) -> std::string {
+    /// Collect the struct types that a type is made of.
+    static void CollectStructTypes(Type* t, std::unordered_set<Type*>& used) {
+        if (not t) return;
+        switch (t->kind) {
+            case Type::Kind::Struct:
+                if (not used.insert(t).second) return;
+                for (auto* m : as<StructType>(t)->members()) CollectStructTypes(m, used);
+                return;
+
+            case Type::Kind::Array:
+                CollectStructTypes(as<ArrayType>(t)->element_type(), used);
+                return;
+
+            case Type::Kind::Function:
+                CollectStructTypes(as<FunctionType>(t)->ret(), used);
+                for (auto* p : as<FunctionType>(t)->params()) CollectStructTypes(p, used);
+                return;
+
+            default: return;
+        }
+    }
+
+    /// Get the struct types that a module uses, in the order in which they
+    /// were created. The context is shared by every module compiled in it,
+    /// so it also has the types of other modules, which we don’t print.
+    static auto UsedStructTypes(Module* mod) -> std::vector<Type*> {
+        std::unordered_set<Type*> used{};
+        auto Use = [&](Type* t) { CollectStructTypes(t, used); };
+        for (auto* var : mod->vars()) {
+            Use(var->allocated_type());
+            if (var->init()) Use(var->init()->type());
+        }
+
+        for (auto* f : mod->code()) {
+            Use(f->type());
+            for (auto* b : f->blocks()) {
+                for (auto* inst : b->instructions()) {
+                    Use(inst->type());
+                    for (auto* v : inst->children())
+                        if (v) Use(v->type());
+                    if (auto* a = cast<AllocaInst>(inst)) Use(a->allocated_type());
+                    else if (auto* c = cast<CallInst>(inst)) Use(c->function_type());
+                    else if (auto* g = cast<GEPBaseInst>(inst)) Use(g->base_type());
+                }
+            }
+        }
+
+        std::vector<Type*> out{};
+        for (auto* t : mod->context()->struct_types)
+            if (used.contains(t)) out.push_back(t);
+        return out;
+    }
+
+    void PrintModule(Module* mod) {
         This()->PrintHeader(mod);
-        for (auto struct_type : mod->context()->struct_types) This()->PrintStructType(struct_type);
-        if (not mod->context()->struct_types.empty()) s += '\n';
-        for (auto var : mod->vars()) This()->PrintGlobal(var);
+        auto struct_types = UsedStructTypes(mod);
+        for (auto struct_type : struct_types) This()->PrintStructType(struct_type);
+        if (not struct_types.empty()) s += '\n';
+        for (auto var : mod->vars()) {
+            This()->PrintGlobal(var);
+            FlushIfFull();
+        }
         if (not mod->vars().empty()) s += '\n';
         bool first = true;
         for (auto f : mod->code()) {
             if (first) first = false;
             else s += '\n';
             PrintFunction(f);
+            FlushIfFull();
         }
         s += C(Reset);
-        return std::move(s);
     }
 
     void SetFunctionIndices(Function* f) {
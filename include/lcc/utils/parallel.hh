@@ -0,0 +1,51 @@
+#ifndef LCC_PARALLEL_HH
+#define LCC_PARALLEL_HH
+
+#include <lcc/utils.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace lcc {
+
+/// Resolve a requested job count to the number of threads to use.
+///
+/// Zero means “one per hardware thread”.
+[[nodiscard]]
+inline auto ResolveJobCount(usz jobs) -> usz {
+    if (jobs) return jobs;
+    return std::max(usz(std::thread::hardware_concurrency()), usz(1));
+}
+
+/// Call \p func with every index in [0, count), using up to \p jobs
+/// threads (including the calling thread).
+///
+/// Work is handed out one index at a time from a shared counter, so a
+/// thread that finishes early simply picks up the next pending item
+/// instead of sitting idle behind a large one. \p func must only touch
+/// state belonging to its own index (or state that is otherwise safe to
+/// share). Returns once every index has been processed.
+template <typename Func>
+void ParallelFor(usz count, usz jobs, Func&& func) {
+    jobs = std::min(ResolveJobCount(jobs), count);
+    if (jobs <= 1) {
+        for (usz i = 0; i < count; ++i) func(i);
+        return;
+    }
+
+    std::atomic<usz> next{0};
+    auto worker = [&] {
+        for (usz i = next++; i < count; i = next++) func(i);
+    };
+
+    std::vector<std::jthread> threads{};
+    threads.reserve(jobs - 1);
+    for (usz i = 1; i < jobs; ++i) threads.emplace_back(worker);
+    worker();
+}
+
+} // namespace lcc
+
+#endif // LCC_PARALLEL_HH
@@ -5,6 +5,8 @@
 /// (e.g. unistd.h, windows.h, ...) here to keep
 /// the APIs below platform-agnostic.
 
+#include <cstddef>
+
 namespace lcc::platform {
 /// Print a stack trace to a FILE*.
 void PrintBacktrace();
@@ -14,6 +16,15 @@ bool StdoutIsTerminal();
 
 /// Check whether stderr is a terminal.
 bool StderrIsTerminal();
+
+/// Get the number of bytes of memory of this process that are currently
+/// resident, or 0 if that can’t be determined on this platform.
+auto ResidentSetSize() -> std::size_t;
+
+/// Get the largest number of bytes of memory of this process that have
+/// been resident at once, or 0 if that can’t be determined on this
+/// platform.
+auto PeakResidentSetSize() -> std::size_t;
 } // namespace lcc::platform
 
 #endif // LCC_PLATFORM_HH
@@ -0,0 +1,184 @@
+#ifndef LCC_SMALL_VECTOR_HH
+#define LCC_SMALL_VECTOR_HH
+
+#include <lcc/utils.hh>
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace lcc {
+
+/// Vector that stores up to \p N elements inline, and only allocates
+/// once it grows past that.
+///
+/// This is meant for the many tiny lists of the backend, e.g. the
+/// operands of a machine instruction, most of which never hold more
+/// than a handful of elements. Elements must be trivially copyable, so
+/// they are copied around as raw memory.
+template <typename T, usz N>
+class SmallVector {
+    static_assert(N > 0, "Use std::vector if nothing is stored inline");
+    static_assert(
+        std::is_trivially_copyable_v<T> and std::is_trivially_destructible_v<T>,
+        "SmallVector elements must be trivially copyable"
+    );
+
+    union {
+        T* _heap;
+        alignas(T) std::byte _inline[N * sizeof(T)];
+    };
+    u32 _size{};
+    u32 _capacity{N};
+
+    [[nodiscard]]
+    auto inline_data() -> T* { return std::launder(reinterpret_cast<T*>(_inline)); }
+
+    [[nodiscard]]
+    auto inline_data() const -> const T* { return std::launder(reinterpret_cast<const T*>(_inline)); }
+
+    void release() {
+        if (not is_inline()) std::allocator<T>{}.deallocate(_heap, _capacity);
+        _capacity = N;
+    }
+
+    void copy_from(const SmallVector& other) {
+        reserve(other._size);
+        std::memcpy(static_cast<void*>(data()), other.data(), other._size * sizeof(T));
+        _size = other._size;
+    }
+
+    void move_from(SmallVector& other) {
+        if (other.is_inline()) {
+            std::memcpy(static_cast<void*>(inline_data()), other.inline_data(), other._size * sizeof(T));
+        } else {
+            _heap = other._heap;
+            _capacity = other._capacity;
+            other._capacity = N;
+        }
+        _size = other._size;
+        other._size = 0;
+    }
+
+public:
+    using value_type = T;
+    using size_type = usz;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() {}
+    SmallVector(std::initializer_list<T> elements) {
+        reserve(elements.size());
+        for (const auto& e : elements) push_back(e);
+    }
+
+    SmallVector(const SmallVector& other) { copy_from(other); }
+    SmallVector(SmallVector&& other) noexcept { move_from(other); }
+
+    auto operator=(const SmallVector& other) -> SmallVector& {
+        if (this == &other) return *this;
+        _size = 0;
+        copy_from(other);
+        return *this;
+    }
+
+    auto operator=(SmallVector&& other) noexcept -> SmallVector& {
+        if (this == &other) return *this;
+        release();
+        move_from(other);
+        return *this;
+    }
+
+    ~SmallVector() { release(); }
+
+    /// Whether the elements are still stored inline.
+    [[nodiscard]]
+    auto is_inline() const -> bool { return _capacity == N; }
+
+    /// Get the number of bytes allocated on the heap.
+    [[nodiscard]]
+    auto heap_bytes() const -> usz { return is_inline() ? 0 : _capacity * sizeof(T); }
+
+    [[nodiscard]]
+    auto data() -> T* { return is_inline() ? inline_data() : _heap; }
+
+    [[nodiscard]]
+    auto data() const -> const T* { return is_inline() ? inline_data() : _heap; }
+
+    [[nodiscard]]
+    auto size() const -> usz { return _size; }
+
+    [[nodiscard]]
+    auto capacity() const -> usz { return _capacity; }
+
+    [[nodiscard]]
+    auto empty() const -> bool { return _size == 0; }
+
+    /// Make room for at least \p capacity elements.
+    void reserve(usz capacity) {
+        if (capacity <= _capacity) return;
+        auto* heap = std::allocator<T>{}.allocate(capacity);
+        std::memcpy(static_cast<void*>(heap), data(), _size * sizeof(T));
+        release();
+        _heap = heap;
+        _capacity = u32(capacity);
+    }
+
+    /// Append an element. This takes a copy first, in case \p value is
+    /// an element of this vector and growing would invalidate it.
+    void push_back(T value) {
+        if (_size == _capacity) reserve(2 * _capacity);
+        std::construct_at(data() + _size, value);
+        _size++;
+    }
+
+    void pop_back() {
+        LCC_ASSERT(_size, "pop_back() on empty SmallVector");
+        _size--;
+    }
+
+    void clear() { _size = 0; }
+
+    [[nodiscard]]
+    auto operator[](usz i) -> T& { return data()[i]; }
+
+    [[nodiscard]]
+    auto operator[](usz i) const -> const T& { return data()[i]; }
+
+    [[nodiscard]]
+    auto at(usz i) -> T& {
+        LCC_ASSERT(i < _size, "SmallVector index {} out of bounds (size {})", i, _size);
+        return data()[i];
+    }
+
+    [[nodiscard]]
+    auto at(usz i) const -> const T& {
+        LCC_ASSERT(i < _size, "SmallVector index {} out of bounds (size {})", i, _size);
+        return data()[i];
+    }
+
+    [[nodiscard]]
+    auto front() -> T& { return at(0); }
+    [[nodiscard]]
+    auto front() const -> const T& { return at(0); }
+    [[nodiscard]]
+    auto back() -> T& { return at(_size - 1); }
+    [[nodiscard]]
+    auto back() const -> const T& { return at(_size - 1); }
+
+    [[nodiscard]]
+    auto begin() -> iterator { return data(); }
+    [[nodiscard]]
+    auto begin() const -> const_iterator { return data(); }
+    [[nodiscard]]
+    auto end() -> iterator { return data() + _size; }
+    [[nodiscard]]
+    auto end() const -> const_iterator { return data() + _size; }
+};
+
+} // namespace lcc
+
+#endif // LCC_SMALL_VECTOR_HH
@@ -0,0 +1,163 @@
+#ifndef COFF_H
+#define COFF_H
+
+#include <stdint.h>
+
+/// x86_64
+#define IMAGE_FILE_MACHINE_AMD64 0x8664
+
+/// Section contains executable code.
+#define IMAGE_SCN_CNT_CODE 0x00000020u
+/// Section contains initialized data.
+#define IMAGE_SCN_CNT_INITIALIZED_DATA 0x00000040u
+/// Section contains uninitialized data (bss).
+#define IMAGE_SCN_CNT_UNINITIALIZED_DATA 0x00000080u
+/// Section contains comments or other information (object files only).
+#define IMAGE_SCN_LNK_INFO 0x00000200u
+/// Section will not become part of the image (object files only).
+#define IMAGE_SCN_LNK_REMOVE 0x00000800u
+/// Align data on a 1-byte boundary (object files only).
+#define IMAGE_SCN_ALIGN_1BYTES 0x00100000u
+/// Align data on a 16-byte boundary (object files only).
+#define IMAGE_SCN_ALIGN_16BYTES 0x00500000u
+/// Section contains more relocations than fit in NumberOfRelocations;
+/// the actual count is in the VirtualAddress field of the first one.
+#define IMAGE_SCN_LNK_NRELOC_OVFL 0x01000000u
+/// Section can be discarded as needed.
+#define IMAGE_SCN_MEM_DISCARDABLE 0x02000000u
+/// Executable
+#define IMAGE_SCN_MEM_EXECUTE 0x20000000u
+/// Readable
+#define IMAGE_SCN_MEM_READ 0x40000000u
+/// Writable
+#define IMAGE_SCN_MEM_WRITE 0x80000000u
+
+/// Symbol is not yet assigned a section (i.e. is external).
+#define IMAGE_SYM_UNDEFINED 0
+
+/// No type information or unknown base type.
+#define IMAGE_SYM_TYPE_NULL 0x0000
+/// Symbol is a function: complex type "function" (2), shifted past the
+/// four bits of the base type. This is the only type Microsoft tools
+/// care about.
+#define IMAGE_SYM_TYPE_FUNCTION 0x0020
+
+/// External symbol; defined if the section number is not zero.
+#define IMAGE_SYM_CLASS_EXTERNAL 2
+/// The offset of the symbol within its section; a section symbol if the
+/// value is zero.
+#define IMAGE_SYM_CLASS_STATIC 3
+
+/// 64-bit virtual address of the target.
+#define IMAGE_REL_AMD64_ADDR64 0x0001
+/// 32-bit virtual address of the target.
+#define IMAGE_REL_AMD64_ADDR32 0x0002
+/// 32-bit address relative to the byte following the relocation; the
+/// equivalent of ELF's R_X86_64_PC32 with an addend of -4.
+#define IMAGE_REL_AMD64_REL32 0x0004
+
+/// No padding anywhere: symbols and relocations are 18 and 10 bytes
+/// long, respectively, and are stored back to back.
+#pragma pack(push, 1)
+
+/// COFF File Header
+typedef struct coff_header {
+  /// Machine that is targeted. See IMAGE_FILE_MACHINE_* macros.
+  uint16_t Machine;
+  /// Amount of entries present in the section table.
+  uint16_t NumberOfSections;
+  /// Seconds since 1970 at which the file was created; leave it zero for
+  /// reproducible output.
+  uint32_t TimeDateStamp;
+  /// Byte offset within file of the symbol table.
+  uint32_t PointerToSymbolTable;
+  /// Amount of entries present in the symbol table, including auxiliary
+  /// records. The string table follows the symbol table immediately.
+  uint32_t NumberOfSymbols;
+  /// Zero for object files.
+  uint16_t SizeOfOptionalHeader;
+  /// Zero for object files.
+  uint16_t Characteristics;
+} coff_header;
+
+/// COFF Section Header
+typedef struct coff_shdr {
+  /// NUL-padded name of the section, if it fits; otherwise, a slash
+  /// followed by the offset of the name within the string table, in
+  /// decimal.
+  char Name[8];
+  /// Zero for object files.
+  uint32_t VirtualSize;
+  /// Zero for object files.
+  uint32_t VirtualAddress;
+  /// Size in bytes of the section (in memory, for uninitialized data).
+  uint32_t SizeOfRawData;
+  /// Byte offset of the section data within the file; zero for
+  /// uninitialized data.
+  uint32_t PointerToRawData;
+  /// Byte offset of the relocations of this section within the file.
+  uint32_t PointerToRelocations;
+  /// Zero; COFF line numbers are deprecated.
+  uint32_t PointerToLinenumbers;
+  /// Amount of relocations of this section. See IMAGE_SCN_LNK_NRELOC_OVFL.
+  uint16_t NumberOfRelocations;
+  /// Zero; COFF line numbers are deprecated.
+  uint16_t NumberOfLinenumbers;
+  /// See IMAGE_SCN_* macros for more info.
+  uint32_t Characteristics;
+} coff_shdr;
+
+/// COFF Symbol Table Entry
+typedef struct coff_sym {
+  /// NUL-padded name of the symbol, if it fits. Otherwise, the first four
+  /// bytes are zero and the last four the offset of the name within the
+  /// string table.
+  union {
+    char ShortName[8];
+    struct {
+      uint32_t Zeroes;
+      uint32_t Offset;
+    } LongName;
+  } Name;
+  /// Meaning depends on section number and storage class; usually the
+  /// offset of the symbol within its section.
+  uint32_t Value;
+  /// One-based index into the section table, or IMAGE_SYM_UNDEFINED.
+  int16_t SectionNumber;
+  /// See IMAGE_SYM_TYPE_* macros for more info.
+  uint16_t Type;
+  /// See IMAGE_SYM_CLASS_* macros for more info.
+  uint8_t StorageClass;
+  /// Amount of auxiliary records following this one.
+  uint8_t NumberOfAuxSymbols;
+} coff_sym;
+
+/// Auxiliary record following the symbol of a section, describing it.
+typedef struct coff_aux_section {
+  /// Size in bytes of the section.
+  uint32_t Length;
+  uint16_t NumberOfRelocations;
+  uint16_t NumberOfLinenumbers;
+  /// Only used for COMDAT sections.
+  uint32_t CheckSum;
+  /// Only used for COMDAT sections.
+  uint16_t Number;
+  /// Only used for COMDAT sections.
+  uint8_t Selection;
+  uint8_t Unused[3];
+} coff_aux_section;
+
+/// COFF Relocation. There is no addend; whatever is stored at the
+/// relocated location is added to the value of the symbol.
+typedef struct coff_reloc {
+  /// Offset of the relocated location within its section.
+  uint32_t VirtualAddress;
+  /// Zero-based index into the symbol table.
+  uint32_t SymbolTableIndex;
+  /// See IMAGE_REL_AMD64_* macros for more info.
+  uint16_t Type;
+} coff_reloc;
+
+#pragma pack(pop)
+
+#endif /* COFF_H */
@@ -149,6 +149,21 @@ typedef struct elf64_header {
   uint16_t e_shstrndx;
 } elf64_header;
 
+/// Program header table entry unused
+#define PT_NULL 0x0
+/// Loadable segment
+#define PT_LOAD 0x1
+/// Dynamic linking information
+#define PT_DYNAMIC 0x2
+/// Path of the program interpreter (dynamic linker)
+#define PT_INTERP 0x3
+/// Auxiliary information
+#define PT_NOTE 0x4
+/// The program header table itself
+#define PT_PHDR 0x6
+/// Whether the stack is executable, by the flags of this entry
+#define PT_GNU_STACK 0x6474e551
+
 /// Executable
 #define PF_X 0b001
 /// Writable
@@ -185,6 +200,42 @@ typedef struct elf64_phdr {
   uint64_t p_align;
 } elf64_phdr;
 
+/// Marks the end of the dynamic section
+#define DT_NULL 0
+/// String table offset of the name of a needed library
+#define DT_NEEDED 1
+/// Address of the symbol hash table
+#define DT_HASH 4
+/// Address of the dynamic string table
+#define DT_STRTAB 5
+/// Address of the dynamic symbol table
+#define DT_SYMTAB 6
+/// Address of the relocations with addends
+#define DT_RELA 7
+/// Size in bytes of the relocations with addends
+#define DT_RELASZ 8
+/// Size in bytes of a relocation with an addend
+#define DT_RELAENT 9
+/// Size in bytes of the dynamic string table
+#define DT_STRSZ 10
+/// Size in bytes of a dynamic symbol
+#define DT_SYMENT 11
+/// Filled in by the dynamic linker, for debuggers
+#define DT_DEBUG 21
+/// See DF_* macros for more info.
+#define DT_FLAGS 30
+
+/// Resolve all symbols at load time rather than lazily
+#define DF_BIND_NOW 0x8
+
+/// ELF 64-bit Dynamic Section Entry
+typedef struct elf64_dyn {
+  /// See DT_* macros for more info.
+  int64_t d_tag;
+  /// Value or address, depending on the tag.
+  uint64_t d_val;
+} elf64_dyn;
+
 /// ELF 64-bit Section Header
 typedef struct elf64_shdr {
   /// Offset into the `.shstrtab` section that represents the name of this section.
@@ -288,6 +339,8 @@ typedef struct elf64_sym {
 #define R_X86_64_64 1
 // dword S + A – P
 #define R_X86_64_PC32 2
+// qword S; sets a GOT entry to the address of a symbol
+#define R_X86_64_GLOB_DAT 6
 // dword S + A
 #define R_X86_64_32	10
 // dword L + A – P
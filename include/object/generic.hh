@@ -5,7 +5,9 @@
 #include <lcc/ir/ir.hh>
 #include <lcc/utils.hh>
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace lcc {
@@ -18,6 +20,10 @@ struct Section {
 private:
     std::vector<u8> _contents{};
 
+    // Iff is_borrowed is true, contents belong to someone else and are
+    // referenced by this span instead.
+    std::span<const u8> _borrowed{};
+
 public:
     u64 attributes{};
 
@@ -30,9 +36,28 @@ public:
     // construct contents of section.
     bool is_fill{false};
 
+    bool is_borrowed{false};
+
     Section() = default;
     Section(std::string name_) : name(name_) {}
 
+    // A section with the same name and attributes as the given one, whose
+    // contents are those of the given section rather than a copy of them.
+    // The given section must outlive the returned one, and not be appended
+    // to while the latter is still around.
+    static Section Borrow(const Section& section) {
+        Section out{section.name};
+        out.attributes = section.attributes;
+        out.is_fill = section.is_fill;
+        out._length = section._length;
+        out._value = section._value;
+        if (not section.is_fill) {
+            out.is_borrowed = true;
+            out._borrowed = section.bytes();
+        }
+        return out;
+    }
+
     // Enum integer value is bit index into attributes field.
     enum struct Attribute {
         // By default, a section is not loaded when the object file is loaded into
@@ -45,6 +70,10 @@ public:
         // Mark this section as having "executable" permissions when it is loaded.
         // Common Sections: `.text`
         EXECUTABLE,
+        // Mark this section as holding NUL-terminated strings, which the linker
+        // may merge with identical strings from other objects.
+        // Common Sections: `.rodata.str1.1`
+        MERGE_STRINGS,
 
         MAX = sizeof(decltype(attributes)) // NONE ALLOWED PAST THIS
     };
@@ -69,25 +98,30 @@ public:
 
     auto& contents() {
         LCC_ASSERT(not is_fill, "Cannot append to contents unless section !is_fill");
+        LCC_ASSERT(not is_borrowed, "Cannot append to contents unless section !is_borrowed");
+        return _contents;
+    }
+
+    // The contents of the section, whether they are its own or borrowed.
+    std::span<const u8> bytes() const {
+        LCC_ASSERT(not is_fill, "Cannot access contents unless section !is_fill");
+        if (is_borrowed) return _borrowed;
         return _contents;
     }
 
     Section& operator+=(u8 rhs) {
-        LCC_ASSERT(not is_fill, "Cannot append to contents unless section !is_fill");
-        _contents.push_back(rhs);
+        contents().push_back(rhs);
         return *this;
     }
 
     // use like <section> += {0x32, 0x4}, etc.
     Section& operator+=(const std::initializer_list<const u8> rhs) {
-        LCC_ASSERT(not is_fill, "Cannot append to contents unless section !is_fill");
-        _contents.insert(_contents.end(), rhs.begin(), rhs.end());
+        contents().insert(_contents.end(), rhs.begin(), rhs.end());
         return *this;
     }
 
     Section& operator+=(const std::span<const u8> rhs) {
-        LCC_ASSERT(not is_fill, "Cannot append to contents unless section !is_fill");
-        _contents.insert(_contents.end(), rhs.begin(), rhs.end());
+        contents().insert(_contents.end(), rhs.begin(), rhs.end());
         return *this;
     }
 
@@ -101,12 +135,13 @@ public:
         if (is_fill) {
             out += fmt::format(" {} {:x}\n", _length, _value);
         } else {
-            if (_contents.empty()) {
+            const auto data = bytes();
+            if (data.empty()) {
                 out += " empty\n";
                 return out;
             }
 
-            const auto size = _contents.size();
+            const auto size = data.size();
             out += fmt::format("\n================ {} bytes\n", size);
 
             // Print bytes like hexdump, kinda
@@ -115,28 +150,28 @@ public:
                 for (; i < size - 16; i += 16) {
                     out += fmt::format(
                         "      {:02x} {:02x} {:02x} {:02x} {:02x} {:02x} {:02x} {:02x}  {:02x} {:02x} {:02x} {:02x} {:02x} {:02x} {:02x} {:02x}",
-                        _contents[i],
-                        _contents[i + 1],
-                        _contents[i + 2],
-                        _contents[i + 3],
-                        _contents[i + 4],
-                        _contents[i + 5],
-                        _contents[i + 6],
-                        _contents[i + 7],
-                        _contents[i + 8],
-                        _contents[i + 9],
-                        _contents[i + 10],
-                        _contents[i + 11],
-                        _contents[i + 12],
-                        _contents[i + 13],
-                        _contents[i + 14],
-                        _contents[i + 15]
+                        data[i],
+                        data[i + 1],
+                        data[i + 2],
+                        data[i + 3],
+                        data[i + 4],
+                        data[i + 5],
+                        data[i + 6],
+                        data[i + 7],
+                        data[i + 8],
+                        data[i + 9],
+                        data[i + 10],
+                        data[i + 11],
+                        data[i + 12],
+                        data[i + 13],
+                        data[i + 14],
+                        data[i + 15]
                     );
 
                     out += "      |";
                     // Loop over 16 bytes starting at `i`.
                     for (usz index = i; index < i + 16; ++index) {
-                        char c = char(_contents[index]);
+                        char c = char(data[index]);
                         if (c < ' ' || c > '~') c = '.';
                         out += fmt::format("{}", c);
                     }
@@ -149,7 +184,7 @@ public:
                 out += "      ";
                 for (usz index = i; index < i + 16; ++index) {
                     // If inbounds, print byte, otherwise print blank space to keep alignment.
-                    if (index < size) out += fmt::format("{:02x}", _contents[index]);
+                    if (index < size) out += fmt::format("{:02x}", data[index]);
                     else out += "  ";
                     // Space after every one except for the last.
                     if (index - i != 15) out += ' ';
@@ -159,7 +194,7 @@ public:
                 out += "      |";
                 for (usz index = i; index < i + 16; ++index) {
                     if (index < size) {
-                        char c = char(_contents[index]);
+                        char c = char(data[index]);
                         if (c < ' ' || c > '~') c = '.';
                         out += fmt::format("{}", c);
                     } else out += '.';
@@ -220,6 +255,10 @@ struct Relocation {
         NONE,
         DISPLACEMENT32,
         DISPLACEMENT32_PCREL,
+
+        // A 32-bit offset from the relocated location to the symbol plus
+        // the addend, for data that refers to code, like .eh_frame.
+        PCREL32,
     } kind;
 
     std::string kind_string(Kind k) {
@@ -230,6 +269,8 @@ struct Relocation {
                 return "DISP32";
             case Kind::DISPLACEMENT32_PCREL:
                 return "DISP32_PCREL";
+            case Kind::PCREL32:
+                return "PCREL32";
         }
         LCC_UNREACHABLE();
     }
@@ -249,6 +290,10 @@ constexpr isz align_to(isz value, isz alignment) {
     return value + ((alignment - (value % alignment)) % alignment);
 }
 
+namespace detail {
+class ObjectWriter;
+} // namespace detail
+
 struct GenericObject {
     std::vector<Section> sections;
     std::vector<Symbol> symbols;
@@ -266,10 +311,15 @@ struct GenericObject {
     }
 
     // Creates symbols representing all names of the given global.
-    // NOTE: Requires .data, .bss sections to exist. .bss needs is_fill set to true.
-    void symbols_from_global(GlobalVariable* var) {
+    // NOTE: Requires .data, .bss sections (or the sections given instead of
+    // them) to exist. .bss needs is_fill set to true.
+    void symbols_from_global(
+        GlobalVariable* var,
+        std::string_view data_section_name = ".data",
+        std::string_view bss_section_name = ".bss"
+    ) {
         if (var->init()) {
-            Section& initialized_data = section(".data");
+            Section& initialized_data = section(data_section_name);
 
             size_t data_offset = initialized_data.contents().size();
             for (auto n : var->names()) {
@@ -283,7 +333,7 @@ struct GenericObject {
                                       ? Symbol::Kind::EXPORT
                                       : Symbol::Kind::STATIC;
 
-                symbols.push_back({kind, n.name, ".data", data_offset});
+                symbols.push_back({kind, n.name, std::string{data_section_name}, data_offset});
             }
 
             switch (var->init()->kind()) {
@@ -313,11 +363,11 @@ struct GenericObject {
 
                 if (imported) {
                     // Create symbol referencing externally-defined value.
-                    symbols.push_back({Symbol::Kind::EXTERNAL, n.name, ".bss", 0});
+                    symbols.push_back({Symbol::Kind::EXTERNAL, n.name, std::string{bss_section_name}, 0});
                 } else {
                     // Allocate space for variable in .bss section
-                    Symbol s{Symbol::Kind::STATIC, n.name, ".bss", 0};
-                    Section& uninitialized_data = section(".bss");
+                    Symbol s{Symbol::Kind::STATIC, n.name, std::string{bss_section_name}, 0};
+                    Section& uninitialized_data = section(bss_section_name);
 
                     // Align uninitialized data to variable type's alignment requirements.
                     uninitialized_data.length() = u32(align_to(
@@ -340,19 +390,35 @@ struct GenericObject {
     std::string print() {
         std::string out{};
         // out += fmt::format("SYMBOLS: {}\n", symbols.size());
-        for (auto sym : symbols)
+        for (auto& sym : symbols)
             out += sym.print();
         // out += fmt::format("RELOCATIONS: {}\n", relocations.size());
-        for (auto relocation : relocations)
+        for (auto& relocation : relocations)
             out += relocation.print();
         // out += fmt::format("SECTIONS: {}\n", sections.size());
-        for (auto section : sections)
+        for (auto& section : sections)
             out += section.print();
         return out;
     }
 
     // Write this generic object file in ELF format into the given file.
     void as_elf(FILE* f);
+
+    // Write this generic object file in ELF format into the given buffer,
+    // replacing its contents.
+    void as_elf(std::vector<u8>& out);
+
+    // Write this generic object file in (x86_64) COFF format into the
+    // given file.
+    void as_coff(FILE* f);
+
+    // Write this generic object file in (x86_64) COFF format into the
+    // given buffer, replacing its contents.
+    void as_coff(std::vector<u8>& out);
+
+private:
+    void write_elf(detail::ObjectWriter& writer);
+    void write_coff(detail::ObjectWriter& writer);
 };
 
 } // namespace lcc
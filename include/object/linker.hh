@@ -0,0 +1,38 @@
+#ifndef LCC_OBJECT_LINKER_HH
+#define LCC_OBJECT_LINKER_HH
+
+#include <lcc/utils.hh>
+#include <object/generic.hh>
+
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace lcc::elf {
+
+// Link the given generic object files into an x86_64 Linux executable,
+// and return the contents of the ELF file.
+//
+// Sections are laid out in two segments: one that is readable and
+// executable, with everything that isn't writable, and one that is
+// readable and writable, with everything else. Sections that aren't
+// loaded are dropped. A symbol is looked up in the object that refers
+// to it first, and among what all the objects export after that.
+//
+// Anything that still isn't defined anywhere is taken to be a function
+// of the C library; if there is any such function, the executable is
+// dynamically linked against libc.so.6, and calls go through stubs that
+// jump to the address the dynamic linker puts in the GOT at load time.
+// Otherwise, the executable is fully static.
+//
+// Unless one of the objects defines `_start`, the entry point calls
+// `main` and exits with what it returns (through `__libc_start_main`,
+// if the executable is dynamically linked).
+//
+// Errors are reported, and std::nullopt returned, if anything can't be
+// linked.
+auto link_executable(std::span<GenericObject> objects) -> std::optional<std::vector<u8>>;
+
+} // namespace lcc::elf
+
+#endif /* LCC_OBJECT_LINKER_HH */
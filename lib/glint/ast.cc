@@ -8,7 +8,11 @@
 #include <glint/module_description.hh>
 #include <glint/parser.hh>
 
+#include <algorithm>
+#include <atomic>
 #include <bit>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -41,31 +45,111 @@ lcc::glint::StringLiteral::StringLiteral(
 /// Declare a symbol in this scope.
 auto lcc::glint::Scope::declare(
     const Context* ctx,
-    std::string&& name,
+    InternedString name,
     Decl* decl
 ) -> Result<Decl*> {
     // If the symbol already exists, then this is an error, (unless that symbol
     // resolves to one or more function declarations, and we are declaring a
     // function).
-    auto found = find_recursive(name);
+    auto found = lookup_recursive(name);
     if (not found.empty()) {
-        bool found_all_functions{true};
-        for (auto found_decl : found) {
-            if (not is<FuncDecl>(found_decl)) {
-                found_all_functions = false;
-                break;
-            }
-        }
+        bool found_all_functions = rgs::all_of(found, [](Decl* found_decl) {
+            return is<FuncDecl>(found_decl);
+        });
 
         if (not found_all_functions or not is<FuncDecl>(decl))
             return Diag::Error(ctx, decl->location(), "Redeclaration of '{}'", name);
     }
 
     // Otherwise, add the symbol.
-    symbols.emplace(std::move(name), decl);
+    symbols.emplace(name, decl);
+    declaration_epoch.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::unique_lock lock{fuzzy_index_mutex};
+        if (fuzzy_index) fuzzy_index->insert(name.str(), decl);
+    }
     return decl;
 }
 
+auto lcc::glint::Scope::closest_symbol(
+    std::string_view name,
+    usz max_distance
+) const -> std::pair<Decl*, usz> {
+    Decl* closest{};
+    usz closest_distance = max_distance + 1;
+
+    // Small scopes are cheaper to just search.
+    if (symbols.size() < FuzzyIndexThreshold) {
+        for (auto& [symbol, decl] : symbols) {
+            auto d = utils::EditDistance(name, symbol.str(), true, closest_distance - 1);
+            if (d < closest_distance) {
+                closest = decl;
+                closest_distance = d;
+            }
+        }
+
+        return {closest, closest_distance};
+    }
+
+    std::unique_lock lock{fuzzy_index_mutex};
+    if (not fuzzy_index) {
+        fuzzy_index = std::make_unique<BKTree<Decl*>>();
+        for (auto& [symbol, decl] : symbols) fuzzy_index->insert(symbol.str(), decl);
+    }
+
+    // The index is built on the Levenshtein distance, which is at most twice
+    // the distance we want, since a transposition costs two edits instead of
+    // one; search twice as far and check every candidate.
+    usz radius = 2 * max_distance;
+    fuzzy_index->search(name, radius, [&](std::string_view symbol, Decl* decl, usz) {
+        auto d = utils::EditDistance(name, symbol, true, closest_distance - 1);
+        if (d >= closest_distance) return;
+        closest = decl;
+        closest_distance = d;
+        radius = 2 * (d ? d - 1 : 0);
+    });
+
+    return {closest, closest_distance};
+}
+
+auto lcc::glint::Scope::closest_symbol_recursive(
+    std::string_view name,
+    usz max_distance
+) const -> std::pair<Decl*, usz> {
+    std::pair<Decl*, usz> closest{nullptr, max_distance + 1};
+    for (auto* scope = this; scope; scope = scope->parent()) {
+        // Only a strictly closer symbol in an outer scope is of interest.
+        if (closest.second == 0) break;
+        auto found = scope->closest_symbol(name, closest.second - 1);
+        if (found.first) closest = found;
+    }
+
+    return closest;
+}
+
+auto lcc::glint::Scope::scope_of(InternedString name) const -> const Scope* {
+    if (symbols.contains(name)) return this;
+    if (not parent()) return nullptr;
+
+    // Anything declared since the result was cached may shadow it.
+    auto epoch = declaration_epoch.load(std::memory_order_relaxed);
+    if (auto cached = lookup_cache.find(name); cached != lookup_cache.end() and cached->second.epoch == epoch)
+        return cached->second.scope;
+
+    // Only cache the result here, not in the scopes in between, since
+    // those may be shared by code that other threads are analysing.
+    const Scope* found{};
+    for (auto* scope = parent(); scope; scope = scope->parent()) {
+        if (scope->symbols.contains(name)) {
+            found = scope;
+            break;
+        }
+    }
+
+    if (found) lookup_cache[name] = {found, epoch};
+    return found;
+}
+
 auto lcc::glint::Expr::type() const -> Type* {
     if (auto e = cast<TypedExpr>(this)) return e->type();
     return Type::Void;
@@ -138,7 +222,10 @@ auto lcc::glint::Type::align(const lcc::Context* ctx) const -> usz {
         case Kind::ArrayView:
             return as<ArrayViewType>(this)->size(ctx);
 
-        case Kind::Array: return elem()->align(ctx);
+        case Kind::Array: {
+            if (auto align = as<ArrayType>(this)->bit_alignment()) return align;
+            return elem()->align(ctx);
+        }
         case Kind::Struct: return as<StructType>(this)->alignment();
         case Kind::Union: return as<UnionType>(this)->alignment();
         case Kind::Sum: return as<SumType>(this)->alignment();
@@ -320,8 +407,10 @@ auto lcc::glint::Type::size(const lcc::Context* ctx) const -> usz {
         case Kind::Sum:
             return SumType::IntegerWidth + as<SumType>(this)->byte_size();
 
-        case Kind::Array:
+        case Kind::Array: {
+            if (auto size = as<ArrayType>(this)->bit_size()) return size;
             return as<ArrayType>(this)->dimension() * elem()->size(ctx);
+        }
 
         case Kind::Struct: return as<StructType>(this)->byte_size() * 8;
         case Kind::Union: return as<UnionType>(this)->byte_size() * 8;
@@ -8,8 +8,11 @@
 #include <array>
 #include <cstring>
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -72,12 +75,143 @@ lcc::glint::Module::Module(
 }
 
 lcc::glint::Module::~Module() {
+    // This only runs the destructors; the memory itself is released
+    // all at once when the arenas are destroyed.
     for (auto* node : nodes) delete node;
+    for (auto& [_, storage] : _thread_storage)
+        for (auto* node : storage->nodes) delete node;
     for (auto* type : types) delete type;
+    for (auto& [_, storage] : _thread_storage)
+        for (auto* type : storage->types) delete type;
     for (auto* scope : scopes) delete scope;
+    for (auto& [_, storage] : _thread_storage)
+        for (auto* scope : storage->scopes) delete scope;
     for (auto& import : _imports) delete import.module;
 }
 
+namespace {
+/// The module whose objects the current thread allocates from storage
+/// of its own, and that storage. \see Module::ThreadAllocation.
+thread_local lcc::glint::Module* allocating_module{};
+thread_local void* allocating_storage{};
+} // namespace
+
+auto lcc::glint::Module::thread_storage() -> ThreadStorage* {
+    if (allocating_module != this) return nullptr;
+    return static_cast<ThreadStorage*>(allocating_storage);
+}
+
+lcc::glint::Module::ThreadAllocation::ThreadAllocation(Module& mod)
+    : outer_module(allocating_module),
+      outer_storage(static_cast<ThreadStorage*>(allocating_storage)) {
+    std::unique_lock lock{mod._thread_storage_mutex};
+    auto& storage = mod._thread_storage[std::this_thread::get_id()];
+    if (not storage) {
+        storage = std::make_unique<ThreadStorage>();
+        if (mod._allocation_counter) {
+            storage->node_arena.count_into(mod._allocation_counter);
+            storage->type_arena.count_into(mod._allocation_counter);
+            storage->scope_arena.count_into(mod._allocation_counter);
+        }
+    }
+    allocating_module = &mod;
+    allocating_storage = storage.get();
+}
+
+lcc::glint::Module::ThreadAllocation::~ThreadAllocation() {
+    allocating_module = outer_module;
+    allocating_storage = outer_storage;
+}
+
+void lcc::glint::Module::count_allocations_into(AllocationCounter* counter) {
+    std::unique_lock lock{_thread_storage_mutex};
+    _allocation_counter = counter;
+    node_arena.count_into(counter);
+    type_arena.count_into(counter);
+    scope_arena.count_into(counter);
+    for (auto& [_, storage] : _thread_storage) {
+        storage->node_arena.count_into(counter);
+        storage->type_arena.count_into(counter);
+        storage->scope_arena.count_into(counter);
+    }
+}
+
+auto lcc::glint::Module::allocate_node(usz size) -> void* {
+    auto* storage = thread_storage();
+    auto* ptr = (storage ? storage->node_arena : node_arena).allocate(size);
+    (storage ? storage->nodes : nodes).push_back(static_cast<Expr*>(ptr));
+    return ptr;
+}
+
+auto lcc::glint::Module::allocate_type(usz size) -> void* {
+    auto* storage = thread_storage();
+    auto* ptr = (storage ? storage->type_arena : type_arena).allocate(size);
+    (storage ? storage->types : types).push_back(static_cast<Type*>(ptr));
+    return ptr;
+}
+
+auto lcc::glint::Module::allocate_scope(usz size) -> void* {
+    auto* storage = thread_storage();
+    auto* ptr = (storage ? storage->scope_arena : scope_arena).allocate(size);
+    (storage ? storage->scopes : scopes).push_back(static_cast<Scope*>(ptr));
+    return ptr;
+}
+
+auto lcc::glint::Module::node_count() -> usz {
+    std::unique_lock lock{_thread_storage_mutex};
+    usz count = nodes.size();
+    for (auto& [_, storage] : _thread_storage) count += storage->nodes.size();
+    return count;
+}
+
+auto lcc::glint::Module::OverloadSetKeyHash::operator()(const OverloadSetKey& key) const -> usz {
+    return std::hash<const Scope*>{}(key.scope) * 31 + std::hash<InternedString>{}(key.name);
+}
+
+auto lcc::glint::Module::KeyHash::operator()(const std::vector<uptr>& key) const -> usz {
+    usz seed = key.size();
+    for (auto k : key) seed ^= std::hash<uptr>{}(k) + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+    return seed;
+}
+
+auto lcc::glint::Module::overload_set(const Scope* scope, InternedString name) -> std::span<FuncDecl* const> {
+    auto decls = scope->lookup(name);
+    auto count = usz(rgs::distance(decls));
+
+    std::unique_lock lock{_overload_mutex};
+    auto& set = _overload_sets[{scope, name}];
+    if (set.size() == count) return set;
+
+    // Something was declared since; the nodes that use the old set
+    // still point to it, so keep it around.
+    if (not set.empty()) _stale_overload_sets.push_back(std::move(set));
+    set.clear();
+    for (auto* decl : decls) set.push_back(as<FuncDecl>(decl));
+    return set;
+}
+
+auto lcc::glint::Module::resolved_overload(const std::vector<uptr>& key) -> FuncDecl* {
+    std::unique_lock lock{_overload_mutex};
+    auto it = _resolved_overloads.find(key);
+    return it == _resolved_overloads.end() ? nullptr : it->second;
+}
+
+void lcc::glint::Module::resolved_overload(std::vector<uptr> key, FuncDecl* callee) {
+    std::unique_lock lock{_overload_mutex};
+    _resolved_overloads.emplace(std::move(key), callee);
+}
+
+auto lcc::glint::Module::evaluated_call(const std::vector<uptr>& key) -> const std::optional<EvalResult>* {
+    std::unique_lock lock{_evaluated_calls_mutex};
+    auto it = _evaluated_calls.find(key);
+    return it == _evaluated_calls.end() ? nullptr : &it->second;
+}
+
+void lcc::glint::Module::evaluated_call(std::vector<uptr> key, std::optional<EvalResult> result) {
+    std::unique_lock lock{_evaluated_calls_mutex};
+    _evaluated_calls.emplace(std::move(key), std::move(result));
+}
+
 void lcc::glint::Module::add_top_level_expr(Expr* node) {
     as<BlockExpr>(top_level_function()->body())->add(node);
 }
@@ -434,8 +568,14 @@ std::vector<lcc::u8> lcc::glint::Module::serialise() {
 
     // Decls and types collected from exports.
     std::vector<Type*> type_cache{};
+    std::vector<ModuleDescription::IndexEntry> index{};
+    const auto declarations_offset = ModuleDescription::DeclarationsOffset(hdr.version, u16(exports.size()));
     for (auto* decl : exports) {
         // Decl: DeclHeader, length :u8, name :u8[length]
+        index.push_back({
+            ModuleDescription::HashName(decl->name()),
+            u32(declarations_offset + declarations.size()),
+        });
 
         // Prepare declaration header
         ModuleDescription::TypeIndex type_index = serialise(types_data, type_cache, decl->type());
@@ -472,10 +612,13 @@ std::vector<lcc::u8> lcc::glint::Module::serialise() {
     );
     serialised_name.push_back('\0');
 
+    // Sort the index by name hash so readers can binary search it.
+    rgs::stable_sort(index, {}, &ModuleDescription::IndexEntry::name_hash);
+
     // Final header fixups now that nothing will change.
-    hdr.size = u32(sizeof(ModuleDescription::Header) + declarations.size() + types_data.size() + serialised_name.size());
-    hdr.type_table_offset = u32(sizeof(ModuleDescription::Header) + declarations.size());
-    hdr.name_offset = u32(sizeof(ModuleDescription::Header) + declarations.size() + types_data.size());
+    hdr.size = u32(declarations_offset + declarations.size() + types_data.size() + serialised_name.size());
+    hdr.type_table_offset = u32(declarations_offset + declarations.size());
+    hdr.name_offset = u32(declarations_offset + declarations.size() + types_data.size());
     hdr.declaration_count = u16(exports.size());
     hdr.type_count = u16(type_cache.size());
 
@@ -484,6 +627,10 @@ std::vector<lcc::u8> lcc::glint::Module::serialise() {
 
     std::vector<u8> out{};
     out.insert(out.end(), hdr_bytes.begin(), hdr_bytes.end());
+    for (const auto& entry : index) {
+        auto entry_bytes = to_bytes(entry);
+        out.insert(out.end(), entry_bytes.begin(), entry_bytes.end());
+    }
     out.insert(out.end(), declarations.begin(), declarations.end());
     out.insert(out.end(), types_data.begin(), types_data.end());
     out.insert(out.end(), serialised_name.begin(), serialised_name.end());
@@ -494,6 +641,33 @@ auto lcc::glint::Module::deserialise(
     lcc::Context* context,
     std::vector<u8> module_metadata_blob
 ) -> bool {
+    return deserialise(context, std::make_shared<const ModuleMetadata>(std::move(module_metadata_blob)));
+}
+
+auto lcc::glint::Module::deserialise(
+    lcc::Context* context,
+    MappedFile module_metadata
+) -> bool {
+    return deserialise(context, std::make_shared<const ModuleMetadata>(std::move(module_metadata)));
+}
+
+auto lcc::glint::Module::deserialise(
+    lcc::Context* context,
+    std::shared_ptr<const ModuleMetadata> module_metadata
+) -> bool {
+    LazyImport import{context};
+    import.blob = module_metadata->blob();
+    import.metadata = std::move(module_metadata);
+    return deserialise(std::move(import));
+}
+
+auto lcc::glint::Module::deserialise(LazyImport import) -> bool {
+    const auto module_metadata_blob = import.blob;
+    const auto ByteAt = [&](usz offset) -> u8 {
+        LCC_ASSERT(offset < module_metadata_blob.size(), "Read past end of binary module metadata");
+        return module_metadata_blob[offset];
+    };
+
     // We need at least enough bytes for a header, for a zero-exports module
     // (if that is even allowed past sema).
     if (module_metadata_blob.size() < sizeof(ModuleDescription::Header))
@@ -504,7 +678,7 @@ auto lcc::glint::Module::deserialise(
     std::memcpy(&hdr, module_metadata_blob.data(), sizeof(ModuleDescription::Header));
 
     // Verify header has expected values.
-    if (hdr.version != 1) {
+    if (hdr.version != 1 and hdr.version != 2) {
         fmt::print("ERROR: Could not deserialise: Invalid version {} in header\n", hdr.version);
         return false;
     }
@@ -522,6 +696,7 @@ auto lcc::glint::Module::deserialise(
     auto type_count = hdr.type_count;
     auto type_offset = hdr.type_table_offset;
     auto types_zero_index = types.size();
+    import.types_zero_index = types_zero_index;
     types.reserve(types.size() + type_count);
 
     // NOTE: Big issue here is forward references. i.e. a pointer type at
@@ -651,7 +826,7 @@ auto lcc::glint::Module::deserialise(
     std::vector<FunctionFixup> function_fixups{};
 
     for (decltype(type_count) type_index = 0; type_index < type_count; ++type_index) {
-        auto tag = module_metadata_blob.at(type_offset++);
+        auto tag = ByteAt(type_offset++);
         auto kind = Type::Kind(tag);
         switch (kind) {
             // NamedType: length :u32, name :u8[length]
@@ -659,25 +834,25 @@ auto lcc::glint::Module::deserialise(
                 constexpr auto length_size = sizeof(u32);
                 std::array<u8, length_size> length_array{};
                 for (unsigned i = 0; i < length_size; ++i)
-                    length_array[i] = module_metadata_blob.at(type_offset++);
+                    length_array[i] = ByteAt(type_offset++);
                 u32 length = from_bytes<u32>(length_array);
 
                 LCC_ASSERT(not name().empty(), "Deserialised named type has zero-length name");
 
                 std::string deserialised_name{};
                 for (u32 i = 0; i < length; ++i)
-                    deserialised_name += char(module_metadata_blob.at(type_offset++));
+                    deserialised_name += char(ByteAt(type_offset++));
 
                 LCC_ASSERT(not deserialised_name.empty(), "Deserialised named type has empty name");
 
                 // FIXME: This may need to be top level scope, not entirely sure the
                 // semantics of this yet.
-                new (*this) NamedType(deserialised_name, global_scope(), {});
+                new (*this) NamedType(InternedString{deserialised_name}, global_scope(), {});
             } break;
 
             // BuiltinType: builtin_kind :u8
             case Type::Kind::Builtin: {
-                auto builtin_kind_value = module_metadata_blob.at(type_offset++);
+                auto builtin_kind_value = ByteAt(type_offset++);
                 // clang-format off
                 LCC_ASSERT(
                     builtin_kind_value == +BuiltinType::BuiltinKind::Bool
@@ -703,7 +878,7 @@ auto lcc::glint::Module::deserialise(
                 constexpr auto ffi_kind_size = sizeof(u16);
                 std::array<u8, ffi_kind_size> length_array{};
                 for (unsigned i = 0; i < ffi_kind_size; ++i)
-                    length_array[i] = module_metadata_blob.at(type_offset++);
+                    length_array[i] = ByteAt(type_offset++);
                 u16 ffi_kind_value = from_bytes<u16>(length_array);
                 auto ffi_kind = FFIType::FFIKind(ffi_kind_value);
                 // Purely for the side-effect of recording the type in the module.
@@ -718,7 +893,7 @@ auto lcc::glint::Module::deserialise(
                 constexpr auto ref_type_index_size = sizeof(ModuleDescription::TypeIndex);
                 std::array<u8, ref_type_index_size> ref_type_index_array{};
                 for (unsigned i = 0; i < ref_type_index_size; ++i)
-                    ref_type_index_array.at(i) = module_metadata_blob.at(type_offset++);
+                    ref_type_index_array.at(i) = ByteAt(type_offset++);
                 auto ref_type_index = from_bytes<ModuleDescription::TypeIndex>(ref_type_index_array);
 
                 // Normally done in operator new of Type, but we do it manually here since
@@ -742,7 +917,7 @@ auto lcc::glint::Module::deserialise(
                 constexpr auto bitwidth_size = sizeof(u16);
                 std::array<u8, bitwidth_size> bitwidth_array{};
                 for (unsigned i = 0; i < bitwidth_size; ++i)
-                    bitwidth_array[i] = module_metadata_blob.at(type_offset++);
+                    bitwidth_array[i] = ByteAt(type_offset++);
                 auto bitwidth = from_bytes<u16>(bitwidth_array);
 
                 u8 is_signed = bitwidth_array[type_offset++];
@@ -754,13 +929,13 @@ auto lcc::glint::Module::deserialise(
                 constexpr auto element_type_index_size = sizeof(ModuleDescription::TypeIndex);
                 std::array<u8, element_type_index_size> element_type_index_array{};
                 for (unsigned i = 0; i < element_type_index_size; ++i)
-                    element_type_index_array[i] = module_metadata_blob.at(type_offset++);
+                    element_type_index_array[i] = ByteAt(type_offset++);
                 auto element_type_index = from_bytes<ModuleDescription::TypeIndex>(element_type_index_array);
 
                 constexpr auto element_count_size = sizeof(u64);
                 std::array<u8, element_count_size> element_count_array{};
                 for (unsigned i = 0; i < element_count_size; ++i)
-                    element_count_array[i] = module_metadata_blob.at(type_offset++);
+                    element_count_array[i] = ByteAt(type_offset++);
                 auto element_count = from_bytes<u64>(element_count_array);
 
                 (void) element_type_index;
@@ -779,14 +954,14 @@ auto lcc::glint::Module::deserialise(
                 constexpr auto attributes_size = sizeof(u32);
                 std::array<u8, attributes_size> attributes_array{};
                 for (unsigned i = 0; i < attributes_size; ++i)
-                    attributes_array[i] = module_metadata_blob.at(type_offset++);
+                    attributes_array[i] = ByteAt(type_offset++);
                 auto attributes = from_bytes<u32>(attributes_array);
 
                 // Parameter Count
                 constexpr auto param_count_size = sizeof(u16);
                 std::array<u8, param_count_size> param_count_array{};
                 for (unsigned i = 0; i < param_count_size; ++i)
-                    param_count_array[i] = module_metadata_blob.at(type_offset++);
+                    param_count_array[i] = ByteAt(type_offset++);
                 auto param_count = from_bytes<u16>(param_count_array);
 
                 // Parameter Type Indices
@@ -795,7 +970,7 @@ auto lcc::glint::Module::deserialise(
                     constexpr auto param_type_index_size = sizeof(ModuleDescription::TypeIndex);
                     std::array<u8, param_type_index_size> param_type_index_array{};
                     for (unsigned i = 0; i < param_type_index_size; ++i)
-                        param_type_index_array[i] = module_metadata_blob.at(type_offset++);
+                        param_type_index_array[i] = ByteAt(type_offset++);
                     auto param_type_index = from_bytes<ModuleDescription::TypeIndex>(param_type_index_array);
 
                     param_type_indices.emplace_back(param_type_index);
@@ -805,7 +980,7 @@ auto lcc::glint::Module::deserialise(
                 constexpr auto return_type_index_size = sizeof(ModuleDescription::TypeIndex);
                 std::array<u8, return_type_index_size> return_type_index_array{};
                 for (unsigned i = 0; i < return_type_index_size; ++i)
-                    return_type_index_array[i] = module_metadata_blob.at(type_offset++);
+                    return_type_index_array[i] = ByteAt(type_offset++);
                 auto return_type_index = from_bytes<ModuleDescription::TypeIndex>(return_type_index_array);
 
                 // Parameter Names
@@ -814,13 +989,13 @@ auto lcc::glint::Module::deserialise(
                     constexpr auto param_name_length_size = sizeof(u16);
                     std::array<u8, param_name_length_size> param_name_length_array{};
                     for (unsigned i = 0; i < param_name_length_size; ++i)
-                        param_name_length_array[i] = module_metadata_blob.at(type_offset++);
+                        param_name_length_array[i] = ByteAt(type_offset++);
                     auto param_name_length = from_bytes<u16>(param_name_length_array);
 
                     std::string param_name{};
                     param_name.reserve(param_name_length);
                     for (unsigned i = 0; i < param_name_length; ++i)
-                        param_name += char(module_metadata_blob.at(type_offset++));
+                        param_name += char(ByteAt(type_offset++));
 
                     param_names.emplace_back(std::move(param_name));
                 }
@@ -949,81 +1124,221 @@ auto lcc::glint::Module::deserialise(
         types.erase(types.begin() + types_size);
     }
 
-    // Starting after the header, begin parsing declarations. Stop after
+    // Version 1 has no index, so all declarations have to be deserialised
+    // right away. Starting after the header, parse declarations; stop after
     // parsing the amount of declarations specified in the header.
-    auto offset = sizeof(ModuleDescription::Header);
-    auto decl_count = hdr.declaration_count;
-    while (decl_count--) {
-        ModuleDescription::DeclarationHeader decl_hdr{};
-        std::memcpy(
-            &decl_hdr,
-            module_metadata_blob.data() + offset,
-            sizeof(decl_hdr)
-        );
-        offset += sizeof(decl_hdr);
-
-        u8 name_length = module_metadata_blob.at(offset++);
+    auto offset = ModuleDescription::DeclarationsOffset(hdr.version, hdr.declaration_count);
+    if (hdr.version == 1) {
+        for (auto decl_count = hdr.declaration_count; decl_count--;)
+            offset = deserialise_declaration(import, offset);
+        return true;
+    }
 
-        std::string name{};
-        for (decltype(offset) i = 0; i < name_length; ++i)
-            name += char(*(module_metadata_blob.data() + offset + i));
-        offset += name_length;
+    // Otherwise, keep the blob around and deserialise declarations as they
+    // are referenced.
+    if (offset > module_metadata_blob.size()) {
+        fmt::print("ERROR: Could not deserialise: Declaration index extends past end of metadata\n");
+        return false;
+    }
+    import.declaration_count = hdr.declaration_count;
+    import.loaded.assign(hdr.declaration_count, false);
+    report_import_clashes(import);
+    _lazy_imports.push_back(std::move(import));
+    return true;
+}
 
-        auto* ty = types.at(types_zero_index + decl_hdr.type_index);
+namespace {
+auto DeclarationName(std::span<const lcc::u8> blob, lcc::usz offset) -> std::string_view {
+    offset += sizeof(lcc::glint::ModuleDescription::DeclarationHeader);
+    LCC_ASSERT(offset < blob.size(), "Declaration extends past end of binary module metadata");
+    auto name_length = blob[offset++];
+    LCC_ASSERT(offset + name_length <= blob.size(), "Declaration extends past end of binary module metadata");
+    return {reinterpret_cast<const char*>(blob.data() + offset), name_length};
+}
 
-        // FIXME: Should it be top level scope instead of global?
-        auto* scope = global_scope();
-        switch (ModuleDescription::DeclarationHeader::Kind(decl_hdr.kind)) {
-            // Created from Expr::Kind::TypeDecl
-            case ModuleDescription::DeclarationHeader::Kind::TYPE: {
-                LCC_ASSERT(
-                    is<DeclaredType>(ty),
-                    "Can't make TypeDecl from a Type that is not derived from DeclaredType"
-                );
-                auto type_decl = new (*this) TypeDecl(this, name, as<DeclaredType>(ty), {});
-                type_decl->set_sema_done();
-                auto decl = scope->declare(context, std::string(name), type_decl);
-            } break;
+auto DeclarationIsFunction(std::span<const lcc::u8> blob, lcc::usz offset) -> bool {
+    lcc::glint::ModuleDescription::DeclarationHeader decl_hdr{};
+    LCC_ASSERT(offset + sizeof(decl_hdr) <= blob.size(), "Declaration extends past end of binary module metadata");
+    std::memcpy(&decl_hdr, blob.data() + offset, sizeof(decl_hdr));
+    return lcc::glint::ModuleDescription::DeclarationHeader::Kind(decl_hdr.kind)
+        == lcc::glint::ModuleDescription::DeclarationHeader::Kind::FUNCTION;
+}
 
-            // Created from Expr::Kind::TypeAliasDecl
-            case ModuleDescription::DeclarationHeader::Kind::TYPE_ALIAS: {
-                auto* type_alias_decl = new (*this) TypeAliasDecl(name, ty, {});
-                type_alias_decl->set_sema_done();
-                auto decl = scope->declare(context, std::string(name), type_alias_decl);
-            } break;
+auto IndexEntry(std::span<const lcc::u8> blob, lcc::usz index) -> lcc::glint::ModuleDescription::IndexEntry {
+    lcc::glint::ModuleDescription::IndexEntry entry{};
+    std::memcpy(
+        &entry,
+        blob.data() + sizeof(lcc::glint::ModuleDescription::Header) + index * sizeof(entry),
+        sizeof(entry)
+    );
+    return entry;
+}
 
-            // Created from Expr::Kind::VarDecl
-            case ModuleDescription::DeclarationHeader::Kind::VARIABLE: {
-                // FIXME: Should possibly be reexported.
-                auto* var_decl = new (*this) VarDecl(name, ty, nullptr, this, Linkage::Imported, {});
-                var_decl->set_sema_done();
-                auto decl = scope->declare(context, std::string(name), var_decl);
-            } break;
+/// Get the index of the first entry in the index of \p blob whose
+/// name hash is \p hash, or of the first one after it, if none is.
+auto FirstIndexEntry(std::span<const lcc::u8> blob, lcc::u16 count, lcc::u32 hash) -> lcc::usz {
+    lcc::usz low = 0;
+    lcc::usz high = count;
+    while (low < high) {
+        auto mid = low + (high - low) / 2;
+        if (IndexEntry(blob, mid).name_hash < hash) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+} // namespace
+
+void lcc::glint::Module::report_import_clashes(LazyImport& import) {
+    for (usz i = 0; i < import.declaration_count; i++) {
+        auto entry = IndexEntry(import.blob, i);
+        auto name = DeclarationName(import.blob, entry.declaration_offset);
+        bool is_function = DeclarationIsFunction(import.blob, entry.declaration_offset);
+
+        // As in Scope::declare(), only functions may share a name, with
+        // other functions.
+        bool clash = false;
+        auto Add = [&](bool other_is_function) {
+            if (not is_function or not other_is_function) clash = true;
+        };
 
-            // Created from Expr::Kind::FuncDecl
-            case ModuleDescription::DeclarationHeader::Kind::FUNCTION: {
-                LCC_ASSERT(
-                    is<FuncType>(ty),
-                    "Cannot create FuncDecl when deserialised type, {}, is not a function",
-                    *ty
-                );
-                auto* func_decl = new (*this) FuncDecl(name, as<FuncType>(ty), nullptr, scope, this, Linkage::Imported, {});
-                func_decl->set_sema_done();
-                auto decl = scope->declare(context, std::string(name), func_decl);
-            } break;
+        if (auto symbol = InternedString::Find(name)) {
+            for (auto* decl : global_scope()->lookup(*symbol))
+                Add(is<FuncDecl>(decl));
+        }
 
-            // Created from Expr::Kind::EnumeratorDecl
-            // FIXME: Is it possible to export a single enum decl? I'm pretty sure the
-            // only place an enum decl can happen is within an enum type.
-            case ModuleDescription::DeclarationHeader::Kind::ENUMERATOR: {
-                LCC_TODO("Make an EnumeratorDecl in the global scope");
+        for (auto& other : _lazy_imports) {
+            for (
+                auto j = FirstIndexEntry(other.blob, other.declaration_count, entry.name_hash);
+                j < other.declaration_count;
+                j++
+            ) {
+                auto other_entry = IndexEntry(other.blob, j);
+                if (other_entry.name_hash != entry.name_hash) break;
+                if (DeclarationName(other.blob, other_entry.declaration_offset) != name) continue;
+                Add(DeclarationIsFunction(other.blob, other_entry.declaration_offset));
             }
+        }
+
+        if (not clash) continue;
+        Diag::Error(import.context, {}, "Redeclaration of '{}'", name);
+        import.loaded[i] = true;
+    }
+}
+
+auto lcc::glint::Module::deserialise_declaration(const LazyImport& import, usz offset) -> usz {
+    const auto module_metadata_blob = import.blob;
+    auto* context = import.context;
+
+    LCC_ASSERT(
+        offset + sizeof(ModuleDescription::DeclarationHeader) <= module_metadata_blob.size(),
+        "Declaration extends past end of binary module metadata"
+    );
+    ModuleDescription::DeclarationHeader decl_hdr{};
+    std::memcpy(
+        &decl_hdr,
+        module_metadata_blob.data() + offset,
+        sizeof(decl_hdr)
+    );
+
+    std::string name{DeclarationName(module_metadata_blob, offset)};
+    offset += sizeof(decl_hdr) + 1 + name.size();
+
+    auto* ty = types.at(import.types_zero_index + decl_hdr.type_index);
 
-            case ModuleDescription::DeclarationHeader::Kind::INVALID:
-            default:
-                LCC_ASSERT(false, "Invalid declaration kind in declaration header: {}", decl_hdr.kind);
+    // FIXME: Should it be top level scope instead of global?
+    auto* scope = global_scope();
+    Decl* decl{};
+    switch (ModuleDescription::DeclarationHeader::Kind(decl_hdr.kind)) {
+        // Created from Expr::Kind::TypeDecl
+        case ModuleDescription::DeclarationHeader::Kind::TYPE: {
+            LCC_ASSERT(
+                is<DeclaredType>(ty),
+                "Can't make TypeDecl from a Type that is not derived from DeclaredType"
+            );
+            decl = new (*this) TypeDecl(this, name, as<DeclaredType>(ty), {});
+        } break;
+
+        // Created from Expr::Kind::TypeAliasDecl
+        case ModuleDescription::DeclarationHeader::Kind::TYPE_ALIAS: {
+            decl = new (*this) TypeAliasDecl(name, ty, {});
+        } break;
+
+        // Created from Expr::Kind::VarDecl
+        case ModuleDescription::DeclarationHeader::Kind::VARIABLE: {
+            // FIXME: Should possibly be reexported.
+            decl = new (*this) VarDecl(name, ty, nullptr, this, Linkage::Imported, {});
+        } break;
+
+        // Created from Expr::Kind::FuncDecl
+        case ModuleDescription::DeclarationHeader::Kind::FUNCTION: {
+            LCC_ASSERT(
+                is<FuncType>(ty),
+                "Cannot create FuncDecl when deserialised type, {}, is not a function",
+                *ty
+            );
+            decl = new (*this) FuncDecl(name, as<FuncType>(ty), nullptr, scope, this, Linkage::Imported, {});
+        } break;
+
+        // Created from Expr::Kind::EnumeratorDecl
+        // An enumerator has the type of its enum, which holds its value, so
+        // declare the enumerator of that type that has this name.
+        case ModuleDescription::DeclarationHeader::Kind::ENUMERATOR: {
+            LCC_ASSERT(
+                is<EnumType>(ty),
+                "Cannot declare enumerator {} when deserialised type, {}, is not an enum",
+                name,
+                *ty
+            );
+            auto& enumerators = as<EnumType>(ty)->enumerators();
+            auto it = rgs::find_if(enumerators, [&](EnumeratorDecl* e) { return e->name() == name; });
+            LCC_ASSERT(
+                it != enumerators.end(),
+                "Deserialised enum type {} has no enumerator {}",
+                *ty,
+                name
+            );
+            decl = *it;
+        } break;
+
+        case ModuleDescription::DeclarationHeader::Kind::INVALID:
+        default:
+            LCC_ASSERT(false, "Invalid declaration kind in declaration header: {}", decl_hdr.kind);
+    }
+
+    // A clash with an existing declaration has been reported by declare()
+    // (or, for lazily loaded imports, by report_import_clashes(), which
+    // keeps the declaration from ever being loaded).
+    if (scope->declare(context, std::string(name), decl)) decl->set_sema_done();
+    else decl->set_sema_errored();
+    return offset;
+}
+
+void lcc::glint::Module::load_imported_declarations(InternedString name) {
+    if (_lazy_imports.empty() or _all_imports_loaded or not _lazy_names_loaded.insert(name).second) return;
+
+    auto text = name.str();
+    auto hash = ModuleDescription::HashName(text);
+    for (auto& import : _lazy_imports) {
+        // Deserialise the declarations with this name; other names
+        // may have the same hash.
+        for (auto i = FirstIndexEntry(import.blob, import.declaration_count, hash); i < import.declaration_count; i++) {
+            auto entry = IndexEntry(import.blob, i);
+            if (entry.name_hash != hash) break;
+            if (import.loaded[i] or DeclarationName(import.blob, entry.declaration_offset) != text) continue;
+            import.loaded[i] = true;
+            (void) deserialise_declaration(import, entry.declaration_offset);
         }
     }
+}
 
-    return true;
+void lcc::glint::Module::load_all_imported_declarations() {
+    if (_all_imports_loaded) return;
+    for (auto& import : _lazy_imports) {
+        for (usz i = 0; i < import.declaration_count; i++) {
+            if (import.loaded[i]) continue;
+            import.loaded[i] = true;
+            (void) deserialise_declaration(import, IndexEntry(import.blob, i).declaration_offset);
+        }
+    }
+    _all_imports_loaded = true;
 }
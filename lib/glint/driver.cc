@@ -3,6 +3,8 @@
 #include <lcc/context.hh>
 #include <lcc/file.hh>
 #include <lcc/ir/module.hh>
+#include <lcc/mem_report.hh>
+#include <lcc/time_report.hh>
 
 #include <glint/ir_gen.hh>
 #include <glint/parser.hh>
@@ -11,19 +13,30 @@
 namespace lcc::glint {
 
 auto produce_module(Context* context, File& source) -> lcc::Module* {
+    TimeReport::Timer timer{context, "Frontend"};
+
     // Parse the file.
-    auto mod = Parser::Parse(context, source);
+    std::unique_ptr<Module> mod{};
+    {
+        TimeReport::Timer parse_timer{context, "Parse"};
+        mod = Parser::Parse(context, source);
+        if (auto* mem = context->mem_report(); mem and mod) mem->count("AST nodes", mod->node_count());
+    }
     if (context->option_print_ast() and mod) mod->print(context->option_use_colour());
     // The error condition is handled by the caller already.
     if (context->has_error()) return {};
     if (context->option_stopat_syntax()) return {};
 
     // Perform semantic analysis.
-    lcc::glint::Sema::Analyse(
-        context,
-        *mod,
-        context->option_use_colour()
-    );
+    {
+        TimeReport::Timer sema_timer{context, "Sema"};
+        lcc::glint::Sema::Analyse(
+            context,
+            *mod,
+            context->option_use_colour()
+        );
+        if (auto* mem = context->mem_report()) mem->count("AST nodes", mod->node_count());
+    }
     if (context->option_print_ast()) {
         fmt::print("\nAfter Sema:\n");
         mod->print(context->option_use_colour());
@@ -34,7 +47,12 @@ auto produce_module(Context* context, File& source) -> lcc::Module* {
     // Stop after sema if requested.
     if (context->option_stopat_sema()) return {};
 
-    auto* ir = IRGen::Generate(context, *mod);
+    lcc::Module* ir{};
+    {
+        TimeReport::Timer irgen_timer{context, "IRGen"};
+        ir = IRGen::Generate(context, *mod);
+        if (auto* mem = context->mem_report(); mem and ir) mem->count("IR instructions", ir->instruction_count());
+    }
     if (context->has_error()) return {};
 
     return ir;
@@ -5,23 +5,202 @@
 #include <lcc/diags.hh>
 #include <lcc/utils.hh>
 
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace lcc::glint {
+namespace {
+/// Wrap an integer around to the width of a type, as storing it in an
+/// object of that type would. Returns false if either is not an integer.
+auto Fit(const Context* ctx, Type* ty, EvalResult& value) -> bool {
+    if (not value.is_int() or not ty->is_integer(true)) return false;
+    auto bits = ty->size(ctx);
+    if (bits == 0 or bits >= 64) return true;
+    auto v = value.as_int().trunc(bits);
+    value = ty->is_signed_int(ctx) ? v.sext(64) : v.zext(64);
+    return true;
+}
+
+/// Tree-walking evaluator for constant expressions.
+///
+/// Besides plain expressions, this runs blocks with integer locals,
+/// loops, and calls to functions whose bodies have been analysed, so
+/// long as they only compute with integers; anything that would touch
+/// memory or the outside world is not a constant expression. Since
+/// such functions are pure, the result of every call is cached in the
+/// module of the callee, keyed by the callee and its arguments.
+///
+/// Evaluation gives up after a fixed number of steps or nested calls,
+/// so that a loop that does not terminate can’t hang the compiler.
+class Evaluator {
+    /// Steps an evaluation may take if a constant is required, and if it
+    /// is merely attempted, e.g. to check whether a conversion is lossless.
+    static constexpr usz RequiredStepLimit = 1 << 22;
+    static constexpr usz OptionalStepLimit = 1 << 16;
+    static constexpr usz CallDepthLimit = 256;
+
+    using Kind = Expr::Kind;
+    using Frame = std::unordered_map<const Expr*, EvalResult>;
+
+    const Context* ctx;
+    bool required;
+    usz steps;
+
+    /// Values of the locals of the expression being evaluated and of each
+    /// call that is being evaluated.
+    std::vector<Frame> frames;
+
+    /// Set while a return expression unwinds to its call.
+    std::optional<EvalResult> returning{};
+
+    /// Set once the step or call depth limit is hit.
+    bool exhausted = false;
+
+public:
+    Evaluator(const Context* context, bool is_required)
+        : ctx(context),
+          required(is_required),
+          steps(is_required ? RequiredStepLimit : OptionalStepLimit),
+          frames(1) {}
+
+    auto eval(Expr* e, EvalResult& out) -> bool;
+
+    [[nodiscard]]
+    auto leaked_return() const -> bool { return returning.has_value(); }
+
+private:
+    auto call(CallExpr* c, EvalResult& out) -> bool;
+
+    /// Get the value of a local in the current frame, if it is bound.
+    auto local(const Expr* decl) -> EvalResult* {
+        auto it = frames.back().find(decl);
+        return it == frames.back().end() ? nullptr : &it->second;
+    }
+
+    auto loop(Expr* condition, Expr* body, Expr* increment, EvalResult& out) -> bool;
+};
+} // namespace
+} // namespace lcc::glint
+
 auto lcc::glint::Expr::evaluate(const Context* ctx, EvalResult& out, bool required) -> bool {
     LCC_ASSERT(
         not required or ok(),
         "Cannot evaluate ill-formed or unchecked expression"
     );
+
+    Evaluator e{ctx, required};
+    EvalResult res;
+    if (not e.eval(this, res)) return false;
+    if (e.leaked_return() or res.is_void()) {
+        if (required) Diag::Error(ctx, location(), "Not a constant expression");
+        return false;
+    }
+
+    out = res;
+    return true;
+}
+
+auto lcc::glint::Evaluator::loop(Expr* condition, Expr* body, Expr* increment, EvalResult& out) -> bool {
+    for (;;) {
+        EvalResult cond;
+        if (not eval(condition, cond)) return false;
+        if (not cond.is_int()) {
+            if (required) Diag::Error(ctx, condition->location(), "Loop condition is not an int");
+            return false;
+        }
+        if (cond.as_int() == 0) break;
+
+        EvalResult ignored;
+        if (not eval(body, ignored)) return false;
+        if (returning) break;
+        if (increment and not eval(increment, ignored)) return false;
+    }
+
+    out = {};
+    return true;
+}
+
+auto lcc::glint::Evaluator::call(CallExpr* c, EvalResult& out) -> bool {
+    auto not_a_constant_expr = [&](std::string_view msg = "Call is not a constant expression") {
+        if (required) Diag::Error(ctx, c->location(), "{}", msg);
+        return false;
+    };
+
+    /// The callee must be a function whose body we can run.
+    auto* callee_expr = c->callee();
+    if (auto* n = cast<NameRefExpr>(callee_expr)) callee_expr = n->target();
+    auto* callee = callee_expr ? cast<FuncDecl>(callee_expr) : nullptr;
+    if (
+        not callee
+        or not callee->body()
+        or not callee->body_analysed()
+        or not callee->body()->ok()
+        or callee->param_decls().size() != c->args().size()
+    ) return not_a_constant_expr();
+
+    /// Evaluate the arguments in the caller’s frame.
+    Frame frame{};
+    std::vector<uptr> key{uptr(callee)};
+    for (usz i = 0; i < c->args().size(); i++) {
+        auto* param = callee->param_decls()[i];
+        EvalResult value;
+        if (not eval(c->args()[i], value)) return false;
+        if (not Fit(ctx, param->type(), value)) return not_a_constant_expr();
+        key.push_back(uptr(value.as_int().value()));
+        frame.emplace(param, value);
+    }
+
+    auto* mod = callee->module();
+    if (auto* cached = mod->evaluated_call(key)) {
+        if (not *cached) return not_a_constant_expr();
+        out = **cached;
+        return true;
+    }
+
+    if (frames.size() > CallDepthLimit) {
+        exhausted = true;
+        return not_a_constant_expr("Compile-time evaluation exceeded the maximum call depth");
+    }
+
+    /// Run the body in a frame of its own.
+    frames.push_back(std::move(frame));
+    EvalResult res;
+    bool ok = eval(callee->body(), res);
+    frames.pop_back();
+    if (ok and returning) res = *std::exchange(returning, std::nullopt);
+    if (ok and callee->return_type()->is_integer(true)) ok = Fit(ctx, callee->return_type(), res);
+    if (ok and res.is_void()) ok = false;
+
+    /// Failures due to the limits depend on where the call is made, so
+    /// don’t remember those.
+    if (exhausted) return false;
+    mod->evaluated_call(std::move(key), ok ? std::optional{res} : std::nullopt);
+    if (not ok) return not_a_constant_expr();
+    out = res;
+    return true;
+}
+
+auto lcc::glint::Evaluator::eval(Expr* e, EvalResult& out) -> bool {
     auto not_a_constant_expr = [&](std::string_view msg = "Not a constant expression") {
         if (required)
-            Diag::Error(ctx, location(), "{}", msg);
+            Diag::Error(ctx, e->location(), "{}", msg);
         return false;
     };
     auto unhandled_constant_expr = [&]() {
         // ICE?
         if (required)
-            Diag::Error(ctx, location(), "Constant expression not yet handled in the compile-time evaluator (sorry)");
+            Diag::Error(ctx, e->location(), "Constant expression not yet handled in the compile-time evaluator (sorry)");
         return false;
     };
-    switch (kind()) {
+
+    if (exhausted) return false;
+    if (steps-- == 0) {
+        exhausted = true;
+        return not_a_constant_expr("Compile-time evaluation exceeded the step limit");
+    }
+
+    switch (e->kind()) {
         /// These are here not necessarily because they are not constant
         /// expressions but rather because evaluating them has not yet
         /// been implemented.
@@ -32,38 +211,80 @@ auto lcc::glint::Expr::evaluate(const Context* ctx, EvalResult& out, bool requir
         case Kind::Type:
         case Kind::TypeAliasDecl:
         case Kind::TypeDecl:
-        case Kind::VarDecl:
             return not_a_constant_expr();
 
         case Kind::Alignof:
-        case Kind::Call:
         case Kind::CompoundLiteral:
-        case Kind::For:
         case Kind::IntrinsicCall:
         case Kind::MemberAccess:
-        case Kind::NameRef:
-        case Kind::Return:
         case Kind::Sizeof:
-        case Kind::While:
             return unhandled_constant_expr();
 
+        /// Only locals of integer type can be evaluated; a declaration
+        /// without an initialiser starts out as zero.
+        case Kind::VarDecl: {
+            auto* v = as<VarDecl>(e);
+            if (not v->ok() or not v->type()->is_integer(true)) return not_a_constant_expr();
+            EvalResult value{aint(0)};
+            if (v->init() and not eval(v->init(), value)) return false;
+            if (not Fit(ctx, v->type(), value)) return not_a_constant_expr();
+            frames.back()[v] = value;
+            out = {};
+            return true;
+        }
+
+        case Kind::NameRef: {
+            auto* value = local(as<NameRefExpr>(e)->target());
+            if (not value) return not_a_constant_expr();
+            out = *value;
+            return true;
+        }
+
+        case Kind::Call:
+            return call(as<CallExpr>(e), out);
+
+        case Kind::While: {
+            auto* w = as<WhileExpr>(e);
+            return loop(w->condition(), w->body(), nullptr, out);
+        }
+
+        case Kind::For: {
+            auto* f = as<ForExpr>(e);
+            EvalResult ignored;
+            if (f->init() and not eval(f->init(), ignored)) return false;
+            return loop(f->condition(), f->body(), f->increment(), out);
+        }
+
+        /// Only valid in a call; the return value is handed to the call
+        /// once everything up to it has been unwound.
+        case Kind::Return: {
+            if (frames.size() < 2) return not_a_constant_expr();
+            auto* r = as<ReturnExpr>(e);
+            EvalResult value;
+            if (r->value() and not eval(r->value(), value)) return false;
+            returning = value;
+            out = {};
+            return true;
+        }
+
         case Kind::IntegerLiteral:
-            out = as<IntegerLiteral>(this)->value();
+            out = as<IntegerLiteral>(e)->value();
             return true;
 
         case Kind::StringLiteral:
-            out = as<StringLiteral>(this);
+            out = as<StringLiteral>(e);
             return true;
 
         case Kind::EvaluatedConstant:
-            out = as<ConstantExpr>(this)->value();
+            out = as<ConstantExpr>(e)->value();
             return true;
 
         case Kind::If: {
-            auto* i = as<IfExpr>(this);
+            auto* i = as<IfExpr>(e);
 
-            /// Check that this returns a value.
-            if (i->type()->is_void()) {
+            /// An if that does not return a value can only be run for
+            /// its effects in a call.
+            if (i->type()->is_void() and frames.size() < 2) {
                 return not_a_constant_expr(
                     "if expression that does not return a value is not a constant expression"
                 );
@@ -71,37 +292,56 @@ auto lcc::glint::Expr::evaluate(const Context* ctx, EvalResult& out, bool requir
 
             /// Evaluate the condition.
             EvalResult res;
-            if (not i->condition()->evaluate(ctx, res, required))
+            if (not eval(i->condition(), res))
                 return false;
             if (not res.is_int())
                 return not_a_constant_expr("if condition expression is not an int");
 
-            return res.as_int() != 0
-                     ? i->then()->evaluate(ctx, out, required)
-                     : i->otherwise()->evaluate(ctx, out, required);
+            auto* branch = res.as_int() != 0 ? i->then() : i->otherwise();
+            if (i->type()->is_void()) {
+                EvalResult ignored;
+                if (branch and not eval(branch, ignored)) return false;
+                out = {};
+                return true;
+            }
+
+            return eval(branch, out);
         }
 
         case Kind::Block:
-            for (auto* expr : as<BlockExpr>(this)->children())
-                if (not expr->evaluate(ctx, out, required))
-                    return false;
+            out = {};
+            for (auto* expr : as<BlockExpr>(e)->children()) {
+                if (not eval(expr, out)) return false;
+                if (returning) break;
+            }
             return true;
 
         /// Most casts that create a new value and which can be performed at compile
-        /// time are already performed by sema when `Convert()` is called, so we only
-        /// check for no-op casts here.
+        /// time are already performed by sema when `Convert()` is called, so apart
+        /// from no-op casts, we only need to handle conversions between integers of
+        /// values that are not known until now, e.g. locals.
         case Kind::Cast: {
-            const auto* c = as<CastExpr>(this);
+            const auto* c = as<CastExpr>(e);
             if (Type::Equal(c->type(), c->operand()->type()))
-                return c->operand()->evaluate(ctx, out, required);
+                return eval(c->operand(), out);
+            if (
+                not c->is_lvalue_to_ref()
+                and not c->is_ref_to_lvalue()
+                and c->type()->is_integer(true)
+                and c->operand()->type()->is_integer(true)
+            ) {
+                if (not eval(c->operand(), out)) return false;
+                if (not Fit(ctx, c->type(), out)) return not_a_constant_expr();
+                return true;
+            }
             return not_a_constant_expr("cast expression is not a no-op, and therefore is not a constant expression. Likely an error in sema");
         }
 
         case Kind::Unary: {
-            const auto* u = cast<UnaryExpr>(this);
+            const auto* u = cast<UnaryExpr>(e);
 
             EvalResult res;
-            if (not u->operand()->evaluate(ctx, res, required))
+            if (not eval(u->operand(), res))
                 return false;
 
             switch (u->op()) {
@@ -223,12 +463,26 @@ auto lcc::glint::Expr::evaluate(const Context* ctx, EvalResult& out, bool requir
         } break;
 
         case Kind::Binary: {
-            const auto* b = cast<BinaryExpr>(this);
+            const auto* b = cast<BinaryExpr>(e);
+
+            /// Assignment to a local; Sema has already turned compound
+            /// assignments into plain ones.
+            if (b->op() == TokenKind::ColonEq) {
+                auto* n = cast<NameRefExpr>(b->lhs());
+                auto* slot = n ? local(n->target()) : nullptr;
+                if (not slot) return not_a_constant_expr();
+                EvalResult value;
+                if (not eval(b->rhs(), value)) return false;
+                if (not Fit(ctx, b->lhs()->type(), value)) return not_a_constant_expr();
+                *slot = value;
+                out = value;
+                return true;
+            }
 
             EvalResult lhs;
             EvalResult rhs;
-            if (not b->lhs()->evaluate(ctx, lhs, required)) return false;
-            if (not b->rhs()->evaluate(ctx, rhs, required)) return false;
+            if (not eval(b->lhs(), lhs)) return false;
+            if (not eval(b->rhs(), rhs)) return false;
 
             // Only handle binary expressions between integers (for now).
             if (not lhs.is_int() or not rhs.is_int())
@@ -273,7 +527,7 @@ auto lcc::glint::Expr::evaluate(const Context* ctx, EvalResult& out, bool requir
 
                 case TokenKind::Slash:
                     if (rhs.as_int() == 0) {
-                        if (required) Diag::Error(ctx, location(), "Division by zero");
+                        if (required) Diag::Error(ctx, e->location(), "Division by zero");
                         return false;
                     }
 
@@ -284,7 +538,7 @@ auto lcc::glint::Expr::evaluate(const Context* ctx, EvalResult& out, bool requir
 
                 case TokenKind::Percent:
                     if (rhs.as_int() == 0) {
-                        if (required) Diag::Error(ctx, location(), "Division by zero");
+                        if (required) Diag::Error(ctx, e->location(), "Division by zero");
                         return false;
                     }
 
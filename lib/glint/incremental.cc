@@ -0,0 +1,311 @@
+#include <glint/incremental.hh>
+
+#include <lcc/context.hh>
+#include <lcc/diags.hh>
+#include <lcc/utils.hh>
+
+#include <glint/ast.hh>
+#include <glint/parser.hh>
+#include <glint/sema.hh>
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace lcc::glint {
+namespace {
+/// Collect the identifiers in a piece of source text. Anything that looks
+/// like one counts, even in comments and strings; a word too many only
+/// means that something is analysed again for no reason.
+void CollectWords(std::string_view text, std::unordered_set<std::string>& words) {
+    /// Same as in the lexer.
+    auto IsStart = [](char c) { return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or c == '_'; };
+    auto IsContinue = [&](char c) { return IsStart(c) or (c >= '0' and c <= '9') or c == '!' or c == '$' or c == '@'; };
+    for (usz i = 0; i < text.size();) {
+        if (not IsStart(text[i])) {
+            i++;
+            continue;
+        }
+
+        auto start = i;
+        while (i < text.size() and IsContinue(text[i])) i++;
+        words.emplace(text.substr(start, i - start));
+    }
+}
+
+/// Whether two sets of names have one in common.
+auto Intersect(const std::unordered_set<std::string>& a, const std::unordered_set<std::string>& b) -> bool {
+    if (a.size() > b.size()) return Intersect(b, a);
+    return rgs::any_of(a, [&](const std::string& name) { return b.contains(name); });
+}
+
+/// Find the item that contains an offset, if any.
+auto Find(const auto& items, u32 offset) -> std::optional<usz> {
+    auto it = rgs::upper_bound(items, offset, {}, [](const auto& item) { return item.begin; });
+    if (it == items.begin()) return std::nullopt;
+    --it;
+    if (offset >= it->end) return std::nullopt;
+    return usz(it - items.begin());
+}
+} // namespace
+} // namespace lcc::glint
+
+lcc::glint::IncrementalChecker::SavedDiags::~SavedDiags() {
+    for (auto& d : diags) d.suppress();
+}
+
+lcc::glint::IncrementalChecker::IncrementalChecker(fs::path file_path, ContextFactory context_factory)
+    : make_context(std::move(context_factory)), path(std::move(file_path)) {}
+
+auto lcc::glint::IncrementalChecker::check(std::string_view contents) -> std::vector<Diag> {
+    auto new_ctx = make_context();
+
+    /// The imports change far less often than the file does, so reuse
+    /// the metadata the last check loaded.
+    if (ctx) new_ctx->imported_modules = ctx->imported_modules;
+    auto& file = new_ctx->create_file(path, std::vector<char>{contents.begin(), contents.end()});
+    auto new_file_id = u16(file.file_id());
+
+    Diag::Buffer out{};
+    Diag::Buffer::Capture capture{out};
+    auto new_mod = Parser::Parse(new_ctx.get(), file);
+    reused = 0;
+    if (not new_mod) {
+        /// Keep what we know about the file as it was for the next check.
+        mod.reset();
+        ctx = std::move(new_ctx);
+        return out.take();
+    }
+
+    /// Split the file into its top-level expressions.
+    std::vector<Item> new_items{};
+    std::unordered_set<std::string> global_variables{};
+    const auto& offsets = new_mod->top_level_offsets();
+    for (usz i = 0; i < offsets.size(); i++) {
+        auto [expr, begin] = offsets[i];
+        auto& item = new_items.emplace_back();
+        item.begin = begin;
+        item.end = i + 1 < offsets.size() ? offsets[i + 1].second : u32(contents.size());
+        item.body_begin = item.end;
+        if (auto* func = cast<FuncDecl>(expr); func and func->body() and func->body()->location().is_valid()) {
+            item.body_begin = std::clamp(func->body()->location().pos, item.begin, item.end);
+            item.reusable = true;
+        }
+
+        auto text = contents.substr(item.begin, item.end - item.begin);
+        auto signature = contents.substr(item.begin, item.body_begin - item.begin);
+        item.hash = std::hash<std::string_view>{}(text);
+        item.signature_hash = std::hash<std::string_view>{}(signature);
+        CollectWords(signature, item.signature_words);
+        CollectWords(contents.substr(item.body_begin, item.end - item.body_begin), item.body_words);
+
+        /// The members of a type, e.g. enumerators, can be used without
+        /// naming the type, so a type counts as declaring every name in it.
+        if (auto* decl = cast<Decl>(expr)) {
+            item.declares.emplace_back(decl->name());
+            if (is<VarDecl>(decl)) global_variables.emplace(decl->name());
+            if (is<TypeDecl, TypeAliasDecl>(decl))
+                item.declares.insert(item.declares.end(), item.signature_words.begin(), item.signature_words.end());
+        }
+    }
+
+    /// Anything before the first expression, i.e. the module declaration
+    /// and imports, affects everything after it.
+    std::string_view old_source{source};
+    u32 old_preamble_end = items.empty() ? u32(source.size()) : items.front().begin;
+    u32 preamble_end = new_items.empty() ? u32(contents.size()) : new_items.front().begin;
+    bool preamble_changed = not have_items or old_source.substr(0, old_preamble_end) != contents.substr(0, preamble_end);
+
+    /// Match the expressions against those of the last check: first those
+    /// whose text is the same, then functions of which only the body changed.
+    std::vector<std::optional<usz>> exact(new_items.size());
+    std::vector<std::optional<usz>> new_of_old(items.size());
+    std::vector<bool> old_matched(items.size());
+    std::vector<bool> new_matched(new_items.size());
+    auto Match = [&](bool same_text, auto Key, auto Text) {
+        std::unordered_multimap<usz, usz> candidates{};
+        for (usz j = 0; j < items.size(); j++)
+            if (not old_matched[j]) candidates.emplace(Key(items[j]), j);
+
+        for (usz i = 0; i < new_items.size(); i++) {
+            if (new_matched[i]) continue;
+            auto [first, last] = candidates.equal_range(Key(new_items[i]));
+            for (auto it = first; it != last; ++it) {
+                auto j = it->second;
+                if (Text(old_source, items[j]) != Text(contents, new_items[i])) continue;
+                old_matched[j] = new_matched[i] = true;
+                candidates.erase(it);
+                if (same_text) {
+                    exact[i] = j;
+                    new_of_old[j] = i;
+                }
+                break;
+            }
+        }
+    };
+
+    Match(
+        true,
+        [](const Item& item) { return item.hash; },
+        [](std::string_view text, const Item& item) { return text.substr(item.begin, item.end - item.begin); }
+    );
+
+    Match(
+        false,
+        [](const Item& item) { return item.signature_hash; },
+        [](std::string_view text, const Item& item) { return text.substr(item.begin, item.body_begin - item.begin); }
+    );
+
+    /// Every name declared by something that was added, removed, or changed
+    /// outside of a function body is dirty, and so is everything declared by
+    /// a declaration that mentions a dirty name.
+    std::unordered_set<std::string> dirty{};
+    std::vector<bool> declares_dirty(new_items.size());
+    for (usz j = 0; j < items.size(); j++)
+        if (not old_matched[j]) dirty.insert(items[j].declares.begin(), items[j].declares.end());
+
+    for (usz i = 0; i < new_items.size(); i++) {
+        if (new_matched[i]) continue;
+        declares_dirty[i] = true;
+        dirty.insert(new_items[i].declares.begin(), new_items[i].declares.end());
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (usz i = 0; i < new_items.size(); i++) {
+            if (declares_dirty[i] or not Intersect(new_items[i].signature_words, dirty)) continue;
+            declares_dirty[i] = true;
+            dirty.insert(new_items[i].declares.begin(), new_items[i].declares.end());
+            changed = true;
+        }
+    }
+
+    /// A body may free a global variable, which makes using it in any
+    /// body after that an error, so the global variables mentioned in a
+    /// body that was added, removed, or changed are dirty for the other
+    /// bodies. Bodies that freed a global variable last time are always
+    /// analysed again, so what they free is known.
+    std::unordered_set<std::string> dirty_variables{};
+    auto DirtyVariables = [&](const Item& item) {
+        for (const auto& word : item.body_words)
+            if (global_variables.contains(word)) dirty_variables.insert(word);
+    };
+
+    for (usz j = 0; j < items.size(); j++)
+        if (not new_of_old[j]) DirtyVariables(items[j]);
+
+    for (usz i = 0; i < new_items.size(); i++)
+        if (not exact[i]) DirtyVariables(new_items[i]);
+
+    /// Find the item each function is declared in.
+    std::unordered_map<FuncDecl*, std::pair<usz, usz>> placement{};
+    std::vector<usz> function_counts(new_items.size());
+    for (auto* func : new_mod->functions()) {
+        if (func == new_mod->top_level_function() or not func->body()) continue;
+        auto l = func->location();
+        if (not l.is_valid() or l.file_id != new_file_id) continue;
+        auto i = Find(new_items, l.pos);
+        if (not i or not new_items[*i].reusable) continue;
+        placement[func] = {*i, function_counts[*i]++};
+    }
+
+    for (usz i = 0; i < new_items.size(); i++)
+        new_items[i].functions.resize(function_counts[i]);
+
+    /// Move a location from where it was in the last check to where it is
+    /// now; this only works for locations in expressions that are still
+    /// there unchanged.
+    auto Relocate = [&](Location l, bool& ok) -> Location {
+        if (not l.is_valid()) return l;
+        if (l.file_id != file_id) {
+            ok = false;
+            return l;
+        }
+
+        if (l.pos < old_preamble_end) return {l.pos, l.len, new_file_id};
+        auto j = Find(items, l.pos);
+        if (not j or not new_of_old[*j]) {
+            ok = false;
+            return l;
+        }
+
+        return {l.pos - items[*j].begin + new_items[*new_of_old[*j]].begin, l.len, new_file_id};
+    };
+
+    /// Reuse the bodies of unchanged functions that mention nothing dirty
+    /// if everything their diagnostics refer to is still there.
+    std::vector<bool> reuse(new_items.size());
+    std::vector<std::vector<std::vector<Diag>>> replay(new_items.size());
+    for (usz i = 0; i < new_items.size() and not preamble_changed; i++) {
+        auto& item = new_items[i];
+        if (
+            not exact[i]
+            or not item.reusable
+            or items[*exact[i]].functions.size() != item.functions.size()
+            or Intersect(item.signature_words, dirty)
+            or Intersect(item.body_words, dirty)
+            or Intersect(item.body_words, dirty_variables)
+            or rgs::any_of(items[*exact[i]].functions, &SavedDiags::frees_globals)
+        ) continue;
+
+        bool ok = true;
+        for (auto& saved : items[*exact[i]].functions) {
+            auto& copies = replay[i].emplace_back();
+            for (auto& d : saved.diags)
+                copies.push_back(d.copy(new_ctx.get(), [&](Location l) { return Relocate(l, ok); }));
+        }
+
+        if (ok) {
+            reuse[i] = true;
+            reused += item.functions.size();
+        } else {
+            for (auto& copies : replay[i])
+                for (auto& d : copies) d.suppress();
+            replay[i].clear();
+        }
+    }
+
+    /// Analyse what can't be reused, and save the diagnostics of every
+    /// function for the next check.
+    auto Same = [](Location l) { return l; };
+    Sema::BodyHooks hooks{
+        [&](FuncDecl* func) {
+            auto it = placement.find(func);
+            return it == placement.end() or not reuse[it->second.first];
+        },
+        [&](FuncDecl* func, Diag::Buffer& buffer, bool frees_globals) {
+            auto it = placement.find(func);
+            if (it == placement.end()) return;
+            auto [i, k] = it->second;
+            new_items[i].functions[k].frees_globals = frees_globals;
+            auto& saved = new_items[i].functions[k].diags;
+            if (not reuse[i]) {
+                for (const auto& d : buffer.diagnostics()) saved.push_back(d.copy(new_ctx.get(), Same));
+                return;
+            }
+
+            for (auto& d : replay[i][k]) {
+                saved.push_back(d.copy(new_ctx.get(), Same));
+                buffer.add(std::move(d));
+            }
+        },
+    };
+
+    Sema::Analyse(new_ctx.get(), *new_mod, hooks, new_ctx->option_use_colour());
+    for (auto& copies : replay | vws::join)
+        for (auto& d : copies) d.suppress();
+
+    mod.reset();
+    ctx = std::move(new_ctx);
+    mod = std::move(new_mod);
+    source = contents;
+    items = std::move(new_items);
+    file_id = new_file_id;
+    have_items = true;
+    return out.take();
+}
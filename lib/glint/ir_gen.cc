@@ -23,7 +23,41 @@ void IRGen::insert(lcc::Inst* inst) {
     block->insert(inst);
 }
 
+namespace {
+auto ConvertUncached(Context* ctx, Type* in) -> lcc::Type*;
+} // namespace
+
 lcc::Type* Convert(Context* ctx, Type* in) {
+    switch (in->kind()) {
+        // These are either shared by all modules or trivial to convert.
+        case Type::Kind::Builtin:
+        case Type::Kind::FFIType:
+        case Type::Kind::Named:
+        case Type::Kind::Pointer:
+        case Type::Kind::Reference:
+            return ConvertUncached(ctx, in);
+
+        // Aggregates are converted member by member, so only do that once.
+        case Type::Kind::Array:
+        case Type::Kind::Function:
+        case Type::Kind::DynamicArray:
+        case Type::Kind::ArrayView:
+        case Type::Kind::Sum:
+        case Type::Kind::Union:
+        case Type::Kind::Struct:
+        case Type::Kind::Enum:
+        case Type::Kind::Integer: {
+            if (auto* t = in->ir_type()) return t;
+            auto* t = ConvertUncached(ctx, in);
+            in->ir_type(t);
+            return t;
+        }
+    }
+    LCC_UNREACHABLE();
+}
+
+namespace {
+auto ConvertUncached(Context* ctx, Type* in) -> lcc::Type* {
     switch (in->kind()) {
         case Type::Kind::Builtin:
             switch ((as<BuiltinType>(in))->builtin_kind()) {
@@ -74,10 +108,7 @@ lcc::Type* Convert(Context* ctx, Type* in) {
                     "Glint Type-checker should have set DynamicArrayType's cached type (by calling struct_type()), but it appears to be nullptr at time of IRGen"
                 );
             }
-            std::vector<lcc::Type*> member_types{};
-            for (const auto& m : struct_type->members())
-                member_types.push_back(Convert(ctx, m.type));
-            return lcc::StructType::Get(ctx, std::move(member_types));
+            return Convert(ctx, struct_type);
         }
 
         case Type::Kind::ArrayView: {
@@ -88,10 +119,7 @@ lcc::Type* Convert(Context* ctx, Type* in) {
                     "Glint Type-checker should have set DynamicArrayType's cached type (by calling struct_type()), but it appears to be nullptr at time of IRGen"
                 );
             }
-            std::vector<lcc::Type*> member_types{};
-            for (const auto& m : struct_type->members())
-                member_types.push_back(Convert(ctx, m.type));
-            return lcc::StructType::Get(ctx, std::move(member_types));
+            return Convert(ctx, struct_type);
         }
 
         case Type::Kind::Sum: {
@@ -102,11 +130,7 @@ lcc::Type* Convert(Context* ctx, Type* in) {
                     "Glint Type-checker should have set SumType's cached type (by calling struct_type() or similar), but it appears to be nullptr at time of IRGen"
                 );
             }
-            std::vector<lcc::Type*> member_types{};
-            member_types.reserve(struct_type->members().size());
-            for (const auto& m : struct_type->members())
-                member_types.emplace_back(Convert(ctx, m.type));
-            return lcc::StructType::Get(ctx, std::move(member_types));
+            return Convert(ctx, struct_type);
         }
 
         case Type::Kind::Union: {
@@ -136,6 +160,7 @@ lcc::Type* Convert(Context* ctx, Type* in) {
     }
     LCC_UNREACHABLE();
 }
+} // namespace
 
 void glint::IRGen::create_function(glint::FuncDecl* f) {
     auto name = f->function_type()->has_attr(FuncAttr::NoMangle)
@@ -152,6 +177,151 @@ void glint::IRGen::create_function(glint::FuncDecl* f) {
 }
 
 /// NOTE: If you `new` an /instruction/ (of, or derived from, type `Inst`), you need to `insert()` it.
+void IRGen::call(lcc::Function* f, std::vector<lcc::Value*> args) {
+    insert(new (*module) CallInst(f, as<FunctionType>(f->type()), std::move(args)));
+}
+
+// A dynamic array is a struct of a pointer to its elements, its size, and
+// its capacity, in that order, no matter what its elements are, so every
+// one of them shares the same runtime:
+//
+//     init(array: ptr, capacity: u32, element_size: u64)
+//         Allocate room for `capacity` elements; the array starts out empty.
+//     grow(array: ptr, element_size: u64)
+//         Double the capacity of the array, or make room for eight elements
+//         if it has none.
+//     free(array: ptr)
+//         Free the elements and leave the array empty, with no capacity.
+//
+// Appending is inlined, since all it does is store the element if there is
+// room; only if there isn't does it call `grow()` first. Doubling the
+// capacity every time keeps that amortised constant time.
+auto IRGen::dynamic_array_builtins() -> const DynamicArrayRuntime& {
+    auto& rt = dynamic_array_runtime;
+    if (rt.init) return rt;
+
+    auto* count_t = lcc::IntegerType::Get(ctx, DynamicArrayType::IntegerWidth);
+    auto* bytes_t = lcc::IntegerType::Get(ctx, ctx->target()->ffi.size_of_long_long);
+    auto* struct_t = lcc::StructType::Get(ctx, {lcc::Type::PtrTy, count_t, count_t});
+
+    auto malloc_func = module->function_by_name("malloc");
+    auto realloc_func = module->function_by_name("realloc");
+    auto free_func = module->function_by_name("free");
+    LCC_ASSERT(malloc_func and realloc_func and free_func, "Glint IRGen couldn't find the allocator");
+
+    auto Create = [&](std::string_view name, std::vector<lcc::Type*> params) {
+        auto* f = new (*module) Function(
+            module,
+            fmt::format("__glint_dynamic_array_{}", name),
+            FunctionType::Get(ctx, lcc::Type::VoidTy, std::move(params)),
+            Linkage::Internal,
+            CallConv::C
+        );
+        function = f;
+        update_block(new (*module) lcc::Block(fmt::format("{}.entry", name)));
+        return f;
+    };
+
+    auto Member = [&](Value* array, usz index) {
+        auto* gmp = new (*module) GetMemberPtrInst(
+            struct_t,
+            array,
+            new (*module) IntegerConstant(Convert(ctx, Type::UInt), index)
+        );
+        insert(gmp);
+        return gmp;
+    };
+
+    auto Bytes = [&](Value* count, Value* element_size) {
+        auto* wide = new (*module) ZExtInst(count, bytes_t);
+        auto* bytes = new (*module) MulInst(wide, element_size);
+        insert(wide);
+        insert(bytes);
+        return bytes;
+    };
+
+    // Don't clobber the insert point of whatever function we're in.
+    auto* saved_function = function;
+    auto* saved_block = block;
+
+    {
+        rt.init = Create("init", {lcc::Type::PtrTy, count_t, bytes_t});
+        auto* array = rt.init->param(0);
+        auto* capacity = rt.init->param(1);
+        insert(new (*module) StoreInst(capacity, Member(array, 2)));
+        insert(new (*module) StoreInst(new (*module) IntegerConstant(count_t, 0), Member(array, 1)));
+
+        auto* data = new (*module) CallInst(
+            *malloc_func,
+            as<FunctionType>(malloc_func->type()),
+            {Bytes(capacity, rt.init->param(2))}
+        );
+        insert(data);
+        insert(new (*module) StoreInst(data, Member(array, 0)));
+        insert(new (*module) ReturnInst(nullptr));
+    }
+
+    {
+        rt.grow = Create("grow", {lcc::Type::PtrTy, bytes_t});
+        auto* array = rt.grow->param(0);
+        auto* entry = block;
+        auto* capacity_ptr = Member(array, 2);
+        auto* capacity = new (*module) LoadInst(count_t, capacity_ptr);
+        auto* empty = new (*module) EqInst(capacity, new (*module) IntegerConstant(count_t, 0));
+        auto* twice = new (*module) lcc::Block("grow.double");
+        auto* resize = new (*module) lcc::Block("grow.resize");
+        insert(capacity);
+        insert(empty);
+        insert(new (*module) CondBranchInst(empty, resize, twice));
+
+        update_block(twice);
+        auto* doubled = new (*module) ShlInst(capacity, new (*module) IntegerConstant(count_t, 1));
+        insert(doubled);
+        insert(new (*module) BranchInst(resize));
+
+        update_block(resize);
+        auto* new_capacity = new (*module) PhiInst(count_t);
+        new_capacity->set_incoming(new (*module) IntegerConstant(count_t, 8), entry);
+        new_capacity->set_incoming(doubled, twice);
+        insert(new_capacity);
+        insert(new (*module) StoreInst(new_capacity, capacity_ptr));
+
+        auto* data_ptr = Member(array, 0);
+        auto* data = new (*module) LoadInst(lcc::Type::PtrTy, data_ptr);
+        insert(data);
+        auto* new_data = new (*module) CallInst(
+            *realloc_func,
+            as<FunctionType>(realloc_func->type()),
+            {data, Bytes(new_capacity, rt.grow->param(1))}
+        );
+        insert(new_data);
+        insert(new (*module) StoreInst(new_data, data_ptr));
+        insert(new (*module) ReturnInst(nullptr));
+    }
+
+    {
+        rt.free = Create("free", {lcc::Type::PtrTy});
+        auto* array = rt.free->param(0);
+        auto* data_ptr = Member(array, 0);
+        auto* data = new (*module) LoadInst(lcc::Type::PtrTy, data_ptr);
+        insert(data);
+        insert(new (*module) CallInst(*free_func, as<FunctionType>(free_func->type()), {data}));
+
+        // realloc() of a null pointer allocates, so the array can be
+        // appended to again.
+        auto* null = new (*module) BitcastInst(new (*module) IntegerConstant(bytes_t, 0), lcc::Type::PtrTy);
+        insert(null);
+        insert(new (*module) StoreInst(null, data_ptr));
+        insert(new (*module) StoreInst(new (*module) IntegerConstant(count_t, 0), Member(array, 1)));
+        insert(new (*module) StoreInst(new (*module) IntegerConstant(count_t, 0), Member(array, 2)));
+        insert(new (*module) ReturnInst(nullptr));
+    }
+
+    function = saved_function;
+    block = saved_block;
+    return rt;
+}
+
 void glint::IRGen::generate_expression(glint::Expr* expr) {
     // Already generated
     if (generated_ir[expr]) return;
@@ -205,9 +375,7 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                     //         capacity: int;
                     //     };
                     //     foo: foo_t;
-                    //     foo.capacity := 8;
-                    //     foo.size := 0;
-                    //     foo.data := malloc 8(sizeof Byte);
+                    //     __glint_dynamic_array_init(&foo, 8, sizeof Byte);
                     // endcode
                     if (auto* dynamic_array_t = cast<DynamicArrayType>(decl->type())) {
                         constexpr usz default_dynamic_array_capacity = 8;
@@ -235,71 +403,12 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                                 default_dynamic_array_capacity
                             );
                         }
-                        LCC_ASSERT(
-                            capacity_val,
-                            "One of the if branches above should have set the value, but it is null"
-                        );
-
-                        // TODO: Don't use hard-coded struct member index.
-                        auto* capacity_ptr = new (*module) GetMemberPtrInst(
-                            Convert(ctx, dynamic_array_t->struct_type()),
-                            alloca,
-                            new (*module) IntegerConstant(Convert(ctx, Type::UInt), 2)
-                        );
-                        auto* capacity_store = new (*module) StoreInst(capacity_val, capacity_ptr);
-                        insert(capacity_ptr);
-                        insert(capacity_store);
 
-                        auto* size_val = new (*module) IntegerConstant(
-                            Convert(ctx, dynamic_array_t->struct_type()->members()[1].type),
-                            0
-                        );
-                        auto* size_ptr = new (*module) GetMemberPtrInst(
-                            Convert(ctx, dynamic_array_t->struct_type()),
-                            alloca,
-                            new (*module) IntegerConstant(Convert(ctx, Type::UInt), 1)
+                        auto* element_size = new (*module) IntegerConstant(
+                            lcc::IntegerType::Get(ctx, ctx->target()->ffi.size_of_long_long),
+                            dynamic_array_t->element_type()->size_in_bytes(ctx)
                         );
-                        auto* size_store = new (*module) StoreInst(size_val, size_ptr);
-                        insert(size_ptr);
-                        insert(size_store);
-
-                        Value* alloc_size_bytes{};
-                        if (dynamic_array_t->initial_size()) {
-                            auto* initial_size = new (*module) LoadInst(
-                                Convert(ctx, dynamic_array_t->initial_size()->type()),
-                                generated_ir[dynamic_array_t->initial_size()]
-                            );
-                            insert(initial_size);
-
-                            alloc_size_bytes = initial_size;
-                        } else {
-                            alloc_size_bytes = new (*module) IntegerConstant(
-                                Convert(ctx, Type::UInt),
-                                default_dynamic_array_capacity * dynamic_array_t->element_type()->size_in_bytes(ctx)
-                            );
-                        }
-                        LCC_ASSERT(
-                            alloc_size_bytes,
-                            "One of the if branches above should have set the value, but it is null"
-                        );
-
-                        auto malloc_func = module->function_by_name("malloc");
-                        LCC_ASSERT(malloc_func, "Glint IRGen couldn't find `malloc'");
-                        auto* malloc_call = new (*module) CallInst(
-                            *malloc_func,
-                            as<FunctionType>(malloc_func->type()),
-                            {alloc_size_bytes}
-                        );
-                        insert(malloc_call);
-
-                        auto* data_ptr = new (*module) GetMemberPtrInst(
-                            Convert(ctx, dynamic_array_t->struct_type()),
-                            alloca,
-                            new (*module) IntegerConstant(Convert(ctx, Type::UInt), 0)
-                        );
-                        auto* data_store = new (*module) StoreInst(malloc_call, data_ptr);
-                        insert(data_ptr);
-                        insert(data_store);
+                        call(dynamic_array_builtins().init, {alloca, capacity_val, element_size});
                     }
 
                     if (auto* init_expr = decl->init()) {
@@ -431,24 +540,7 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                 } break;
                 case TokenKind::Minus: {
                     if (unary_expr->operand()->type()->is_dynamic_array()) {
-                        auto* struct_t = as<DynamicArrayType>(unary_expr->operand()->type())->struct_type();
-                        auto* data_ptr = new (*module) GetMemberPtrInst(
-                            Convert(ctx, struct_t),
-                            generated_ir[unary_expr->operand()],
-                            new (*module) IntegerConstant(Convert(ctx, Type::UInt), 0)
-                        );
-                        auto* data_load = new (*module) LoadInst(lcc::Type::PtrTy, data_ptr);
-                        insert(data_ptr);
-                        insert(data_load);
-
-                        auto free_func = module->function_by_name("free");
-                        LCC_ASSERT(free_func, "Glint IRGen couldn't find `free'");
-                        auto* free_call = new (*module) CallInst(
-                            *free_func,
-                            as<FunctionType>(free_func->type()),
-                            {data_load}
-                        );
-                        insert(free_call);
+                        call(dynamic_array_builtins().free, {generated_ir[unary_expr->operand()]});
                         break;
                     }
 
@@ -671,6 +763,81 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                 break;
             }
 
+            // Append to a dynamic array
+            // code
+            //     foo += 42;
+            //     ;; roughly equivalent to
+            //     if foo.size >= foo.capacity
+            //         __glint_dynamic_array_grow(&foo, sizeof Byte);
+            //     @foo.data[foo.size] := 42;
+            //     foo.size += 1;
+            // endcode
+            if (binary_expr->op() == TokenKind::PlusEq) {
+                auto* dynamic_array_t = as<DynamicArrayType>(lhs_expr->type());
+                auto* struct_t = Convert(ctx, dynamic_array_t->struct_type());
+                auto* count_t = Convert(ctx, dynamic_array_t->struct_type()->members()[1].type);
+                auto* bytes_t = lcc::IntegerType::Get(ctx, ctx->target()->ffi.size_of_long_long);
+
+                generate_expression(lhs_expr);
+                auto* array = generated_ir[lhs_expr];
+
+                generate_expression(rhs_expr);
+                auto* rhs = generated_ir[rhs_expr];
+
+                auto Member = [&](usz index) {
+                    auto* gmp = new (*module) GetMemberPtrInst(
+                        struct_t,
+                        array,
+                        new (*module) IntegerConstant(Convert(ctx, Type::UInt), index),
+                        expr->location()
+                    );
+                    insert(gmp);
+                    return gmp;
+                };
+
+                auto* size_ptr = Member(1);
+                auto* size = new (*module) LoadInst(count_t, size_ptr);
+                insert(size);
+                auto* capacity = new (*module) LoadInst(count_t, Member(2));
+                insert(capacity);
+                auto* full = new (*module) UGeInst(size, capacity);
+                insert(full);
+
+                auto* grow = new (*module) lcc::Block(fmt::format("append.grow.{}", total_append));
+                auto* store = new (*module) lcc::Block(fmt::format("append.store.{}", total_append));
+                total_append += 1;
+                insert(new (*module) CondBranchInst(full, grow, store, expr->location()));
+
+                update_block(grow);
+                call(
+                    dynamic_array_builtins().grow,
+                    {array, new (*module) IntegerConstant(bytes_t, dynamic_array_t->element_type()->size_in_bytes(ctx))}
+                );
+                insert(new (*module) BranchInst(store, expr->location()));
+
+                update_block(store);
+                auto* data = new (*module) LoadInst(lcc::Type::PtrTy, Member(0));
+                insert(data);
+                auto* index = new (*module) ZExtInst(size, bytes_t);
+                insert(index);
+                auto* element_ptr = new (*module) GEPInst(
+                    Convert(ctx, dynamic_array_t->element_type()),
+                    data,
+                    index,
+                    expr->location()
+                );
+                insert(element_ptr);
+                insert(new (*module) StoreInst(rhs, element_ptr, expr->location()));
+
+                auto* new_size = new (*module) AddInst(size, new (*module) IntegerConstant(count_t, 1));
+                insert(new_size);
+                insert(new (*module) StoreInst(new_size, size_ptr));
+
+                // Like assignment, this yields the lvalue appended to.
+                generated_ir[expr] = array;
+                break;
+            }
+
             // Subscript
             if (binary_expr->op() == TokenKind::LBrack) {
                 generate_expression(lhs_expr);
@@ -845,6 +1012,7 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                 case TokenKind::LBrace:
                 case TokenKind::RBrace:
                 case TokenKind::LBrack: // handled above
+                case TokenKind::PlusEq: // handled above
                 case TokenKind::RBrack:
                 case TokenKind::Sizeof:
                 case TokenKind::Alignof:
@@ -875,7 +1043,6 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                         ToString(binary_expr->op())
                     );
 
-                case TokenKind::PlusEq:
                 case TokenKind::MinusEq:
                 case TokenKind::StarEq:
                 case TokenKind::SlashEq:
@@ -1139,7 +1306,7 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                     auto* struct_type = sum_type->struct_type();
                     auto* tag_type = Convert(ctx, struct_type->members().at(0).type);
 
-                    auto it = rgs::find_if(sum_type->members(), [&](auto& member) { return member.name == m->name(); });
+                    auto it = rgs::find(sum_type->members(), m->symbol(), &SumType::Member::symbol);
                     LCC_ASSERT(
                         it != sum_type->members().end(),
                         "Sum type {} has no member named '{}'",
@@ -1166,7 +1333,6 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                     // member's default expression.
 
                     // Create Basic Blocks
-                    static usz total_sum_access{0};
                     auto* then = new (*module) lcc::Block(fmt::format("sum.access.good.{}", total_sum_access));
                     auto* otherwise = new (*module) lcc::Block(fmt::format("sum.access.bad.{}", total_sum_access));
                     auto* exit = new (*module) lcc::Block(fmt::format("sum.access.exit.{}", total_sum_access));
@@ -1427,6 +1593,7 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
 
                 update_block(then);
                 generate_expression(if_expr->then());
+                if (not block->closed()) insert(new (*module) BranchInst(exit, expr->location()));
 
                 update_block(exit);
                 break;
@@ -1524,15 +1691,32 @@ void glint::IRGen::generate_expression(glint::Expr* expr) {
                 } break;
 
                 case IntrinsicKind::BuiltinInline: {
-                    LCC_ASSERT(intrinsic->args().empty(), "No arguments to Inline Builtin");
-                } break;
-                case IntrinsicKind::BuiltinMemCopy: {
-                    LCC_ASSERT(intrinsic->args().size() == 3, "Exactly three arguments to Memory Copy Builtin: (destination, source, amountOfBytesToCopy)");
-                    LCC_ASSERT(false, "TODO: memcopy ir generation");
+                    LCC_ASSERT(intrinsic->args().size() == 1, "Exactly one argument to Inline Builtin");
+                    auto* call_expr = intrinsic->args().front();
+                    generate_expression(call_expr);
+                    auto* call = as<CallInst>(generated_ir[call_expr]);
+                    call->set_force_inline();
+                    generated_ir[expr] = call;
                 } break;
+                case IntrinsicKind::BuiltinMemCopy:
                 case IntrinsicKind::BuiltinMemSet: {
-                    LCC_ASSERT(intrinsic->args().size() == 3, "Exactly three arguments to Memory Set Builtin");
-                    LCC_ASSERT(false, "TODO: memset ir generation");
+                    bool is_memcpy = intrinsic->intrinsic_kind() == IntrinsicKind::BuiltinMemCopy;
+                    if (is_memcpy) LCC_ASSERT(intrinsic->args().size() == 3, "Exactly three arguments to Memory Copy Builtin: (destination, source, amountOfBytesToCopy)");
+                    else LCC_ASSERT(intrinsic->args().size() == 3, "Exactly three arguments to Memory Set Builtin");
+
+                    std::vector<lcc::Value*> operands{};
+                    for (auto* arg : intrinsic->args()) {
+                        generate_expression(arg);
+                        operands.push_back(generated_ir[arg]);
+                    }
+
+                    auto* ir_intrinsic = new (*module) lcc::IntrinsicInst(
+                        is_memcpy ? lcc::IntrinsicKind::MemCopy : lcc::IntrinsicKind::MemSet,
+                        std::move(operands),
+                        expr->location()
+                    );
+                    generated_ir[expr] = ir_intrinsic;
+                    insert(ir_intrinsic);
                 } break;
                 case IntrinsicKind::BuiltinSyscall: {
                     LCC_ASSERT(intrinsic->args().empty(), "No arguments to Syscall Builtin");
@@ -1639,9 +1823,8 @@ auto IRGen::Generate(Context* context, glint::Module& mod) -> lcc::Module* {
     // wanted to do that. Or write it in strings, but I don't think that'd be
     // very nice as compared to building it in memory.
     // TODO: Add builtins here like malloc, free, exit, whatever else we
-    // insert a ton of up there. Also need to abstract the dynamic array
-    // initialisation stuff into a builtin probably oh and definitely the
-    // "grow" functionality and stuff like that.
+    // insert a ton of up there. The dynamic array runtime is created on
+    // demand, in `dynamic_array_builtins()`.
 
     { // malloc
         auto* malloc_ty = FunctionType::Get(
@@ -1660,6 +1843,22 @@ auto IRGen::Generate(Context* context, glint::Module& mod) -> lcc::Module* {
         );
     }
 
+    { // realloc
+        auto* realloc_ty = FunctionType::Get(
+            context,
+            lcc::Type::PtrTy,
+            {lcc::Type::PtrTy, lcc::IntegerType::Get(context, context->target()->ffi.size_of_long_long)}
+        );
+        new (*ir_gen.module) Function(
+            ir_gen.module,
+            "realloc",
+            realloc_ty,
+            Linkage::Imported,
+            CallConv::C,
+            {}
+        );
+    }
+
     { // free
         auto* free_ty = FunctionType::Get(
             context,
@@ -1714,7 +1913,7 @@ auto IRGen::Generate(Context* context, glint::Module& mod) -> lcc::Module* {
         );
 
         // Tell LCC to emit this section in the output code.
-        ir_gen.mod()->add_extra_section(metadata_blob);
+        ir_gen.mod()->add_extra_section(std::move(metadata_blob));
     }
 
     return ir_gen.mod();
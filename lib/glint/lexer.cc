@@ -4,6 +4,7 @@
 #include <glint/lexer.hh>
 #include <glint/parser.hh>
 
+#include <array>
 #include <concepts>
 #include <cstdlib>
 #include <iterator>
@@ -16,7 +17,12 @@ using Tk = lcc::glint::TokenKind;
 
 /// All keywords.
 namespace {
-lcc::StringMap<Tk> keywords{
+struct Keyword {
+    std::string_view text;
+    Tk kind;
+};
+
+constexpr Keyword keywords[]{
     {"if", Tk::If},
     {"else", Tk::Else}, // Maybe make contextual
     {"while", Tk::While},
@@ -54,37 +60,62 @@ lcc::StringMap<Tk> keywords{
     {"csize", Tk::CLongLong},
     {"cusize", Tk::CULongLong},
 };
-} // namespace
 
-auto lcc::glint::Lexer::LookAhead(usz n) -> Token* {
-    if (n == 0) return &tok;
+/// Perfect hash table of the keywords, i.e. one in which no two keywords
+/// share a slot, so classifying an identifier takes one hash and at most
+/// one string comparison. The seed of the hash is searched for when the
+/// lexer is compiled.
+class KeywordTable {
+    static constexpr lcc::usz size = 256;
+    static constexpr lcc::u8 empty = lcc::u8(-1);
+    static_assert(std::size(keywords) < empty);
+
+    lcc::u32 seed{};
+    std::array<lcc::u8, size> slots{};
+
+    /// FNV-1a, starting from the seed.
+    static constexpr auto Hash(std::string_view text, lcc::u32 basis) -> lcc::u32 {
+        lcc::u32 hash = basis;
+        for (char c : text) hash = (hash ^ lcc::u8(c)) * 16777619u;
+        return hash;
+    }
 
-    /// If we already have enough tokens, just return the nth token.
-    const auto idx = n - 1;
-    if (idx < lookahead_tokens.size()) return &lookahead_tokens[idx];
+public:
+    consteval KeywordTable() {
+        for (seed = 2166136261u;; seed++) {
+            slots.fill(empty);
+            bool collision = false;
+            for (lcc::usz i = 0; i < std::size(keywords) and not collision; i++) {
+                auto& slot = slots[Hash(keywords[i].text, seed) % size];
+                collision = slot != empty;
+                slot = lcc::u8(i);
+            }
+            if (not collision) return;
+        }
+    }
 
-    /// Otherwise, lex enough tokens.
-    tempset looking_ahead = true;
-    auto current = std::move(tok);
-    for (usz i = lookahead_tokens.size(); i < n; i++) {
-        tok = {};
-        NextToken();
-        lookahead_tokens.push_back(std::move(tok));
+    /// Get the keyword with this name, if there is one.
+    [[nodiscard]]
+    constexpr auto find(std::string_view text) const -> const Keyword* {
+        auto slot = slots[Hash(text, seed) % size];
+        if (slot == empty or keywords[slot].text != text) return nullptr;
+        return &keywords[slot];
     }
-    tok = std::move(current);
+};
+
+constexpr KeywordTable keyword_table{};
+static_assert(keyword_table.find("culonglong")->kind == Tk::CULongLong);
+static_assert(not keyword_table.find("macro"));
+} // namespace
 
-    /// Return the nth token.
-    return &lookahead_tokens[idx];
+auto lcc::glint::Lexer::LookAhead(usz n) -> Token* {
+    return syntax::Lexer<Token>::LookAhead(n, [this] { NextToken(); });
 }
 
 void lcc::glint::Lexer::NextToken() {
     /// If we have lookahead tokens, and we’re not looking
     /// ahead, use those first.
-    if (not looking_ahead and not lookahead_tokens.empty()) {
-        tok = std::move(lookahead_tokens.front());
-        lookahead_tokens.pop_front();
-        return;
-    }
+    if (NextBufferedToken()) return;
 
     /// Pop empty macro expansions off the expansion stack.
     std::erase_if(macro_expansion_stack, [](MacroExpansion& x) { return x.done(); });
@@ -104,6 +135,7 @@ void lcc::glint::Lexer::NextToken() {
 
     /// Reset the token.
     tok.artificial = false;
+    tok.from_macro = false;
     tok.kind = TokenKind::Invalid;
 
     /// Keep returning EOF if we’re at EOF.
@@ -444,6 +476,9 @@ void lcc::glint::Lexer::NextToken() {
     // adjust the length all the way from the macro definition until after the
     // macro invocation.
     if (not tok.from_macro) tok.location.len = (u16) (CurrentOffset() - tok.location.pos);
+
+    /// Intern identifiers so that name lookup can compare symbols.
+    if (tok.kind == TokenKind::Ident) tok.symbol = InternedString{tok.text};
 }
 
 void lcc::glint::Lexer::NextIdentifier() {
@@ -465,18 +500,13 @@ void lcc::glint::Lexer::HandleIdentifier() {
         return;
     }
 
-    auto macro = rgs::find_if(
-        macros,
-        [&](const auto& m) { return m.name == tok.text; }
-    );
-
-    if (macro != macros.end()) {
-        ExpandMacro(*macro);
+    if (auto macro = macro_table.find(tok.text); macro != macro_table.end()) {
+        ExpandMacro(*macro->second);
         return;
     }
 
-    if (auto kw = keywords.find(tok.text); kw != keywords.end()) {
-        tok.kind = kw->second;
+    if (const auto* kw = keyword_table.find(tok.text)) {
+        tok.kind = kw->kind;
         return;
     }
 
@@ -616,7 +646,8 @@ void lcc::glint::Lexer::ExpandMacro(Macro& m) {
     raw_mode = true;
 
     /// Match the parameters against the input stream.
-    StringMap<Token> bound_toks;
+    std::vector<Token> bound_toks;
+    bound_toks.reserve(m.argument_count);
     for (const auto& param_tok : m.parameters) {
         NextToken();
 
@@ -625,7 +656,7 @@ void lcc::glint::Lexer::ExpandMacro(Macro& m) {
             switch (MacroArgumentSelector(param_tok.integer_value)) {
                 /// Bind a token.
                 case MacroArgumentSelector::Token:
-                    bound_toks[param_tok.text] = tok;
+                    bound_toks.push_back(tok);
                     continue;
 
                 /// Bind an expression.
@@ -641,7 +672,7 @@ void lcc::glint::Lexer::ExpandMacro(Macro& m) {
                         Token t;
                         t.kind = TokenKind::Number;
                         t.integer_value = 0;
-                        bound_toks[param_tok.text] = t;
+                        bound_toks.push_back(std::move(t));
                         continue;
                     }
 
@@ -651,7 +682,7 @@ void lcc::glint::Lexer::ExpandMacro(Macro& m) {
                     e.location = {start, expr->location()};
                     e.expression = *expr;
                     e.eval_once = param_tok.integer_value == +MacroArgumentSelector::ExprOnce;
-                    bound_toks[param_tok.text] = e;
+                    bound_toks.push_back(std::move(e));
                     continue;
                 }
             }
@@ -702,11 +733,13 @@ void lcc::glint::Lexer::HandleMacroDefinition() {
     auto name = tok.text;
 
     /// Check that the macro isn’t already defined.
-    if (rgs::find_if(macros, [&](auto&& m) { return m.name == name; }) != macros.end())
+    if (macro_table.contains(name))
         Error("Macro '{}' is already defined", name);
 
-    /// Lex parameter token list.
+    /// Lex parameter token list. If the macro is a redefinition, the
+    /// original definition stays in effect.
     auto& macro = macros.emplace_back(name);
+    macro_table.try_emplace(name, &macro);
     for (;;) {
         // First iteration eats macro name; afterwards, eats parameter tokens.
         NextToken();
@@ -721,6 +754,7 @@ void lcc::glint::Lexer::HandleMacroDefinition() {
             );
 
             if (it != macro.parameters.end()) Error("Duplicate macro argument name '{}'", tok.text);
+            macro.argument_count++;
         }
 
         /// Add the token.
@@ -759,14 +793,21 @@ void lcc::glint::Lexer::HandleMacroDefinition() {
         if (AtEof()) return;
         if (AtMacroKw("endmacro")) break;
 
-        /// If the next token is a macro arg, make sure it exists.
+        /// If the next token is a macro arg, make sure it exists, and
+        /// bind it to the index of the argument.
         if (tok.kind == Tk::MacroArg) {
-            auto arg = rgs::find_if(
-                macro.parameters,
-                [&](auto&& t) { return t.kind == Tk::MacroArg and t.text == tok.text; }
-            );
+            tok.integer_value = Macro::UnboundArgument;
+            u64 index = 0;
+            for (const auto& param : macro.parameters) {
+                if (param.kind != Tk::MacroArg) continue;
+                if (param.text == tok.text) {
+                    tok.integer_value = index;
+                    break;
+                }
+                index++;
+            }
 
-            if (arg == macro.parameters.end())
+            if (tok.integer_value == Macro::UnboundArgument)
                 Error("Undefined macro argument '{}'", tok.text);
         }
 
@@ -800,11 +841,14 @@ void lcc::glint::Lexer::HandleMacroDefinition() {
 lcc::glint::Lexer::MacroExpansion::MacroExpansion(
     Lexer& lexer,
     Macro& macro,
-    StringMap<Token> args,
+    std::vector<Token> args,
     Location l
-) : m(&macro), it(macro.expansion.begin()), bound_arguments(std::move(args)), location(l) {
-    for (usz i = 0; i < macro.definitions.size(); i++)
-        gensyms.push_back(fmt::format("__L{}", lexer.gensym_counter++));
+) : m(&macro),
+    it(macro.expansion.begin()),
+    arguments(std::move(args)),
+    location(l),
+    first_gensym(lexer.gensym_counter) {
+    lexer.gensym_counter += macro.definitions.size();
 }
 
 auto lcc::glint::Lexer::MacroExpansion::operator++() -> Token {
@@ -813,10 +857,9 @@ auto lcc::glint::Lexer::MacroExpansion::operator++() -> Token {
 
     // If the token is a macro arg, get the bound argument.
     if (it->kind == TokenKind::MacroArg) {
-        auto arg = bound_arguments.find(it->text);
-        LCC_ASSERT(arg != bound_arguments.end(), "Unbound macro argument '{}'", it->text);
+        LCC_ASSERT(it->integer_value < arguments.size(), "Unbound macro argument '{}'", it->text);
+        ret = arguments[it->integer_value];
         it++;
-        ret = arg->second;
     }
     // Otherwise, return a copy of the token.
     else
@@ -825,7 +868,8 @@ auto lcc::glint::Lexer::MacroExpansion::operator++() -> Token {
     /// If the token is a gensym, get its value.
     if (ret.kind == Tk::Gensym) {
         ret.kind = Tk::Ident;
-        ret.text = gensyms[ret.integer_value];
+        ret.text = fmt::format("__L{}", first_gensym + ret.integer_value);
+        ret.symbol = InternedString{ret.text};
     }
 
     // Mark the token as non-artificial, because, for example, if we are
@@ -0,0 +1,265 @@
+#include <lcc/file.hh>
+#include <lcc/utils.hh>
+
+#include <object/elf.h>
+#include <object/elf.hh>
+
+#include <glint/ast.hh>
+#include <glint/module_cache.hh>
+#include <glint/module_description.hh>
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lcc::glint {
+namespace {
+/// Validation data stored next to each cache entry.
+struct Stamp {
+    static constexpr u32 current_version = 1;
+
+    u8 magic[4]{'G', 'M', 'C', 'S'};
+    u32 version{current_version};
+
+    /// Size, modification time, and hash of the contents of the
+    /// object file the entry was extracted from.
+    u64 source_size{};
+    i64 source_mtime{};
+    u64 source_hash{};
+
+    [[nodiscard]]
+    auto valid() const -> bool {
+        return std::memcmp(magic, Stamp{}.magic, sizeof magic) == 0 and version == current_version;
+    }
+};
+
+/// 64-bit FNV-1a.
+auto Hash(std::string_view data) -> u64 {
+    u64 hash = 14695981039346656037u;
+    for (char c : data) {
+        hash ^= u8(c);
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+auto ModificationTime(const fs::path& path, std::error_code& ec) -> i64 {
+    return i64(fs::last_write_time(path, ec).time_since_epoch().count());
+}
+
+/// Write a file such that readers either see all of it or none of it.
+auto WriteAtomically(const fs::path& path, const void* data, usz size) -> bool {
+    auto temp = path;
+    temp += fmt::format(".{:016x}.tmp", std::random_device{}() | u64(std::random_device{}()) << 32);
+    if (not File::Write(data, size, temp)) return false;
+
+    std::error_code ec;
+    fs::rename(temp, path, ec);
+    if (ec) fs::remove(temp, ec);
+    return not ec;
+}
+
+auto EntryPath(const fs::path& directory, std::string_view name, const fs::path& source) -> fs::path {
+    std::error_code ec;
+    auto absolute = fs::absolute(source, ec);
+    return directory / fmt::format("{}-{:016x}", name, Hash((ec ? source : absolute).string()));
+}
+
+/// An entry in the import cache.
+struct Import {
+    u64 size{};
+    i64 mtime{};
+    std::shared_ptr<const ModuleMetadata> metadata;
+};
+
+struct Imports {
+    std::mutex mutex;
+    std::unordered_map<std::string, Import> entries;
+    std::vector<std::string> stored_paths;
+};
+
+auto GetImports() -> Imports& {
+    static Imports imports{};
+    return imports;
+}
+
+/// Requests to the compile server may come from different directories,
+/// so entries are keyed by absolute path.
+auto Key(const fs::path& path) -> std::string {
+    std::error_code ec;
+    auto absolute = fs::absolute(path, ec);
+    return (ec ? path : absolute).lexically_normal().string();
+}
+
+auto HasMetadataMagic(std::span<const u8> blob) -> bool {
+    return blob.size() >= 4
+       and blob[1] == ModuleDescription::magic_byte0
+       and blob[2] == ModuleDescription::magic_byte1
+       and blob[3] == ModuleDescription::magic_byte2;
+}
+
+/// Read the metadata in the gmeta or object file at \p path, without
+/// asserting anything about the file.
+auto ReadMetadata(const fs::path& path) -> std::shared_ptr<const ModuleMetadata> {
+    if (path.extension() == metadata_file_extension) {
+        auto mapping = MappedFile::Map(path);
+        if (not mapping) return {};
+        auto metadata = std::make_shared<const ModuleMetadata>(std::move(*mapping));
+        if (not HasMetadataMagic(metadata->blob())) return {};
+        return metadata;
+    }
+
+    // Check everything that would make extracting the section assert or
+    // read out of bounds.
+    auto mapping = MappedFile::Map(path);
+    if (not mapping or mapping->size() < sizeof(elf64_header)) return {};
+    std::vector<char> contents(mapping->data(), mapping->data() + mapping->size());
+    elf64_header hdr{};
+    std::memcpy(&hdr, contents.data(), sizeof(elf64_header));
+    if (not elf::validate_header(hdr).first) return {};
+    if (
+        hdr.e_shstrndx >= hdr.e_shnum
+        or hdr.e_shoff > contents.size()
+        or (contents.size() - hdr.e_shoff) / sizeof(elf64_shdr) < hdr.e_shnum
+    ) return {};
+    auto SectionHeader = [&](usz i) {
+        elf64_shdr shdr{};
+        std::memcpy(&shdr, contents.data() + hdr.e_shoff + i * sizeof(elf64_shdr), sizeof(elf64_shdr));
+        return shdr;
+    };
+    for (usz i = 0; i < hdr.e_shnum; ++i) {
+        auto shdr = SectionHeader(i);
+        if (shdr.sh_offset > contents.size() or shdr.sh_size > contents.size() - shdr.sh_offset) return {};
+    }
+    auto names = SectionHeader(hdr.e_shstrndx);
+    if (not names.sh_size or contents[names.sh_offset + names.sh_size - 1] != '\0') return {};
+    for (usz i = 0; i < hdr.e_shnum; ++i)
+        if (SectionHeader(i).sh_name >= names.sh_size) return {};
+
+    auto section = elf::get_section_from_blob(std::move(contents), metadata_section_name);
+    if (not HasMetadataMagic(section.contents())) return {};
+    return std::make_shared<const ModuleMetadata>(std::move(section.contents()));
+}
+} // namespace
+
+auto ModuleCache::stat(const fs::path& source) -> std::optional<SourceStat> {
+    std::error_code ec;
+    SourceStat stat{};
+    stat.size = fs::file_size(source, ec);
+    if (ec) return std::nullopt;
+    stat.mtime = ModificationTime(source, ec);
+    if (ec) return std::nullopt;
+    return stat;
+}
+
+auto ModuleCache::lookup(std::string_view name, const fs::path& source) const -> std::optional<MappedFile> {
+    auto entry = EntryPath(_directory, name, source);
+    auto stamp_path = fs::path{entry} += ".stamp";
+    auto stamp_file = MappedFile::Map(stamp_path);
+    if (not stamp_file or stamp_file->size() != sizeof(Stamp)) return std::nullopt;
+
+    Stamp stamp{};
+    std::memcpy(&stamp, stamp_file->data(), sizeof(Stamp));
+    if (not stamp.valid()) return std::nullopt;
+
+    std::error_code ec;
+    auto size = fs::file_size(source, ec);
+    if (ec or size != stamp.source_size) return std::nullopt;
+    auto mtime = ModificationTime(source, ec);
+    if (ec) return std::nullopt;
+
+    // The object file was touched; check whether it actually changed.
+    if (mtime != stamp.source_mtime) {
+        auto contents = MappedFile::Map(source);
+        if (not contents or Hash({contents->data(), contents->size()}) != stamp.source_hash)
+            return std::nullopt;
+
+        stamp.source_mtime = mtime;
+        (void) WriteAtomically(stamp_path, &stamp, sizeof(Stamp));
+    }
+
+    return MappedFile::Map(entry += ".gmeta");
+}
+
+void ModuleCache::store(
+    std::string_view name,
+    const fs::path& source,
+    SourceStat source_stat,
+    std::span<const char> source_contents,
+    std::span<const u8> metadata
+) const {
+    // The file changed while it was being read.
+    if (source_contents.size() != source_stat.size) return;
+
+    std::error_code ec;
+    fs::create_directories(_directory, ec);
+    if (ec) return;
+
+    Stamp stamp{};
+    stamp.source_size = source_stat.size;
+    stamp.source_mtime = source_stat.mtime;
+    stamp.source_hash = Hash({source_contents.data(), source_contents.size()});
+
+    // Write the entry before the stamp so that there is never a stamp
+    // without an entry.
+    auto entry = EntryPath(_directory, name, source);
+    if (not WriteAtomically(fs::path{entry} += ".gmeta", metadata.data(), metadata.size())) return;
+    (void) WriteAtomically(entry += ".stamp", &stamp, sizeof(Stamp));
+}
+
+auto ImportCache::get(
+    const fs::path& path,
+    const std::function<std::shared_ptr<const ModuleMetadata>()>& read
+) -> std::shared_ptr<const ModuleMetadata> {
+    // Stat the file before reading it, so that a change in between makes
+    // the entry stale rather than wrong.
+    auto stat = ModuleCache::stat(path);
+    if (not stat) return read();
+    Import import{stat->size, stat->mtime, {}};
+
+    auto key = Key(path);
+    auto& imports = GetImports();
+    {
+        std::unique_lock lock{imports.mutex};
+        auto it = imports.entries.find(key);
+        if (it != imports.entries.end() and it->second.size == import.size and it->second.mtime == import.mtime)
+            return it->second.metadata;
+    }
+
+    import.metadata = read();
+    if (not import.metadata) return {};
+
+    std::unique_lock lock{imports.mutex};
+    imports.stored_paths.push_back(key);
+    return imports.entries.insert_or_assign(std::move(key), std::move(import)).first->second.metadata;
+}
+
+auto ImportCache::take_stored_paths() -> std::vector<std::string> {
+    auto& imports = GetImports();
+    std::unique_lock lock{imports.mutex};
+    return std::exchange(imports.stored_paths, {});
+}
+
+auto ImportCache::warm(const fs::path& path) -> bool {
+    // As above, stat the file before reading it.
+    auto stat = ModuleCache::stat(path);
+    if (not stat) return false;
+    Import import{stat->size, stat->mtime, {}};
+    import.metadata = ReadMetadata(path);
+    if (not import.metadata) return false;
+
+    auto key = Key(path);
+    auto& imports = GetImports();
+    std::unique_lock lock{imports.mutex};
+    imports.entries.insert_or_assign(std::move(key), std::move(import));
+    return true;
+}
+} // namespace lcc::glint
@@ -1,4 +1,5 @@
 #include <lcc/diags.hh>
+#include <lcc/mem_report.hh>
 #include <lcc/target.hh>
 #include <lcc/utils.hh>
 #include <lcc/utils/macros.hh>
@@ -927,10 +928,10 @@ auto lcc::glint::Parser::ParseExpr(isz current_precedence, bool single_expressio
             case Tk::Dot: {
                 NextToken();
                 if (not At(Tk::Ident)) return Error("Expected identifier after .");
-                auto member = tok.text;
+                auto member = tok.symbol;
                 auto loc = tok.location;
                 NextToken();
-                lhs = new (*mod) MemberAccessExpr(*lhs, std::move(member), {lhs->location(), loc});
+                lhs = new (*mod) MemberAccessExpr(*lhs, member, {lhs->location(), loc});
                 continue;
             }
         }
@@ -1005,10 +1006,10 @@ auto lcc::glint::Parser::ParseExpr(isz current_precedence, bool single_expressio
             case Tk::Dot: {
                 NextToken();
                 if (not At(Tk::Ident)) return Error("Expected identifier after .");
-                auto member = tok.text;
+                auto member = tok.symbol;
                 auto loc = tok.location;
                 NextToken();
-                lhs = new (*mod) MemberAccessExpr(*lhs, std::move(member), {lhs->location(), loc});
+                lhs = new (*mod) MemberAccessExpr(*lhs, member, {lhs->location(), loc});
                 continue;
             }
         }
@@ -1200,12 +1201,13 @@ auto lcc::glint::Parser::ParseFuncSig(Type* return_type) -> Result<FuncType*> {
 auto lcc::glint::Parser::ParseIdentExpr() -> Result<Expr*> {
     auto loc = tok.location;
     auto text = tok.text;
+    auto symbol = tok.symbol;
     LCC_ASSERT(Consume(Tk::Ident), "ParseIdentExpr called while not at identifier");
 
     if (tok.from_macro) {
-        auto found = CurrScope()->find(text);
+        auto found = CurrScope()->lookup(symbol);
         if (not found.empty()) {
-            auto decl = found.at(0);
+            auto decl = found.front();
             auto err = Diag::Error(
                 context,
                 loc,
@@ -1223,7 +1225,7 @@ auto lcc::glint::Parser::ParseIdentExpr() -> Result<Expr*> {
     if (At(Tk::Colon, Tk::ColonColon)) return ParseDeclRest(std::move(text), loc, false);
 
     /// Otherwise, it’s just a name.
-    return new (*mod) NameRefExpr(std::move(text), CurrScope(), loc);
+    return new (*mod) NameRefExpr(symbol, CurrScope(), loc);
 }
 
 auto lcc::glint::Parser::ParseIfExpr() -> Result<IfExpr*> {
@@ -1298,6 +1300,8 @@ auto lcc::glint::Parser::ParsePreamble(File* f) -> Result<void> {
         module_name,
         module_kind
     );
+    if (auto* mem = context->mem_report())
+        mod->count_allocations_into(mem->counter(MemReport::Source::AST));
 
     while (+ConsumeExpressionSeparator(ExpressionSeparator::Hard))
         ;
@@ -1537,7 +1541,7 @@ auto lcc::glint::Parser::ParseType(isz current_precedence) -> Result<Type*> {
 
         /// Named type.
         case Tk::Ident:
-            ty = new (*mod) NamedType(tok.text, CurrScope(), tok.location);
+            ty = new (*mod) NamedType(tok.symbol, CurrScope(), tok.location);
             NextToken();
             break;
 
@@ -1772,6 +1776,7 @@ void lcc::glint::Parser::ParseTopLevel() {
         if (At(Tk::Eof)) break;
 
         /// Parse a top-level expression.
+        auto offset = tok.location.pos;
         auto expr = ParseExpr();
         if (not +ConsumeExpressionSeparator(ExpressionSeparator::Hard)) {
             if (At(Tk::Eof)) {
@@ -1810,9 +1815,10 @@ void lcc::glint::Parser::ParseTopLevel() {
                     .attach(Note("Before this"));
             }
         }
-        if (expr)
+        if (expr) {
             mod->add_top_level_expr(expr.value());
-        else {
+            mod->add_top_level_offset(expr.value(), offset);
+        } else {
             // If we failed to parse an expression at the top level, there was an error.
             context->set_error();
             // Jump past the next semicolon or closing brace in case of an error.
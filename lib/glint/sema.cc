@@ -1,10 +1,12 @@
 #include <lcc/context.hh>
 #include <lcc/utils.hh>
 #include <lcc/utils/macros.hh>
+#include <lcc/utils/parallel.hh>
 #include <object/elf.h>
 #include <object/elf.hh>
 
 #include <glint/ast.hh>
+#include <glint/module_cache.hh>
 #include <glint/module_description.hh>
 #include <glint/sema.hh>
 
@@ -12,6 +14,9 @@
 #include <filesystem>
 #include <functional>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_set>
@@ -641,11 +646,18 @@ void lcc::glint::Sema::Analyse(Context* ctx, Module& m, bool use_colours) {
     return s.AnalyseModule();
 }
 
+void lcc::glint::Sema::Analyse(Context* ctx, Module& m, const BodyHooks& hooks, bool use_colours) {
+    if (ctx->has_error()) return;
+    Sema s{ctx, m, use_colours};
+    s.body_hooks = &hooks;
+    return s.AnalyseModule();
+}
+
 auto lcc::glint::Sema::try_get_metadata_blob_from_object(
     const Module::Ref& import,
     const std::string& include_dir,
     std::vector<std::string>& paths_tried
-) -> bool {
+) -> std::shared_ptr<const ModuleMetadata> {
     auto path_base0 = include_dir + std::filesystem::path::preferred_separator + import.name;
     auto path_base1 = include_dir + std::filesystem::path::preferred_separator + "lib" + import.name;
     auto paths = {
@@ -660,61 +672,72 @@ auto lcc::glint::Sema::try_get_metadata_blob_from_object(
         paths_tried.push_back(p);
         if (std::filesystem::exists(p)) {
             fmt::print("Found IMPORT {} at {}\n", import.name, p);
-            // Open file, get contents
-            auto object_file = File::Read(p);
-            LCC_ASSERT(
-                not object_file.empty(),
-                "Found object file for module {} at {}, but the file is empty",
-                import.name,
-                p
-            );
-            // Determine file-type via magic bytes or extension
-            std::vector<u8> metadata_blob{};
-            if (
-                object_file.size() >= sizeof(elf64_header)
-                and object_file.at(0) == 0x7f and object_file.at(1) == 'E'
-                and object_file.at(2) == 'L' and object_file.at(3) == 'F'
-            ) {
-                auto section = elf::get_section_from_blob(
-                    object_file,
-                    metadata_section_name
+            // Other compilations in this process may have read it already.
+            return ImportCache::get(p, [&]() -> std::shared_ptr<const ModuleMetadata> {
+                // Reuse the metadata extracted from this object file by an
+                // earlier compilation, if it has not changed since.
+                std::optional<ModuleCache> cache{};
+                std::optional<ModuleCache::SourceStat> source_stat{};
+                if (not context->module_cache_directory().empty()) {
+                    cache.emplace(context->module_cache_directory());
+                    if (auto cached = cache->lookup(import.name, p))
+                        return std::make_shared<const ModuleMetadata>(std::move(*cached));
+                    source_stat = ModuleCache::stat(p);
+                }
+                // Open file, get contents
+                auto object_file = File::Read(p);
+                LCC_ASSERT(
+                    not object_file.empty(),
+                    "Found object file for module {} at {}, but the file is empty",
+                    import.name,
+                    p
                 );
-                metadata_blob = std::move(section.contents());
-            } else LCC_ASSERT(
-                false,
-                "Unrecognized file format of module {} at {}",
-                import.name,
-                p
-            );
-            // Very basic validation pass
-            LCC_ASSERT(
-                not metadata_blob.empty(),
-                "Didn't properly get metadata (it's empty) for module {} at {}",
-                import.name,
-                p
-            );
-            LCC_ASSERT(
-                metadata_blob.at(0) == ModuleDescription::default_version
-                    and metadata_blob.at(1) == ModuleDescription::magic_byte0
-                    and metadata_blob.at(2) == ModuleDescription::magic_byte1
-                    and metadata_blob.at(3) == ModuleDescription::magic_byte2,
-                "Metadata for module {} at {} has invalid magic bytes",
-                import.name,
-                p
-            );
-            // Deserialise metadata blob into a module
-            // FIXME: (this module? or a new module?)
-            return mod.deserialise(context, metadata_blob);
+                // Determine file-type via magic bytes or extension
+                std::vector<u8> metadata_blob{};
+                if (
+                    object_file.size() >= sizeof(elf64_header)
+                    and object_file.at(0) == 0x7f and object_file.at(1) == 'E'
+                    and object_file.at(2) == 'L' and object_file.at(3) == 'F'
+                ) {
+                    auto section = elf::get_section_from_blob(
+                        object_file,
+                        metadata_section_name
+                    );
+                    metadata_blob = std::move(section.contents());
+                } else LCC_ASSERT(
+                    false,
+                    "Unrecognized file format of module {} at {}",
+                    import.name,
+                    p
+                );
+                // Very basic validation pass
+                LCC_ASSERT(
+                    not metadata_blob.empty(),
+                    "Didn't properly get metadata (it's empty) for module {} at {}",
+                    import.name,
+                    p
+                );
+                LCC_ASSERT(
+                    metadata_blob.at(1) == ModuleDescription::magic_byte0
+                        and metadata_blob.at(2) == ModuleDescription::magic_byte1
+                        and metadata_blob.at(3) == ModuleDescription::magic_byte2,
+                    "Metadata for module {} at {} has invalid magic bytes",
+                    import.name,
+                    p
+                );
+                if (cache and source_stat) cache->store(import.name, p, *source_stat, object_file, metadata_blob);
+                return std::make_shared<const ModuleMetadata>(std::move(metadata_blob));
+            });
         }
     }
-    return false;
+    return {};
 }
 
 auto lcc::glint::Sema::try_get_metadata_blob_from_gmeta(
     const Module::Ref& import,
     const std::string& include_dir,
     std::vector<std::string>& paths_tried
-) -> bool {
+) -> std::shared_ptr<const ModuleMetadata> {
     auto path = include_dir
               + std::filesystem::path::preferred_separator
               + import.name + std::string(metadata_file_extension);
@@ -723,37 +746,37 @@ auto lcc::glint::Sema::try_get_metadata_blob_from_gmeta(
     if (std::filesystem::exists(path)) {
         fmt::print("Found IMPORT {} at {}\n", import.name, path);
 
-        // Open file, get contents
-        auto gmeta_file = File::Read(path);
-
-        std::vector<u8> metadata_blob{};
-        metadata_blob.insert(metadata_blob.end(), gmeta_file.begin(), gmeta_file.end());
-        LCC_ASSERT(
-            not metadata_blob.empty(),
-            "Found gmeta file for module {} at {}, but the file is empty",
-            import.name,
-            path
-        );
-        LCC_ASSERT(
-            metadata_blob.at(0) == ModuleDescription::default_version
-                and metadata_blob.at(1) == ModuleDescription::magic_byte0
-                and metadata_blob.at(2) == ModuleDescription::magic_byte1
-                and metadata_blob.at(3) == ModuleDescription::magic_byte2,
-            "Metadata for module {} at {} has invalid magic bytes",
-            import.name,
-            path
-        );
-        return mod.deserialise(context, metadata_blob);
+        return ImportCache::get(path, [&]() -> std::shared_ptr<const ModuleMetadata> {
+            // Map the file; declarations are read from it as they are used. This
+            // only fails for empty files (and things that aren't regular files).
+            auto gmeta_file = MappedFile::Map(path);
+            LCC_ASSERT(
+                gmeta_file and gmeta_file->size(),
+                "Found gmeta file for module {} at {}, but the file is empty",
+                import.name,
+                path
+            );
+            LCC_ASSERT(
+                gmeta_file->size() >= 4
+                    and u8(gmeta_file->data()[1]) == ModuleDescription::magic_byte0
+                    and u8(gmeta_file->data()[2]) == ModuleDescription::magic_byte1
+                    and u8(gmeta_file->data()[3]) == ModuleDescription::magic_byte2,
+                "Metadata for module {} at {} has invalid magic bytes",
+                import.name,
+                path
+            );
+            return std::make_shared<const ModuleMetadata>(std::move(*gmeta_file));
+        });
     }
 
-    return false;
+    return {};
 }
 
 auto lcc::glint::Sema::try_get_metadata_blob_from_assembly(
     const Module::Ref& import,
     const std::string& include_dir,
     std::vector<std::string>& paths_tried
-) -> bool {
+) -> std::shared_ptr<const ModuleMetadata> {
     auto path = include_dir
               + std::filesystem::path::preferred_separator
               + import.name + ".s";
@@ -765,23 +788,32 @@ auto lcc::glint::Sema::try_get_metadata_blob_from_assembly(
         // literals forming a stream of bytes.
         LCC_TODO("Parse Glint module metadata from assembly file (alternatively, provide a gmeta or object file)");
     }
-    return false;
+    return {};
 }
 
 void lcc::glint::Sema::AnalyseModule() {
-    // Load imported modules.
+    // Load imported modules. The metadata of each import is only located
+    // and read once per context, and shared with every other module that
+    // imports it.
     for (auto& import : mod.imports()) {
-        bool loaded{false};
+        std::shared_ptr<const ModuleMetadata> metadata{};
         std::vector<std::string> paths_tried{};
-
-        for (const auto& include_dir : context->include_directories()) {
-            loaded = try_get_metadata_blob_from_gmeta(import, include_dir, paths_tried)
-                  or try_get_metadata_blob_from_object(import, include_dir, paths_tried)
-                  or try_get_metadata_blob_from_assembly(import, include_dir, paths_tried);
-            if (loaded) break;
+        {
+            std::unique_lock lock{context->imported_modules_mutex};
+            auto& shared = context->imported_modules[import.name];
+            if (not shared) {
+                for (const auto& include_dir : context->include_directories()) {
+                    shared = try_get_metadata_blob_from_gmeta(import, include_dir, paths_tried);
+                    if (not shared) shared = try_get_metadata_blob_from_object(import, include_dir, paths_tried);
+                    if (not shared) shared = try_get_metadata_blob_from_assembly(import, include_dir, paths_tried);
+                    if (shared) break;
+                }
+            }
+            metadata = std::static_pointer_cast<const ModuleMetadata>(shared);
         }
 
-        if (not loaded) {
+        // Deserialise metadata blob into this module.
+        if (not metadata or not mod.deserialise(context, std::move(metadata))) {
             // TODO: Link/reference help documentation on how to point the compiler to
             // look in the proper place for Glint metadata, and how to produce it.
             Error(
@@ -808,15 +840,101 @@ void lcc::glint::Sema::AnalyseModule() {
     for (auto& func : mod.functions()) AnalyseFunctionSignature(func);
 
     /// Analyse function bodies.
-    for (auto& func : mod.functions()) AnalyseFunctionBody(func);
+    AnalyseFunctionBodies();
+}
+
+void lcc::glint::Sema::AnalyseFunctionBodies() {
+    /// Loading imported declarations adds the imported functions to the
+    /// module while we're at it. They have no bodies, so only look at the
+    /// functions that are there now, and by index.
+    auto& functions = mod.functions();
+    const usz count = functions.size();
+    std::vector<Diag::Buffer> diagnostics(count);
+    std::vector<u8> parameters_ok(count, true);
+    std::vector<std::unordered_set<Expr*>> freed(count);
+    std::vector<std::vector<NameRefExpr*>> references(count);
+    auto AnalyseBody = [&](usz i) {
+        if (body_hooks and not body_hooks->analyse(functions[i])) return;
+
+        /// Nothing this finds would be printed anymore.
+        if (Diag::Buffer::LimitReachedBefore(context, diagnostics, i)) return;
+        Diag::Buffer::Capture capture{diagnostics[i]};
+        Sema s{context, mod, _use_colours};
+        parameters_ok[i] = s.AnalyseFunctionBody(functions[i]);
+        functions[i]->set_body_analysed();
+        freed[i] = std::move(s.freed_globals);
+        references[i] = std::move(s.global_references);
+    };
+
+    /// Whether a function is nested in a function other than the
+    /// top-level function.
+    auto Nested = [](FuncDecl* func) {
+        if (not func->scope()) return false;
+        for (auto* scope = func->scope()->parent(); scope; scope = scope->parent())
+            if (scope->is_function()) return true;
+        return false;
+    };
+
+    /// The top-level function declares the global variables and types
+    /// that every other function may use, so it goes first.
+    std::vector<usz> independent{};
+    std::vector<usz> nested{};
+    for (usz i = 0; i < count; i++) {
+        if (functions[i] == mod.top_level_function()) AnalyseBody(i);
+        else if (Nested(functions[i])) nested.push_back(i);
+        else independent.push_back(i);
+    }
+
+    /// Looking up a name normally loads the imported declarations with
+    /// that name into the global scope; load all of them now instead so
+    /// that it doesn't change while several threads search it.
+    const usz jobs = std::min(ResolveJobCount(context->option_jobs()), independent.size());
+    if (jobs > 1) mod.load_all_imported_declarations();
+    ParallelFor(independent.size(), jobs, [&](usz i) {
+        std::optional<Module::ThreadAllocation> allocation{};
+        if (jobs > 1) allocation.emplace(mod);
+        AnalyseBody(independent[i]);
+    });
+
+    /// A nested function sees the declarations of the functions it is
+    /// nested in, so those must be done by now.
+    for (auto i : nested) AnalyseBody(i);
+
+    for (usz i = 0; i < count; i++)
+        if (not parameters_ok[i]) functions[i]->set_sema_errored();
+
+    /// Diagnose references to globals freed in an earlier function, as if
+    /// the functions had been analysed one after the other.
+    std::unordered_set<Expr*> freed_before{};
+    for (usz i = 0; i < count; i++) {
+        Diag::Buffer::Capture capture{diagnostics[i]};
+        for (auto* ref : references[i]) {
+            if (not freed_before.contains(ref->target())) continue;
+            Error(
+                ref->location(),
+                "Reference to a name, {}, that is no longer viable; probably a use-after-free thing",
+                ref->name()
+            );
+        }
+        freed_before.insert(freed[i].begin(), freed[i].end());
+    }
+
+    for (auto [i, buffer] : vws::enumerate(diagnostics)) {
+        if (body_hooks) body_hooks->finish(functions[usz(i)], buffer, not freed[usz(i)].empty());
+        buffer.flush();
+    }
 }
 
-void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
+auto lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) -> bool {
     tempset curr_func = decl;
     auto* ty = as<FuncType>(decl->type());
 
     /// If the function has no body, then we’re done.
-    if (not decl->body()) return;
+    if (not decl->body()) return true;
+
+    /// Other functions may be analysed at the same time and look at the
+    /// state of this one, so it is only marked as errored by the caller.
+    bool parameters_ok = true;
 
     /// Create variable declarations for the parameters.
     for (auto& param : ty->params()) {
@@ -844,8 +962,7 @@ void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
         LCC_ASSERT(decl->scope()->declare(context, auto(param.name), as<VarDecl>(d)).is_value());
         if (not Analyse(&d)) {
             // Continue to analyse the rest of the parameters
-            if (not decl->sema_errored())
-                decl->set_sema_errored();
+            parameters_ok = false;
         }
         decl->param_decls().push_back(as<VarDecl>(d));
     }
@@ -860,7 +977,7 @@ void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
     // full of uses of the parameters, and those will all cause a whole bunch
     // of errors that won't be relevant once the programmer fixes the error in
     // the parameter declaration(s).
-    if (not decl->ok()) return;
+    if (not parameters_ok or not decl->ok()) return parameters_ok;
 
     /// Analyse the body.
     (void) Analyse(&decl->body(), ty->return_type());
@@ -901,7 +1018,7 @@ void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
                     "No expression in body of function {}",
                     decl->name()
                 );
-                return;
+                return true;
             }
             auto* inserted_return_value = new (mod) IntegerLiteral(0, {});
             decl->body() = new (mod) ReturnExpr(inserted_return_value, {});
@@ -914,7 +1031,7 @@ void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
                 TryConvert(&ret->value(), ty->return_type()) == 0,
                 "Last expression may be a return expression, sure, but the expression it's returning is not convertible to the return type!"
             );
-            return;
+            return true;
         }
 
         // If the last expression is not a return expression and the type of the
@@ -926,7 +1043,7 @@ void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
             if (is<BlockExpr>(decl->body()))
                 *last = new (mod) ReturnExpr(*last, {});
             else decl->body() = new (mod) ReturnExpr(*last, {});
-            return;
+            return true;
         }
         // Otherwise, if the last expression is not a return expression and the
         // type of that last expression is not convertible to the return type of
@@ -940,7 +1057,7 @@ void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
                 (*last)->type(),
                 ty->return_type()
             );
-            return;
+            return true;
         }
 
         // insert "return 0;"
@@ -966,6 +1083,8 @@ void lcc::glint::Sema::AnalyseFunctionBody(FuncDecl* decl) {
 
         Discard(&decl->body());
     }
+
+    return true;
 }
 
 void lcc::glint::Sema::AnalyseFunctionSignature(FuncDecl* decl) {
@@ -1281,7 +1400,7 @@ auto lcc::glint::Sema::Analyse(Expr** expr_ptr, Type* expected_type) -> bool {
 
                     auto* member_access = new (mod) MemberAccessExpr(
                         v,
-                        member.name,
+                        s->members().at(member_index).symbol,
                         v->location()
                     );
                     member_access->finalise(s->struct_type(), member_index);
@@ -1503,7 +1622,7 @@ auto lcc::glint::Sema::Analyse(Expr** expr_ptr, Type* expected_type) -> bool {
                 auto* referenced_module = module_expr->mod();
                 auto* scope = referenced_module->global_scope();
                 // Replace member access with a name ref
-                *expr_ptr = new (mod) NameRefExpr(m->name(), scope, m->location());
+                *expr_ptr = new (mod) NameRefExpr(m->symbol(), scope, m->location());
                 AnalyseNameRef(as<NameRefExpr>(*expr_ptr));
                 break;
             }
@@ -1567,7 +1686,7 @@ auto lcc::glint::Sema::Analyse(Expr** expr_ptr, Type* expected_type) -> bool {
                 auto& members = union_type->members();
                 auto it = rgs::find_if(
                     members,
-                    [&](auto& member) { return member.name == m->name(); }
+                    [&](auto& member) { return member.symbol == m->symbol(); }
                 );
                 if (it == members.end()) {
                     Error(m->location(), "Union {} has no member named '{}'", union_type, m->name());
@@ -1584,7 +1703,7 @@ auto lcc::glint::Sema::Analyse(Expr** expr_ptr, Type* expected_type) -> bool {
             // Access to sum type member
             if (auto* sum_type = cast<SumType>(stripped_object_type)) {
                 auto& members = sum_type->members();
-                auto it = rgs::find_if(members, [&](auto& member) { return member.name == m->name(); });
+                auto it = rgs::find(members, m->symbol(), &SumType::Member::symbol);
                 if (it == members.end()) {
                     Error(m->location(), "Sum type {} has no member named '{}'", sum_type, m->name());
                     m->set_sema_errored();
@@ -1662,7 +1781,7 @@ auto lcc::glint::Sema::Analyse(Expr** expr_ptr, Type* expected_type) -> bool {
 
             /// The struct type must contain the member.
             auto& members = struct_type->members();
-            auto it = rgs::find_if(members, [&](auto& member) { return member.name == m->name(); });
+            auto it = rgs::find(members, m->symbol(), &StructType::Member::symbol);
             if (it == members.end()) {
                 Error(m->location(), "Struct {} has no member named '{}'", struct_type, m->name());
                 m->set_sema_errored();
@@ -1801,6 +1920,31 @@ void lcc::glint::Sema::AnalyseBinary(Expr** expr_ptr, BinaryExpr* b) {
             break;
 
         case TokenKind::PlusEq:
+            // Appending to a dynamic array; IRGen handles this itself.
+            if (auto* dynamic_array = cast<DynamicArrayType>(b->lhs()->type()->strip_references())) {
+                LValueToRValue(&b->rhs());
+                (void) ImplicitDe_Reference(&b->lhs());
+                if (not b->lhs()->is_lvalue()) {
+                    Error(b->location(), "LHS of append must be an lvalue");
+                    b->set_sema_errored();
+                    return;
+                }
+
+                // Like assignment, appending yields the lvalue appended to.
+                b->type(lhs_t);
+                b->set_lvalue();
+
+                if (not Convert(&b->rhs(), dynamic_array->element_type())) {
+                    Error(
+                        b->rhs()->location(),
+                        "Type of expression {} is not convertible to element type {} of dynamic array",
+                        rhs_t,
+                        dynamic_array->element_type()
+                    );
+                }
+                break;
+            }
+
             *expr_ptr = new (mod) BinaryExpr(
                 TokenKind::ColonEq,
                 b->lhs(),
@@ -2237,6 +2381,226 @@ void lcc::glint::Sema::AnalyseBinary(Expr** expr_ptr, BinaryExpr* b) {
 #undef rhs_t
 }
 
+namespace {
+/// Get a key for a call to an overloaded function that identifies the
+/// result of overload resolution, or nothing if that result depends on
+/// more than the types and value categories of the arguments.
+auto OverloadResolutionKey(
+    lcc::Context* context,
+    std::span<lcc::glint::FuncDecl* const> overloads,
+    const std::vector<lcc::glint::Expr*>& args
+) -> std::optional<std::vector<lcc::uptr>> {
+    std::vector<lcc::uptr> key{};
+    key.reserve(1 + 2 * args.size());
+    key.push_back(lcc::uptr(overloads.data()));
+    for (auto* arg : args) {
+        auto* ty = arg->type();
+
+        // Whether an integer converts to a smaller type depends on its value,
+        // if it is known at compile time.
+        lcc::glint::EvalResult res;
+        if (ty->is_integer() and arg->evaluate(context, res, false)) return std::nullopt;
+
+        // Functions may be converted into a call to them, which depends on
+        // the expression.
+        if (ty->is_function() or (ty->is_pointer() and ty->elem()->is_function())) return std::nullopt;
+
+        key.push_back(lcc::uptr(ty));
+        key.push_back(arg->is_lvalue());
+    }
+    return key;
+}
+} // namespace
+
+auto lcc::glint::Sema::ResolveOverload(CallExpr* expr, std::span<FuncDecl* const> overloads) -> FuncDecl* {
+    // *** 0
+    //
+    // Skip anything that is not a function reference, or any function
+    // references previously resolved.
+
+    // *** 1
+    //
+    // Collect all functions with the same name as the function being
+    // resolved into an *overload set* O. We cannot filter out any
+    // functions just yet.
+    //
+    // If the overload set size is zero, it is an error (no function may be resolved).
+    //
+    // It is advisable to ensure any invariants you require across function
+    // overloads, given the semantics of the language. For example, in
+    // Intercept, all overloads of a function must have the same return type.
+
+    // *** 2
+    //
+    // If the parent expression is a call expression, and the function being
+    // resolved is the callee of the call, then:
+
+    // **** 2a
+    //
+    // Typecheck all arguments of the call that are not unresolved function
+    // references themselves. Note: This takes care of resolving nested calls.
+
+    // **** 2b
+    //
+    // Remove from O all functions that have a different number of
+    // parameters than the call expression has arguments.
+    std::vector<FuncDecl*> O{};
+    for (auto* f : overloads)
+        if (f->param_types().size() == expr->args().size())
+            O.push_back(f);
+
+    // **** 2c
+    //
+    // Let A_1, ... A_n be the arguments of the call expression.
+    //
+    // For candidate C in O, let P_1, ... P_n be the parameters of C. For each
+    // argument A_i of the call, iff it is not an unresolved function, check
+    // if it is convertible to P_i. Remove C from O if it is not. Note down
+    // the number of A_i’s that required a (series of) implicit conversions to
+    // their corresponding P_i’s. Also collect unresolved function references.
+    std::erase_if(O, [&](FuncDecl* C) {
+        auto P = C->param_types();
+        for (usz i = 0; i < expr->args().size(); i++) {
+            // TODO: Record score to choose lowest if multiple in overload set at the
+            // end. Currently approximated via type equal check.
+            if (TryConvert(&expr->args()[i], P[isz(i)]) < 0)
+                return true;
+        }
+        return false;
+    });
+
+    // **** 2e
+    //
+    // If there are unresolved function references:
+
+    // ***** 2eα
+    //
+    // Collect their overload sets.
+
+    // ***** 2eβ
+    // Remove from O all candidates C that do no accept any overload of this
+    // argument as a parameter.
+
+    // ***** 2eγ
+    //
+    // Remove from O all functions except those with the least number of
+    // implicit conversions as per step 2d.
+
+    // ***** 2eδ
+    //
+    // Resolve the function being resolved.
+
+    // ***** 2eε
+    //
+    // For each argument, remove from its overload set all candidates that are
+    // not equivalent to the type of the corresponding parameter of the
+    // resolved function.
+
+    // ***** 2eζ
+    //
+    // Resolve the argument.
+
+    // **** 2f
+    //
+    // Remove from O all functions except those with the least number of
+    // implicit conversions as per step 2d.
+
+    // *** 3
+    //
+    // Otherwise, depending on the type of the parent expression:
+
+    // **** 3a
+    //
+    // If the parent expression is a unary prefix expression with operator
+    // address-of, then replace the parent expression with the unresolved
+    // function and go to step 2/3 depending on the type of the new parent.
+
+    // **** 3b
+    //
+    // If the parent expression is a declaration, and the lvalue is not of
+    // function pointer type, this is a type error. Otherwise, remove from O
+    // all functions that are not equivalent to the lvalue being assigned to.
+
+    // **** 3c
+    //
+    // If the parent expression is an assignment expression, then if we are
+    // the LHS, then this is a type error, as we cannot assign to a function
+    // reference.
+    //
+    // If the lvalue is not of function pointer type, this is a type error.
+    //
+    // Otherwise, remove from O all functions that are not equivalent to the lvalue being assigned to.
+
+    // **** 3d
+    //
+    // If the parent expression is a return expression, and the return type of
+    // the function F containing that return expression is not of function
+    // pointer type, this is a type error. Otherwise, remove from O all
+    // functions that are not equivalent to the return type of F.
+
+    // **** 3e
+    //
+    // If the parent expression is a cast expression, and the result type of
+    // the cast is a function or function pointer type, remove from O all
+    // functions that are not equivalent to that type.
+
+    // **** 3f
+    //
+    // Otherwise, do nothing.
+
+    // FIXME: See step 2c for more info.
+    // This is a last hail-mary attempt to narrow down an overload set not
+    // just to convertible arguments, but to ones that are exactly equal.
+    // But don't remove all of them!
+    if (O.size() > 1) {
+        auto Inexact = [&](FuncDecl* C) {
+            auto P = C->param_types();
+            for (usz i = 0; i < expr->args().size(); i++)
+                if (not Type::Equal(expr->args()[i]->type(), P[isz(i)]))
+                    return true;
+            return false;
+        };
+
+        if (not rgs::all_of(O, Inexact)) std::erase_if(O, Inexact);
+    }
+
+    // *** 4
+    //
+    // Resolve the function reference.
+    //
+    // For the most part, entails finding the one function that is still
+    // marked viable in the overload set.
+    if (O.size() == 1) return O.front();
+
+    if (O.empty()) {
+        Error(
+            expr->location(),
+            "Given arguments didn't match any of the possible candidates in the overload set"
+        );
+    } else {
+        Error(
+            expr->location(),
+            "Unresolved function overload: ambiguous, here are the possible candidates"
+        );
+    }
+
+    for (auto* C : overloads) {
+        if (C->param_types().size() != expr->args().size()) {
+            Note(
+                C->location(),
+                "Candidate {} removed because parameter count doesn't match given arguments: {} vs {}",
+                C->type(),
+                C->param_types().size(),
+                expr->args().size()
+            );
+        } else {
+            Note(C->location(), "Candidate defined here");
+        }
+    }
+
+    return nullptr;
+}
+
 void lcc::glint::Sema::AnalyseCall(Expr** expr_ptr, CallExpr* expr) {
     /// If the callee is a name ref, check for builtins first.
     if (auto* name = cast<NameRefExpr>(expr->callee())) {
@@ -2285,242 +2649,29 @@ void lcc::glint::Sema::AnalyseCall(Expr** expr_ptr, CallExpr* expr) {
             return;
         }
 
-        std::vector<FuncDecl*> O;
+        std::span<FuncDecl* const> overloads;
         if (is<OverloadSet>(expr->callee())) {
-            O = as<OverloadSet>(expr->callee())->overloads();
+            overloads = as<OverloadSet>(expr->callee())->overloads();
         } else if (expr->callee()->type()->is_overload_set()) {
             LCC_ASSERT(is<NameRefExpr>(expr->callee()));
 
             auto* set = as<NameRefExpr>(expr->callee())->target();
             LCC_ASSERT(is<OverloadSet>(set));
 
-            O = as<OverloadSet>(set)->overloads();
-        }
-        std::vector<FuncDecl*> O_unchanged = O;
-
-        // *** 0
-        //
-        // Skip anything that is not a function reference, or any function
-        // references previously resolved.
-
-        // *** 1
-        //
-        // Collect all functions with the same name as the function being
-        // resolved into an *overload set* O. We cannot filter out any
-        // functions just yet.
-        //
-        // If the overload set size is zero, it is an error (no function may be resolved).
-        //
-        // It is advisable to ensure any invariants you require across function
-        // overloads, given the semantics of the language. For example, in
-        // Intercept, all overloads of a function must have the same return type.
-
-        // *** 2
-        //
-        // If the parent expression is a call expression, and the function being
-        // resolved is the callee of the call, then:
-
-        // **** 2a
-        //
-        // Typecheck all arguments of the call that are not unresolved function
-        // references themselves. Note: This takes care of resolving nested calls.
-
-        // **** 2b
-        //
-        // Remove from O all functions that have a different number of
-        // parameters than the call expression has arguments.
-        std::vector<FuncDecl*> invalid{};
-        for (auto* f : O) {
-            if (f->param_types().size() != expr->args().size()) {
-                Note(
-                    f->location(),
-                    "Candidate {} removed because parameter count doesn't match given arguments: {} vs {}",
-                    f->type(),
-                    f->param_types().size(),
-                    expr->args().size()
-                );
-                invalid.emplace_back(f);
-            }
-        }
-        for (auto* f : invalid) std::erase(O, f);
-        invalid.clear();
-
-        // **** 2c
-        //
-        // Let A_1, ... A_n be the arguments of the call expression.
-        //
-        // For candidate C in O, let P_1, ... P_n be the parameters of C. For each
-        // argument A_i of the call, iff it is not an unresolved function, check
-        // if it is convertible to P_i. Remove C from O if it is not. Note down
-        // the number of A_i’s that required a (series of) implicit conversions to
-        // their corresponding P_i’s. Also collect unresolved function references.
-
-        // For candidate C in O,
-        for (auto* C : O) {
-            // let P_... be the parameters of C.
-            for (auto* P : C->param_types()) {
-                // For each argument A_i,
-                for (auto*& A : expr->args()) {
-                    // check if it is convertible to P_i.
-                    auto conversion_score = TryConvert(&A, P);
-                    // TODO: Record score to choose lowest if multiple in overload set at the
-                    // end. Currently approximated via type equal check.
-                    if (conversion_score < 0) {
-                        // Note(
-                        //     A->location(),
-                        //     "Argument type {} is not convertible to parameter type {}\n",
-                        //     A->type(),
-                        //     P
-                        // );
-
-                        // Remove C from O if it is not.
-                        invalid.emplace_back(C);
-                    }
-                }
-            }
+            overloads = as<OverloadSet>(set)->overloads();
         }
-        for (auto* f : invalid) std::erase(O, f);
-        invalid.clear();
-
-        // **** 2e
-        //
-        // If there are unresolved function references:
-
-        // ***** 2eα
-        //
-        // Collect their overload sets.
-
-        // ***** 2eβ
-        // Remove from O all candidates C that do no accept any overload of this
-        // argument as a parameter.
-
-        // ***** 2eγ
-        //
-        // Remove from O all functions except those with the least number of
-        // implicit conversions as per step 2d.
-
-        // ***** 2eδ
-        //
-        // Resolve the function being resolved.
-
-        // ***** 2eε
-        //
-        // For each argument, remove from its overload set all candidates that are
-        // not equivalent to the type of the corresponding parameter of the
-        // resolved function.
-
-        // ***** 2eζ
-        //
-        // Resolve the argument.
-
-        // **** 2f
-        //
-        // Remove from O all functions except those with the least number of
-        // implicit conversions as per step 2d.
-
-        // *** 3
-        //
-        // Otherwise, depending on the type of the parent expression:
-
-        // **** 3a
-        //
-        // If the parent expression is a unary prefix expression with operator
-        // address-of, then replace the parent expression with the unresolved
-        // function and go to step 2/3 depending on the type of the new parent.
-
-        // **** 3b
-        //
-        // If the parent expression is a declaration, and the lvalue is not of
-        // function pointer type, this is a type error. Otherwise, remove from O
-        // all functions that are not equivalent to the lvalue being assigned to.
-
-        // **** 3c
-        //
-        // If the parent expression is an assignment expression, then if we are
-        // the LHS, then this is a type error, as we cannot assign to a function
-        // reference.
-        //
-        // If the lvalue is not of function pointer type, this is a type error.
-        //
-        // Otherwise, remove from O all functions that are not equivalent to the lvalue being assigned to.
-
-        // **** 3d
-        //
-        // If the parent expression is a return expression, and the return type of
-        // the function F containing that return expression is not of function
-        // pointer type, this is a type error. Otherwise, remove from O all
-        // functions that are not equivalent to the return type of F.
-
-        // **** 3e
-        //
-        // If the parent expression is a cast expression, and the result type of
-        // the cast is a function or function pointer type, remove from O all
-        // functions that are not equivalent to that type.
-
-        // **** 3f
-        //
-        // Otherwise, do nothing.
-
-        // FIXME: See step 2c for more info.
-        // This is a last hail-mary attempt to narrow down an overload set not
-        // just to convertible arguments, but to ones that are exactly equal.
-        // But don't remove all of them!
-        if (O.size() > 1) {
-            for (auto* C : O) {
-                for (auto* P : C->param_types()) {
-                    for (auto* A : expr->args()) {
-                        if (not Type::Equal(A->type(), P)) {
-                            // Note(
-                            //     A->location(),
-                            //     "Argument type {} is not equal to parameter type {}\n",
-                            //     A->type(),
-                            //     P
-                            // );
-
-                            // Remove C from O if it is not.
-                            invalid.emplace_back(C);
-                        }
-                    }
-                }
-            }
-            // Only remove if we won't be removing all of them.
-            if (invalid.size() != O.size())
-                for (auto* f : invalid) std::erase(O, f);
-            invalid.clear();
-        }
-
-        // *** 4
-        //
-        // Resolve the function reference.
-        //
-        // For the most part, entails finding the one function that is still
-        // marked viable in the overload set.
 
-        if (not invalid.empty()) {
-            Diag::ICE("Overload resolution has leftover invalid. This usually means the developer has forgotten to remove them from the overload set, so make sure that is happening and then clear the invalid list.");
-            LCC_UNREACHABLE();
+        // Calls to the same overload set with the same kinds of arguments
+        // always resolve to the same function.
+        auto key = OverloadResolutionKey(context, overloads, expr->args());
+        auto* callee = key ? mod.resolved_overload(*key) : nullptr;
+        if (not callee) {
+            callee = ResolveOverload(expr, overloads);
+            if (not callee) return;
+            if (key) mod.resolved_overload(std::move(*key), callee);
         }
 
-        if (O.size() != 1) {
-            if (O.empty()) {
-                Error(
-                    expr->location(),
-                    "Given arguments didn't match any of the possible candidates in the overload set"
-                );
-            } else {
-                Error(
-                    expr->location(),
-                    "Unresolved function overload: ambiguous, here are the possible candidates"
-                );
-            }
-
-            for (auto* C : O_unchanged)
-                Note(C->location(), "Candidate defined here");
-
-            return;
-        }
-
-        expr->callee() = O.at(0);
+        expr->callee() = callee;
     }
 
     // If the callee is a type expression, this is a type instantiation.
@@ -2941,65 +3092,12 @@ void lcc::glint::Sema::AnalyseIntrinsicCall(Expr** expr_ptr, IntrinsicCallExpr*
     }
 }
 
-auto optimal_string_alignment_distance(
-    std::string_view s,
-    std::string_view t
-)
-    -> size_t {
-    auto m = s.size();
-    auto n = t.size();
-    // Allocate 2d array
-    // d :: [uint (m + 1) * (n + 1)]; <- equivalent in Glint
-    size_t* d = (decltype(d))
-        calloc(
-            (m + 1) * (n + 1),
-            sizeof(typeof(*d))
-        );
-
-    auto ref = [d, n](size_t i, size_t j) -> size_t& {
-        return d[(i * n) + j];
-    };
-
-    for (size_t i = 0; i <= m; ++i) ref(i, 0) = i;
-    for (size_t j = 0; j <= n; ++j) ref(0, j) = j;
-
-    for (size_t j = 1; j <= n; ++j) {
-        auto j_i = j - 1;
-        for (size_t i = 1; i <= m; ++i) {
-            auto i_i = i - 1;
-            // SUBSTITUTION CHECK
-            size_t cost{0};
-            if (s.at(i_i) != t.at(j_i))
-                cost = 1;
-
-            ref(i, j) = std::min(
-                {ref(i - 1, j) + 1,
-                 ref(i, j - 1) + 1,
-                 ref(i - 1, j - 1) + cost}
-            );
-
-            // TRANSPOSITION CHECK
-            // abcd and acbd are very likely closer in distance, so we do that.
-            if (i > 1 and j > 1
-                and s.at(i_i) == t.at(j_i - 1)
-                and s.at(i_i - 1) == t.at(j_i)) {
-                ref(i, j) = std::min(
-                    {ref(i, j),
-                     ref(i - 2, j - 2) + 1}
-                );
-            }
-        }
-    }
-    size_t out = ref(m, n);
-    free(d);
-    return out;
-}
-
 void lcc::glint::Sema::AnalyseNameRef(NameRefExpr* expr) {
     // Look up the thing in its scope, if there is no definition of the symbol
     // in its scope, search its parent scopes until we find one.
     auto* scope = expr->scope();
-    std::vector<Decl*> syms = expr->scope()->find_recursive(expr->name());
+    mod.load_imported_declarations(expr->symbol());
+    auto syms = expr->scope()->lookup_recursive(expr->symbol());
 
     // If we’re at the global scope and there still is no symbol, then this
     // symbol is apparently not declared.
@@ -3019,21 +3117,18 @@ void lcc::glint::Sema::AnalyseNameRef(NameRefExpr* expr) {
         // of an existing declaration to what they typed.
         // NOTE: The more similar two strings are, the more their distances
         // approach zero.
-        Decl* least_distance_decl = nullptr;
-        size_t least_distance{size_t(-1)};
-        for (auto* decl : scope->all_symbols_recursive()) {
-            auto distance = optimal_string_alignment_distance(expr->name(), decl->name());
-            LCC_ASSERT(
-                distance,
-                "If distance from '{}' to '{}' was zero, then symbol would have been found. Likely error in distance calculation.\n",
-                expr->name(),
-                decl->name()
-            );
-            if (distance < least_distance) {
-                least_distance_decl = decl;
-                least_distance = distance;
-            }
-        }
+        // Anything more than a third of the name away from it is too different
+        // to be a typo, and not looking any further than that is what keeps
+        // this fast in scopes with lots of declarations.
+        mod.load_all_imported_declarations();
+        auto max_distance = std::max(expr->name().size() / 3, usz(2));
+        auto [least_distance_decl, least_distance] = scope->closest_symbol_recursive(expr->name(), max_distance);
+        LCC_ASSERT(
+            not least_distance_decl or least_distance,
+            "If distance from '{}' to '{}' was zero, then symbol would have been found. Likely error in distance calculation.\n",
+            expr->name(),
+            least_distance_decl->name()
+        );
         // ¡AUTO-SPELLCHECK!
         // For identifiers that are unknown yet so, so close to an existing, valid
         // declaration, we just treat them like they were spelled right,
@@ -3068,10 +3163,10 @@ void lcc::glint::Sema::AnalyseNameRef(NameRefExpr* expr) {
 
         // If there is a declaration of this variable in the top-level scope, tell
         // the user that they may have forgotten to make it static.
-        auto top_level = mod.top_level_scope()->find(expr->name());
+        auto top_level = mod.top_level_scope()->lookup(expr->symbol());
         if (not top_level.empty()) {
             err.attach(Note(
-                top_level.at(0)->location(),
+                top_level.front()->location(),
                 "A declaration exists at the top-level. Did you mean to make it 'static'?"
             ));
         }
@@ -3106,23 +3201,28 @@ void lcc::glint::Sema::AnalyseNameRef(NameRefExpr* expr) {
     // Either there is exactly one node that is not a function, or, there may
     // be one or more nodes with that name that are functions. In the case of
     // a non-function node, resolve to that node.
-    if (not is<FuncDecl>(syms.at(0))) {
+    if (not is<FuncDecl>(syms.front())) {
         // Make a copy of the pointer so we don't accidentally overwrite the
         // declaration's pointer in the following analysation.
-        Expr* e = syms.at(0);
+        Decl* decl = syms.front();
+        Expr* e = decl;
         (void) Analyse(&e);
-        // FIXME: What in the fuck is this for? The assert would mean we wouldn't
-        // need the following line and the line following means we wouldn't need
-        // the assert. A fucking idiot wrote this, clearly.
-        LCC_ASSERT(syms.at(0) == e);
-        syms.at(0) = as<Decl>(e);
+        LCC_ASSERT(decl == e, "Analysing a declaration must not replace it");
 
-        if (e->sema() == SemaNode::State::NoLongerViable) {
+        if (e->sema() == SemaNode::State::NoLongerViable or freed_globals.contains(decl)) {
             Error(
                 expr->location(),
                 "Reference to a name, {}, that is no longer viable; probably a use-after-free thing",
                 expr->name()
             );
+        } else if (
+            auto* object = cast<ObjectDecl>(decl);
+            curr_func != mod.top_level_function()
+            and object
+            and object->linkage() != Linkage::LocalVar
+            and decl->type()->is_dynamic_array()
+        ) {
+            global_references.push_back(expr);
         }
 
         // If sema is in progress for the declaration, and there is a name ref we
@@ -3139,26 +3239,23 @@ void lcc::glint::Sema::AnalyseNameRef(NameRefExpr* expr) {
             return;
         }
 
-        expr->target(syms.at(0));
-        expr->type(syms.at(0)->type());
-        if (syms.at(0)->is_lvalue()) expr->set_lvalue();
+        expr->target(decl);
+        expr->type(decl->type());
+        if (decl->is_lvalue()) expr->set_lvalue();
         return;
     }
 
-    // In the other case, collect all functions with that name and create an
-    // overload set for them.
-    std::vector<FuncDecl*> overloads{};
-    overloads.reserve(syms.size());
-    for (auto& sym : syms)
-        overloads.emplace_back(as<FuncDecl>(sym));
-
     // If there is only one function, resolve it directly to that function.
-    if (overloads.size() == 1) {
-        expr->target(overloads[0]);
-        expr->type(overloads[0]->type());
+    if (std::next(syms.begin()) == syms.end()) {
+        auto* func = as<FuncDecl>(syms.front());
+        expr->target(func);
+        expr->type(func->type());
         return;
     }
 
+    // In the other case, all functions with that name form an overload set.
+    auto overloads = mod.overload_set(expr->scope()->scope_of(expr->symbol()), expr->symbol());
+
     // Create a new overload set and analyse it. This will make sure there are
     // no redeclarations etc.
     Expr* overload_set = new (mod) OverloadSet(overloads, expr->location());
@@ -3225,7 +3322,17 @@ void lcc::glint::Sema::AnalyseUnary(Expr** expr_ptr, UnaryExpr* u) {
 
                 // NOTE: If referenced again, will cause a used-but-no-longer-viable
                 // diagnostic (catches use-after-free).
-                target->set_sema_no_longer_viable();
+                //
+                // Global variables are only marked by the top-level function:
+                // other functions may be analysed at the same time, in any
+                // order, so they only record what they freed, for
+                // AnalyseFunctionBodies() to check once they're all done.
+                auto* object = cast<ObjectDecl>(target);
+                if (
+                    curr_func == mod.top_level_function()
+                    or (object and object->linkage() == Linkage::LocalVar)
+                ) target->set_sema_no_longer_viable();
+                else freed_globals.insert(target);
 
                 // NOTE: For forget-to-free diagnostics.
                 std::erase(curr_func->dangling_dynarrays(), target);
@@ -3463,35 +3570,28 @@ auto lcc::glint::Sema::Analyse(Type** type_ptr) -> bool {
 
             // This code is similar to name resolution for expressions,
             // except that we don’t need to worry about overloads.
+            mod.load_imported_declarations(n->symbol());
             Type* ty{};
-            for (auto* scope = n->scope(); scope; scope = scope->parent()) {
-                auto syms = scope->find(n->name());
-                // If we don't find the symbol in this scope, continue searching the
-                // parent scope.
-                if (syms.empty()) continue;
-                if (auto* s = cast<TypeDecl>(syms.at(0))) {
+            auto syms = n->scope()->lookup_recursive(n->symbol());
+            if (not syms.empty()) {
+                if (auto* s = cast<TypeDecl>(syms.front())) {
                     Expr* e = s;
                     (void) Analyse(&e);
                     ty = s->type();
-                    break;
-                }
-
-                if (auto* a = cast<TypeAliasDecl>(syms.at(0))) {
+                } else if (auto* a = cast<TypeAliasDecl>(syms.front())) {
                     Expr* e = a;
                     (void) Analyse(&e);
                     ty = a->type();
-                    break;
+                } else {
+                    Error(n->location(), "'{}' is not a type", n->name())
+                        .attach(Note(
+                            syms.front()->location(),
+                            "Because of declaration here",
+                            n->name()
+                        ));
+
+                    n->set_sema_errored();
                 }
-
-                Error(n->location(), "'{}' is not a type", n->name())
-                    .attach(Note(
-                        syms.at(0)->location(),
-                        "Because of declaration here",
-                        n->name()
-                    ));
-
-                n->set_sema_errored();
-                break;
             }
 
             if (not ty) {
@@ -3567,6 +3667,12 @@ auto lcc::glint::Sema::Analyse(Type** type_ptr) -> bool {
                     a->set_sema_errored();
                 }
             }
+
+            // Compute the layout now rather than every time it is needed, unless
+            // the element type is still being analysed, e.g. if it is a struct
+            // that contains a pointer to an array of itself.
+            if (not a->sema_errored() and elem->sema_done_or_errored())
+                a->layout(size * elem->size(context), elem->align(context));
         } break;
 
         // Apply decltype decay to the element type, prohibit arrays of
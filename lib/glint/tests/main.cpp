@@ -6,6 +6,7 @@
 #include <lcc/ir/module.hh>
 #include <lcc/target.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/parallel.hh>
 
 #include <glint/ast.hh>
 #include <glint/ir_gen.hh>
@@ -13,10 +14,12 @@
 #include <glint/sema.hh>
 
 #include <algorithm>
+#include <charconv>
 #include <filesystem>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 static lcc::utils::Colours C{true};
 using lcc::utils::Colour;
@@ -83,7 +86,7 @@ struct GlintTest : langtest::Test {
                 // decorated as expected to fail.
 
                 auto* root = mod->top_level_function()->body();
-                ast_matches = perform_match<lcc::glint::Expr>(root, matcher);
+                ast_matches = perform_match<lcc::glint::Expr>(*this, root, matcher);
 
                 if (not ir.empty()) {
                     // Parse expected IRGen IR
@@ -103,11 +106,11 @@ struct GlintTest : langtest::Test {
                             if (not got_func_in_ir) {
                                 ir_matches = false;
 
-                                fmt::print(
+                                print(
                                     "IR MISMATCH: Expected function {} to be in IR, but didn't find it\n",
                                     expected_func->names().at(0).name
                                 );
-                                got_ir->print_ir(true);
+                                print("{}", got_ir->ir_string(true));
 
                                 // Stop iterating IR functions since they already don't match.
                                 break;
@@ -121,7 +124,7 @@ struct GlintTest : langtest::Test {
                             if (expected_func->blocks().size() != got_func->blocks().size()) {
                                 ir_matches = false;
 
-                                fmt::print(
+                                print(
                                     "IR MISMATCH: Block count in function {}\n",
                                     expected_func->names().at(0).name
                                 );
@@ -133,10 +136,10 @@ struct GlintTest : langtest::Test {
                                 auto* expected_block = expected_func->blocks().at(block_i);
                                 auto* got_block = got_func->blocks().at(block_i);
 
-                                if (expected_func->blocks().size() != got_func->blocks().size()) {
+                                if (expected_block->instructions().size() != got_block->instructions().size()) {
                                     ir_matches = false;
 
-                                    fmt::print(
+                                    print(
                                         "IR MISMATCH: Instruction count in block {} in function {}\n",
                                         expected_block->name(),
                                         expected_func->names().at(0).name
@@ -146,9 +149,9 @@ struct GlintTest : langtest::Test {
                                 }
 
                                 std::unordered_map<lcc::Inst*, lcc::Inst*> expected_to_got{};
-                                for (size_t inst_i = 0; inst_i < expected_block->instructions().size(); ++inst_i) {
-                                    auto* expected_inst = expected_block->instructions().at(inst_i);
-                                    auto* got_inst = got_block->instructions().at(inst_i);
+                                auto got_inst_it = got_block->instructions().begin();
+                                for (auto* expected_inst : expected_block->instructions()) {
+                                    auto* got_inst = *got_inst_it++;
                                     expected_to_got[expected_inst] = got_inst;
 
                                     if (expected_inst->kind() != got_inst->kind()) {
@@ -160,19 +163,15 @@ struct GlintTest : langtest::Test {
                                         // fmt::print("Got IR:\n");
                                         // got_func->print();
 
-                                        fmt::print(
+                                        print(
                                             "IR MISMATCH: Expected instruction (1) but got instruction (2) in block {} in function {}\n",
                                             expected_block->name(),
                                             expected_func->names().at(0).name
                                         );
 
-                                        fmt::print("(1): ");
-                                        expected_inst->print();
-                                        fmt::print("{}\n", C(lcc::utils::Colour::Reset));
+                                        print("(1): {}\n", expected_inst->string());
 
-                                        fmt::print("(2): ");
-                                        got_inst->print();
-                                        fmt::print("{}\n", C(lcc::utils::Colour::Reset));
+                                        print("(2): {}\n", got_inst->string());
 
                                         break;
                                     }
@@ -196,22 +195,16 @@ struct GlintTest : langtest::Test {
                                             if (expected_to_got[expected_child_inst] != got_child) {
                                                 ir_matches = false;
 
-                                                fmt::print(
+                                                print(
                                                     "IR MISMATCH: Expected operand {} (zero-based) of instruction (1) to reference (2), but it instead references (3)\n",
                                                     child_i
                                                 );
 
-                                                fmt::print("(1): ");
-                                                got_inst->print();
-                                                fmt::print("{}\n", C(lcc::utils::Colour::Reset));
+                                                print("(1): {}\n", got_inst->string());
 
-                                                fmt::print("(2): ");
-                                                expected_child_inst->print();
-                                                fmt::print("{}\n", C(lcc::utils::Colour::Reset));
+                                                print("(2): {}\n", expected_child_inst->string());
 
-                                                fmt::print("(3): ");
-                                                expected_to_got[expected_child_inst]->print();
-                                                fmt::print("{}\n", C(lcc::utils::Colour::Reset));
+                                                print("(3): {}\n", expected_to_got[expected_child_inst]->string());
                                             }
                                         }
                                         // Advance iterators
@@ -222,22 +215,22 @@ struct GlintTest : langtest::Test {
                                 }
                             }
                         }
-                    } else fmt::print("Error parsing expected IR for test {}\n", name);
+                    } else print("Error parsing expected IR for test {}\n", name);
                 }
 
             } else failed_check = true;
         } else failed_parse = true;
 
         // TODO: Handle expected to fail to parse, to fail to check sort of tests.
-        bool passed = ast_matches and ir_matches
-                  and not failed_parse and not failed_check;
+        bool test_passed = ast_matches and ir_matches
+                       and not failed_parse and not failed_check;
 
         // NOTE: Even if we shouldn't print, the parsing/semantic analysis that
         // failed almost certainly printed something of some kind, so we are kind
         // of forced to print something just to delineate what that output came
         // from.
-        if (not passed) {
-            fmt::print("  {}: {}FAIL{}\n\n", name, C(Colour::Red), C(Colour::Reset));
+        if (not test_passed) {
+            print("  {}: {}FAIL{}\n\n", name, C(Colour::Red), C(Colour::Reset));
             if (not ast_matches) {
                 std::string expected = matcher.print();
                 std::string got = langtest::print_node<lcc::glint::Expr>(mod->top_level_function()->body());
@@ -263,16 +256,16 @@ struct GlintTest : langtest::Test {
                 );
                 got += C(lcc::utils::Colour::Reset);
 
-                fmt::print("EXPECTED: {}\n", expected);
-                fmt::print("GOT:      {}\n", got);
+                print("EXPECTED: {}\n", expected);
+                print("GOT:      {}\n", got);
             }
         }
 
-        if (should_print and passed) {
-            fmt::print("  {}: {}PASS{}\n", name, C(Colour::Green), C(Colour::Reset));
+        if (should_print and test_passed) {
+            print("  {}: {}PASS{}\n", name, C(Colour::Green), C(Colour::Reset));
         }
 
-        return passed;
+        return test_passed;
     }
 };
 
@@ -281,14 +274,23 @@ void help() {
         "Glint Programming Language Test Runner\n"
         "USAGE: glinttests [FLAGS]\n"
         "FLAGS:\n"
-        "  -h, --help  ::  Show this help\n"
-        "  -a, --all   ::  Print messages for every test\n"
-        "  -c, --count ::  Print counts at the end and for every test file processed\n"
+        "  -h, --help     ::  Show this help\n"
+        "  -a, --all      ::  Print messages for every test\n"
+        "  -c, --count    ::  Print counts at the end and for every test file processed\n"
+        "  -j, --jobs <N> ::  Run up to N tests at once (0 = one per hardware thread; default 0)\n"
     );
 }
 
+/// A corpus file and the tests parsed from it.
+struct TestFile {
+    std::filesystem::path path;
+    std::vector<char> contents;
+    std::vector<GlintTest> tests;
+};
+
 int main(int argc, const char** argv) {
     bool option_count{false};
+    lcc::usz option_jobs{0};
     for (int i = 1; i < argc; ++i) {
         std::string_view arg{argv[i]};
         if (arg.starts_with("-h") or arg.starts_with("--h") or arg.starts_with("-?")) {
@@ -303,6 +305,17 @@ int main(int argc, const char** argv) {
             option_count = true;
             continue;
         }
+        if (arg.starts_with("-j") or arg.starts_with("--jobs")) {
+            // Accept both `-jN` and `-j N`.
+            std::string_view value = arg.starts_with("--") ? "" : arg.substr(2);
+            if (value.empty()) {
+                LCC_ASSERT(i + 1 < argc, "Option `{}' requires a job count", arg);
+                value = argv[++i];
+            }
+            auto [_, ec] = std::from_chars(value.data(), value.data() + value.size(), option_jobs);
+            LCC_ASSERT(ec == std::errc(), "Invalid job count `{}'", value);
+            continue;
+        }
         LCC_ASSERT(
             false,
             "Unhandled command line option `{}'.\n"
@@ -311,34 +324,55 @@ int main(int argc, const char** argv) {
         );
     }
 
-    langtest::TestContext out{};
-    for (const auto& entry : std::filesystem::directory_iterator("corpus")) {
-        if (entry.is_regular_file()) {
-            if (option_print or option_count)
-                fmt::print("{}:\n", entry.path().lexically_normal().filename().string());
+    // Collect the corpus in a fixed order so that the output does not depend
+    // on the order the filesystem happens to list the files in.
+    std::vector<TestFile> files{};
+    for (const auto& entry : std::filesystem::directory_iterator("corpus"))
+        if (entry.is_regular_file()) files.push_back({entry.path(), {}, {}});
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        return a.path < b.path;
+    });
+
+    // Parse every file up front, then run all tests from all files in one
+    // job pool, so that a file with few tests doesn't leave threads idle.
+    std::vector<GlintTest*> all_tests{};
+    for (auto& file : files) {
+        file.contents = langtest::read_test_file(file.path);
+        file.tests = langtest::parse_tests<GlintTest>(file.contents);
+        for (auto& test : file.tests) all_tests.push_back(&test);
+    }
 
-            auto count = langtest::process_ast_test_file<GlintTest>(entry.path());
+    lcc::ParallelFor(all_tests.size(), option_jobs, [&](lcc::usz i) {
+        all_tests[i]->passed = all_tests[i]->run();
+    });
 
-            if (option_count) {
+    // Report the results in corpus order.
+    langtest::TestContext out{};
+    for (auto& file : files) {
+        if (option_print or option_count)
+            fmt::print("{}:\n", file.path.lexically_normal().filename().string());
+
+        auto count = langtest::report_tests<GlintTest>(file.tests);
+
+        if (option_count) {
+            fmt::print(
+                "  {}PASSED:  {}/{}{}\n",
+                C(lcc::utils::Colour::Green),
+                count.count_passed(),
+                count.count(),
+                C(lcc::utils::Colour::Reset)
+            );
+            if (count.count_failed()) {
                 fmt::print(
-                    "  {}PASSED:  {}/{}{}\n",
-                    C(lcc::utils::Colour::Green),
-                    count.count_passed(),
-                    count.count(),
+                    "  {}FAILED:  {}{}\n",
+                    C(lcc::utils::Colour::Red),
+                    count.count_failed(),
                     C(lcc::utils::Colour::Reset)
                 );
-                if (count.count_failed()) {
-                    fmt::print(
-                        "  {}FAILED:  {}{}\n",
-                        C(lcc::utils::Colour::Red),
-                        count.count_failed(),
-                        C(lcc::utils::Colour::Reset)
-                    );
-                }
             }
-
-            out.merge(count);
         }
+
+        out.merge(count);
     }
 
     // Print stats if CLI options request it or if all tests did not pass.
@@ -0,0 +1,228 @@
+#include <lcc/codegen/block_layout.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/utils.hh>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+
+namespace {
+/// How much more often a block runs than the ones around the loop it
+/// is in.
+constexpr double loop_scale = 8;
+
+/// Nesting depth past which loops are not told apart anymore, so the
+/// weights stay within a sensible range.
+constexpr usz max_loop_depth = 8;
+
+/// How much less likely a branch is to leave a loop than to stay in it.
+constexpr double exit_scale = 1. / 8;
+
+/// How much less likely a branch is to go to a block from which only
+/// `unreachable` can be reached than to go anywhere else.
+constexpr double cold_scale = 1. / 64;
+
+struct Edge {
+    usz from;
+    usz to;
+    double weight;
+};
+} // namespace
+
+void layout_blocks(MFunction& function) {
+    auto& blocks = function.blocks();
+    const usz n = blocks.size();
+
+    // With two blocks, the entry block has to come first anyway.
+    if (n < 3) return;
+
+    std::unordered_map<std::string_view, usz> block_indices{};
+    for (usz i = 0; i < n; i++) block_indices[blocks[i].name()] = i;
+
+    std::vector<std::vector<usz>> successors(n);
+    std::vector<std::vector<usz>> predecessors(n);
+    for (usz i = 0; i < n; i++) {
+        for (const auto& name : blocks[i].successors()) {
+            auto it = block_indices.find(name);
+            LCC_ASSERT(it != block_indices.end(), "Successor {} of block {} does not exist", name, blocks[i].name());
+            successors[i].push_back(it->second);
+            predecessors[it->second].push_back(i);
+        }
+    }
+
+    // An edge to a block that is still on the DFS stack is a back edge.
+    std::vector<std::pair<usz, usz>> back_edges{};
+    std::vector<bool> reachable(n), on_stack(n);
+    std::vector<std::pair<usz, usz>> stack{{0, 0}};
+    reachable[0] = on_stack[0] = true;
+    while (not stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next < successors[block].size()) {
+            auto succ = successors[block][next++];
+            if (on_stack[succ]) back_edges.emplace_back(block, succ);
+            else if (not reachable[succ]) {
+                reachable[succ] = on_stack[succ] = true;
+                stack.emplace_back(succ, 0);
+            }
+        } else {
+            on_stack[block] = false;
+            stack.pop_back();
+        }
+    }
+
+    // The loop of a header consists of the header and every block that
+    // reaches one of its back edges without going through the header.
+    std::vector<usz> headers{};
+    std::vector<std::vector<bool>> loops(n);
+    for (auto [latch, header] : back_edges) {
+        auto& loop = loops[header];
+        if (loop.empty()) {
+            headers.push_back(header);
+            loop.resize(n);
+            loop[header] = true;
+        }
+
+        std::vector<usz> worklist{latch};
+        while (not worklist.empty()) {
+            auto b = worklist.back();
+            worklist.pop_back();
+            if (loop[b]) continue;
+            loop[b] = true;
+            for (auto p : predecessors[b])
+                if (reachable[p]) worklist.push_back(p);
+        }
+    }
+
+    // A block is cold if it ends in `unreachable`, or if all of its
+    // successors are cold.
+    std::vector<bool> cold(n);
+    for (usz i = 0; i < n; i++) {
+        const auto& insts = blocks[i].instructions();
+        cold[i] = successors[i].empty()
+              and not insts.empty()
+              and insts.back().opcode() == +MInst::Kind::Unreachable;
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (usz i = n; i-- > 0;) {
+            if (cold[i] or successors[i].empty()) continue;
+            if (rgs::all_of(successors[i], [&](usz s) { return cold[s]; })) {
+                cold[i] = true;
+                changed = true;
+            }
+        }
+    }
+
+    auto LeavesLoop = [&](usz from, usz to) {
+        return rgs::any_of(headers, [&](usz h) { return loops[h][from] and not loops[h][to]; });
+    };
+
+    // If there is a profile, a block runs as often as it did then, and a
+    // branch goes to each successor in proportion to how often that ran.
+    const bool profiled = rgs::all_of(blocks, [](const MBlock& b) { return b.profile_count().has_value(); });
+    auto Count = [&](usz b) { return double(*blocks[b].profile_count()); };
+
+    // Estimate how often each edge is taken. Edges out of the same
+    // block are adjacent.
+    std::vector<Edge> edges{};
+    std::vector<usz> first_edge(n + 1);
+    for (usz i = 0; i < n; i++) {
+        first_edge[i] = edges.size();
+        double frequency{};
+        if (profiled) frequency = Count(i);
+        else {
+            usz depth = usz(rgs::count_if(headers, [&](usz h) { return loops[h][i]; }));
+            frequency = std::pow(loop_scale, double(std::min(depth, max_loop_depth)));
+            if (cold[i]) frequency *= cold_scale;
+        }
+
+        double total = 0;
+        const bool use_counts = profiled and rgs::any_of(successors[i], [&](usz s) { return Count(s) != 0; });
+        for (auto s : successors[i]) {
+            double weight = 1;
+            if (use_counts) weight = Count(s);
+            else {
+                if (LeavesLoop(i, s)) weight *= exit_scale;
+                if (cold[s] and not cold[i]) weight *= cold_scale;
+            }
+            edges.push_back({i, s, weight});
+            total += weight;
+        }
+
+        for (usz e = first_edge[i]; e < edges.size(); e++)
+            edges[e].weight *= frequency / total;
+    }
+    first_edge[n] = edges.size();
+
+    // Chain blocks together along the heaviest edges first. An edge can
+    // only link the end of one chain to the start of another, and
+    // nothing may be placed before the entry block.
+    std::vector<std::vector<usz>> chains(n);
+    std::vector<usz> chain_of(n);
+    for (usz i = 0; i < n; i++) {
+        chains[i] = {i};
+        chain_of[i] = i;
+    }
+
+    std::vector<usz> by_weight(edges.size());
+    for (usz e = 0; e < edges.size(); e++) by_weight[e] = e;
+    rgs::stable_sort(by_weight, [&](usz a, usz b) { return edges[a].weight > edges[b].weight; });
+    for (auto e : by_weight) {
+        auto [from, to, _] = edges[e];
+        if (to == 0) continue;
+        auto a = chain_of[from];
+        auto b = chain_of[to];
+        if (a == b or chains[a].back() != from or chains[b].front() != to) continue;
+        for (auto block : chains[b]) {
+            chains[a].push_back(block);
+            chain_of[block] = a;
+        }
+        chains[b].clear();
+    }
+
+    // Start with the chain of the entry block, then keep adding the
+    // chain that the heaviest edge from what has been placed so far
+    // leads into. A chain is identified by the block it starts with,
+    // so ties go to whichever came first originally.
+    std::vector<usz> order{};
+    order.reserve(n);
+    std::vector<double> priority(n, -1);
+    std::vector<bool> placed(n);
+    auto Place = [&](usz chain) {
+        placed[chain] = true;
+        for (auto block : chains[chain]) {
+            order.push_back(block);
+            for (usz e = first_edge[block]; e < first_edge[block + 1]; e++) {
+                auto& p = priority[chain_of[edges[e].to]];
+                p = std::max(p, edges[e].weight);
+            }
+        }
+    };
+
+    Place(chain_of[0]);
+    for (;;) {
+        std::optional<usz> best{};
+        for (usz c = 0; c < n; c++) {
+            if (chains[c].empty() or placed[c]) continue;
+            if (not best or priority[c] > priority[*best]) best = c;
+        }
+        if (not best) break;
+        Place(*best);
+    }
+
+    LCC_ASSERT(order.size() == n, "Block layout lost some blocks");
+    if (rgs::is_sorted(order)) return;
+
+    std::vector<MBlock> reordered{};
+    reordered.reserve(n);
+    for (auto b : order) reordered.push_back(std::move(blocks[b]));
+    blocks = std::move(reordered);
+}
+
+} // namespace lcc
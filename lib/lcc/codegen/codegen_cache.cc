@@ -0,0 +1,306 @@
+#include <lcc/codegen/codegen_cache.hh>
+#include <lcc/codegen/x86_64/object.hh>
+#include <lcc/context.hh>
+#include <lcc/file.hh>
+#include <lcc/format.hh>
+#include <lcc/ir/ir.hh>
+#include <lcc/ir/type.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <cstring>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+namespace lcc {
+namespace {
+constexpr std::string_view magic{"LCCCGEN\0", 8};
+
+/// Bump this whenever the layout of an entry changes.
+constexpr u64 current_version = 1;
+
+/// 64-bit FNV-1a.
+auto Hash(std::string_view data) -> u64 {
+    u64 hash = 14695981039346656037u;
+    for (char c : data) {
+        hash ^= u8(c);
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+/// Write a file such that readers either see all of it or none of it.
+auto WriteAtomically(const fs::path& path, const void* data, usz size) -> bool {
+    auto temp = path;
+    temp += fmt::format(".{:016x}.tmp", std::random_device{}() | u64(std::random_device{}()) << 32);
+    if (not File::Write(data, size, temp)) return false;
+
+    std::error_code ec;
+    fs::rename(temp, path, ec);
+    if (ec) fs::remove(temp, ec);
+    return not ec;
+}
+
+auto EntryPath(const fs::path& directory, std::string_view key) -> fs::path {
+    return directory / fmt::format("{:016x}.lcccg", Hash(key));
+}
+
+/// Identify the compiler that is running, so that entries written by
+/// a different build of it, which may generate different code for the
+/// same IR, are never used.
+auto CompilerStamp() -> std::string {
+    std::error_code ec;
+    auto exe = fs::read_symlink("/proc/self/exe", ec);
+    if (ec) return "";
+    auto size = fs::file_size(exe, ec);
+    if (ec) return "";
+    auto mtime = fs::last_write_time(exe, ec);
+    if (ec) return "";
+    return fmt::format("{} {} {}", exe.string(), size, mtime.time_since_epoch().count());
+}
+
+/// Collect the struct types that \p t is or contains, each once, in the
+/// order in which they are first seen.
+void CollectStructTypes(Type* t, std::unordered_set<Type*>& seen, std::vector<StructType*>& out) {
+    if (not seen.insert(t).second) return;
+    switch (t->kind) {
+        case Type::Kind::Unknown:
+        case Type::Kind::Pointer:
+        case Type::Kind::Void:
+        case Type::Kind::Integer:
+            return;
+
+        case Type::Kind::Array:
+            return CollectStructTypes(as<ArrayType>(t)->element_type(), seen, out);
+
+        case Type::Kind::Vector:
+            return CollectStructTypes(as<VectorType>(t)->element_type(), seen, out);
+
+        case Type::Kind::Function: {
+            auto* ft = as<FunctionType>(t);
+            CollectStructTypes(ft->ret(), seen, out);
+            for (auto* param : ft->params()) CollectStructTypes(param, seen, out);
+            return;
+        }
+
+        case Type::Kind::Struct: {
+            auto* st = as<StructType>(t);
+            out.push_back(st);
+            for (auto* member : st->members()) CollectStructTypes(member, seen, out);
+            return;
+        }
+    }
+    LCC_UNREACHABLE();
+}
+
+class Writer {
+    std::vector<char> _out{};
+
+public:
+    void integer(u64 value) {
+        char bytes[sizeof value];
+        std::memcpy(bytes, &value, sizeof value);
+        _out.insert(_out.end(), bytes, bytes + sizeof value);
+    }
+
+    void bytes(std::span<const char> data) {
+        integer(data.size());
+        _out.insert(_out.end(), data.begin(), data.end());
+    }
+
+    void bytes(std::span<const u8> data) {
+        bytes(std::span{reinterpret_cast<const char*>(data.data()), data.size()});
+    }
+
+    void symbol(const Symbol& sym) {
+        integer(u64(sym.kind));
+        bytes(std::span{sym.name});
+        bytes(std::span{sym.section_name});
+        integer(sym.byte_offset);
+    }
+
+    auto out() -> std::vector<char>& { return _out; }
+};
+
+/// Reads an entry; every read fails once the entry turns out to be
+/// truncated.
+class Reader {
+    std::span<const char> _data;
+    usz _offset = 0;
+
+public:
+    explicit Reader(std::span<const char> data) : _data(data) {}
+
+    auto integer() -> std::optional<u64> {
+        if (_data.size() - _offset < sizeof(u64)) return std::nullopt;
+        u64 value{};
+        std::memcpy(&value, _data.data() + _offset, sizeof value);
+        _offset += sizeof value;
+        return value;
+    }
+
+    auto bytes() -> std::optional<std::span<const char>> {
+        auto size = integer();
+        if (not size or _data.size() - _offset < *size) return std::nullopt;
+        auto out = _data.subspan(_offset, *size);
+        _offset += *size;
+        return out;
+    }
+
+    auto string() -> std::optional<std::string> {
+        auto data = bytes();
+        if (not data) return std::nullopt;
+        return std::string{data->begin(), data->end()};
+    }
+
+    auto byte_vector() -> std::optional<std::vector<u8>> {
+        auto data = bytes();
+        if (not data) return std::nullopt;
+        return std::vector<u8>{data->begin(), data->end()};
+    }
+
+    auto symbol() -> std::optional<Symbol> {
+        auto kind = integer();
+        auto name = string();
+        auto section_name = string();
+        auto offset = integer();
+        if (not kind or not name or not section_name or not offset) return std::nullopt;
+        if (*kind > u64(Symbol::Kind::EXTERNAL)) return std::nullopt;
+        return Symbol{Symbol::Kind(*kind), std::move(*name), std::move(*section_name), *offset};
+    }
+
+    [[nodiscard]]
+    auto done() const -> bool { return _offset == _data.size(); }
+};
+} // namespace
+
+CodegenCache::CodegenCache(Context* ctx, fs::path directory)
+    : _directory(std::move(directory)) {
+    _configuration = fmt::format(
+        "{} target {} format {} regalloc {} frame-pointer {} function-sections {}\n",
+        CompilerStamp(),
+        ctx->target()->is_platform_windows() ? "x86_64-windows" : "x86_64-linux",
+        int(ctx->format()->format()),
+        bool(ctx->option_register_allocator()),
+        bool(ctx->option_frame_pointer()),
+        bool(ctx->option_function_sections())
+    );
+}
+
+auto CodegenCache::key(Function* f) const -> std::string {
+    auto out = _configuration;
+    out += f->string(false);
+
+    // Blocks become symbols named after them, and they are laid out based
+    // on their profile counts, neither of which is part of the IR.
+    for (auto* b : f->blocks()) {
+        out += fmt::format("\n{}", b->name());
+        if (auto count = b->profile_count()) out += fmt::format(" {}", *count);
+    }
+
+    // The IR refers to struct types by name only, but their layout
+    // decides the offsets and sizes we generate code for.
+    std::unordered_set<Type*> seen{};
+    std::vector<StructType*> structs{};
+    CollectStructTypes(f->type(), seen, structs);
+    for (auto* b : f->blocks()) {
+        for (auto* i : b->instructions()) {
+            CollectStructTypes(i->type(), seen, structs);
+            if (auto* alloca = cast<AllocaInst>(i)) CollectStructTypes(alloca->allocated_type(), seen, structs);
+            else if (auto* gep = cast<GEPBaseInst>(i)) CollectStructTypes(gep->base_type(), seen, structs);
+            else if (auto* call = cast<CallInst>(i)) CollectStructTypes(call->function_type(), seen, structs);
+            for (auto* child : i->children()) CollectStructTypes(child->type(), seen, structs);
+        }
+    }
+
+    for (auto* st : structs) {
+        out += fmt::format("\nstruct {} size {} align {}", st->string(false), st->bytes(), st->align_bytes());
+        for (auto* member : st->members()) out += fmt::format(" {}", member->string(false));
+    }
+    return out;
+}
+
+auto CodegenCache::lookup(const std::string& key) const -> std::optional<x86_64::EncodedFunction> {
+    auto file = MappedFile::Map(EntryPath(_directory, key));
+    if (not file or file->size() < magic.size()) return std::nullopt;
+    if (std::string_view{file->data(), magic.size()} != magic) return std::nullopt;
+
+    Reader r{std::span{file->data(), file->size()}.subspan(magic.size())};
+    auto version = r.integer();
+    auto stored_key = r.bytes();
+    if (not version or *version != current_version) return std::nullopt;
+    if (not stored_key or std::string_view{stored_key->data(), stored_key->size()} != key) return std::nullopt;
+
+    x86_64::EncodedFunction out{};
+    auto code = r.byte_vector();
+    if (not code) return std::nullopt;
+    out.code = std::move(*code);
+
+    auto symbols = r.integer();
+    if (not symbols) return std::nullopt;
+    for (u64 i = 0; i < *symbols; i++) {
+        auto sym = r.symbol();
+        if (not sym) return std::nullopt;
+        out.symbols.push_back(std::move(*sym));
+    }
+
+    auto relocations = r.integer();
+    if (not relocations) return std::nullopt;
+    for (u64 i = 0; i < *relocations; i++) {
+        auto kind = r.integer();
+        auto sym = r.symbol();
+        auto addend = r.integer();
+        if (not kind or not sym or not addend) return std::nullopt;
+        if (*kind > u64(Relocation::Kind::PCREL32)) return std::nullopt;
+        out.relocations.push_back({Relocation::Kind(*kind), std::move(*sym), isz(*addend)});
+    }
+
+    auto events = r.integer();
+    if (not events) return std::nullopt;
+    for (u64 i = 0; i < *events; i++) {
+        auto offset = r.integer();
+        auto instructions = r.byte_vector();
+        if (not offset or not instructions) return std::nullopt;
+        out.frame.push_back({*offset, std::move(*instructions)});
+    }
+
+    if (not r.done()) return std::nullopt;
+    return out;
+}
+
+void CodegenCache::store(const std::string& key, const x86_64::EncodedFunction& encoded) const {
+    std::error_code ec;
+    fs::create_directories(_directory, ec);
+    if (ec) return;
+
+    Writer w{};
+    w.out().assign(magic.begin(), magic.end());
+    w.integer(current_version);
+    w.bytes(std::span{key});
+    w.bytes(std::span{encoded.code});
+
+    w.integer(encoded.symbols.size());
+    for (const auto& sym : encoded.symbols) w.symbol(sym);
+
+    w.integer(encoded.relocations.size());
+    for (const auto& reloc : encoded.relocations) {
+        w.integer(u64(reloc.kind));
+        w.symbol(reloc.symbol);
+        w.integer(u64(reloc.addend));
+    }
+
+    w.integer(encoded.frame.size());
+    for (const auto& event : encoded.frame) {
+        w.integer(event.offset);
+        w.bytes(std::span{event.instructions});
+    }
+
+    (void) WriteAtomically(EntryPath(_directory, key), w.out().data(), w.out().size());
+}
+} // namespace lcc
@@ -0,0 +1,91 @@
+#include <lcc/codegen/codegen_report.hh>
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+void CodegenReport::add(std::vector<Function> module_functions) {
+    std::unique_lock lock{mutex};
+    functions.insert(
+        functions.end(),
+        std::make_move_iterator(module_functions.begin()),
+        std::make_move_iterator(module_functions.end())
+    );
+}
+
+auto CodegenReport::str() -> std::string {
+    std::unique_lock lock{mutex};
+
+    /// Order by code size if we know it, and by instruction count
+    /// otherwise, which is a decent proxy for it.
+    auto sorted = functions;
+    rgs::stable_sort(sorted, [](const Function& a, const Function& b) {
+        if (a.code_size != b.code_size) return a.code_size > b.code_size;
+        return a.selected_instructions > b.selected_instructions;
+    });
+
+    auto Size = [](std::optional<usz> size) {
+        return size ? fmt::format("{}", *size) : std::string{"-"};
+    };
+
+    std::string out = "Code generation report\n";
+    out += fmt::format(
+        "{:>8} {:>8} {:>8} {:>8} {:>7} {:>7} {:>7} {:>8}  {}\n",
+        "MIR",
+        "ISel",
+        "VRegs",
+        "Edges",
+        "Moves",
+        "Spills",
+        "Frame",
+        "Bytes",
+        "Function"
+    );
+
+    Function total{"(total)"};
+    bool sizes_known = not sorted.empty();
+    for (auto& f : sorted) {
+        out += fmt::format(
+            "{:>8} {:>8} {:>8} {:>8} {:>7} {:>7} {:>7} {:>8}  {}\n",
+            f.mir_instructions,
+            f.selected_instructions,
+            f.virtual_registers,
+            f.interference_edges,
+            f.removed_moves,
+            f.spills,
+            f.frame_size,
+            Size(f.code_size),
+            f.name
+        );
+
+        total.mir_instructions += f.mir_instructions;
+        total.selected_instructions += f.selected_instructions;
+        total.virtual_registers += f.virtual_registers;
+        total.interference_edges += f.interference_edges;
+        total.removed_moves += f.removed_moves;
+        total.spills += f.spills;
+        total.frame_size += f.frame_size;
+        if (f.code_size) total.code_size = total.code_size.value_or(0) + *f.code_size;
+        else sizes_known = false;
+    }
+
+    if (not sizes_known) total.code_size = std::nullopt;
+    out += fmt::format(
+        "{:>8} {:>8} {:>8} {:>8} {:>7} {:>7} {:>7} {:>8}  {}\n",
+        total.mir_instructions,
+        total.selected_instructions,
+        total.virtual_registers,
+        total.interference_edges,
+        total.removed_moves,
+        total.spills,
+        total.frame_size,
+        Size(total.code_size),
+        total.name
+    );
+    return out;
+}
+} // namespace lcc
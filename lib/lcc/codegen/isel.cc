@@ -7,88 +7,457 @@
 #include <lcc/ir/module.hh>
 #include <lcc/target.hh>
 #include <lcc/utils.hh>
+
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace lcc {
 
-// Mark defining uses of virtual registers within a single block.
-static void mark_defining_uses(std::vector<usz>& regs_seen, MBlock* block) {
+// Mark defining uses of virtual registers within a single block, given
+// the registers that have been seen on every path to its entry.
+static void mark_defining_uses(std::unordered_set<usz>& regs_seen, MBlock* block) {
     for (auto& inst : block->instructions()) {
-        if (inst.reg() >= +MInst::Kind::ArchStart and std::find(regs_seen.begin(), regs_seen.end(), inst.reg()) == regs_seen.end()) {
+        if (inst.reg() >= +MInst::Kind::ArchStart and regs_seen.insert(inst.reg()).second)
             inst.is_defining(true);
-            regs_seen.push_back(inst.reg());
+
+        // A move into all of a register defines it again, even if it was
+        // seen before, e.g. in the copies that replace a phi; otherwise, it
+        // would be live from its first definition on.
+        if (
+            inst.reg() >= +MInst::Kind::ArchStart
+            and inst.opcode() == +x86_64::Opcode::Move
+            and inst.all_operands().size() == 2
+        ) {
+            auto src = inst.get_operand(0);
+            auto dst = inst.get_operand(1);
+            bool reads_itself = std::holds_alternative<MOperandRegister>(src)
+                            and std::get<MOperandRegister>(src).value == inst.reg();
+            if (
+                std::holds_alternative<MOperandRegister>(dst)
+                and std::get<MOperandRegister>(dst).value == inst.reg()
+                and std::get<MOperandRegister>(dst).size >= inst.regsize()
+                and not reads_itself
+            ) inst.is_defining(true);
         }
+
         for (auto& op : inst.all_operands()) {
             if (std::holds_alternative<MOperandRegister>(op)) {
                 auto reg = std::get<MOperandRegister>(op);
-                if (reg.value >= +MInst::Kind::ArchStart and std::find(regs_seen.begin(), regs_seen.end(), reg.value) == regs_seen.end()) {
+                if (reg.value >= +MInst::Kind::ArchStart and regs_seen.insert(reg.value).second) {
                     reg.defining_use = true;
                     op = reg;
-                    regs_seen.push_back(reg.value);
                 }
             }
         }
     }
 }
 
-/// NOTE: Pass empty vectors for visited and doubly_visited when
-/// calling on entry of function.
-static void calculate_defining_uses_for_block(
-    MFunction& function,
-    std::vector<usz> regs_seen,
-    MBlock* block,
-    std::vector<MBlock*> visited,
-    std::vector<MBlock*> doubly_visited
-) {
-    LCC_ASSERT(block, "Cannot calculate defining uses for NULL block");
-
-    /// Don't visit the same block thrice.
-    if (std::find(visited.begin(), visited.end(), block) != visited.end()) {
-        if (std::find(doubly_visited.begin(), doubly_visited.end(), block) != doubly_visited.end())
-            return;
-        doubly_visited.push_back(block);
-    } else visited.push_back(block);
+// The first operand usage of a virtual register on some path from the
+// entry is a defining use (i.e. the first place that that register must
+// be classified as "in use" by the register allocator).
+//
+// This is a forward dataflow analysis: a register is marked wherever it
+// has not been seen on *every* path to it, which we iterate to a fixpoint
+// over the blocks in reverse post-order, starting at the entry. Only
+// blocks reachable from the entry are marked.
+static void calculate_defining_uses(MFunction& function) {
+    auto& blocks = function.blocks();
+    std::unordered_map<std::string_view, usz> block_indices{};
+    for (usz i = 0; i < blocks.size(); i++) block_indices[blocks[i].name()] = i;
 
-    // At each block of the function, starting at the entry, walk the
-    // control flow. The first operand usage of a virtual register will
-    // be set to a defining use (i.e. the first place that that register
-    // must be classified as "in use" by the register allocator).
+    // Resolve successors and collect the registers each block mentions.
+    std::vector<std::vector<usz>> successors(blocks.size());
+    std::vector<std::unordered_set<usz>> mentioned(blocks.size());
+    for (usz i = 0; i < blocks.size(); i++) {
+        for (const auto& name : blocks[i].successors()) {
+            auto it = block_indices.find(name);
+            LCC_ASSERT(it != block_indices.end(), "Successor {} of block {} does not exist", name, blocks[i].name());
+            successors[i].push_back(it->second);
+        }
 
-    mark_defining_uses(regs_seen, block);
+        for (auto& inst : blocks[i].instructions()) {
+            if (inst.reg() >= +MInst::Kind::ArchStart) mentioned[i].insert(inst.reg());
+            for (auto& op : inst.all_operands())
+                if (std::holds_alternative<MOperandRegister>(op) and std::get<MOperandRegister>(op).value >= +MInst::Kind::ArchStart)
+                    mentioned[i].insert(std::get<MOperandRegister>(op).value);
+        }
+    }
 
-    // To follow control flow of an exit block, we stop.
-    if (not block->successors().size()) return;
+    // Order the reachable blocks so that predecessors come before their
+    // successors wherever possible.
+    std::vector<usz> order{};
+    std::vector<bool> reachable(blocks.size());
+    std::vector<std::pair<usz, usz>> stack{{0, 0}};
+    reachable[0] = true;
+    while (not stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next < successors[block].size()) {
+            auto succ = successors[block][next++];
+            if (not reachable[succ]) {
+                reachable[succ] = true;
+                stack.emplace_back(succ, 0);
+            }
+            continue;
+        }
+        order.push_back(block);
+        stack.pop_back();
+    }
+    rgs::reverse(order);
 
-    // If a block has only a single successor, we don't need to do
-    // anything fancy; just follow the simple control flow for as long as
-    // possible.
-    while (block->successors().size() == 1) {
-        block = function.block_by_name(block->successors().front());
-        mark_defining_uses(regs_seen, block);
+    // Registers seen on every path to the entry of each block; empty
+    // until the first predecessor has been visited.
+    std::vector<std::optional<std::unordered_set<usz>>> seen_on_entry(blocks.size());
+    seen_on_entry[0].emplace();
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto b : order) {
+            if (not seen_on_entry[b]) continue;
+            auto seen_on_exit = *seen_on_entry[b];
+            seen_on_exit.insert(mentioned[b].begin(), mentioned[b].end());
+            for (auto succ : successors[b]) {
+                auto& entry = seen_on_entry[succ];
+                if (not entry) {
+                    entry = seen_on_exit;
+                    changed = true;
+                    continue;
+                }
+                if (std::erase_if(*entry, [&](usz reg) { return not seen_on_exit.contains(reg); }))
+                    changed = true;
+            }
+        }
     }
-    // If a block has multiple successors, we will "remember" the
-    // registers that we had seen at the beginning, and reset
-    // to that after following each one.
-    // To follow control flow, we sometimes have to come back to a
-    // block after reaching the exit, as some blocks have multiple
-    // successors. We use recursion for this.
-    for (auto successor : block->successors()) {
-        // Copy registers seen.
-        std::vector<usz> regs_seen_copy = {regs_seen};
-        calculate_defining_uses_for_block(function, regs_seen_copy, function.block_by_name(successor), visited, doubly_visited);
+
+    for (auto b : order) mark_defining_uses(*seen_on_entry[b], &blocks[b]);
+}
+
+namespace {
+[[nodiscard]]
+auto is_virtual_register(const MOperand& op) -> bool {
+    return std::holds_alternative<MOperandRegister>(op)
+       and std::get<MOperandRegister>(op).value >= +MInst::Kind::ArchStart;
+}
+
+/// Whether \p op is a register that can be used as the base or index of
+/// an x86_64 memory operand: a 64-bit virtual register, or a general
+/// purpose hardware register (e.g. one a parameter is passed in).
+[[nodiscard]]
+auto is_address_register(const MOperand& op) -> bool {
+    if (not std::holds_alternative<MOperandRegister>(op)) return false;
+    auto reg = std::get<MOperandRegister>(op);
+    return reg.size == 64
+       and (
+           reg.value >= +MInst::Kind::ArchStart
+           or (reg.value >= +x86_64::RegisterId::RAX and reg.value <= +x86_64::RegisterId::RSI)
+       );
+}
+
+/// Whether \p inst is an x86_64 arithmetic instruction whose immediate
+/// source operand does not fit in the sign-extended 32-bit immediate
+/// of the instruction encoding.
+[[nodiscard]]
+auto has_wide_immediate(const MInst& inst) -> bool {
+    switch (x86_64::Opcode(inst.opcode())) {
+        default: return false;
+        case x86_64::Opcode::Add:
+        case x86_64::Opcode::Sub:
+        case x86_64::Opcode::Multiply:
+        case x86_64::Opcode::And:
+        case x86_64::Opcode::Or:
+        case x86_64::Opcode::Xor: break;
     }
+
+    if (inst.all_operands().size() != 2) return false;
+    if (not std::holds_alternative<MOperandImmediate>(inst.get_operand(0))) return false;
+    auto imm = std::get<MOperandImmediate>(inst.get_operand(0));
+    return imm.size == 64 and i64(imm.value) != i64(i32(imm.value));
 }
 
-static void calculate_defining_uses(MFunction& function) {
-    // Only calculate defining uses for blocks reachable from the entry point (first block).
-    calculate_defining_uses_for_block(function, {}, &function.blocks().front(), {}, {});
+/// Virtual registers written by an instruction. Target instructions
+/// (e.g. from calling convention lowering) may write any of their
+/// register operands.
+void foreach_definition(const MInst& inst, auto&& callback) {
+    if (inst.reg() >= +MInst::Kind::ArchStart) callback(inst.reg());
+    if (inst.opcode() < +MInst::Kind::ArchStart) return;
+    for (const auto& op : inst.all_operands())
+        if (is_virtual_register(op)) callback(std::get<MOperandRegister>(op).value);
 }
 
+/// An x86_64 memory operand: base + index * scale + displacement, where
+/// the base is either a register or a local.
+struct Address {
+    MOperand base;
+    std::optional<MOperandRegister> index{};
+    usz scale{1};
+    i64 displacement{0};
+};
+
+/// Matches trees of address computations in the use-def DAG of a block
+/// of generic MIR, and folds them into the loads and stores that use
+/// them, so that instruction selection can emit a single memory operand
+/// instead of the adds (and multiplies) leading up to it, e.g.
+///
+///     r3 | M.Mul 8, r2          ; lowered `gep i64 from %1 at i64 %2`
+///     r3 | M.Add r1, r3
+///     r4 | M.Add r3, 16         ; lowered `gep ... at 2`
+///     r5 | M.Load r4
+///
+/// becomes `r5 | M.Load r1, 16, r2, 8`, or `mov 16(%r1, %r2, 8), %r5`.
+///
+/// A definition is only folded into its user if that is its one and
+/// only use and none of the registers it reads are written before the
+/// user; folded definitions are removed.
+class AddressFolder {
+    MBlock& _block;
+
+    /// Reads of each virtual register in the whole function, indexed by
+    /// register value minus MInst::Kind::ArchStart.
+    const std::vector<usz>& _function_reads;
+
+    /// Indices of the instructions in this block that write and read
+    /// each virtual register, in order.
+    std::unordered_map<usz, std::vector<usz>> _definitions{};
+    std::unordered_map<usz, std::vector<usz>> _reads{};
+
+    std::vector<bool> _folded;
+
+    /// Whether the instruction selected for the current user writes to a
+    /// temporary register before it reads its address.
+    bool _user_writes_temporary{};
+
+public:
+    AddressFolder(MBlock& block, const std::vector<usz>& function_reads)
+        : _block(block), _function_reads(function_reads), _folded(block.instructions().size()) {
+        for (auto [index, inst] : vws::enumerate(block.instructions())) {
+            foreach_definition(inst, [&](usz reg) { _definitions[reg].push_back(usz(index)); });
+            for (const auto& op : inst.all_operands())
+                if (is_virtual_register(op)) _reads[std::get<MOperandRegister>(op).value].push_back(usz(index));
+        }
+    }
+
+    void run() {
+        auto& instructions = _block.instructions();
+        for (usz index = 0; index < instructions.size(); ++index) {
+            auto& inst = instructions[index];
+            if (inst.kind() == MInst::Kind::Load and inst.all_operands().size() == 1)
+                fold_into(index, 0);
+
+            // Only those stores we have patterns for.
+            else if (
+                inst.kind() == MInst::Kind::Store and inst.all_operands().size() == 2
+                and (std::holds_alternative<MOperandRegister>(inst.get_operand(0)) or std::holds_alternative<MOperandImmediate>(inst.get_operand(0)))
+            ) fold_into(index, 1);
+        }
+
+        usz kept = 0;
+        for (usz index = 0; index < instructions.size(); ++index) {
+            if (_folded[index]) continue;
+            if (kept != index) instructions[kept] = std::move(instructions[index]);
+            ++kept;
+        }
+        instructions.erase(instructions.begin() + isz(kept), instructions.end());
+    }
+
+private:
+    /// Find the definition of \p op that is read only by the instruction
+    /// at \p reader, which must be the original reader of \p op.
+    [[nodiscard]]
+    auto sole_definition(const MOperand& op, usz reader) const -> std::optional<usz> {
+        if (not is_virtual_register(op)) return std::nullopt;
+        auto reg = std::get<MOperandRegister>(op).value;
+
+        auto definitions = _definitions.find(reg);
+        if (definitions == _definitions.end()) return std::nullopt;
+        const auto& defs = definitions->second;
+        auto next = rgs::lower_bound(defs, reader);
+        if (next == defs.begin()) return std::nullopt;
+        auto definition = *std::prev(next);
+        if (_folded[definition]) return std::nullopt;
+
+        // The reader must be the only one to see this definition. If it is
+        // the last one in the block, then it may also reach reads in other
+        // blocks, or in this one before its first definition.
+        const auto& reads = _reads.at(reg);
+        auto first = rgs::upper_bound(reads, definition);
+        auto last = next == defs.end() ? reads.end() : rgs::upper_bound(reads, *next);
+        if (std::distance(first, last) != 1 or *first != reader) return std::nullopt;
+        if (next == defs.end()) {
+            auto block_reads = std::distance(rgs::upper_bound(reads, defs.front()), reads.end());
+            if (_function_reads.at(reg - +MInst::Kind::ArchStart) != usz(block_reads)) return std::nullopt;
+        }
+
+        auto& inst = _block.instructions()[definition];
+        if (inst.opcode() >= +MInst::Kind::ArchStart or inst.regsize() != 64) return std::nullopt;
+        return definition;
+    }
+
+    /// Whether the register \p op may be written after \p from and
+    /// before \p to. Hardware registers may also be written implicitly
+    /// (by calls, shifts, divisions, ...), and the register allocator
+    /// doesn't know they are live, so they are only ever moved across
+    /// instructions that are folded away, and never into a user that
+    /// needs a temporary register.
+    [[nodiscard]]
+    auto written_between(const MOperand& op, usz from, usz to) const -> bool {
+        if (not std::holds_alternative<MOperandRegister>(op)) return false;
+        if (not is_virtual_register(op)) {
+            if (_user_writes_temporary) return true;
+            for (usz index = from + 1; index < to; ++index)
+                if (not _folded[index]) return true;
+            return false;
+        }
+        auto definitions = _definitions.find(std::get<MOperandRegister>(op).value);
+        if (definitions == _definitions.end()) return false;
+        auto next = rgs::upper_bound(definitions->second, from);
+        return next != definitions->second.end() and *next < to;
+    }
+
+    /// If \p op is a register holding a multiple of 1, 2, 4, or 8 of
+    /// some other register, or that register shifted left by at most 3,
+    /// absorb its definition into an index.
+    [[nodiscard]]
+    auto scaled_index(const MOperand& op, usz reader, usz user) -> std::pair<MOperandRegister, usz> {
+        if (auto definition = sole_definition(op, reader)) {
+            auto& inst = _block.instructions()[*definition];
+            auto is_mul = inst.kind() == MInst::Kind::Mul;
+            auto is_shl = inst.kind() == MInst::Kind::Shl;
+            if ((is_mul or is_shl) and inst.all_operands().size() == 2) {
+                auto lhs = inst.get_operand(0);
+                auto rhs = inst.get_operand(1);
+                if (std::holds_alternative<MOperandImmediate>(rhs)) std::swap(lhs, rhs);
+                if (
+                    std::holds_alternative<MOperandImmediate>(lhs)
+                    and is_address_register(rhs)
+                    and (is_mul or std::holds_alternative<MOperandImmediate>(inst.get_operand(1)))
+                ) {
+                    auto scale = std::get<MOperandImmediate>(lhs).value;
+                    if (is_shl) scale = scale <= 3 ? usz(1) << scale : 0;
+                    if (
+                        (scale == 1 or scale == 2 or scale == 4 or scale == 8)
+                        and not written_between(rhs, *definition, user)
+                    ) {
+                        _folded[*definition] = true;
+                        return {std::get<MOperandRegister>(rhs), scale};
+                    }
+                }
+            }
+        }
+        return {std::get<MOperandRegister>(op), 1};
+    }
+
+    /// Fold the computation of the address operand \p operand_index of
+    /// the instruction at \p user into it.
+    void fold_into(usz user, usz operand_index) {
+        auto& operands = _block.instructions()[user].all_operands();
+        Address address{operands[operand_index]};
+
+        // Immediates are stored through a temporary register.
+        _user_writes_temporary = std::holds_alternative<MOperandImmediate>(operands[0])
+                             and _block.instructions()[user].kind() == MInst::Kind::Store;
+
+        bool changed = false;
+        for (usz reader = user;;) {
+            auto definition = sole_definition(address.base, reader);
+            if (not definition) break;
+
+            auto& inst = _block.instructions()[*definition];
+            const auto& ops = inst.all_operands();
+            auto is_base = [&](const MOperand& op) {
+                return (is_address_register(op) and not written_between(op, *definition, user))
+                    or (std::holds_alternative<MOperandLocal>(op) and not address.index);
+            };
+
+            Address folded{address};
+            if (inst.kind() == MInst::Kind::Copy and ops.size() == 1 and is_base(ops[0])) {
+                folded.base = ops[0];
+            } else if (inst.kind() == MInst::Kind::Add and ops.size() == 2) {
+                auto lhs = ops[0];
+                auto rhs = ops[1];
+                if (std::holds_alternative<MOperandImmediate>(lhs)) std::swap(lhs, rhs);
+
+                // base + displacement
+                if (std::holds_alternative<MOperandImmediate>(rhs) and is_base(lhs)) {
+                    folded.base = lhs;
+                    folded.displacement += i64(std::get<MOperandImmediate>(rhs).value);
+                }
+
+                // base + index * scale
+                else if (
+                    not address.index
+                    and is_address_register(lhs) and is_address_register(rhs)
+                    and not written_between(lhs, *definition, user)
+                    and not written_between(rhs, *definition, user)
+                ) {
+                    // This add is folded either way (and the displacement
+                    // doesn't change), so mark it now; hardware registers
+                    // may then be moved across it into the index.
+                    _folded[*definition] = true;
+                    auto [index, scale] = scaled_index(rhs, *definition, user);
+                    folded.base = lhs;
+                    folded.index = index;
+                    folded.scale = scale;
+                } else break;
+            } else break;
+
+            auto displacement = folded.displacement;
+            if (std::holds_alternative<MOperandLocal>(folded.base))
+                displacement += std::get<MOperandLocal>(folded.base).offset;
+            if (
+                displacement < std::numeric_limits<i32>::min()
+                or displacement > std::numeric_limits<i32>::max()
+            ) break;
+
+            _folded[*definition] = true;
+            address = folded;
+            reader = *definition;
+            changed = true;
+        }
+
+        if (not changed) return;
+
+        // Locals have their own offset; registers get the displacement (and
+        // index) as extra operands.
+        if (std::holds_alternative<MOperandLocal>(address.base)) {
+            auto local = std::get<MOperandLocal>(address.base);
+            local.offset = i32(local.offset + address.displacement);
+            operands[operand_index] = local;
+            return;
+        }
+
+        operands[operand_index] = address.base;
+        if (address.displacement or address.index)
+            operands.push_back(MOperandImmediate(u64(address.displacement), 32));
+        if (address.index) {
+            operands.push_back(*address.index);
+            operands.push_back(MOperandImmediate(address.scale, 8));
+        }
+    }
+};
+
+/// Fold address computations into loads and stores in every block.
+void fold_addresses(MFunction& function) {
+    std::vector<usz> reads(function.vreg_end() - +MInst::Kind::ArchStart);
+    for (auto& block : function.blocks())
+        for (auto& inst : block.instructions())
+            for (const auto& op : inst.all_operands())
+                if (is_virtual_register(op)) ++reads.at(std::get<MOperandRegister>(op).value - +MInst::Kind::ArchStart);
+
+    for (auto& block : function.blocks())
+        AddressFolder{block, reads}.run();
+}
+} // namespace
+
 void select_instructions(Module* mod, MFunction& function) {
     // Don't selection instructions for empty functions.
     if (function.blocks().empty()) return;
 
     if (mod->context()->target()->is_arch_x86_64()) {
+        fold_addresses(function);
         function = lcc::isel::x86_64::AllPatterns::rewrite(mod, function);
 
         // In-code instruction selection. Ideally, we wouldn't have to do this at
@@ -96,6 +465,47 @@ void select_instructions(Module* mod, MFunction& function) {
         for (auto& block : function.blocks()) {
             for (usz index = 0; index < block.instructions().size(); ++index) {
                 MInst& inst = block.instructions().at(index);
+
+                // Arithmetic only takes 32-bit immediates, which are sign
+                // extended for 64-bit operations; larger ones have to be
+                // moved into a register first.
+                //
+                // M.Multiply $0xaaaaaaab, r1.64
+                // becomes the following machine code, GNU syntax
+                //     mov $0xaaaaaaab, %r2.64
+                //     imul %r2.64, %r1.64
+                if (has_wide_immediate(inst)) {
+                    auto imm = std::get<MOperandImmediate>(inst.get_operand(0));
+                    auto reg = MOperandRegister{function.next_vreg(), uint(imm.size)};
+                    inst.all_operands()[0] = reg;
+
+                    auto mov_imm = MInst(usz(x86_64::Opcode::Move), {0, 0});
+                    mov_imm.add_operand(imm);
+                    mov_imm.add_operand(reg);
+                    block.instructions().insert(block.instructions().begin() + isz(index++), mov_imm);
+                    continue;
+                }
+
+                // There is no 8-bit multiplication by an immediate, but the
+                // low byte of a product only depends on the low bytes of
+                // its factors, so multiply the whole 32-bit register.
+                //
+                // M.Multiply $6, r1.8
+                // becomes the following machine code, GNU syntax
+                //     imul $6, %r1.32
+                if (
+                    inst.opcode() == +x86_64::Opcode::Multiply
+                    and inst.all_operands().size() == 2
+                    and std::holds_alternative<MOperandImmediate>(inst.get_operand(0))
+                    and std::holds_alternative<MOperandRegister>(inst.get_operand(1))
+                    and std::get<MOperandRegister>(inst.get_operand(1)).size == 8
+                ) {
+                    auto reg = std::get<MOperandRegister>(inst.get_operand(1));
+                    reg.size = 32;
+                    inst.all_operands()[1] = reg;
+                    continue;
+                }
+
                 switch (inst.kind()) {
                     // Rewrite truncates into bitwise ands.
                     //
@@ -0,0 +1,97 @@
+#include <lcc/codegen/liveness.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/utils.hh>
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lcc {
+
+namespace {
+/// The effect of a block on a live set, walking backwards over it:
+/// live-in = (live-out - kill) | gen.
+struct BlockSummary {
+    RegisterSet gen;
+    RegisterSet kill;
+
+    explicit BlockSummary(usz size) : gen(size), kill(size) {}
+
+    void insert(usz i) { gen.insert(i); }
+    void erase(usz i) {
+        gen.erase(i);
+        kill.insert(i);
+    }
+};
+} // namespace
+
+Liveness::Liveness(const MFunction& function, const RegisterIndex& indices, usz register_count) {
+    const auto& blocks = function.blocks();
+    _live_in.assign(blocks.size(), RegisterSet{register_count});
+    _live_out.assign(blocks.size(), RegisterSet{register_count});
+    if (blocks.empty()) return;
+
+    std::unordered_map<std::string_view, usz> block_indices{};
+    for (usz i = 0; i < blocks.size(); i++) block_indices[blocks[i].name()] = i;
+
+    // Resolve successors and summarise each block.
+    std::vector<std::vector<usz>> successors(blocks.size());
+    std::vector<BlockSummary> summaries{};
+    summaries.reserve(blocks.size());
+    for (usz i = 0; i < blocks.size(); i++) {
+        for (const auto& name : blocks[i].successors()) {
+            auto it = block_indices.find(name);
+            LCC_ASSERT(it != block_indices.end(), "Successor {} of block {} does not exist", name, blocks[i].name());
+            successors[i].push_back(it->second);
+        }
+
+        auto& summary = summaries.emplace_back(register_count);
+        for (auto& inst : blocks[i].instructions() | vws::reverse) {
+            KillDefinitions(inst, indices, summary);
+            AddUses(inst, indices, summary);
+        }
+    }
+
+    // Order blocks so that successors come before their predecessors
+    // wherever possible; unreachable blocks go at the end.
+    std::vector<usz> order{};
+    std::vector<bool> seen(blocks.size());
+    std::vector<std::pair<usz, usz>> stack{{0, 0}};
+    seen[0] = true;
+    while (not stack.empty()) {
+        auto& [block, next] = stack.back();
+        if (next < successors[block].size()) {
+            auto succ = successors[block][next++];
+            if (not seen[succ]) {
+                seen[succ] = true;
+                stack.emplace_back(succ, 0);
+            }
+            continue;
+        }
+        order.push_back(block);
+        stack.pop_back();
+    }
+    for (usz i = 0; i < blocks.size(); i++)
+        if (not seen[i]) order.push_back(i);
+
+    // Iterate to a fixpoint.
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto b : order) {
+            RegisterSet out{register_count};
+            for (auto succ : successors[b]) out |= _live_in[succ];
+
+            RegisterSet in = out;
+            in -= summaries[b].kill;
+            in |= summaries[b].gen;
+
+            _live_out[b] = std::move(out);
+            if (in != _live_in[b]) {
+                _live_in[b] = std::move(in);
+                changed = true;
+            }
+        }
+    }
+}
+
+} // namespace lcc
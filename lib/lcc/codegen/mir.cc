@@ -56,6 +56,7 @@ auto PrintMInstImpl(const MInst& inst, auto&& inst_opcode) -> std::string {
              or inst.kind() == MInst::Kind::Branch
              or inst.kind() == MInst::Kind::CondBranch
              or inst.kind() == MInst::Kind::Return
+             or inst.kind() == MInst::Kind::TailCall
              or inst.kind() == MInst::Kind::Unreachable))
         // clang-format on
         return fmt::format(
@@ -166,4 +167,24 @@ auto PrintMIR(std::vector<GlobalVariable*>& vars, std::vector<MFunction>& mcode)
     );
 };
 
+void TraceMFunction(Trace::Event& event, const MFunction& function) {
+    if (not event) return;
+    event.arg("function", function.names().at(0).name);
+    event.arg("instructions", function.instruction_count());
+}
+
+void CountMInstructions(MemReport* report, const std::vector<MFunction>& functions) {
+    usz instructions = 0;
+    usz bytes = 0;
+    for (auto& function : functions) {
+        for (auto& block : function.blocks()) {
+            instructions += block.instructions().size();
+            bytes += block.instructions().capacity() * sizeof(MInst);
+            for (auto& inst : block.instructions()) bytes += inst.operand_storage();
+        }
+    }
+    report->count("MIR instructions", instructions);
+    report->count("MIR instruction bytes", bytes);
+}
+
 } // namespace lcc
@@ -0,0 +1,18 @@
+#include <lcc/codegen/isel.hh>
+#include <lcc/codegen/mir.hh>
+#include <lcc/codegen/peephole.hh>
+#include <lcc/codegen/x86_64/peephole_patterns.hh>
+#include <lcc/context.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/target.hh>
+
+namespace lcc {
+
+void peephole_optimise(Module* mod, MFunction& function) {
+    if (function.blocks().empty()) return;
+
+    if (mod->context()->target()->is_arch_x86_64())
+        function = isel::x86_64::peephole::AllPatterns::rewrite(mod, function);
+}
+
+} // namespace lcc
@@ -1,45 +1,66 @@
+#include <lcc/codegen/liveness.hh>
 #include <lcc/codegen/mir.hh>
+#include <lcc/codegen/mir_utils.hh>
 #include <lcc/codegen/register_allocation.hh>
 #include <lcc/codegen/x86_64/x86_64.hh>
 #include <lcc/utils.hh>
 
 #include <algorithm>
 #include <memory>
+#include <numeric>
 #include <ranges>
 #include <string>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
 namespace lcc {
 
-struct AdjacencyMatrix {
-    std::unique_ptr<bool[]> data;
-    usz size;
+/// Interference graph over the registers of a function, by index into
+/// its register list. Only edges that are actually present are stored.
+class InterferenceGraph {
+    std::vector<std::vector<usz>> adjacencies;
+    std::unordered_set<u64> edges;
 
-    explicit AdjacencyMatrix(usz sz) : data(std::make_unique<bool[]>(sz * sz)), size(sz) {}
-
-    [[nodiscard]]
-    auto coord(usz x, usz y) const -> usz {
-        LCC_ASSERT(x < size, "AdjacencyMatrix: X out of bounds");
-        LCC_ASSERT(y < size, "AdjacencyMatrix: Y out of bounds");
-        LCC_ASSERT(x != y, "AdjacencyMatrix: X and Y are equal; must not set adjacency with self");
-        return y * size + x;
+    static auto key(usz x, usz y) -> u64 {
+        return (u64(std::min(x, y)) << 32) | u64(std::max(x, y));
     }
 
+public:
+    explicit InterferenceGraph(usz size) : adjacencies(size) {}
+
+    /// Get the indices of all registers that interfere with a register.
     [[nodiscard]]
-    auto at(usz x, usz y) const -> bool {
-        return data[coord(x, y)];
-    }
+    auto adjacent(usz x) const -> const std::vector<usz>& { return adjacencies.at(x); }
 
+    /// Record that two registers interfere.
     void set(usz x, usz y) {
+        LCC_ASSERT(x < adjacencies.size(), "InterferenceGraph: X out of bounds");
+        LCC_ASSERT(y < adjacencies.size(), "InterferenceGraph: Y out of bounds");
         if (x == y) return;
-        data[coord(x, y)] = true;
+        if (not edges.insert(key(x, y)).second) return;
+        adjacencies[x].push_back(y);
+        adjacencies[y].push_back(x);
     }
 
-    void clear(usz x, usz y) {
-        if (x == y) return;
-        data[coord(x, y)] = false;
+    /// Check whether two registers interfere.
+    [[nodiscard]]
+    auto interferes(usz x, usz y) const -> bool { return edges.contains(key(x, y)); }
+
+    /// Merge register \p y into register \p x: everything that interfered
+    /// with y now interferes with x instead, and y is left without edges.
+    void merge(usz x, usz y) {
+        for (usz t : adjacencies[y]) {
+            edges.erase(key(y, t));
+            std::erase(adjacencies[t], y);
+            set(x, t);
+        }
+        adjacencies[y].clear();
     }
+
+    /// Get the number of pairs of registers that interfere.
+    [[nodiscard]]
+    auto edge_count() const -> usz { return edges.size(); }
 };
 
 struct AdjacencyList {
@@ -83,10 +104,7 @@ struct AdjacencyList {
         for (usz adj_i : adjacencies) {
             if (not first) out += ", ";
             else first = false;
-            auto found = std::find_if(lists.begin(), lists.end(), [&](const AdjacencyList& l) {
-                return adj_i == l.value;
-            });
-            out += lists.at(usz(found - lists.begin())).string_base();
+            out += lists.at(adj_i).string_base();
         }
         return out;
     }
@@ -95,48 +113,26 @@ struct AdjacencyList {
 namespace {
 
 void collect_interferences_from_block(
-    AdjacencyMatrix& matrix,
-    std::vector<Register>& registers,
-    MFunction& function,
-    std::vector<usz> live_values,
-    std::vector<MBlock*> visited,
-    std::vector<MBlock*> doubly_visited,
-    MBlock* block
+    const MachineDescription& desc,
+    InterferenceGraph& graph,
+    const RegisterIndex& indices,
+    RegisterSet live_values,
+    MBlock& block
 ) {
-    /// Don't visit the same block thrice.
-    if (std::find(visited.begin(), visited.end(), block) != visited.end()) {
-        if (std::find(doubly_visited.begin(), doubly_visited.end(), block) != doubly_visited.end())
-            return;
-        doubly_visited.push_back(block);
-    } else visited.push_back(block);
-
-    const auto live_idx_from_register_value = [&](usz value) -> usz {
-        auto found = std::find_if(registers.begin(), registers.end(), [&](const Register& r) {
-            return value == r.value;
-        });
-        LCC_ASSERT(found != registers.end(), "Did not find referenced register in register list");
-        return usz(found - registers.begin());
-    };
     const auto live_idx_from_register = [&](Register reg) -> usz {
-        return live_idx_from_register_value(reg.value);
+        return indices[reg.value];
     };
 
     // Basically, walk over the instructions of the block backwards, keeping
     // track of all virtual registers that have been encountered but not
     // their defining use, as these are our "live values".
-    for (auto& inst : block->instructions() | vws::reverse) {
+    for (auto& inst : block.instructions() | vws::reverse) {
         // fmt::print("{}\n", PrintMInstImpl(inst, x86_64::opcode_to_string));
         // fmt::print("live after: {}\n", fmt::join(live_values, ", "));
 
         // If the defining use of a virtual register is an operand of this
         // instruction, remove it from vector of live vals.
-        if (inst.is_defining()) std::erase(live_values, inst.reg());
-        for (auto& op : inst.all_operands()) {
-            if (std::holds_alternative<MOperandRegister>(op)) {
-                auto reg = std::get<MOperandRegister>(op);
-                if (reg.defining_use) std::erase(live_values, reg.value);
-            }
-        }
+        KillDefinitions(inst, indices, live_values);
 
         // fmt::print("live during: {}\n", fmt::join(live_values, ", "));
 
@@ -148,10 +144,20 @@ void collect_interferences_from_block(
             if (std::holds_alternative<MOperandRegister>(op)) {
                 auto reg = std::get<MOperandRegister>(op);
                 auto live_idx = live_idx_from_register(reg);
-                for (auto live : live_values) {
-                    matrix.set(live_idx_from_register_value(live), live_idx);
+                live_values.for_each([&](usz live) {
+                    graph.set(live, live_idx);
                     // fmt::print("Clobber r{} interferes with live value r{}\n", reg.value, live);
-                }
+                });
+            }
+        }
+
+        // A call clobbers every caller-saved register, so everything that
+        // is live across it interferes with them.
+        if (inst.opcode() == desc.call_opcode) {
+            usz caller_saved = desc.caller_saved_mask();
+            for (usz reg = 0; caller_saved; reg++, caller_saved >>= 1) {
+                if (not(caller_saved & 1)) continue;
+                live_values.for_each([&](usz live) { graph.set(live, indices[reg]); });
             }
         }
 
@@ -205,7 +211,7 @@ void collect_interferences_from_block(
                     rgs::find(clobbered_regs, A.reg.value) == clobbered_regs.end()
                     and rgs::find(clobbered_regs, B.reg.value) == clobbered_regs.end()
                 ) {
-                    matrix.set(A.idx, B.idx);
+                    graph.set(A.idx, B.idx);
                     // fmt::print("Non-clobbered register operands r{} and r{} interfere\n", A.reg.value, B.reg.value);
                 }
             }
@@ -219,85 +225,151 @@ void collect_interferences_from_block(
         //     MoveDereferenceLHS(v0, v1, 40) clobbers 1st operand
         // RESULT
         //     Both v0 and v1 interfere with both v3 and v7.
-        for (auto r : vreg_operands) {
-            for (auto live : live_values)
-                matrix.set(r.idx, live_idx_from_register_value(live));
-        }
+        for (auto r : vreg_operands)
+            live_values.for_each([&](usz live) { graph.set(r.idx, live); });
 
         // If a virtual register is not live and is seen as an operand, it is
-        // added to the vector of live values.
-        for (auto r : vreg_operands) {
-            if (
-                not r.reg.defining_use
-                and std::find(live_values.begin(), live_values.end(), r.reg.value) == live_values.end()
-            ) {
-                live_values.push_back(r.reg.value);
-            }
-        }
-        // Handle the case of a non-defining register operand in use of the
-        // instruction that defines that register.
-        if (inst.is_defining()) std::erase(live_values, inst.reg());
+        // added to the set of live values.
+        AddUses(inst, indices, live_values);
 
         // fmt::print("live before: {}\n", fmt::join(live_values, ", "));
 
     } // for inst
+}
+
+void collect_interferences(
+    const MachineDescription& desc,
+    InterferenceGraph& graph,
+    const RegisterIndex& indices,
+    usz register_count,
+    MFunction& function
+) {
+    // Each block starts out with whatever is live on exit from it, so
+    // a single walk over every block finds all interferences.
+    Liveness liveness{function, indices, register_count};
+    for (auto [i, block] : vws::enumerate(function.blocks()))
+        collect_interferences_from_block(desc, graph, indices, liveness.live_out(usz(i)), block);
+}
 
-    // Walk CFG backwards (follow predecessors)
+/// Registers that have been coalesced share a representative, which is
+/// the one that is actually coloured.
+class Coalescing {
+    std::vector<usz> parents;
 
-    // No predecessors == entry block: done walking.
-    if (block->predecessors().empty()) return;
+public:
+    explicit Coalescing(usz size) : parents(size) { std::iota(parents.begin(), parents.end(), usz(0)); }
 
-    // Follow all predecessors, resetting live values to what they are now
-    // before each one.
-    for (const auto& parent_name : block->predecessors()) {
-        auto* parent = function.block_by_name(parent_name);
-        auto live_values_copy{live_values};
-        collect_interferences_from_block(matrix, registers, function, live_values_copy, visited, doubly_visited, parent);
+    /// Get the representative of a register.
+    [[nodiscard]]
+    auto find(usz x) -> usz {
+        while (parents[x] != x) x = parents[x] = parents[parents[x]];
+        return x;
     }
-}
 
-void collect_interferences(AdjacencyMatrix& matrix, std::vector<Register>& registers, MFunction& function) {
-    std::vector<MBlock*> exits{};
+    /// Make \p into the representative of \p from, which must both be
+    /// representatives.
+    void join(usz into, usz from) { parents[from] = into; }
+};
+
+/// Coalesce the operands of register-to-register moves that do not
+/// interfere, so that they are given the same colour and the move
+/// becomes a move from a register into itself.
+///
+/// This is conservative, i.e. it never turns a graph that we could
+/// colour into one that we can't: two virtual registers are only merged
+/// if the result has fewer than k neighbours of significant degree
+/// (Briggs), and a virtual register is only merged into a hardware
+/// register if each of its neighbours already interferes with that
+/// hardware register or is of insignificant degree (George). Hardware
+/// registers always count as significant, since they can't be coloured
+/// differently to get out of the way. Both operands of a move are of
+/// the same size, so k is the number of registers of their class.
+///
+/// \return The number of registers that were merged into another.
+auto coalesce_moves(
+    const MachineDescription& desc,
+    MFunction& function,
+    const std::vector<Register>& registers,
+    const RegisterIndex& indices,
+    InterferenceGraph& graph,
+    Coalescing& coalescing
+) -> usz {
+    const auto is_virtual = [&](usz i) { return registers[i].value >= +MInst::Kind::ArchStart; };
+
+    std::vector<std::pair<usz, usz>> moves{};
     for (auto& block : function.blocks()) {
-        if (block.successors().empty())
-            exits.push_back(&block);
+        for (auto& inst : block.instructions()) {
+            if (inst.opcode() != desc.move_opcode or not is_reg_reg(inst)) continue;
+            auto [src, dst] = extract_reg_reg(inst);
+            if (src.value == dst.value or src.size != dst.size) continue;
+            if (src.value < +MInst::Kind::ArchStart and dst.value < +MInst::Kind::ArchStart) continue;
+            moves.emplace_back(indices[src.value], indices[dst.value]);
+        }
     }
 
-    LCC_ASSERT(not exits.empty(), "Cannot walk CFG as function {} has no exit blocks", function.names().at(0).name);
-
-    // fmt::print(
-    //     "Collected following exit blocks for function {}: {}\n",
-    //     function.names().at(0).name,
-    //     fmt::join(vws::transform(exits, [](MBlock* b) { return b->name(); }), ", ")
-    // );
-
-    // From each exit block (collected above), follow control flow to the
-    // root of the function (entry block), or to a block already visited.
-    for (auto* exit : exits)
-        collect_interferences_from_block(matrix, registers, function, {}, {}, {}, exit);
-}
+    // Merging two registers may make another pair coalescable, e.g. by
+    // lowering the degree of a neighbour, so iterate until nothing changes.
+    usz merged = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto [src, dst] : moves) {
+            usz x = coalescing.find(src);
+            usz y = coalescing.find(dst);
+            if (x == y or graph.interferes(x, y)) continue;
+
+            // If either is a hardware register, it must be x.
+            if (not is_virtual(y)) std::swap(x, y);
+            if (not is_virtual(y)) continue;
+
+            const auto& allocatable = desc.registers_for(registers[y].size);
+            const usz k = allocatable.size();
+            bool conservative{};
+            if (not is_virtual(x)) {
+                const auto harmless = [&](usz t) {
+                    return not is_virtual(t) or graph.interferes(t, x) or graph.adjacent(t).size() < k;
+                };
+                conservative = rgs::find(allocatable, registers[x].value) != allocatable.end()
+                           and rgs::all_of(graph.adjacent(y), harmless);
+            } else {
+                usz significant = 0;
+                const auto count = [&](usz t, bool shared) {
+                    if (not is_virtual(t) or graph.adjacent(t).size() - shared >= k) significant++;
+                };
+                for (usz t : graph.adjacent(x)) count(t, graph.interferes(t, y));
+                for (usz t : graph.adjacent(y))
+                    if (not graph.interferes(t, x)) count(t, false);
+                conservative = significant < k;
+            }
 
-} // namespace
+            if (not conservative) continue;
+            graph.merge(x, y);
+            coalescing.join(x, y);
+            merged++;
+            changed = true;
+        }
+    }
 
-void allocate_registers(const MachineDescription& desc, MFunction& function) {
-    // Don't allocate registers for empty functions.
-    if (function.blocks().empty()) return;
+    return merged;
+}
 
-    // Steps:
-    //   1. Collect all existing registers, both hardware and virtual.
-    //   2. Walk control flow in reverse, build adjacency matrix as you go.
-    //   3. Build adjacency lists from adjacency matrix.
-    //   4. Figure out order that registers should be allocated in: call this
-    //      list the "coloring stack".
-    //   5. Assign colors to registers, ensuring no overlap (adjacencies), in
-    //      order of the coloring stack.
-    //     5a. TODO If we can't color with the existing stack, spill a register
-    //         and retry.
-    //   6. Map colors to registers, updating all register operands to the
-    //      allocated register.
+/// Delete moves from a register into itself, which coalescing leaves
+/// behind.
+///
+/// \return The number of moves deleted.
+auto remove_redundant_moves(const MachineDescription& desc, MFunction& function) -> usz {
+    usz removed = 0;
+    for (auto& block : function.blocks()) {
+        removed += usz(std::erase_if(block.instructions(), [&](MInst& inst) {
+            if (inst.opcode() != desc.move_opcode or not is_reg_reg(inst)) return false;
+            auto [src, dst] = extract_reg_reg(inst);
+            return src.value == dst.value and src.size == dst.size;
+        }));
+    }
+    return removed;
+}
 
-    // STEP -1
-    // Replace explicit return registers with the actual return register...
+/// Replace explicit return registers with the actual return register.
+void replace_return_register(const MachineDescription& desc, MFunction& function) {
     for (auto& block : function.blocks()) {
         for (auto& inst : block.instructions()) {
             if (inst.reg() == desc.return_register_to_replace)
@@ -313,26 +385,24 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
             }
         }
     }
+}
 
-    // TODO: We need the context here (or the module so we can get to the
-    // context) so that we can query if target is actually x86_64.
-    // fmt::print(
-    //    "Return register replaced.\n{}\n",
-    //    PrintMFunctionImpl(function, x86_64::opcode_to_string)
-    //);
-
-    // STEP ONE
-    // Populate list of registers, first using hardware registers, then using virtual registers.
-    std::vector<Register> registers{};
+/// Populate the list of registers of a function, first using hardware
+/// registers, then using virtual registers.
+void collect_registers(
+    const MachineDescription& desc,
+    MFunction& function,
+    std::vector<Register>& registers,
+    RegisterIndex& indices
+) {
     // Helper function that handles not adding duplicates.
     auto add_reg = [&](usz id, usz size) {
-        auto found = std::find_if(registers.begin(), registers.end(), [&](Register& r) {
-            return r.value == id;
-        });
-        if (found == registers.end())
+        if (indices.add(id, registers.size()))
             registers.push_back(Register{id, uint(size)});
     };
-    for (auto [index, reg] : vws::enumerate(desc.registers))
+    for (auto reg : desc.registers)
+        add_reg(reg, 0);
+    for (auto reg : desc.vector_registers)
         add_reg(reg, 0);
 
     for (auto& block : function.blocks()) {
@@ -346,6 +416,97 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
             }
         }
     }
+}
+
+/// Get the number of virtual registers among the collected registers.
+auto count_virtual_registers(const std::vector<Register>& registers) -> usz {
+    return usz(rgs::count_if(registers, [](const Register& r) {
+        return r.value >= +MInst::Kind::ArchStart;
+    }));
+}
+
+/// Estimate how expensive it would be to spill each register: every
+/// time it is defined or used adds how often its block runs, which is
+/// the block's profile count if we have one, and 1 otherwise. Costs of
+/// coalesced registers go to their representative.
+void collect_spill_costs(
+    MFunction& function,
+    const RegisterIndex& indices,
+    Coalescing& coalescing,
+    std::vector<AdjacencyList>& lists
+) {
+    for (auto& block : function.blocks()) {
+        const usz weight = block.profile_count().value_or(1);
+        for (auto& inst : block.instructions()) {
+            if (inst.reg() >= +MInst::Kind::ArchStart)
+                lists.at(coalescing.find(indices[inst.reg()])).spill_cost += weight;
+            for (auto& op : inst.all_operands()) {
+                if (not std::holds_alternative<MOperandRegister>(op)) continue;
+                auto reg = std::get<MOperandRegister>(op);
+                if (reg.value < +MInst::Kind::ArchStart) continue;
+                lists.at(coalescing.find(indices[reg.value])).spill_cost += weight;
+            }
+        }
+    }
+}
+
+/// Update all references to virtual registers with the hardware
+/// registers they were assigned.
+template <typename ColourOf>
+void assign_registers(MFunction& function, ColourOf color_of) {
+    for (auto& block : function.blocks()) {
+        for (auto& instruction : block.instructions()) {
+            instruction.reg(color_of(instruction.reg()));
+            for (auto& op : instruction.all_operands()) {
+                if (std::holds_alternative<MOperandRegister>(op)) {
+                    MOperandRegister reg = std::get<MOperandRegister>(op);
+                    reg.value = color_of(reg.value);
+                    op = reg;
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+auto allocate_registers(const MachineDescription& desc, MFunction& function) -> RegisterAllocationStats {
+    RegisterAllocationStats stats{};
+
+    // Don't allocate registers for empty functions.
+    if (function.blocks().empty()) return stats;
+
+    // Steps:
+    //   1. Collect all existing registers, both hardware and virtual.
+    //   2. Walk control flow in reverse, build adjacency matrix as you go.
+    //     2a. Coalesce moves between registers that don't interfere.
+    //   3. Build adjacency lists from adjacency matrix.
+    //   4. Figure out order that registers should be allocated in: call this
+    //      list the "coloring stack".
+    //   5. Assign colors to registers, ensuring no overlap (adjacencies), in
+    //      order of the coloring stack.
+    //     5a. TODO If we can't color with the existing stack, spill a register
+    //         and retry.
+    //   6. Map colors to registers, updating all register operands to the
+    //      allocated register, and delete moves that became redundant.
+
+    // STEP -1
+    // Replace explicit return registers with the actual return register...
+    replace_return_register(desc, function);
+
+    // TODO: We need the context here (or the module so we can get to the
+    // context) so that we can query if target is actually x86_64.
+    // fmt::print(
+    //    "Return register replaced.\n{}\n",
+    //    PrintMFunctionImpl(function, x86_64::opcode_to_string)
+    //);
+
+    // STEP ONE
+    // Populate list of registers, first using hardware registers, then using virtual registers.
+    std::vector<Register> registers{};
+    RegisterIndex indices{function.vreg_end()};
+    collect_registers(desc, function, registers, indices);
+    stats.virtual_registers = count_virtual_registers(registers);
 
     // Error if zero registers collected.
     // NOTE: We could technically just return but for the most part this
@@ -358,40 +519,40 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
     );
 
     // STEP TWO
-    // Walk control flow in reverse, build adjacency matrix as you go.
+    // Walk control flow in reverse, build interference graph as you go.
     // We walk in reverse because of how control flow tends to work; a single
     // vreg may have multiple defining uses in different predecessor blocks.
-    AdjacencyMatrix matrix{registers.size()};
+    InterferenceGraph graph{registers.size()};
+
+    // Collect the interferences into the graph by walking CFG in reverse.
+    collect_interferences(desc, graph, indices, registers.size(), function);
+    stats.interference_edges = graph.edge_count();
 
-    // Collect the interferences into the matrix by walking CFG in reverse.
-    collect_interferences(matrix, registers, function);
+    // STEP TWO A
+    // Merge copy-related registers; from here on, only the representative
+    // of each set of merged registers is coloured.
+    Coalescing coalescing{registers.size()};
+    usz merged = coalesce_moves(desc, function, registers, indices, graph, coalescing);
 
     // STEP THREE
-    // Build adjacency lists from adjacency matrix
+    // Build adjacency lists from interference graph
     std::vector<AdjacencyList> lists{};
 
     for (auto [i, reg] : vws::enumerate(registers)) {
         AdjacencyList list{};
         list.index = usz(i);
         list.value = reg.value;
+        list.adjacencies = graph.adjacent(usz(i));
         if (list.value < +MInst::Kind::ArchStart) {
             list.color = list.value;
             list.allocated = true;
+        } else if (coalescing.find(usz(i)) != usz(i)) {
+            list.allocated = true;
         }
         lists.push_back(list);
     }
 
-    for (auto [a_idx, a] : vws::enumerate(registers)) {
-        for (auto [b_idx, b] : vws::enumerate(registers)) {
-            if (a_idx == b_idx) break;
-            if (matrix.at(usz(a_idx), usz(b_idx))) {
-                auto& a_list = lists.at(usz(a_idx));
-                auto& b_list = lists.at(usz(b_idx));
-                a_list.adjacencies.push_back(b.value);
-                b_list.adjacencies.push_back(a.value);
-            }
-        }
-    }
+    collect_spill_costs(function, indices, coalescing, lists);
 
     // fmt::print("AdjacencyLists:\n");
     // for (auto list : lists)
@@ -407,10 +568,14 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
         return list.value < +MInst::Kind::ArchStart or list.allocated;
     };
 
-    usz k = desc.registers.size();
+    // The degree < k rule applies per register class.
+    const auto k_of = [&](const AdjacencyList& list) {
+        return desc.registers_for(registers[list.index].size).size();
+    };
+
     // We don't color hardware registers with other hardware registers,
     // so we don't count them.
-    usz count = registers.size() - k;
+    usz count = stats.virtual_registers - merged;
     while (count) {
         /// degree < k rule:
         ///   A graph G is k-colorable if, for every node N in G, the degree
@@ -420,7 +585,7 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
             done = true;
             for (auto [i, list] : vws::enumerate(lists)) {
                 if (should_skip_list(list)) continue;
-                if (list.degree() < k) {
+                if (list.degree() < k_of(list)) {
                     list.allocated = 1;
                     done = false;
                     count--;
@@ -434,11 +599,13 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
             usz min_cost = (usz) -1; /// (!)
             usz node_to_spill = 0;
 
+            /// Prefer registers that are rarely used but get in the way
+            /// of many others.
             for (auto& list : lists) {
-                if (should_skip_list(list)) continue;
-                list.spill_cost = list.degree() ? (list.spill_cost / list.degree()) : 0;
-                if (list.degree() and list.spill_cost <= min_cost) {
-                    min_cost = list.spill_cost;
+                if (should_skip_list(list) or not list.degree()) continue;
+                usz cost = list.spill_cost / list.degree();
+                if (cost <= min_cost) {
+                    min_cost = cost;
                     node_to_spill = list.index;
                     if (not min_cost) break;
                 }
@@ -461,10 +628,7 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
         if (list.value < +MInst::Kind::ArchStart) continue;
         usz register_interferences = list.regmask;
         for (usz i_adj : list.adjacencies) {
-            auto adj_list = std::find_if(lists.begin(), lists.end(), [&](AdjacencyList& l) {
-                return l.value == i_adj;
-            });
-            LCC_ASSERT(adj_list != lists.end(), "Could not find adjacency list corresponding to vreg {}", i_adj);
+            auto* adj_list = &lists.at(i_adj);
             // If any adjacency of the current list is already colored, the current
             // list must not be colored with that color.
             if (adj_list->color) {
@@ -474,7 +638,7 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
         }
 
         usz reg_value = 0;
-        for (auto reg : desc.registers) {
+        for (auto reg : desc.registers_for(registers[i].size)) {
             if (not(register_interferences & (usz(1) << reg))) {
                 reg_value = reg;
                 break;
@@ -482,9 +646,8 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
         }
 
         if (not reg_value) {
-            Diag::Error("Can not color graph with {} colors until stack spilling is implemented!", desc.registers.size());
-            Diag::Note("Allocating registers for function `{}`", function.names().at(0).name);
-            return;
+            stats.spills++;
+            continue;
         }
 
         list.color = reg_value;
@@ -497,30 +660,168 @@ void allocate_registers(const MachineDescription& desc, MFunction& function) {
         // fmt::print("Vreg {} mapped to HWreg {}\n", list.value, list.color);
     }
 
+    // Leave the function alone if we ran out of registers; it is up to the
+    // caller to report that.
+    if (stats.spills) return stats;
+
+    // Registers merged into a hardware register use it, too.
+    for (auto [i, reg] : vws::enumerate(registers)) {
+        auto& representative = lists.at(coalescing.find(usz(i)));
+        if (reg.value >= +MInst::Kind::ArchStart and representative.value < +MInst::Kind::ArchStart)
+            function.registers_used().insert(u8(representative.color));
+    }
+
     // STEP SIX
     // Actually update all references to old virtual registers with newly
     // colored hardware registers.
-    for (auto& list : lists) {
-        // Skip hardware registers (no need to color them).
-        if (list.value < +MInst::Kind::ArchStart) continue;
+    assign_registers(function, [&](usz value) {
+        if (value < +MInst::Kind::ArchStart) return value;
+        auto& list = lists.at(coalescing.find(indices[value]));
         LCC_ASSERT(list.allocated, "AdjacencyList must have a color allocated");
-        usz vreg = list.value;
-        usz color = list.color;
-        for (auto& block : function.blocks()) {
-            for (auto& instruction : block.instructions()) {
-                if (instruction.reg() == vreg) instruction.reg(color);
-                for (auto& op : instruction.all_operands()) {
-                    if (std::holds_alternative<MOperandRegister>(op)) {
-                        MOperandRegister reg = std::get<MOperandRegister>(op);
-                        if (reg.value == vreg) {
-                            reg.value = color;
-                            op = reg;
-                        }
-                    }
+        return list.color;
+    });
+
+    stats.removed_moves = remove_redundant_moves(desc, function);
+    return stats;
+}
+
+auto allocate_registers_linear_scan(const MachineDescription& desc, MFunction& function) -> RegisterAllocationStats {
+    RegisterAllocationStats stats{};
+
+    // Don't allocate registers for empty functions.
+    if (function.blocks().empty()) return stats;
+
+    replace_return_register(desc, function);
+
+    std::vector<Register> registers{};
+    RegisterIndex indices{function.vreg_end()};
+    collect_registers(desc, function, registers, indices);
+    stats.virtual_registers = count_virtual_registers(registers);
+    LCC_ASSERT(
+        not registers.empty(),
+        "Cannot allocate registers when there are no registers to allocate"
+    );
+
+    // Number the instructions in block order, and find for every register
+    // the first and last position at which it may be live, as well as the
+    // hardware registers that are clobbered while it is live, which it must
+    // not be assigned. The clobber rules are the same as those used to
+    // build the interference graph.
+    //
+    // Every instruction gets two positions: registers it reads are live at
+    // the first, and registers it clobbers at the second, so that e.g. in
+    // `mov %v0, %v1` where this is the last use of v0, v1 may be assigned
+    // the same register as v0.
+    struct Interval {
+        usz start = usz(-1);
+        usz end{};
+        usz forbidden{};
+    };
+
+    std::vector<Interval> intervals(registers.size());
+    const usz caller_saved = desc.caller_saved_mask();
+    const auto extend = [&](usz index, usz position) {
+        auto& interval = intervals[index];
+        interval.start = std::min(interval.start, position);
+        interval.end = std::max(interval.end, position);
+    };
+
+    Liveness liveness{function, indices, registers.size()};
+    usz position = 0;
+    for (auto [i, block] : vws::enumerate(function.blocks())) {
+        // One extra position at the end of each block stands for the
+        // edges out of it.
+        usz first = position;
+        usz last = first + 2 * block.instructions().size();
+        liveness.live_in(usz(i)).for_each([&](usz live) { extend(live, first); });
+        liveness.live_out(usz(i)).for_each([&](usz live) { extend(live, last); });
+
+        RegisterSet live_values = liveness.live_out(usz(i));
+        position = last;
+        for (auto& inst : block.instructions() | vws::reverse) {
+            position -= 2;
+            KillDefinitions(inst, indices, live_values);
+
+            std::vector<usz> clobbered_regs{};
+            for (auto index : inst.operand_clobbers()) {
+                auto op = inst.get_operand(index);
+                if (std::holds_alternative<MOperandRegister>(op)) {
+                    auto reg = std::get<MOperandRegister>(op);
+                    clobbered_regs.push_back(reg.value);
+                    if (reg.value >= +MInst::Kind::ArchStart) continue;
+                    live_values.for_each([&](usz live) {
+                        intervals[live].forbidden |= usz(1) << reg.value;
+                    });
                 }
             }
+
+            // A call clobbers every caller-saved register.
+            if (inst.opcode() == desc.call_opcode) {
+                live_values.for_each([&](usz live) {
+                    intervals[live].forbidden |= caller_saved;
+                });
+            }
+
+            if (inst.reg() >= +MInst::Kind::ArchStart)
+                extend(indices[inst.reg()], position);
+            for (auto& op : inst.all_operands()) {
+                if (std::holds_alternative<MOperandRegister>(op)) {
+                    auto reg = std::get<MOperandRegister>(op);
+                    if (reg.value < +MInst::Kind::ArchStart) continue;
+                    bool clobbered = rgs::find(clobbered_regs, reg.value) != clobbered_regs.end();
+                    extend(indices[reg.value], position + clobbered);
+                }
+            }
+
+            AddUses(inst, indices, live_values);
         }
+        position = last + 2;
     }
+
+    // Visit the virtual registers in order of the start of their interval,
+    // giving each the first hardware register that is neither clobbered
+    // during it nor held by an interval that has not ended yet.
+    std::vector<usz> order{};
+    for (auto [i, reg] : vws::enumerate(registers))
+        if (reg.value >= +MInst::Kind::ArchStart) order.push_back(usz(i));
+    rgs::stable_sort(order, {}, [&](usz i) { return intervals[i].start; });
+
+    std::vector<usz> colours(registers.size());
+    std::vector<usz> active{};
+    for (usz i : order) {
+        auto& interval = intervals[i];
+        std::erase_if(active, [&](usz a) { return intervals[a].end < interval.start; });
+
+        usz register_interferences = interval.forbidden;
+        for (usz a : active) register_interferences |= usz(1) << colours[a];
+
+        usz reg_value = 0;
+        for (auto reg : desc.registers_for(registers[i].size)) {
+            if (not(register_interferences & (usz(1) << reg))) {
+                reg_value = reg;
+                break;
+            }
+        }
+
+        if (not reg_value) {
+            stats.spills++;
+            continue;
+        }
+
+        colours[i] = reg_value;
+        active.push_back(i);
+        function.registers_used().insert(u8(reg_value));
+    }
+
+    if (stats.spills) return stats;
+
+    assign_registers(function, [&](usz value) {
+        if (value < +MInst::Kind::ArchStart) return value;
+        return colours[indices[value]];
+    });
+
+    stats.removed_moves = remove_redundant_moves(desc, function);
+    return stats;
 }
 
 } // namespace lcc
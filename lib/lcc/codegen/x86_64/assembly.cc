@@ -8,11 +8,19 @@
 #include <lcc/ir/ir.hh>
 #include <lcc/utils.hh>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <fmt/format.h>
 #include <functional>
+#include <random>
 #include <ranges>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -20,25 +28,137 @@ namespace lcc::x86_64 {
 
 namespace {
 
-// NOTE: Does not handle empty string (because we want every input of this
-// function to produce the same output)
-auto safe_name(std::string in) -> std::string {
-    LCC_ASSERT(not in.empty(), "safe_name does not handle empty string input");
-    // . in the middle of an identifier is not allowed
-    std::replace(in.begin(), in.end(), '.', '_');
-    return fmt::format("{}", in);
-}
+/// Collects assembly text in a buffer, and writes it out to the output
+/// file whenever a chunk's worth of it has accumulated. Everything is
+/// formatted straight into the buffer, so, once that has grown to its
+/// working size, emitting an instruction doesn't allocate. Chunks may
+/// also be collected in memory instead of being written to a file.
+///
+/// A regular output file is written to a temporary file next to it,
+/// which is only renamed into place once all of it has been written, so
+/// a failed emission never leaves a partial output behind.
+class AssemblyWriter {
+    static constexpr usz chunk_size = usz(64) * 1024;
+
+    fs::path _path{};
+    fs::path _target_path{};
+    fs::path _temp_path{};
+    FILE* _file{};
+    std::vector<u8>* _output{};
+    fmt::memory_buffer _buffer{};
+
+public:
+    explicit AssemblyWriter(const fs::path& path) : _path{path} {
+        if (_path == "-") _file = stdout;
+        else {
+            // Anything that isn't a regular file, e.g. /dev/null, must not
+            // be replaced, so write to that directly. Replace what a symlink
+            // points to rather than the symlink itself.
+            std::error_code ec;
+            auto status = fs::status(_path, ec);
+            if (not fs::exists(status) or fs::is_regular_file(status)) {
+                _target_path = fs::is_symlink(fs::symlink_status(_path, ec)) ? fs::canonical(_path, ec) : _path;
+                if (ec) _target_path = _path;
+                _temp_path = _target_path;
+                _temp_path += fmt::format(".{:016x}.tmp", std::random_device{}() | u64(std::random_device{}()) << 32);
+            }
 
-auto block_name(const std::string& in) -> std::string {
-    LCC_ASSERT(not in.empty(), "Cannot emit empty block name!");
-    // ".L" at the beginning tells the assembler it's a local label and not a
-    // function, which helps objdump and things like that don't get confused.
-    return fmt::format(".L{}", safe_name(in));
-}
+            _file = std::fopen((_temp_path.empty() ? _path : _temp_path).string().c_str(), "wb");
+            if (not _file) Fail();
+            // We hand over whole chunks; don't copy them again.
+            std::setvbuf(_file, nullptr, _IONBF, 0);
+        }
+        _buffer.reserve(2 * chunk_size);
+    }
 
-} // namespace
+    explicit AssemblyWriter(std::vector<u8>& output) : _output{&output} {
+        _output->clear();
+        _buffer.reserve(2 * chunk_size);
+    }
+
+    AssemblyWriter(const AssemblyWriter&) = delete;
+    AssemblyWriter& operator=(const AssemblyWriter&) = delete;
+
+    ~AssemblyWriter() {
+        if (not _file or _file == stdout) return;
+        std::fclose(_file);
+        if (not _temp_path.empty()) {
+            std::error_code ec;
+            fs::remove(_temp_path, ec);
+        }
+    }
+
+    template <typename... Args>
+    void format(fmt::format_string<Args...> fmt, Args&&... args) {
+        fmt::format_to(fmt::appender(_buffer), fmt, std::forward<Args>(args)...);
+        flush_if_full();
+    }
+
+    auto operator+=(std::string_view text) -> AssemblyWriter& {
+        _buffer.append(text);
+        flush_if_full();
+        return *this;
+    }
+
+    auto operator+=(char c) -> AssemblyWriter& {
+        _buffer.push_back(c);
+        flush_if_full();
+        return *this;
+    }
+
+    // NOTE: Does not handle empty string (because we want every input of this
+    // function to produce the same output)
+    void safe_name(std::string_view name) {
+        LCC_ASSERT(not name.empty(), "safe_name does not handle empty string input");
+        // . in the middle of an identifier is not allowed
+        auto start = _buffer.size();
+        _buffer.append(name);
+        std::replace(_buffer.begin() + isz(start), _buffer.end(), '.', '_');
+        flush_if_full();
+    }
+
+    void block_name(std::string_view name) {
+        LCC_ASSERT(not name.empty(), "Cannot emit empty block name!");
+        // ".L" at the beginning tells the assembler it's a local label and not a
+        // function, which helps objdump and things like that don't get confused.
+        _buffer.append(std::string_view{".L"});
+        safe_name(name);
+    }
+
+    /// Write out what is left, and close the file.
+    void finish() {
+        flush();
+        if (_output) return;
+        auto* file = std::exchange(_file, nullptr);
+        if (file == stdout ? std::fflush(file) != 0 : std::fclose(file) != 0) Fail();
+        if (_temp_path.empty()) return;
+
+        std::error_code ec;
+        fs::rename(_temp_path, _target_path, ec);
+        if (ec) {
+            auto message = ec.message();
+            fs::remove(_temp_path, ec);
+            Diag::Fatal("Failed to write to file '{}': {}", _path.string(), message);
+        }
+    }
+
+private:
+    void flush_if_full() {
+        if (_buffer.size() >= chunk_size) flush();
+    }
+
+    void flush() {
+        if (_output) _output->insert(_output->end(), _buffer.begin(), _buffer.end());
+        else if (std::fwrite(_buffer.data(), 1, _buffer.size(), _file) != _buffer.size()) Fail();
+        _buffer.clear();
+    }
+
+    [[noreturn]] void Fail() const {
+        Diag::Fatal("Failed to write to file '{}': {}", _path.string(), std::strerror(errno));
+    }
+};
 
-auto ToString(MFunction& function, MOperand op) -> std::string {
+void write_operand(AssemblyWriter& out, MFunction& function, const MOperand& op, FrameBase base = {}) {
     static_assert(
         std::variant_size_v<MOperand> == 6,
         "Exhaustive handling of MOperand alternatives in x86_64 GNU Assembly backend"
@@ -46,87 +166,158 @@ auto ToString(MFunction& function, MOperand op) -> std::string {
     if (std::holds_alternative<MOperandRegister>(op)) {
         // TODO: Assert that register id is one of the x86_64 register ids...
         MOperandRegister reg = std::get<MOperandRegister>(op);
-        return fmt::format(
-            "%{}",
-            ToString(RegisterId(reg.value), reg.size)
-        );
+        out += '%';
+        out += ToString(RegisterId(reg.value), reg.size);
+        return;
     }
     if (std::holds_alternative<MOperandImmediate>(op)) {
-        return fmt::format(
-            "${}",
-            std::get<MOperandImmediate>(op).value
-        );
+        out.format("${}", std::get<MOperandImmediate>(op).value);
+        return;
     }
     if (std::holds_alternative<MOperandLocal>(op)) {
-        return fmt::format(
-            "{}(%rbp)",
-            function.local_offset(std::get<MOperandLocal>(op))
+        out.format(
+            "{}(%{})",
+            function.local_offset(std::get<MOperandLocal>(op)) + base.offset,
+            ToString(base.reg)
         );
+        return;
     }
     if (std::holds_alternative<MOperandGlobal>(op)) {
-        return fmt::format(
-            "{}(%rip)",
-            safe_name(std::get<MOperandGlobal>(op)->names().at(0).name)
-        );
+        out.safe_name(std::get<MOperandGlobal>(op)->names().at(0).name);
+        out += "(%rip)";
+        return;
     }
     if (std::holds_alternative<MOperandFunction>(op)) {
-        return fmt::format(
-            "{}",
-            std::get<MOperandFunction>(op)->names().at(0).name
-        );
+        out += std::get<MOperandFunction>(op)->names().at(0).name;
+        return;
     }
     if (std::holds_alternative<MOperandBlock>(op)) {
-        return fmt::format(
-            "{}",
-            block_name(std::get<MOperandBlock>(op)->name())
-        );
+        out.block_name(std::get<MOperandBlock>(op)->name());
+        return;
     }
     LCC_ASSERT(false, "Unhandled MOperand kind (index {})", op.index());
 }
 
-void emit_gnu_att_assembly(
-    const fs::path& output_path,
+/// Get the mnemonic of an instruction on \p bits-wide vector registers.
+/// 256-bit ones are AVX instructions, which have a `v` prefix.
+auto vector_mnemonic(Opcode opcode, usz bits) -> std::string {
+    std::string mnemonic = bits == 256 ? "v" : "";
+    switch (opcode) {
+        case Opcode::Move: mnemonic += "movdqa"; break;
+        case Opcode::MoveDereferenceLHS:
+        case Opcode::MoveDereferenceRHS: mnemonic += "movdqu"; break;
+        default:
+            LCC_ASSERT(is_packed(opcode), "Unhandled vector instruction {}", ToString(opcode));
+            mnemonic += ToString(opcode);
+    }
+    return mnemonic;
+}
+
+/// Write the memory operand of a dereferencing move, whose base register
+/// is operand \p base_index, followed by the optional offset, index
+/// register, and scale operands: `offset(%base, %index, scale)`.
+void write_memory_operand(AssemblyWriter& out, MFunction& function, MInst& instruction, usz base_index) {
+    const auto& operands = instruction.all_operands();
+    LCC_ASSERT(
+        operands.size() == 2 or operands.size() == 3 or operands.size() == 5,
+        "Dereferencing move may only have offset, index, and scale operands after its source and destination"
+    );
+
+    isz offset = 0;
+    if (operands.size() > 2) {
+        LCC_ASSERT(
+            std::holds_alternative<MOperandImmediate>(operands[2]),
+            "Offset operand of dereferencing move must be an immediate"
+        );
+        offset = i32(std::get<MOperandImmediate>(operands[2]).value);
+    }
+
+    if (offset) out.format("{}", offset);
+    out += '(';
+    write_operand(out, function, operands[base_index]);
+    if (operands.size() == 5) {
+        LCC_ASSERT(
+            std::holds_alternative<MOperandRegister>(operands[3])
+                and std::holds_alternative<MOperandImmediate>(operands[4]),
+            "Index and scale operands of dereferencing move must be a register and an immediate"
+        );
+        out += ", ";
+        write_operand(out, function, operands[3]);
+        out.format(", {}", std::get<MOperandImmediate>(operands[4]).value);
+    }
+    out += ')';
+}
+
+void write_gnu_att_assembly(
+    AssemblyWriter& out,
     Module* module,
     const MachineDescription& desc,
     std::vector<MFunction>& mir
 ) {
-    std::string out{};
-
     // If we ever add optional location information to the MIR (and some
     // eventually trickles through), this would allow somebody to step through
     // the source in a debugger like gdb.
     for (const auto& f : module->context()->files()) {
-        out += fmt::format(
+        out.format(
             "    .file {} \"{}\"\n",
             f->file_id(),
             fs::absolute(f->path()).string()
         );
     }
 
+    const bool function_sections = module->context()->option_function_sections();
+    const bool data_sections = module->context()->option_data_sections();
+
     for (auto* var : module->vars()) {
         // From GNU as manual: `.extern` is accepted in the source program--for
         // compatibility with other assemblers--but it is ignored. `as` treats all
         // undefined symbols as external. That's why imported is ignored.
-        for (auto n : var->names()) {
+        for (const auto& n : var->names()) {
             if (IsExportedLinkage(n.linkage))
-                out += fmt::format("    .globl {}\n", n.name);
+                out.format("    .globl {}\n", n.name);
         }
 
+        // With data sections, every variable defined here goes into a
+        // section of its own; uninitialised ones go into .bss.
+        if (data_sections and not var->init()) {
+            const bool defined = rgs::any_of(var->names(), [](const auto& n) {
+                return not IsImportedLinkage(n.linkage);
+            });
+            if (not defined) continue;
+            out += "    .section .bss.";
+            out.safe_name(var->names().at(0).name);
+            out.format(",\"aw\",@nobits\n    .balign {}\n", var->type()->align_bytes());
+            for (const auto& n : var->names()) {
+                out.safe_name(n.name);
+                out += ":\n";
+            }
+            out.format("    .zero {}\n", var->type()->bytes());
+        }
+
+        // String literals are never written to; those that are a single
+        // string go where the linker can merge them with identical ones,
+        // even with data sections.
         if (var->init()) {
-            for (auto n : var->names())
-                out += fmt::format("{}:\n", safe_name(n.name));
+            if (var->is_mergeable_string()) {
+                out += "    .section .rodata.str1.1,\"aMS\",@progbits,1\n";
+            } else if (data_sections) {
+                out += var->is_string_literal() ? "    .section .rodata." : "    .section .data.";
+                out.safe_name(var->names().at(0).name);
+                out += var->is_string_literal() ? ",\"a\",@progbits\n" : ",\"aw\",@progbits\n";
+            } else {
+                out += var->is_string_literal() ? "    .section .rodata\n" : "    .data\n";
+            }
+            for (const auto& n : var->names()) {
+                out.safe_name(n.name);
+                out += ":\n";
+            }
             switch (var->init()->kind()) {
                 case Value::Kind::ArrayConstant: {
                     auto* array_constant = as<ArrayConstant>(var->init());
-                    out += fmt::format(
-                        "    .byte {}\n",
-                        fmt::join(
-                            vws::transform(*array_constant, [&](char c) {
-                                return fmt::format("0x{:x}", int(c));
-                            }),
-                            ","
-                        )
-                    );
+                    out += "    .byte ";
+                    for (auto [i, c] : vws::enumerate(*array_constant))
+                        out.format("{}0x{:x}", i ? "," : "", int(c));
+                    out += '\n';
                 } break;
 
                 case Value::Kind::IntegerConstant: {
@@ -137,7 +328,7 @@ void emit_gnu_att_assembly(
                     u64 value = integer_constant->value().value();
                     for (usz i = 0; i < integer_constant->type()->bytes(); ++i) {
                         int byte = (value >> (i * 8)) & 0xff;
-                        out += fmt::format("0x{:x}", byte);
+                        out.format("0x{:x}", byte);
                         if (i + 1 < integer_constant->type()->bytes())
                             out += ", ";
                     }
@@ -154,14 +345,18 @@ void emit_gnu_att_assembly(
         }
     }
 
+    // Go back to .text for the functions, unless each of them has its
+    // own section anyway.
+    if (not module->vars().empty() and not function_sections) out += "    .text\n";
+
     for (auto& function : mir) {
         bool imported{false};
-        for (auto n : function.names()) {
+        for (const auto& n : function.names()) {
             // From GNU as manual: `.extern` is accepted in the source program--for
             // compatibility with other assemblers--but it is ignored. `as` treats all
             // undefined symbols as external.
             if (IsExportedLinkage(n.linkage)) {
-                out += fmt::format(
+                out.format(
                     "    .globl {}\n"
                     "    .type {},@function\n",
                     n.name,
@@ -174,8 +369,18 @@ void emit_gnu_att_assembly(
         }
         if (imported) continue;
 
-        for (auto n : function.names())
-            out += fmt::format("{}:\n", n.name);
+        Trace::Event event{module->context(), "Emit Function"};
+        TraceMFunction(event, function);
+
+        if (function_sections) {
+            out.format(
+                "    .section .text.{},\"ax\",@progbits\n",
+                function.names().at(0).name
+            );
+        }
+
+        for (const auto& n : function.names())
+            out.format("{}:\n", n.name);
 
         // TODO: Total hack just to try and get the source to show up at all in a
         // debugger. We would need real location information to properly do this.
@@ -183,7 +388,7 @@ void emit_gnu_att_assembly(
         //   .loc <file-id> <line-number> [ <column-number> ]
         if (function.location().is_valid()) {
             auto l = function.location().seek_line_column(module->context());
-            out += fmt::format(
+            out.format(
                 "    .loc {} {} {}\n",
                 function.location().file_id,
                 l.line,
@@ -195,35 +400,66 @@ void emit_gnu_att_assembly(
         out += "    .cfi_startproc\n";
 
         // Function Header
-        // TODO: Different stack frame kinds.
-        out += "    push %rbp\n";
-        // Update CFA offset, as we now have changed the stack pointer (by 8).
-        // `.cfi_def_cfa_offset` updates CFA offset to new expression, but not register.
-        // `.cfi_offset` notifies saved register rbp location from CFA.
-        out +=
-            "    .cfi_def_cfa_offset 16\n"
-            "    .cfi_offset %rbp, -16\n";
-
-        out += "    mov %rsp, %rbp\n";
-        // Update CFA register, as we now have stored the value of RSP in RBP.
-        out += "    .cfi_def_cfa_register %rbp\n";
-
-        usz stack_frame_size = rgs::fold_left(
-            vws::transform(function.locals(), [](AllocaInst* l) {
-                return l->allocated_type()->bytes();
-            }),
-            0,
-            std::plus{}
-        );
-        if (stack_frame_size) {
-            constexpr usz alignment = 16;
-            stack_frame_size = utils::AlignTo(stack_frame_size, alignment);
-            out += fmt::format("    sub ${}, %rsp\n", stack_frame_size);
+        auto frame = stack_frame(desc, function);
+        switch (frame.kind) {
+            case FrameKind::None: break;
+
+            case FrameKind::Full:
+            case FrameKind::RedZone:
+                out += "    push %rbp\n";
+                // Update CFA offset, as we now have changed the stack pointer (by 8).
+                // `.cfi_def_cfa_offset` updates CFA offset to new expression, but not register.
+                // `.cfi_offset` notifies saved register rbp location from CFA.
+                out +=
+                    "    .cfi_def_cfa_offset 16\n"
+                    "    .cfi_offset %rbp, -16\n";
+
+                out += "    mov %rsp, %rbp\n";
+                // Update CFA register, as we now have stored the value of RSP in RBP.
+                out += "    .cfi_def_cfa_register %rbp\n";
+
+                if (frame.locals_size)
+                    out.format("    sub ${}, %rsp\n", frame.locals_size);
+                break;
+
+            // Allocate the slot RBP would have been saved in along with the
+            // locals, so they are at the same distance from the CFA as in a
+            // full frame. From here on, the CFA moves along with RSP.
+            case FrameKind::NoFramePointer:
+                out.format("    sub ${}, %rsp\n", frame.locals_size + GeneralPurposeBytewidth);
+                out.format("    .cfi_adjust_cfa_offset {}\n", frame.locals_size + GeneralPurposeBytewidth);
+                break;
         }
 
+        // Save the callee-saved registers we use below the locals, and tell
+        // the unwinder where to find them (relative to the CFA, which is 16
+        // bytes above where RBP points in a full frame).
+        for (auto [i, reg] : vws::enumerate(frame.saved_registers)) {
+            auto name = ToString(RegisterId(reg));
+            out.format("    push %{}\n", name);
+            if (frame.kind == FrameKind::NoFramePointer)
+                out.format("    .cfi_adjust_cfa_offset {}\n", GeneralPurposeBytewidth);
+            out.format(
+                "    .cfi_offset %{}, -{}\n",
+                name,
+                16 + frame.locals_size + (usz(i) + 1) * GeneralPurposeBytewidth
+            );
+        }
+
+        // How far RSP has been lowered past the end of the prologue, e.g.
+        // for arguments passed in memory. Without a frame pointer, locals
+        // are addressed relative to RSP, so this has to be kept track of.
+        isz adjustment = 0;
+        auto AdjustStack = [&](isz by) {
+            adjustment += by;
+            if (frame.kind == FrameKind::NoFramePointer)
+                out.format("    .cfi_adjust_cfa_offset {}\n", by);
+        };
+
         Location last_location{};
         for (auto [block_index, block] : vws::enumerate(function.blocks())) {
-            out += fmt::format("{}:\n", block_name(block.name()));
+            out.block_name(block.name());
+            out += ":\n";
 
             for (auto& instruction : block.instructions()) {
                 // ================================
@@ -246,7 +482,7 @@ void emit_gnu_att_assembly(
                     and is_block(instruction)
                 ) {
                     auto* target_block = extract_block(instruction);
-                    auto next_block = function.blocks().at(usz(block_index + 1));
+                    const auto& next_block = function.blocks().at(usz(block_index + 1));
                     if (target_block->name() == next_block.name())
                         continue;
                 }
@@ -268,14 +504,6 @@ void emit_gnu_att_assembly(
                     }
                 }
 
-                // ================================
-                // TODO: CFA: Record saved registers
-                // ================================
-                if (
-                    instruction.opcode() == +x86_64::Opcode::Push
-                    and is_reg(instruction)
-                ) {}
-
                 // ================================
                 // INSTRUCTION FIXUP
                 //   movzx from 32 bit to 64 bit register is just a mov between 32 bit
@@ -299,21 +527,42 @@ void emit_gnu_att_assembly(
                 // ================================
                 // INSTRUCTION PROLOGUE (some insts have preceding instructions)
                 // ================================
-                if (instruction.opcode() == +x86_64::Opcode::Return) {
-                    // Function Footer
-                    // TODO: Different stack frame kinds.
-                    out +=
-                        "    mov %rbp, %rsp\n"
-                        "    pop %rbp\n";
+                if (
+                    instruction.opcode() == +x86_64::Opcode::Return
+                    or (instruction.opcode() == +x86_64::Opcode::Jump and is_function(instruction))
+                ) {
+                    // Function Footer; a jump to a function is a tail call,
+                    // which leaves it to the callee to return to our caller.
+                    //
+                    // A return needn't be the last instruction of the
+                    // function, so save the unwind state of the body here
+                    // and restore it once we're past the exit below.
+                    if (frame.kind != FrameKind::None) {
+                        out += "    .cfi_remember_state\n";
+                        for (auto reg : frame.saved_registers | vws::reverse) {
+                            out.format("    pop %{}\n", ToString(RegisterId(reg)));
+                            if (frame.kind == FrameKind::NoFramePointer)
+                                out.format("    .cfi_adjust_cfa_offset -{}\n", GeneralPurposeBytewidth);
+                        }
 
-                    // Update CFA expression since 16(%rbp) is no longer accurate.
-                    out += "    .cfi_def_cfa %rsp, 8\n";
+                        if (frame.kind == FrameKind::NoFramePointer) {
+                            out.format("    add ${}, %rsp\n", frame.locals_size + GeneralPurposeBytewidth);
+                            out += "    .cfi_def_cfa_offset 8\n";
+                        } else {
+                            if (frame.kind == FrameKind::Full) out += "    mov %rbp, %rsp\n";
+                            out += "    pop %rbp\n";
+
+                            // Update CFA expression since 16(%rbp) is no longer accurate.
+                            out += "    .cfi_def_cfa %rsp, 8\n";
+                        }
+                    }
 
                 } else if (instruction.opcode() == +x86_64::Opcode::Call) {
                     // Save return register, if necessary.
-                    // TODO: CFA `.cfi_offset`
-                    if (instruction.reg() != desc.return_register)
-                        out += fmt::format("    push %{}\n", ToString(x86_64::RegisterId(desc.return_register)));
+                    if (instruction.reg() != desc.return_register) {
+                        out.format("    push %{}\n", ToString(x86_64::RegisterId(desc.return_register)));
+                        AdjustStack(GeneralPurposeBytewidth);
+                    }
                 }
 
                 // ================================
@@ -323,7 +572,7 @@ void emit_gnu_att_assembly(
                     auto loc = instruction.location();
                     if (loc.is_valid() and not loc.equal_position(last_location)) {
                         auto l = loc.seek_line_column(module->context());
-                        out += fmt::format(
+                        out.format(
                             "    .loc {} {} {}\n",
                             loc.file_id,
                             l.line,
@@ -337,7 +586,9 @@ void emit_gnu_att_assembly(
                 // INSTRUCTION MNEMONIC
                 // ================================
                 out += "    ";
-                out += ToString(Opcode(instruction.opcode()));
+                auto vector_width = vector_bits(instruction);
+                if (vector_width) out += vector_mnemonic(Opcode(instruction.opcode()), vector_width);
+                else out += ToString(Opcode(instruction.opcode()));
 
                 // ================================
                 // CUSTOM OPERAND HANDLING (dereference register operand on rhs of move)
@@ -346,22 +597,11 @@ void emit_gnu_att_assembly(
                     instruction.opcode() == +x86_64::Opcode::MoveDereferenceRHS
                     and std::holds_alternative<MOperandRegister>(instruction.get_operand(1))
                 ) {
-                    auto lhs = instruction.get_operand(0);
-                    auto rhs = instruction.get_operand(1);
-
-                    usz offset = 0;
-                    if (instruction.all_operands().size() == 3) {
-                        auto given_offset = instruction.get_operand(2);
-                        LCC_ASSERT(
-                            std::holds_alternative<MOperandImmediate>(given_offset),
-                            "Offset operand of dereferencing move must be an immediate"
-                        );
-                        offset = std::get<MOperandImmediate>(given_offset).value;
-                    }
-
-                    if (offset)
-                        out += fmt::format(" {}, {}({})\n", ToString(function, lhs), offset, ToString(function, rhs));
-                    else out += fmt::format(" {}, ({})\n", ToString(function, lhs), ToString(function, rhs));
+                    out += ' ';
+                    write_operand(out, function, instruction.get_operand(0));
+                    out += ", ";
+                    write_memory_operand(out, function, instruction, 1);
+                    out += '\n';
                     continue;
                 }
                 // ================================
@@ -371,20 +611,11 @@ void emit_gnu_att_assembly(
                     instruction.opcode() == +x86_64::Opcode::MoveDereferenceLHS
                     and std::holds_alternative<MOperandRegister>(instruction.get_operand(0))
                 ) {
-                    auto lhs = instruction.get_operand(0);
-                    auto rhs = instruction.get_operand(1);
-                    usz offset = 0;
-                    if (instruction.all_operands().size() == 3) {
-                        auto given_offset = instruction.get_operand(2);
-                        LCC_ASSERT(
-                            std::holds_alternative<MOperandImmediate>(given_offset),
-                            "Offset operand of dereferencing move must be an immediate"
-                        );
-                        offset = std::get<MOperandImmediate>(given_offset).value;
-                    }
-                    if (offset)
-                        out += fmt::format(" {}({}), {}\n", offset, ToString(function, lhs), ToString(function, rhs));
-                    else out += fmt::format(" ({}), {}\n", ToString(function, lhs), ToString(function, rhs));
+                    out += ' ';
+                    write_memory_operand(out, function, instruction, 0);
+                    out += ", ";
+                    write_operand(out, function, instruction.get_operand(1));
+                    out += '\n';
                     continue;
                 }
                 // ================================
@@ -407,6 +638,8 @@ void emit_gnu_att_assembly(
                                 case 64: out += 'q'; break;
                                 case 32: out += 'l'; break;
                                 case 16: out += 'w'; break;
+                                // A boolean takes up a byte in memory.
+                                case 1:
                                 case 8: out += 'b'; break;
                                 default: LCC_ASSERT(false, "Invalid move");
                             }
@@ -427,55 +660,89 @@ void emit_gnu_att_assembly(
                         tmp.size = 8;
                         operand = tmp;
                     }
-                    out += ToString(function, operand);
+                    write_operand(out, function, operand, frame.base(adjustment));
                     ++i;
                 }
+
+                // AVX instructions don't overwrite a source operand; pass
+                // the destination as both.
+                if (vector_width == 256 and is_packed(Opcode(instruction.opcode()))) {
+                    out += ", ";
+                    write_operand(out, function, instruction.all_operands().back());
+                }
                 out += '\n';
 
                 // ================================
                 // INSTRUCTION EPILOGUE (some insts have instructions following)
                 // ================================
-                if (instruction.opcode() == +x86_64::Opcode::Call) {
+                if (
+                    instruction.opcode() == +x86_64::Opcode::Return
+                    or (instruction.opcode() == +x86_64::Opcode::Jump and is_function(instruction))
+                ) {
+                    if (frame.kind != FrameKind::None) out += "    .cfi_restore_state\n";
+                } else if (instruction.opcode() == +x86_64::Opcode::Call) {
                     // Move return value from return register to result register, if necessary.
-                    // Also restore return register, if necessary.
-                    if (instruction.use_count() and instruction.reg() and instruction.reg() != desc.return_register) {
-                        out += fmt::format(
-                            "    mov %{}, %{}\n",
-                            ToString(x86_64::RegisterId(desc.return_register), instruction.regsize()),
-                            ToString(x86_64::RegisterId(instruction.reg()), instruction.regsize())
-                        );
-                        out += fmt::format("    pop %{}\n", ToString(x86_64::RegisterId(desc.return_register)));
+                    // Also restore return register, if it was saved above.
+                    if (instruction.reg() != desc.return_register) {
+                        if (instruction.use_count() and instruction.reg()) {
+                            out.format(
+                                "    mov %{}, %{}\n",
+                                ToString(x86_64::RegisterId(desc.return_register), instruction.regsize()),
+                                ToString(x86_64::RegisterId(instruction.reg()), instruction.regsize())
+                            );
+                        }
+                        out.format("    pop %{}\n", ToString(x86_64::RegisterId(desc.return_register)));
+                        AdjustStack(-isz(GeneralPurposeBytewidth));
                     }
                 }
+
+                // Arguments passed in memory move RSP until the call returns.
+                if (auto by = stack_adjustment(instruction)) AdjustStack(by);
             }
         }
 
-        out += fmt::format("    .cfi_endproc\n");
+        out += "    .cfi_endproc\n";
 
-        for (auto n : function.names()) {
+        for (const auto& n : function.names()) {
             if (IsExportedLinkage(n.linkage))
-                out += fmt::format("    .size {}, .-{}\n", n.name, n.name);
+                out.format("    .size {}, .-{}\n", n.name, n.name);
         }
     }
 
     for (auto& section : module->extra_sections()) {
-        out += fmt::format(".section {}\n", section.name);
+        out.format(".section {}\n", section.name);
         LCC_ASSERT(not section.is_fill, "Sorry, haven't handled fill extra sections");
-        if (section.contents().empty()) continue;
-        const auto write_byte = [&](u8 byte) {
-            return fmt::format("0x{:x}", byte);
-        };
-        out += fmt::format(
-            ".byte {}\n",
-            fmt::join(vws::transform(section.contents(), write_byte), ",")
-        );
+        if (section.bytes().empty()) continue;
+        out += ".byte ";
+        for (auto [i, byte] : vws::enumerate(section.bytes()))
+            out.format("{}0x{:x}", i ? "," : "", byte);
+        out += '\n';
     }
 
     out += ".section .note.GNU-stack\n";
+}
+} // namespace
+
+void emit_gnu_att_assembly(
+    const fs::path& output_path,
+    Module* module,
+    const MachineDescription& desc,
+    std::vector<MFunction>& mir
+) {
+    AssemblyWriter out{output_path};
+    write_gnu_att_assembly(out, module, desc, mir);
+    out.finish();
+}
 
-    if (output_path == "-")
-        fmt::print("{}", out);
-    else File::WriteOrTerminate(out.data(), out.size(), output_path);
+void emit_gnu_att_assembly(
+    std::vector<u8>& output,
+    Module* module,
+    const MachineDescription& desc,
+    std::vector<MFunction>& mir
+) {
+    AssemblyWriter out{output};
+    write_gnu_att_assembly(out, module, desc, mir);
+    out.finish();
 }
 
 } // namespace lcc::x86_64
@@ -0,0 +1,228 @@
+#include <lcc/codegen/x86_64/jit.hh>
+#include <lcc/context.hh>
+#include <lcc/diags.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/utils.hh>
+#include <object/generic.hh>
+
+#ifndef _WIN32
+#    include <dlfcn.h>
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lcc::x86_64 {
+
+namespace {
+/// `jmp *0(%rip)`, followed by the 8-byte address to jump to.
+constexpr u8 stub_jump[]{0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+constexpr usz stub_size = 16;
+
+auto HasAttribute(const Section& section, Section::Attribute a) -> bool {
+    return section.attributes & (u64(1) << int(a));
+}
+
+auto FitsInI32(i64 value) -> bool {
+    return value >= std::numeric_limits<i32>::min() and value <= std::numeric_limits<i32>::max();
+}
+} // namespace
+
+#ifndef _WIN32
+JITImage::~JITImage() {
+    if (_memory) ::munmap(_memory, _size);
+}
+
+auto JITImage::Load(Context* ctx, GenericObject& object) -> std::unique_ptr<JITImage> {
+    const auto page_size = usz(::sysconf(_SC_PAGESIZE));
+    const auto PageAlign = [&](usz size) { return (size + page_size - 1) & ~(page_size - 1); };
+
+    // Every section that is loaded gets pages of its own, so that each can
+    // be given the permissions it needs; the stubs come after them.
+    struct LoadedSection {
+        Section* section;
+        usz offset;
+        usz size;
+    };
+
+    std::vector<LoadedSection> loaded{};
+    StringMap<usz> loaded_by_name{};
+    usz size = 0;
+    for (auto& section : object.sections) {
+        if (not HasAttribute(section, Section::Attribute::LOAD)) continue;
+        const usz section_size = section.is_fill ? section.length() : section.bytes().size();
+        loaded_by_name.try_emplace(section.name, loaded.size());
+        loaded.push_back({&section, size, section_size});
+        size += PageAlign(section_size);
+    }
+
+    // One stub per undefined function that is called.
+    StringMap<usz> stubs{};
+    for (auto& reloc : object.relocations) {
+        if (reloc.symbol.kind != Symbol::Kind::FUNCTION) continue;
+        const bool defined = rgs::any_of(object.symbols, [&](const Symbol& s) {
+            return s.name == reloc.symbol.name and s.kind != Symbol::Kind::EXTERNAL;
+        });
+        if (not defined) stubs.try_emplace(reloc.symbol.name, stubs.size());
+    }
+    const usz stubs_offset = size;
+    size += PageAlign(stubs.size() * stub_size);
+    if (size == 0) size = page_size;
+
+    auto* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        Diag::Error(ctx, {}, "Could not map memory for JIT code: {}", std::strerror(errno));
+        return nullptr;
+    }
+
+    std::unique_ptr<JITImage> image{new JITImage{}};
+    image->_memory = static_cast<std::byte*>(memory);
+    image->_size = size;
+    auto* base = image->_memory;
+
+    for (auto& l : loaded) {
+        if (l.section->is_fill) std::memset(base + l.offset, l.section->value(), l.size);
+        else std::memcpy(base + l.offset, l.section->bytes().data(), l.size);
+    }
+
+    // Symbols defined in the image.
+    for (auto& sym : object.symbols) {
+        if (sym.kind == Symbol::Kind::EXTERNAL) continue;
+        auto found = loaded_by_name.find(sym.section_name);
+        if (found == loaded_by_name.end()) continue;
+        image->_symbols.try_emplace(sym.name, base + loaded[found->second].offset + sym.byte_offset);
+    }
+
+    auto Resolve = [&](const Symbol& sym) -> std::byte* {
+        if (auto* address = image->symbol(sym.name)) return static_cast<std::byte*>(address);
+        return static_cast<std::byte*>(::dlsym(RTLD_DEFAULT, sym.name.c_str()));
+    };
+
+    for (auto [name, index] : stubs) {
+        auto* target = ::dlsym(RTLD_DEFAULT, name.c_str());
+        if (not target) {
+            Diag::Error(ctx, {}, "Undefined reference to `{}`", name);
+            return nullptr;
+        }
+
+        auto* stub = base + stubs_offset + index * stub_size;
+        std::memcpy(stub, stub_jump, sizeof stub_jump);
+        std::memcpy(stub + sizeof stub_jump, &target, sizeof target);
+    }
+
+    for (auto& reloc : object.relocations) {
+        auto section = loaded_by_name.find(reloc.symbol.section_name);
+        if (section == loaded_by_name.end()) continue;
+        auto* place = base + loaded[section->second].offset + reloc.symbol.byte_offset;
+
+        auto* target = Resolve(reloc.symbol);
+        if (not target) {
+            Diag::Error(ctx, {}, "Undefined reference to `{}`", reloc.symbol.name);
+            return nullptr;
+        }
+
+        // Go through the stub if the function is too far away.
+        auto Displacement = [&](i64 addend) {
+            auto value = i64(target - place) + addend;
+            if (not FitsInI32(value) and stubs.contains(reloc.symbol.name)) {
+                target = base + stubs_offset + stubs.at(reloc.symbol.name) * stub_size;
+                value = i64(target - place) + addend;
+            }
+            return value;
+        };
+
+        i64 value{};
+        switch (reloc.kind) {
+            case Relocation::Kind::NONE: continue;
+
+            // The displacement is relative to the end of the 4 bytes that
+            // hold it; see the ELF writer.
+            case Relocation::Kind::DISPLACEMENT32_PCREL:
+                value = Displacement(-4);
+                break;
+
+            case Relocation::Kind::PCREL32:
+                value = Displacement(reloc.addend);
+                break;
+
+            case Relocation::Kind::DISPLACEMENT32:
+                value = i64(reinterpret_cast<uptr>(target));
+                if (value < 0 or value > i64(std::numeric_limits<u32>::max())) {
+                    Diag::Error(ctx, {}, "Address of `{}` does not fit into 32 bits", reloc.symbol.name);
+                    return nullptr;
+                }
+                break;
+        }
+
+        if (reloc.kind != Relocation::Kind::DISPLACEMENT32 and not FitsInI32(value)) {
+            Diag::Error(ctx, {}, "`{}` is too far away to be referenced from JIT code", reloc.symbol.name);
+            return nullptr;
+        }
+
+        auto field = u32(value);
+        std::memcpy(place, &field, sizeof field);
+    }
+
+    // Only now that everything is written, make code executable, and
+    // whatever isn't writable read-only.
+    auto Protect = [&](usz offset, usz length, int protection) {
+        if (length == 0) return true;
+        if (::mprotect(base + offset, PageAlign(length), protection) == 0) return true;
+        Diag::Error(ctx, {}, "Could not protect memory of JIT code: {}", std::strerror(errno));
+        return false;
+    };
+
+    for (auto& l : loaded) {
+        int protection = PROT_READ;
+        if (HasAttribute(*l.section, Section::Attribute::EXECUTABLE)) protection |= PROT_EXEC;
+        if (HasAttribute(*l.section, Section::Attribute::WRITABLE)) protection |= PROT_WRITE;
+        if (not Protect(l.offset, l.size, protection)) return nullptr;
+    }
+
+    if (not Protect(stubs_offset, stubs.size() * stub_size, PROT_READ | PROT_EXEC)) return nullptr;
+    return image;
+}
+#else
+JITImage::~JITImage() = default;
+
+auto JITImage::Load(Context* ctx, GenericObject&) -> std::unique_ptr<JITImage> {
+    Diag::Error(ctx, {}, "Running code in-process is not supported on this platform");
+    return nullptr;
+}
+#endif
+
+auto JITImage::symbol(std::string_view name) const -> void* {
+    auto found = _symbols.find(name);
+    if (found == _symbols.end()) return nullptr;
+    return found->second;
+}
+
+auto RunMain(Module* module, std::span<const std::string> args) -> std::optional<int> {
+    auto object = module->emit_object();
+    auto image = JITImage::Load(module->context(), object);
+    if (not image) return std::nullopt;
+
+    auto* main = image->symbol("main");
+    if (not main) {
+        Diag::Error(module->context(), {}, "Cannot run a module without a `main` function");
+        return std::nullopt;
+    }
+
+    std::vector<char*> argv{};
+    for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    using MainFunction = int (*)(int, char**);
+    return reinterpret_cast<MainFunction>(main)(int(args.size()), argv.data());
+}
+
+} // namespace lcc::x86_64
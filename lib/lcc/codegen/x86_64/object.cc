@@ -1,16 +1,25 @@
 #include <lcc/codegen/mir.hh>
 #include <lcc/codegen/mir_utils.hh>
+#include <lcc/codegen/x86_64/encoder.hh>
 #include <lcc/codegen/x86_64/object.hh>
 #include <lcc/codegen/x86_64/x86_64.hh>
 #include <lcc/context.hh>
 #include <lcc/core.hh>
+#include <lcc/format.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/parallel.hh>
 #include <object/generic.hh>
 
 #include <algorithm>
 #include <bit>
 #include <functional>
+#include <iterator>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -35,66 +44,6 @@ namespace lcc::x86_64 {
 //     64-bit mode, indicates the four bit field of REX.b and opcode[2:0]
 //     field encodes the register operand of the instruction.
 
-namespace {
-constexpr auto as_bytes(u16 value) -> std::vector<u8> {
-    // 0xffff
-    //   __    upper
-    //     __  lower
-    const u8 upper = u8((value >> 8) & 0xff);
-    const u8 lower = u8((value >> 0) & 0xff);
-    return {lower, upper};
-}
-constexpr auto as_bytes(i16 value) -> std::vector<u8> {
-    return as_bytes(static_cast<u16>(value));
-}
-
-constexpr auto as_bytes(u32 value) -> std::vector<u8> {
-    // 0xffff.ffff
-    // a ____
-    // b      ____
-    const u8 upper_a = u8((value >> 24) & 0xff);
-    const u8 lower_a = u8((value >> 16) & 0xff);
-    const u8 upper_b = u8((value >> 8) & 0xff);
-    const u8 lower_b = u8((value >> 0) & 0xff);
-    return {lower_b, upper_b, lower_a, upper_a};
-}
-constexpr auto as_bytes(i32 value) -> std::vector<u8> {
-    return as_bytes(static_cast<u32>(value));
-}
-
-constexpr auto as_bytes(u64 value) -> std::vector<u8> {
-    const u8 upper_a = u8((value >> 56) & 0xff);
-    const u8 lower_a = u8((value >> 48) & 0xff);
-    const u8 upper_b = u8((value >> 40) & 0xff);
-    const u8 lower_b = u8((value >> 32) & 0xff);
-    const u8 upper_c = u8((value >> 24) & 0xff);
-    const u8 lower_c = u8((value >> 16) & 0xff);
-    const u8 upper_d = u8((value >> 8) & 0xff);
-    const u8 lower_d = u8((value >> 0) & 0xff);
-    return {lower_d, upper_d, lower_c, upper_c, lower_b, upper_b, lower_a, upper_a};
-}
-constexpr auto as_bytes(i64 value) -> std::vector<u8> {
-    return as_bytes(static_cast<u64>(value));
-}
-
-constexpr auto as_bytes(MOperandImmediate imm) -> std::vector<u8> {
-    if (imm.size <= 8)
-        return {u8(imm.value)};
-    if (imm.size <= 16)
-        return as_bytes(u16(imm.value));
-    if (imm.size <= 32)
-        return as_bytes(u32(imm.value));
-    if (imm.size <= 64)
-        return as_bytes(u64(imm.value));
-    LCC_UNREACHABLE();
-}
-
-constexpr auto as_bytes_cap32(MOperandImmediate imm) -> std::vector<u8> {
-    if (imm.size > 32) imm.size = 32;
-    return as_bytes(imm);
-}
-} // namespace
-
 // TODO: Move helpful static functions beyond this to a header in case I
 // or somebody else wants to reuse all this annoying RTFM code.
 
@@ -137,7 +86,24 @@ static constexpr u8 rw_encoding(RegisterId id) {
             return 7;
 
         // Not encodable in rw.
-        case RegisterId::RIP: break;
+        case RegisterId::RIP:
+        case RegisterId::XMM0:
+        case RegisterId::XMM1:
+        case RegisterId::XMM2:
+        case RegisterId::XMM3:
+        case RegisterId::XMM4:
+        case RegisterId::XMM5:
+        case RegisterId::XMM6:
+        case RegisterId::XMM7:
+        case RegisterId::XMM8:
+        case RegisterId::XMM9:
+        case RegisterId::XMM10:
+        case RegisterId::XMM11:
+        case RegisterId::XMM12:
+        case RegisterId::XMM13:
+        case RegisterId::XMM14:
+        case RegisterId::XMM15:
+            break;
 
         // Not actual registers.
         case RegisterId::RETURN:
@@ -237,6 +203,22 @@ static constexpr u8 regbits(RegisterId id) {
         case RegisterId::R13: return 0b1101;
         case RegisterId::R14: return 0b1110;
         case RegisterId::R15: return 0b1111;
+        case RegisterId::XMM0: return 0b0000;
+        case RegisterId::XMM1: return 0b0001;
+        case RegisterId::XMM2: return 0b0010;
+        case RegisterId::XMM3: return 0b0011;
+        case RegisterId::XMM4: return 0b0100;
+        case RegisterId::XMM5: return 0b0101;
+        case RegisterId::XMM6: return 0b0110;
+        case RegisterId::XMM7: return 0b0111;
+        case RegisterId::XMM8: return 0b1000;
+        case RegisterId::XMM9: return 0b1001;
+        case RegisterId::XMM10: return 0b1010;
+        case RegisterId::XMM11: return 0b1011;
+        case RegisterId::XMM12: return 0b1100;
+        case RegisterId::XMM13: return 0b1101;
+        case RegisterId::XMM14: return 0b1110;
+        case RegisterId::XMM15: return 0b1111;
         default: break;
     }
     Diag::ICE("Unhandled register in regbits: %s\n", ToString(id));
@@ -294,7 +276,7 @@ static constexpr u8 sib_byte(u8 scale_factor, u8 index, u8 base) {
 
 /// Should be used after every modrm byte with a mod not equal to 0b11
 /// is written that may contain r12 in the r/m field.
-static constexpr void mcode_sib_if_r12(Section& text, RegisterId address_register, u8 modrm) {
+static constexpr void mcode_sib_if_r12(Encoder& text, RegisterId address_register, u8 modrm) {
     if (address_register == RegisterId::R12 && (modrm & 0b11000000) != 0b11000000)
         text += sib_byte(0b00, 0b100, 0b100);
 }
@@ -304,6 +286,79 @@ constexpr bool is_one_of(usz value) {
     return ((ints == value) or ...);
 }
 
+/// A memory operand addressed by registers: disp(%base, %index, scale).
+struct MemoryOperand {
+    Register base;
+    std::optional<Register> index{};
+    usz scale{1};
+    i32 displacement{};
+};
+
+/// The memory operand of a dereferencing move whose base register is
+/// operand \p base_index, followed by the optional offset, index
+/// register, and scale operands, if it is one.
+static auto memory_operand(MInst& inst, usz base_index) -> std::optional<MemoryOperand> {
+    const auto& operands = inst.all_operands();
+    if (not is_one_of<2, 3, 5>(operands.size())) return std::nullopt;
+    if (not std::holds_alternative<MOperandRegister>(operands[base_index])) return std::nullopt;
+
+    MemoryOperand address{std::get<MOperandRegister>(operands[base_index])};
+    if (operands.size() > 2) {
+        if (not std::holds_alternative<MOperandImmediate>(operands[2])) return std::nullopt;
+        address.displacement = i32(std::get<MOperandImmediate>(operands[2]).value);
+    }
+    if (operands.size() == 5) {
+        if (
+            not std::holds_alternative<MOperandRegister>(operands[3])
+            or not std::holds_alternative<MOperandImmediate>(operands[4])
+        ) return std::nullopt;
+        address.index = std::get<MOperandRegister>(operands[3]);
+        address.scale = std::get<MOperandImmediate>(operands[4]).value;
+        LCC_ASSERT((is_one_of<1, 2, 4, 8>(address.scale)), "Invalid scale in memory operand");
+        LCC_ASSERT(RegisterId(address.index->value) != RegisterId::RSP, "RSP cannot be used as an index register");
+    }
+    return address;
+}
+
+/// The memory operand of a local, addressed relative to \p base.
+static auto local_address(MFunction& func, MOperandLocal local, FrameBase base) -> MemoryOperand {
+    return {MOperandRegister(usz(base.reg), 64), std::nullopt, 1, i32(func.local_offset(local) + base.offset)};
+}
+
+/// REX.X and REX.B bits for a memory operand.
+static constexpr bool rex_x(const MemoryOperand& address) {
+    return address.index and reg_topbit(*address.index);
+}
+static constexpr bool rex_b(const MemoryOperand& address) {
+    return reg_topbit(address.base);
+}
+
+/// Write the modrm byte, SIB byte (if any) and displacement (if any) for
+/// a memory operand, with \p reg in the reg field of the modrm byte.
+/// This takes care of the special cases of Table 2-5 of the Intel SDM:
+/// - r/m = 0b100 (RSP, R12) means a SIB byte follows, so those bases
+///   always need one.
+/// - mod = 0b00 with r/m (or SIB base) 0b101 (RBP, R13) means there is
+///   no base register, so those bases always need a displacement.
+static void mcode_memory_operand(Encoder& text, u8 reg, const MemoryOperand& address) {
+    auto base = regbits(address.base);
+
+    u8 mod = 0b10;
+    if (address.displacement == 0 and (base & 0b111) != 0b101) mod = 0b00;
+    else if (address.displacement >= -128 and address.displacement <= 127) mod = 0b01;
+
+    if (address.index or (base & 0b111) == 0b100) {
+        u8 index = address.index ? regbits(*address.index) : u8(0b100); // 0b100: no index
+        text += {
+            modrm_byte(mod, reg, 0b100),
+            sib_byte(u8(std::countr_zero(address.scale)), index, base) //
+        };
+    } else text += modrm_byte(mod, reg, base);
+
+    if (mod == 0b01) text += u8(address.displacement);
+    else if (mod == 0b10) text.append32(u32(address.displacement));
+}
+
 static constexpr u8 prefix16 = 0x66;
 
 // /r means register and r/m operand referenced by modrm.
@@ -319,7 +374,7 @@ static void opcode_slash_r(
     MFunction& func,
     MInst& inst,
     u8 opcode,
-    Section& text
+    Encoder& text
 ) {
     // GNU syntax (src, dst operands)
     //
@@ -368,11 +423,179 @@ static void opcode_slash_r(
     }
 }
 
+/// Write the prefixes and the opcode of a vector instruction whose
+/// opcode is in the 0x0f map (or the 0x0f 0x38 map if \p map_0f38), but
+/// not the modrm byte or anything after it.
+///
+/// 128-bit instructions are SSE ones: the mandatory \p prefix (if any),
+/// a REX prefix if any of \p r, \p x, \p b are set, and then the opcode.
+/// 256-bit ones are AVX ones, which use a VEX prefix instead; that also
+/// encodes the prefix and the map, as well as the extra source operand
+/// \p vvvv of three-operand instructions.
+///
+///   C5 [R̄ v̄v̄v̄v̄ L pp]                    (if X, B, and the map allow)
+///   C4 [R̄ X̄ B̄ mmmmm] [W v̄v̄v̄v̄ L pp]
+static void mcode_vector_opcode(
+    Encoder& text,
+    usz bits,
+    u8 prefix,
+    bool map_0f38,
+    u8 opcode,
+    bool r,
+    bool x,
+    bool b,
+    std::optional<Register> vvvv = std::nullopt
+) {
+    LCC_ASSERT((is_one_of<128, 256>(bits)), "x86_64: invalid vector size {}", bits);
+    if (bits == 128) {
+        if (prefix) text += prefix;
+        if (r or x or b) text += rex_byte(false, r, x, b);
+        text += 0x0f;
+        if (map_0f38) text += 0x38;
+        text += opcode;
+        return;
+    }
+
+    u8 pp = 0b00;
+    if (prefix == prefix16) pp = 0b01;
+    else if (prefix == 0xf3) pp = 0b10;
+    else if (prefix == 0xf2) pp = 0b11;
+
+    // The register fields are stored inverted; an unused vvvv is 0b1111.
+    u8 v = vvvv ? regbits(*vvvv) : u8(0);
+    u8 last = u8(((~v & 0b1111) << 3) | (1 << 2) | pp);
+    if (not x and not b and not map_0f38) text += {0xc5, u8((r ? 0 : 0x80) | last)};
+    else {
+        u8 map = map_0f38 ? 0b00010 : 0b00001;
+        text += {0xc4, u8((r ? 0 : 0x80) | (x ? 0 : 0x40) | (b ? 0 : 0x20) | map), last};
+    }
+    text += opcode;
+}
+
+/// Encode an instruction on vector registers.
+static void assemble_vector_inst(
+    GenericObject& gobj,
+    MFunction& func,
+    MInst& inst,
+    Encoder& text,
+    FrameBase base,
+    usz bits
+) {
+    // GNU syntax (src, dst operands)
+    //  0x66 0x0f 0x6f /r | MOVDQA xmm/m128, xmm | RM
+    //  0xf3 0x0f 0x6f /r | MOVDQU xmm/m128, xmm | RM
+    //  0xf3 0x0f 0x7f /r | MOVDQU xmm, xmm/m128 | MR
+    // and the same with a VEX.256 prefix for ymm registers.
+    auto opcode = Opcode(inst.opcode());
+    if (opcode == Opcode::Move and is_reg_reg(inst)) {
+        auto [src, dst] = extract_reg_reg(inst);
+        if (src.value == dst.value) return;
+        mcode_vector_opcode(text, bits, prefix16, false, 0x6f, reg_topbit(dst), false, reg_topbit(src));
+        text += modrm_byte(0b11, regbits(dst), regbits(src));
+        return;
+    }
+
+    if (opcode == Opcode::MoveDereferenceLHS) {
+        if (is_global_reg(inst)) {
+            auto [global, dst] = extract_global_reg(inst);
+            mcode_vector_opcode(text, bits, 0xf3, false, 0x6f, reg_topbit(dst), false, false);
+            text += modrm_byte(0b00, regbits(dst), 0b101);
+
+            // Make RIP-relative disp32 relocation
+            Relocation reloc{};
+            reloc.symbol.byte_offset = text.offset();
+            reloc.symbol.name = global->names().at(0).name;
+            reloc.symbol.section_name = text.section_name();
+            reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
+            gobj.relocations.push_back(reloc);
+
+            text.append32(0);
+            return;
+        }
+
+        std::optional<MemoryOperand> address{};
+        if (is_local_reg(inst)) address = local_address(func, std::get<MOperandLocal>(inst.get_operand(0)), base);
+        else address = memory_operand(inst, 0);
+        if (address and std::holds_alternative<MOperandRegister>(inst.get_operand(1))) {
+            auto dst = std::get<MOperandRegister>(inst.get_operand(1));
+            mcode_vector_opcode(text, bits, 0xf3, false, 0x6f, reg_topbit(dst), rex_x(*address), rex_b(*address));
+            mcode_memory_operand(text, regbits(dst), *address);
+            return;
+        }
+    }
+
+    if (opcode == Opcode::MoveDereferenceRHS) {
+        std::optional<MemoryOperand> address{};
+        if (is_reg_local(inst)) address = local_address(func, std::get<MOperandLocal>(inst.get_operand(1)), base);
+        else address = memory_operand(inst, 1);
+        if (address and std::holds_alternative<MOperandRegister>(inst.get_operand(0))) {
+            auto src = std::get<MOperandRegister>(inst.get_operand(0));
+            mcode_vector_opcode(text, bits, 0xf3, false, 0x7f, reg_topbit(src), rex_x(*address), rex_b(*address));
+            mcode_memory_operand(text, regbits(src), *address);
+            return;
+        }
+    }
+
+    // GNU syntax (imm, dst operands)
+    //  0x66 0x0f 0x73 /6 ib      | PSLLQ imm8, xmm       | MI
+    //  VEX.256.66.0f 0x73 /6 ib  | VPSLLQ imm8, ymm, ymm | VMI
+    // and likewise with /2 for PSRLQ; the VEX forms take the destination
+    // in vvvv and the source in r/m, which are the same register here.
+    if ((opcode == Opcode::PackedShiftLeft64 or opcode == Opcode::PackedShiftRight64) and is_imm_reg(inst)) {
+        auto [imm, dst] = extract_imm_reg(inst);
+        u8 slash = opcode == Opcode::PackedShiftLeft64 ? 6 : 2;
+        mcode_vector_opcode(text, bits, prefix16, false, 0x73, false, false, reg_topbit(dst), dst);
+        text += {modrm_byte(0b11, slash, regbits(dst)), u8(imm.value)};
+        return;
+    }
+
+    // GNU syntax (src, dst operands)
+    //  0x66 0x0f 0xfe /r      | PADDD xmm/m128, xmm         | RM
+    //  VEX.256.66.0f 0xfe /r  | VPADDD ymm/m256, ymm, ymm   | RVM
+    // and likewise for the others; the destination is also the first
+    // source operand.
+    if (is_packed(opcode) and is_reg_reg(inst)) {
+        bool map_0f38 = false;
+        u8 op{};
+        switch (opcode) {
+            case Opcode::PackedAdd8: op = 0xfc; break;
+            case Opcode::PackedAdd16: op = 0xfd; break;
+            case Opcode::PackedAdd32: op = 0xfe; break;
+            case Opcode::PackedAdd64: op = 0xd4; break;
+            case Opcode::PackedSub8: op = 0xf8; break;
+            case Opcode::PackedSub16: op = 0xf9; break;
+            case Opcode::PackedSub32: op = 0xfa; break;
+            case Opcode::PackedSub64: op = 0xfb; break;
+            case Opcode::PackedMultiply16: op = 0xd5; break;
+            case Opcode::PackedMultiply32:
+                map_0f38 = true;
+                op = 0x40;
+                break;
+            case Opcode::PackedAnd: op = 0xdb; break;
+            case Opcode::PackedOr: op = 0xeb; break;
+            case Opcode::PackedXor: op = 0xef; break;
+            case Opcode::PackedMultiplyEven32: op = 0xf4; break;
+            default: LCC_UNREACHABLE();
+        }
+
+        auto [src, dst] = extract_reg_reg(inst);
+        mcode_vector_opcode(text, bits, prefix16, map_0f38, op, reg_topbit(dst), false, reg_topbit(src), dst);
+        text += modrm_byte(0b11, regbits(dst), regbits(src));
+        return;
+    }
+
+    Diag::ICE(
+        "Sorry, unhandled form of vector instruction\n    {}\n",
+        PrintMInstImpl(inst, opcode_to_string)
+    );
+}
+
 static void assemble_inst(
     GenericObject& gobj,
     MFunction& func,
     MInst& inst,
-    Section& text
+    Encoder& text,
+    FrameBase base = {}
 ) {
     // TODO: Once I write code to assemble all the instructions, start to
     // consolidate and de-duplicate code by looking at "pattern" of
@@ -403,20 +626,14 @@ static void assemble_inst(
         );
     };
 
+    if (auto bits = vector_bits(inst)) {
+        assemble_vector_inst(gobj, func, inst, text, base, bits);
+        return;
+    }
+
     switch (Opcode(inst.opcode())) {
         case Opcode::Return: {
-            // TODO: Stack frame kinds
-            // GNU syntax (src, dst operands)
-            // mov %rbp, %rsp
-            // pop %rbp
-            auto mov_rbp_into_rsp = MInst(usz(Opcode::Move), {0, 0});
-            mov_rbp_into_rsp.add_operand(MOperandRegister(usz(RegisterId::RBP), 64));
-            mov_rbp_into_rsp.add_operand(MOperandRegister(usz(RegisterId::RSP), 64));
-            auto pop_rbp = MInst(usz(Opcode::Pop), {0, 0});
-            pop_rbp.add_operand(MOperandRegister(usz(RegisterId::RBP), 64));
-            assemble_inst(gobj, func, mov_rbp_into_rsp, text);
-            assemble_inst(gobj, func, pop_rbp, text);
-
+            // The epilogue has been emitted by now; see `assemble()`.
             text += 0xc3;
         } break;
 
@@ -451,7 +668,7 @@ static void assemble_inst(
                     text += {0x6a, u8(imm.value)};
                 else if (imm.size <= 32) {
                     text += 0x68;
-                    text += as_bytes(imm);
+                    text.immediate(imm);
                 } else Diag::ICE("x86_64 only supports pushing immediates sized 32, 16, or 8 bits: got {}", imm.size);
             } else Diag::ICE(
                 "Sorry, unhandled form\n    {}\n",
@@ -530,7 +747,7 @@ static void assemble_inst(
                 if (dst.size == 64 or reg_topbit(dst))
                     text += rex_byte(dst.size == 64, false, false, reg_topbit(dst));
                 text += op;
-                text += as_bytes(imm);
+                text.immediate(imm);
 
             } else Diag::ICE(
                 "Sorry, unhandled form of move\n    {}\n",
@@ -548,7 +765,7 @@ static void assemble_inst(
             // destination operand goes in the r/m field.
             if (is_reg_local(inst)) {
                 auto [reg, local] = extract_reg_local(inst);
-                isz offset = func.local_offset(local);
+                auto address = local_address(func, local, base);
 
                 LCC_ASSERT((is_one_of<1, 8, 16, 32, 64>(reg.size)));
 
@@ -556,31 +773,28 @@ static void assemble_inst(
                 if (reg.size == 1 or reg.size == 8)
                     op = 0x88;
 
-                u8 modrm = modrm_byte(0b10, regbits(reg), regbits(RegisterId::RBP));
-
                 if (reg.size == 16) text += prefix16;
                 if (reg.size == 64 or reg_topbit(reg))
                     text += rex_byte(reg.size == 64, reg_topbit(reg), false, false);
-                text += {op, modrm};
-                text += as_bytes(i32(offset));
-                // TODO: r12 nonsense
-            } else if (is_reg_reg(inst)) {
-                auto [src, dst] = extract_reg_reg(inst);
+                text += op;
+                mcode_memory_operand(text, regbits(reg), address);
+            } else if (
+                auto address = memory_operand(inst, 1);
+                address and std::holds_alternative<MOperandRegister>(inst.get_operand(0))
+            ) {
+                auto src = std::get<MOperandRegister>(inst.get_operand(0));
 
-                LCC_ASSERT((is_one_of<1, 8, 16, 32, 64>(dst.size)));
+                LCC_ASSERT((is_one_of<1, 8, 16, 32, 64>(src.size)));
 
                 u8 op = 0x89;
-                if (dst.size == 1 or dst.size == 8)
+                if (src.size == 1 or src.size == 8)
                     op = 0x88;
 
-                // TODO: Is 0b11 right here? Wouldn't that mean register to register move?
-                u8 modrm = modrm_byte(0b11, regbits(dst), regbits(src));
-
-                if (dst.size == 16) text += prefix16;
-                if (dst.size == 64 || reg_topbit(src) || reg_topbit(dst))
-                    text += rex_byte(dst.size == 64, reg_topbit(dst), false, reg_topbit(src));
-                text += {op, modrm};
-                // TODO: mcode_sib_if_r12 ??
+                if (src.size == 16) text += prefix16;
+                if (src.size == 64 or reg_topbit(src) or rex_x(*address) or rex_b(*address))
+                    text += rex_byte(src.size == 64, reg_topbit(src), rex_x(*address), rex_b(*address));
+                text += op;
+                mcode_memory_operand(text, regbits(src), *address);
             }
             // GNU syntax (src, dst operands)
             //        0xc6 /0 ib | MOV imm8, r/m8   | MI
@@ -593,22 +807,19 @@ static void assemble_inst(
             // "MI" means that the destination operand goes in the r/m field.
             else if (is_imm_local(inst)) {
                 auto [imm, local] = extract_imm_local(inst);
-                isz offset = func.local_offset(local);
+                auto local_addr = local_address(func, local, base);
 
                 u8 op = 0xc7;
                 if (imm.size <= 8)
                     op = 0xc6;
 
-                u8 modrm = modrm_byte(0b10, 0, regbits(RegisterId::RBP));
-
                 if (imm.size > 8 and imm.size <= 16)
                     text += prefix16;
-                if (imm.size > 32 or reg_topbit(RegisterId::RBP))
-                    text += rex_byte(imm.size > 32, reg_topbit(RegisterId::RBP), false, false);
-                text += {op, modrm};
-                // modrm 0b10 disp32 offset
-                text += as_bytes(i32(offset));
-                text += as_bytes_cap32(imm);
+                if (imm.size > 32)
+                    text += rex_byte(true, false, false, false);
+                text += op;
+                mcode_memory_operand(text, 0, local_addr);
+                text.immediate_cap32(imm);
             } else Diag::ICE(
                 "Sorry, unhandled form of move (deref rhs)\n    {}\n",
                 PrintMInstImpl(inst, opcode_to_string)
@@ -625,7 +836,7 @@ static void assemble_inst(
             // the destination operand is in the reg field of the modrm byte.
             if (is_local_reg(inst)) {
                 auto [local, reg] = extract_local_reg(inst);
-                isz offset = func.local_offset(local);
+                auto address = local_address(func, local, base);
 
                 LCC_ASSERT((is_one_of<1, 8, 16, 32, 64>(reg.size)));
 
@@ -633,13 +844,11 @@ static void assemble_inst(
                 if (reg.size == 1 or reg.size == 8)
                     op = 0x8a;
 
-                u8 modrm = modrm_byte(0b10, regbits(reg), regbits(RegisterId::RBP));
-
                 if (reg.size == 16) text += prefix16;
                 if (reg.size == 64 or reg_topbit(reg))
                     text += rex_byte(reg.size == 64, reg_topbit(reg), false, false);
-                text += {op, modrm};
-                text += as_bytes(i32(offset));
+                text += op;
+                mcode_memory_operand(text, regbits(reg), address);
             } else if (is_global_reg(inst)) {
                 auto [global, dst] = extract_global_reg(inst);
 
@@ -662,15 +871,18 @@ static void assemble_inst(
 
                 // Make RIP-relative disp32 relocation
                 Relocation reloc{};
-                reloc.symbol.byte_offset = text.contents().size();
+                reloc.symbol.byte_offset = text.offset();
                 reloc.symbol.name = global->names().at(0).name;
-                reloc.symbol.section_name = text.name;
+                reloc.symbol.section_name = text.section_name();
                 reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
                 gobj.relocations.push_back(reloc);
 
-                text += as_bytes(u32(0));
-            } else if (is_reg_reg(inst)) {
-                auto [src, dst] = extract_reg_reg(inst);
+                text.append32(0);
+            } else if (
+                auto address = memory_operand(inst, 0);
+                address and std::holds_alternative<MOperandRegister>(inst.get_operand(1))
+            ) {
+                auto dst = std::get<MOperandRegister>(inst.get_operand(1));
 
                 LCC_ASSERT((is_one_of<1, 8, 16, 32, 64>(dst.size)));
 
@@ -678,14 +890,11 @@ static void assemble_inst(
                 if (dst.size == 1 or dst.size == 8)
                     op = 0x8a;
 
-                u8 modrm = modrm_byte(0b11, regbits(dst), regbits(src));
-
                 if (dst.size == 16) text += prefix16;
-                if (dst.size == 64 || reg_topbit(src) || reg_topbit(dst))
-                    text += rex_byte(dst.size == 64, reg_topbit(dst), false, reg_topbit(src));
-                text += {op, modrm};
-                // TODO: mcode_sib_if_r12 ??
-
+                if (dst.size == 64 or reg_topbit(dst) or rex_x(*address) or rex_b(*address))
+                    text += rex_byte(dst.size == 64, reg_topbit(dst), rex_x(*address), rex_b(*address));
+                text += op;
+                mcode_memory_operand(text, regbits(dst), *address);
             } else Diag::ICE(
                 "Sorry, unhandled form of move (deref lhs)\n    {}\n",
                 PrintMInstImpl(inst, opcode_to_string)
@@ -760,17 +969,17 @@ static void assemble_inst(
                 text += {0x8d, modrm};
                 // Make RIP-relative disp32 relocation
                 Relocation reloc{};
-                reloc.symbol.byte_offset = text.contents().size();
+                reloc.symbol.byte_offset = text.offset();
                 reloc.symbol.name = global->names().at(0).name;
-                reloc.symbol.section_name = text.name;
+                reloc.symbol.section_name = text.section_name();
                 reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
                 gobj.relocations.push_back(reloc);
 
-                text += as_bytes(u32(0));
+                text.append32(0);
 
             } else if (is_local_reg(inst)) {
                 auto [local, reg] = extract_local_reg(inst);
-                isz offset = func.local_offset(local);
+                auto address = local_address(func, local, base);
 
                 LCC_ASSERT(
                     (is_one_of<16, 32, 64>(reg.size)),
@@ -780,13 +989,11 @@ static void assemble_inst(
 
                 u8 op = 0x8d;
 
-                u8 modrm = modrm_byte(0b10, regbits(reg), regbits(RegisterId::RBP));
-
                 if (reg.size == 16) text += prefix16;
                 if (reg.size == 64 || reg_topbit(reg))
                     text += rex_byte(reg.size == 64, reg_topbit(reg), false, false);
-                text += {op, modrm};
-                text += as_bytes(i32(offset));
+                text += op;
+                mcode_memory_operand(text, regbits(reg), address);
             } else Diag::ICE(
                 "Sorry, invalid form\n    {}\n",
                 PrintMInstImpl(inst, opcode_to_string)
@@ -803,13 +1010,13 @@ static void assemble_inst(
                 // Make RIP-relative disp32 relocation
                 Relocation reloc{};
                 reloc.symbol.kind = Symbol::Kind::FUNCTION;
-                reloc.symbol.byte_offset = text.contents().size();
+                reloc.symbol.byte_offset = text.offset();
                 reloc.symbol.name = function->names().at(0).name;
-                reloc.symbol.section_name = text.name;
+                reloc.symbol.section_name = text.section_name();
                 reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
                 gobj.relocations.push_back(reloc);
 
-                text += as_bytes(u32(0));
+                text.append32(0);
 
             } else Diag::ICE(
                 "Sorry, unhandled form\n    {}\n",
@@ -916,65 +1123,71 @@ static void assemble_inst(
                 text += 0xe9;
                 // RELOCATION
                 Relocation reloc{};
-                reloc.symbol.byte_offset = text.contents().size();
+                reloc.symbol.byte_offset = text.offset();
                 reloc.symbol.name = block->name();
-                reloc.symbol.section_name = text.name;
+                reloc.symbol.section_name = text.section_name();
                 reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
                 gobj.relocations.push_back(reloc);
 
-                text += as_bytes(u32(0));
+                text.append32(0);
             } else if (is_function(inst)) {
+                // Tail call: the frame has been torn down like for a
+                // return, which leaves returning to our caller to the
+                // callee.
                 auto function = extract_function(inst);
 
                 text += 0xe9;
                 // RELOCATION
                 Relocation reloc{};
                 reloc.symbol.kind = Symbol::Kind::FUNCTION;
-                reloc.symbol.byte_offset = text.contents().size();
+                reloc.symbol.byte_offset = text.offset();
                 reloc.symbol.name = function->names().at(0).name;
-                reloc.symbol.section_name = text.name;
+                reloc.symbol.section_name = text.section_name();
                 reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
                 gobj.relocations.push_back(reloc);
 
-                text += as_bytes(u32(0));
+                text.append32(0);
             } else Diag::ICE(
                 "Sorry, unhandled form\n    {}\n",
                 PrintMInstImpl(inst, opcode_to_string)
             );
         } break;
 
-        case Opcode::JumpIfZeroFlag: {
+        case Opcode::JumpIfZeroFlag:
+        case Opcode::JumpIfNotZeroFlag: {
             // Just do 32-bit for now. Could technically do smaller jumps if we know we
             // aren't jumping far.
-            // 0x0f 0x84 cd | JZ rel32 | D
+            // 0x0f 0x84 cd | JZ rel32  | D
+            // 0x0f 0x85 cd | JNZ rel32 | D
+            const u8 op = inst.opcode() == +Opcode::JumpIfZeroFlag ? 0x84 : 0x85;
             if (is_block(inst)) {
                 auto block = extract_block(inst);
 
-                text += {0x0f, 0x84};
+                text += {0x0f, op};
                 // RELOCATION
                 Relocation reloc{};
                 reloc.symbol.kind = Symbol::Kind::FUNCTION;
-                reloc.symbol.byte_offset = text.contents().size();
+                reloc.symbol.byte_offset = text.offset();
                 reloc.symbol.name = block->name();
-                reloc.symbol.section_name = text.name;
+                reloc.symbol.section_name = text.section_name();
                 reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
                 gobj.relocations.push_back(reloc);
 
-                text += as_bytes(u32(0));
+                text.append32(0);
             } else if (is_function(inst)) {
                 auto function = extract_function(inst);
 
-                text += {0x0f, 0x84};
+                text += {0x0f, op};
                 // RELOCATION
                 Relocation reloc{};
                 reloc.symbol.kind = Symbol::Kind::FUNCTION;
-                reloc.symbol.byte_offset = text.contents().size();
+                reloc.symbol.byte_offset = text.offset();
                 reloc.symbol.name = function->names().at(0).name;
-                reloc.symbol.section_name = text.name;
+                reloc.symbol.section_name = text.section_name();
                 reloc.kind = Relocation::Kind::DISPLACEMENT32_PCREL;
                 gobj.relocations.push_back(reloc);
 
-                text += as_bytes(u32(0));
+                text.append32(0);
             } else Diag::ICE(
                 "Sorry, unhandled form\n    {}\n",
                 PrintMInstImpl(inst, opcode_to_string)
@@ -1011,7 +1224,7 @@ static void assemble_inst(
                 if (imm.size <= 8 or imm.size > 32 or reg_topbit(reg))
                     text += rex_byte(imm.size > 32, reg_topbit(reg), false, false);
                 text += {op, modrm};
-                text += as_bytes_cap32(imm);
+                text.immediate_cap32(imm);
             } else Diag::ICE(
                 "Sorry, unhandled form\n    {}\n",
                 PrintMInstImpl(inst, opcode_to_string)
@@ -1044,6 +1257,19 @@ static void assemble_inst(
             );
         } break;
 
+        case Opcode::Xor: {
+            // GNU syntax (src, dst operands)
+            //       0x30 /r | XOR r8, r/m8   | MR
+            //  0x66 0x31 /r | XOR r16, r/m16 | MR
+            //       0x31 /r | XOR r32, r/m32 | MR
+            // REX.W 0x31 /r | XOR r64, r/m64 | MR
+            if (is_reg_reg(inst)) opcode_slash_r(gobj, func, inst, 0x30, text);
+            else Diag::ICE(
+                "Sorry, unhandled form\n    {}\n",
+                PrintMInstImpl(inst, opcode_to_string)
+            );
+        } break;
+
         case Opcode::Not:
         case Opcode::Or:
         case Opcode::Multiply:
@@ -1052,79 +1278,593 @@ static void assemble_inst(
         case Opcode::ShiftRightLogical:
             LCC_TODO("Assemble {}\n", PrintMInstImpl(inst, opcode_to_string));
 
+        // Handled by assemble_vector_inst() above.
+        case Opcode::PackedAdd8:
+        case Opcode::PackedAdd16:
+        case Opcode::PackedAdd32:
+        case Opcode::PackedAdd64:
+        case Opcode::PackedSub8:
+        case Opcode::PackedSub16:
+        case Opcode::PackedSub32:
+        case Opcode::PackedSub64:
+        case Opcode::PackedMultiply16:
+        case Opcode::PackedMultiply32:
+        case Opcode::PackedAnd:
+        case Opcode::PackedOr:
+        case Opcode::PackedXor:
+        case Opcode::PackedMultiplyEven32:
+        case Opcode::PackedShiftLeft64:
+        case Opcode::PackedShiftRight64:
         case Opcode::Poison: LCC_UNREACHABLE();
     }
 }
 
-static void assemble(GenericObject& gobj, MFunction& func, Section& text) {
-    // TODO: Stack frame kinds.
-    // GNU syntax (src, dst operands)
-    // push %rbp
-    // mov %rsp, %rbp
-    auto push_rbp = MInst(usz(Opcode::Push), {0, 0});
-    push_rbp.add_operand(MOperandRegister(usz(RegisterId::RBP), 64));
-    auto mov_rsp_into_rbp = MInst(usz(Opcode::Move), {0, 0});
-    mov_rsp_into_rbp.add_operand(MOperandRegister(usz(RegisterId::RSP), 64));
-    mov_rsp_into_rbp.add_operand(MOperandRegister(usz(RegisterId::RBP), 64));
-    assemble_inst(gobj, func, push_rbp, text);
-    assemble_inst(gobj, func, mov_rsp_into_rbp, text);
-
-    // TODO: Different stack frame kinds
-    usz stack_frame_size = rgs::fold_left(
-        vws::transform(func.locals(), [](AllocaInst* l) {
-            return l->allocated_type()->bytes();
-        }),
-        0,
-        std::plus{}
+/// A jump to a block of the function being assembled, which is first
+/// encoded with a 32-bit displacement:
+///
+///      0xe9 cd | JMP rel32 | D
+/// 0x0f 0x84 cd | JZ rel32  | D
+/// 0x0f 0x85 cd | JNZ rel32 | D
+///
+/// and may be relaxed to the two-byte form with an 8-bit displacement:
+///
+///      0xeb cb | JMP rel8  | D
+///      0x74 cb | JZ rel8   | D
+///      0x75 cb | JNZ rel8  | D
+struct BlockBranch {
+    /// Offset of the first byte of the instruction.
+    usz offset;
+
+    /// Size of the rel32 form.
+    usz size;
+
+    /// Opcode of the rel8 form.
+    u8 short_opcode;
+
+    /// Offset of the block jumped to.
+    usz target;
+
+    /// Index of the relocation for the rel32 displacement.
+    usz relocation;
+
+    bool relaxed{false};
+};
+
+static constexpr usz short_branch_size = 2;
+
+/// Branch relaxation: replace jumps to blocks that are close enough
+/// by their rel8 forms, and resolve their displacements directly rather
+/// than through a relocation. Symbols, relocations, and frame events
+/// after a relaxed jump are moved up accordingly. \p branches must be
+/// sorted by offset.
+///
+/// Every jump starts out in its rel32 form. Relaxing a jump only ever
+/// brings others closer to their targets, so we just keep relaxing all
+/// jumps that fit until none are left that do; a jump never needs to
+/// be grown back once it's been relaxed.
+static void relax_branches(
+    GenericObject& gobj,
+    Section& text,
+    std::vector<BlockBranch>& branches,
+    std::vector<FrameEvent>& frame
+) {
+    if (branches.empty()) return;
+
+    // saved[i] is the number of bytes saved by relaxing the first i
+    // branches.
+    std::vector<usz> saved(branches.size() + 1);
+    auto update_saved = [&] {
+        for (auto [i, branch] : vws::enumerate(branches)) {
+            usz saving = branch.relaxed ? branch.size - short_branch_size : 0;
+            saved[usz(i) + 1] = saved[usz(i)] + saving;
+        }
+    };
+
+    // Where a byte (that isn't part of a relaxed branch) ends up after
+    // relaxation: before it, there are all branches that end at or
+    // before it.
+    auto relocate = [&](usz offset) {
+        auto after = rgs::upper_bound(branches, offset, std::less{}, [](const BlockBranch& branch) {
+            return branch.offset + branch.size;
+        });
+        return offset - saved[usz(after - branches.begin())];
+    };
+
+    // The displacement of a branch in its rel8 form.
+    auto short_displacement = [&](const BlockBranch& branch) {
+        auto from = isz(relocate(branch.offset) + short_branch_size);
+        auto to = isz(relocate(branch.target));
+        if (not branch.relaxed and branch.target > branch.offset)
+            to -= isz(branch.size - short_branch_size);
+        return to - from;
+    };
+
+    // Decisions made within one pass are based on the layout at the
+    // start of it, which, if anything, overestimates the distances.
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& branch : branches) {
+            if (branch.relaxed) continue;
+            auto displacement = short_displacement(branch);
+            if (displacement >= -128 and displacement <= 127) {
+                branch.relaxed = true;
+                changed = true;
+            }
+        }
+        update_saved();
+    }
+    if (not saved.back()) return;
+
+    // Rewrite the code with the relaxed branches.
+    auto& contents = text.contents();
+    std::vector<u8> relaxed{};
+    relaxed.reserve(contents.size() - saved.back());
+    usz copied = 0;
+    for (auto& branch : branches) {
+        if (not branch.relaxed) continue;
+        auto displacement = short_displacement(branch);
+        LCC_ASSERT(displacement >= -128 and displacement <= 127, "Relaxed branch out of range");
+        relaxed.insert(relaxed.end(), contents.begin() + isz(copied), contents.begin() + isz(branch.offset));
+        relaxed.push_back(branch.short_opcode);
+        relaxed.push_back(u8(i8(displacement)));
+        copied = branch.offset + branch.size;
+    }
+    relaxed.insert(relaxed.end(), contents.begin() + isz(copied), contents.end());
+    contents = std::move(relaxed);
+
+    // Drop the relocations of relaxed branches, and move everything else.
+    std::vector<bool> resolved(gobj.relocations.size());
+    for (auto& branch : branches)
+        if (branch.relaxed) resolved[branch.relocation] = true;
+    std::vector<Relocation> relocations{};
+    for (auto [i, reloc] : vws::enumerate(gobj.relocations)) {
+        if (resolved[usz(i)]) continue;
+        reloc.symbol.byte_offset = relocate(reloc.symbol.byte_offset);
+        relocations.push_back(std::move(reloc));
+    }
+    gobj.relocations = std::move(relocations);
+    for (auto& sym : gobj.symbols)
+        sym.byte_offset = relocate(sym.byte_offset);
+    for (auto& event : frame)
+        event.offset = relocate(event.offset);
+}
+
+/// The longest an x86_64 instruction can be, in bytes.
+static constexpr usz max_instruction_length = 15;
+
+/// Whether an instruction leaves the function and so has to tear down
+/// its frame first: a return, or a jump to a function, which is a tail
+/// call.
+static bool is_frame_exit(MInst& inst) {
+    return inst.opcode() == +Opcode::Return
+        or (inst.opcode() == +Opcode::Jump and is_function(inst));
+}
+
+// DWARF call frame instructions and register numbers (System V x86_64
+// psABI, figure 3.36) used to describe our stack frames.
+static constexpr u8 DW_CFA_advance_loc = 0x40;
+static constexpr u8 DW_CFA_offset = 0x80;
+static constexpr u8 DW_CFA_advance_loc1 = 0x02;
+static constexpr u8 DW_CFA_advance_loc2 = 0x03;
+static constexpr u8 DW_CFA_advance_loc4 = 0x04;
+static constexpr u8 DW_CFA_remember_state = 0x0a;
+static constexpr u8 DW_CFA_restore_state = 0x0b;
+static constexpr u8 DW_CFA_def_cfa = 0x0c;
+static constexpr u8 DW_CFA_def_cfa_register = 0x0d;
+static constexpr u8 DW_CFA_def_cfa_offset = 0x0e;
+static constexpr u8 DW_CFA_nop = 0x00;
+static constexpr u8 dwarf_rbp = 6;
+static constexpr u8 dwarf_rsp = 7;
+static constexpr u8 dwarf_return_address = 16;
+
+/// Offsets of saved registers from the CFA are given in multiples of
+/// this (the CIE's data alignment factor), to keep them to one byte.
+static constexpr isz cfa_data_alignment = -8;
+
+static constexpr u8 dwarf_register(RegisterId id) {
+    switch (id) {
+        case RegisterId::RAX: return 0;
+        case RegisterId::RDX: return 1;
+        case RegisterId::RCX: return 2;
+        case RegisterId::RBX: return 3;
+        case RegisterId::RSI: return 4;
+        case RegisterId::RDI: return 5;
+        case RegisterId::RBP: return dwarf_rbp;
+        case RegisterId::RSP: return dwarf_rsp;
+        case RegisterId::R8: return 8;
+        case RegisterId::R9: return 9;
+        case RegisterId::R10: return 10;
+        case RegisterId::R11: return 11;
+        case RegisterId::R12: return 12;
+        case RegisterId::R13: return 13;
+        case RegisterId::R14: return 14;
+        case RegisterId::R15: return 15;
+        default: LCC_UNREACHABLE();
+    }
+}
+
+static void append_uleb128(std::vector<u8>& out, u64 value) {
+    do {
+        u8 byte = value & 0x7f;
+        value >>= 7;
+        if (value) byte |= 0x80;
+        out.push_back(byte);
+    } while (value);
+}
+
+static void append_sleb128(std::vector<u8>& out, i64 value) {
+    for (;;) {
+        u8 byte = value & 0x7f;
+        value >>= 7;
+        bool done = (value == 0 and not(byte & 0x40)) or (value == -1 and (byte & 0x40));
+        if (not done) byte |= 0x80;
+        out.push_back(byte);
+        if (done) break;
+    }
+}
+
+/// DW_CFA_offset: \p reg is saved at CFA - \p distance.
+static auto cfa_offset(u8 reg, usz distance) -> std::vector<u8> {
+    LCC_ASSERT(
+        distance % usz(-cfa_data_alignment) == 0,
+        "Saved register at misaligned distance {} from the CFA",
+        distance
     );
-    if (stack_frame_size) {
-        constexpr usz alignment = 16;
-        stack_frame_size = utils::AlignTo(stack_frame_size, alignment);
-        auto sub_rsp = MInst(usz(Opcode::Sub), {});
-        sub_rsp.add_operand(MOperandImmediate(stack_frame_size));
-        sub_rsp.add_operand(MOperandRegister(usz(RegisterId::RSP), 64));
-        assemble_inst(gobj, func, sub_rsp, text);
+    LCC_ASSERT(reg < 64, "DWARF register {} too large for DW_CFA_offset", reg);
+    std::vector<u8> out{u8(DW_CFA_offset | reg)};
+    append_uleb128(out, distance / usz(-cfa_data_alignment));
+    return out;
+}
+
+static void assemble(
+    GenericObject& gobj,
+    const MachineDescription& desc,
+    MFunction& func,
+    Section& section,
+    std::vector<FrameEvent>& frame_events
+) {
+    // Reserve enough room for the whole function up front, so that the
+    // section grows at most once per function rather than repeatedly as
+    // instructions are appended. The prologue and the epilogue of every
+    // return take a few instructions more than the function has.
+    auto frame = stack_frame(desc, func);
+    usz instructions = 4 + frame.saved_registers.size();
+    for (auto& block : func.blocks()) {
+        for (auto& inst : block.instructions()) {
+            instructions++;
+            if (is_frame_exit(inst))
+                instructions += 2 + frame.saved_registers.size();
+        }
+    }
+    Encoder text{section};
+    text.reserve(instructions * max_instruction_length);
+
+    auto rsp = MOperandRegister(usz(RegisterId::RSP), 64);
+    auto rbp = MOperandRegister(usz(RegisterId::RBP), 64);
+    auto Emit = [&](Opcode opcode, auto... operands) {
+        auto inst = MInst(usz(opcode), {0, 0});
+        (inst.add_operand(operands), ...);
+        assemble_inst(gobj, func, inst, text);
+    };
+
+    // Without a frame pointer, the CFA stays at a fixed distance from
+    // RSP, which changes every time RSP does.
+    usz cfa_distance = GeneralPurposeBytewidth;
+    auto MoveCFA = [&](isz by) {
+        cfa_distance = usz(isz(cfa_distance) + by);
+        std::vector<u8> event{DW_CFA_def_cfa_offset};
+        append_uleb128(event, cfa_distance);
+        frame_events.push_back({text.offset(), std::move(event)});
+    };
+
+    // The CIE starts out with the CFA at RSP+8, where the call left it.
+    // Pushing RBP moves it to RSP+16, with RBP saved right below it, and
+    // from then on, it is RBP+16, however the stack pointer moves.
+    //
+    // Without a frame pointer, the slot RBP would have been saved in is
+    // allocated along with the locals, so the locals are at the same
+    // offsets from the CFA either way.
+    switch (frame.kind) {
+        case FrameKind::None: break;
+
+        case FrameKind::Full:
+        case FrameKind::RedZone: {
+            // GNU syntax (src, dst operands)
+            // push %rbp
+            // mov %rsp, %rbp
+            Emit(Opcode::Push, rbp);
+            auto save_rbp = cfa_offset(dwarf_rbp, 16);
+            save_rbp.insert(save_rbp.begin(), {DW_CFA_def_cfa_offset, 16});
+            frame_events.push_back({text.offset(), std::move(save_rbp)});
+            Emit(Opcode::Move, rsp, rbp);
+            frame_events.push_back({text.offset(), {DW_CFA_def_cfa_register, dwarf_rbp}});
+            if (frame.locals_size) Emit(Opcode::Sub, MOperandImmediate(frame.locals_size), rsp);
+        } break;
+
+        case FrameKind::NoFramePointer: {
+            auto size = frame.locals_size + GeneralPurposeBytewidth;
+            Emit(Opcode::Sub, MOperandImmediate(size), rsp);
+            MoveCFA(isz(size));
+        } break;
     }
 
+    // Save the callee-saved registers we use below the locals.
+    for (auto [i, reg] : vws::enumerate(frame.saved_registers)) {
+        Emit(Opcode::Push, MOperandRegister(reg, 64));
+        auto save = cfa_offset(
+            dwarf_register(RegisterId(reg)),
+            16 + frame.locals_size + (usz(i) + 1) * GeneralPurposeBytewidth
+        );
+        if (frame.kind == FrameKind::NoFramePointer) {
+            cfa_distance += GeneralPurposeBytewidth;
+            save.push_back(DW_CFA_def_cfa_offset);
+            append_uleb128(save, cfa_distance);
+        }
+        frame_events.push_back({text.offset(), std::move(save)});
+    }
+
+    // Restore the saved registers and tear down the frame right before a
+    // return or tail call. A frame exit needn't be the last instruction
+    // of the function, so the unwind state of the body is saved here and
+    // restored after it.
+    auto Epilogue = [&] {
+        if (frame.kind == FrameKind::None) return;
+        frame_events.push_back({text.offset(), {DW_CFA_remember_state}});
+        auto body_distance = cfa_distance;
+        for (auto reg : frame.saved_registers | vws::reverse) {
+            Emit(Opcode::Pop, MOperandRegister(reg, 64));
+            if (frame.kind == FrameKind::NoFramePointer) MoveCFA(-isz(GeneralPurposeBytewidth));
+        }
+
+        if (frame.kind == FrameKind::NoFramePointer) {
+            Emit(Opcode::Add, MOperandImmediate(frame.locals_size + GeneralPurposeBytewidth), rsp);
+            frame_events.push_back({text.offset(), {DW_CFA_def_cfa_offset, 8}});
+            cfa_distance = body_distance;
+            return;
+        }
+
+        // GNU syntax (src, dst operands)
+        // mov %rbp, %rsp
+        // pop %rbp
+        if (frame.kind == FrameKind::Full) Emit(Opcode::Move, rbp, rsp);
+        Emit(Opcode::Pop, rbp);
+        frame_events.push_back({text.offset(), {DW_CFA_def_cfa, dwarf_rsp, 8}});
+    };
+
+    // Jumps to blocks of this function, along with the names of the
+    // blocks they jump to, for branch relaxation.
+    std::vector<BlockBranch> branches{};
+    std::vector<std::string> branch_targets{};
+    std::unordered_map<std::string, usz> block_offsets{};
+    isz adjustment = 0;
     for (auto& block : func.blocks()) {
+        block_offsets[block.name()] = text.offset();
         gobj.symbols.push_back(
             {Symbol::Kind::STATIC,
              block.name(),
-             text.name,
-             text.contents().size()}
+             text.section_name(),
+             text.offset()}
         );
 
-        for (auto& inst : block.instructions())
-            assemble_inst(gobj, func, inst, text);
+        for (auto& inst : block.instructions()) {
+            // A jump to the block right after this one can fall through.
+            if (
+                &block != &func.blocks().back()
+                and inst.opcode() == +Opcode::Jump
+                and is_block(inst)
+                and extract_block(inst)->name() == (&block + 1)->name()
+            ) continue;
+
+            if (is_frame_exit(inst)) Epilogue();
+
+            const usz offset = text.offset();
+            assemble_inst(gobj, func, inst, text, frame.base(adjustment));
+
+            if (is_frame_exit(inst) and frame.kind != FrameKind::None)
+                frame_events.push_back({text.offset(), {DW_CFA_restore_state}});
+
+            // Arguments passed in memory move RSP, and thus the locals
+            // relative to it, until the call returns.
+            if (auto by = stack_adjustment(inst)) {
+                adjustment += by;
+                if (frame.kind == FrameKind::NoFramePointer) MoveCFA(by);
+            }
+
+            if (
+                (inst.opcode() == +Opcode::Jump or inst.opcode() == +Opcode::JumpIfZeroFlag or inst.opcode() == +Opcode::JumpIfNotZeroFlag)
+                and is_block(inst)
+            ) {
+                u8 short_opcode = 0xeb;
+                if (inst.opcode() == +Opcode::JumpIfZeroFlag) short_opcode = 0x74;
+                else if (inst.opcode() == +Opcode::JumpIfNotZeroFlag) short_opcode = 0x75;
+                branches.push_back({
+                    offset,
+                    text.offset() - offset,
+                    short_opcode,
+                    0,
+                    gobj.relocations.size() - 1,
+                });
+                branch_targets.push_back(extract_block(inst)->name());
+            }
+        }
+    }
+
+    for (auto [i, branch] : vws::enumerate(branches))
+        branch.target = block_offsets.at(branch_targets[usz(i)]);
+    relax_branches(gobj, section, branches, frame_events);
+}
+
+/// A function that gets an FDE in .eh_frame.
+struct FrameDescription {
+    /// The name of the function symbol that the FDE refers to.
+    std::string name;
+
+    /// Size of the machine code of the function.
+    usz size;
+
+    std::vector<FrameEvent> events;
+};
+
+/// Build the .eh_frame section of an ELF object: one CIE shared by all
+/// functions, which describes the state at the entry of every function,
+/// and an FDE for each function that is defined here, which describes
+/// how its prologue and epilogues change that state.
+static auto eh_frame(GenericObject& gobj, std::span<const FrameDescription> functions) -> Section {
+    Section eh_frame_{".eh_frame"};
+    eh_frame_.attribute(Section::Attribute::LOAD, true);
+    auto& out = eh_frame_.contents();
+
+    auto append32 = [&](u32 value) {
+        for (usz i = 0; i < 4; i++) out.push_back(u8(value >> (8 * i)));
+    };
+
+    // Fill in the length of an entry that starts at \p start, padding it
+    // to a multiple of the address size first.
+    auto finish_entry = [&](usz start) {
+        while ((out.size() - start) % 8) out.push_back(DW_CFA_nop);
+        u32 length = u32(out.size() - start - 4);
+        for (usz i = 0; i < 4; i++) out[start + i] = u8(length >> (8 * i));
+    };
+
+    // CIE
+    const usz cie = out.size();
+    append32(0); // Length
+    append32(0); // CIE ID
+    out.push_back(1); // Version
+    out.insert(out.end(), {'z', 'R', '\0'}); // Augmentation
+    append_uleb128(out, 1); // Code alignment factor
+    append_sleb128(out, cfa_data_alignment);
+    append_uleb128(out, dwarf_return_address);
+    append_uleb128(out, 1); // Augmentation data length
+    out.push_back(0x1b); // FDE pointers are PC-relative, signed 4-byte.
+    out.insert(out.end(), {DW_CFA_def_cfa, dwarf_rsp, 8});
+    auto save_return_address = cfa_offset(dwarf_return_address, 8);
+    out.insert(out.end(), save_return_address.begin(), save_return_address.end());
+    finish_entry(cie);
+
+    // FDEs
+    for (auto& function : functions) {
+        const usz fde = out.size();
+        append32(0); // Length
+        append32(u32(out.size() - cie)); // CIE pointer, relative to itself
+
+        Relocation reloc{};
+        reloc.kind = Relocation::Kind::PCREL32;
+        reloc.symbol.name = function.name;
+        reloc.symbol.section_name = eh_frame_.name;
+        reloc.symbol.byte_offset = out.size();
+        reloc.addend = 0;
+        gobj.relocations.push_back(std::move(reloc));
+        append32(0); // PC begin
+        append32(u32(function.size)); // PC range
+        append_uleb128(out, 0); // Augmentation data length
+
+        usz location = 0;
+        for (auto& event : function.events) {
+            LCC_ASSERT(event.offset >= location, "Frame events of {} out of order", function.name);
+            usz delta = event.offset - location;
+            if (delta < 0x40) {
+                if (delta) out.push_back(u8(DW_CFA_advance_loc | delta));
+            } else if (delta <= 0xff) {
+                out.insert(out.end(), {DW_CFA_advance_loc1, u8(delta)});
+            } else if (delta <= 0xffff) {
+                out.insert(out.end(), {DW_CFA_advance_loc2, u8(delta), u8(delta >> 8)});
+            } else {
+                out.push_back(DW_CFA_advance_loc4);
+                append32(u32(delta));
+            }
+            out.insert(out.end(), event.instructions.begin(), event.instructions.end());
+            location = event.offset;
+        }
+        finish_entry(fde);
     }
+
+    return eh_frame_;
+}
+
+/// Whether a function is defined elsewhere.
+static bool is_imported(const MFunction& func) {
+    return rgs::any_of(func.names(), [](const auto& n) {
+        return IsImportedLinkage(n.linkage);
+    });
+}
+
+/// The name of the section of its own that a function or variable goes
+/// into with function or data sections, e.g. ".text.main".
+static auto section_name(std::string_view prefix, std::string_view name) -> std::string {
+    return fmt::format("{}.{}", prefix, name);
+}
+
+/// The section that an initialised variable goes into. String literals
+/// are never written to; those that are a single string go where the
+/// linker can merge them with identical ones from other objects.
+static auto data_section_name(GlobalVariable* var) -> std::string_view {
+    if (var->is_mergeable_string()) return ".rodata.str1.1";
+    if (var->is_string_literal()) return ".rodata";
+    return ".data";
 }
 
 auto emit_mcode_gobj(
     Module* module,
     const MachineDescription& desc,
-    std::vector<MFunction>& mir
+    std::vector<MFunction>& mir,
+    std::vector<usz>* function_sizes,
+    std::vector<std::optional<EncodedFunction>>* encoded
 ) -> GenericObject {
     GenericObject out{};
 
+    const bool function_sections = module->context()->option_function_sections();
+    const bool data_sections = module->context()->option_data_sections();
+
     Section text_{".text"};
     Section data_{".data"};
+    Section rodata_{".rodata"};
+    Section strings_{".rodata.str1.1"};
     Section bss_{".bss"};
     text_.attribute(Section::Attribute::LOAD, true);
     text_.attribute(Section::Attribute::EXECUTABLE, true);
     data_.attribute(Section::Attribute::LOAD, true);
     data_.attribute(Section::Attribute::WRITABLE, true);
+    rodata_.attribute(Section::Attribute::LOAD, true);
+    strings_.attribute(Section::Attribute::LOAD, true);
+    strings_.attribute(Section::Attribute::MERGE_STRINGS, true);
     bss_.attribute(Section::Attribute::LOAD, true);
     bss_.attribute(Section::Attribute::WRITABLE, true);
+    bss_.is_fill = true;
     out.sections.push_back(text_);
     out.sections.push_back(data_);
+    out.sections.push_back(rodata_);
+    out.sections.push_back(strings_);
     out.sections.push_back(bss_);
 
-    // Extra sections (frontend metadata and the like).
-    out.sections.insert(
-        out.sections.end(),
-        module->extra_sections().begin(),
-        module->extra_sections().end()
-    );
+    // With data sections, every global variable that is defined here gets
+    // a section of its own, ".data.<name>", ".rodata.<name>" or
+    // ".bss.<name>", except for mergeable strings, which all stay in one
+    // section so the linker can merge them.
+    std::vector<std::string> var_sections{};
+    if (data_sections) {
+        for (auto* var : module->vars()) {
+            const bool defined = var->init() or rgs::any_of(var->names(), [](const auto& n) {
+                return not IsImportedLinkage(n.linkage);
+            });
+            if (not defined or var->is_mergeable_string()) {
+                var_sections.emplace_back();
+                continue;
+            }
+
+            Section section{section_name(var->init() ? data_section_name(var) : ".bss", var->names().at(0).name)};
+            section.attribute(Section::Attribute::LOAD, true);
+            if (not var->is_string_literal()) section.attribute(Section::Attribute::WRITABLE, true);
+            section.is_fill = not var->init();
+            var_sections.push_back(section.name);
+            out.sections.push_back(std::move(section));
+        }
+    }
+
+    // Extra sections (frontend metadata and the like). These may be
+    // large, and the module outlives the object, so don't copy them.
+    for (auto& section : module->extra_sections())
+        out.sections.push_back(Section::Borrow(section));
 
     Section gnu_stack{};
     gnu_stack.name = ".note.GNU-stack";
@@ -1134,10 +1874,88 @@ auto emit_mcode_gobj(
     // Section& data = out.section(".data");
     // Section& bss = out.section(".bss");
 
-    for (auto* var : module->vars())
-        out.symbols_from_global(var);
+    for (auto [i, var] : vws::enumerate(module->vars())) {
+        if (data_sections and not var_sections[usz(i)].empty())
+            out.symbols_from_global(var, var_sections[usz(i)], var_sections[usz(i)]);
+        else if (var->init()) out.symbols_from_global(var, data_section_name(var));
+        else out.symbols_from_global(var);
+    }
+
+    // Functions are encoded independently of one another, each into a
+    // fragment of its own whose offsets start at zero. The fragments
+    // are then appended to .text in order and their symbols and
+    // relocations rebased, which yields the same object as encoding
+    // everything serially.
+    //
+    // With function sections, the fragment of every function that is
+    // defined here becomes a section of its own, ".text.<name>", as is.
+    struct Fragment {
+        GenericObject gobj{};
+        Section text{".text"};
+        std::vector<FrameEvent> frame{};
+    };
+    std::vector<Fragment> fragments(mir.size());
+    if (function_sections) {
+        for (auto [i, func] : vws::enumerate(mir)) {
+            if (is_imported(func)) continue;
+            auto& section = fragments[usz(i)].text;
+            section.name = section_name(".text", func.names().at(0).name);
+            section.attribute(Section::Attribute::LOAD, true);
+            section.attribute(Section::Attribute::EXECUTABLE, true);
+        }
+    }
+
+    // A function that was encoded before, e.g. by an earlier compilation,
+    // is spliced in as a fragment just the same.
+    ParallelFor(mir.size(), module->context()->option_jobs(), [&](usz i) {
+        if (function_sections and is_imported(mir[i])) return;
+        auto& fragment = fragments[i];
+        if (encoded and encoded->at(i)) {
+            auto& e = *encoded->at(i);
+            fragment.text.contents() = e.code;
+            fragment.gobj.symbols = e.symbols;
+            fragment.gobj.relocations = e.relocations;
+            fragment.frame = e.frame;
+            return;
+        }
+
+        Trace::Event event{module->context(), "Encode Function"};
+        TraceMFunction(event, mir[i]);
+        assemble(fragment.gobj, desc, mir[i], fragment.text, fragment.frame);
+        if (encoded and not is_imported(mir[i])) {
+            encoded->at(i) = EncodedFunction{
+                fragment.text.contents(),
+                fragment.gobj.symbols,
+                fragment.gobj.relocations,
+                fragment.frame,
+            };
+        }
+    });
+
+    if (function_sizes) {
+        function_sizes->clear();
+        for (auto& fragment : fragments) function_sizes->push_back(fragment.text.contents().size());
+    }
+
+    if (not function_sections) {
+        usz text_size = text.contents().size();
+        for (auto& fragment : fragments) text_size += fragment.text.contents().size();
+        text.contents().reserve(text_size);
+    }
+
+    // Unwind information, so that debuggers, profilers, and exceptions
+    // can walk the stack through our code. COFF has its own format for
+    // this, which we don't emit (yet).
+    const bool unwind_info = module->context()->format()->format() == Format::ELF_OBJECT;
+    std::vector<FrameDescription> frame_descriptions{};
+
+    std::vector<Section> own_sections{};
+    for (auto [i, func] : vws::enumerate(mir)) {
+        auto& fragment = fragments.at(usz(i));
+        const bool own_section = function_sections and not is_imported(func);
+        const std::string function_section = own_section ? fragment.text.name : text.name;
+        const usz base = own_section ? 0 : text.contents().size();
 
-    for (auto& func : mir) {
         for (auto n : func.names()) {
             const bool imported = IsImportedLinkage(n.linkage);
             // const bool exported = IsLinkageExported(n.linkage);
@@ -1151,15 +1969,42 @@ auto emit_mcode_gobj(
                 Symbol sym{};
                 sym.kind = Symbol::Kind::FUNCTION;
                 sym.name = n.name;
-                sym.section_name = text.name;
-                sym.byte_offset = text.contents().size();
+                sym.section_name = function_section;
+                sym.byte_offset = base;
                 out.symbols.push_back(sym);
             }
         }
 
-        // Assemble function into machine code.
-        assemble(out, func, text);
+        // Append the machine code of the function.
+        for (auto& sym : fragment.gobj.symbols) {
+            sym.byte_offset += base;
+            out.symbols.push_back(std::move(sym));
+        }
+        for (auto& reloc : fragment.gobj.relocations) {
+            reloc.symbol.byte_offset += base;
+            out.relocations.push_back(std::move(reloc));
+        }
+        if (unwind_info and not is_imported(func)) {
+            frame_descriptions.push_back({
+                func.names().at(0).name,
+                fragment.text.contents().size(),
+                std::move(fragment.frame),
+            });
+        }
+
+        if (own_section) own_sections.push_back(std::move(fragment.text));
+        else if (not function_sections) {
+            text += std::span<const u8>(fragment.text.contents());
+            fragment.text.contents() = {};
+        }
     }
+    out.sections.insert(
+        out.sections.end(),
+        std::make_move_iterator(own_sections.begin()),
+        std::make_move_iterator(own_sections.end())
+    );
+
+    if (unwind_info) out.sections.push_back(eh_frame(out, frame_descriptions));
 
     // TODO: Resolve local label ".Lxxxx" relocations.
 
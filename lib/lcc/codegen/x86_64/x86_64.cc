@@ -1,6 +1,20 @@
 #include <lcc/codegen/x86_64/x86_64.hh>
 
+#include <lcc/codegen/liveness.hh>
 #include <lcc/codegen/mir.hh>
+#include <lcc/codegen/mir_utils.hh>
+#include <lcc/context.hh>
+#include <lcc/ir/ir.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 namespace lcc::x86_64 {
 
@@ -9,4 +23,367 @@ std::string opcode_to_string(usz opcode) {
         return std::string{ToString(static_cast<Opcode>(opcode))};
     return MInstOpcodeToString(opcode);
 }
+
+auto vector_bits(const MInst& inst) -> usz {
+    for (const auto& op : inst.all_operands()) {
+        if (not std::holds_alternative<MOperandRegister>(op)) continue;
+        auto reg = std::get<MOperandRegister>(op);
+        if (reg.size > GeneralPurposeBitwidth) return reg.size;
+    }
+    return 0;
+}
+
+auto machine_description(const Context* ctx) -> MachineDescription {
+    MachineDescription desc{};
+    desc.return_register_to_replace = +RegisterId::RETURN;
+    desc.move_opcode = +Opcode::Move;
+    desc.call_opcode = +Opcode::Call;
+    desc.general_purpose_bits = GeneralPurposeBitwidth;
+    if (ctx->target()->is_cconv_ms()) {
+        desc.return_register = +RegisterId::RAX;
+        // Volatile registers first, so that callee-saved registers are
+        // only used (and thus saved) when we run out of the former.
+        desc.registers = {
+            +RegisterId::RAX,
+            +RegisterId::RCX,
+            +RegisterId::RDX,
+            +RegisterId::R8,
+            +RegisterId::R9,
+            +RegisterId::R10,
+            +RegisterId::R11,
+        };
+        desc.callee_saved_registers = {
+            +RegisterId::RBX,
+            +RegisterId::RSI,
+            +RegisterId::RDI,
+            +RegisterId::R12,
+            +RegisterId::R13,
+            +RegisterId::R14,
+            +RegisterId::R15,
+        };
+        // XMM6-XMM15 are callee-saved, which we can't do with a push, so
+        // only the volatile ones are used.
+        desc.vector_registers = {
+            +RegisterId::XMM0,
+            +RegisterId::XMM1,
+            +RegisterId::XMM2,
+            +RegisterId::XMM3,
+            +RegisterId::XMM4,
+            +RegisterId::XMM5,
+        };
+    } else {
+        desc.return_register = +RegisterId::RAX;
+        desc.registers = {
+            +RegisterId::RAX,
+            +RegisterId::RCX,
+            +RegisterId::RDX,
+            +RegisterId::RSI,
+            +RegisterId::RDI,
+            +RegisterId::R8,
+            +RegisterId::R9,
+            +RegisterId::R10,
+            +RegisterId::R11,
+        };
+        desc.callee_saved_registers = {
+            +RegisterId::RBX,
+            +RegisterId::R12,
+            +RegisterId::R13,
+            +RegisterId::R14,
+            +RegisterId::R15,
+        };
+        // All vector registers are volatile.
+        desc.vector_registers = {
+            +RegisterId::XMM0,
+            +RegisterId::XMM1,
+            +RegisterId::XMM2,
+            +RegisterId::XMM3,
+            +RegisterId::XMM4,
+            +RegisterId::XMM5,
+            +RegisterId::XMM6,
+            +RegisterId::XMM7,
+            +RegisterId::XMM8,
+            +RegisterId::XMM9,
+            +RegisterId::XMM10,
+            +RegisterId::XMM11,
+            +RegisterId::XMM12,
+            +RegisterId::XMM13,
+            +RegisterId::XMM14,
+            +RegisterId::XMM15,
+        };
+        desc.red_zone_size = 128;
+    }
+
+    // Without a frame pointer, RBP is just another register to save.
+    if (ctx->option_frame_pointer() == Context::OmitFramePointer) {
+        desc.omit_frame_pointer = true;
+        desc.callee_saved_registers.push_back(+RegisterId::RBP);
+    }
+
+    desc.registers.insert(
+        desc.registers.end(),
+        desc.callee_saved_registers.begin(),
+        desc.callee_saved_registers.end()
+    );
+    return desc;
+}
+
+auto stack_frame(const MachineDescription& desc, const MFunction& function) -> StackFrame {
+    StackFrame frame{};
+    for (auto reg : desc.callee_saved_registers)
+        if (function.registers_used().contains(u8(reg)))
+            frame.saved_registers.push_back(reg);
+
+    usz locals_size = function.locals_size();
+
+    // The saved registers are pushed below the locals, and RSP has to be
+    // 16-byte aligned after that, as it was after pushing RBP.
+    constexpr usz alignment = 16;
+    usz saved_size = frame.saved_registers.size() * GeneralPurposeBytewidth;
+    frame.locals_size = utils::AlignTo(locals_size + saved_size, alignment) - saved_size;
+
+    // A function that calls nothing can get away with less, as long as
+    // it has nothing to save. A jump to a function is fine, since the
+    // frame is gone by then.
+    bool leaf = true, uses_stack = false;
+    for (const auto& block : function.blocks()) {
+        for (const auto& inst : block.instructions()) {
+            if (inst.opcode() == +Opcode::Call) leaf = false;
+            for (const auto& op : inst.all_operands()) {
+                if (std::holds_alternative<MOperandLocal>(op)) uses_stack = true;
+                else if (
+                    std::holds_alternative<MOperandRegister>(op)
+                    and std::get<MOperandRegister>(op).value == +RegisterId::RSP
+                ) leaf = false;
+            }
+        }
+    }
+
+    if (leaf and frame.saved_registers.empty()) {
+        if (not uses_stack and not locals_size) {
+            frame.kind = FrameKind::None;
+            frame.locals_size = 0;
+            return frame;
+        }
+
+        if (not desc.omit_frame_pointer and frame.locals_size <= desc.red_zone_size) {
+            frame.kind = FrameKind::RedZone;
+            frame.locals_size = 0;
+            return frame;
+        }
+    }
+
+    frame.kind = desc.omit_frame_pointer ? FrameKind::NoFramePointer : FrameKind::Full;
+    return frame;
+}
+
+auto StackFrame::base(isz adjustment) const -> FrameBase {
+    if (kind != FrameKind::NoFramePointer) return {};
+    return {
+        RegisterId::RSP,
+        isz(locals_size + saved_registers.size() * GeneralPurposeBytewidth) + adjustment,
+    };
+}
+
+auto stack_adjustment(const MInst& inst) -> isz {
+    if (inst.opcode() != +Opcode::Add and inst.opcode() != +Opcode::Sub) return 0;
+    if (inst.all_operands().size() != 2) return 0;
+
+    std::optional<usz> amount{};
+    bool rsp = false;
+    for (const auto& op : inst.all_operands()) {
+        if (std::holds_alternative<MOperandImmediate>(op))
+            amount = std::get<MOperandImmediate>(op).value;
+        else if (std::holds_alternative<MOperandRegister>(op))
+            rsp = std::get<MOperandRegister>(op).value == +RegisterId::RSP;
+    }
+
+    if (not rsp or not amount) return 0;
+    return inst.opcode() == +Opcode::Sub ? isz(*amount) : -isz(*amount);
+}
+
+void assign_stack_slots(MFunction& function) {
+    const auto& locals = function.locals();
+    const auto& blocks = function.blocks();
+    if (locals.empty() or blocks.empty()) return;
+
+    std::unordered_map<std::string_view, usz> block_indices{};
+    for (usz i = 0; i < blocks.size(); i++) block_indices[blocks[i].name()] = i;
+
+    std::vector<std::vector<usz>> successors(blocks.size());
+    std::vector<std::vector<usz>> predecessors(blocks.size());
+    for (usz i = 0; i < blocks.size(); i++) {
+        for (const auto& name : blocks[i].successors()) {
+            auto it = block_indices.find(name);
+            LCC_ASSERT(it != block_indices.end(), "Successor {} of block {} does not exist", name, blocks[i].name());
+            successors[i].push_back(it->second);
+            predecessors[it->second].push_back(i);
+        }
+    }
+
+    // Number the instructions in block order, and find the locals each
+    // block accesses; a RegisterSet is just a dense bit set, and is used
+    // for sets of locals here. Anything but a plain load or store of a
+    // local takes its address, after which it may be accessed through
+    // that anywhere in the function.
+    struct Interval {
+        usz start = usz(-1);
+        usz end{};
+    };
+
+    std::vector<Interval> intervals(locals.size());
+    std::vector<bool> escapes(locals.size());
+    std::vector<RegisterSet> accessed(blocks.size(), RegisterSet{locals.size()});
+    std::vector<usz> first_position(blocks.size());
+    const auto extend = [&](usz local, usz position) {
+        intervals[local].start = std::min(intervals[local].start, position);
+        intervals[local].end = std::max(intervals[local].end, position);
+    };
+
+    usz position = 0;
+    for (auto [i, block] : vws::enumerate(blocks)) {
+        first_position[usz(i)] = position;
+        for (auto& inst : block.instructions()) {
+            bool direct = inst.opcode() == +Opcode::MoveDereferenceLHS
+                       or inst.opcode() == +Opcode::MoveDereferenceRHS;
+            for (auto& op : inst.all_operands()) {
+                if (not std::holds_alternative<MOperandLocal>(op)) continue;
+                auto index = std::get<MOperandLocal>(op).index;
+                if (index >= locals.size()) continue;
+                if (not direct) escapes[index] = true;
+                accessed[usz(i)].insert(index);
+                extend(index, position);
+            }
+            position++;
+        }
+
+        // Give empty blocks a position, too.
+        if (block.instructions().empty()) position++;
+    }
+
+    // A local is in use wherever it may have been accessed before and may
+    // be accessed again. Find the locals that may have been accessed on
+    // entry to each block, and those that may be accessed after its exit.
+    std::vector<RegisterSet> before(blocks.size(), RegisterSet{locals.size()});
+    std::vector<RegisterSet> after(blocks.size(), RegisterSet{locals.size()});
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (usz i = 0; i < blocks.size(); i++) {
+            RegisterSet in{locals.size()};
+            for (usz p : predecessors[i]) {
+                in |= before[p];
+                in |= accessed[p];
+            }
+            if (in != before[i]) {
+                before[i] = std::move(in);
+                changed = true;
+            }
+        }
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (usz i = blocks.size(); i-- > 0;) {
+            RegisterSet out{locals.size()};
+            for (usz s : successors[i]) {
+                out |= after[s];
+                out |= accessed[s];
+            }
+            if (out != after[i]) {
+                after[i] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+
+    for (usz i = 0; i < blocks.size(); i++) {
+        usz first = first_position[i];
+        usz last = i + 1 < blocks.size() ? first_position[i + 1] - 1 : position - 1;
+
+        // In use across the entry or the exit of the block.
+        RegisterSet from_entry = after[i];
+        from_entry |= accessed[i];
+        before[i].for_each([&](usz local) {
+            if (from_entry.contains(local)) extend(local, first);
+        });
+
+        RegisterSet until_exit = before[i];
+        until_exit |= accessed[i];
+        after[i].for_each([&](usz local) {
+            if (until_exit.contains(local)) extend(local, last);
+        });
+    }
+
+    for (usz i = 0; i < locals.size(); i++) {
+        if (escapes[i]) intervals[i] = {0, position};
+    }
+
+    // Visit the locals in order of the start of their interval, and give
+    // each the smallest slot that is free by then and is large and
+    // aligned enough, or a new one below all others if there is none.
+    // Locals that are never accessed don't need a slot at all, but are
+    // given one anyway so that their offset is valid.
+    struct Slot {
+        usz offset;
+        usz size;
+        usz align;
+        usz end;
+    };
+
+    std::vector<usz> order(locals.size());
+    std::iota(order.begin(), order.end(), usz(0));
+    rgs::stable_sort(order, {}, [&](usz i) { return intervals[i].start; });
+
+    std::vector<Slot> slots{};
+    std::vector<isz> offsets(locals.size());
+    usz size = 0;
+    for (usz i : order) {
+        auto* type = locals[i]->allocated_type();
+        usz bytes = type->bytes();
+        usz align = std::clamp<usz>(type->align_bytes(), 1, 16);
+        auto& interval = intervals[i];
+        if (interval.start == usz(-1)) interval = {0, 0};
+
+        Slot* best = nullptr;
+        for (auto& slot : slots) {
+            if (slot.end >= interval.start or slot.size < bytes or slot.offset % align) continue;
+            if (not best or slot.size < best->size) best = &slot;
+        }
+
+        if (not best) {
+            size = utils::AlignTo(size + bytes, align);
+            slots.push_back({size, bytes, align, 0});
+            best = &slots.back();
+        }
+
+        best->end = interval.end;
+        offsets[i] = -isz(best->offset);
+    }
+
+    function.assign_local_offsets(std::move(offsets), size);
+}
+
+void simplify_branches(MFunction& function) {
+    auto& blocks = function.blocks();
+    for (usz i = 0; i + 1 < blocks.size(); i++) {
+        auto& insts = blocks[i].instructions();
+        const auto& next = blocks[i + 1].name();
+        auto JumpsToNext = [&](MInst& inst, Opcode opcode) {
+            return inst.opcode() == +opcode and is_block(inst) and extract_block(inst)->name() == next;
+        };
+
+        if (insts.empty() or insts.back().opcode() != +Opcode::Jump or not is_block(insts.back())) continue;
+        if (JumpsToNext(insts.back(), Opcode::Jump)) {
+            insts.pop_back();
+            continue;
+        }
+
+        // jz next; jmp elsewhere -> jnz elsewhere
+        if (insts.size() < 2) continue;
+        auto& cond = insts[insts.size() - 2];
+        if (not JumpsToNext(cond, Opcode::JumpIfZeroFlag)) continue;
+        cond.opcode(+Opcode::JumpIfNotZeroFlag);
+        cond.all_operands()[0] = insts.back().get_operand(0);
+        insts.pop_back();
+    }
+}
 } // namespace lcc::x86_64
@@ -1,5 +1,9 @@
+#include <lcc/codegen/codegen_report.hh>
 #include <lcc/context.hh>
 #include <lcc/ir/type.hh>
+#include <lcc/mem_report.hh>
+#include <lcc/time_report.hh>
+#include <lcc/trace.hh>
 
 #include <limits>
 #include <mutex>
@@ -17,10 +21,16 @@ lcc::Context::Context(
 
     /// Initialise type caches.
     integer_types[1] = Type::I1Ty;
+
+    if (options._time_report) _time_report = std::make_unique<TimeReport>();
+    if (options._trace) _trace = std::make_unique<Trace>();
+    if (options._mem_report) _mem_report = std::make_unique<MemReport>();
+    if (options._codegen_report) _codegen_report = std::make_unique<CodegenReport>();
 }
 
 lcc::Context::~Context() {
     for (auto* type : array_types) delete type;
+    for (auto* type : vector_types) delete type;
     for (auto* type : function_types) delete type;
     for (auto* type : struct_types) delete type;
     for (auto [_, type] : integer_types)
@@ -34,18 +44,23 @@ auto lcc::Context::get_or_load_file(fs::path path) -> File& {
     });
     if (f != owned_files.end()) return **f;
 
-    /// Load the file.
+    /// Map the file if we can, and read it otherwise.
+    if (auto mapping = MappedFile::Map(path))
+        return make_file(std::move(path), std::move(*mapping));
+
     auto contents = File::LoadFileData(path);
     return make_file(std::move(path), std::move(contents));
 }
 
 auto lcc::Context::make_file(fs::path name, std::vector<char>&& contents) -> File& {
-    /// Create the file.
-    auto* fptr = new File(
-        *this,
-        std::move(name),
-        std::move(contents)
-    );
+    return add_file(new File(*this, std::move(name), std::move(contents)));
+}
+
+auto lcc::Context::make_file(fs::path name, MappedFile&& mapping) -> File& {
+    return add_file(new File(*this, std::move(name), std::move(mapping)));
+}
+
+auto lcc::Context::add_file(File* fptr) -> File& {
     fptr->_id = u32(owned_files.size());
     LCC_ASSERT(fptr->_id <= std::numeric_limits<u16>::max());
     owned_files.emplace_back(fptr);
@@ -4,8 +4,11 @@
 #include <lcc/utils/platform.hh>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <filesystem>
+#include <mutex>
+#include <span>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -45,8 +48,49 @@ constexpr auto Name(lcc::Diag::Kind kind) -> std::string_view {
         default: return "Diagnostic";
     }
 }
+
+/// Get the name of a diagnostic in JSON output.
+constexpr auto JSONName(lcc::Diag::Kind kind) -> std::string_view {
+    switch (kind) {
+        case Kind::ICError: return "ice";
+        case Kind::FError: return "fatal";
+        case Kind::Error: return "error";
+        case Kind::Warning: return "warning";
+        case Kind::Note: return "note";
+        default: return "diagnostic";
+    }
+}
+
+/// The buffer that diagnostics issued on this thread go into, if any.
+thread_local lcc::Diag::Buffer* capturing_buffer{};
+
+/// How diagnostics are printed.
+std::atomic<lcc::Diag::OutputFormat> output_format{lcc::Diag::OutputFormat::Text};
 } // namespace
 
+lcc::Diag::Buffer::Capture::Capture(Buffer& buffer) : outer(capturing_buffer) {
+    capturing_buffer = &buffer;
+}
+
+lcc::Diag::Buffer::Capture::~Capture() { capturing_buffer = outer; }
+
+void lcc::Diag::Buffer::flush() {
+    auto flushed = take();
+    for (auto& diag : flushed) diag.print();
+}
+
+auto lcc::Diag::Buffer::LimitReachedBefore(const Context* ctx, std::span<const Buffer> buffers, usz i) -> bool {
+    if (not ctx->error_limit_reached()) return false;
+    auto errors = ctx->errors_printed.load();
+    for (const auto& b : buffers.first(i)) {
+        if (errors >= ctx->error_limit()) break;
+        errors += b.errors();
+    }
+    return errors >= ctx->error_limit();
+}
+
+void lcc::Diag::SetOutputFormat(OutputFormat format) { output_format = format; }
+
 // Exit due to assertion failure.
 [[noreturn]]
 void lcc::detail::AssertFail(std::string&& msg) {
@@ -83,6 +127,25 @@ void lcc::Diag::PrintDiagWithoutLocation() {
     HandleFatalErrors();
 }
 
+void lcc::Diag::PrintJSON() {
+    auto out = fmt::format(R"({{"severity":"{}","message":"{}")", JSONName(kind), utils::EscapeJSON(message));
+    if (context and where.seekable(context)) {
+        const auto& file = *context->files()[where.file_id].get();
+        auto [line, col] = where.seek_line_column(context);
+        out += fmt::format(
+            R"(,"file":"{}","line":{},"column":{},"offset":{},"length":{})",
+            utils::EscapeJSON(fs::relative(file.path()).string()),
+            line,
+            col + 1,
+            where.pos,
+            where.len
+        );
+    }
+
+    fmt::print(stderr, "{}}}\n", out);
+    HandleFatalErrors();
+}
+
 auto lcc::Diag::ShouldUseColour() const -> bool {
     if (context) return context->option_use_colour();
     return lcc::platform::StderrIsTerminal();
@@ -107,9 +170,38 @@ void lcc::Diag::print() {
     // If this diagnostic is suppressed, do nothing.
     if (kind == Kind::None) return;
 
+    // Count errors as soon as they are issued, even if they are held back,
+    // so that work which can only find more of them can stop early.
+    if (kind == Kind::Error and context and not counted) {
+        counted = true;
+        context->errors_issued++;
+    }
+
+    // Hold it back if it is being buffered; this resets it as well.
+    if (capturing_buffer and kind != Kind::FError and kind != Kind::ICError) {
+        capturing_buffer->add(std::move(*this));
+        return;
+    }
+
     // Don’t print the same diagnostic twice.
     defer { kind = Kind::None; };
 
+    // Keep diagnostics issued by different threads from interleaving; this
+    // is recursive since attached diagnostics are printed from in here.
+    static std::recursive_mutex print_mutex;
+    std::lock_guard lock{print_mutex};
+
+    // Give up on the compilation once the error limit is reached; nothing
+    // after the last error, other than what is attached to it, is printed.
+    auto limit = context ? context->error_limit() : 0;
+    bool stop = kind == Kind::Error and limit and ++context->errors_printed >= limit;
+    defer {
+        if (stop) {
+            Note("Too many errors emitted, stopping now [-ferror-limit={}]", limit).print();
+            std::exit(1);
+        }
+    };
+
     // Print attached diagnostics to be printed before this one.
     for (auto& [diag, print_before] : attached)
         if (print_before)
@@ -128,6 +220,11 @@ void lcc::Diag::print() {
     // If the diagnostic is an error, set the error flag.
     if (kind == Kind::Error and context) context->set_error();
 
+    if (output_format == OutputFormat::JSON) {
+        PrintJSON();
+        return;
+    }
+
     // If there is no context, then there is also no location info.
     if (not context) {
         PrintDiagWithoutLocation();
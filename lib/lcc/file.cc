@@ -9,18 +9,25 @@
 #    include <sys/stat.h>
 #    include <sys/wait.h>
 #    include <unistd.h>
+#else
+#    define NOMINMAX
+#    include <Windows.h>
 #endif
 
+#include <algorithm>
 #include <array>
 #include <cstdio>
 #include <cstring>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <random>
 #include <ranges>
 #include <string>
 #include <string_view>
 #include <thread>
+#include <utility>
 #include <vector>
 
 auto lcc::File::TempPath(std::string_view extension) -> fs::path {
@@ -84,60 +91,143 @@ void lcc::File::WriteOrTerminate(const void* data, usz size, const fs::path& fil
 }
 
 lcc::File::File(Context& context, fs::path name, std::vector<char>&& contents)
-    : _context(context), _file_path(std::move(name)), _contents(std::move(contents)) {}
+    : _context(context),
+      _file_path(std::move(name)),
+      _contents(std::move(contents)),
+      _view(_contents.data(), _contents.size()) {}
+
+lcc::File::File(Context& context, fs::path name, MappedFile&& mapping)
+    : _context(context),
+      _file_path(std::move(name)),
+      _mapping(std::move(mapping)),
+      _view(_mapping->data(), _mapping->size()) {}
+
+auto lcc::File::line_starts() const -> const std::vector<usz>& {
+    /// Diagnostics may be issued from several threads at once.
+    std::call_once(_line_starts_built, [&] {
+        _line_starts.push_back(0);
+        const char* const begin = _view.data();
+        const char* const end = begin + _view.size();
+        for (const char* d = begin; d < end; d++) {
+            d = static_cast<const char*>(std::memchr(d, '\n', usz(end - d)));
+            if (not d) break;
+            _line_starts.push_back(usz(d - begin) + 1);
+        }
+    });
+    return _line_starts;
+}
+
+auto lcc::File::line_index(usz offset) const -> usz {
+    const auto& starts = line_starts();
+    return usz(rgs::upper_bound(starts, offset) - starts.begin()) - 1;
+}
 
 auto lcc::File::Read(const fs::path& path) -> std::vector<char> {
     return LoadFileData(path);
 }
 
 auto lcc::File::LoadFileData(const fs::path& path) -> std::vector<char> {
-#ifdef __linux__
+    /// Read the file manually. We don’t rely on its size here since
+    /// this is also used for pipes and the like, which don’t have one.
+    std::unique_ptr<FILE, decltype(&std::fclose)> f{std::fopen(path.string().c_str(), "rb"), std::fclose};
+    if (not f) Diag::Fatal("Could not open file \"{}\": {}", path.string(), strerror(errno));
+
+    /// Read the file.
+    static constexpr usz chunk_size = 64 * 1024;
+    std::vector<char> ret;
+    for (;;) {
+        auto n_read = ret.size();
+        ret.resize(n_read + chunk_size);
+        errno = 0;
+        auto n = std::fread(ret.data() + n_read, 1, chunk_size, f.get());
+        if (errno) Diag::Fatal("Error reading file \"{}\": {}", path.string(), strerror(errno));
+        ret.resize(n_read + n);
+        if (n == 0) break;
+    }
+
+    /// Construct the file data.
+    return ret;
+}
+
+auto lcc::MappedFile::Map(const fs::path& path) -> std::optional<MappedFile> {
+    MappedFile mapped{};
+#ifndef _WIN32
     /// Open the file.
     int fd = open(path.c_str(), O_RDONLY);
-    if (fd == -1) Diag::Fatal("Could not open file \"{}\": {}", path.string(), strerror(errno));
+    if (fd == -1) return std::nullopt;
     defer { close(fd); };
 
-    /// Determine the file size.
+    /// Only regular files can be mapped. Empty files can’t be mapped
+    /// at all.
     struct stat st {};
-    if (fstat(fd, &st) == -1) Diag::Fatal("Could not stat file \"{}\": {}", path.string(), strerror(errno));
-
-    /// If the file is empty, return an empty string.
-    if (st.st_size == 0) return {};
+    if (fstat(fd, &st) == -1 or not S_ISREG(st.st_mode) or st.st_size == 0)
+        return std::nullopt;
 
     /// Map the file into memory.
     void* ptr = mmap(nullptr, static_cast<usz>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
-    if (ptr == MAP_FAILED) Diag::Fatal("Could not map file \"{}\": {}", path.string(), strerror(errno));
-
-    /// Copy the file into a vector.
-    std::vector<char> ret(static_cast<usz>(st.st_size));
-    memcpy(ret.data(), ptr, static_cast<usz>(st.st_size));
-
-    /// Unmap the file.
-    munmap(ptr, static_cast<usz>(st.st_size));
+    if (ptr == MAP_FAILED) return std::nullopt;
 
+    mapped._data = static_cast<const char*>(ptr);
+    mapped._size = static_cast<usz>(st.st_size);
 #else
-    /// Read the file manually.
-    std::unique_ptr<FILE, decltype(&std::fclose)> f{std::fopen(path.string().c_str(), "rb"), std::fclose};
-    if (not f) Diag::Fatal("Could not open file \"{}\": {}", path.string(), strerror(errno));
+    HANDLE file = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) return std::nullopt;
+    defer { CloseHandle(file); };
+
+    /// Only regular files can be mapped. Empty files can’t be mapped
+    /// at all.
+    LARGE_INTEGER size{};
+    if (GetFileType(file) != FILE_TYPE_DISK or not GetFileSizeEx(file, &size) or size.QuadPart == 0)
+        return std::nullopt;
+
+    /// Map the file into memory. The view keeps the mapping object alive
+    /// only as long as we do, so hold on to it.
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (not mapping) return std::nullopt;
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (not ptr) {
+        CloseHandle(mapping);
+        return std::nullopt;
+    }
 
-    /// Get the file size.
-    std::fseek(f.get(), 0, SEEK_END);
-    auto sz = std::size_t(std::ftell(f.get()));
-    std::fseek(f.get(), 0, SEEK_SET);
+    mapped._data = static_cast<const char*>(ptr);
+    mapped._size = static_cast<usz>(size.QuadPart);
+    mapped._mapping = mapping;
+#endif
+    return mapped;
+}
 
-    /// Read the file.
-    std::vector<char> ret;
-    ret.resize(sz);
-    std::size_t n_read = 0;
-    while (n_read < sz) {
-        errno = 0;
-        auto n = std::fread(ret.data() + n_read, 1, sz - n_read, f.get());
-        if (errno) Diag::Fatal("Error reading file \"{}\": {}", path.string(), strerror(errno));
-        if (n == 0) break;
-        n_read += n;
-    }
+lcc::MappedFile::MappedFile(MappedFile&& other) noexcept
+    : _data(std::exchange(other._data, nullptr)),
+      _size(std::exchange(other._size, 0)) {
+#ifdef _WIN32
+    _mapping = std::exchange(other._mapping, nullptr);
 #endif
+}
 
-    /// Construct the file data.
-    return ret;
+auto lcc::MappedFile::operator=(MappedFile&& other) noexcept -> MappedFile& {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+#ifdef _WIN32
+    std::swap(_mapping, other._mapping);
+#endif
+    return *this;
+}
+
+lcc::MappedFile::~MappedFile() {
+    if (not _data) return;
+#ifndef _WIN32
+    munmap(const_cast<char*>(_data), _size);
+#else
+    UnmapViewOfFile(_data);
+    CloseHandle(_mapping);
+#endif
 }
@@ -0,0 +1,892 @@
+/// The binary IR format, or bitcode.
+///
+/// A module is written as the magic bytes, a version, a table of every
+/// type the module uses, and then its extra sections, global variables,
+/// functions, and the bodies of the functions. All integers are encoded
+/// as unsigned LEB128 varints; signed integers are zigzag-encoded first.
+///
+/// Types are referred to by their index in the type table; a type only
+/// ever refers to types before it in the table. Values are referred to
+/// by index as well: the global variables come first, followed by the
+/// functions, and then, in a function body, the parameters, blocks, and
+/// instructions of that function, in order. Constants are encoded in
+/// place instead, since they are not shared. Source locations are not
+/// kept, since they would refer to files of another context.
+#include <lcc/context.hh>
+#include <lcc/diags.hh>
+#include <lcc/ir/ir.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/ir/type.hh>
+#include <lcc/mem_report.hh>
+#include <lcc/time_report.hh>
+#include <lcc/utils.hh>
+#include <lcc/utils/rtti.hh>
+#include <object/generic.hh>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lcc {
+namespace {
+constexpr std::string_view Magic = "LCCB";
+
+/// Bump this whenever the format changes.
+constexpr u64 Version = 1;
+
+enum struct TypeTag : u8 {
+    Unknown,
+    Pointer,
+    Void,
+    Integer,
+    Array,
+    Function,
+    Struct,
+    NamedStruct,
+    Vector,
+};
+
+/// How an operand is encoded; this is stored in the low bits of the
+/// varint that starts it.
+enum struct OperandTag : u8 {
+    Value,
+    Integer,
+    Poison,
+    Array,
+};
+
+constexpr u64 OperandTagBits = 2;
+
+/// Flags of call instructions.
+enum : u8 {
+    CallTail = 1 << 0,
+    CallInline = 1 << 1,
+};
+
+auto ZigZag(i64 value) -> u64 { return (u64(value) << 1) ^ u64(value >> 63); }
+auto UnZigZag(u64 value) -> i64 { return i64(value >> 1) ^ -i64(value & 1); }
+
+class BitcodeWriter {
+    std::vector<char> types{};
+    std::vector<char> out{};
+
+    std::unordered_map<Type*, u64> type_indices{};
+    u64 type_count = 0;
+
+    /// Global values, and the values of the current function.
+    std::unordered_map<Value*, u64> global_indices{};
+    std::unordered_map<Value*, u64> local_indices{};
+
+public:
+    auto write(Module* mod) -> std::vector<char>;
+
+private:
+    static void Write(std::vector<char>& buffer, u64 value) {
+        while (value >= 0x80) {
+            buffer.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(char(value));
+    }
+
+    static void Write(std::vector<char>& buffer, std::string_view str) {
+        Write(buffer, u64(str.size()));
+        buffer.insert(buffer.end(), str.begin(), str.end());
+    }
+
+    void write(u64 value) { Write(out, value); }
+    void write(std::string_view str) { Write(out, str); }
+    void write_names(const std::vector<IRName>& names);
+    void write_operand(Value* v);
+    void write_inst(Inst* i);
+
+    /// Get the index of a type, adding it to the table if need be.
+    auto type(Type* t) -> u64;
+};
+
+auto BitcodeWriter::type(Type* t) -> u64 {
+    if (auto it = type_indices.find(t); it != type_indices.end()) return it->second;
+
+    /// Add the types this one refers to first.
+    std::vector<char> entry{};
+    switch (t->kind) {
+        case Type::Kind::Unknown: Write(entry, u64(TypeTag::Unknown)); break;
+        case Type::Kind::Pointer: Write(entry, u64(TypeTag::Pointer)); break;
+        case Type::Kind::Void: Write(entry, u64(TypeTag::Void)); break;
+        case Type::Kind::Integer:
+            Write(entry, u64(TypeTag::Integer));
+            Write(entry, u64(as<IntegerType>(t)->bits()));
+            break;
+
+        case Type::Kind::Array: {
+            auto* a = as<ArrayType>(t);
+            auto element = type(a->element_type());
+            Write(entry, u64(TypeTag::Array));
+            Write(entry, u64(a->length()));
+            Write(entry, element);
+        } break;
+
+        case Type::Kind::Vector: {
+            auto* v = as<VectorType>(t);
+            auto element = type(v->element_type());
+            Write(entry, u64(TypeTag::Vector));
+            Write(entry, u64(v->length()));
+            Write(entry, element);
+        } break;
+
+        case Type::Kind::Function: {
+            auto* f = as<FunctionType>(t);
+            std::vector<u64> params{};
+            auto ret = type(f->ret());
+            for (auto* p : f->params()) params.push_back(type(p));
+            Write(entry, u64(TypeTag::Function));
+            Write(entry, ret);
+            Write(entry, u64(f->variadic()));
+            Write(entry, u64(params.size()));
+            for (auto p : params) Write(entry, p);
+        } break;
+
+        case Type::Kind::Struct: {
+            auto* s = as<StructType>(t);
+            std::vector<u64> members{};
+            for (auto* m : s->members()) members.push_back(type(m));
+            Write(entry, u64(s->named() ? TypeTag::NamedStruct : TypeTag::Struct));
+            if (s->named()) Write(entry, s->name());
+            Write(entry, u64(members.size()));
+            for (auto m : members) Write(entry, m);
+        } break;
+    }
+
+    types.insert(types.end(), entry.begin(), entry.end());
+    type_indices[t] = type_count;
+    return type_count++;
+}
+
+void BitcodeWriter::write_names(const std::vector<IRName>& names) {
+    write(u64(names.size()));
+    for (const auto& n : names) {
+        write(n.name);
+        write(u64(n.linkage));
+    }
+}
+
+void BitcodeWriter::write_operand(Value* v) {
+    switch (v->kind()) {
+        case Value::Kind::IntegerConstant: {
+            auto* c = as<IntegerConstant>(v);
+            write(u64(OperandTag::Integer));
+            write(type(c->type()));
+            write(ZigZag(i64(c->value().sext(64).value())));
+        } return;
+
+        case Value::Kind::Poison:
+            write(u64(OperandTag::Poison));
+            write(type(v->type()));
+            return;
+
+        case Value::Kind::ArrayConstant: {
+            auto* a = as<ArrayConstant>(v);
+            write(u64(OperandTag::Array));
+            write(type(a->type()));
+            write(u64(a->is_string_literal()));
+            write(std::string_view{a->data(), a->size()});
+        } return;
+
+        default: {
+            auto it = local_indices.find(v);
+            if (it == local_indices.end()) {
+                it = global_indices.find(v);
+                LCC_ASSERT(it != global_indices.end(), "Operand is not a value of this module");
+            }
+            write((it->second << OperandTagBits) | u64(OperandTag::Value));
+        }
+    }
+}
+
+void BitcodeWriter::write_inst(Inst* i) {
+    using K = Value::Kind;
+    write(u64(i->kind()));
+    switch (i->kind()) {
+        case K::Alloca:
+            write(type(as<AllocaInst>(i)->allocated_type()));
+            return;
+
+        case K::Call: {
+            auto* c = as<CallInst>(i);
+            u8 flags = 0;
+            if (c->is_tail_call()) flags |= CallTail;
+            if (c->is_force_inline()) flags |= CallInline;
+            write(type(c->function_type()));
+            write(u64(flags));
+            write(u64(c->call_conv()));
+            write_operand(c->callee());
+            write(u64(c->args().size()));
+            for (auto* a : c->args()) write_operand(a);
+        } return;
+
+        case K::GetElementPtr:
+        case K::GetMemberPtr: {
+            auto* g = as<GEPBaseInst>(i);
+            write(type(g->base_type()));
+            write_operand(g->ptr());
+            write_operand(g->idx());
+        } return;
+
+        case K::Intrinsic: {
+            auto* intrinsic = as<IntrinsicInst>(i);
+            write(u64(intrinsic->intrinsic_kind()));
+            write(u64(intrinsic->operands().size()));
+            for (auto* o : intrinsic->operands()) write_operand(o);
+        } return;
+
+        case K::Load:
+            write(type(i->type()));
+            write_operand(as<LoadInst>(i)->ptr());
+            return;
+
+        case K::Phi: {
+            auto* phi = as<PhiInst>(i);
+            write(type(phi->type()));
+            write(u64(phi->operands().size()));
+            for (const auto& incoming : phi->operands()) {
+                write_operand(incoming.block);
+                write_operand(incoming.value);
+            }
+        } return;
+
+        case K::Store:
+            write_operand(as<StoreInst>(i)->val());
+            write_operand(as<StoreInst>(i)->ptr());
+            return;
+
+        case K::Branch:
+            write_operand(as<BranchInst>(i)->target());
+            return;
+
+        case K::CondBranch: {
+            auto* b = as<CondBranchInst>(i);
+            write_operand(b->cond());
+            write_operand(b->then_block());
+            write_operand(b->else_block());
+        } return;
+
+        case K::Return: {
+            auto* r = as<ReturnInst>(i);
+            write(u64(r->has_value()));
+            if (r->has_value()) write_operand(r->val());
+        } return;
+
+        case K::Unreachable: return;
+
+        case K::ZExt:
+        case K::SExt:
+        case K::Trunc:
+        case K::Bitcast:
+        case K::Neg:
+        case K::Copy:
+        case K::Compl:
+            write(type(i->type()));
+            write_operand(as<UnaryInstBase>(i)->operand());
+            return;
+
+        case K::Add:
+        case K::Sub:
+        case K::Mul:
+        case K::SDiv:
+        case K::UDiv:
+        case K::SRem:
+        case K::URem:
+        case K::Shl:
+        case K::Sar:
+        case K::Shr:
+        case K::And:
+        case K::Or:
+        case K::Xor:
+            write(type(i->type()));
+            [[fallthrough]];
+
+        case K::Eq:
+        case K::Ne:
+        case K::SLt:
+        case K::SLe:
+        case K::SGt:
+        case K::SGe:
+        case K::ULt:
+        case K::ULe:
+        case K::UGt:
+        case K::UGe:
+            write_operand(as<BinaryInst>(i)->lhs());
+            write_operand(as<BinaryInst>(i)->rhs());
+            return;
+
+        case K::IntegerConstant:
+        case K::ArrayConstant:
+        case K::Poison:
+        case K::Block:
+        case K::Function:
+        case K::GlobalVariable:
+        case K::Parameter:
+            break;
+    }
+
+    Diag::ICE("Cannot write {} as an instruction", Value::ToString(i->kind()));
+}
+
+auto BitcodeWriter::write(Module* mod) -> std::vector<char> {
+    for (auto* var : mod->vars()) global_indices.emplace(var, global_indices.size());
+    for (auto* f : mod->code()) global_indices.emplace(f, global_indices.size());
+
+    write(mod->name());
+
+    write(u64(mod->extra_sections().size()));
+    for (const auto& section : mod->extra_sections()) {
+        write(section.name);
+        write(section.attributes);
+        write(u64(section.is_fill));
+        if (section.is_fill) {
+            auto copy = section;
+            write(u64(copy.length()));
+            write(u64(copy.value()));
+        } else {
+            auto bytes = section.bytes();
+            write(std::string_view{reinterpret_cast<const char*>(bytes.data()), bytes.size()});
+        }
+    }
+
+    /// Declare all global values before the bodies, so that they can
+    /// refer to each other.
+    write(u64(mod->vars().size()));
+    for (auto* var : mod->vars()) {
+        write_names(var->names());
+        write(type(var->allocated_type()));
+    }
+
+    write(u64(mod->code().size()));
+    for (auto* f : mod->code()) {
+        write_names(f->names());
+        write(u64(f->call_conv()));
+        write(type(f->type()));
+    }
+
+    for (auto* var : mod->vars()) {
+        write(u64(var->init() != nullptr));
+        if (var->init()) write_operand(var->init());
+    }
+
+    for (auto* f : mod->code()) {
+        local_indices.clear();
+        auto next = global_indices.size();
+        for (auto* p : f->params()) local_indices.emplace(p, next++);
+        for (auto* b : f->blocks()) local_indices.emplace(b, next++);
+        for (auto* b : f->blocks())
+            for (auto* i : b->instructions()) local_indices.emplace(i, next++);
+
+        write(u64(f->blocks().size()));
+        for (auto* b : f->blocks()) {
+            write(b->name());
+            write(u64(b->instructions().size()));
+            for (auto* i : b->instructions()) write_inst(i);
+        }
+    }
+
+    /// The type table goes before everything that refers to it.
+    std::vector<char> data{Magic.begin(), Magic.end()};
+    Write(data, Version);
+    Write(data, type_count);
+    data.insert(data.end(), types.begin(), types.end());
+    data.insert(data.end(), out.begin(), out.end());
+    return data;
+}
+} // namespace
+
+namespace parser {
+class BitcodeReader {
+    Context* ctx;
+    std::string_view data;
+    usz pos = 0;
+    bool failed = false;
+
+    std::vector<Type*> types{};
+
+    /// The global values, and then the values of the current function.
+    std::vector<Value*> values{};
+    usz global_count = 0;
+
+    /// Operands that refer to values by index; these are resolved once
+    /// all values of a function exist, since instructions may refer to
+    /// instructions after them.
+    struct Fixup {
+        std::variant<Value**, Block**> slot;
+        Inst* user;
+        u64 index;
+    };
+
+    std::vector<Fixup> fixups{};
+
+public:
+    std::unique_ptr<Module> mod;
+
+    BitcodeReader(Context* context, std::string_view bitcode) : ctx(context), data(bitcode) {}
+
+    auto read() -> bool;
+
+private:
+    /// Report that the bitcode is malformed. Only the first error is
+    /// reported; reading stops at the end of the data after it.
+    auto Error(std::string_view what) -> u64 {
+        if (not failed) Diag::Error(ctx, {}, "Malformed bitcode: {}", what);
+        failed = true;
+        pos = data.size();
+        return 0;
+    }
+
+    auto read_varint() -> u64 {
+        u64 value = 0;
+        for (u64 shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) return Error("unexpected end of data");
+            auto byte = u8(data[pos++]);
+            value |= u64(byte & 0x7F) << shift;
+            if (not(byte & 0x80)) return value;
+        }
+        return Error("varint is too long");
+    }
+
+    auto read_string() -> std::string_view {
+        auto size = read_varint();
+        if (size > data.size() - pos) {
+            Error("string extends past the end of the data");
+            return {};
+        }
+        auto str = data.substr(pos, size);
+        pos += size;
+        return str;
+    }
+
+    /// Read a count of things, each of which takes at least one byte.
+    auto read_count() -> u64 {
+        auto count = read_varint();
+        if (count > data.size() - pos) return Error("count exceeds the size of the data");
+        return count;
+    }
+
+    auto read_type() -> Type* {
+        auto index = read_varint();
+        if (index >= types.size()) {
+            Error("type index out of range");
+            return Type::UnknownTy;
+        }
+        return types[index];
+    }
+
+    template <typename T>
+    auto read_type_of_kind() -> T* {
+        auto* t = cast<T>(read_type());
+        if (not t) Error("type has the wrong kind");
+        return t;
+    }
+
+    void read_type_table();
+    auto read_names() -> std::vector<IRName>;
+    auto read_inst() -> Inst*;
+
+    /// Read an operand into a slot of an instruction.
+    template <std::derived_from<Value> T>
+    void read_operand(Inst* user, T*& slot) {
+        auto op = read_varint();
+        switch (OperandTag(op & ((1 << OperandTagBits) - 1))) {
+            case OperandTag::Value:
+                if constexpr (std::is_same_v<T, Value> or std::is_same_v<T, Block>) fixups.push_back({&slot, user, op >> OperandTagBits});
+                else Error("operand must be a constant");
+                return;
+
+            case OperandTag::Integer: {
+                auto* ty = read_type_of_kind<IntegerType>();
+                auto value = UnZigZag(read_varint());
+                if (not ty) return;
+                set(user, slot, new (*mod) IntegerConstant(ty, aint(value)));
+            } return;
+
+            case OperandTag::Poison:
+                set(user, slot, new (*mod) PoisonValue(read_type()));
+                return;
+
+            case OperandTag::Array: {
+                auto* ty = read_type();
+                bool string_literal = read_varint();
+                auto bytes = read_string();
+                set(user, slot, new (*mod) ArrayConstant(ty, {bytes.begin(), bytes.end()}, string_literal));
+            } return;
+        }
+    }
+
+    template <std::derived_from<Value> T>
+    void set(Inst* user, T*& slot, Value* v) {
+        if constexpr (std::is_same_v<T, Value>) slot = v;
+        else {
+            slot = cast<T>(v);
+            if (not slot) {
+                Error("operand has the wrong kind");
+                return;
+            }
+        }
+
+        if (user) Inst::AddUse(v, user);
+    }
+
+    /// Resolve the operands that refer to values by index.
+    void resolve();
+
+    template <typename Instruction>
+    auto binary(Type* ty) -> Inst* {
+        Instruction* inst;
+        if constexpr (requires { Instruction(ty); }) inst = new (*mod) Instruction(ty);
+        else inst = new (*mod) Instruction();
+        read_operand(inst, inst->left);
+        read_operand(inst, inst->right);
+        return inst;
+    }
+
+    template <typename Instruction>
+    auto unary(Type* ty) -> Inst* {
+        auto* inst = new (*mod) Instruction(ty);
+        read_operand(inst, inst->op);
+        return inst;
+    }
+};
+} // namespace parser
+} // namespace lcc
+
+void lcc::parser::BitcodeReader::read_type_table() {
+    auto count = read_count();
+    types.reserve(count);
+    for (u64 i = 0; i < count and not failed; i++) {
+        auto tag = TypeTag(read_varint());
+        switch (tag) {
+            case TypeTag::Unknown: types.push_back(Type::UnknownTy); break;
+            case TypeTag::Pointer: types.push_back(Type::PtrTy); break;
+            case TypeTag::Void: types.push_back(Type::VoidTy); break;
+            case TypeTag::Integer: {
+                auto bits = read_varint();
+                if (not bits or bits > 64) {
+                    Error("invalid integer width");
+                    break;
+                }
+                types.push_back(IntegerType::Get(ctx, bits));
+            } break;
+
+            case TypeTag::Array: {
+                auto length = read_varint();
+                types.push_back(ArrayType::Get(ctx, length, read_type()));
+            } break;
+
+            case TypeTag::Vector: {
+                auto length = read_varint();
+                auto* element = read_type();
+                if (not length or not is<IntegerType>(element)) {
+                    Error("invalid vector type");
+                    break;
+                }
+                types.push_back(VectorType::Get(ctx, length, element));
+            } break;
+
+            case TypeTag::Function: {
+                auto* ret = read_type();
+                bool variadic = read_varint();
+                std::vector<Type*> params(read_count());
+                for (auto& p : params) p = read_type();
+                types.push_back(FunctionType::Get(ctx, ret, std::move(params), variadic));
+            } break;
+
+            case TypeTag::Struct:
+            case TypeTag::NamedStruct: {
+                std::string name{};
+                if (tag == TypeTag::NamedStruct) name = read_string();
+                std::vector<Type*> members(read_count());
+                for (auto& m : members) m = read_type();
+                types.push_back(StructType::Get(ctx, std::move(members), std::move(name)));
+            } break;
+
+            default: Error("unknown type");
+        }
+    }
+}
+
+auto lcc::parser::BitcodeReader::read_names() -> std::vector<IRName> {
+    std::vector<IRName> names(read_count());
+    for (auto& n : names) {
+        n.name = read_string();
+        auto linkage = read_varint();
+        if (linkage > u64(Linkage::Reexported)) Error("invalid linkage");
+        n.linkage = Linkage(linkage);
+    }
+    if (names.empty()) Error("global value without a name");
+    return names;
+}
+
+auto lcc::parser::BitcodeReader::read_inst() -> Inst* {
+    using K = Value::Kind;
+    switch (K(read_varint())) {
+        case K::Alloca: return new (*mod) AllocaInst(read_type());
+
+        case K::Call: {
+            auto* ty = read_type_of_kind<FunctionType>();
+            auto flags = read_varint();
+            auto cc = read_varint();
+            if (not ty) return nullptr;
+            if (cc > u64(CallConv::Glint)) Error("invalid calling convention");
+
+            auto* call = new (*mod) CallInst(ty, Location{});
+            call->cc = CallConv(cc);
+            if (flags & CallTail) call->set_tail_call();
+            if (flags & CallInline) call->set_force_inline();
+            read_operand(call, call->callee_value);
+            call->arguments.resize(read_count());
+            for (auto& a : call->arguments) read_operand(call, a);
+            return call;
+        }
+
+        case K::GetElementPtr: {
+            auto* gep = new (*mod) GEPInst(read_type(), Location{});
+            read_operand(gep, gep->pointer);
+            read_operand(gep, gep->index);
+            return gep;
+        }
+
+        case K::GetMemberPtr: {
+            auto* ty = read_type_of_kind<StructType>();
+            if (not ty) return nullptr;
+            auto* gmp = new (*mod) GetMemberPtrInst(ty, Location{});
+            read_operand(gmp, gmp->pointer);
+            read_operand(gmp, gmp->index);
+            return gmp;
+        }
+
+        case K::Intrinsic: {
+            auto kind = read_varint();
+            auto* intrinsic = new (*mod) IntrinsicInst(IntrinsicKind(kind), {});
+            intrinsic->operand_list.resize(read_count());
+            for (auto& o : intrinsic->operand_list) read_operand(intrinsic, o);
+            return intrinsic;
+        }
+
+        case K::Load: {
+            auto* load = new (*mod) LoadInst(read_type());
+            read_operand(load, load->pointer);
+            return load;
+        }
+
+        case K::Phi: {
+            auto* phi = new (*mod) PhiInst(read_type());
+            phi->incoming.resize(read_count());
+            for (auto& incoming : phi->incoming) {
+                read_operand(phi, incoming.block);
+                read_operand(phi, incoming.value);
+            }
+            return phi;
+        }
+
+        case K::Store: {
+            auto* store = new (*mod) StoreInst();
+            read_operand(store, store->value);
+            read_operand(store, store->pointer);
+            return store;
+        }
+
+        case K::Branch: {
+            auto* branch = new (*mod) BranchInst();
+            read_operand(branch, branch->target_block);
+            return branch;
+        }
+
+        case K::CondBranch: {
+            auto* branch = new (*mod) CondBranchInst();
+            read_operand(branch, branch->condition);
+            read_operand(branch, branch->then);
+            read_operand(branch, branch->otherwise);
+            return branch;
+        }
+
+        case K::Return: {
+            auto* ret = new (*mod) ReturnInst(nullptr);
+            if (read_varint()) read_operand(ret, ret->value);
+            return ret;
+        }
+
+        case K::Unreachable: return new (*mod) UnreachableInst();
+
+        case K::ZExt: return unary<ZExtInst>(read_type());
+        case K::SExt: return unary<SExtInst>(read_type());
+        case K::Trunc: return unary<TruncInst>(read_type());
+        case K::Bitcast: return unary<BitcastInst>(read_type());
+        case K::Neg: return unary<NegInst>(read_type());
+        case K::Copy: return unary<CopyInst>(read_type());
+        case K::Compl: return unary<ComplInst>(read_type());
+
+        case K::Add: return binary<AddInst>(read_type());
+        case K::Sub: return binary<SubInst>(read_type());
+        case K::Mul: return binary<MulInst>(read_type());
+        case K::SDiv: return binary<SDivInst>(read_type());
+        case K::UDiv: return binary<UDivInst>(read_type());
+        case K::SRem: return binary<SRemInst>(read_type());
+        case K::URem: return binary<URemInst>(read_type());
+        case K::Shl: return binary<ShlInst>(read_type());
+        case K::Sar: return binary<SarInst>(read_type());
+        case K::Shr: return binary<ShrInst>(read_type());
+        case K::And: return binary<AndInst>(read_type());
+        case K::Or: return binary<OrInst>(read_type());
+        case K::Xor: return binary<XorInst>(read_type());
+
+        case K::Eq: return binary<EqInst>(nullptr);
+        case K::Ne: return binary<NeInst>(nullptr);
+        case K::SLt: return binary<SLtInst>(nullptr);
+        case K::SLe: return binary<SLeInst>(nullptr);
+        case K::SGt: return binary<SGtInst>(nullptr);
+        case K::SGe: return binary<SGeInst>(nullptr);
+        case K::ULt: return binary<ULtInst>(nullptr);
+        case K::ULe: return binary<ULeInst>(nullptr);
+        case K::UGt: return binary<UGtInst>(nullptr);
+        case K::UGe: return binary<UGeInst>(nullptr);
+
+        default:
+            Error("unknown instruction");
+            return nullptr;
+    }
+}
+
+void lcc::parser::BitcodeReader::resolve() {
+    for (auto [slot, user, index] : fixups) {
+        if (index >= values.size()) {
+            Error("value index out of range");
+            return;
+        }
+
+        /// Blocks may only be used where a block is expected.
+        auto* v = values[index];
+        if (auto* block_slot = std::get_if<Block**>(&slot)) {
+            if (not is<Block>(v)) {
+                Error("operand is not a block");
+                return;
+            }
+            **block_slot = as<Block>(v);
+        } else {
+            if (is<Block>(v)) {
+                Error("operand is a block");
+                return;
+            }
+            *std::get<Value**>(slot) = v;
+        }
+
+        if (user) Inst::AddUse(v, user);
+    }
+    fixups.clear();
+}
+
+auto lcc::parser::BitcodeReader::read() -> bool {
+    if (not data.starts_with(Magic)) {
+        Error("not an LCC bitcode file");
+        return false;
+    }
+
+    pos = Magic.size();
+    if (read_varint() != Version) {
+        Error("unsupported version");
+        return false;
+    }
+
+    read_type_table();
+    mod = std::make_unique<Module>(ctx, std::string{read_string()});
+
+    for (auto n = read_count(); n; n--) {
+        Section section{std::string{read_string()}};
+        section.attributes = read_varint();
+        section.is_fill = read_varint();
+        if (section.is_fill) {
+            section.length() = u32(read_varint());
+            section.value() = u8(read_varint());
+        } else {
+            auto bytes = read_string();
+            section.contents().assign(bytes.begin(), bytes.end());
+        }
+        mod->add_extra_section(std::move(section));
+    }
+
+    /// Global values.
+    for (auto n = read_count(); n and not failed; n--) {
+        auto names = read_names();
+        auto* ty = read_type();
+        if (failed) break;
+        auto* var = new (*mod) GlobalVariable(mod.get(), ty, names[0].name, names[0].linkage, nullptr);
+        var->_names = std::move(names);
+        values.push_back(var);
+    }
+
+    for (auto n = read_count(); n and not failed; n--) {
+        auto names = read_names();
+        auto cc = read_varint();
+        auto* ty = read_type_of_kind<FunctionType>();
+        if (cc > u64(CallConv::Glint)) Error("invalid calling convention");
+        if (failed) break;
+        auto* f = new (*mod) Function(mod.get(), names[0].name, ty, names[0].linkage, CallConv(cc));
+        for (auto& name : names | vws::drop(1)) f->add_name(std::move(name.name), name.linkage);
+        values.push_back(f);
+    }
+
+    global_count = values.size();
+    for (auto* var : mod->vars()) {
+        if (failed) break;
+        if (read_varint()) read_operand<Value>(nullptr, var->_init);
+    }
+    resolve();
+
+    /// Function bodies.
+    for (auto* f : mod->code()) {
+        if (failed) break;
+        values.resize(global_count);
+        for (auto* p : f->params()) values.push_back(p);
+
+        auto blocks = read_count();
+        std::vector<Block*> block_list{};
+        block_list.reserve(blocks);
+        for (u64 i = 0; i < blocks; i++) {
+            block_list.push_back(new (*mod) Block());
+            values.push_back(block_list.back());
+        }
+
+        for (auto* b : block_list) {
+            if (failed) break;
+            b->name(std::string{read_string()});
+            for (auto n = read_count(); n and not failed; n--) {
+                auto* i = read_inst();
+                if (not i) break;
+                b->insert(i, true);
+                values.push_back(i);
+            }
+            f->append_block(b);
+        }
+
+        resolve();
+    }
+
+    if (not failed and pos != data.size()) Error("trailing data");
+    return not failed;
+}
+
+auto lcc::Module::bitcode() -> std::vector<char> {
+    return BitcodeWriter{}.write(this);
+}
+
+auto lcc::Module::IsBitcode(std::string_view data) -> bool {
+    return data.starts_with(Magic);
+}
+
+auto lcc::Module::ParseBitcode(Context* ctx, std::string_view data) -> std::unique_ptr<Module> {
+    TimeReport::Timer timer{ctx, "Parse IR"};
+    parser::BitcodeReader r{ctx, data};
+    if (not r.read()) return nullptr;
+    if (auto* mem = ctx->mem_report()) mem->count("IR instructions", r.mod->instruction_count());
+    return std::move(r.mod);
+}
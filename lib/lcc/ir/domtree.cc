@@ -10,16 +10,23 @@ namespace {
 class DisjointSets {
     Buffer<usz> entries;
 
+    /// The elements of each set form a circular list; this is the
+    /// element after each one in the list of its set.
+    Buffer<usz> next;
+
 public:
-    explicit DisjointSets(usz entry_count) : entries(entry_count) {
+    explicit DisjointSets(usz entry_count) : entries(entry_count), next(entry_count) {
         rgs::generate(entries, [i = 0] mutable { return i++; });
+        rgs::generate(next, [i = 0] mutable { return i++; });
     }
 
     /// Get all elements of a set.
     auto elements(usz a) -> Generator<usz> {
-        for (auto root = find(a); auto [i, e] : vws::enumerate(entries))
-            if (find(e) == root)
-                co_yield usz(i);
+        auto e = a;
+        do {
+            co_yield e;
+            e = next[e];
+        } while (e != a);
     }
 
     usz find(usz a) {
@@ -30,7 +37,11 @@ public:
     void unite(usz a, usz b) {
         auto aset = find(a);
         auto bset = find(b);
+        if (aset == bset) return;
         entries[bset] = aset;
+
+        /// Splice the two lists together.
+        std::swap(next[aset], next[bset]);
     }
 };
 
@@ -55,6 +66,7 @@ public:
 struct DomTreeBuilder {
     Buffer<usz>& idoms;
     Buffer<std::vector<usz>>& children;
+    const std::unordered_map<Block*, usz>& ids;
     Function* f;
 
     /// Flags indicating whether we’ve already visited a node.
@@ -79,42 +91,63 @@ struct DomTreeBuilder {
     DisjointSets same{f->blocks().size()};
 
     /// List of outgoing arcs for each vertex.
-    std::unordered_multimap<usz, usz> out{};
+    Buffer<std::vector<usz>> out{f->blocks().size()};
 
     /// List of incoming arcs for each vertex.
-    std::unordered_multimap<usz, usz> in{};
+    Buffer<std::vector<usz>> in{f->blocks().size()};
 
     /// For each vertex v, the list of arcs (a, b) such that v = nca(a, b).
-    std::unordered_multimap<usz, std::pair<usz, usz>> arcs{};
+    Buffer<std::vector<std::pair<usz, usz>>> arcs{f->blocks().size()};
 
     void Build() {
         idoms[0] = 0;
 
-        for (auto [i, u] : vws::enumerate(f->blocks()))
-            total[usz(i)] = u->predecessor_count();
+        /// Only count arcs from blocks that are reachable from the entry;
+        /// the DFS never gets to mark the others.
+        std::vector<usz> stack{0};
+        visited[0] = true;
+        while (not stack.empty()) {
+            auto u = stack.back();
+            stack.pop_back();
+            for (auto s : f->blocks()[u]->successors()) {
+                auto v = ids.at(s);
+                total[v]++;
+                if (not visited[v]) {
+                    visited[v] = true;
+                    stack.push_back(v);
+                }
+            }
+        }
 
+        rgs::fill(visited, false);
         DFS(0);
     }
 
 private:
-    /// Merge two ranges in a multimap.
-    void Merge(decltype(out)& map, usz x, usz v) {
-        auto [v1, vn] = map.equal_range(v);
-        for (auto [_, e] : rgs::subrange(v1, vn)) map.emplace(x, e);
+    /// Move the arcs of a vertex that has been contracted into another
+    /// vertex over to that vertex; the order of the arcs doesn’t matter,
+    /// so always append the shorter list to the longer one.
+    void Merge(decltype(out)& lists, usz x, usz v) {
+        if (x == v) return;
+        auto& into = lists[x];
+        auto& from = lists[v];
+        if (into.size() < from.size()) std::swap(into, from);
+        into.insert(into.end(), from.begin(), from.end());
+        from = {};
     }
 
     void DFS(usz u) {
         Previsit(u);
 
         for (auto s : f->blocks()[u]->successors()) {
-            auto v = s->id();
+            auto v = ids.at(s);
             if (not visited[v]) {
                 DFS(v);
                 parents[v] = u;
                 ncas.unite(u, v);
             }
 
-            arcs.emplace(ncas.find(v), std::pair{u, v});
+            arcs[ncas.find(v)].emplace_back(u, v);
         }
 
         Postvisit(u);
@@ -125,18 +158,15 @@ private:
     }
 
     void Postvisit(usz u) {
-        auto [fst, lst] = arcs.equal_range(u);
-        for (auto [_, arc] : rgs::subrange(fst, lst)) {
-            auto [x, y] = arc;
-            out.emplace(contr.find(x), y);
-            in.emplace(contr.find(y), x);
+        for (auto [x, y] : arcs[u]) {
+            out[contr.find(x)].push_back(y);
+            in[contr.find(y)].push_back(x);
             added[contr.find(y)]++;
         }
 
-        while (out.contains(u)) {
-            auto it = out.find(u);
-            auto v = contr.find(it->second);
-            out.erase(it);
+        while (not out[u].empty()) {
+            auto v = contr.find(out[u].back());
+            out[u].pop_back();
 
             if (v != u) {
                 total[v]--;
@@ -159,10 +189,9 @@ private:
             }
         }
 
-        while (in.contains(u)) {
-            auto it = in.find(u);
-            auto v = contr.find(it->second);
-            in.erase(it);
+        while (not in[u].empty()) {
+            auto v = contr.find(in[u].back());
+            in[u].pop_back();
 
             while (v != u) {
                 same.unite(u, v);
@@ -185,18 +214,26 @@ private:
 
 lcc::DomTree::DomTree(Function* function, bool compute_dominance_frontiers) : f(function) {
     if (function->blocks().empty()) return;
+    for (auto [i, b] : vws::enumerate(function->blocks())) ids[b] = usz(i);
 
     /// Build dominator tree.
-    DomTreeBuilder{idoms, children, function}.Build();
+    DomTreeBuilder{idoms, children, ids, function}.Build();
 
     /// Compute dominance frontiers.
     if (not compute_dominance_frontiers) return;
+    ///
+    /// Walk up the dominator tree from each predecessor of a block until
+    /// we get to the immediate dominator of that block; if the block is
+    /// the root, it is in the frontier of every block we pass, the root
+    /// included. Unreachable blocks are not in the tree at all.
     for (auto [i, a] : vws::enumerate(function->blocks())) {
+        if (idoms[usz(i)] == -1zu) continue;
         for (auto b : a->successors()) {
-            for (Block* x = a; not strictly_dominates(x, b);) {
-                auto xid = x->id();
-                df[xid].push_back(b);
-                x = function->blocks()[idoms[xid]];
+            auto bid = index(b);
+            for (auto x = usz(i);; x = idoms[x]) {
+                if (bid != RootId and x == idoms[bid]) break;
+                df[x].push_back(b);
+                if (x == RootId) break;
             }
         }
     }
@@ -11,9 +11,11 @@
 #include <lcc/utils/rtti.hh>
 
 #include <algorithm>
+#include <bit>
 #include <cctype>
 #include <functional>
 #include <iterator>
+#include <mutex>
 #include <ranges>
 #include <span>
 #include <string>
@@ -23,6 +25,10 @@
 #include <vector>
 
 namespace lcc {
+auto Value::operator new(size_t sz, Module& mod) -> void* {
+    return mod.allocate(sz);
+}
+
 Function::Function(
     Module* module,
     std::string mangled_name,
@@ -45,6 +51,11 @@ Function::Function(
     mod->add_function(this);
 }
 
+void Function::add_name(std::string n, Linkage l) {
+    mod->add_function_name(this, n);
+    func_names.push_back({std::move(n), l});
+}
+
 GlobalVariable::GlobalVariable(Module* mod, Type* t, std::string name, Linkage linkage, Value* init)
     : UseTrackingValue(Value::Kind::GlobalVariable, Type::PtrTy),
       _init(init),
@@ -77,6 +88,22 @@ GlobalVariable* GlobalVariable::CreateStringPtr(Module* mod, std::string name, s
     return var;
 }
 
+auto GlobalVariable::is_string_literal() -> bool {
+    return _init and is<ArrayConstant>(_init) and as<ArrayConstant>(_init)->is_string_literal();
+}
+
+auto GlobalVariable::is_mergeable_string() -> bool {
+    if (not is_string_literal()) return false;
+    const bool local = rgs::none_of(_names, [](const IRName& n) {
+        return IsExportedLinkage(n.linkage) or IsImportedLinkage(n.linkage);
+    });
+
+    // An embedded NUL would split this into several strings, which the
+    // linker could then merge separately.
+    auto* array = as<ArrayConstant>(_init);
+    return local and array->size() and rgs::find(*array, '\0') == std::prev(array->end());
+}
+
 auto Type::bits() const -> usz {
     switch (kind) {
         case Kind::Unknown:
@@ -97,6 +124,11 @@ auto Type::bits() const -> usz {
             return array->element_type()->bits() * array->length();
         }
 
+        case Kind::Vector: {
+            const auto& vector = as<VectorType>(this);
+            return vector->element_type()->bits() * vector->length();
+        }
+
         case Kind::Struct: {
             const auto& struct_ = as<StructType>(this);
             const std::vector<Type*>& members = struct_->members();
@@ -121,6 +153,7 @@ usz Type::align() const {
 
         case Kind::Void: return 1; /// Alignment of 0 is invalid.
         case Kind::Array: return as<ArrayType>(this)->element_type()->align();
+        case Kind::Vector: return std::bit_ceil(bits());
         case Kind::Integer: return as<IntegerType>(this)->bitwidth();
         case Kind::Struct: return rgs::max(as<StructType>(this)->members() | vws::transform(&Type::align));
     }
@@ -153,6 +186,20 @@ auto Type::string(bool use_colour) const -> std::string {
             );
         }
 
+        case Kind::Vector: {
+            auto vec = as<VectorType>(this);
+            return fmt::format(
+                "{}<{}{}{} x {}{}>{}",
+                C(Red),
+                C(Magenta),
+                vec->length(),
+                C(Red),
+                vec->element_type()->string(use_colour),
+                C(Red),
+                C(Reset)
+            );
+        }
+
         case Kind::Integer: {
             auto integer = as<IntegerType>(this);
             return fmt::format("{}i{}{}", C(Cyan), integer->bitwidth(), C(Reset));
@@ -184,26 +231,71 @@ auto Type::string(bool use_colour) const -> std::string {
     LCC_UNREACHABLE();
 }
 
+namespace {
+/// Mix a value into a structural type hash.
+template <typename T>
+void HashCombine(usz& seed, const T& value) {
+    seed ^= std::hash<T>{}(value) + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+}
+
+/// Compute the hash used to intern a type in the context.
+///
+/// \param kind The kind of the type.
+/// \param element The return type of a function or the element type of an array or vector.
+/// \param types The parameter types of a function or the member types of a struct.
+/// \param size The length of an array or vector.
+/// \param name The name of a named struct.
+/// \param variadic Whether a function is variadic.
+auto StructuralHash(
+    Type::Kind kind,
+    Type* element,
+    std::span<Type* const> types,
+    usz size = 0,
+    std::string_view name = {},
+    bool variadic = false
+) -> usz {
+    usz seed = usz(+kind);
+    HashCombine(seed, element);
+    for (auto* t : types) HashCombine(seed, t);
+    HashCombine(seed, size);
+    HashCombine(seed, name);
+    HashCombine(seed, variadic);
+    return seed;
+}
+
+/// Find an interned type of kind T with the given hash that satisfies a predicate.
+template <typename T, typename Predicate>
+auto FindInterned(Context* ctx, usz hash, Predicate matches) -> T* {
+    auto [begin, end] = ctx->type_table.equal_range(hash);
+    for (auto it = begin; it != end; ++it)
+        if (auto* t = cast<T>(it->second); t and matches(t))
+            return t;
+    return nullptr;
+}
+} // namespace
+
 /// Get or create a function type.
 FunctionType* FunctionType::Get(Context* ctx, Type* ret, std::vector<Type*> params, bool is_variadic) {
+    std::lock_guard _{ctx->type_mutex};
+
     // Look in ctx type cache.
-    const auto& found = rgs::find_if(ctx->function_types, [&](const Type* t) {
-        const FunctionType* f = as<FunctionType>(t);
+    auto hash = StructuralHash(Kind::Function, ret, params, 0, {}, is_variadic);
+    auto* found = FindInterned<FunctionType>(ctx, hash, [&](const FunctionType* f) {
         return f->ret() == ret && rgs::equal(f->params(), params) && f->variadic() == is_variadic;
     });
-    if (found != ctx->function_types.end())
-        return as<FunctionType>(*found);
+    if (found) return found;
 
-    FunctionType* out = new (ctx) FunctionType(ret, params, is_variadic);
+    FunctionType* out = new (ctx) FunctionType(ret, std::move(params), is_variadic);
     ctx->function_types.push_back(out);
+    ctx->type_table.emplace(hash, out);
     return out;
 }
 
 IntegerType* IntegerType::Get(Context* ctx, usz bitwidth) {
+    std::lock_guard _{ctx->type_mutex};
+
     // Look in ctx type cache.
-    const auto& found = std::find_if(ctx->integer_types.begin(), ctx->integer_types.end(), [&](const std::pair<usz, Type*>& pair) {
-        return pair.first == bitwidth;
-    });
+    auto found = ctx->integer_types.find(bitwidth);
     if (found != ctx->integer_types.end())
         return as<IntegerType>(found->second);
 
@@ -214,47 +306,75 @@ IntegerType* IntegerType::Get(Context* ctx, usz bitwidth) {
 }
 
 ArrayType* ArrayType::Get(Context* ctx, usz length, Type* element_type) {
+    std::lock_guard _{ctx->type_mutex};
+
     // Look in ctx type cache.
-    const auto& found = rgs::find_if(ctx->array_types, [&](const Type* t) {
-        const ArrayType* a = as<ArrayType>(t);
+    auto hash = StructuralHash(Kind::Array, element_type, {}, length);
+    auto* found = FindInterned<ArrayType>(ctx, hash, [&](const ArrayType* a) {
         return a->length() == length && a->element_type() == element_type;
     });
-    if (found != ctx->array_types.end())
-        return as<ArrayType>(*found);
+    if (found) return found;
 
     ArrayType* out = new (ctx) ArrayType(length, element_type);
     ctx->array_types.push_back(out);
+    ctx->type_table.emplace(hash, out);
     return out;
 }
 
-StructType* StructType::Get(Context* ctx, std::vector<Type*> member_types, std::string name) {
+VectorType* VectorType::Get(Context* ctx, usz length, Type* element_type) {
+    LCC_ASSERT(is<IntegerType>(element_type), "Vector elements must be integers");
+    LCC_ASSERT(length != 0, "Vectors must have at least one element");
+    std::lock_guard _{ctx->type_mutex};
+
     // Look in ctx type cache.
-    const auto& found = rgs::find_if(ctx->struct_types, [&](const Type* t) {
-        const StructType* s = as<StructType>(t);
-        return s->named()
-                 ? s->name() == name and rgs::equal(s->members(), member_types)
-                 : rgs::equal(as<StructType>(ctx->struct_types[usz(s->index())])->members(), member_types);
+    auto hash = StructuralHash(Kind::Vector, element_type, {}, length);
+    auto* found = FindInterned<VectorType>(ctx, hash, [&](const VectorType* v) {
+        return v->length() == length && v->element_type() == element_type;
     });
-    if (found != ctx->struct_types.end())
-        return as<StructType>(*found);
+    if (found) return found;
+
+    VectorType* out = new (ctx) VectorType(length, element_type);
+    ctx->vector_types.push_back(out);
+    ctx->type_table.emplace(hash, out);
+    return out;
+}
+
+bool VectorType::supported() const {
+    auto element_bits = _element_type->bits();
+    return (bits() == 128 or bits() == 256) and element_bits >= 8 and element_bits <= 64 and std::has_single_bit(element_bits);
+}
+
+StructType* StructType::Get(Context* ctx, std::vector<Type*> member_types, std::string name) {
+    std::lock_guard _{ctx->type_mutex};
+
+    // Look in ctx type cache. Named structs are unique by name and
+    // members; unnamed structs are unique by members alone.
+    auto hash = StructuralHash(Kind::Struct, nullptr, member_types, 0, name);
+    auto* found = FindInterned<StructType>(ctx, hash, [&](const StructType* s) {
+        if (s->named() != not name.empty()) return false;
+        if (s->named() and s->name() != name) return false;
+        return rgs::equal(s->members(), member_types);
+    });
+    if (found) return found;
 
     StructType* out;
     if (not name.empty())
-        out = new (ctx) StructType(member_types, name);
-    else out = new (ctx) StructType(member_types, (long int) ctx->struct_types.size());
+        out = new (ctx) StructType(std::move(member_types), std::move(name));
+    else out = new (ctx) StructType(std::move(member_types), (long int) ctx->struct_types.size());
     ctx->struct_types.push_back(out);
+    ctx->type_table.emplace(hash, out);
     return out;
 }
 
 void Block::insert_before(Inst* to_insert, Inst* before) {
-    auto before_it = rgs::find(inst_list, before);
-    inst_list.insert(before_it, to_insert);
+    LCC_ASSERT(before->parent == this, "Instruction not found in block");
+    inst_list.insert(inst_list.iterator_to(before), to_insert);
     to_insert->parent = this;
 }
 
 void Block::insert_after(Inst* to_insert, Inst* after) {
-    auto after_it = rgs::find(inst_list, after);
-    inst_list.insert(after_it + 1, to_insert);
+    LCC_ASSERT(after->parent == this, "Instruction not found in block");
+    inst_list.insert(std::next(inst_list.iterator_to(after)), to_insert);
     to_insert->parent = this;
 }
 
@@ -328,7 +448,7 @@ auto Inst::Children() -> Generator<Value**> {
 
         case Kind::Intrinsic: {
             auto* i = as<IntrinsicInst>(this);
-            for (auto* a : i->operand_list) co_yield &a;
+            for (auto& a : i->operand_list) co_yield &a;
         } break;
 
         case Kind::Load: {
@@ -403,7 +523,10 @@ void Inst::EraseImpl() {
     for (auto* usee : children()) RemoveUse(usee, this);
 
     /// Erase this instruction.
-    if (parent) parent->instructions().erase(rgs::find(parent->instructions(), this));
+    if (parent) {
+        parent->instructions().erase(this);
+        parent = nullptr;
+    }
 }
 
 auto Inst::children() const -> Generator<Value*> {
@@ -426,19 +549,18 @@ void Inst::erase() {
 
 void Inst::erase_cascade() {
     EraseImpl();
-    while (not users().empty()) users().front()->erase_cascade();
+    while (not users().empty()) users().back()->erase_cascade();
 }
 
-auto Inst::instructions_before_this() -> std::span<Inst*> {
+auto Inst::instructions_before_this() -> rgs::subrange<InstList::Iterator> {
     if (not parent) return {};
-    auto it = rgs::find(parent->instructions(), this);
-    LCC_ASSERT(it != parent->instructions().end(), "Instruction not found in parent");
-    return {parent->instructions().begin(), it};
+    auto& list = parent->instructions();
+    return {list.begin(), list.iterator_to(this)};
 }
 
 void Inst::replace_with(Value* v) {
     while (not users().empty()) {
-        auto* u = users().front();
+        auto* u = users().back();
 
         /// Using `Children()` is fine here since we are not a block.
         for (auto* use : u->Children()) {
@@ -462,6 +584,28 @@ void Inst::replace_with(Value* v) {
     erase();
 }
 
+auto BinaryInst::SupportsVector(Kind kind, const VectorType* type) -> bool {
+    if (not type->supported()) return false;
+    switch (kind) {
+        case Kind::Add:
+        case Kind::Sub:
+        case Kind::And:
+        case Kind::Or:
+        case Kind::Xor:
+            return true;
+
+        /// There is no instruction for 8-bit elements, and none for 64-bit
+        /// ones short of AVX-512.
+        case Kind::Mul: {
+            auto element_bits = type->element_type()->bits();
+            return element_bits == 16 or element_bits == 32;
+        }
+
+        default:
+            return false;
+    }
+}
+
 auto Block::create_phi(Type* type, Location loc) -> PhiInst* {
     auto phi = new (*parent->module()) PhiInst(type, loc);
     auto it = rgs::find_if(inst_list, [](Inst* i) { return not is<PhiInst>(i); });
@@ -506,13 +650,23 @@ void Block::merge(lcc::Block* b) {
                 continue;
             }
 
-            /// Any PHIs that use a value from the other block must
-            /// be updated to use the value from this block.
-            else if (auto in = phi->get_incoming(b)) {
-                phi->remove_incoming(b);
-                phi->set_incoming(in, this);
+            i++;
+        }
+
+        /// Any PHIs that use a value from the other block must
+        /// be updated to use the value from this block; these
+        /// need not use this block as well, e.g. if the other
+        /// block branches back to this one.
+        for (usz i = 0; i < b->users().size(); /** No increment! **/) {
+            auto phi = cast<PhiInst>(b->users()[i]);
+            if (not phi) {
                 i++;
+                continue;
             }
+
+            auto in = phi->get_incoming(b);
+            phi->remove_incoming(b);
+            phi->set_incoming(in, this);
         }
     }
 
@@ -524,8 +678,7 @@ void Block::merge(lcc::Block* b) {
     /// Set the parent for each instruction to this block and move
     /// them all over. Lastly, delete the block.
     for (auto i : b->inst_list) i->parent = this;
-    inst_list.insert(inst_list.end(), b->inst_list.begin(), b->inst_list.end());
-    b->inst_list.clear();
+    inst_list.splice(b->inst_list);
     if (b->parent) b->erase();
 }
 
@@ -578,6 +731,17 @@ struct LCCIRPrinter : IRPrinter<LCCIRPrinter, 2> {
         using enum utils::Colour;
         if (auto struct_type = cast<StructType>(ty)) {
             return fmt::format("{}@{}{}", C(Green), struct_type->string(false), C(Reset));
+        } else if (auto vec = cast<VectorType>(ty)) {
+            return fmt::format(
+                "{}<{}{}{} x {}{}>{}",
+                C(Red),
+                C(Magenta),
+                vec->length(),
+                C(Red),
+                Ty(vec->element_type()),
+                C(Red),
+                C(Reset)
+            );
         } else if (auto arr = cast<ArrayType>(ty)) {
             return fmt::format(
                 "{}{}[{}{}{}]{}",
@@ -735,8 +899,9 @@ struct LCCIRPrinter : IRPrinter<LCCIRPrinter, 2> {
                 if (not callee_ty->ret()->is_void()) PrintTemp(i);
                 else Print("    {}", C(Yellow));
                 Print(
-                    "{}call{}{} {} {}(",
+                    "{}{}call{}{} {} {}(",
                     c->is_tail_call() ? "tail "sv : ""sv,
+                    c->is_force_inline() ? "inline "sv : ""sv,
                     c->call_conv() == CallConv::C ? ""sv : " "sv,
                     c->call_conv() == CallConv::C ? ""sv : StringifyEnum(c->call_conv()),
                     Val(c->callee(), false),
@@ -791,11 +956,13 @@ struct LCCIRPrinter : IRPrinter<LCCIRPrinter, 2> {
                 switch (intrinsic->intrinsic_kind()) {
                     default: LCC_ASSERT(false, "Unimplemented intrinsic in LCC IR printer");
 
-                    case IntrinsicKind::MemCopy: {
+                    case IntrinsicKind::MemCopy:
+                    case IntrinsicKind::MemSet: {
                         Print(
-                            "    {}intrinsic {}@memcpy{}({}{}, {}{}, {}{})",
+                            "    {}intrinsic {}@{}{}({}{}, {}{}, {}{})",
                             C(Yellow),
                             C(Green),
+                            intrinsic->intrinsic_kind() == IntrinsicKind::MemCopy ? "memcpy" : "memset",
                             C(Red),
                             Val(operands[0]),
                             C(Red),
@@ -1215,7 +1382,7 @@ struct LCCIRPrinter : IRPrinter<LCCIRPrinter, 2> {
     /// This is *not* to be used when printing the rest of
     /// the IR! This is the entry point for printing a single
     /// value only.
-    static void PrintValue(const Value* const_value, bool use_colour) {
+    static auto PrintValue(const Value* const_value, bool use_colour) -> std::string {
         /// Ok because we’re not going to mutate this, but we should
         /// probably refactor the IR printer to use const Value*’s
         /// instead...
@@ -1235,7 +1402,7 @@ struct LCCIRPrinter : IRPrinter<LCCIRPrinter, 2> {
         } else {
             p.Print("{}", p.Val(v, true));
         }
-        fmt::print(
+        return fmt::format(
             "{}{}",
             p.Output(),
             lcc::utils::Colours{use_colour}(lcc::utils::Colour::Reset)
@@ -1244,16 +1411,29 @@ struct LCCIRPrinter : IRPrinter<LCCIRPrinter, 2> {
 };
 } // namespace
 
-void Module::print_ir(bool use_colour) {
-    fmt::print(
+auto Module::ir_string(bool use_colour) -> std::string {
+    return fmt::format(
         "{}{}",
         LCCIRPrinter::Print(this, use_colour),
         lcc::utils::Colours{use_colour}(lcc::utils::Colour::Reset)
     );
 }
 
+void Module::print_ir(bool use_colour) {
+    write_ir(stdout, use_colour);
+}
+
+void Module::write_ir(std::FILE* file, bool use_colour) {
+    LCCIRPrinter::Print(this, use_colour, file);
+    fmt::print(file, "{}", lcc::utils::Colours{use_colour}(lcc::utils::Colour::Reset));
+}
+
+auto Value::string(bool use_colour) const -> std::string {
+    return LCCIRPrinter::PrintValue(this, use_colour);
+}
+
 void Value::print() const {
-    LCCIRPrinter::PrintValue(this, true);
+    fmt::print("{}", string(true));
 }
 
 } // namespace lcc
@@ -3,6 +3,7 @@
 #include <lcc/ir/module.hh>
 #include <lcc/utils/ir_printer.hh>
 
+#include <cstdio>
 #include <ranges>
 #include <string>
 
@@ -384,7 +385,7 @@ struct LLVMIRPrinter : IRPrinter<LLVMIRPrinter, 0> {
 
     /// Print a global variable declaration or definition.
     void PrintGlobal(GlobalVariable* v) {
-        const bool is_string = v->init() and is<ArrayConstant>(v->init()) and as<ArrayConstant>(v->init())->is_string_literal();
+        const bool is_string = v->is_string_literal();
         LCC_ASSERT(v->names().size() == 1, "I don't know if LLVM can handle globals with multiple names and I don't care");
         auto name = v->names().at(0).name;
         auto linkage = v->names().at(0).linkage;
@@ -509,6 +510,13 @@ struct LLVMIRPrinter : IRPrinter<LLVMIRPrinter, 0> {
                     Ty(as<ArrayType>(ty)->element_type())
                 );
 
+            case Type::Kind::Vector:
+                return fmt::format(
+                    "<{} x {}>",
+                    as<VectorType>(ty)->length(),
+                    Ty(as<VectorType>(ty)->element_type())
+                );
+
             case Type::Kind::Struct:
                 return fmt::format("%{}", GetStructName(as<StructType>(ty)));
         }
@@ -657,3 +665,7 @@ struct LLVMIRPrinter : IRPrinter<LLVMIRPrinter, 0> {
 auto lcc::Module::llvm() -> std::string {
     return LLVMIRPrinter::Print(this, false);
 }
+
+void lcc::Module::write_llvm(std::FILE* file) {
+    LLVMIRPrinter::Print(this, false, file);
+}
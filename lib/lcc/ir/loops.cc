@@ -0,0 +1,75 @@
+#include <lcc/ir/loops.hh>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+auto lcc::Loop::preheader() const -> Block* {
+    Block* pre = nullptr;
+    for (auto* u : head->users()) {
+        if (not is<BranchInst, CondBranchInst>(u) or not u->block()) continue;
+        if (contains(u->block()) or u->block() == pre) continue;
+        if (pre) return nullptr;
+        pre = u->block();
+    }
+
+    if (not pre) return nullptr;
+    auto* term = pre->terminator();
+    return term and is<BranchInst>(term) ? pre : nullptr;
+}
+
+lcc::LoopInfo::LoopInfo(Function* f, const DomTree& dom) {
+    if (f->blocks().empty()) return;
+
+    /// Collect the predecessors of every reachable block.
+    std::vector<Block*> reachable{};
+    std::unordered_map<Block*, std::vector<Block*>> preds{};
+    for (auto* b : dom.dfs_preorder()) reachable.push_back(b);
+    for (auto* b : reachable)
+        for (auto* s : b->successors())
+            preds[s].push_back(b);
+
+    /// An edge is a back edge if its target dominates its source. Walk
+    /// backwards from the source to find the rest of the loop; this
+    /// stops at the header since it is added first.
+    std::unordered_map<Block*, Loop*> by_header{};
+    for (auto* b : reachable) {
+        for (auto* h : b->successors()) {
+            if (not dom.dominates(h, b)) continue;
+            auto*& l = by_header[h];
+            if (not l) {
+                l = all.emplace_back(new Loop(h)).get();
+                l->block_list.push_back(h);
+                l->block_set.insert(h);
+            }
+
+            l->latch_list.push_back(b);
+            std::vector<Block*> worklist{b};
+            while (not worklist.empty()) {
+                auto* x = worklist.back();
+                worklist.pop_back();
+                if (not l->block_set.insert(x).second) continue;
+                l->block_list.push_back(x);
+                worklist.insert(worklist.end(), preds[x].begin(), preds[x].end());
+            }
+        }
+    }
+
+    /// Two loops are either disjoint or one contains the other, so the
+    /// smallest loop containing the header of a loop is its parent.
+    rgs::stable_sort(all, {}, [](const auto& l) { return l->block_list.size(); });
+    for (auto [i, l] : vws::enumerate(all)) {
+        for (const auto& outer : all | vws::drop(usz(i) + 1)) {
+            if (outer->contains(l->head)) {
+                l->outer = outer.get();
+                outer->inner.push_back(l.get());
+                break;
+            }
+        }
+
+        if (not l->outer) roots.push_back(l.get());
+        for (auto* b : l->block_list) innermost.try_emplace(b, l.get());
+    }
+}
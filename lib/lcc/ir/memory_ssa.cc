@@ -0,0 +1,215 @@
+#include <lcc/ir/memory_ssa.hh>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+namespace {
+/// Check if a pointer, or anything derived from it with GEPs and GMPs,
+/// is used other than as the address of a load or store.
+auto AddressTaken(Value* ptr) -> bool {
+    for (auto* u : as<UseTrackingValue>(ptr)->users()) {
+        if (is<LoadInst>(u)) continue;
+        if (auto* s = cast<StoreInst>(u); s and s->ptr() == ptr and s->val() != ptr) continue;
+        if (auto* g = cast<GEPBaseInst>(u); g and g->ptr() == ptr and g->idx() != ptr) {
+            if (AddressTaken(g)) return true;
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+} // namespace
+
+MemorySSA::MemorySSA(Function* f, const DomTree& dom) {
+    auto Create = [&](MemoryAccess::Kind k, Block* b, Inst* i = nullptr) {
+        all.emplace_back(new MemoryAccess(k, b, i));
+        return all.back().get();
+    };
+
+    entry = Create(MemoryAccess::Kind::LiveOnEntry, nullptr);
+    if (f->blocks().empty()) return;
+
+    /// Create a def for every instruction that may write to memory, and
+    /// a use for every one that only reads from it.
+    std::vector<Block*> reachable{};
+    std::vector<Block*> def_blocks{};
+    for (auto* b : dom.dfs_preorder()) {
+        reachable.push_back(b);
+        bool defines = false;
+        for (auto* i : b->instructions()) {
+            if (is<LoadInst, ReturnInst>(i)) {
+                by_inst[i] = Create(MemoryAccess::Kind::Use, b, i);
+            } else if (is<StoreInst, CallInst, IntrinsicInst>(i)) {
+                by_inst[i] = Create(MemoryAccess::Kind::Def, b, i);
+                defines = true;
+            }
+        }
+        if (defines) def_blocks.push_back(b);
+    }
+
+    /// Insert a PHI at each block of DF+(defs).
+    std::unordered_set<Block*> is_reachable{reachable.begin(), reachable.end()};
+    for (auto* b : dom.iterated_dom_frontier(def_blocks))
+        if (is_reachable.contains(b))
+            phis[b] = Create(MemoryAccess::Kind::Phi, b);
+
+    /// Link every access to the version of memory that reaches it by
+    /// walking the dominator tree, as in SSA construction; each block is
+    /// paired with the number of reaching versions before we entered it,
+    /// or with -1 if we haven’t entered it yet.
+    std::vector<MemoryAccess*> current{entry};
+    std::vector<std::pair<Block*, usz>> stack{{dom.root(), -1zu}};
+    while (not stack.empty()) {
+        auto [b, mark] = stack.back();
+
+        /// Leaving the block; its versions go out of scope.
+        if (mark != -1zu) {
+            current.resize(mark);
+            stack.pop_back();
+            continue;
+        }
+
+        stack.back().second = current.size();
+        if (auto* p = phi(b)) current.push_back(p);
+        for (auto* i : b->instructions()) {
+            auto* a = access(i);
+            if (not a) continue;
+            a->defining = current.back();
+            current.back()->user_list.push_back(a);
+            if (a->kind() == MemoryAccess::Kind::Def) current.push_back(a);
+        }
+
+        /// Update PHIs in successors.
+        for (auto* s : b->successors()) {
+            if (auto* p = phi(s)) {
+                p->incoming.emplace_back(b, current.back());
+                current.back()->user_list.push_back(p);
+            }
+        }
+
+        /// Visit the blocks dominated by this one before leaving it.
+        for (auto* c : dom.immediately_dominated(b)) stack.emplace_back(c, -1zu);
+    }
+}
+
+auto MemorySSA::alias(const MemoryLocation& a, const MemoryLocation& b) const -> AliasResult {
+    if (a.base == b.base) {
+        if (not a.offset or not b.offset) return AliasResult::MayAlias;
+        if (*a.offset == *b.offset and a.size == b.size) return AliasResult::MustAlias;
+        if (*a.offset + a.size <= *b.offset or *b.offset + b.size <= *a.offset) return AliasResult::NoAlias;
+        return AliasResult::MayAlias;
+    }
+
+    /// Distinct objects never overlap.
+    if (is<AllocaInst, GlobalVariable>(a.base) and is<AllocaInst, GlobalVariable>(b.base))
+        return AliasResult::NoAlias;
+
+    /// Any other pointer can only point into an alloca whose address
+    /// has been taken.
+    if (not visible_outside(a) or not visible_outside(b)) return AliasResult::NoAlias;
+    return AliasResult::MayAlias;
+}
+
+auto MemorySSA::covers(const MemoryLocation& outer, const MemoryLocation& inner) -> bool {
+    if (outer.base != inner.base or not outer.offset or not inner.offset) return false;
+    return *outer.offset <= *inner.offset and *outer.offset + outer.size >= *inner.offset + inner.size;
+}
+
+auto MemorySSA::escapes(AllocaInst* a) const -> bool {
+    auto [it, inserted] = escaped_allocas.try_emplace(a);
+    if (inserted) it->second = AddressTaken(a);
+    return it->second;
+}
+
+auto MemorySSA::location(Inst* load_or_store) -> MemoryLocation {
+    MemoryLocation loc{};
+    if (auto* l = cast<LoadInst>(load_or_store)) loc = {l->ptr(), 0zu, l->type()->bytes()};
+    else {
+        auto* s = as<StoreInst>(load_or_store);
+        loc = {s->ptr(), 0zu, s->val()->type()->bytes()};
+    }
+
+    /// Find the object the pointer points into, and the offset from its
+    /// start, if every index on the way there is known.
+    while (auto* g = cast<GEPBaseInst>(loc.base)) {
+        auto* idx = cast<IntegerConstant>(g->idx());
+        if (not idx or idx->value().is_negative()) loc.offset = std::nullopt;
+        else if (loc.offset) {
+            auto index = idx->value().value();
+            if (auto* gmp = cast<GetMemberPtrInst>(g)) {
+                for (auto* member : gmp->struct_type()->members() | vws::take(index))
+                    *loc.offset += member->bytes();
+            } else {
+                *loc.offset += index * g->base_type()->bytes();
+            }
+        }
+        loc.base = g->ptr();
+    }
+
+    return loc;
+}
+
+auto MemorySSA::may_read(MemoryAccess* a, const MemoryLocation& loc) const -> bool {
+    switch (a->kind()) {
+        case MemoryAccess::Kind::LiveOnEntry:
+        case MemoryAccess::Kind::Phi:
+            return false;
+
+        /// Once we return, our own stack frame is gone, but anything else
+        /// may still be read by the caller.
+        case MemoryAccess::Kind::Use:
+            if (is<ReturnInst>(a->inst())) return not is<AllocaInst>(loc.base);
+            return alias(location(a->inst()), loc) != AliasResult::NoAlias;
+
+        case MemoryAccess::Kind::Def:
+            if (is<StoreInst>(a->inst())) return false;
+            return visible_outside(loc);
+    }
+
+    LCC_UNREACHABLE();
+}
+
+auto MemorySSA::may_write(MemoryAccess* a, const MemoryLocation& loc) const -> bool {
+    switch (a->kind()) {
+        case MemoryAccess::Kind::LiveOnEntry:
+        case MemoryAccess::Kind::Phi:
+            return true;
+
+        case MemoryAccess::Kind::Use:
+            return false;
+
+        case MemoryAccess::Kind::Def:
+            if (is<StoreInst>(a->inst())) return alias(location(a->inst()), loc) != AliasResult::NoAlias;
+            return visible_outside(loc);
+    }
+
+    LCC_UNREACHABLE();
+}
+
+void MemorySSA::remove(Inst* i) {
+    auto it = by_inst.find(i);
+    if (it == by_inst.end()) return;
+    auto* a = it->second;
+    by_inst.erase(it);
+
+    auto* def = a->defining;
+    std::erase(def->user_list, a);
+    for (auto* u : a->user_list) {
+        if (u->defining == a) u->defining = def;
+        for (auto& in : u->incoming)
+            if (in.second == a) in.second = def;
+        def->user_list.push_back(u);
+    }
+
+    a->user_list.clear();
+}
+
+auto MemorySSA::visible_outside(const MemoryLocation& loc) const -> bool {
+    auto* a = cast<AllocaInst>(loc.base);
+    return not a or escapes(a);
+}
+} // namespace lcc
@@ -1,6 +1,11 @@
 #include <fmt/format.h>
+#include <lcc/calling_conventions/sysv_x86_64.hh>
+#include <lcc/codegen/block_layout.hh>
+#include <lcc/codegen/codegen_cache.hh>
+#include <lcc/codegen/codegen_report.hh>
 #include <lcc/codegen/isel.hh>
 #include <lcc/codegen/mir.hh>
+#include <lcc/codegen/peephole.hh>
 #include <lcc/codegen/register_allocation.hh>
 #include <lcc/codegen/x86_64/assembly.hh>
 #include <lcc/codegen/x86_64/object.hh>
@@ -10,12 +15,18 @@
 #include <lcc/format.hh>
 #include <lcc/ir/ir.hh>
 #include <lcc/ir/module.hh>
+#include <lcc/mem_report.hh>
 #include <lcc/target.hh>
+#include <lcc/time_report.hh>
 #include <lcc/utils.hh>
 #include <lcc/utils/ir_printer.hh>
+#include <lcc/utils/parallel.hh>
 #include <object/generic.hh>
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 
 // NOTE: See module_mir.cc for Machine Instruction Representation (MIR)
 // generation.
@@ -23,6 +34,7 @@
 namespace lcc {
 
 void Module::lower() {
+    TimeReport::Timer timer{_ctx, "Lowering"};
     if (_ctx->target()->is_arch_x86_64()) {
         for (auto function : code()) {
             FunctionType* function_type = as<FunctionType>(function->type());
@@ -66,14 +78,19 @@ void Module::lower() {
             //     return (*xptr).a + (*xptr).b;
             // }
             //
+            // Classify the parameters before any of them are changed.
+            cconv::sysv::ParameterDescription sysv_params{};
+            if (_ctx->target()->is_cconv_sysv()) sysv_params = cconv::sysv::parameter_description(function);
+
             for (size_t param_i{0}; param_i < function_type->params().size(); ++param_i) {
                 auto*& param = function_type->params().at(param_i);
                 // TODO: Calling convention here /may/ be affected by function calling
                 // convention (maybe `function->call_conv()`).
-                // TODO: This isn't a proper check of whether or not a parameter should go
-                // in memory or not. We need to make sure there are registers left, even
-                // if it would fit.
-                bool sysv_memory_param = _ctx->target()->is_cconv_sysv() and param->bytes() > 16;
+                // Aggregates that don't fit in the registers that are left are passed
+                // in memory, too; a scalar can always be loaded from its stack slot.
+                bool sysv_memory_param = _ctx->target()->is_cconv_sysv()
+                                     and param->bytes() > x86_64::GeneralPurposeBytewidth
+                                     and sysv_params.info.at(param_i).kind == cconv::sysv::ParameterClass::MEMORY;
                 bool x64_memory_param = _ctx->target()->is_cconv_ms() and param->bytes() >= 8;
 
                 // TODO: x64 will also use this style lowering when actually passing stack
@@ -140,7 +157,10 @@ void Module::lower() {
             // Add parameter for over-large return types (in-memory ones that alter
             // function signature).
             // SysV is able to return objects <= 16 bytes in two registers.
-            bool ret_t_tworeg = _ctx->target()->is_cconv_sysv() and function_type->ret()->bytes() > 8 and function_type->ret()->bytes() <= 16;
+            auto ret_class = cconv::sysv::classify(function_type->ret());
+            bool ret_t_tworeg = _ctx->target()->is_cconv_sysv()
+                            and ret_class.kind == cconv::sysv::ParameterClass::REGISTER
+                            and ret_class.eightbytes == 2;
             bool ret_t_large = function_type->ret()->bytes() > 8;
             Value* ret_v_large{nullptr};
             if (not ret_t_tworeg and ret_t_large) {
@@ -155,7 +175,7 @@ void Module::lower() {
                     auto start = function->blocks().at(0);
                     auto alloca = new (*this) AllocaInst(Type::PtrTy, {});
                     auto store = new (*this) StoreInst(function->params().at(0), alloca);
-                    start->insert_before(alloca, start->instructions().at(0));
+                    start->insert_before(alloca, start->instructions().front());
                     start->insert_after(store, alloca);
                     ret_v_large = alloca;
                 }
@@ -165,8 +185,12 @@ void Module::lower() {
             }
 
             for (auto* block : function->blocks()) {
-                for (size_t inst_i = 0; inst_i < block->instructions().size(); ++inst_i) {
-                    auto*& instruction = block->instructions().at(inst_i);
+                // Lowering an instruction may replace it or insert new
+                // instructions next to it; only the instructions that
+                // were there to begin with are visited.
+                std::vector<Inst*> instructions(block->begin(), block->end());
+                for (auto* instruction : instructions) {
+                    if (instruction->block() != block) continue;
                     switch (instruction->kind()) {
                         case Value::Kind::Return: {
                             auto* ret = as<ReturnInst>(instruction);
@@ -204,6 +228,9 @@ void Module::lower() {
                             // Less than or equal to size of general purpose register; no change.
                             if (load->type()->bits() <= x86_64::GeneralPurposeBitwidth) continue;
 
+                            // Vectors live in vector registers.
+                            if (is<VectorType>(load->type())) continue;
+
                             // If this is an over-large load but it is used by a call, assume the
                             // calling convention allows for it and it will be handled in MIR.
                             // NOTE: Taken advantage of by SysV (see both parameter handling above as
@@ -259,6 +286,10 @@ void Module::lower() {
                             // Less than or equal to size of general purpose register; no change.
                             if (store->val()->type()->bits() <= x86_64::GeneralPurposeBitwidth)
                                 continue;
+
+                            // Vectors live in vector registers.
+                            if (is<VectorType>(store->val()->type())) continue;
+
                             auto byte_count = store->val()->type()->bytes();
 
                             // Return in multiple registers (handled in MIR generation)
@@ -310,35 +341,227 @@ void Module::lower() {
     } else {
         LCC_ASSERT(false, "TODO: Lowering of specified arch is not yet supported");
     }
+
+    if (auto* mem = _ctx->mem_report()) mem->count("IR instructions", instruction_count());
+}
+
+Module::Module(Context* ctx, std::string name)
+    : _ctx(ctx), _name(std::move(name)) {
+    if (auto* mem = _ctx ? _ctx->mem_report() : nullptr)
+        _arena.count_into(mem->counter(MemReport::Source::IR));
+}
+
+Module::~Module() {
+    for (auto* value : _values) value->~Value();
+    for (auto& [_, storage] : _thread_storage)
+        for (auto* value : storage->values) value->~Value();
+}
+
+namespace {
+/// The module whose values the current thread allocates from storage
+/// of its own, and that storage. \see Module::ThreadAllocation.
+thread_local Module* allocating_module{};
+thread_local void* allocating_storage{};
+} // namespace
+
+auto Module::thread_storage() -> ThreadStorage* {
+    if (allocating_module != this) return nullptr;
+    return static_cast<ThreadStorage*>(allocating_storage);
+}
+
+auto Module::allocate(usz size) -> void* {
+    if (auto* storage = thread_storage()) {
+        auto* ptr = storage->arena.allocate(size);
+        storage->values.push_back(static_cast<Value*>(ptr));
+        return ptr;
+    }
+
+    std::lock_guard _{_allocation_mutex};
+    auto* ptr = _arena.allocate(size);
+    _values.push_back(static_cast<Value*>(ptr));
+    return ptr;
+}
+
+Module::ThreadAllocation::ThreadAllocation(Module& mod)
+    : outer_module(allocating_module),
+      outer_storage(static_cast<ThreadStorage*>(allocating_storage)) {
+    std::lock_guard _{mod._allocation_mutex};
+    auto& storage = mod._thread_storage[std::this_thread::get_id()];
+    if (not storage) {
+        storage = std::make_unique<ThreadStorage>();
+        if (auto* mem = mod._ctx ? mod._ctx->mem_report() : nullptr)
+            storage->arena.count_into(mem->counter(MemReport::Source::IR));
+    }
+    allocating_module = &mod;
+    allocating_storage = storage.get();
+}
+
+Module::ThreadAllocation::~ThreadAllocation() {
+    allocating_module = outer_module;
+    allocating_storage = outer_storage;
+}
+
+void Module::add_function(Function* func) {
+    _code.push_back(func);
+    for (const auto& n : func->names()) add_function_name(func, n.name);
+}
+
+void Module::add_var(GlobalVariable* var) {
+    _vars.push_back(var);
+    for (const auto& n : var->names()) _vars_by_name.try_emplace(n.name, var);
+}
+
+void Module::reserve_functions(usz count) {
+    _code.reserve(_code.size() + count);
+    _functions_by_name.reserve(_functions_by_name.size() + count);
+}
+
+void Module::reserve_vars(usz count) {
+    _vars.reserve(_vars.size() + count);
+    _vars_by_name.reserve(_vars_by_name.size() + count);
+}
+
+auto Module::instruction_count() const -> usz {
+    usz count = 0;
+    for (auto* function : _code)
+        for (auto* block : function->blocks())
+            count += block->instructions().size();
+    return count;
+}
+
+namespace {
+/// Call \p write with the output file, or with stdout if the path is
+/// empty or `-`, so that it can write to it as it goes.
+void WriteOutput(const fs::path& path, auto write) {
+    const bool to_stdout = path.empty() or path == "-";
+    auto* file = to_stdout ? stdout : std::fopen(path.string().c_str(), "wb");
+    if (not file) Diag::Fatal("Failed to open file '{}': {}", path.string(), std::strerror(errno));
+    write(file);
+    if (to_stdout ? std::fflush(file) != 0 : std::fclose(file) != 0)
+        Diag::Fatal("Failed to write to file '{}': {}", path.string(), std::strerror(errno));
 }
+} // namespace
 
 void Module::emit(std::filesystem::path output_file_path) {
+    emit(output_file_path, nullptr, nullptr);
+}
+
+auto Module::emit_to_buffer() -> std::vector<u8> {
+    std::vector<u8> buffer{};
+    emit({}, &buffer, nullptr);
+    return buffer;
+}
+
+auto Module::emit_object() -> GenericObject {
+    LCC_ASSERT(
+        _ctx->format()->format() == Format::ELF_OBJECT or _ctx->format()->format() == Format::COFF_OBJECT,
+        "Can only emit a module as an object in an object file format"
+    );
+
+    GenericObject object{};
+    emit({}, nullptr, &object);
+    return object;
+}
+
+void Module::emit(const std::filesystem::path& output_file_path, std::vector<u8>* buffer, GenericObject* object) {
+    const auto Append = [&](std::string_view text) {
+        buffer->insert(buffer->end(), text.begin(), text.end());
+    };
+
+    TimeReport::Timer timer{_ctx, "Code Generation"};
     switch (_ctx->format()->format()) {
         case Format::INVALID: LCC_UNREACHABLE();
 
         case Format::LCC_IR: {
-            // FIXME: Whoever made this only work on stdout is dumb.
-            fmt::print("; We are currently stupid about things and can only print IR to stdout (sorry)\n");
-            print_ir(false);
+            TimeReport::Timer emit_timer{_ctx, "Emission"};
+            if (buffer) Append(ir_string(false));
+            else WriteOutput(output_file_path, [&](std::FILE* file) { write_ir(file, false); });
         } break;
 
         case Format::LLVM_TEXTUAL_IR: {
-            auto llvm_ir = llvm();
-            if (output_file_path.empty() || output_file_path == "-")
-                fmt::print("{}", llvm_ir);
-            else File::WriteOrTerminate(llvm_ir.c_str(), llvm_ir.size(), output_file_path);
+            TimeReport::Timer emit_timer{_ctx, "Emission"};
+            if (buffer) Append(llvm());
+            else WriteOutput(output_file_path, [&](std::FILE* file) { write_llvm(file); });
+        } break;
+
+        case Format::LCC_BITCODE: {
+            TimeReport::Timer emit_timer{_ctx, "Emission"};
+            auto data = bitcode();
+            if (buffer) Append({data.data(), data.size()});
+            else if (output_file_path.empty() || output_file_path == "-")
+                std::fwrite(data.data(), 1, data.size(), stdout);
+            else File::WriteOrTerminate(data.data(), data.size(), output_file_path);
         } break;
 
         case Format::COFF_OBJECT:
         case Format::ELF_OBJECT:
         case Format::GNU_AS_ATT_ASSEMBLY: {
-            auto machine_ir = mir();
+            std::vector<MFunction> machine_ir{};
+            {
+                TimeReport::Timer mir_timer{_ctx, "MIR Generation"};
+                machine_ir = mir();
+                if (auto* mem = _ctx->mem_report()) CountMInstructions(mem, machine_ir);
+            }
+
+            // Collect what becomes of every function for the codegen report.
+            auto* codegen = _ctx->codegen_report();
+            std::vector<CodegenReport::Function> codegen_functions{};
+            if (codegen) {
+                codegen_functions.resize(machine_ir.size());
+                for (auto [i, function] : vws::enumerate(machine_ir)) {
+                    codegen_functions[usz(i)].name = function.names().at(0).name;
+                    codegen_functions[usz(i)].mir_instructions = function.instruction_count();
+                }
+            }
 
             if (_ctx->option_print_mir())
                 fmt::print("{}", PrintMIR(vars(), machine_ir));
 
-            for (auto& mfunc : machine_ir)
-                select_instructions(this, mfunc);
+            // Functions whose machine code is in the codegen cache are
+            // neither selected, allocated, nor encoded again; they are
+            // spliced into the object as they were cached. MIR generation
+            // may have added functions to the module, so look them up only
+            // now, when every function has a machine function at the same
+            // index.
+            std::optional<CodegenCache> cache{};
+            std::vector<std::string> cache_keys{};
+            std::vector<std::optional<x86_64::EncodedFunction>> encoded{};
+            std::vector<u8> cached(machine_ir.size());
+            if (
+                not _ctx->codegen_cache_directory().empty()
+                and _ctx->format()->format() != Format::GNU_AS_ATT_ASSEMBLY
+                and _ctx->target()->is_arch_x86_64()
+            ) {
+                TimeReport::Timer cache_timer{_ctx, "Codegen Cache Lookup"};
+                cache.emplace(_ctx, _ctx->codegen_cache_directory());
+                cache_keys.resize(machine_ir.size());
+                encoded.resize(machine_ir.size());
+                ParallelFor(machine_ir.size(), _ctx->option_jobs(), [&](usz i) {
+                    auto* function = code().at(i);
+                    if (function->blocks().empty()) return;
+                    cache_keys[i] = cache->key(function);
+                    encoded[i] = cache->lookup(cache_keys[i]);
+                    cached[i] = encoded[i].has_value();
+                });
+            }
+
+            // Functions are independent of one another from here until
+            // emission, so instruction selection and register allocation
+            // may run on several of them at once. Every function is
+            // written back into its own slot of machine_ir, so the output
+            // does not depend on the order in which they finish.
+            {
+                TimeReport::Timer isel_timer{_ctx, "Instruction Selection"};
+                ParallelFor(machine_ir.size(), _ctx->option_jobs(), [&](usz i) {
+                    if (cached[i]) return;
+                    Trace::Event event{isel_timer.event().trace(), "ISel Function"};
+                    select_instructions(this, machine_ir[i]);
+                    if (_ctx->target()->is_arch_x86_64()) x86_64::assign_stack_slots(machine_ir[i]);
+                    TraceMFunction(event, machine_ir[i]);
+                    if (codegen) codegen_functions[i].selected_instructions = machine_ir[i].instruction_count();
+                });
+                if (auto* mem = _ctx->mem_report()) CountMInstructions(mem, machine_ir);
+            }
 
             if (_ctx->option_print_mir()) {
                 fmt::print("\nAfter ISel\n");
@@ -354,40 +577,68 @@ void Module::emit(std::filesystem::path output_file_path) {
             }
 
             // Register Allocation
-            MachineDescription desc{};
-            if (_ctx->target()->is_arch_x86_64()) {
-                desc.return_register_to_replace = +x86_64::RegisterId::RETURN;
-                if (_ctx->target()->is_cconv_ms()) {
-                    desc.return_register = +x86_64::RegisterId::RAX;
-                    // Just the volatile registers
-                    desc.registers = {
-                        +x86_64::RegisterId::RAX,
-                        +x86_64::RegisterId::RCX,
-                        +x86_64::RegisterId::RDX,
-                        +x86_64::RegisterId::R8,
-                        +x86_64::RegisterId::R9,
-                        +x86_64::RegisterId::R10,
-                        +x86_64::RegisterId::R11,
-                    };
-                } else {
-                    desc.return_register = +x86_64::RegisterId::RAX;
-                    // Just the volatile registers
-                    desc.registers = {
-                        +x86_64::RegisterId::RAX,
-                        +x86_64::RegisterId::RCX,
-                        +x86_64::RegisterId::RDX,
-                        +x86_64::RegisterId::RSI,
-                        +x86_64::RegisterId::RDI,
-                        +x86_64::RegisterId::R8,
-                        +x86_64::RegisterId::R9,
-                        +x86_64::RegisterId::R10,
-                        +x86_64::RegisterId::R11,
-                    };
+            LCC_ASSERT(_ctx->target()->is_arch_x86_64(), "Sorry, unhandled target architecture");
+            auto desc = x86_64::machine_description(_ctx);
+            auto allocate = _ctx->option_register_allocator() == Context::LinearScanAllocator
+                              ? allocate_registers_linear_scan
+                              : allocate_registers;
+
+            {
+                TimeReport::Timer ra_timer{_ctx, "Register Allocation"};
+                std::vector<RegisterAllocationStats> ra_stats(machine_ir.size());
+                ParallelFor(machine_ir.size(), _ctx->option_jobs(), [&](usz i) {
+                    if (cached[i]) return;
+                    Trace::Event event{ra_timer.event().trace(), "RA Function"};
+                    auto stats = ra_stats[i] = allocate(desc, machine_ir[i]);
+                    TraceMFunction(event, machine_ir[i]);
+                    if (codegen) {
+                        auto& f = codegen_functions[i];
+                        auto frame = x86_64::stack_frame(desc, machine_ir[i]);
+                        f.virtual_registers = stats.virtual_registers;
+                        f.interference_edges = stats.interference_edges;
+                        f.removed_moves = stats.removed_moves;
+                        f.spills = stats.spills;
+                        f.frame_size = frame.locals_size + frame.saved_registers.size() * x86_64::GeneralPurposeBytewidth;
+                    }
+                    event.arg("spills", stats.spills);
+                    if (stats.spills) {
+                        Diag::Error("Can not color graph with {} colors until stack spilling is implemented!", desc.registers.size());
+                        Diag::Note("Allocating registers for function `{}`", machine_ir[i].names().at(0).name);
+                    }
+                });
+
+                if (auto* mem = _ctx->mem_report()) {
+                    usz virtual_registers = 0;
+                    usz interference_edges = 0;
+                    usz removed_moves = 0;
+                    for (auto& stats : ra_stats) {
+                        virtual_registers += stats.virtual_registers;
+                        interference_edges += stats.interference_edges;
+                        removed_moves += stats.removed_moves;
+                    }
+                    mem->count("virtual registers", virtual_registers);
+                    mem->count("interference edges", interference_edges);
+                    mem->count("removed moves", removed_moves);
+                    CountMInstructions(mem, machine_ir);
                 }
-            } else LCC_ASSERT(false, "Sorry, unhandled target architecture");
+            }
+
+            {
+                TimeReport::Timer peephole_timer{_ctx, "Peephole Optimisation"};
+                ParallelFor(machine_ir.size(), _ctx->option_jobs(), [&](usz i) {
+                    if (cached[i]) return;
+                    peephole_optimise(this, machine_ir[i]);
+                });
+            }
 
-            for (auto& mfunc : machine_ir)
-                allocate_registers(desc, mfunc);
+            {
+                TimeReport::Timer layout_timer{_ctx, "Block Layout"};
+                ParallelFor(machine_ir.size(), _ctx->option_jobs(), [&](usz i) {
+                    if (cached[i]) return;
+                    layout_blocks(machine_ir[i]);
+                    if (_ctx->target()->is_arch_x86_64()) x86_64::simplify_branches(machine_ir[i]);
+                });
+            }
 
             if (_ctx->option_print_mir()) {
                 fmt::print("\nAfter RA\n");
@@ -402,27 +653,56 @@ void Module::emit(std::filesystem::path output_file_path) {
                 }
             }
 
+            // Functions without blocks are imported and not generated, so
+            // leave them out of the report.
+            auto ReportCodegen = [&] {
+                if (not codegen) return;
+                std::vector<CodegenReport::Function> generated{};
+                for (auto [i, f] : vws::enumerate(codegen_functions))
+                    if (not machine_ir[usz(i)].blocks().empty()) generated.push_back(std::move(f));
+                codegen->add(std::move(generated));
+            };
+
             if (_ctx->option_stopat_mir()) std::exit(0);
 
+            TimeReport::Timer emit_timer{_ctx, "Emission"};
             if (_ctx->format()->format() == Format::GNU_AS_ATT_ASSEMBLY) {
-                if (_ctx->target()->is_arch_x86_64())
-                    x86_64::emit_gnu_att_assembly(output_file_path, this, desc, machine_ir);
-                else LCC_ASSERT(false, "Unhandled code emission target, sorry");
-            } else if (_ctx->format()->format() == Format::ELF_OBJECT) {
+                if (not _ctx->target()->is_arch_x86_64()) LCC_ASSERT(false, "Unhandled code emission target, sorry");
+                else if (buffer) x86_64::emit_gnu_att_assembly(*buffer, this, desc, machine_ir);
+                else x86_64::emit_gnu_att_assembly(output_file_path, this, desc, machine_ir);
+                ReportCodegen();
+            } else {
                 GenericObject gobj{};
+                std::vector<usz> function_sizes{};
                 if (_ctx->target()->is_arch_x86_64())
-                    gobj = x86_64::emit_mcode_gobj(this, desc, machine_ir);
+                    gobj = x86_64::emit_mcode_gobj(this, desc, machine_ir, codegen ? &function_sizes : nullptr, cache ? &encoded : nullptr);
                 else LCC_ASSERT(false, "Unhandled code emission target, sorry");
 
-                fmt::print("{}\n", gobj.print());
+                if (cache) {
+                    TimeReport::Timer cache_timer{_ctx, "Codegen Cache Store"};
+                    ParallelFor(machine_ir.size(), _ctx->option_jobs(), [&](usz i) {
+                        if (cached[i] or not encoded[i]) return;
+                        cache->store(cache_keys[i], *encoded[i]);
+                    });
+                }
+
+                for (auto [i, size] : vws::enumerate(function_sizes)) codegen_functions[usz(i)].code_size = size;
+                ReportCodegen();
 
-                FILE* f = fopen(output_file_path.string().data(), "wb");
-                if (not f) Diag::ICE("Could not open output file at {} for writing", output_file_path.string());
-                gobj.as_elf(f);
-                fclose(f);
+                if (object) {
+                    *object = std::move(gobj);
+                } else if (buffer) {
+                    if (_ctx->format()->format() == Format::COFF_OBJECT) gobj.as_coff(*buffer);
+                    else gobj.as_elf(*buffer);
+                } else {
+                    fmt::print("{}\n", gobj.print());
 
-            } else if (_ctx->format()->format() == Format::COFF_OBJECT) {
-                LCC_TODO("Emit COFF object from generic object format");
+                    FILE* f = fopen(output_file_path.string().data(), "wb");
+                    if (not f) Diag::ICE("Could not open output file at {} for writing", output_file_path.string());
+                    if (_ctx->format()->format() == Format::COFF_OBJECT) gobj.as_coff(f);
+                    else gobj.as_elf(f);
+                    fclose(f);
+                }
             }
         } break;
     }
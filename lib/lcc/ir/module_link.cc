@@ -0,0 +1,207 @@
+#include <lcc/context.hh>
+#include <lcc/diags.hh>
+#include <lcc/ir/ir.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/utils.hh>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+namespace {
+/// Whether a function or variable with a name of this linkage can be
+/// referred to by, or refers to, another module.
+auto IsGlobalLinkage(Linkage linkage) -> bool {
+    return IsExportedLinkage(linkage) or IsImportedLinkage(linkage);
+}
+
+/// Make every instruction that uses \p of use \p with instead.
+void ReplaceUses(UseTrackingValue* of, Value* with) {
+    std::vector<Inst*> users{of->users().begin(), of->users().end()};
+    for (auto* user : users)
+        user->replace_children([&](Value* child) -> Value* { return child == of ? with : nullptr; });
+}
+
+auto IsDefined(Function* f) -> bool {
+    return not f->blocks().empty();
+}
+
+auto IsDefined(GlobalVariable* var) -> bool {
+    return var->init() or rgs::any_of(var->names(), [](const IRName& n) {
+        return not IsImportedLinkage(n.linkage);
+    });
+}
+} // namespace
+
+void Module::link(std::unique_ptr<Module> other) {
+    LCC_ASSERT(other->_ctx == _ctx, "Cannot link modules of different contexts");
+
+    // Functions and variables share one namespace in the object file, so
+    // a name is taken if either of them uses it in either module.
+    auto Taken = [&](const std::string& name) {
+        for (auto* mod : {this, other.get()}) {
+            if (mod->_functions_by_name.find(name) != mod->_functions_by_name.end()) return true;
+            if (mod->_vars_by_name.find(name) != mod->_vars_by_name.end()) return true;
+        }
+        return false;
+    };
+
+    auto NamesOf = [](auto* value) -> std::vector<IRName>& {
+        if constexpr (std::is_same_v<std::remove_pointer_t<decltype(value)>, Function>) return value->func_names;
+        else return value->_names;
+    };
+
+    usz suffix = 0;
+    auto UniqueName = [&](const std::string& name) {
+        std::string unique{};
+        do unique = fmt::format("{}.{}", name, suffix++);
+        while (Taken(unique));
+        return unique;
+    };
+
+    // Rename a local function or variable of this module, so that the
+    // name it had can be used by one of the other module instead.
+    auto RenameOwn = [&](auto* value, auto& by_name, IRName& n) {
+        by_name.erase(n.name);
+        n.name = UniqueName(n.name);
+        by_name.try_emplace(n.name, value);
+    };
+
+    // Make the names of a function or variable of the other module that
+    // clash with local names in either module distinct, and find the one
+    // of this module it refers to or defines, if any.
+    auto Resolve = [&](std::vector<IRName>& names, auto& own_by_name, auto& other_kind_by_name) {
+        using ValueType = std::remove_pointer_t<typename std::remove_reference_t<decltype(own_by_name)>::mapped_type>;
+        ValueType* existing{};
+        for (auto& n : names) {
+            auto other_kind = other_kind_by_name.find(n.name);
+            auto own = own_by_name.find(n.name);
+            if (other_kind == other_kind_by_name.end() and own == own_by_name.end()) continue;
+
+            if (not IsGlobalLinkage(n.linkage)) {
+                n.name = UniqueName(n.name);
+                continue;
+            }
+
+            if (other_kind != other_kind_by_name.end()) {
+                auto& clash = *rgs::find(NamesOf(other_kind->second), n.name, &IRName::name);
+                if (IsGlobalLinkage(clash.linkage)) {
+                    Diag::Error(_ctx, {}, "`{}` is both a function and a variable", n.name);
+                    continue;
+                }
+                RenameOwn(other_kind->second, other_kind_by_name, clash);
+                continue;
+            }
+
+            auto& clash = *rgs::find(NamesOf(own->second), n.name, &IRName::name);
+            if (not IsGlobalLinkage(clash.linkage)) {
+                RenameOwn(own->second, own_by_name, clash);
+                continue;
+            }
+
+            existing = own->second;
+        }
+        return existing;
+    };
+
+    // Point everything that refers to the declaration `decl` of this
+    // module at the definition `def` of the other module instead.
+    auto Replace = [&](auto* decl, auto* def, auto& values, auto& by_name) {
+        ReplaceUses(decl, def);
+        *rgs::find(values, decl) = def;
+        for (const auto& n : NamesOf(decl)) by_name.erase(n.name);
+        for (const auto& n : NamesOf(def)) by_name.try_emplace(n.name, def);
+    };
+
+    // Every module has its own copy of the string literals it uses, but
+    // the linked module only needs one of each.
+    std::unordered_map<std::string_view, GlobalVariable*> strings{};
+    auto Contents = [](GlobalVariable* var) {
+        auto* array = as<ArrayConstant>(var->init());
+        return std::string_view{array->data(), array->size()};
+    };
+    for (auto* var : _vars)
+        if (var->is_mergeable_string()) strings.try_emplace(Contents(var), var);
+
+    for (auto* var : other->_vars) {
+        if (var->is_mergeable_string()) {
+            auto [it, inserted] = strings.try_emplace(Contents(var), var);
+            if (not inserted) {
+                ReplaceUses(var, it->second);
+                continue;
+            }
+        }
+
+        auto* existing = Resolve(var->_names, _vars_by_name, _functions_by_name);
+        if (not existing) {
+            add_var(var);
+            continue;
+        }
+
+        const auto& name = var->names().at(0).name;
+        if (existing->allocated_type() != var->allocated_type()) {
+            Diag::Error(
+                _ctx,
+                {},
+                "Conflicting types for variable `{}`: {} and {}",
+                name,
+                *existing->allocated_type(),
+                *var->allocated_type()
+            );
+        } else if (IsDefined(existing) and IsDefined(var)) {
+            Diag::Error(_ctx, {}, "Variable `{}` is defined in both {} and {}", name, _name, other->_name);
+        } else if (IsDefined(var)) {
+            Replace(existing, var, _vars, _vars_by_name);
+        } else {
+            ReplaceUses(var, existing);
+        }
+    }
+
+    for (auto* f : other->_code) {
+        f->mod = this;
+        auto* existing = Resolve(f->func_names, _functions_by_name, _vars_by_name);
+        if (not existing) {
+            add_function(f);
+            continue;
+        }
+
+        const auto& name = f->names().at(0).name;
+        if (existing->type() != f->type()) {
+            Diag::Error(
+                _ctx,
+                f->location(),
+                "Conflicting types for function `{}`: {} and {}",
+                name,
+                *existing->type(),
+                *f->type()
+            );
+        } else if (IsDefined(existing) and IsDefined(f)) {
+            Diag::Error(_ctx, f->location(), "Function `{}` is defined in both {} and {}", name, _name, other->_name);
+            Diag::Note(_ctx, existing->location(), "Other definition is here");
+        } else if (IsDefined(f)) {
+            Replace(existing, f, _code, _functions_by_name);
+        } else {
+            ReplaceUses(f, existing);
+        }
+    }
+
+    // Extra sections hold data about a module as a whole, which is only
+    // kept for the first module that has a section of any given name.
+    for (auto& section : other->_extra_sections) {
+        if (rgs::any_of(_extra_sections, [&](const Section& s) { return s.name == section.name; })) continue;
+        _extra_sections.push_back(std::move(section));
+    }
+
+    other->_code.clear();
+    other->_vars.clear();
+    other->_extra_sections.clear();
+    other->_functions_by_name.clear();
+    other->_vars_by_name.clear();
+    _linked_modules.push_back(std::move(other));
+}
+} // namespace lcc
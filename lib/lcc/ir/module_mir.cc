@@ -8,7 +8,7 @@
 #include <lcc/utils.hh>
 
 #include <algorithm>
-#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -77,6 +77,65 @@ constexpr auto ir_nary_inst_kind_to_mir(Value::Kind kind) -> MInst::Kind {
     }
     LCC_UNREACHABLE();
 }
+
+/// Whether a call is lowered to a jump to the callee after tearing down
+/// the frame of the caller rather than to a call. This is the case for
+/// direct tail calls whose result, if any, is returned right away, and
+/// that pass all of their arguments in registers, so that nothing is
+/// left on the stack of the caller for the callee to find.
+auto LowersToTailCall(Context* ctx, CallInst* call) -> bool {
+    if (not call->is_tail_call() or not is<Function>(call->callee())) return false;
+    if (not ctx->target()->is_arch_x86_64()) return false;
+
+    if (not call->next() or not is<ReturnInst>(call->next())) return false;
+    auto* ret = as<ReturnInst>(call->next());
+    if (ret->has_value() ? ret->val() != call : not call->type()->is_void()) return false;
+    if (call->type()->bytes() > x86_64::GeneralPurposeBytewidth) return false;
+
+    usz arg_regs = ctx->target()->is_platform_windows() ? 4 : cconv::sysv::arg_regs.size();
+    if (call->args().size() > arg_regs) return false;
+    return rgs::all_of(call->args(), [](Value* arg) {
+        return arg->type()->bytes() <= x86_64::GeneralPurposeBytewidth;
+    });
+}
+
+/// A register and how many bits of it are used.
+struct SizedRegister {
+    usz value;
+    uint bits;
+};
+
+/// The registers a parameter is passed in, one per eightbyte, or none
+/// if it is passed in memory.
+auto ParameterRegisters(Context* ctx, Function* function, Parameter* param) -> std::vector<SizedRegister> {
+    if (not ctx->target()->is_arch_x86_64()) return {};
+    if (ctx->target()->is_platform_windows()) {
+        constexpr std::array<x86_64::RegisterId, 4> reg_by_param_index{
+            x86_64::RegisterId::RCX,
+            x86_64::RegisterId::RDX,
+            x86_64::RegisterId::R8,
+            x86_64::RegisterId::R9 //
+        };
+        if (
+            param->type()->bytes() > x86_64::GeneralPurposeBytewidth
+            or param->index() >= reg_by_param_index.size()
+        ) return {};
+        return {{+reg_by_param_index.at(param->index()), uint(param->type()->bits())}};
+    }
+
+    if (not ctx->target()->is_cconv_sysv()) return {};
+    auto info = cconv::sysv::parameter_description(function).info.at(param->index());
+    if (info.kind != cconv::sysv::ParameterClass::REGISTER) return {};
+
+    std::vector<SizedRegister> registers{};
+    for (usz eightbyte = 0; eightbyte < info.arg_regs; eightbyte++) {
+        registers.push_back({
+            cconv::sysv::arg_regs.at(info.arg_regs_used + eightbyte),
+            cconv::sysv::eightbyte_bits(param->type(), eightbyte),
+        });
+    }
+    return registers;
+}
 } // namespace
 
 auto Module::mir() -> std::vector<MFunction> {
@@ -89,9 +148,12 @@ auto Module::mir() -> std::vector<MFunction> {
     // do is put the result of a certain computation in a specific register,
     // and then later, if you haven't done anything to clobber it, that result
     // will still be there. A virtual register is exactly that.
-    std::unordered_map<Value*, usz> virts{};
-    const auto assign_virtual_register = [&](Value* v) {
-        if (virts[v]) return; // don't double-assign registers
+    //
+    // Virtual registers are numbered per function, and each instruction
+    // keeps its own, so that looking one up is never more than a load.
+    const auto assign_virtual_register = [&](MFunction& f, Value* v) {
+        auto* inst = cast<Inst>(v);
+        if (not inst or inst->vreg()) return; // don't double-assign registers
         switch (v->kind()) {
             // Instructions that can never produce a value
             case Value::Kind::Store:
@@ -99,27 +161,25 @@ auto Module::mir() -> std::vector<MFunction> {
             case Value::Kind::CondBranch:
             case Value::Kind::Return:
             case Value::Kind::Unreachable:
-            // Non-instructions
-            case Value::Kind::Function:
-            case Value::Kind::Block:
-            case Value::Kind::IntegerConstant:
-            case Value::Kind::ArrayConstant:
-            case Value::Kind::Poison:
-            case Value::Kind::GlobalVariable:
-            case Value::Kind::Parameter:
                 return;
 
             default:
                 break;
         }
-        virts[v] = next_vreg();
+        inst->vreg(f.next_vreg());
     };
 
     // virtual register assignment
-    for (auto& function : code()) {
+    const auto assign_virtual_registers = [&](Function* function, MFunction& f) {
+        // Clear registers left over from a previous run first; operands may
+        // come from blocks we haven't visited yet.
+        for (auto& block : function->blocks())
+            for (auto* instruction : block->instructions())
+                instruction->vreg(0);
+
         for (auto& block : function->blocks()) {
-            for (auto& instruction : block->instructions()) {
-                assign_virtual_register(instruction);
+            for (auto* instruction : block->instructions()) {
+                assign_virtual_register(f, instruction);
                 switch (instruction->kind()) {
                     // Non-instructions
                     case Value::Kind::Function:
@@ -140,35 +200,35 @@ auto Module::mir() -> std::vector<MFunction> {
                         break;
 
                     case Value::Kind::Copy:
-                        assign_virtual_register(as<CopyInst>(instruction)->operand());
+                        assign_virtual_register(f, as<CopyInst>(instruction)->operand());
                         break;
 
                     case Value::Kind::CondBranch:
-                        assign_virtual_register(as<CondBranchInst>(instruction)->cond());
+                        assign_virtual_register(f, as<CondBranchInst>(instruction)->cond());
                         break;
 
                     case Value::Kind::Return: {
                         auto* ret = as<ReturnInst>(instruction);
-                        if (ret->has_value()) assign_virtual_register(ret->val());
+                        if (ret->has_value()) assign_virtual_register(f, ret->val());
                     } break;
 
                     case Value::Kind::Call: {
                         auto* call = as<CallInst>(instruction);
-                        assign_virtual_register(call->callee());
+                        assign_virtual_register(f, call->callee());
                         for (auto& arg : call->args())
-                            assign_virtual_register(arg);
+                            assign_virtual_register(f, arg);
                     } break;
 
                     case Value::Kind::GetElementPtr: {
                         auto* gep = as<GEPInst>(instruction);
-                        assign_virtual_register(gep->ptr());
-                        assign_virtual_register(gep->idx());
+                        assign_virtual_register(f, gep->ptr());
+                        assign_virtual_register(f, gep->idx());
                     } break;
 
                     case Value::Kind::GetMemberPtr: {
                         auto* gmp = as<GetMemberPtrInst>(instruction);
-                        assign_virtual_register(gmp->ptr());
-                        assign_virtual_register(gmp->idx());
+                        assign_virtual_register(f, gmp->ptr());
+                        assign_virtual_register(f, gmp->idx());
                     } break;
 
                     case Value::Kind::Intrinsic:
@@ -176,19 +236,19 @@ auto Module::mir() -> std::vector<MFunction> {
                         break;
 
                     case Value::Kind::Load: {
-                        assign_virtual_register(as<LoadInst>(instruction)->ptr());
+                        assign_virtual_register(f, as<LoadInst>(instruction)->ptr());
                     } break;
 
                     case Value::Kind::Store: {
                         auto* store = as<StoreInst>(instruction);
-                        assign_virtual_register(store->ptr());
-                        assign_virtual_register(store->val());
+                        assign_virtual_register(f, store->ptr());
+                        assign_virtual_register(f, store->val());
                     } break;
 
                     case Value::Kind::Phi: {
                         for (auto phi_operand : as<PhiInst>(instruction)->operands()) {
                             // phi_operand.block handled, or will be handled, in block iteration above.
-                            assign_virtual_register(phi_operand.value);
+                            assign_virtual_register(f, phi_operand.value);
                         }
                     } break;
 
@@ -200,7 +260,7 @@ auto Module::mir() -> std::vector<MFunction> {
                     case Value::Kind::Neg:
                     case Value::Kind::Compl: {
                         auto* unary = as<UnaryInstBase>(instruction);
-                        assign_virtual_register(unary->operand());
+                        assign_virtual_register(f, unary->operand());
                     } break;
 
                     // Binary
@@ -228,35 +288,72 @@ auto Module::mir() -> std::vector<MFunction> {
                     case Value::Kind::UGt:
                     case Value::Kind::UGe: {
                         auto* binary = as<BinaryInst>(instruction);
-                        assign_virtual_register(binary->lhs());
-                        assign_virtual_register(binary->rhs());
+                        assign_virtual_register(f, binary->lhs());
+                        assign_virtual_register(f, binary->rhs());
                     } break;
                 }
             }
         }
-    }
+    };
 
     // Generate MIR
     std::vector<MFunction> funcs{};
 
+    // Where the machine instruction that defines each virtual register of the
+    // function being generated is, indexed by virtual register. Generating
+    // MIR only ever appends instructions to the current block, so the
+    // instructions lowered from each IR instruction are recorded once it is
+    // done. The index may be stale if instructions were removed since.
+    struct MInstPosition {
+        MBlock* block{};
+        usz index{};
+    };
+    std::vector<MInstPosition> minst_positions{};
+
+    // Record the machine instructions added to a block since `from`.
+    const auto RecordMInstPositions = [&](MBlock& bb, usz& from) {
+        auto& instructions = bb.instructions();
+        for (usz index = std::min(from, instructions.size()); index < instructions.size(); ++index) {
+            auto reg = instructions[index].reg();
+            if (reg < +MInst::Kind::ArchStart) continue;
+            auto slot = reg - +MInst::Kind::ArchStart;
+            if (slot >= minst_positions.size()) minst_positions.resize(slot + 1);
+            if (not minst_positions[slot].block) minst_positions[slot] = {&bb, index};
+        }
+        from = instructions.size();
+    };
+
     // Find machine instruction based on virtual register.
     const auto MInstByVirtualRegister = [&](usz virtual_register) -> MInst* {
-        for (auto& mfunc : funcs) {
-            for (auto& mblock : mfunc.blocks()) {
-                for (auto& instruction : mblock.instructions()) {
-                    if (instruction.reg() == virtual_register)
-                        return &instruction;
-                }
-            }
-        }
+        if (virtual_register < +MInst::Kind::ArchStart) return nullptr;
+        auto slot = virtual_register - +MInst::Kind::ArchStart;
+        if (slot >= minst_positions.size() or not minst_positions[slot].block) return nullptr;
+
+        auto [block, index] = minst_positions[slot];
+        auto& instructions = block->instructions();
+        if (index < instructions.size() and instructions[index].reg() == virtual_register)
+            return &instructions[index];
+        for (auto& instruction : instructions)
+            if (instruction.reg() == virtual_register)
+                return &instruction;
         return nullptr;
     };
 
+    // Get the virtual register of a value, or zero if it has none.
+    const auto VirtualRegister = [](Value* v) -> usz {
+        auto* inst = cast<Inst>(v);
+        return inst ? inst->vreg() : 0;
+    };
+
+    // The registers that hold each parameter of the function being generated,
+    // one per eightbyte; empty for parameters passed in memory.
+    std::vector<std::vector<SizedRegister>> parameter_registers{};
+
     // Handle inlining of values into operands vs using register references.
     const auto MOperandValueReference = [&](Function* f_ir, MFunction& f, Value* v) -> MOperand {
         // Find MInst if possible, add to use count.
         usz regsize{0};
-        if (auto* inst = MInstByVirtualRegister(virts[v])) {
+        if (auto* inst = MInstByVirtualRegister(VirtualRegister(v))) {
             inst->add_use();
             regsize = inst->regsize();
         }
@@ -277,84 +374,30 @@ auto Module::mir() -> std::vector<MFunction> {
                 // specific cases where we want to handle over-large values, we will.
                 // Otherwise, this will handle the general case of single-register
                 // parameters and memory parameters being referenced.
+                auto& registers = parameter_registers.at(param->index());
+                if (not registers.empty()) {
+                    LCC_ASSERT(
+                        registers.size() == 1,
+                        "Cannot handle multiple register parameter in this way"
+                    );
+                    return MOperandRegister(registers.front().value, registers.front().bits);
+                }
+
                 if (_ctx->target()->is_arch_x86_64()) {
                     if (_ctx->target()->is_platform_windows()) {
-                        constexpr std::array<x86_64::RegisterId, 4> reg_by_param_index{
-                            x86_64::RegisterId::RCX,
-                            x86_64::RegisterId::RDX,
-                            x86_64::RegisterId::R8,
-                            x86_64::RegisterId::R9 //
-                        };
-                        if (
-                            param->type()->bytes() <= x86_64::GeneralPurposeBytewidth
-                            and param->index() < reg_by_param_index.size()
-                        ) {
-                            return MOperandRegister(
-                                +reg_by_param_index.at(param->index()),
-                                uint(param->type()->bits())
-                            );
-                        }
-
                         LCC_ASSERT(false, "TODO: Handle x64cc memory parameter");
 
                     } else if (_ctx->target()->is_cconv_sysv()) {
-                        usz sysv_registers_used = 0;
-                        i32 sysv_memory_parameter_offset = 0;
-                        for (usz i = 0; i < param->index(); ++i) {
-                            auto* p = f_ir->param(i);
-                            if (
-                                p->type()->bytes() <= x86_64::GeneralPurposeBytewidth
-                                and sysv_registers_used < cconv::sysv::arg_regs.size()
-                            )
-                                ++sysv_registers_used;
-                            else if (
-                                p->type()->bytes() <= 2 * x86_64::GeneralPurposeBytewidth
-                                and sysv_registers_used < cconv::sysv::arg_regs.size() - 1
-                            ) {
-                                sysv_registers_used += 2;
-                            } else {
-                                // TODO: Take alignment into consideration.
-                                sysv_memory_parameter_offset += i32(p->type()->bytes());
-                            }
-                        }
-
-                        static constexpr std::array<x86_64::RegisterId, 6> reg_by_param_index{
-                            x86_64::RegisterId::RDI,
-                            x86_64::RegisterId::RSI,
-                            x86_64::RegisterId::RDX,
-                            x86_64::RegisterId::RCX,
-                            x86_64::RegisterId::R8,
-                            x86_64::RegisterId::R9 //
-                        };
-
-                        // Single register parameter
-                        if (
-                            param->type()->bytes() <= x86_64::GeneralPurposeBytewidth
-                            and sysv_registers_used < cconv::sysv::arg_regs.size()
-                        ) {
-                            return MOperandRegister(
-                                +reg_by_param_index.at(sysv_registers_used),
-                                uint(param->type()->bits())
-                            );
-                        }
-                        // Multiple register parameter
-                        if (
-                            param->type()->bytes() <= 2 * x86_64::GeneralPurposeBytewidth
-                            and sysv_registers_used < cconv::sysv::arg_regs.size() - 1
-                        )
-                            LCC_ASSERT(false, "Cannot handle multiple register parameter in this way");
-                        else {
-                            // Return Local with positive offset into parent stack frame.
-                            // To get the actual offset, we need to know how many memory parameters
-                            // come before this parameter, as well as their size (and alignment, I'd
-                            // think).
-                            i32 offset = 2 * x86_64::GeneralPurposeBytewidth;
-                            offset += sysv_memory_parameter_offset;
-                            return MOperandLocal(
-                                MOperandLocal::absolute_index,
-                                offset
-                            );
-                        }
+                        auto description = cconv::sysv::parameter_description(f_ir).info.at(param->index());
+
+                        // Return Local with positive offset into parent stack frame,
+                        // past the return address and the saved frame pointer.
+                        i32 offset = 2 * x86_64::GeneralPurposeBytewidth;
+                        offset += i32(description.stack_byte_offset);
+                        return MOperandLocal(
+                            MOperandLocal::absolute_index,
+                            offset
+                        );
                     }
                 }
                 Diag::ICE("It appears we haven't handled the target properly, sorry");
@@ -431,13 +474,22 @@ auto Module::mir() -> std::vector<MFunction> {
             case Value::Kind::UGe:
                 break;
         }
-        return MOperandRegister{virts[v], uint(regsize)};
+        return MOperandRegister{VirtualRegister(v), uint(regsize)};
     };
 
     // NOTE: We cannot add functions to the IR while iterating over them (use-
     // after-free nightmare), so, please, do not alter the IR in the main loop
     // that generates MIR, for here there be dragons.
 
+    // Copies and fills of a constant number of bytes up to this size are
+    // expanded into loads and stores instead of calls to memcpy/memset;
+    // most of these are struct copies, which are small.
+    static constexpr usz InlineMemoryIntrinsicMaxBytes = 64;
+    const auto IsInlinedMemoryIntrinsic = [](IntrinsicInst* intrinsic) {
+        auto* size = cast<IntegerConstant>(intrinsic->operands().at(2));
+        return size and size->value().value() <= InlineMemoryIntrinsicMaxBytes;
+    };
+
     // TODO: if memcpy already in module, use that
     auto* memcpy_ty = FunctionType::Get(
         _ctx,
@@ -454,15 +506,101 @@ auto Module::mir() -> std::vector<MFunction> {
         CallConv::C
     );
 
+    // Only declare memset if something calls it, so that it doesn't end up
+    // in the symbol table of every object file.
+    Function* memset_function{};
+    const auto UsesMemSet = [&](Function* function) {
+        return rgs::any_of(function->blocks(), [&](Block* block) {
+            return rgs::any_of(block->instructions(), [&](Inst* inst) {
+                return is<IntrinsicInst>(inst)
+                   and as<IntrinsicInst>(inst)->intrinsic_kind() == IntrinsicKind::MemSet
+                   and not IsInlinedMemoryIntrinsic(as<IntrinsicInst>(inst));
+            });
+        });
+    };
+    if (rgs::any_of(code(), UsesMemSet)) {
+        auto* memset_ty = FunctionType::Get(
+            _ctx,
+            Type::VoidTy,
+            {Type::PtrTy,
+             IntegerType::Get(_ctx, 32),
+             IntegerType::Get(_ctx, 32)}
+        );
+        memset_function = new (*this) Function(
+            this,
+            "memset",
+            memset_ty,
+            Linkage::Imported,
+            CallConv::C
+        );
+    }
+
+    // Split a copy or fill of `bytes` bytes into the widest loads and
+    // stores that fit, and call `chunk(offset, bits)` for each of them.
+    const auto ForEachMemoryChunk = [](usz bytes, auto chunk) {
+        usz offset = 0;
+        while (offset < bytes) {
+            usz width = x86_64::GeneralPurposeBytewidth;
+            while (width > bytes - offset) width /= 2;
+            chunk(offset, uint(width * 8));
+            offset += width;
+        }
+    };
+
+    // Get an operand that can be used as the base address of the loads and
+    // stores of an inlined memory intrinsic. Locals are accessed relative to
+    // the frame pointer directly; anything else is put in a register first.
+    const auto MemoryIntrinsicBase = [&](Function* f_ir, MFunction& f, MBlock& bb, IntrinsicInst* intrinsic, Value* ptr) -> MOperand {
+        auto op = MOperandValueReference(f_ir, f, ptr);
+        if (std::holds_alternative<MOperandRegister>(op)) return op;
+        if (
+            std::holds_alternative<MOperandLocal>(op)
+            and std::get<MOperandLocal>(op).index != MOperandLocal::absolute_index
+        ) return op;
+
+        // A pointer passed in memory has to be loaded; a global's address is
+        // taken.
+        auto kind = std::holds_alternative<MOperandLocal>(op) ? MInst::Kind::Load : MInst::Kind::Copy;
+        auto base = MInst(kind, {f.next_vreg(), x86_64::GeneralPurposeBitwidth});
+        base.location(intrinsic->location());
+        base.add_operand(op);
+        base.add_use();
+        bb.add_instruction(base);
+        return MOperandRegister(base.reg(), uint(base.regsize()));
+    };
+
+    // Add the address `offset` bytes past `base` to a load or store, in the
+    // form the instruction selector expects.
+    const auto AddMemoryIntrinsicAddress = [](MInst& inst, MOperand base, usz offset) {
+        if (std::holds_alternative<MOperandLocal>(base)) {
+            auto local = std::get<MOperandLocal>(base);
+            inst.add_operand(MOperandLocal{local.index, local.offset + i32(offset)});
+            return;
+        }
+
+        inst.add_operand(base);
+        if (offset) inst.add_operand(MOperandImmediate(offset, 32));
+    };
+
     // To avoid iterator invalidation when any of these vectors are resizing,
     // we "pre-construct" functions and blocks.
     for (auto& function : code()) {
+        // Vectors only ever live in vector registers, which no calling
+        // convention we lower passes anything in yet; the parser rejects
+        // such signatures.
+        auto* function_type = as<FunctionType>(function->type());
+        if (
+            is<VectorType>(function_type->ret())
+            or rgs::any_of(function_type->params(), [](Type* t) { return is<VectorType>(t); })
+        ) Diag::ICE("Function '{}' takes or returns a vector, which is not supported yet", function->names().at(0).name);
+
         funcs.emplace_back(function->call_conv());
         auto& f = funcs.back();
         f.names() = function->names();
         f.location(function->location());
         for (auto& block : function->blocks())
             f.add_block(MBlock(block->name()));
+        assign_virtual_registers(function, f);
     }
 
     // Now that the vectors won't be resizing, we can put MFunction and MBlock
@@ -476,14 +614,48 @@ auto Module::mir() -> std::vector<MFunction> {
         for (auto [block_index, block] : vws::enumerate(function->blocks())) {
             auto& bb = f.blocks().at(usz(block_index));
             block->machine_block(&bb);
+            bb.profile_count(block->profile_count());
         }
     }
 
     for (auto [f_index, function] : vws::enumerate(code())) {
         auto& f = funcs.at(usz(f_index));
+        minst_positions.assign(f.vreg_end() - +MInst::Kind::ArchStart, {});
+
+        // Parameters passed in registers are copied into virtual registers
+        // before anything else, as the register allocator only knows how
+        // long virtual registers live; were the hardware registers used
+        // throughout the function, it might hand them out while they still
+        // hold a parameter. This does not work if the entry block can be
+        // branched to, in which case the hardware registers are used.
+        parameter_registers.clear();
+        bool copy_parameters = not function->blocks().empty() and function->entry()->predecessor_count() == 0;
+        for (auto* param : function->params()) {
+            auto& registers = parameter_registers.emplace_back(ParameterRegisters(_ctx, function, param));
+            if (not copy_parameters or param->users().empty()) continue;
+            for (auto& reg : registers) {
+                auto vreg = f.next_vreg();
+
+                // Until a parameter register is copied, it must not be assigned
+                // to any of the copies made before it. It is not actually
+                // clobbered here, but saying so has exactly that effect.
+                auto copy = MInst(+x86_64::Opcode::Move, {0, 0});
+                copy.location(function->location());
+                copy.add_operand(MOperandRegister(reg.value, reg.bits));
+                copy.add_operand(MOperandRegister(vreg, reg.bits));
+                copy.add_operand_clobber(0);
+                copy.add_operand_clobber(1);
+                f.blocks().front().add_instruction(std::move(copy));
+                reg.value = vreg;
+            }
+        }
+
         for (auto [block_index, block] : vws::enumerate(function->blocks())) {
             auto& bb = f.blocks().at(usz(block_index));
-            for (auto& instruction : block->instructions()) {
+            bb.instructions().reserve(block->instructions().size());
+            usz recorded = 0;
+            for (auto* instruction : block->instructions()) {
+                RecordMInstPositions(bb, recorded);
                 switch (instruction->kind()) {
                     // Non-instructions
                     case Value::Kind::Function:
@@ -500,11 +672,11 @@ auto Module::mir() -> std::vector<MFunction> {
                         auto* copy_ir = as<CopyInst>(instruction);
                         auto copy = MInst(
                             MInst::Kind::Copy,
-                            {virts[instruction], uint(copy_ir->type()->bits())}
+                            {instruction->vreg(), uint(copy_ir->type()->bits())}
                         );
                         copy.location(copy_ir->location());
                         copy.add_operand(MOperandValueReference(function, f, copy_ir->operand()));
-                        bb.add_instruction(copy);
+                        bb.add_instruction(std::move(copy));
                     } break;
 
                     // Inlined
@@ -524,14 +696,20 @@ auto Module::mir() -> std::vector<MFunction> {
 
                         auto phi = MInst(
                             MInst::Kind::Phi,
-                            {virts[instruction], uint(phi_ir->type()->bits())}
+                            {instruction->vreg(), uint(phi_ir->type()->bits())}
                         );
                         phi.location(phi_ir->location());
                         for (const auto& op : phi_ir->operands()) {
                             phi.add_operand(MOperandValueReference(function, f, op.block));
+                            // Any value will do where a poison value comes in, but
+                            // the register must still be defined on that edge.
+                            if (is<PoisonValue>(op.value)) {
+                                phi.add_operand(MOperandImmediate(0, uint(phi_ir->type()->bits())));
+                                continue;
+                            }
                             phi.add_operand(MOperandValueReference(function, f, op.value));
                         }
-                        bb.add_instruction(phi);
+                        bb.add_instruction(std::move(phi));
                     } break;
 
                     case Value::Kind::Call: {
@@ -558,7 +736,7 @@ auto Module::mir() -> std::vector<MFunction> {
                                         );
                                         copy.location(call_ir->location());
                                         copy.add_operand(MOperandValueReference(function, f, arg));
-                                        bb.add_instruction(copy);
+                                        bb.add_instruction(std::move(copy));
                                     } else {
                                         // Basically, if an argument is over-large, we allocate a copy on the
                                         // stack (that way the caller can modify without doing bad bad), and then
@@ -574,177 +752,162 @@ auto Module::mir() -> std::vector<MFunction> {
                                 }
 
                             } else if (_ctx->target()->is_cconv_sysv()) {
-                                // Handle all arguments that are passed in memory first, before register arguments.
-                                usz arg_regs_used = 0;
-                                for (auto [arg_i, arg] : vws::enumerate(call_ir->args())) {
-                                    if (
-                                        arg_regs_used < cconv::sysv::arg_regs.size()
-                                        and arg->type()->bytes() <= x86_64::GeneralPurposeBytewidth
-                                    )
-                                        ++arg_regs_used;
-
-                                    else if (
-                                        arg_regs_used < cconv::sysv::arg_regs.size() - 1
-                                        and arg->type()->bytes() <= 2 * x86_64::GeneralPurposeBytewidth
-                                    )
-                                        arg_regs_used += 2;
-
-                                    else {
-                                        // Memory parameter
-                                        // Basically just allocate a temporary on the stack, memcpy (or similar)
-                                        // into that.
-
-                                        // Remove the original argument; we will be building it by hand.
-                                        auto arg_mir = MOperandValueReference(function, f, arg);
-                                        LCC_ASSERT(std::holds_alternative<MOperandRegister>(arg_mir));
-                                        auto arg_reg = std::get<MOperandRegister>(arg_mir);
-                                        bb.remove_inst_by_reg(arg_reg.value);
-
-                                        // Get a reference to a pointer to the argument.
-                                        Value* arg_ptr{nullptr};
-                                        if (auto* load = cast<LoadInst>(arg))
-                                            arg_ptr = load->ptr();
-                                        else if (auto* alloca = cast<AllocaInst>(arg))
-                                            arg_ptr = alloca;
-                                        else LCC_ASSERT(
-                                            false,
-                                            "Memory argument must be prepared such that MIR generation may fetch the pointer (i.e. a LoadInst or AllocaInst).\n"
-                                            "This allows us to copy from the pointer (load operand) onto the stack."
-                                        );
+                                using cconv::sysv::ParameterClass;
+                                auto description = cconv::sysv::parameter_description(call_ir);
+
+                                // Handle all arguments that are passed in memory first, before register
+                                // arguments, since copying them clobbers the argument registers. The
+                                // first one ends up at the lowest address, so go backwards.
+                                for (usz arg_i = call_ir->args().size(); arg_i-- > 0;) {
+                                    auto* arg = call_ir->args().at(arg_i);
+                                    const auto& info = description.info.at(arg_i);
+                                    if (info.kind != ParameterClass::MEMORY) continue;
+
+                                    // Memory parameter
+                                    // Basically just allocate a temporary on the stack, memcpy (or similar)
+                                    // into that.
+
+                                    // Remove the original argument; we will be building it by hand.
+                                    auto arg_mir = MOperandValueReference(function, f, arg);
+                                    LCC_ASSERT(std::holds_alternative<MOperandRegister>(arg_mir));
+                                    auto arg_reg = std::get<MOperandRegister>(arg_mir);
+                                    bb.remove_inst_by_reg(arg_reg.value);
+
+                                    // Get a reference to a pointer to the argument.
+                                    Value* arg_ptr{nullptr};
+                                    if (auto* load = cast<LoadInst>(arg))
+                                        arg_ptr = load->ptr();
+                                    else if (auto* alloca = cast<AllocaInst>(arg))
+                                        arg_ptr = alloca;
+                                    else LCC_ASSERT(
+                                        false,
+                                        "Memory argument must be prepared such that MIR generation may fetch the pointer (i.e. a LoadInst or AllocaInst).\n"
+                                        "This allows us to copy from the pointer (load operand) onto the stack."
+                                    );
 
-                                        auto byte_count = arg->type()->bytes();
+                                    auto byte_count = arg->type()->bytes();
 
-                                        // sub $<size>, %rsp
-                                        constexpr Register stack_pointer_reg{+x86_64::RegisterId::RSP, 64};
-                                        auto sub = MInst(MInst::Kind::Sub, stack_pointer_reg);
-                                        sub.location(call_ir->location());
-                                        sub.add_operand(stack_pointer_reg);
-                                        sub.add_operand(MOperandImmediate(byte_count));
-                                        bb.add_instruction(sub);
+                                    // sub $<size>, %rsp
+                                    constexpr Register stack_pointer_reg{+x86_64::RegisterId::RSP, 64};
+                                    auto sub = MInst(MInst::Kind::Sub, stack_pointer_reg);
+                                    sub.location(call_ir->location());
+                                    sub.add_operand(stack_pointer_reg);
+                                    sub.add_operand(MOperandImmediate(info.stack_bytes));
+                                    bb.add_instruction(std::move(sub));
 
-                                        // Record stack subtraction so we can undo it after the call
-                                        arg_stack_bytes_used += byte_count;
+                                    // Record stack subtraction so we can undo it after the call
+                                    arg_stack_bytes_used += info.stack_bytes;
 
-                                        // Copy from arg into stack pointer
+                                    // Copy from arg into stack pointer
 
-                                        // TODO: If memcpy sets return register we may end up having a bad time.
+                                    // TODO: If memcpy sets return register we may end up having a bad time.
 
-                                        { // Destination argument (stack pointer)
-                                            auto copy = MInst(MInst::Kind::Copy, {cconv::sysv::arg_regs[0], 64});
-                                            copy.location(call_ir->location());
-                                            copy.add_operand(stack_pointer_reg);
-                                            bb.add_instruction(copy);
-                                        }
-                                        { // Source argument
-                                            auto copy = MInst(MInst::Kind::Copy, {cconv::sysv::arg_regs[1], 64});
-                                            copy.location(call_ir->location());
-                                            copy.add_operand(MOperandValueReference(function, f, arg_ptr));
-                                            bb.add_instruction(copy);
-                                        }
-                                        { // Size argument
-                                            auto copy = MInst(MInst::Kind::Copy, {cconv::sysv::arg_regs[2], 64});
-                                            copy.location(call_ir->location());
-                                            copy.add_operand(MOperandImmediate(byte_count));
-                                            bb.add_instruction(copy);
-                                        }
-
-                                        auto call = MInst(
-                                            MInst::Kind::Call,
-                                            {usz(x86_64::RegisterId::RETURN), 0}
-                                        );
-                                        call.location(call_ir->location());
-                                        call.add_operand(memcpy_function);
-                                        bb.add_instruction(call);
+                                    { // Destination argument (stack pointer)
+                                        auto copy = MInst(MInst::Kind::Copy, {cconv::sysv::arg_regs[0], 64});
+                                        copy.location(call_ir->location());
+                                        copy.add_operand(stack_pointer_reg);
+                                        bb.add_instruction(std::move(copy));
+                                    }
+                                    { // Source argument
+                                        auto copy = MInst(MInst::Kind::Copy, {cconv::sysv::arg_regs[1], 64});
+                                        copy.location(call_ir->location());
+                                        copy.add_operand(MOperandValueReference(function, f, arg_ptr));
+                                        bb.add_instruction(std::move(copy));
+                                    }
+                                    { // Size argument
+                                        auto copy = MInst(MInst::Kind::Copy, {cconv::sysv::arg_regs[2], 64});
+                                        copy.location(call_ir->location());
+                                        copy.add_operand(MOperandImmediate(byte_count));
+                                        bb.add_instruction(std::move(copy));
                                     }
+
+                                    auto call = MInst(
+                                        MInst::Kind::Call,
+                                        {usz(x86_64::RegisterId::RETURN), 0}
+                                    );
+                                    call.location(call_ir->location());
+                                    call.add_operand(memcpy_function);
+                                    bb.add_instruction(std::move(call));
                                 }
 
-                                arg_regs_used = 0;
                                 for (auto [arg_i, arg] : vws::enumerate(call_ir->args())) {
-                                    if (
-                                        arg_regs_used < cconv::sysv::arg_regs.size()
-                                        and arg->type()->bytes() <= x86_64::GeneralPurposeBytewidth
-                                    ) {
+                                    const auto& info = description.info.at(usz(arg_i));
+                                    if (info.kind != ParameterClass::REGISTER) continue;
+
+                                    if (info.arg_regs <= 1) {
                                         // TODO: May have to quantize arg->type()->bits() to 8, 16, 32, 64
                                         auto copy = MInst(
                                             MInst::Kind::Copy,
-                                            {cconv::sysv::arg_regs.at(arg_regs_used++), uint(arg->type()->bits())}
+                                            {cconv::sysv::arg_regs.at(info.arg_regs_used), uint(arg->type()->bits())}
                                         );
                                         copy.location(call_ir->location());
                                         copy.add_operand(MOperandValueReference(function, f, arg));
-                                        bb.add_instruction(copy);
-                                    } else if (
-                                        arg_regs_used < cconv::sysv::arg_regs.size() - 1
-                                        and arg->type()->bytes() <= 2 * x86_64::GeneralPurposeBytewidth
-                                    ) {
-                                        auto load_a = MInst(
-                                            MInst::Kind::Load,
-                                            {
-                                                cconv::sysv::arg_regs.at(arg_regs_used++),
-                                                x86_64::GeneralPurposeBitwidth //
-                                            }
-                                        );
-                                        auto load_b = MInst(
+                                        bb.add_instruction(std::move(copy));
+                                        continue;
+                                    }
+
+                                    // Load each eightbyte of the aggregate straight from wherever
+                                    // it lives into its register.
+                                    Value* arg_ptr{nullptr};
+                                    if (auto* load_arg = cast<LoadInst>(arg)) {
+                                        arg_ptr = load_arg->ptr();
+
+                                        // In doing the copying and stuff, we have effectively loaded the thing
+                                        // manually. So, we remove the load that was there before.
+                                        bb.remove_inst_by_reg(load_arg->vreg());
+                                    } else if (is<AllocaInst>(arg)) {
+                                        arg_ptr = arg;
+                                    } else {
+                                        arg->print();
+                                        LCC_ASSERT(false, "Handle gMIR lowering of SysV multiple register argument");
+                                    }
+
+                                    for (usz eightbyte = 0; eightbyte < info.arg_regs; ++eightbyte) {
+                                        auto load = MInst(
                                             MInst::Kind::Load,
                                             {
-                                                cconv::sysv::arg_regs.at(arg_regs_used++),
-                                                uint(arg->type()->bits() - x86_64::GeneralPurposeBitwidth) //
+                                                cconv::sysv::arg_regs.at(info.arg_regs_used + eightbyte),
+                                                cconv::sysv::eightbyte_bits(arg->type(), eightbyte) //
                                             }
                                         );
-                                        load_a.location(call_ir->location());
-                                        load_b.location(call_ir->location());
-
-                                        if (auto* load_arg = cast<LoadInst>(arg)) {
-                                            if (auto* alloca = cast<AllocaInst>(load_arg->ptr())) {
-                                                load_a.add_operand(MOperandValueReference(function, f, alloca));
-
-                                                auto add_b = MInst(
-                                                    MInst::Kind::Add,
-                                                    {next_vreg(), x86_64::GeneralPurposeBitwidth}
-                                                );
-                                                add_b.location(call_ir->location());
-                                                add_b.add_operand(MOperandValueReference(function, f, alloca));
-                                                add_b.add_operand(MOperandImmediate(x86_64::GeneralPurposeBytewidth, 32));
-
-                                                load_b.add_operand(MOperandRegister(add_b.reg(), uint(add_b.regsize())));
-                                                bb.add_instruction(add_b);
-
-                                                // In doing the copying and stuff, we have effectively loaded the thing
-                                                // manually. So, we remove the load that was there before.
-                                                bb.remove_inst_by_reg(virts[load_arg]);
+                                        load.location(call_ir->location());
 
-                                            } else LCC_ASSERT(false, "TODO: Create a temporary, store into it, and then treat argument like any other alloca.");
-                                        } else if (arg->kind() == Value::Kind::Alloca) {
-                                            load_a.add_operand(MOperandValueReference(function, f, arg));
-
-                                            auto add_b = MInst(
+                                        if (eightbyte == 0) load.add_operand(MOperandValueReference(function, f, arg_ptr));
+                                        else {
+                                            auto add = MInst(
                                                 MInst::Kind::Add,
-                                                {next_vreg(), x86_64::GeneralPurposeBitwidth}
+                                                {f.next_vreg(), x86_64::GeneralPurposeBitwidth}
                                             );
-                                            add_b.location(call_ir->location());
-                                            add_b.add_operand(MOperandValueReference(function, f, arg));
-                                            add_b.add_operand(MOperandImmediate(x86_64::GeneralPurposeBytewidth, 32));
-
-                                            load_b.add_operand(MOperandRegister(add_b.reg(), uint(add_b.regsize())));
-                                            bb.add_instruction(add_b);
-                                        } else {
-                                            arg->print();
-                                            LCC_ASSERT(false, "Handle gMIR lowering of SysV multiple register argument");
+                                            add.location(call_ir->location());
+                                            add.add_operand(MOperandValueReference(function, f, arg_ptr));
+                                            add.add_operand(MOperandImmediate(eightbyte * x86_64::GeneralPurposeBytewidth, 32));
+                                            load.add_operand(MOperandRegister(add.reg(), uint(add.regsize())));
+                                            bb.add_instruction(std::move(add));
                                         }
 
-                                        bb.add_instruction(load_a);
-                                        bb.add_instruction(load_b);
+                                        bb.add_instruction(std::move(load));
                                     }
                                 }
                             }
                         } else (LCC_ASSERT(false, "Unhandled architecture in gMIR generation from IR call"));
 
+                        // The return that follows is subsumed by the jump.
+                        if (LowersToTailCall(_ctx, call_ir)) {
+                            LCC_ASSERT(not arg_stack_bytes_used);
+                            auto call = MInst(MInst::Kind::TailCall, {0, 0});
+                            call.location(call_ir->location());
+                            call.add_operand(MOperandValueReference(function, f, call_ir->callee()));
+                            bb.add_instruction(std::move(call));
+                            break;
+                        }
+
                         auto call = MInst(
                             MInst::Kind::Call,
-                            {virts[instruction], uint(call_ir->function_type()->ret()->bits())}
+                            {instruction->vreg(), uint(call_ir->function_type()->ret()->bits())}
                         );
                         call.location(call_ir->location());
                         call.add_operand(MOperandValueReference(function, f, call_ir->callee()));
-                        bb.add_instruction(call);
+                        bb.add_instruction(std::move(call));
 
                         if (arg_stack_bytes_used) {
                             LCC_ASSERT(_ctx->target()->is_arch_x86_64(), "Handle architecture when resetting stack after a call");
@@ -760,15 +923,87 @@ auto Module::mir() -> std::vector<MFunction> {
                                     x86_64::GeneralPurposeBitwidth //
                                 }
                             );
-                            bb.add_instruction(stack_fixup);
+                            bb.add_instruction(std::move(stack_fixup));
                         }
                     } break;
 
                     case Value::Kind::Intrinsic: {
                         auto intrinsic = as<IntrinsicInst>(instruction);
                         switch (intrinsic->intrinsic_kind()) {
-                            case IntrinsicKind::MemCopy: {
-                                LCC_ASSERT(intrinsic->operands().size() == 3, "Invalid number of operands to memcpy intrinsic");
+                            case IntrinsicKind::MemCopy:
+                            case IntrinsicKind::MemSet: {
+                                bool is_memcpy = intrinsic->intrinsic_kind() == IntrinsicKind::MemCopy;
+                                LCC_ASSERT(
+                                    intrinsic->operands().size() == 3,
+                                    "Invalid number of operands to {} intrinsic",
+                                    is_memcpy ? "memcpy" : "memset"
+                                );
+
+                                auto* dest = intrinsic->operands().at(0);
+                                auto* source = intrinsic->operands().at(1);
+                                if (IsInlinedMemoryIntrinsic(intrinsic)) {
+                                    auto bytes = usz(as<IntegerConstant>(intrinsic->operands().at(2))->value().value());
+                                    if (not bytes) break;
+
+                                    auto dest_base = MemoryIntrinsicBase(function, f, bb, intrinsic, dest);
+                                    if (is_memcpy) {
+                                        auto source_base = MemoryIntrinsicBase(function, f, bb, intrinsic, source);
+                                        ForEachMemoryChunk(bytes, [&](usz offset, uint bits) {
+                                            auto load = MInst(MInst::Kind::Load, {f.next_vreg(), bits});
+                                            load.location(intrinsic->location());
+                                            AddMemoryIntrinsicAddress(load, source_base, offset);
+                                            load.add_use();
+
+                                            auto store = MInst(MInst::Kind::Store, {0, 0});
+                                            store.location(intrinsic->location());
+                                            store.add_operand(MOperandRegister(load.reg(), bits));
+                                            AddMemoryIntrinsicAddress(store, dest_base, offset);
+
+                                            bb.add_instruction(std::move(load));
+                                            bb.add_instruction(std::move(store));
+                                        });
+                                        break;
+                                    }
+
+                                    // Replicate the byte to fill with across a whole register, so
+                                    // that every store can use (the low part of) the same one. Fills
+                                    // shorter than a register are never stored in more than 32 bits.
+                                    uint fill_bits = bytes >= x86_64::GeneralPurposeBytewidth ? 64 : 32;
+                                    u64 ones = u64(0x0101010101010101) >> (64 - fill_bits);
+                                    auto fill = MInst(MInst::Kind::Copy, {f.next_vreg(), fill_bits});
+                                    fill.location(intrinsic->location());
+                                    if (auto* byte = cast<IntegerConstant>(source)) {
+                                        fill.add_operand(MOperandImmediate(
+                                            (byte->value().value() & 0xff) * ones,
+                                            fill_bits
+                                        ));
+                                        fill.add_use();
+                                        bb.add_instruction(fill);
+                                    } else {
+                                        auto zext = MInst(MInst::Kind::ZExt, {f.next_vreg(), fill_bits});
+                                        zext.location(intrinsic->location());
+                                        zext.add_operand(MOperandValueReference(function, f, source));
+                                        zext.add_use();
+
+                                        fill = MInst(MInst::Kind::Mul, {fill.reg(), fill_bits});
+                                        fill.location(intrinsic->location());
+                                        fill.add_operand(MOperandRegister(zext.reg(), fill_bits));
+                                        fill.add_operand(MOperandImmediate(ones, fill_bits));
+                                        fill.add_use();
+
+                                        bb.add_instruction(std::move(zext));
+                                        bb.add_instruction(fill);
+                                    }
+
+                                    ForEachMemoryChunk(bytes, [&](usz offset, uint bits) {
+                                        auto store = MInst(MInst::Kind::Store, {0, 0});
+                                        store.location(intrinsic->location());
+                                        store.add_operand(MOperandRegister(fill.reg(), bits));
+                                        AddMemoryIntrinsicAddress(store, dest_base, offset);
+                                        bb.add_instruction(std::move(store));
+                                    });
+                                    break;
+                                }
 
                                 std::vector<usz> arg_regs{};
                                 // TODO: Static assert for handling of targets.
@@ -793,17 +1028,16 @@ auto Module::mir() -> std::vector<MFunction> {
                                     );
                                     copy.location(intrinsic->location());
                                     copy.add_operand(MOperandValueReference(function, f, op));
-                                    bb.add_instruction(copy);
+                                    bb.add_instruction(std::move(copy));
                                 }
 
                                 auto call = MInst(MInst::Kind::Call, {0, 0});
                                 call.location(intrinsic->location());
-                                call.add_operand(memcpy_function);
-                                bb.add_instruction(call);
+                                call.add_operand(is_memcpy ? memcpy_function : memset_function);
+                                bb.add_instruction(std::move(call));
                             } break;
 
                             case IntrinsicKind::DebugTrap:
-                            case IntrinsicKind::MemSet:
                             case IntrinsicKind::SystemCall:
                                 LCC_TODO("Generate MIR for IntrinsicInst");
                         }
@@ -811,7 +1045,7 @@ auto Module::mir() -> std::vector<MFunction> {
 
                     case Value::Kind::GetElementPtr: {
                         auto* gep_ir = as<GEPInst>(instruction);
-                        Register reg{virts[instruction], uint(gep_ir->type()->bits())};
+                        Register reg{instruction->vreg(), uint(gep_ir->type()->bits())};
 
                         if (auto* idx = cast<IntegerConstant>(gep_ir->idx())) {
                             usz offset = gep_ir->base_type()->bytes() * idx->value().value();
@@ -820,7 +1054,7 @@ auto Module::mir() -> std::vector<MFunction> {
                                 auto copy = MInst(MInst::Kind::Copy, reg);
                                 copy.location(gep_ir->location());
                                 copy.add_operand(MOperandValueReference(function, f, gep_ir->ptr()));
-                                bb.add_instruction(copy);
+                                bb.add_instruction(std::move(copy));
                                 break;
                             }
 
@@ -832,7 +1066,7 @@ auto Module::mir() -> std::vector<MFunction> {
                             usz use_count = gep_ir->users().size();
                             while (use_count--) add.add_use();
 
-                            bb.add_instruction(add);
+                            bb.add_instruction(std::move(add));
                             break;
                         }
 
@@ -849,13 +1083,13 @@ auto Module::mir() -> std::vector<MFunction> {
                         usz use_count = gep_ir->users().size();
                         while (use_count--) add.add_use();
 
-                        bb.add_instruction(mul);
-                        bb.add_instruction(add);
+                        bb.add_instruction(std::move(mul));
+                        bb.add_instruction(std::move(add));
                     } break;
 
                     case Value::Kind::GetMemberPtr: {
                         auto gmp_ir = as<GetMemberPtrInst>(instruction);
-                        auto reg = Register{virts[instruction], uint(gmp_ir->type()->bits())};
+                        auto reg = Register{instruction->vreg(), uint(gmp_ir->type()->bits())};
 
                         LCC_ASSERT(
                             gmp_ir->idx()->kind() == Value::Kind::IntegerConstant,
@@ -874,7 +1108,7 @@ auto Module::mir() -> std::vector<MFunction> {
                             auto copy = MInst(MInst::Kind::Copy, reg);
                             copy.location(gmp_ir->location());
                             copy.add_operand(MOperandValueReference(function, f, gmp_ir->ptr()));
-                            bb.add_instruction(copy);
+                            bb.add_instruction(std::move(copy));
                             break;
                         }
 
@@ -883,18 +1117,18 @@ auto Module::mir() -> std::vector<MFunction> {
                         add.add_operand(MOperandValueReference(function, f, gmp_ir->ptr()));
                         add.add_operand(MOperandImmediate(offset, 32));
 
-                        bb.add_instruction(add);
+                        bb.add_instruction(std::move(add));
                     } break;
 
                     case Value::Kind::Branch: {
                         auto* branch_ir = as<BranchInst>(instruction);
                         // A branch does not produce a useable value, and as such it's register
                         // size is zero.
-                        auto branch = MInst(MInst::Kind::Branch, {virts[instruction], 0});
+                        auto branch = MInst(MInst::Kind::Branch, {instruction->vreg(), 0});
                         branch.location(branch_ir->location());
                         auto op = MOperandValueReference(function, f, branch_ir->target());
                         branch.add_operand(op);
-                        bb.add_instruction(branch);
+                        bb.add_instruction(std::move(branch));
 
                         // MIR Control Flow Graph
                         if (std::holds_alternative<MOperandBlock>(op)) {
@@ -910,7 +1144,7 @@ auto Module::mir() -> std::vector<MFunction> {
                         // size is zero.
                         auto branch = MInst(
                             MInst::Kind::CondBranch,
-                            {virts[instruction], 0}
+                            {instruction->vreg(), 0}
                         );
                         branch.location(branch_ir->location());
                         branch.add_operand(MOperandValueReference(function, f, branch_ir->cond()));
@@ -918,7 +1152,7 @@ auto Module::mir() -> std::vector<MFunction> {
                         auto else_op = MOperandValueReference(function, f, branch_ir->else_block());
                         branch.add_operand(then_op);
                         branch.add_operand(else_op);
-                        bb.add_instruction(branch);
+                        bb.add_instruction(std::move(branch));
 
                         // MIR Control Flow Graph
                         if (std::holds_alternative<MOperandBlock>(then_op)) {
@@ -938,163 +1172,122 @@ auto Module::mir() -> std::vector<MFunction> {
                         // size is zero.
                         auto unreachable = MInst(
                             MInst::Kind::Unreachable,
-                            {virts[instruction], 0}
+                            {instruction->vreg(), 0}
                         );
                         unreachable.location(as<UnreachableInst>(instruction)->location());
-                        bb.add_instruction(unreachable);
+                        bb.add_instruction(std::move(unreachable));
                     } break;
 
                     case Value::Kind::Store: {
                         auto* store_ir = as<StoreInst>(instruction);
 
-                        // Special case lowering of storing multiple register return value..
-                        if (
-                            is<CallInst>(store_ir->val())
-                            and _ctx->target()->is_arch_x86_64()
-                            and _ctx->target()->is_cconv_sysv()
-                            and store_ir->val()->type()->bits() > x86_64::GeneralPurposeBitwidth
-                            and store_ir->val()->type()->bits() <= 2 * x86_64::GeneralPurposeBitwidth
-                        ) {
-                            // Multiple register return value stored into store's destination pointer
-                            auto reg_a = MOperandRegister(
-                                +x86_64::RegisterId::RAX,
-                                x86_64::GeneralPurposeBitwidth
-                            );
-                            auto reg_b = MOperandRegister(
-                                +x86_64::RegisterId::RDX,
-                                uint(store_ir->val()->type()->bits() - x86_64::GeneralPurposeBitwidth)
-                            );
-
-                            auto store_a = MInst(MInst::Kind::Store, {virts[instruction], 0});
-                            store_a.location(store_ir->location());
-                            store_a.add_operand(reg_a);
-                            store_a.add_operand(MOperandValueReference(function, f, store_ir->ptr()));
-
-                            auto add_b = MInst(MInst::Kind::Add, {next_vreg(), 64});
-                            add_b.location(store_ir->location());
-                            add_b.add_operand(MOperandValueReference(function, f, store_ir->ptr()));
-                            add_b.add_operand(MOperandImmediate(x86_64::GeneralPurposeBytewidth, 32));
-
-                            auto store_b = MInst(MInst::Kind::Store, {virts[instruction], 0});
-                            store_b.location(store_ir->location());
-                            store_b.add_operand(reg_b);
-                            store_b.add_operand(MOperandRegister(add_b.reg(), uint(add_b.regsize())));
-
-                            bb.add_instruction(store_a);
-                            bb.add_instruction(add_b);
-                            bb.add_instruction(store_b);
-                            break; // Value::Kind::Store
-                        }
-
-                        // Special case lowering of storing multiple register parameter.
-                        else if (auto* param = cast<Parameter>(store_ir->val())) {
-                            // TODO FOR FUN: Functions marked internal we can do all the fucky wucky
-                            // to, to make more efficient-like.
-                            // FIXME: What does f.calling_convention() (C, Glint) have to do
-                            // with any of this?
-                            if (_ctx->target()->is_arch_x86_64() and _ctx->target()->is_cconv_sysv()) {
-                                auto param_description = cconv::sysv::parameter_description(function);
-
-                                auto arg_regs_used_before_parameter = param_description.info.at(param->index()).arg_regs_used;
-
-                                // Multiple register parameter
-                                if (
-                                    // The parameter value has to fit within two registers (and not one).
-                                    param->type()->bytes() > x86_64::GeneralPurposeBytewidth
-                                    and param->type()->bytes() <= 2 * x86_64::GeneralPurposeBytewidth
-                                    // There has to be two registers available, obviously.
-                                    and arg_regs_used_before_parameter < cconv::sysv::arg_regs.size() - 1
-                                ) {
-                                    if (auto* alloca = cast<AllocaInst>(store_ir->ptr())) {
-                                        // Multiple register parameter stored into alloca
-                                        auto reg_a = MOperandRegister(
-                                            +cconv::sysv::arg_regs.at(arg_regs_used_before_parameter++),
-                                            x86_64::GeneralPurposeBitwidth
-                                        );
-                                        auto reg_b = MOperandRegister(
-                                            +cconv::sysv::arg_regs.at(arg_regs_used_before_parameter++),
-                                            uint(param->type()->bits() - x86_64::GeneralPurposeBitwidth)
-                                        );
-
-                                        auto store_a = MInst(
-                                            MInst::Kind::Store,
-                                            {virts[instruction], 0}
-                                        );
-                                        store_a.location(store_ir->location());
-                                        store_a.add_operand(reg_a);
-                                        store_a.add_operand(MOperandValueReference(function, f, alloca));
-
-                                        auto add_b = MInst(
-                                            MInst::Kind::Add,
-                                            {next_vreg(), x86_64::GeneralPurposeBitwidth}
-                                        );
-                                        add_b.location(store_ir->location());
-                                        add_b.add_operand(MOperandValueReference(function, f, alloca));
-                                        add_b.add_operand(MOperandImmediate(x86_64::GeneralPurposeBytewidth, 32));
+                        // Special case lowering of storing a value that lives in multiple
+                        // registers, i.e. a multiple register return value or parameter: each
+                        // register is stored separately.
+                        // TODO FOR FUN: Functions marked internal we can do all the fucky wucky
+                        // to, to make more efficient-like.
+                        // FIXME: What does f.calling_convention() (C, Glint) have to do
+                        // with any of this?
+                        if (_ctx->target()->is_arch_x86_64() and _ctx->target()->is_cconv_sysv()) {
+                            using cconv::sysv::ParameterClass;
+                            auto* type = store_ir->val()->type();
+                            std::vector<usz> registers{};
+
+                            if (is<CallInst>(store_ir->val())) {
+                                auto classification = cconv::sysv::classify(type);
+                                if (classification.kind == ParameterClass::REGISTER and classification.eightbytes > 1) {
+                                    registers.assign(
+                                        cconv::sysv::return_regs.begin(),
+                                        cconv::sysv::return_regs.begin() + isz(classification.eightbytes)
+                                    );
+                                }
+                            } else if (auto* param = cast<Parameter>(store_ir->val())) {
+                                auto& param_registers = parameter_registers.at(param->index());
+                                if (param_registers.size() > 1) {
+                                    for (auto reg : param_registers)
+                                        registers.push_back(reg.value);
+                                }
+                            }
 
-                                        auto store_b = MInst(
-                                            MInst::Kind::Store,
-                                            {virts[instruction], 0}
-                                        );
-                                        store_b.location(store_ir->location());
-                                        store_b.add_operand(reg_b);
-                                        store_b.add_operand(MOperandRegister(add_b.reg(), uint(add_b.regsize())));
-
-                                        bb.add_instruction(store_a);
-                                        bb.add_instruction(add_b);
-                                        bb.add_instruction(store_b);
-                                        break; // Value::Kind::Store
-                                    }
-                                    LCC_UNREACHABLE();
+                            for (auto [eightbyte, reg] : vws::enumerate(registers)) {
+                                auto store = MInst(MInst::Kind::Store, {instruction->vreg(), 0});
+                                store.location(store_ir->location());
+                                store.add_operand(MOperandRegister(reg, cconv::sysv::eightbyte_bits(type, usz(eightbyte))));
+
+                                if (eightbyte == 0) store.add_operand(MOperandValueReference(function, f, store_ir->ptr()));
+                                else {
+                                    auto add = MInst(MInst::Kind::Add, {f.next_vreg(), x86_64::GeneralPurposeBitwidth});
+                                    add.location(store_ir->location());
+                                    add.add_operand(MOperandValueReference(function, f, store_ir->ptr()));
+                                    add.add_operand(MOperandImmediate(usz(eightbyte) * x86_64::GeneralPurposeBytewidth, 32));
+                                    store.add_operand(MOperandRegister(add.reg(), uint(add.regsize())));
+                                    bb.add_instruction(std::move(add));
                                 }
+
+                                bb.add_instruction(std::move(store));
                             }
+
+                            if (not registers.empty()) break; // Value::Kind::Store
                         }
 
                         // A store does not produce a useable value, and as such it's register
                         // size is zero.
-                        auto store = MInst(MInst::Kind::Store, {virts[instruction], 0});
+                        auto store = MInst(MInst::Kind::Store, {instruction->vreg(), 0});
                         store.location(store_ir->location());
                         store.add_operand(MOperandValueReference(function, f, store_ir->val()));
                         store.add_operand(MOperandValueReference(function, f, store_ir->ptr()));
-                        bb.add_instruction(store);
+                        bb.add_instruction(std::move(store));
                     } break;
 
                     case Value::Kind::Load: {
                         auto* load_ir = as<LoadInst>(instruction);
                         auto load = MInst(
                             MInst::Kind::Load,
-                            {virts[instruction], uint(load_ir->type()->bits())}
+                            {instruction->vreg(), uint(load_ir->type()->bits())}
                         );
                         load.location(load_ir->location());
                         load.add_operand(MOperandValueReference(function, f, load_ir->ptr()));
-                        bb.add_instruction(load);
+                        bb.add_instruction(std::move(load));
                     } break;
 
                     case Value::Kind::Return: {
                         auto* ret_ir = as<ReturnInst>(instruction);
                         auto* func_type = as<FunctionType>(function->type());
-                        auto ret_type_bytes = func_type->ret()->bytes();
+
+                        // Already emitted as part of the tail call.
+                        if (
+                            ret_ir->prev() and is<CallInst>(ret_ir->prev())
+                            and LowersToTailCall(_ctx, as<CallInst>(ret_ir->prev()))
+                        ) break;
+                        auto ret_class = cconv::sysv::classify(func_type->ret());
 
                         // SysV return in two registers
                         if (
                             _ctx->target()->is_cconv_sysv()
                             and ret_ir->has_value()
-                            and ret_type_bytes > x86_64::GeneralPurposeBytewidth
-                            and ret_type_bytes <= 2 * x86_64::GeneralPurposeBytewidth
+                            and ret_class.kind == cconv::sysv::ParameterClass::REGISTER
+                            and ret_class.eightbytes == 2
                         ) {
                             if (_ctx->target()->is_arch_x86_64()) {
+                                // Returning what a call right before returned; it is still in
+                                // the return registers.
+                                if (is<CallInst>(ret_ir->val()) and ret_ir->prev() == ret_ir->val()) {
+                                    bb.emplace_instruction(MInst::Kind::Return, Register{0, 0});
+                                    break;
+                                }
+
                                 // Add eight bytes to pointer to load from next.
                                 // Copy pointer
                                 auto copy_b = MInst(
                                     MInst::Kind::Copy,
-                                    {next_vreg(), x86_64::GeneralPurposeBitwidth}
+                                    {f.next_vreg(), x86_64::GeneralPurposeBitwidth}
                                 );
                                 copy_b.location(ret_ir->location());
                                 copy_b.add_operand(MOperandValueReference(function, f, ret_ir->val()));
 
                                 auto add_b = MInst(
                                     MInst::Kind::Add,
-                                    {next_vreg(), x86_64::GeneralPurposeBitwidth}
+                                    {f.next_vreg(), x86_64::GeneralPurposeBitwidth}
                                 );
                                 add_b.location(ret_ir->location());
                                 add_b.add_operand(MOperandRegister(copy_b.reg(), uint(copy_b.regsize())));
@@ -1111,17 +1304,17 @@ auto Module::mir() -> std::vector<MFunction> {
                                     MInst::Kind::Load,
                                     {
                                         usz(x86_64::RegisterId::RDX),
-                                        uint(func_type->ret()->bits() - x86_64::GeneralPurposeBitwidth) //
+                                        cconv::sysv::eightbyte_bits(func_type->ret(), 1) //
                                     }
                                 );
                                 load_b.location(ret_ir->location());
                                 load_b.add_operand(MOperandRegister(add_b.reg(), uint(add_b.regsize())));
 
-                                bb.add_instruction(copy_b);
-                                bb.add_instruction(add_b);
-                                bb.add_instruction(load_a);
-                                bb.add_instruction(load_b);
-                                bb.add_instruction(MInst(MInst::Kind::Return, {0, 0}));
+                                bb.add_instruction(std::move(copy_b));
+                                bb.add_instruction(std::move(add_b));
+                                bb.add_instruction(std::move(load_a));
+                                bb.add_instruction(std::move(load_b));
+                                bb.emplace_instruction(MInst::Kind::Return, Register{0, 0});
                                 break;
                             } else LCC_ASSERT(false, "Unhandled target architecture in SysV multiple register return");
                         }
@@ -1130,12 +1323,12 @@ auto Module::mir() -> std::vector<MFunction> {
                         if (ret_ir->has_value()) regsize = ret_ir->val()->type()->bits();
                         auto ret = MInst(
                             MInst::Kind::Return,
-                            {virts[instruction], uint(regsize)}
+                            {instruction->vreg(), uint(regsize)}
                         );
                         ret.location(ret_ir->location());
                         if (ret_ir->has_value())
                             ret.add_operand(MOperandValueReference(function, f, ret_ir->val()));
-                        bb.add_instruction(ret);
+                        bb.add_instruction(std::move(ret));
                     } break;
 
                     // Unary
@@ -1146,10 +1339,10 @@ auto Module::mir() -> std::vector<MFunction> {
                     case Value::Kind::Neg:
                     case Value::Kind::Compl: {
                         auto* unary_ir = as<UnaryInstBase>(instruction);
-                        auto unary = MInst(ir_nary_inst_kind_to_mir(unary_ir->kind()), {virts[instruction], uint(unary_ir->type()->bits())});
+                        auto unary = MInst(ir_nary_inst_kind_to_mir(unary_ir->kind()), {instruction->vreg(), uint(unary_ir->type()->bits())});
                         unary.location(unary_ir->location());
                         unary.add_operand(MOperandValueReference(function, f, unary_ir->operand()));
-                        bb.add_instruction(unary);
+                        bb.add_instruction(std::move(unary));
                     } break;
 
                     // Binary
@@ -1177,22 +1370,52 @@ auto Module::mir() -> std::vector<MFunction> {
                     case Value::Kind::UGt:
                     case Value::Kind::UGe: {
                         auto* binary_ir = as<BinaryInst>(instruction);
-                        auto binary = MInst(ir_nary_inst_kind_to_mir(binary_ir->kind()), {virts[instruction], uint(binary_ir->type()->bits())});
+                        auto binary = MInst(ir_nary_inst_kind_to_mir(binary_ir->kind()), {instruction->vreg(), uint(binary_ir->type()->bits())});
                         binary.location(binary_ir->location());
                         binary.add_operand(MOperandValueReference(function, f, binary_ir->lhs()));
                         binary.add_operand(MOperandValueReference(function, f, binary_ir->rhs()));
-                        bb.add_instruction(binary);
+
+                        // Element-wise operations on vectors carry the width of
+                        // their elements as a trailing immediate, so that isel can
+                        // tell e.g. `paddd` from `paddq`.
+                        if (auto* vector = cast<VectorType>(binary_ir->type())) {
+                            // The parser rejects anything else.
+                            if (not BinaryInst::SupportsVector(binary_ir->kind(), vector)) Diag::ICE(
+                                "Cannot generate MIR for {} on {}",
+                                Value::ToString(binary_ir->kind()),
+                                vector->string(false)
+                            );
+                            binary.add_operand(MOperandImmediate(vector->element_type()->bits(), 32));
+                        }
+
+                        bb.add_instruction(std::move(binary));
                     } break;
                 }
             }
+            RecordMInstPositions(bb, recorded);
+        }
+
+        // A phi may use a value from a block that was generated after it,
+        // e.g. along a loop's back edge; count those uses now that there is
+        // an instruction to count them against.
+        for (auto& bb : f.blocks()) {
+            for (auto& minst : bb.instructions()) {
+                if (minst.kind() != MInst::Kind::Phi) continue;
+                for (const auto& op : minst.all_operands()) {
+                    if (not std::holds_alternative<MOperandRegister>(op)) continue;
+                    auto reg = std::get<MOperandRegister>(op);
+                    if (reg.size) continue;
+                    if (auto* def = MInstByVirtualRegister(reg.value)) def->add_use();
+                }
+            }
         }
     }
 
     // Lowering
     for (auto& mfunc : funcs) {
         for (auto& mblock : mfunc.blocks()) {
-            std::vector<isz> indices_of_instructions_to_remove{};
-            for (auto [minst_index, minst] : vws::enumerate(mblock.instructions())) {
+            bool has_phis = false;
+            for (auto& minst : mblock.instructions()) {
                 // phi2copy
                 if (minst.kind() == MInst::Kind::Phi) {
                     // Insert copy of each operand value into virtual register of phi
@@ -1242,18 +1465,22 @@ auto Module::mir() -> std::vector<MFunction> {
                             copy.add_operand(std::get<MOperandBlock>(op));
                         } else LCC_ASSERT(false, "Unhandled MIR operand alternative");
 
-                        phi_operand_block->add_instruction(copy, true);
+                        phi_operand_block->add_instruction(std::move(copy), true);
 
                         block = nullptr;
                     }
 
                     LCC_ASSERT(not block, "Phi *must* have an even number of operands: incoming block and value pairs");
 
-                    indices_of_instructions_to_remove.push_back(minst_index);
+                    has_phis = true;
                 }
             }
-            for (isz index : indices_of_instructions_to_remove | vws::reverse)
-                mblock.instructions().erase(mblock.instructions().begin() + index);
+
+            // Remove all phis in one go instead of shifting the rest of the block
+            // down for each of them.
+            if (has_phis) std::erase_if(mblock.instructions(), [](const MInst& minst) {
+                return minst.kind() == MInst::Kind::Phi;
+            });
         }
     }
 
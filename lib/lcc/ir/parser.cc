@@ -1,13 +1,18 @@
+#include <lcc/context.hh>
 #include <lcc/ir/ir.hh>
 #include <lcc/ir/module.hh>
+#include <lcc/mem_report.hh>
 #include <lcc/syntax/lexer.hh>
 #include <lcc/syntax/token.hh>
+#include <lcc/time_report.hh>
 #include <lcc/utils/macros.hh>
+#include <lcc/utils/parallel.hh>
 #include <lcc/utils/result.hh>
 
 #include <cstdlib>
-#include <deque>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -33,6 +38,8 @@ enum struct TokenKind {
     RParen,
     LBrack,
     RBrack,
+    LAngle,
+    RAngle,
     Equals,
     Newline,
     Arrow,
@@ -55,6 +62,8 @@ constexpr auto StringifyEnum(TokenKind t) -> std::string_view {
         case TokenKind::RParen: return ")";
         case TokenKind::LBrack: return "[";
         case TokenKind::RBrack: return "]";
+        case TokenKind::LAngle: return "<";
+        case TokenKind::RAngle: return ">";
         case TokenKind::Equals: return "=";
         case TokenKind::Arrow: return "->";
     }
@@ -63,7 +72,8 @@ constexpr auto StringifyEnum(TokenKind t) -> std::string_view {
 }
 
 std::unordered_map<std::string, IntrinsicKind> intrinsic_kinds{
-    {"@memcpy", IntrinsicKind::MemCopy}};
+    {"@memcpy", IntrinsicKind::MemCopy},
+    {"@memset", IntrinsicKind::MemSet}};
 
 class Parser : syntax::Lexer<syntax::Token<TokenKind>> {
     using Tk = TokenKind;
@@ -82,34 +92,66 @@ class Parser : syntax::Lexer<syntax::Token<TokenKind>> {
     };
     using IRValue = std::variant<Value*, Temporary, Global>;
 
-    std::deque<Token> lookahead_tokens{};
-    bool looking_ahead = false;
     bool last_token_was_newline = false;
     StringMap<Value*> temporaries{};
-    StringMap<Value*> globals{};
+
+    /// Parsers that each parse a part of the same module share the
+    /// globals of the whole module.
+    StringMap<Value*> own_globals{};
+    StringMap<Value*>& globals{own_globals};
+
+    /// Leave every reference to a global to be fixed up at the end, even
+    /// if the global is already known. Functions parsed on several threads
+    /// at once must not record uses of the same global concurrently.
+    bool defer_globals = false;
 
     /// Unresolved values.
     StringMap<std::vector<std::pair<Inst*, Block**>>> block_fixups{};
     StringMap<std::vector<std::pair<Inst*, Value**>>> temporary_fixups{};
     StringMap<std::vector<std::pair<Inst*, Value**>>> global_fixups{};
 
+    /// The header of a function, up to its body.
+    struct FunctionHeader {
+        Function* function;
+        std::vector<std::string> param_names;
+        bool has_body;
+    };
+
 public:
-    std::unique_ptr<Module> mod;
+    /// The module that is being parsed into, and the same module if this
+    /// parser created it.
+    std::unique_ptr<Module> owned_mod{};
+    Module* mod{};
 
-    Parser(Context* ctx, File* file)
-        : syntax::Lexer<Token>(ctx, file) {
-        mod = std::make_unique<Module>(context);
+    Parser(Context* ctx, std::string_view source)
+        : syntax::Lexer<Token>(ctx, source) {
+        owned_mod = std::make_unique<Module>(context);
+        mod = owned_mod.get();
         NextToken();
+
+        /// Lexing IR does not depend on the parser, so lex
+        /// all of it up front.
+        Tokenize([this] { NextToken(); });
     }
 
-    Parser(Context* ctx, std::string_view source)
-        : syntax::Lexer<Token>(ctx, source) {
-        mod = std::make_unique<Module>(context);
+    /// Parse only \p part, a span of \p source that starts at the start
+    /// of a line, into \p module, sharing \p module_globals with the
+    /// other parsers of the same module.
+    Parser(Module* module, std::string_view source, std::string_view part, StringMap<Value*>& module_globals)
+        : syntax::Lexer<Token>(module->context(), syntax::detail::CharacterRange{source, part}),
+          globals(module_globals),
+          mod(module) {
+        last_token_was_newline = true;
+        NextChar();
         NextToken();
+        Tokenize([this] { NextToken(); });
     }
 
     auto ParseModule() -> Result<void>;
 
+    /// Parse the functions of a module on up to \p jobs threads.
+    static auto ParseModuleInParallel(Context* ctx, std::string_view source, usz jobs) -> std::unique_ptr<Module>;
+
 private:
     /// Check if we’re at one of a set of tokens.
     [[nodiscard]]
@@ -142,6 +184,14 @@ private:
         return {};
     }
 
+    /// Check if a signature passes or returns vectors, which only ever
+    /// live in vector registers, and which no calling convention we lower
+    /// passes anything in.
+    [[nodiscard]]
+    static auto TakesOrReturnsVector(Type* ret, std::span<Type* const> params) -> bool {
+        return is<VectorType>(ret) or rgs::any_of(params, [](Type* t) { return is<VectorType>(t); });
+    }
+
     auto LookAhead(usz n) -> Token*;
     void NextIdentifier();
     void NextNumber();
@@ -161,12 +211,17 @@ private:
     auto ParseIntrinsic() -> Result<IntrinsicInst*>;
     auto ParseCallConv() -> CallConv;
     auto ParseFunction() -> Result<void>;
+    auto ParseFunctionHeader() -> Result<FunctionHeader>;
+    auto ParseFunctionBody(Function* f, std::vector<std::string> names) -> Result<void>;
     auto ParseLiteral(std::string_view lit) -> Result<void>;
     auto ParseInstruction() -> Result<Inst*>;
     auto ParseType() -> Result<Type*>;
     auto ParseUntypedValue(Type* assumed_type) -> Result<IRValue>;
     auto ParseValue() -> Result<std::pair<Type*, IRValue>>;
 
+    /// Point every reference to a global at that global.
+    auto ResolveGlobals() -> Result<void>;
+
     /// Get a `Value*` for a temporary, or mark it to be resolved later.
     void SetBlock(Inst* parent, Block*& val, IRValue v);
     void SetValue(Inst* parent, Value*& val, IRValue v);
@@ -248,11 +303,7 @@ void lcc::parser::Parser::NextToken() {
     defer { last_token_was_newline = At(Tk::Newline); };
     tok.kind = TokenKind::Invalid;
 
-    if (not looking_ahead and not lookahead_tokens.empty()) {
-        tok = std::move(lookahead_tokens.front());
-        lookahead_tokens.pop_front();
-        return;
-    }
+    if (NextBufferedToken()) return;
 
     if (lastc == 0) {
         tok.kind = TokenKind::Eof;
@@ -297,6 +348,16 @@ void lcc::parser::Parser::NextToken() {
             NextChar();
             break;
 
+        case '<':
+            tok.kind = TokenKind::LAngle;
+            NextChar();
+            break;
+
+        case '>':
+            tok.kind = TokenKind::RAngle;
+            NextChar();
+            break;
+
         case ':':
             tok.kind = TokenKind::Colon;
             NextChar();
@@ -384,29 +445,13 @@ void lcc::parser::Parser::NextToken() {
 }
 
 auto lcc::parser::Parser::LookAhead(usz n) -> Token* {
-    if (n == 0) return &tok;
-
-    /// If we already have enough tokens, just return the nth token.
-    const auto idx = n - 1;
-    if (idx < lookahead_tokens.size()) return &lookahead_tokens[idx];
-
-    /// Otherwise, lex enough tokens.
-    tempset looking_ahead = true;
-    auto current = std::move(tok);
-    for (usz i = lookahead_tokens.size(); i < n; i++) {
-        tok = {};
-        NextToken();
-        lookahead_tokens.push_back(std::move(tok));
-    }
-    tok = std::move(current);
-
-    /// Return the nth token.
-    return &lookahead_tokens[idx];
+    return syntax::Lexer<Token>::LookAhead(n, [this] { NextToken(); });
 }
 
 template <typename Instruction>
 auto lcc::parser::Parser::ParseBinary(std::string tmp) -> Result<Inst*> {
     auto loc = tok.location;
+    auto name = tok.text;
     NextToken();
     auto lhs = ParseValue();
     auto comma = ConsumeOrError(Tk::Comma);
@@ -420,6 +465,10 @@ auto lcc::parser::Parser::ParseBinary(std::string tmp) -> Result<Inst*> {
         inst = new (*mod) Instruction(loc);
     }
 
+    auto* vector = cast<VectorType>(lhs->first);
+    if (vector and not BinaryInst::SupportsVector(inst->kind(), vector))
+        return Diag::Error(context, loc, "'{}' is not supported on {}", name, vector->string(false));
+
     SetValue(inst, inst->left, lhs->second);
     SetValue(inst, inst->right, *rhs);
     AddTemporary(std::move(tmp), inst);
@@ -449,7 +498,9 @@ auto lcc::parser::Parser::ParseBlock() -> Result<Block*> {
 
 auto lcc::parser::Parser::ParseCall(bool tail) -> Result<CallInst*> {
     auto loc = tok.location;
-    NextToken();
+    const bool force_inline = tok.text == "inline";
+    if (force_inline) NextToken();
+    if (auto res = ParseLiteral("call"); res.is_diag()) return res.diag();
     auto cc = ParseCallConv();
 
     Type* ret = Type::VoidTy;
@@ -480,6 +531,9 @@ auto lcc::parser::Parser::ParseCall(bool tail) -> Result<CallInst*> {
         ret = *ty;
     }
 
+    if (TakesOrReturnsVector(ret, arg_types))
+        return Diag::Error(context, loc, "Vectors cannot be passed to or returned from functions");
+
     auto call = new (*mod) CallInst(
         FunctionType::Get(mod->context(), ret, std::move(arg_types), is_variadic),
         loc
@@ -491,6 +545,7 @@ auto lcc::parser::Parser::ParseCall(bool tail) -> Result<CallInst*> {
         SetValue(call, call->arguments[usz(i)], arg);
 
     if (tail) call->set_tail_call();
+    if (force_inline) call->set_force_inline();
     call->cc = cc;
     return call;
 }
@@ -545,18 +600,22 @@ auto lcc::parser::Parser::ParseCallConv() -> CallConv {
 
 template <typename Instruction>
 auto lcc::parser::Parser::ParseCast(std::string tmp) -> Result<Inst*> {
+    auto loc = tok.location;
+    auto name = tok.text;
     NextToken();
     auto val = ParseValue();
     auto to = ParseLiteral("to");
     auto ty = ParseType();
     if (IsError(val, to, ty)) return Diag();
+    if (is<VectorType>(val->first) or is<VectorType>(*ty))
+        return Diag::Error(context, loc, "'{}' is not supported on vectors", name);
     auto inst = new (*mod) Instruction(*ty, tok.location);
     SetValue(inst, inst->op, val->second);
     AddTemporary(std::move(tmp), inst);
     return inst;
 }
 
-auto lcc::parser::Parser::ParseFunction() -> Result<void> {
+auto lcc::parser::Parser::ParseFunctionHeader() -> Result<FunctionHeader> {
     /// Parse name and colon.
     if (not At(Tk::Keyword)) return Error("Expected function name");
     auto name = tok.text;
@@ -599,6 +658,8 @@ auto lcc::parser::Parser::ParseFunction() -> Result<void> {
         if (not Consume(Tk::Comma)) break;
     }
     if (not Consume(Tk::RParen)) return Error("Expected ')'");
+    if (TakesOrReturnsVector(*ret, args))
+        return Diag::Error(context, loc, "Vectors cannot be passed to or returned from functions");
 
     bool is_variadic = false;
     if (At(Tk::Keyword) and tok.text == "variadic") {
@@ -608,7 +669,7 @@ auto lcc::parser::Parser::ParseFunction() -> Result<void> {
 
     /// Create the function.
     auto f = new (*mod) Function(
-        mod.get(),
+        mod,
         std::move(name),
         FunctionType::Get(mod->context(), *ret, std::move(args), is_variadic),
         linkage,
@@ -623,9 +684,19 @@ auto lcc::parser::Parser::ParseFunction() -> Result<void> {
     }
 
     /// Colon means we have a body.
-    if (not Consume(Tk::Colon)) return {};
+    if (not Consume(Tk::Colon)) return FunctionHeader{f, std::move(names), false};
     if (not Consume(Tk::Newline)) return Error("Expected line break");
+    return FunctionHeader{f, std::move(names), true};
+}
+
+auto lcc::parser::Parser::ParseFunction() -> Result<void> {
+    auto header = ParseFunctionHeader();
+    if (not header) return header.diag();
+    if (not header->has_body) return {};
+    return ParseFunctionBody(header->function, std::move(header->param_names));
+}
 
+auto lcc::parser::Parser::ParseFunctionBody(Function* f, std::vector<std::string> names) -> Result<void> {
     /// Register mappings for function arguments.
     temporaries.clear();
     for (const auto& [i, arg] : vws::enumerate(names)) {
@@ -696,7 +767,7 @@ auto lcc::parser::Parser::ParseInstruction() -> Result<Inst*> {
     /// Instructions that don’t yield a value.
     if (At(Tk::Keyword)) {
         auto loc = tok.location;
-        if (tok.text == "tail" or tok.text == "call") {
+        if (tok.text == "tail" or tok.text == "inline" or tok.text == "call") {
             const bool tail = tok.text == "tail";
             if (tail) NextToken();
             return ParseCall(tail);
@@ -798,7 +869,7 @@ auto lcc::parser::Parser::ParseInstruction() -> Result<Inst*> {
         return copy;
     }
 
-    if (tok.text == "call") {
+    if (tok.text == "inline" or tok.text == "call") {
         auto call = ParseCall(false);
         if (call.is_diag()) return call.diag();
         AddTemporary(std::move(tmp), *call);
@@ -854,6 +925,7 @@ auto lcc::parser::Parser::ParseInstruction() -> Result<Inst*> {
         NextToken();
         auto val = ParseValue();
         if (val.is_diag()) return val.diag();
+        if (is<VectorType>(val->first)) return Diag::Error(context, loc, "'neg' is not supported on vectors");
         auto neg = new (*mod) NegInst(val->first, loc);
         SetValue(neg, neg->op, val->second);
         AddTemporary(std::move(tmp), neg);
@@ -864,6 +936,7 @@ auto lcc::parser::Parser::ParseInstruction() -> Result<Inst*> {
         NextToken();
         auto val = ParseValue();
         if (val.is_diag()) return val.diag();
+        if (is<VectorType>(val->first)) return Diag::Error(context, loc, "'compl' is not supported on vectors");
         auto c = new (*mod) ComplInst(val->first, loc);
         SetValue(c, c->op, val->second);
         AddTemporary(std::move(tmp), c);
@@ -908,7 +981,10 @@ auto lcc::parser::Parser::ParseModule() -> Result<void> {
             return err.diag();
     }
 
-    /// Fix up references to globals.
+    return ResolveGlobals();
+}
+
+auto lcc::parser::Parser::ResolveGlobals() -> Result<void> {
     for (auto&& [name, fixups] : global_fixups) {
         auto it = globals.find(name);
         if (it == globals.end()) return Error("Unknown global '{}'", name);
@@ -927,7 +1003,31 @@ auto lcc::parser::Parser::ParseType() -> Result<Type*> {
     if (Kw("ptr")) base = Type::PtrTy;
     else if (Kw("void")) base = Type::VoidTy;
     else if (At(Tk::IntegerType)) base = IntegerType::Get(mod->context(), tok.integer_value);
-    else return Error("Expected type");
+    else if (At(Tk::LAngle)) {
+        /// Vector type, e.g. `<4 x i32>`.
+        auto loc = tok.location;
+        NextToken();
+        if (not At(Tk::Integer) or tok.integer_value == 0) return Error("Expected vector length");
+        auto length = tok.integer_value;
+        NextToken();
+        if (not Kw("x")) return Error("Expected 'x'");
+        NextToken();
+        if (not At(Tk::IntegerType)) return Error("Vector elements must be integers");
+        auto* element = IntegerType::Get(mod->context(), tok.integer_value);
+        NextToken();
+        if (not At(Tk::RAngle)) return Error("Expected '>'");
+        auto* vector = VectorType::Get(mod->context(), length, element);
+        if (not vector->supported()) {
+            NextToken();
+            return Diag::Error(
+                context,
+                loc,
+                "Unsupported vector type {}: vectors must be 128 or 256 bits wide, with 8, 16, 32, or 64-bit elements",
+                vector->string(false)
+            );
+        }
+        base = vector;
+    } else return Error("Expected type");
     NextToken();
 
     /// Parse qualifiers.
@@ -957,6 +1057,7 @@ auto lcc::parser::Parser::ParseUntypedValue(Type* assumed_type) -> Result<IRValu
     if (At(Tk::Global)) {
         auto text = tok.text;
         NextToken();
+        if (defer_globals) return IRValue{Global{std::move(text)}};
         auto it = globals.find(text);
         if (it == globals.end()) return IRValue{Global{std::move(text)}};
         return IRValue{it->second};
@@ -971,6 +1072,7 @@ auto lcc::parser::Parser::ParseUntypedValue(Type* assumed_type) -> Result<IRValu
     }
 
     if (At(Tk::Integer)) {
+        if (is<VectorType>(assumed_type)) return Error("Vector constants are not supported");
         auto i = new (*mod) IntegerConstant(
             assumed_type,
             tok.integer_value
@@ -1019,14 +1121,167 @@ void lcc::parser::Parser::SetBlock(Inst* parent, lcc::Block*& val, lcc::parser::
     }
 }
 
+namespace lcc::parser {
+namespace {
+/// Split IR source into the text of each function. A function starts
+/// at a line that does not start with whitespace or a comment, and
+/// runs up to the start of the next one.
+///
+/// Returns nothing if there is anything but blank lines and comments
+/// before the first function.
+auto SplitFunctions(std::string_view source) -> std::optional<std::vector<std::string_view>> {
+    static constexpr std::string_view whitespace = " \t\r\n\f\v";
+    std::vector<std::string_view> functions{};
+    usz start = std::string_view::npos;
+    for (usz line = 0; line < source.size();) {
+        auto end = source.find_first_of("\r\n", line);
+        end = end == std::string_view::npos ? source.size() : end + 1;
+        if (whitespace.find(source[line]) == std::string_view::npos and source[line] != ';') {
+            if (start != std::string_view::npos) functions.push_back(source.substr(start, line - start));
+            start = line;
+        } else if (start == std::string_view::npos) {
+            auto first = source.find_first_not_of(whitespace, line);
+            if (first < end and source[first] != ';') return std::nullopt;
+        }
+        line = end;
+    }
+
+    if (start != std::string_view::npos) functions.push_back(source.substr(start));
+    return functions;
+}
+
+/// Get the length of the first line of \p text, including its line
+/// break. The lexer treats a pair of line break characters as one.
+auto HeaderLength(std::string_view text) -> usz {
+    auto end = text.find_first_of("\r\n");
+    if (end == std::string_view::npos) return text.size();
+    if (end + 1 < text.size() and (text[end + 1] == '\r' or text[end + 1] == '\n')) return end + 2;
+    return end + 1;
+}
+} // namespace
+} // namespace lcc::parser
+
+auto lcc::parser::Parser::ParseModuleInParallel(
+    Context* ctx,
+    std::string_view source,
+    usz jobs
+) -> std::unique_ptr<Module> {
+    auto module = std::make_unique<Module>(ctx);
+    StringMap<Value*> module_globals{};
+
+    /// The serial parser reports anything odd before the first function.
+    auto functions = SplitFunctions(source);
+    if (not functions) {
+        Parser p{ctx, source};
+        if (not p.ParseModule()) return nullptr;
+        return std::move(p.owned_mod);
+    }
+
+    /// Create every function first, in order, so that the bodies can
+    /// refer to functions defined after them.
+    std::vector<FunctionHeader> headers{};
+    headers.reserve(functions->size());
+    for (auto text : *functions) {
+        Parser p{module.get(), source, text.substr(0, HeaderLength(text)), module_globals};
+        auto header = p.ParseFunctionHeader();
+        if (not header) return nullptr;
+        if (not header->has_body and not p.At(Tk::Newline, Tk::Eof)) {
+            p.Error("Expected line break");
+            return nullptr;
+        }
+        headers.push_back(std::move(*header));
+    }
+
+    /// Parse the bodies. Values go into storage of each thread's own, and
+    /// references to functions are only recorded afterwards, so that no
+    /// thread touches anything another thread might be using.
+    using GlobalFixups = decltype(global_fixups);
+    std::vector<GlobalFixups> fixups(functions->size());
+    std::vector<Diag::Buffer> diagnostics(functions->size());
+    std::vector<char> succeeded(functions->size(), true);
+    ParallelFor(functions->size(), jobs, [&](usz i) {
+        /// An earlier function has failed to parse anyway.
+        if (Diag::Buffer::LimitReachedBefore(ctx, diagnostics, i)) {
+            succeeded[i] = false;
+            return;
+        }
+
+        Diag::Buffer::Capture capture{diagnostics[i]};
+        Module::ThreadAllocation allocation{*module};
+        auto text = (*functions)[i];
+        Parser p{module.get(), source, text.substr(HeaderLength(text)), module_globals};
+        p.defer_globals = true;
+
+        auto& header = headers[i];
+        if (header.has_body and not p.ParseFunctionBody(header.function, std::move(header.param_names))) {
+            succeeded[i] = false;
+            return;
+        }
+
+        /// Anything after the body would have to be another function.
+        while (not p.At(Tk::Eof)) {
+            if (p.Consume(Tk::Newline)) continue;
+            p.Error("Expected function name");
+            succeeded[i] = false;
+            return;
+        }
+
+        fixups[i] = std::move(p.global_fixups);
+    });
+
+    /// Report errors in the order of the functions, and stop at the first
+    /// function that could not be parsed, as the serial parser would.
+    for (auto [i, buffer] : vws::enumerate(diagnostics)) {
+        buffer.flush();
+        if (not succeeded[usz(i)]) return nullptr;
+    }
+
+    /// Link up references to functions.
+    bool ok = true;
+    for (auto& function_fixups : fixups) {
+        for (auto&& [name, uses] : function_fixups) {
+            auto it = module_globals.find(name);
+            if (it == module_globals.end()) {
+                Diag::Error(ctx, {}, "Unknown global '{}'", name);
+                ok = false;
+                continue;
+            }
+
+            for (auto [user, slot] : uses) {
+                *slot = it->second;
+                Inst::AddUse(it->second, user);
+            }
+        }
+    }
+
+    if (not ok) return nullptr;
+    return module;
+}
+
+namespace lcc::parser {
+namespace {
+/// Parse a module, on several threads if the context allows it.
+auto ParseIR(Context* ctx, std::string_view source) -> std::unique_ptr<Module> {
+    TimeReport::Timer timer{ctx, "Parse IR"};
+    std::unique_ptr<Module> mod{};
+    if (auto jobs = ResolveJobCount(ctx->option_jobs()); jobs > 1) {
+        mod = Parser::ParseModuleInParallel(ctx, source, jobs);
+    } else {
+        Parser p{ctx, source};
+        if (p.ParseModule()) mod = std::move(p.owned_mod);
+    }
+
+    if (not mod) return nullptr;
+    if (auto* mem = ctx->mem_report()) mem->count("IR instructions", mod->instruction_count());
+    return mod;
+}
+} // namespace
+} // namespace lcc::parser
+
 auto lcc::Module::Parse(Context* ctx, std::string_view source) -> std::unique_ptr<Module> {
-    parser::Parser p{ctx, source};
-    if (not p.ParseModule()) return nullptr;
-    return std::move(p.mod);
+    return parser::ParseIR(ctx, source);
 }
 
 auto lcc::Module::Parse(Context* ctx, File& file) -> std::unique_ptr<Module> {
-    parser::Parser p{ctx, &file};
-    if (not p.ParseModule()) return nullptr;
-    return std::move(p.mod);
+    return parser::ParseIR(ctx, {file.data(), file.size()});
 }
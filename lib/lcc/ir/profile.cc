@@ -0,0 +1,257 @@
+#include <lcc/context.hh>
+#include <lcc/diags.hh>
+#include <lcc/file.hh>
+#include <lcc/ir/ir.hh>
+#include <lcc/ir/module.hh>
+#include <lcc/ir/profile.hh>
+#include <lcc/ir/type.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lcc::profile {
+namespace {
+constexpr std::string_view magic{"LCCPROF\0", 8};
+
+/// Flags for `open()` on Linux: O_WRONLY | O_CREAT | O_APPEND.
+constexpr u64 open_flags = 01 | 0100 | 02000;
+
+/// Permissions of a newly created profile.
+constexpr u64 open_mode = 0644;
+
+/// Hash of the shape of a function: how many blocks it has, and how
+/// many instructions and successors each of those has.
+auto Shape(Function* f) -> u64 {
+    u64 hash = 0xcbf29ce484222325;
+    auto Mix = [&](u64 value) {
+        hash ^= value;
+        hash *= 0x100000001b3;
+    };
+
+    Mix(f->blocks().size());
+    for (auto* b : f->blocks()) {
+        Mix(b->instructions().size());
+        Mix(b->successor_count());
+    }
+    return hash;
+}
+
+auto FindFunction(Module* mod, std::string_view name) -> Function* {
+    for (auto* f : mod->code())
+        if (f->has_name(name)) return f;
+    return nullptr;
+}
+
+void AppendU64(std::vector<char>& out, u64 value) {
+    char bytes[sizeof value];
+    std::memcpy(bytes, &value, sizeof value);
+    out.insert(out.end(), bytes, bytes + sizeof value);
+}
+} // namespace
+
+void Instrument(Module* mod, std::string_view path) {
+    auto* ctx = mod->context();
+    if (not ctx->target()->is_platform_linux()) {
+        Diag::Error(ctx, {}, "-fprofile-generate is only supported when targeting Linux");
+        return;
+    }
+
+    auto* main_function = FindFunction(mod, "main");
+    if (not main_function or main_function->blocks().empty()) {
+        Diag::Warning(ctx, {}, "Module {} does not define `main`, so it cannot write a profile", mod->name());
+        return;
+    }
+
+    std::vector<Function*> functions{};
+    usz block_count = 0;
+    for (auto* f : mod->code()) {
+        if (f->blocks().empty()) continue;
+        functions.push_back(f);
+        block_count += f->blocks().size();
+    }
+
+    // Describe the counters up front, before we add anything to the
+    // blocks they count.
+    std::vector<char> header{magic.begin(), magic.end()};
+    AppendU64(header, functions.size());
+    for (auto* f : functions) {
+        const auto& name = f->names().at(0).name;
+        AppendU64(header, name.size());
+        header.insert(header.end(), name.begin(), name.end());
+        AppendU64(header, f->blocks().size());
+        AppendU64(header, Shape(f));
+    }
+
+    auto* i8 = IntegerType::Get(ctx, 8);
+    auto* i32 = IntegerType::Get(ctx, 32);
+    auto* i64 = IntegerType::Get(ctx, 64);
+    auto* counters = new (*mod) GlobalVariable(
+        mod,
+        ArrayType::Get(ctx, block_count, i64),
+        "__lcc_profile_counters",
+        Linkage::Internal,
+        nullptr
+    );
+
+    // Count every block on entry, after its phis and, in the entry
+    // block, after the allocas.
+    usz index = 0;
+    for (auto* f : functions) {
+        for (auto* b : f->blocks()) {
+            auto* first = b->instructions().front();
+            while (first and is<PhiInst, AllocaInst>(first)) first = first->next();
+            LCC_ASSERT(first, "Block {} of function {} has no terminator", b->name(), f->names().at(0).name);
+
+            auto* slot = new (*mod) GEPInst(i64, counters, new (*mod) IntegerConstant(i64, index++));
+            auto* count = new (*mod) LoadInst(i64, slot);
+            auto* incremented = new (*mod) AddInst(count, new (*mod) IntegerConstant(i64, 1));
+            b->insert_before(slot, first);
+            b->insert_before(count, first);
+            b->insert_before(incremented, first);
+            b->insert_before(new (*mod) StoreInst(incremented, slot), first);
+        }
+    }
+
+    // The counters are appended to the profile with plain system calls;
+    // `open()` takes the mode as a variadic argument, which is passed just
+    // like a regular one.
+    auto Declare = [&](std::string_view name, Type* ret, std::vector<Type*> params) {
+        auto* type = FunctionType::Get(ctx, ret, std::move(params));
+        auto* f = FindFunction(mod, name);
+        if (not f) f = new (*mod) Function(mod, std::string{name}, type, Linkage::Imported, CallConv::C);
+        return std::pair{f, type};
+    };
+
+    auto [open_function, open_type] = Declare("open", i32, {Type::PtrTy, i32, i32});
+    auto [write_function, write_type] = Declare("write", i64, {i32, Type::PtrTy, i64});
+    auto [close_function, close_type] = Declare("close", i32, {i32});
+
+    auto* header_type = ArrayType::Get(ctx, header.size(), i8);
+    auto header_size = header.size();
+    auto* header_var = new (*mod) GlobalVariable(
+        mod,
+        header_type,
+        "__lcc_profile_header",
+        Linkage::Internal,
+        new (*mod) ArrayConstant(header_type, std::move(header))
+    );
+    auto* path_var = GlobalVariable::CreateStringPtr(mod, "__lcc_profile_path", path);
+
+    auto* writer = new (*mod) Function(
+        mod,
+        "__lcc_profile_write",
+        FunctionType::Get(ctx, Type::VoidTy, {}),
+        Linkage::Internal,
+        CallConv::C
+    );
+
+    auto* entry = new (*mod) Block("__lcc_profile_write.entry");
+    writer->append_block(entry);
+    auto* fd = new (*mod) CallInst(
+        open_function,
+        open_type,
+        {path_var, new (*mod) IntegerConstant(i32, open_flags), new (*mod) IntegerConstant(i32, open_mode)}
+    );
+    entry->insert(fd);
+    entry->insert(new (*mod) CallInst(write_function, write_type, {fd, header_var, new (*mod) IntegerConstant(i64, header_size)}));
+    entry->insert(new (*mod) CallInst(write_function, write_type, {fd, counters, new (*mod) IntegerConstant(i64, block_count * sizeof(u64))}));
+    entry->insert(new (*mod) CallInst(close_function, close_type, {fd}));
+    entry->insert(new (*mod) ReturnInst(nullptr));
+
+    auto* writer_type = as<FunctionType>(writer->type());
+    for (auto* b : main_function->blocks()) {
+        auto* ret = cast<ReturnInst>(b->terminator());
+        if (not ret) continue;
+        b->insert_before(new (*mod) CallInst(writer, writer_type, {}, ret->location()), ret);
+    }
+}
+
+void Apply(Module* mod, std::string_view path) {
+    auto* ctx = mod->context();
+    auto data = File::Read(path);
+
+    struct Counts {
+        u64 shape;
+        std::vector<u64> counts;
+    };
+
+    StringMap<Counts> profile{};
+    usz offset = 0;
+    auto ReadU64 = [&]() -> std::optional<u64> {
+        if (data.size() - offset < sizeof(u64)) return std::nullopt;
+        u64 value{};
+        std::memcpy(&value, data.data() + offset, sizeof value);
+        offset += sizeof value;
+        return value;
+    };
+
+    auto Malformed = [&] {
+        Diag::Error(ctx, {}, "{} is not a valid profile", path);
+    };
+
+    while (offset < data.size()) {
+        if (data.size() - offset < magic.size() or std::string_view{data.data() + offset, magic.size()} != magic)
+            return Malformed();
+        offset += magic.size();
+
+        auto functions = ReadU64();
+        if (not functions) return Malformed();
+
+        struct Entry {
+            std::string name;
+            u64 blocks;
+            u64 shape;
+        };
+
+        std::vector<Entry> entries{};
+        for (u64 i = 0; i < *functions; i++) {
+            auto length = ReadU64();
+            if (not length or data.size() - offset < *length) return Malformed();
+            std::string name{data.data() + offset, *length};
+            offset += *length;
+
+            auto blocks = ReadU64();
+            auto shape = ReadU64();
+            if (not blocks or not shape) return Malformed();
+            entries.push_back({std::move(name), *blocks, *shape});
+        }
+
+        // Records of the same function with a different shape come from
+        // a different version of it; only the latest one counts.
+        for (auto& e : entries) {
+            auto& counts = profile[e.name];
+            if (counts.shape != e.shape or counts.counts.size() != e.blocks) {
+                counts.shape = e.shape;
+                counts.counts.assign(e.blocks, 0);
+            }
+
+            for (auto& c : counts.counts) {
+                auto count = ReadU64();
+                if (not count) return Malformed();
+                c += *count;
+            }
+        }
+    }
+
+    for (auto* f : mod->code()) {
+        if (f->blocks().empty()) continue;
+        const auto& name = f->names().at(0).name;
+        auto it = profile.find(name);
+        if (it == profile.end()) continue;
+
+        auto& [shape, counts] = it->second;
+        if (shape != Shape(f) or counts.size() != f->blocks().size()) {
+            Diag::Warning(ctx, f->location(), "Function `{}` has changed since its profile was recorded; ignoring its profile", name);
+            continue;
+        }
+
+        for (auto [i, b] : vws::enumerate(f->blocks()))
+            b->profile_count(counts[usz(i)]);
+    }
+}
+} // namespace lcc::profile
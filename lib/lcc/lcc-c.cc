@@ -5,6 +5,207 @@
 #include <lcc/ir/type.hh>
 #include <lcc/lcc-c.h>
 #include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace {
+using namespace lcc;
+
+static_assert(+Value::Kind::UGe - +Value::Kind::Alloca == LCC_OP_UGE, "LccOpcode is out of sync with Value::Kind");
+static_assert(+IntrinsicKind::SystemCall == LCC_INTRINSIC_SYSCALL, "LccIntrinsicKind is out of sync with IntrinsicKind");
+
+auto ToValue(LccValueRef value) -> Value* { return reinterpret_cast<Value*>(value); }
+auto ToType(LccTypeRef type) -> Type* { return reinterpret_cast<Type*>(type); }
+auto ToLocation(LccLocation l) -> Location { return {l.position, l.length, l.file_id}; }
+
+/// Creates the instructions of one call to the bulk construction API and
+/// appends them to a block.
+///
+/// All values are allocated from storage of the calling thread, so the
+/// module's allocation lock is only taken once per batch.
+class BulkBuilder {
+    Module& mod;
+    Block* block;
+    const LccValueRef* values;
+    std::vector<Inst*> created{};
+    Module::ThreadAllocation allocation;
+
+    auto Operand(LccOperand op) -> Value* {
+        if (op < 0) {
+            LCC_ASSERT(values, "Operand refers to the value table, but there is none");
+            return ToValue(values[-(op + 1)]);
+        }
+
+        LCC_ASSERT(usz(op) < created.size(), "Operand refers to instruction {} of a batch of {}", op, created.size());
+        return created[usz(op)];
+    }
+
+    auto BlockOperand(LccOperand op) -> Block* { return as<Block>(Operand(op)); }
+
+    static void ExpectOperands(Value::Kind kind, std::span<const LccOperand> ops, usz n) {
+        LCC_ASSERT(
+            ops.size() == n,
+            "{} takes {} operands, but got {}",
+            Value::ToString(kind),
+            n,
+            ops.size()
+        );
+    }
+
+    template <typename I>
+    auto Unary(Value::Kind kind, std::span<const LccOperand> ops, Location loc) -> Inst* {
+        ExpectOperands(kind, ops, 1);
+        return new (mod) I(Operand(ops[0]), loc);
+    }
+
+    template <typename I>
+    auto Cast(Value::Kind kind, std::span<const LccOperand> ops, Type* ty, Location loc) -> Inst* {
+        ExpectOperands(kind, ops, 1);
+        return new (mod) I(Operand(ops[0]), ty, loc);
+    }
+
+    template <typename I>
+    auto Binary(Value::Kind kind, std::span<const LccOperand> ops, Location loc) -> Inst* {
+        ExpectOperands(kind, ops, 2);
+        return new (mod) I(Operand(ops[0]), Operand(ops[1]), loc);
+    }
+
+public:
+    BulkBuilder(Module& m, Block* b, const LccValueRef* v, usz count)
+        : mod(m), block(b), values(v), allocation(m) {
+        created.reserve(count);
+    }
+
+    void Append(u32 opcode, u32 immediate, Type* ty, std::span<const LccOperand> ops, Location loc) {
+        LCC_ASSERT(opcode <= LCC_OP_UGE, "Invalid opcode {}", opcode);
+        auto kind = Value::Kind(+Value::Kind::Alloca + opcode);
+        auto Expect = [&](usz n) { ExpectOperands(kind, ops, n); };
+
+        auto Operands = [&](std::span<const LccOperand> o) {
+            std::vector<Value*> operands{};
+            operands.reserve(o.size());
+            for (auto op : o) operands.push_back(Operand(op));
+            return operands;
+        };
+
+        Inst* i{};
+        switch (kind) {
+            default: Diag::ICE("Cannot create {} in bulk", Value::ToString(kind));
+
+            case Value::Kind::Alloca:
+                Expect(0);
+                i = new (mod) AllocaInst(ty, loc);
+                break;
+
+            case Value::Kind::Call:
+                LCC_ASSERT(not ops.empty(), "call needs a callee");
+                i = new (mod) CallInst(Operand(ops[0]), as<FunctionType>(ty), Operands(ops.subspan(1)), loc);
+                break;
+
+            case Value::Kind::GetElementPtr:
+                Expect(2);
+                i = new (mod) GEPInst(ty, Operand(ops[0]), Operand(ops[1]), loc);
+                break;
+
+            case Value::Kind::GetMemberPtr:
+                Expect(2);
+                i = new (mod) GetMemberPtrInst(ty, Operand(ops[0]), Operand(ops[1]), loc);
+                break;
+
+            case Value::Kind::Intrinsic:
+                LCC_ASSERT(immediate <= LCC_INTRINSIC_SYSCALL, "Invalid intrinsic {}", immediate);
+                i = new (mod) IntrinsicInst(IntrinsicKind(immediate), Operands(ops), loc);
+                break;
+
+            case Value::Kind::Load:
+                Expect(1);
+                i = new (mod) LoadInst(ty, Operand(ops[0]), loc);
+                break;
+
+            case Value::Kind::Phi: {
+                LCC_ASSERT(ops.size() % 2 == 0, "phi operands must be pairs of a block and a value");
+                auto* phi = new (mod) PhiInst(ty, loc);
+                for (usz j = 0; j < ops.size(); j += 2)
+                    phi->set_incoming(Operand(ops[j + 1]), BlockOperand(ops[j]));
+                i = phi;
+            } break;
+
+            case Value::Kind::Store:
+                Expect(2);
+                i = new (mod) StoreInst(Operand(ops[0]), Operand(ops[1]), loc);
+                break;
+
+            case Value::Kind::Branch:
+                Expect(1);
+                i = new (mod) BranchInst(BlockOperand(ops[0]), loc);
+                break;
+
+            case Value::Kind::CondBranch:
+                Expect(3);
+                i = new (mod) CondBranchInst(Operand(ops[0]), BlockOperand(ops[1]), BlockOperand(ops[2]), loc);
+                break;
+
+            case Value::Kind::Return:
+                LCC_ASSERT(ops.size() <= 1, "return takes at most one operand");
+                i = new (mod) ReturnInst(ops.empty() ? nullptr : Operand(ops[0]), loc);
+                break;
+
+            case Value::Kind::Unreachable:
+                Expect(0);
+                i = new (mod) UnreachableInst(loc);
+                break;
+
+            case Value::Kind::ZExt: i = Cast<ZExtInst>(kind, ops, ty, loc); break;
+            case Value::Kind::SExt: i = Cast<SExtInst>(kind, ops, ty, loc); break;
+            case Value::Kind::Trunc: i = Cast<TruncInst>(kind, ops, ty, loc); break;
+            case Value::Kind::Bitcast: i = Cast<BitcastInst>(kind, ops, ty, loc); break;
+            case Value::Kind::Neg: i = Unary<NegInst>(kind, ops, loc); break;
+            case Value::Kind::Copy: i = Unary<CopyInst>(kind, ops, loc); break;
+            case Value::Kind::Compl: i = Unary<ComplInst>(kind, ops, loc); break;
+
+            case Value::Kind::Add: i = Binary<AddInst>(kind, ops, loc); break;
+            case Value::Kind::Sub: i = Binary<SubInst>(kind, ops, loc); break;
+            case Value::Kind::Mul: i = Binary<MulInst>(kind, ops, loc); break;
+            case Value::Kind::SDiv: i = Binary<SDivInst>(kind, ops, loc); break;
+            case Value::Kind::UDiv: i = Binary<UDivInst>(kind, ops, loc); break;
+            case Value::Kind::SRem: i = Binary<SRemInst>(kind, ops, loc); break;
+            case Value::Kind::URem: i = Binary<URemInst>(kind, ops, loc); break;
+            case Value::Kind::Shl: i = Binary<ShlInst>(kind, ops, loc); break;
+            case Value::Kind::Sar: i = Binary<SarInst>(kind, ops, loc); break;
+            case Value::Kind::Shr: i = Binary<ShrInst>(kind, ops, loc); break;
+            case Value::Kind::And: i = Binary<AndInst>(kind, ops, loc); break;
+            case Value::Kind::Or: i = Binary<OrInst>(kind, ops, loc); break;
+            case Value::Kind::Xor: i = Binary<XorInst>(kind, ops, loc); break;
+            case Value::Kind::Eq: i = Binary<EqInst>(kind, ops, loc); break;
+            case Value::Kind::Ne: i = Binary<NeInst>(kind, ops, loc); break;
+            case Value::Kind::SLt: i = Binary<SLtInst>(kind, ops, loc); break;
+            case Value::Kind::SLe: i = Binary<SLeInst>(kind, ops, loc); break;
+            case Value::Kind::SGt: i = Binary<SGtInst>(kind, ops, loc); break;
+            case Value::Kind::SGe: i = Binary<SGeInst>(kind, ops, loc); break;
+            case Value::Kind::ULt: i = Binary<ULtInst>(kind, ops, loc); break;
+            case Value::Kind::ULe: i = Binary<ULeInst>(kind, ops, loc); break;
+            case Value::Kind::UGt: i = Binary<UGtInst>(kind, ops, loc); break;
+            case Value::Kind::UGe: i = Binary<UGeInst>(kind, ops, loc); break;
+        }
+
+        block->insert(i);
+        created.push_back(i);
+    }
+
+    /// Store the instructions created so far in \p results, if it is not
+    /// null, and return how many there are.
+    auto Finish(LccValueRef* results) -> int64_t {
+        if (results) {
+            for (auto [index, i] : vws::enumerate(created))
+                results[index] = reinterpret_cast<LccValueRef>(i);
+        }
+        return int64_t(created.size());
+    }
+};
+} // namespace
 
 extern "C" {
 
@@ -28,6 +229,21 @@ LccFormatRef lcc_format_gnu_as_att_assembly() {
     return reinterpret_cast<LccFormatRef>(lcc::Format::gnu_as_att_assembly);
 }
 
+/// Gets the emission format for LCC's binary IR.
+LccFormatRef lcc_format_lcc_bitcode() {
+    return reinterpret_cast<LccFormatRef>(lcc::Format::lcc_bitcode);
+}
+
+/// Gets the emission format for ELF object files.
+LccFormatRef lcc_format_elf_object() {
+    return reinterpret_cast<LccFormatRef>(lcc::Format::elf_object);
+}
+
+/// Gets the emission format for COFF object files.
+LccFormatRef lcc_format_coff_object() {
+    return reinterpret_cast<LccFormatRef>(lcc::Format::coff_object);
+}
+
 /// Create an LCC context.
 LccContextRef lcc_context_create(LccTargetRef target, LccFormatRef format) {
     return reinterpret_cast<LccContextRef>(new lcc::Context{
@@ -47,4 +263,111 @@ LccModuleRef lcc_module_create(LccContextRef context) {
     auto* lcc_context = reinterpret_cast<lcc::Context*>(context);
     return reinterpret_cast<LccModuleRef>(new lcc::Module(lcc_context));
 }
+
+LccModuleRef lcc_module_parse(LccContextRef context, LccStringView source) {
+    auto* lcc_context = reinterpret_cast<lcc::Context*>(context);
+    std::string_view text{source.string, usz(source.length)};
+    auto mod = Module::IsBitcode(text)
+                 ? Module::ParseBitcode(lcc_context, text)
+                 : Module::Parse(lcc_context, text);
+    if (not mod or lcc_context->has_error()) return nullptr;
+    return reinterpret_cast<LccModuleRef>(mod.release());
+}
+
+void lcc_module_lower(LccModuleRef module) {
+    reinterpret_cast<Module*>(module)->lower();
+}
+
+LccBuffer lcc_module_emit_to_buffer(LccModuleRef module) {
+    auto* bytes = new std::vector<u8>(reinterpret_cast<Module*>(module)->emit_to_buffer());
+    return {bytes->data(), int64_t(bytes->size()), bytes};
+}
+
+void lcc_buffer_free(LccBuffer buffer) {
+    delete static_cast<std::vector<u8>*>(buffer.handle);
+}
+
+void lcc_module_reserve_functions(LccModuleRef module, int64_t count) {
+    reinterpret_cast<Module*>(module)->reserve_functions(usz(count));
+}
+
+void lcc_module_reserve_variables(LccModuleRef module, int64_t count) {
+    reinterpret_cast<Module*>(module)->reserve_vars(usz(count));
+}
+
+void lcc_function_append_new_blocks(LccValueRef function, int64_t count, LccValueRef* blocks) {
+    auto* f = as<Function>(ToValue(function));
+    Module::ThreadAllocation allocation{*f->module()};
+    f->blocks().reserve(f->blocks().size() + usz(count));
+    for (int64_t i = 0; i < count; i++) {
+        auto* b = new (*f->module()) Block{};
+        f->append_block(b);
+        if (blocks) blocks[i] = reinterpret_cast<LccValueRef>(b);
+    }
+}
+
+void lcc_function_reserve_blocks(LccValueRef function, int64_t count) {
+    auto& blocks = as<Function>(ToValue(function))->blocks();
+    blocks.reserve(blocks.size() + usz(count));
+}
+
+int64_t lcc_block_append_instructions(
+    LccModuleRef module,
+    LccValueRef block,
+    const LccInstructionDesc* instructions,
+    int64_t count,
+    const LccValueRef* values,
+    LccValueRef* results
+) {
+    BulkBuilder builder{*reinterpret_cast<Module*>(module), as<Block>(ToValue(block)), values, usz(count)};
+    for (const auto& i : std::span{instructions, usz(count)}) {
+        builder.Append(
+            u32(i.opcode),
+            i.immediate,
+            ToType(i.type),
+            {i.operands, usz(i.operand_count)},
+            ToLocation(i.location)
+        );
+    }
+    return builder.Finish(results);
+}
+
+int64_t lcc_block_append_buffer(
+    LccModuleRef module,
+    LccValueRef block,
+    const uint64_t* buffer,
+    int64_t word_count,
+    const LccTypeRef* types,
+    const LccValueRef* values,
+    LccValueRef* results
+) {
+    static_assert(sizeof(LccOperand) == sizeof(u64));
+    BulkBuilder builder{*reinterpret_cast<Module*>(module), as<Block>(ToValue(block)), values, 0};
+    std::span words{buffer, usz(word_count)};
+    while (not words.empty()) {
+        LCC_ASSERT(words.size() >= 3, "Truncated instruction in op-coded buffer");
+        auto header = words[0];
+        auto operand_count = usz(header >> 8 & 0xff'ffff);
+        LCC_ASSERT(words.size() >= 3 + operand_count, "Truncated operands in op-coded buffer");
+
+        Type* ty{};
+        if (words[1] != ~u64{}) {
+            LCC_ASSERT(types, "Instruction refers to the type table, but there is none");
+            ty = ToType(types[words[1]]);
+        }
+
+        Location loc{u32(words[2]), u16(words[2] >> 32), u16(words[2] >> 48)};
+        auto operands = words.subspan(3, operand_count);
+        builder.Append(
+            u32(header & 0xff),
+            u32(header >> 32),
+            ty,
+            {reinterpret_cast<const LccOperand*>(operands.data()), operands.size()},
+            loc
+        );
+
+        words = words.subspan(3 + operand_count);
+    }
+    return builder.Finish(results);
+}
 }
@@ -16,34 +16,23 @@ auto lcc::Location::seek(const lcc::Context* ctx) const -> LocInfo {
     auto& files = ctx->files();
     const auto* f = files.at(file_id).get();
 
-    // Seek back to the start of the line.
+    // Find the line by binary search in the line index of the file.
     const char* const data = f->data();
-    info.line_start = data + pos;
-    while (info.line_start > data and *info.line_start != '\n') info.line_start--;
-    if (*info.line_start == '\n') info.line_start++;
+    auto line = f->line_index(pos);
+    auto line_start = f->line_starts()[line];
+    info.line = line + 1;
+    info.col = pos - line_start;
+    info.line_start = data + line_start;
 
     // Seek forward to the end of the line.
     const char* const end = data + f->size();
     info.line_end = data + pos + len;
     while (info.line_end < end and *info.line_end != '\n') info.line_end++;
 
-    // Determine the line and column number.
-    info.line = 1;
-    for (const char* d = data; d < data + pos; d++) {
-        if (*d == '\n') {
-            info.line++;
-            info.col = 0;
-        } else {
-            info.col++;
-        }
-    }
-
     /// Done!
     return info;
 }
 
-/// TODO: Lexer should create map that counts where in a file the lines start so
-/// we can do binary search on that instead of iterating over the entire file.
 auto lcc::Location::seek_line_column(const lcc::Context* ctx) const -> LocInfoShort {
     LocInfoShort info{};
 
@@ -51,19 +40,10 @@ auto lcc::Location::seek_line_column(const lcc::Context* ctx) const -> LocInfoSh
     auto& files = ctx->files();
     const auto* f = files.at(file_id).get();
 
-    /// Seek back to the start of the line.
-    const char* const data = f->data();
-
     /// Determine the line and column number.
-    info.line = 1;
-    for (const char* d = data; d < data + pos; d++) {
-        if (*d == '\n') {
-            info.line++;
-            info.col = 0;
-        } else {
-            info.col++;
-        }
-    }
+    auto line = f->line_index(pos);
+    info.line = line + 1;
+    info.col = pos - f->line_starts()[line];
 
     /// Done!
     return info;
@@ -0,0 +1,145 @@
+#include <lcc/context.hh>
+#include <lcc/mem_report.hh>
+#include <lcc/utils/platform.hh>
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+namespace {
+/// The innermost phase that is running on this thread.
+thread_local const MemReport::Phase* current_phase{};
+
+auto FormatBytes(usz bytes) -> std::string {
+    if (bytes < 1024) return fmt::format("{} B", bytes);
+    if (bytes < 1024 * 1024) return fmt::format("{:.1f} KiB", double(bytes) / 1024);
+    if (bytes < 1024 * 1024 * 1024) return fmt::format("{:.1f} MiB", double(bytes) / (1024 * 1024));
+    return fmt::format("{:.2f} GiB", double(bytes) / (1024 * 1024 * 1024));
+}
+
+auto FormatDelta(isz bytes) -> std::string {
+    if (bytes < 0) return fmt::format("-{}", FormatBytes(usz(-bytes)));
+    return fmt::format("+{}", FormatBytes(usz(bytes)));
+}
+
+auto Name(std::string_view path) -> std::string_view {
+    auto slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+} // namespace
+
+MemReport::Phase::Phase(const Context* ctx, std::string_view name)
+    : report(ctx->mem_report()) {
+    if (not report) return;
+    outer = current_phase;
+    path = outer and outer->report == report
+             ? fmt::format("{}/{}", outer->path, name)
+             : std::string{name};
+    current_phase = this;
+
+    /// Create the entry now so that phases are listed in the order in
+    /// which they were entered, with every phase before its children.
+    {
+        std::unique_lock lock{report->mutex};
+        (void) report->entry(path);
+    }
+
+    for (usz i = 0; i < usz(Source::Count); i++) {
+        counts[i] = report->counters[i].count.load(std::memory_order_relaxed);
+        bytes[i] = report->counters[i].bytes.load(std::memory_order_relaxed);
+    }
+    rss = platform::ResidentSetSize();
+}
+
+MemReport::Phase::~Phase() {
+    if (not report) return;
+    auto rss_now = platform::ResidentSetSize();
+    auto peak_rss = platform::PeakResidentSetSize();
+
+    std::unique_lock lock{report->mutex};
+    auto& e = report->entry(path);
+    e.peak_rss = std::max(e.peak_rss, peak_rss);
+    e.rss_delta += isz(rss_now) - isz(rss);
+    for (usz i = 0; i < usz(Source::Count); i++) {
+        e.counts[i] += report->counters[i].count.load(std::memory_order_relaxed) - counts[i];
+        e.bytes[i] += report->counters[i].bytes.load(std::memory_order_relaxed) - bytes[i];
+    }
+    e.runs++;
+    current_phase = outer;
+}
+
+auto MemReport::entry(const std::string& path) -> Entry& {
+    auto [it, inserted] = entry_indices.try_emplace(path, entries.size());
+    if (inserted) entries.emplace_back(path, Entry{});
+    return entries[it->second].second;
+}
+
+void MemReport::count(std::string_view structure, usz n) {
+    std::unique_lock lock{mutex};
+    auto& e = entry(current_phase and current_phase->report == this ? current_phase->path : std::string{});
+    auto s = rgs::find_if(e.structures, [&](const auto& p) { return p.first == structure; });
+    if (s == e.structures.end()) e.structures.emplace_back(structure, n);
+    else s->second = std::max(s->second, n);
+}
+
+auto MemReport::str() -> std::string {
+    std::unique_lock lock{mutex};
+    std::string out = fmt::format(
+        "Memory report (peak RSS: {})\n",
+        FormatBytes(platform::PeakResidentSetSize())
+    );
+    out += fmt::format(
+        "{:>10} {:>11} {:>10} {:>10} {:>10} {:>10}  {}\n",
+        "Peak RSS",
+        "RSS change",
+        "AST allocs",
+        "AST bytes",
+        "IR allocs",
+        "IR bytes",
+        "Phase"
+    );
+
+    for (auto& [path, e] : entries) {
+        auto depth = usz(rgs::count(path, '/'));
+        auto indent = 2 * depth;
+        if (path.empty()) {
+            /// Structures recorded outside of any phase.
+            out += fmt::format("{:>66}  (no phase)\n", "");
+        } else {
+            out += fmt::format(
+                "{:>10} {:>11} {:>10} {:>10} {:>10} {:>10}  {:{}}{}\n",
+                FormatBytes(e.peak_rss),
+                FormatDelta(e.rss_delta),
+                e.counts[usz(Source::AST)],
+                FormatBytes(e.bytes[usz(Source::AST)]),
+                e.counts[usz(Source::IR)],
+                FormatBytes(e.bytes[usz(Source::IR)]),
+                "",
+                indent,
+                Name(path)
+            );
+        }
+
+        for (auto& [structure, n] : e.structures)
+            out += fmt::format("{:>66}  {:{}}  {}: {}\n", "", "", indent, structure, n);
+    }
+
+    return out;
+}
+
+auto MemReport::allocated_bytes() -> std::vector<std::pair<std::string, usz>> {
+    std::unique_lock lock{mutex};
+    std::vector<std::pair<std::string, usz>> out{};
+    for (auto& [path, e] : entries) {
+        if (path.empty()) continue;
+        usz total = 0;
+        for (auto b : e.bytes) total += b;
+        out.emplace_back(path, total);
+    }
+    return out;
+}
+} // namespace lcc
@@ -1,19 +1,76 @@
+#include <lcc/context.hh>
 #include <lcc/core.hh>
 #include <lcc/ir/domtree.hh>
+#include <lcc/ir/loops.hh>
+#include <lcc/ir/memory_ssa.hh>
+#include <lcc/mem_report.hh>
 #include <lcc/opt/opt.hh>
+#include <lcc/statistics.hh>
+#include <lcc/time_report.hh>
+#include <lcc/trace.hh>
+#include <lcc/utils/parallel.hh>
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <concepts>
+#include <deque>
 #include <functional>
 #include <iterator>
+#include <optional>
 #include <string_view>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 namespace lcc::opt {
 namespace {
+/// Record the function an event is about in a trace.
+void TraceFunction(Trace::Event& event, Function* f) {
+    if (not event) return;
+    usz instructions = 0;
+    for (auto* b : f->blocks()) instructions += b->instructions().size();
+    event.arg("function", f->names().at(0).name);
+    event.arg("instructions", instructions);
+}
+
+/// Analyses of a function, computed when a pass first asks for them and
+/// kept around across passes until a pass changes the function in a way
+/// that may invalidate them.
+///
+/// All of these only depend on the control flow graph, so they remain
+/// valid for as long as no blocks or edges are added or removed.
+class FunctionAnalyses {
+    Function* f;
+    std::optional<DomTree> dom_tree{};
+    std::optional<LoopInfo> loop_info{};
+
+public:
+    explicit FunctionAnalyses(Function* function) : f(function) {}
+
+    /// Get the dominator tree, including dominance frontiers.
+    [[nodiscard]]
+    auto dominators() -> const DomTree& {
+        if (not dom_tree) dom_tree.emplace(f);
+        return *dom_tree;
+    }
+
+    /// Get the loop nesting forest.
+    [[nodiscard]]
+    auto loops() -> const LoopInfo& {
+        if (not loop_info) loop_info.emplace(f, dominators());
+        return *loop_info;
+    }
+
+    /// Discard everything after the control flow graph has changed.
+    void invalidate() {
+        loop_info.reset();
+        dom_tree.reset();
+    }
+};
+
 /// Base class for all optimisation passes.
 /// Optimisation pass that runs on an instruction kind.
 struct OptimisationPass {
@@ -25,6 +82,22 @@ struct OptimisationPass {
     [[nodiscard]]
     auto changed() const -> bool { return has_changed; }
 
+    /// Get the number of instructions this pass has replaced.
+    [[nodiscard]]
+    auto replaced() const -> usz { return replacements; }
+
+    /// Get the next instruction queued for another visit, if any.
+    ///
+    /// Instructions are revisited in the order they were queued in; this
+    /// keeps folding chains of instructions linear.
+    [[nodiscard]]
+    auto next_from_worklist() -> Inst* {
+        if (worklist.empty()) return nullptr;
+        auto* i = worklist.front();
+        worklist.pop_front();
+        return i;
+    }
+
 protected:
     /// Helper to create an integer constant.
     [[nodiscard]]
@@ -35,13 +108,22 @@ protected:
         );
     }
 
+    /// Helper to create an integer constant of a certain bit width.
+    [[nodiscard]]
+    auto MakeInt(usz bits, u64 value) const -> IntegerConstant* {
+        return MakeInt(aint(bits, aint::Word(value)));
+    }
+
     /// Create a new instruction, replace another instruction with
     /// it, and mark that a change has occurred.
     template <typename Instruction, typename... Args>
     auto Replace(Inst* what, Args&&... args) -> Instruction* {
         auto* i = new (*mod) Instruction(std::forward<Args>(args)...);
+        RevisitUsers(what);
         what->replace_with(i);
+        Revisit(i);
         SetChanged();
+        replacements++;
         return i;
     }
 
@@ -51,33 +133,77 @@ protected:
         LCC_ASSERT(after->block(), "Cannot insert after floating instruction");
         auto* i = new (*mod) Instruction(std::forward<Args>(args)...);
         after->block()->insert_after(i, after);
+        Revisit(i);
+        SetChanged();
+        return i;
+    }
+
+    /// Create a new instruction, and insert it before another instruction.
+    template <typename Instruction, typename... Args>
+    auto Insert(Inst* before, Args&&... args) -> Instruction* {
+        LCC_ASSERT(before->block(), "Cannot insert before floating instruction");
+        auto* i = new (*mod) Instruction(std::forward<Args>(args)...);
+        before->block()->insert_before(i, before);
+        Revisit(i);
         SetChanged();
         return i;
     }
 
     /// Replace an instruction with a value.
     auto Replace(Inst* i, Value* v) {
+        RevisitUsers(i);
         i->replace_with(v);
         SetChanged();
+        replacements++;
     }
 
     /// Replace an instruction with a an integer constant.
     auto Replace(Inst* i, aint value) {
+        RevisitUsers(i);
         i->replace_with(MakeInt(value));
         SetChanged();
+        replacements++;
+    }
+
+    /// Queue a value to be visited again if it is an instruction.
+    void Revisit(Value* v) {
+        if (auto* i = cast<Inst>(v)) worklist.push_back(i);
+    }
+
+    /// Queue all users of a value to be visited again.
+    void RevisitUsers(Value* v) {
+        if (auto* u = cast<UseTrackingValue>(v))
+            worklist.insert(worklist.end(), u->users().begin(), u->users().end());
     }
 
     /// Mark that this pass has changed the ir.
     void SetChanged() { has_changed = true; }
 
+    /// Mark that this pass has changed an instruction in place.
+    void SetChanged(Inst* i) {
+        Revisit(i);
+        RevisitUsers(i);
+        SetChanged();
+    }
+
 private:
     bool has_changed = false;
+    usz replacements = 0;
+
+    /// Instructions whose operands have changed since they were
+    /// last visited.
+    std::deque<Inst*> worklist;
 };
 
 /// Optimisation pass that runs on an instruction kind.
 ///
 /// API:
 ///
+/// REQUIRED: static constexpr std::string_view name;
+///
+///     The name of the pass, as given to `--passes` and as
+///     shown in the time report.
+///
 /// OPTIONAL: void run_on_instruction(Inst* inst);
 ///
 ///     Called for every instruction.
@@ -100,22 +226,107 @@ private:
 ///
 ///     Called whenever we leave a block.
 ///
-struct InstructionRewritePass : OptimisationPass {};
+/// OPTIONAL: static constexpr bool use_worklist = true;
+///
+///     After visiting every instruction, keep visiting instructions
+///     whose operands were changed by this pass until there are none
+///     left, so the pass reaches a fixpoint in a single run.
+///
+/// OPTIONAL: static constexpr bool run_serially = true;
+///
+///     Never run this pass on several functions at once, e.g.
+///     because it prints something. Otherwise, a pass must only
+///     ever touch the function it is currently running on.
+///
+/// OPTIONAL: static constexpr bool preserves_cfg = true;
+///
+///     This pass never adds or removes blocks or edges, so the
+///     analyses of the function stay valid even if it changes
+///     something. Passes that use an analysis and change the
+///     CFG themselves must call `analyses->invalidate()`.
+///
+struct InstructionRewritePass : OptimisationPass {
+    /// Cached analyses of the function that is being optimised.
+    FunctionAnalyses* analyses;
+
+    /// Insert a block before the header of a loop that all branches into
+    /// the loop from outside of it go through.
+    void CreatePreheader(Loop* l) {
+        auto* header = l->header();
+        auto* f = header->function();
+        auto* pre = new (*mod) Block(fmt::format("{}.pre", header->name()));
+        f->blocks().insert(rgs::find(f->blocks(), header), pre);
+        pre->function(f);
+
+        /// Values coming in from outside the loop now come in from the
+        /// preheader; if there are several, merge them there.
+        for (auto* i : header->instructions()) {
+            auto* phi = cast<PhiInst>(i);
+            if (not phi) break;
+
+            std::vector<PhiInst::IncomingValue> outside{};
+            for (auto in : phi->operands())
+                if (not l->contains(in.block))
+                    outside.push_back(in);
+            if (outside.empty()) continue;
+
+            Value* value = outside.front().value;
+            if (rgs::any_of(outside, [&](auto& in) { return in.value != value; })) {
+                auto* merged = pre->create_phi(phi->type(), phi->location());
+                for (auto [v, b] : outside) merged->set_incoming(v, b);
+                value = merged;
+            }
+
+            for (auto& in : outside) phi->remove_incoming(in.block);
+            phi->set_incoming(value, pre);
+        }
+
+        /// Redirect branches from outside the loop.
+        std::vector<Inst*> branches{};
+        for (auto* u : header->users())
+            if (is<BranchInst, CondBranchInst>(u) and u->block() and not l->contains(u->block()))
+                branches.push_back(u);
+
+        for (auto* u : branches) {
+            if (auto* br = cast<BranchInst>(u)) br->target(pre);
+            else {
+                auto* cond = as<CondBranchInst>(u);
+                if (cond->then_block() == header) cond->then_block(pre);
+                if (cond->else_block() == header) cond->else_block(pre);
+            }
+        }
+
+        pre->insert(new (*mod) BranchInst(header));
+        SetChanged();
+    }
+};
 
 /// Optimisation pass that runs on an entire module.
 ///
 /// API:
 ///
+/// REQUIRED: static constexpr std::string_view name;
+///
+///     The name of the pass, as for instruction passes.
+///
 /// REQUIRED: void run();
 ///
 ///     Called once for the entire module.
 ///
+/// OPTIONAL: auto changed_functions() -> const std::unordered_set<Function*>&;
+///
+///     The functions whose bodies this pass has changed, so that
+///     the function passes run on them again.
+///
 struct ModuleRewritePass : OptimisationPass {};
 
 /// Pass that performs constant folding and propagation. Passes that
 /// operate on individual instructions and don’t really fit in anywhere
 /// else can also go here.
 struct InstCombinePass : InstructionRewritePass {
+    static constexpr std::string_view name = "icmb";
+    static constexpr bool use_worklist = true;
+
 private:
     /// Get the lhs and rhs of a binary expression as integer constants.
     static auto GetIntegerPair(BinaryInst* b) {
@@ -136,8 +347,127 @@ private:
         return Result{false, {}, {}};
     }
 
+    /// Compute the quotient of an unsigned division of `x` by `d`,
+    /// which is neither 0 nor 1, with the instructions inserted before
+    /// `i`. Returns nullptr if there is no cheaper way to do this than
+    /// to divide.
+    ///
+    /// Division by a constant that is not a power of two is a multiply
+    /// by a ‘magic number’ `m` followed by a shift (Granlund and
+    /// Montgomery, 1994): `x / d = (x * m) >> (N + s)` for all N-bit
+    /// `x` if `2^(N+s) <= m * d <= 2^(N+s) + 2^s`. We only have 64-bit
+    /// multiplications, so this is done for at most 32-bit integers,
+    /// whose product with `m` (which has at most N+1 bits) fits those.
+    auto UDivByConstant(Inst* i, Value* x, u64 d) -> Value* {
+        auto bits = x->type()->bits();
+        if (std::has_single_bit(d)) return Insert<ShrInst>(i, x, MakeInt(bits, u64(std::countr_zero(d))));
+        if (bits > 32) return nullptr;
+
+        for (usz s = 0; bits + s < 64; s++) {
+            u64 p = u64(1) << (bits + s);
+            u64 m = (p + d - 1) / d;
+            if (m * d - p > u64(1) << s) continue;
+
+            auto* wide = IntegerType::Get(mod->context(), 64);
+            auto* x64 = Insert<ZExtInst>(i, x, wide);
+            Value* q{};
+
+            /// If the product might not fit in 64 bits, which is only the
+            /// case for 32-bit integers, compute it in two halves: with
+            /// `m = 2^N + m'`, we have `x * m >> N = (x * m' >> N) + x`.
+            if (std::bit_width(m) + bits > 64) {
+                auto* mul = Insert<MulInst>(i, MakeInt(64, m - (u64(1) << bits)), x64);
+                auto* high = Insert<ShrInst>(i, mul, MakeInt(64, bits));
+                auto* add = Insert<AddInst>(i, high, x64);
+                q = Insert<ShrInst>(i, add, MakeInt(64, s));
+            } else {
+                auto* mul = Insert<MulInst>(i, MakeInt(64, m), x64);
+                q = Insert<ShrInst>(i, mul, MakeInt(64, bits + s));
+            }
+
+            return Insert<TruncInst>(i, q, x->type());
+        }
+
+        return nullptr;
+    }
+
+    /// Compute the quotient of a signed division of `x` by `d`, which
+    /// is neither 0 nor 1, with the instructions inserted before `i`.
+    /// Returns nullptr if there is no cheaper way to do this than to
+    /// divide.
+    ///
+    /// This uses the signed variant of the magic numbers above: for the
+    /// absolute value `|d|`, which is not a power of two, and N-bit `x`,
+    /// `x / |d| = (x * m) >> (N - 1 + s)`, plus 1 if `x` is negative, if
+    /// `2^(N-1+s) <= m * |d| <= 2^(N-1+s) + 2^s`.
+    auto SDivByConstant(Inst* i, Value* x, aint d) -> Value* {
+        auto bits = x->type()->bits();
+        auto negative = d.is_negative();
+        auto abs = negative ? (-d).value() : d.value();
+
+        /// Division by a power of two is a right shift, but that rounds
+        /// towards negative infinity, so add `d - 1` to negative values
+        /// first. We have no cheap way of negating the result, so leave
+        /// negative powers of two alone.
+        if (std::has_single_bit(abs)) {
+            if (negative) return nullptr;
+            auto k = u64(std::countr_zero(abs));
+            auto* sign = Insert<SarInst>(i, x, MakeInt(bits, bits - 1));
+            auto* bias = Insert<ShrInst>(i, sign, MakeInt(bits, bits - k));
+            auto* add = Insert<AddInst>(i, x, bias);
+            return Insert<SarInst>(i, add, MakeInt(bits, k));
+        }
+
+        if (bits > 32) return nullptr;
+        for (usz s = 0; bits - 1 + s < 64; s++) {
+            u64 p = u64(1) << (bits - 1 + s);
+            u64 m = (p + abs - 1) / abs;
+            if (m * abs - p > u64(1) << s) continue;
+
+            /// `m` is at most 2^N, and the absolute value of `x` at most
+            /// 2^(N-1), so the product fits in 64 bits.
+            auto* wide = IntegerType::Get(mod->context(), 64);
+            auto* x64 = Insert<SExtInst>(i, x, wide);
+            auto* mul = Insert<MulInst>(i, MakeInt(64, m), x64);
+            auto* q = Insert<SarInst>(i, mul, MakeInt(64, bits - 1 + s));
+
+            /// For a negative divisor, negate the quotient: `-(q + 1)` is
+            /// `-1 - q`, and the sign of `x` is -1 if it is negative.
+            Value* res{};
+            if (negative) {
+                auto* sign = Insert<SarInst>(i, x64, MakeInt(64, 63));
+                res = Insert<SubInst>(i, sign, q);
+            } else {
+                auto* sign = Insert<ShrInst>(i, x64, MakeInt(64, 63));
+                res = Insert<AddInst>(i, q, sign);
+            }
+
+            return Insert<TruncInst>(i, res, x->type());
+        }
+
+        return nullptr;
+    }
+
+    /// Replace a multiplication by a power of two, or by one more or
+    /// one less than that, with a shift followed by an add or sub.
+    void MulByConstant(MulInst* mul, aint c) {
+        auto bits = c.bits();
+        auto one = aint(bits, aint::Word(1));
+        auto* x = mul->rhs();
+
+        if (c.is_power_of_two()) {
+            Replace<ShlInst>(mul, x, MakeInt(bits, c.log2()), mul->location());
+        } else if (c > u64(2) and (c - one).is_power_of_two()) {
+            auto* shl = Insert<ShlInst>(mul, x, MakeInt(bits, (c - one).log2()));
+            Replace<AddInst>(mul, shl, x, mul->location());
+        } else if (c > u64(2) and (c + one).is_power_of_two()) {
+            auto* shl = Insert<ShlInst>(mul, x, MakeInt(bits, (c + one).log2()));
+            Replace<SubInst>(mul, shl, x, mul->location());
+        }
+    }
+
     /// Handle signed and unsigned division.
-    template <typename DivInst, typename ShiftInst, auto Eval>
+    template <typename DivInst, auto Eval>
     void DivImpl(Inst* i) {
         auto d = as<DivInst>(i);
         auto rhs = cast<IntegerConstant>(d->rhs());
@@ -154,15 +484,50 @@ private:
             Replace(i, Eval(lhs->value(), rhs->value()));
         }
 
-        /// Division by a power of two is a right shift (note that
-        /// this only works for *unsigned* division; for signed
-        /// division, we defer optimising this to the backend).
-        else {
-            if constexpr (std::is_same_v<DivInst, UDivInst>) {
-                if (rhs->value().is_power_of_two()) {
-                    Replace<ShiftInst>(i, d->lhs(), MakeInt(rhs->value().log2()), d->location());
-                }
+        /// Division by any other constant can be done using shifts
+        /// and multiplications.
+        else if (is<IntegerType>(d->type())) {
+            Value* q{};
+            if constexpr (std::is_same_v<DivInst, UDivInst>) q = UDivByConstant(i, d->lhs(), rhs->value().value());
+            else q = SDivByConstant(i, d->lhs(), rhs->value());
+            if (q) Replace(i, q);
+        }
+    }
+
+    /// Handle signed and unsigned remainder.
+    template <typename RemInst, auto Eval>
+    void RemImpl(Inst* i) {
+        auto r = as<RemInst>(i);
+        auto rhs = cast<IntegerConstant>(r->rhs());
+        if (not rhs) return;
+
+        /// Check for division by zero.
+        if (rhs->value() == 0) Replace<PoisonValue>(i, r->type());
+
+        /// The remainder of a division by 1 is 0.
+        else if (rhs->value() == 1) Replace<IntegerConstant>(i, i->type(), 0);
+
+        /// Evaluate the remainder if both operands are constants.
+        else if (auto lhs = cast<IntegerConstant>(r->lhs())) {
+            Replace(i, Eval(lhs->value(), rhs->value()));
+        }
+
+        /// Otherwise, the remainder is `x - x / d * d`, or, for unsigned
+        /// division by a power of two, just the low bits of `x`.
+        else if (is<IntegerType>(r->type())) {
+            auto d = rhs->value();
+            if (std::is_same_v<RemInst, URemInst> and d.is_power_of_two()) {
+                Replace<AndInst>(i, r->lhs(), MakeInt(d - aint(d.bits(), aint::Word(1))), r->location());
+                return;
             }
+
+            Value* q{};
+            if constexpr (std::is_same_v<RemInst, URemInst>) q = UDivByConstant(i, r->lhs(), d.value());
+            else q = SDivByConstant(i, r->lhs(), d);
+            if (not q) return;
+
+            auto* mul = Insert<MulInst>(i, rhs, q);
+            Replace<SubInst>(i, r->lhs(), mul, r->location());
         }
     }
 
@@ -238,7 +603,7 @@ public:
                         auto rlhs = cast<IntegerConstant>(radd->lhs());
                         add->lhs(MakeInt(lhs->value() + rlhs->value()));
                         add->rhs(radd->rhs());
-                        SetChanged();
+                        SetChanged(add);
                     }
                 }
 
@@ -247,7 +612,7 @@ public:
                     if (rhs->value() == 0) Replace(i, add->lhs());
                     else {
                         add->swap_operands();
-                        SetChanged();
+                        SetChanged(add);
                     }
                 }
             } break;
@@ -257,8 +622,9 @@ public:
                 auto* lhs = cast<IntegerConstant>(sub->lhs());
                 auto* rhs = cast<IntegerConstant>(sub->rhs());
 
-                /// If the operands are the same, the result is 0.
-                if (sub->lhs() == sub->rhs())
+                /// If the operands are the same, the result is 0. There
+                /// are no vector constants, so leave vectors alone.
+                if (sub->lhs() == sub->rhs() and is<IntegerType>(i->type()))
                     Replace<IntegerConstant>(i, i->type(), 0);
 
                 /// Evaluate if possible.
@@ -296,7 +662,9 @@ public:
                         auto* rlhs = cast<IntegerConstant>(rmul->lhs());
                         mul->lhs(MakeInt(lhs->value() * rlhs->value()));
                         mul->rhs(rmul->rhs());
-                        SetChanged();
+                        SetChanged(mul);
+                    } else {
+                        MulByConstant(mul, lhs->value());
                     }
                 }
 
@@ -306,7 +674,7 @@ public:
                         Replace(i, mul->lhs());
                     else {
                         mul->swap_operands();
-                        SetChanged();
+                        SetChanged(mul);
                     }
                 }
             } break;
@@ -325,10 +693,9 @@ public:
                 /// Make sure they’re right next to each other in the
                 /// same block, else intervening operations might change
                 /// the semantics of this.
-                auto* b = s->block();
                 if (not s->block() or not l->block()) break;
                 if (s->block() != l->block()) break;
-                if (std::next(rgs::find(b->instructions(), l)) != rgs::find(b->instructions(), s)) break;
+                if (l->next() != s) break;
 
                 /// Insert a memcpy.
                 Create<IntrinsicInst>(
@@ -361,7 +728,7 @@ public:
                     if (nested->operand()->type() == b->type()) Replace(b, nested->operand());
                     else {
                         b->operand(nested->operand());
-                        SetChanged();
+                        SetChanged(b);
                     }
                 }
             } break;
@@ -376,11 +743,19 @@ public:
             } break;
 
             case Value::Kind::SDiv:
-                DivImpl<SDivInst, SarInst, [](auto l, auto r) { return l.sdiv(r); }>(i);
+                DivImpl<SDivInst, [](auto l, auto r) { return l.sdiv(r); }>(i);
                 break;
 
             case Value::Kind::UDiv:
-                DivImpl<UDivInst, ShrInst, [](auto l, auto r) { return l.udiv(r); }>(i);
+                DivImpl<UDivInst, [](auto l, auto r) { return l.udiv(r); }>(i);
+                break;
+
+            case Value::Kind::SRem:
+                RemImpl<SRemInst, [](auto l, auto r) { return l.srem(r); }>(i);
+                break;
+
+            case Value::Kind::URem:
+                RemImpl<URemInst, [](auto l, auto r) { return l.urem(r); }>(i);
                 break;
 
             case Value::Kind::Eq: CmpImpl < &aint::operator==>(i); break;
@@ -407,6 +782,10 @@ public:
 /// into multiple variables if possible so we can optimise
 /// each one in isolation.
 struct SROAPass : InstructionRewritePass {
+    static constexpr std::string_view name = "sroa";
+    static constexpr bool preserves_cfg = true;
+    static inline Statistic split{name, "split", "Allocas of aggregates split into their elements"};
+
 private:
     void TrySplitAlloca(AllocaInst* a) {
         /// Skip if this is not a struct or array type.
@@ -547,6 +926,7 @@ private:
 
         /// Finally, delete the original alloca.
         a->erase();
+        ++split;
     }
 
     /// Split a struct into multiple variables; since structs
@@ -579,6 +959,18 @@ private:
                 continue;
             }
 
+            /// Copy a memcpy into the struct member by member.
+            if (auto* cpy = cast<IntrinsicInst>(u)) {
+                for (auto&& [i, inst] : vws::enumerate(insts)) {
+                    auto* addr = Create<GetMemberPtrInst>(cpy, stype, cpy->operands()[1], MakeInt(u64(i)));
+                    auto* load = Create<LoadInst>(addr, stype->members()[usz(i)], addr);
+                    Create<StoreInst>(load, load, inst);
+                }
+
+                cpy->erase();
+                continue;
+            }
+
             /// Replace loads and stores with the first element.
             if (auto* l = cast<LoadInst>(u)) l->ptr(insts[0]);
             else as<StoreInst>(u)->ptr(insts[0]);
@@ -586,6 +978,7 @@ private:
 
         /// Finally, delete the original alloca.
         a->erase();
+        ++split;
         SetChanged();
     }
 
@@ -598,6 +991,11 @@ public:
 
 /// Pass that performs simple store forwarding.
 struct StoreFowardingPass : InstructionRewritePass {
+    static constexpr std::string_view name = "sfwd";
+    static constexpr bool preserves_cfg = true;
+    static inline Statistic forwarded{name, "forwarded", "Loads replaced with the value last stored"};
+    static inline Statistic stores_erased{name, "stores-erased", "Stores erased because they were never loaded"};
+
     struct Var {
         AllocaInst* alloca;
         StoreInst* store{};
@@ -650,6 +1048,7 @@ struct StoreFowardingPass : InstructionRewritePass {
             /// Otherwise, replace this with the last value.
             l->replace_with(var->last_value);
             var->last_store_used = true;
+            ++forwarded;
             SetChanged();
             return;
         }
@@ -696,8 +1095,8 @@ struct StoreFowardingPass : InstructionRewritePass {
             var->last_store_used = true;
         }
 
-        /// Calls invalidate all escaped values.
-        if (is<CallInst>(i)) {
+        /// Calls and memory intrinsics invalidate all escaped values.
+        if (is<CallInst, IntrinsicInst>(i)) {
             for (auto& var : vars) {
                 if (var.escaped) {
                     var.last_store_used = true;
@@ -712,6 +1111,7 @@ private:
     void EraseLastStoreIfUnused(Var& var) {
         if (var.store and var.last_value == var.store->val() and not var.last_store_used) {
             var.store->erase();
+            ++stores_erased;
             SetChanged();
         }
     }
@@ -719,6 +1119,11 @@ private:
 
 /// SSA construction pass (aka mem2reg).
 struct SSAConstructionPass : InstructionRewritePass {
+    static constexpr std::string_view name = "ssa";
+    static constexpr bool preserves_cfg = true;
+    static inline Statistic promoted{name, "promoted", "Allocas promoted to SSA values"};
+    static inline Statistic phis_inserted{name, "phis-inserted", "PHIs inserted"};
+
     std::vector<AllocaInst*> allocas{};
 
     void run_on_instruction(Inst* i) {
@@ -727,82 +1132,88 @@ struct SSAConstructionPass : InstructionRewritePass {
     }
 
     void run_on_function(Function* f) {
-        DomTree dom_tree{f};
-
         /// Determine what allocas we can convert.
         auto optimisable = utils::to_vec(allocas | vws::filter(Optimisable));
         if (optimisable.empty()) return;
+        promoted += optimisable.size();
         SetChanged();
 
-        /// Definitions of a variable.
-        std::unordered_map<AllocaInst*, std::vector<Inst*>> defs{optimisable.size()};
-
-        /// Map from PHIs to their corresponding allocas.
-        using Entry = std::pair<PhiInst*, AllocaInst*>;
-        std::vector<Entry> phis;
-
-        /// Get a value of a variable from a definition if it is one.
-        auto DefinedValue = [&](AllocaInst* a, Inst* def) -> Value* {
-            auto d = rgs::find(defs[a], def);
-            if (d == defs[a].end()) return nullptr;
-            if (auto* s = cast<StoreInst>(*d)) return s->val();
-            return *d;
-        };
-
-        /// Get the reaching definition of a variable for an instruction.
-        /// FIXME: This is currently *very* dumb and inefficient...
-        auto ReachingDef = [&](AllocaInst* a, Inst* user) -> Value* {
-            /// Search backwards in this block.
-            for (auto* i : vws::reverse(user->instructions_before_this())) {
-                auto* d = DefinedValue(a, i);
-                if (d) return d;
-            }
-
-            /// Search dominators.
-            for (auto* b : dom_tree.parents(user->block())) {
-                for (auto* i : vws::reverse(b->instructions())) {
-                    auto* d = DefinedValue(a, i);
-                    if (d) return d;
-                }
-            }
+        const auto& dom_tree = analyses->dominators();
 
-            /// No reaching def!
-            return new (*mod) PoisonValue(a->allocated_type());
-        };
+        /// Index of each variable, and the variable each of the PHIs
+        /// we insert is for.
+        std::unordered_map<Value*, usz> variables{optimisable.size()};
+        std::unordered_map<PhiInst*, usz> phis{};
+        for (auto [i, a] : vws::enumerate(optimisable)) variables[a] = usz(i);
 
-        /// Insert PHIs for each alloca.
+        /// Insert a PHI for each alloca at each block of DF+(defs).
         for (auto [i, a] : vws::enumerate(optimisable)) {
-            /// Collect definitions.
             auto def_blocks = a->users()
                             | vws::filter([](Inst* u) { return is<StoreInst>(u); })
                             | vws::transform(&Inst::block);
 
-            /// Insert a PHI at each block of DF+(defs).
-            for (auto* b : dom_tree.iterated_dom_frontier(def_blocks)) {
-                auto* phi = b->create_phi(a->allocated_type(), a->location());
-                defs[a].push_back(phi);
-                phis.emplace_back(phi, a);
-            }
+            for (auto* b : dom_tree.iterated_dom_frontier(def_blocks))
+                phis[b->create_phi(a->allocated_type(), a->location())] = usz(i);
         }
+        phis_inserted += phis.size();
+
+        /// Reaching definitions of each variable: the innermost one is
+        /// at the back. Every definition pushed is also recorded in the
+        /// log so it can be popped again once we leave the subtree of the
+        /// dominator tree that it is in scope in.
+        std::vector<std::vector<Value*>> defs(optimisable.size());
+        std::vector<usz> log{};
+        auto Define = [&](usz var, Value* v) {
+            defs[var].push_back(v);
+            log.push_back(var);
+        };
 
-        /// Add incoming values for each reaching definition.
-        for (auto* b : dom_tree.dfs_preorder()) {
-            for (auto* i : b->instructions()) {
-                /// If this instruction is a store to an optimisable
-                /// alloca, mark it as the new reaching definition.
-                if (auto* s = cast<StoreInst>(i)) {
-                    auto a = rgs::find(optimisable, s->ptr());
-                    if (a != optimisable.end()) defs[*a].push_back(s);
+        /// Get the reaching definition of a variable.
+        auto ReachingDef = [&](usz var) -> Value* {
+            if (defs[var].empty()) return new (*mod) PoisonValue(optimisable[var]->allocated_type());
+            return defs[var].back();
+        };
+
+        /// Get the variable that a load from or store to a pointer accesses.
+        auto Variable = [&](Value* ptr) -> std::optional<usz> {
+            auto it = variables.find(ptr);
+            if (it == variables.end()) return std::nullopt;
+            return it->second;
+        };
+
+        /// Rename the variables by walking the dominator tree; each block
+        /// is paired with the size of the log before we entered it, or
+        /// with -1 if we haven’t entered it yet.
+        std::vector<std::pair<Block*, usz>> stack{{dom_tree.root(), -1zu}};
+        while (not stack.empty()) {
+            auto [b, mark] = stack.back();
+
+            /// Leaving the block; its definitions go out of scope.
+            if (mark != -1zu) {
+                for (; log.size() > mark; log.pop_back()) defs[log.back()].pop_back();
+                stack.pop_back();
+                continue;
+            }
+
+            stack.back().second = log.size();
+            for (auto* i = b->instructions().front(); i;) {
+                auto* next = i->next();
+
+                /// A PHI we inserted or a store to an optimisable alloca
+                /// is the new reaching definition of its variable.
+                if (auto* phi = cast<PhiInst>(i)) {
+                    if (auto it = phis.find(phi); it != phis.end()) Define(it->second, phi);
+                } else if (auto* st = cast<StoreInst>(i)) {
+                    if (auto var = Variable(st->ptr())) Define(*var, st->val());
+                }
+
+                /// Replace a load of an optimisable alloca with the reaching
+                /// definition of that alloca.
+                else if (auto* l = cast<LoadInst>(i)) {
+                    if (auto var = Variable(l->ptr())) l->replace_with(ReachingDef(*var));
                 }
 
-                /// If this instruction uses a load of an optimisable
-                /// alloca, replace the load with the reaching definition
-                /// of that alloca.
-                i->replace_children<LoadInst>([&](LoadInst* l) -> Value* {
-                    auto a = rgs::find(optimisable, l->ptr());
-                    if (a == optimisable.end()) return nullptr;
-                    return ReachingDef(*a, l);
-                });
+                i = next;
             }
 
             /// Update PHIs in successors.
@@ -812,10 +1223,13 @@ struct SSAConstructionPass : InstructionRewritePass {
                     if (not phi) break;
 
                     /// This is one of the PHIs we inserted for a specific variable.
-                    if (auto it = rgs::find(phis, phi, &Entry::first); it != phis.end())
-                        phi->set_incoming(ReachingDef(it->second, b->instructions().back()), b);
+                    if (auto it = phis.find(phi); it != phis.end())
+                        phi->set_incoming(ReachingDef(it->second), b);
                 }
             }
+
+            /// Visit the blocks dominated by this one before leaving it.
+            for (auto* c : dom_tree.immediately_dominated(b)) stack.emplace_back(c, -1zu);
         }
 
         /// Lastly, erase all allocas.
@@ -839,161 +1253,1667 @@ private:
     }
 };
 
-/// CFG simplification pass.
-struct CFGSimplPass : InstructionRewritePass {
-    void run_on_function(Function* f) {
-        /// We start at 1 because the entry block is always reachable.
-        for (usz i = 1; i < f->blocks().size(); /** No increment! **/) {
-            auto* b = f->blocks()[i];
+/// Replace loads with the value stored by the only store that reaches
+/// them, across blocks.
+///
+/// Starting at the version of memory a load uses, walk memory SSA back
+/// past every store that can’t overlap the loaded bytes, and through
+/// PHIs into all predecessors. If every path ends at a store of the
+/// same value to exactly those bytes, the load is replaced with that
+/// value; the value must dominate all of those stores, and thus the
+/// load. Anything else that may write to the loaded bytes, including
+/// memory as it was on entry to the function, stops this.
+///
+/// Aggregates are left alone, since module lowering expects those to
+/// only be copied in memory.
+struct MemoryForwardingPass : InstructionRewritePass {
+    static constexpr std::string_view name = "mfwd";
+    static constexpr bool preserves_cfg = true;
+    static inline Statistic forwarded{name, "forwarded", "Loads replaced with the value stored on every path to them"};
 
-            /// Count how many users of this block are not PHIs.
-            Inst* branch = nullptr;
-            for (auto* u : b->users()) {
-                if (not is<PhiInst>(u)) {
-                    if (branch) {
-                        ++i;
-                        continue;
-                    }
-                    branch = u;
-                }
+    void run_on_function(Function* f) {
+        MemorySSA mssa{f, analyses->dominators()};
+        for (auto* b : f->blocks()) {
+            for (auto* i = b->instructions().front(); i;) {
+                auto* next = i->next();
+                if (auto* l = cast<LoadInst>(i)) Forward(mssa, l);
+                i = next;
             }
+        }
+    }
 
-            // If there is only one non-PHI user, and that user is a direct branch to
-            // this, inline this block into the block containing that branch
-            if (branch) {
-                if (not is<BranchInst>(branch)) {
-                    ++i;
-                    continue;
-                }
-                branch->block()->merge(b);
+private:
+    void Forward(MemorySSA& mssa, LoadInst* l) {
+        auto* a = mssa.access(l);
+        if (not a or is<StructType, ArrayType>(l->type()) or l->type()->bits() > 64) return;
+
+        auto loc = MemorySSA::location(l);
+        Value* value{};
+        std::unordered_set<MemoryAccess*> visited{};
+        std::vector<MemoryAccess*> pending{a->defining_access()};
+        while (not pending.empty()) {
+            auto* m = pending.back();
+            pending.pop_back();
+            if (not visited.insert(m).second) continue;
+
+            if (m->kind() == MemoryAccess::Kind::Phi) {
+                for (auto [_, in] : m->incoming_values()) pending.push_back(in);
+                continue;
             }
-            // Otherwise, the block is unreachable. Remove it from all PHIs.
-            else {
-                for (auto* u : b->users()) {
-                    auto* phi = as<PhiInst>(u);
-                    phi->remove_incoming(b);
-                }
 
-                /// Yeet!
-                b->erase();
+            auto* s = m->inst() ? cast<StoreInst>(m->inst()) : nullptr;
+            if (s and mssa.alias(MemorySSA::location(s), loc) == AliasResult::MustAlias) {
+                if (value and value != s->val()) return;
+                value = s->val();
+                continue;
             }
 
-            // Don't increment, since we may just have removed this block, and
-            // incrementing would cause use to skip the next one.
-            SetChanged();
+            if (mssa.may_write(m, loc)) return;
+            pending.push_back(m->defining_access());
         }
-    }
-};
 
-/// Eliminate instructions whose results are unused if they have no side-effects.
-struct DCEPass : InstructionRewritePass {
-    void run_on_instruction(Inst* i) {
-        if (not i->users().empty()) return;
-        switch (i->kind()) {
-            default: return;
-            case Value::Kind::GetElementPtr:
-            case Value::Kind::Load:
-            case Value::Kind::Phi:
-            case Value::Kind::ZExt:
-            case Value::Kind::SExt:
-            case Value::Kind::Trunc:
-            case Value::Kind::Bitcast:
-            case Value::Kind::Neg:
-            case Value::Kind::Copy:
-            case Value::Kind::Compl:
-            case Value::Kind::Add:
-            case Value::Kind::Sub:
-            case Value::Kind::Mul:
-            case Value::Kind::SDiv:
-            case Value::Kind::UDiv:
-            case Value::Kind::SRem:
-            case Value::Kind::URem:
-            case Value::Kind::Shl:
-            case Value::Kind::Sar:
-            case Value::Kind::Shr:
-            case Value::Kind::And:
-            case Value::Kind::Or:
-            case Value::Kind::Xor:
-            case Value::Kind::Eq:
-            case Value::Kind::Ne:
-            case Value::Kind::SLt:
-            case Value::Kind::SLe:
-            case Value::Kind::SGt:
-            case Value::Kind::SGe:
-            case Value::Kind::ULt:
-            case Value::Kind::ULe:
-            case Value::Kind::UGt:
-            case Value::Kind::UGe:
-                i->erase();
-                SetChanged();
-                return;
-        }
+        if (not value or value->type() != l->type()) return;
+        mssa.remove(l);
+        l->replace_with(value);
+        ++forwarded;
+        SetChanged();
     }
 };
 
-struct GlobalDCEPass : ModuleRewritePass {
-    void run() {
-        for (usz i = 0; i < mod->code().size(); /** No increment! **/) {
-            auto* f = mod->code()[i];
-
-            // Check if exported.
-            bool exported{false};
-            for (const auto& n : f->names()) {
-                if (IsExportedLinkage(n.linkage)) {
-                    exported = true;
-                    break;
+/// Dead store elimination.
+///
+/// A store is dead if, on every path from it, the bytes it writes are
+/// overwritten by another store before anything may read them; this
+/// includes returning from the function for anything but our own
+/// allocas, and calls for anything they may see. Memory SSA is kept up
+/// to date as stores are erased, so chains of dead stores to the same
+/// location are all erased in one go.
+struct DeadStoreEliminationPass : InstructionRewritePass {
+    static constexpr std::string_view name = "dse";
+    static constexpr bool preserves_cfg = true;
+    static inline Statistic erased{name, "erased", "Stores erased because nothing can read what they store"};
+
+    void run_on_function(Function* f) {
+        MemorySSA mssa{f, analyses->dominators()};
+        for (auto* b : f->blocks()) {
+            for (auto* i = b->instructions().front(); i;) {
+                auto* next = i->next();
+                if (auto* s = cast<StoreInst>(i); s and Dead(mssa, s)) {
+                    mssa.remove(s);
+                    s->erase();
+                    ++erased;
+                    SetChanged();
                 }
+                i = next;
             }
+        }
+    }
 
-            // Do not delete exported functions or used functions.
-            if (exported or not f->users().empty()) {
-                i++;
-                continue;
+private:
+    [[nodiscard]]
+    static auto Dead(const MemorySSA& mssa, StoreInst* s) -> bool {
+        auto* a = mssa.access(s);
+        if (not a) return false;
+
+        /// Walk forward until every path has overwritten what we stored.
+        auto loc = MemorySSA::location(s);
+        std::unordered_set<MemoryAccess*> visited{};
+        std::vector<MemoryAccess*> pending{a};
+        while (not pending.empty()) {
+            auto* m = pending.back();
+            pending.pop_back();
+            if (not visited.insert(m).second) continue;
+
+            for (auto* u : m->users()) {
+                if (mssa.may_read(u, loc)) return false;
+                if (u->kind() == MemoryAccess::Kind::Use) continue;
+                auto* other = u->inst() ? cast<StoreInst>(u->inst()) : nullptr;
+                if (other and MemorySSA::covers(MemorySSA::location(other), loc)) continue;
+                pending.push_back(u);
             }
-
-            /// Yeet.
-            mod->code().erase(mod->code().begin() + isz(i));
         }
-    }
-};
 
-/// Debugging pass to print the dominator tree of a function.
-struct PrintDOMTreePass : InstructionRewritePass {
-    static void run_on_function(Function* f) {
-        fmt::print("{}", DomTree{f, false}.debug());
+        return true;
     }
 };
 
-struct Optimiser {
-    Module* mod;
+/// Sparse conditional constant propagation.
+///
+/// Every instruction starts out with an unknown value, which can only
+/// ever be lowered to a constant, and then to ‘overdefined’, i.e. not
+/// a constant. A block is only visited once an edge into it is known to
+/// be taken, so values coming in along edges that are never taken don’t
+/// keep a PHI from being folded, and conditional branches on constants
+/// found this way don’t keep the blocks they skip alive.
+///
+/// Blocks found to be dead are cut off from the rest of the function
+/// and left for CFGSimplPass to remove.
+struct SCCPPass : InstructionRewritePass {
+    static constexpr std::string_view name = "sccp";
+    static inline Statistic dead_blocks{name, "dead-blocks", "Unreachable blocks cut off"};
+    static inline Statistic branches_folded{name, "branches-folded", "Conditional branches on constants folded"};
+
+    /// A value in the lattice.
+    struct Lattice {
+        enum struct State {
+            Unknown,
+            Constant,
+            Overdefined,
+        };
 
-    /// TODO: Actually use this.
-    [[maybe_unused]] int opt_level;
+        /// Value-initialised lattice values are unknown.
+        State state;
+        aint value;
 
-    /// Entry point.
-    void run() { // clang-format off
-        RunPasses<
-            InstCombinePass,
-            SROAPass,
-            StoreFowardingPass,
-            CFGSimplPass,
-            SSAConstructionPass,
-            DCEPass,
-            GlobalDCEPass
-        >();
-    } // clang-format on
+        [[nodiscard]] auto constant() const -> bool { return state == State::Constant; }
+        [[nodiscard]] auto overdefined() const -> bool { return state == State::Overdefined; }
+        [[nodiscard]] auto unknown() const -> bool { return state == State::Unknown; }
+    };
 
-    /// Entry point for running select passes.
-    void run_passes(std::string_view passes) {
-        for (const auto& p : vws::split(passes, ',')) {
-            auto s = std::string_view{p};
+    static constexpr Lattice Overdefined{Lattice::State::Overdefined, {}};
+
+    /// The value of every instruction visited so far.
+    std::unordered_map<Inst*, Lattice> values{};
+
+    /// Blocks known to be reachable.
+    std::unordered_set<Block*> executable{};
+
+    /// For each block, the predecessors whose edges to it are taken.
+    std::unordered_map<Block*, std::unordered_set<Block*>> taken{};
+
+    /// Edges to follow (source, target); the entry block has no source.
+    std::vector<std::pair<Block*, Block*>> cfg_worklist{};
+
+    /// Instructions whose operands have changed.
+    std::vector<Inst*> ssa_worklist{};
+
+    void run_on_function(Function* f) {
+        if (f->blocks().empty()) return;
+        cfg_worklist.emplace_back(nullptr, f->entry());
+        while (not cfg_worklist.empty() or not ssa_worklist.empty()) {
+            while (not cfg_worklist.empty()) {
+                auto [from, to] = cfg_worklist.back();
+                cfg_worklist.pop_back();
+                if (from and not taken[to].insert(from).second) continue;
+
+                /// Visit every instruction the first time we reach a block;
+                /// after that, only the PHIs can change.
+                bool first = executable.insert(to).second;
+                for (auto* i : to->instructions()) {
+                    if (not first and not is<PhiInst>(i)) break;
+                    Visit(i);
+                }
+            }
+
+            while (not ssa_worklist.empty()) {
+                auto* i = ssa_worklist.back();
+                ssa_worklist.pop_back();
+                if (executable.contains(i->block())) Visit(i);
+            }
+        }
+
+        Rewrite(f);
+    }
+
+private:
+    /// Get the value of an operand.
+    auto Get(Value* v) -> Lattice {
+        if (auto* c = cast<IntegerConstant>(v)) return {Lattice::State::Constant, c->value()};
+        if (auto* i = cast<Inst>(v)) {
+            auto it = values.find(i);
+            return it == values.end() ? Lattice{} : it->second;
+        }
+
+        /// Parameters, globals, poison, etc.
+        return Overdefined;
+    }
+
+    /// Combine the values of two incoming edges.
+    static auto Meet(Lattice a, Lattice b) -> Lattice {
+        if (a.unknown()) return b;
+        if (b.unknown()) return a;
+        if (a.constant() and b.constant() and a.value.bits() == b.value.bits() and a.value == b.value) return a;
+        return Overdefined;
+    }
+
+    /// Check if the edge from one block to another is taken.
+    auto Taken(Block* from, Block* to) -> bool {
+        auto it = taken.find(to);
+        return it != taken.end() and it->second.contains(from);
+    }
+
+    /// Evaluate a binary instruction whose operands are constants.
+    static auto Fold(Inst* i, aint l, aint r) -> Lattice {
+        auto Const = [](aint v) { return Lattice{Lattice::State::Constant, v}; };
+
+        /// Don’t fold anything whose result is undefined.
+        auto DivOk = [&] { return r != 0; };
+        auto SDivOk = [&] { return r != 0 and not(~r == 0 and l == l.sign_bit()); };
+        auto ShiftOk = [&] { return r.value() < l.bits(); };
+
+        switch (i->kind()) {
+            default: return Overdefined;
+            case Value::Kind::Add: return Const(l + r);
+            case Value::Kind::Sub: return Const(l - r);
+            case Value::Kind::Mul: return Const(l * r);
+            case Value::Kind::And: return Const(l & r);
+            case Value::Kind::Or: return Const(l | r);
+            case Value::Kind::Xor: return Const(l ^ r);
+            case Value::Kind::SDiv: return SDivOk() ? Const(l.sdiv(r)) : Overdefined;
+            case Value::Kind::SRem: return SDivOk() ? Const(l.srem(r)) : Overdefined;
+            case Value::Kind::UDiv: return DivOk() ? Const(l.udiv(r)) : Overdefined;
+            case Value::Kind::URem: return DivOk() ? Const(l.urem(r)) : Overdefined;
+            case Value::Kind::Shl: return ShiftOk() ? Const(l.shl(r)) : Overdefined;
+            case Value::Kind::Shr: return ShiftOk() ? Const(l.shr(r)) : Overdefined;
+            case Value::Kind::Sar: return ShiftOk() ? Const(l.sar(r)) : Overdefined;
+            case Value::Kind::Eq: return Const(l == r);
+            case Value::Kind::Ne: return Const(l != r);
+            case Value::Kind::SLt: return Const(l.slt(r));
+            case Value::Kind::SLe: return Const(l.sle(r));
+            case Value::Kind::SGt: return Const(l.sgt(r));
+            case Value::Kind::SGe: return Const(l.sge(r));
+            case Value::Kind::ULt: return Const(l.ult(r));
+            case Value::Kind::ULe: return Const(l.ule(r));
+            case Value::Kind::UGt: return Const(l.ugt(r));
+            case Value::Kind::UGe: return Const(l.uge(r));
+        }
+    }
+
+    /// Compute the value of an instruction from that of its operands.
+    auto Evaluate(Inst* i) -> Lattice {
+        switch (i->kind()) {
+            default: {
+                auto* b = cast<BinaryInst>(i);
+                if (not b) return Overdefined;
+                auto l = Get(b->lhs());
+                auto r = Get(b->rhs());
+                if (l.overdefined() or r.overdefined()) return Overdefined;
+                if (l.unknown() or r.unknown()) return {};
+                return Fold(i, l.value, r.value);
+            }
+
+            case Value::Kind::Phi: {
+                Lattice l{};
+                for (auto [value, block] : as<PhiInst>(i)->operands())
+                    if (Taken(block, i->block()))
+                        l = Meet(l, Get(value));
+                return l;
+            }
+
+            case Value::Kind::ZExt:
+            case Value::Kind::SExt:
+            case Value::Kind::Trunc:
+            case Value::Kind::Neg:
+            case Value::Kind::Compl:
+            case Value::Kind::Copy: {
+                auto* ty = cast<IntegerType>(i->type());
+                auto op = Get(as<UnaryInstBase>(i)->operand());
+                if (not ty) return Overdefined;
+                if (not op.constant()) return op;
+
+                auto bits = u8(ty->bitwidth());
+                switch (i->kind()) {
+                    case Value::Kind::ZExt: op.value = op.value.zext(bits); break;
+                    case Value::Kind::SExt: op.value = op.value.sext(bits); break;
+                    case Value::Kind::Trunc: op.value = op.value.trunc(bits); break;
+                    case Value::Kind::Neg: op.value = -op.value; break;
+                    case Value::Kind::Compl: op.value = ~op.value; break;
+                    default: break;
+                }
+                return op;
+            }
+        }
+    }
+
+    /// Queue an edge to be followed.
+    void MarkEdge(Block* from, Block* to) {
+        if (not Taken(from, to)) cfg_worklist.emplace_back(from, to);
+    }
+
+    /// Visit an instruction in a reachable block.
+    void Visit(Inst* i) {
+        switch (i->kind()) {
+            case Value::Kind::Branch:
+                MarkEdge(i->block(), as<BranchInst>(i)->target());
+                return;
+
+            case Value::Kind::CondBranch: {
+                auto* br = as<CondBranchInst>(i);
+                auto cond = Get(br->cond());
+                if (cond.constant()) MarkEdge(i->block(), cond.value == 1 ? br->then_block() : br->else_block());
+                else if (cond.overdefined()) {
+                    MarkEdge(i->block(), br->then_block());
+                    MarkEdge(i->block(), br->else_block());
+                }
+                return;
+            }
+
+            case Value::Kind::Return:
+            case Value::Kind::Unreachable:
+                return;
+
+            default: {
+                auto& current = values[i];
+                auto updated = Meet(current, Evaluate(i));
+                if (updated.state == current.state) return;
+                current = updated;
+                ssa_worklist.insert(ssa_worklist.end(), i->users().begin(), i->users().end());
+            }
+        }
+    }
+
+    /// Remove a block from the PHIs in another block.
+    static void RemoveIncoming(Block* from, Block* to) {
+        for (auto* i : to->instructions()) {
+            auto* phi = cast<PhiInst>(i);
+            if (not phi) break;
+            phi->remove_incoming(from);
+        }
+    }
+
+    /// Apply what we’ve found to the function.
+    void Rewrite(Function* f) {
+        std::vector<Inst*> constants{};
+        for (auto* b : f->blocks()) {
+            auto* term = b->terminator();
+
+            /// Cut off dead blocks; they no longer have predecessors once
+            /// every other dead block has been cut off as well.
+            if (not executable.contains(b)) {
+                if (term and is<UnreachableInst>(term)) continue;
+                std::vector<Block*> successors{};
+                for (auto* s : b->successors()) successors.push_back(s);
+                for (auto* s : successors) RemoveIncoming(b, s);
+                if (term) term->erase();
+                b->insert(new (*mod) UnreachableInst{});
+                ++dead_blocks;
+                SetChanged();
+                continue;
+            }
+
+            for (auto* i : b->instructions())
+                if (auto it = values.find(i); it != values.end() and it->second.constant())
+                    constants.push_back(i);
+
+            /// Drop the edge a branch on a constant never takes.
+            if (not term or not is<CondBranchInst>(term)) continue;
+            auto* br = as<CondBranchInst>(term);
+            auto cond = Get(br->cond());
+            if (not cond.constant()) continue;
+            auto* then = br->then_block();
+            auto* otherwise = br->else_block();
+            if (cond.value != 1) std::swap(then, otherwise);
+            if (then != otherwise) RemoveIncoming(b, otherwise);
+            Replace<BranchInst>(br, then, br->location());
+            ++branches_folded;
+        }
+
+        for (auto* i : constants) Replace(i, values[i].value);
+    }
+};
+
+/// Global value numbering.
+///
+/// Replace every pure instruction with an equivalent instruction that
+/// dominates it, if there is one. Two instructions are equivalent if
+/// they have the same kind, type, and operands; integer constants are
+/// compared by value since folding creates a new one every time.
+///
+/// Loads are only numbered within a block, and only up to the next
+/// instruction that may write to memory.
+struct GVNPass : InstructionRewritePass {
+    static constexpr std::string_view name = "gvn";
+    static constexpr bool preserves_cfg = true;
+
+    /// The parts of an instruction that determine its value.
+    struct Expression {
+        Value::Kind kind;
+        Type* type;
+        std::vector<uptr> operands;
+
+        [[nodiscard]] bool operator==(const Expression&) const = default;
+    };
+
+    struct ExpressionHash {
+        [[nodiscard]] auto operator()(const Expression& e) const -> usz {
+            usz seed = usz(+e.kind);
+            auto Combine = [&](uptr v) { seed ^= std::hash<uptr>{}(v) + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2); };
+            Combine(uptr(e.type));
+            for (auto v : e.operands) Combine(v);
+            return seed;
+        }
+    };
+
+    /// Instructions computing each expression, in the order visited.
+    std::unordered_map<Expression, std::vector<Inst*>, ExpressionHash> leaders{};
+
+    void run_on_function(Function* f) {
+        if (f->blocks().empty()) return;
+        const auto& dom_tree = analyses->dominators();
+
+        /// Visiting blocks in preorder means that any instruction that
+        /// dominates another has been visited before it.
+        for (auto* b : dom_tree.dfs_preorder()) {
+            usz memory_generation = 0;
+            for (auto* i = b->instructions().front(); i;) {
+                auto* next = i->next();
+                if (is<StoreInst, CallInst, IntrinsicInst>(i)) memory_generation++;
+                else if (auto e = Number(i, memory_generation)) {
+                    auto& candidates = leaders[*e];
+                    auto leader = rgs::find_if(candidates, [&](Inst* c) { return dom_tree.dominates(c->block(), b); });
+                    if (leader != candidates.end()) Replace(i, *leader);
+                    else candidates.push_back(i);
+                }
+                i = next;
+            }
+        }
+    }
+
+private:
+    /// Identify an operand; integer constants by their type and value.
+    static auto Operand(Value* v) -> std::array<uptr, 3> {
+        if (auto* c = cast<IntegerConstant>(v)) return {1, uptr(c->type()), uptr(c->value().value())};
+        return {0, uptr(v), 0};
+    }
+
+    /// Compute the expression of an instruction, if it is pure.
+    static auto Number(Inst* i, usz memory_generation) -> std::optional<Expression> {
+        Expression e{i->kind(), i->type(), {}};
+        auto Add = [&](Value* v) { rgs::copy(Operand(v), std::back_inserter(e.operands)); };
+
+        switch (i->kind()) {
+            default: return std::nullopt;
+
+            /// A load is only equivalent to another load in the same
+            /// block if nothing can have written to memory in between.
+            case Value::Kind::Load:
+                e.operands.push_back(uptr(i->block()));
+                e.operands.push_back(memory_generation);
+                Add(as<LoadInst>(i)->ptr());
+                return e;
+
+            case Value::Kind::GetElementPtr:
+            case Value::Kind::GetMemberPtr: {
+                auto* gep = as<GEPBaseInst>(i);
+                e.operands.push_back(uptr(gep->base_type()));
+                Add(gep->ptr());
+                Add(gep->idx());
+                return e;
+            }
+
+            case Value::Kind::ZExt:
+            case Value::Kind::SExt:
+            case Value::Kind::Trunc:
+            case Value::Kind::Bitcast:
+            case Value::Kind::Neg:
+            case Value::Kind::Copy:
+            case Value::Kind::Compl:
+                Add(as<UnaryInstBase>(i)->operand());
+                return e;
+
+            case Value::Kind::Add:
+            case Value::Kind::Mul:
+            case Value::Kind::And:
+            case Value::Kind::Or:
+            case Value::Kind::Xor:
+            case Value::Kind::Eq:
+            case Value::Kind::Ne: {
+                /// These are commutative, so put the operands in a fixed order.
+                auto* b = as<BinaryInst>(i);
+                auto lhs = Operand(b->lhs());
+                auto rhs = Operand(b->rhs());
+                if (rhs < lhs) std::swap(lhs, rhs);
+                rgs::copy(lhs, std::back_inserter(e.operands));
+                rgs::copy(rhs, std::back_inserter(e.operands));
+                return e;
+            }
+
+            case Value::Kind::Sub:
+            case Value::Kind::SDiv:
+            case Value::Kind::UDiv:
+            case Value::Kind::SRem:
+            case Value::Kind::URem:
+            case Value::Kind::Shl:
+            case Value::Kind::Sar:
+            case Value::Kind::Shr:
+            case Value::Kind::SLt:
+            case Value::Kind::SLe:
+            case Value::Kind::SGt:
+            case Value::Kind::SGe:
+            case Value::Kind::ULt:
+            case Value::Kind::ULe:
+            case Value::Kind::UGt:
+            case Value::Kind::UGe: {
+                auto* b = as<BinaryInst>(i);
+                Add(b->lhs());
+                Add(b->rhs());
+                return e;
+            }
+        }
+    }
+};
+
+/// Loop-invariant code motion.
+///
+/// Hoist instructions whose operands don’t change in a loop into its
+/// preheader, creating one if need be. Inner loops are handled first,
+/// so an instruction can be hoisted out of several loops in one go.
+///
+/// Since the loop body may never run, only instructions that are safe
+/// to execute anyway are hoisted: address computations, arithmetic that
+/// can’t trap, and loads from allocas whose address never escapes and
+/// that are not written to anywhere in the loop.
+struct LICMPass : InstructionRewritePass {
+    static constexpr std::string_view name = "licm";
+    static inline Statistic instructions_hoisted{name, "instructions-hoisted", "Loop-invariant instructions hoisted"};
+
+    void run_on_function(Function* f) {
+        if (f->blocks().empty()) return;
+
+        /// Creating a preheader changes the CFG, so start over after that.
+        for (bool cfg_changed = true; cfg_changed;) {
+            cfg_changed = false;
+            const auto& dom_tree = analyses->dominators();
+            const auto& loops = analyses->loops();
+            for (auto* l : loops.loops()) {
+                /// Everything before the entry block would be hoisted into
+                /// the loop instead; there are no such loops in practice.
+                if (l->header() == f->entry()) continue;
+
+                auto invariant = Invariant(l, dom_tree);
+                if (invariant.empty()) continue;
+
+                auto* pre = l->preheader();
+                if (not pre) {
+                    CreatePreheader(l);
+                    analyses->invalidate();
+                    cfg_changed = true;
+                    break;
+                }
+
+                for (auto* i : invariant) {
+                    i->block()->instructions().erase(i);
+                    pre->insert_before(i, pre->terminator());
+                }
+                instructions_hoisted += invariant.size();
+
+                SetChanged();
+            }
+        }
+    }
+
+private:
+    /// Collect the instructions that can be hoisted out of a loop, in an
+    /// order in which they can be inserted into the preheader.
+    auto Invariant(Loop* l, const DomTree& dom_tree) -> std::vector<Inst*> {
+        std::vector<Inst*> hoist{};
+        std::unordered_set<Inst*> hoisted{};
+        auto IsInvariant = [&](Value* v) {
+            auto* i = cast<Inst>(v);
+            return not i or not l->contains(i->block()) or hoisted.contains(i);
+        };
+
+        /// Visit the blocks in dominator order so operands are seen first.
+        for (auto* b : dom_tree.dfs_preorder()) {
+            if (not l->contains(b)) continue;
+            for (auto* i : b->instructions()) {
+                if (not Hoistable(i, l)) continue;
+                bool invariant = true;
+                for (auto* v : i->children()) invariant = invariant and IsInvariant(v);
+                if (not invariant) continue;
+                hoist.push_back(i);
+                hoisted.insert(i);
+            }
+        }
+
+        return hoist;
+    }
+
+    /// Check if an instruction is safe to hoist out of a loop if its
+    /// operands are invariant.
+    static auto Hoistable(Inst* i, Loop* l) -> bool {
+        switch (i->kind()) {
+            default: return false;
+
+            case Value::Kind::GetElementPtr:
+            case Value::Kind::GetMemberPtr:
+            case Value::Kind::ZExt:
+            case Value::Kind::SExt:
+            case Value::Kind::Trunc:
+            case Value::Kind::Bitcast:
+            case Value::Kind::Neg:
+            case Value::Kind::Copy:
+            case Value::Kind::Compl:
+            case Value::Kind::Add:
+            case Value::Kind::Sub:
+            case Value::Kind::Mul:
+            case Value::Kind::Shl:
+            case Value::Kind::Sar:
+            case Value::Kind::Shr:
+            case Value::Kind::And:
+            case Value::Kind::Or:
+            case Value::Kind::Xor:
+            case Value::Kind::Eq:
+            case Value::Kind::Ne:
+            case Value::Kind::SLt:
+            case Value::Kind::SLe:
+            case Value::Kind::SGt:
+            case Value::Kind::SGe:
+            case Value::Kind::ULt:
+            case Value::Kind::ULe:
+            case Value::Kind::UGt:
+            case Value::Kind::UGe:
+                return true;
+
+            /// Division traps if the divisor is zero, and signed division
+            /// also if it overflows.
+            case Value::Kind::UDiv:
+            case Value::Kind::URem:
+            case Value::Kind::SDiv:
+            case Value::Kind::SRem: {
+                auto* rhs = cast<IntegerConstant>(as<BinaryInst>(i)->rhs());
+                if (not rhs or rhs->value() == 0) return false;
+                return is<UDivInst, URemInst>(i) or ~rhs->value() != 0;
+            }
+
+            case Value::Kind::Load: {
+                Value* ptr = as<LoadInst>(i)->ptr();
+                while (auto* gep = cast<GEPBaseInst>(ptr)) ptr = gep->ptr();
+                auto* a = cast<AllocaInst>(ptr);
+                return a and NotWrittenIn(a, l);
+            }
+        }
+    }
+
+    /// Check that the address of an alloca, or of any part of it, never
+    /// escapes, and that none of it is written to in a loop.
+    static auto NotWrittenIn(Inst* address, Loop* l) -> bool {
+        return rgs::all_of(address->users(), [&](Inst* u) {
+            if (is<LoadInst>(u)) return true;
+            if (auto* s = cast<StoreInst>(u)) return s->val() != address and not l->contains(s->block());
+            if (auto* gep = cast<GEPBaseInst>(u)) return gep->ptr() == address and NotWrittenIn(gep, l);
+            return false;
+        });
+    }
+};
+
+/// Loop vectorisation pass.
+///
+/// This handles innermost loops that consist of a header, which compares
+/// an induction variable that goes up by one with a loop-invariant bound,
+/// and a single block for the body, e.g.
+///
+///     header:
+///         %i = phi i64, [%pre : %start], [%body : %i.next]
+///         %sum = phi i32, [%pre : 0], [%body : %sum.next]
+///         %c = slt i64 %i, %n
+///         branch on %c to %body else %exit
+///     body:
+///         %p = gep i32 from %a at i64 %i
+///         %x = load i32 from %p
+///         %sum.next = add i32 %sum, %x
+///         %i.next = add i64 %i, 1
+///         branch to %header
+///
+/// Everything else in the body must be a `gep` indexed by the induction
+/// variable, a load or store through one of those, or an element-wise
+/// operation on values that are loaded, invariant, or constant. Every
+/// header phi other than the induction variable must be a reduction,
+/// i.e. only be combined with a value computed in the body by an `add`,
+/// `and`, `or`, or `xor` whose result only feeds back into the phi.
+///
+/// A copy of the loop that runs as many iterations at once as there are
+/// lanes in a vector is placed in front of it, and the original loop runs
+/// whatever iterations are left. There are no instructions to broadcast
+/// a scalar or to extract a lane, so both go through a stack slot.
+struct LoopVectorisePass : InstructionRewritePass {
+    static constexpr std::string_view name = "vec";
+    static inline Statistic loops_vectorised{name, "loops-vectorised", "Loops vectorised"};
+
+    /// Size of the vectors we create, in bits.
+    static constexpr usz vector_bits = 128;
+
+    void run_on_function(Function* f) {
+        if (f->blocks().empty()) return;
+
+        /// The original loop still looks like something we can vectorise
+        /// afterwards, so remember which ones are already done.
+        std::unordered_set<Block*> done{};
+        for (bool cfg_changed = true; cfg_changed;) {
+            cfg_changed = false;
+            for (auto* l : analyses->loops().loops()) {
+                if (done.contains(l->header())) continue;
+
+                auto candidate = Analyse(l);
+                if (not candidate) continue;
+
+                /// Creating a preheader changes the CFG, so start over after that.
+                candidate->preheader = l->preheader();
+                if (not candidate->preheader) {
+                    if (l->header() == f->entry()) continue;
+                    CreatePreheader(l);
+                    analyses->invalidate();
+                    cfg_changed = true;
+                    break;
+                }
+
+                Vectorise(l, *candidate);
+                done.insert(l->header());
+                analyses->invalidate();
+                cfg_changed = true;
+                break;
+            }
+        }
+    }
+
+private:
+    struct Reduction {
+        PhiInst* phi;
+        BinaryInst* op;
+    };
+
+    struct Candidate {
+        /// Only filled in once we know the loop has one.
+        Block* preheader;
+        Block* body;
+        PhiInst* induction;
+        AddInst* step;
+        CompareInst* compare;
+        IntegerType* element;
+        std::vector<Reduction> reductions;
+    };
+
+    /// Check if a loop can be vectorised.
+    auto Analyse(Loop* l) -> std::optional<Candidate> {
+        if (not l->children().empty() or l->blocks().size() != 2 or l->latches().size() != 1) return std::nullopt;
+
+        Candidate c{};
+        auto* header = l->header();
+        c.body = l->latches().front();
+        if (c.body == header or not is<BranchInst>(c.body->terminator())) return std::nullopt;
+
+        /// The header must only decide whether to run the body again.
+        auto* br = cast<CondBranchInst>(header->terminator());
+        if (not br or br->then_block() != c.body or l->contains(br->else_block())) return std::nullopt;
+        c.compare = cast<CompareInst>(br->cond());
+        if (not c.compare or not is<SLtInst, ULtInst>(c.compare) or c.compare->users().size() != 1) return std::nullopt;
+        c.induction = cast<PhiInst>(c.compare->lhs());
+        if (not c.induction or c.induction->block() != header or not Invariant(c.compare->rhs(), l)) return std::nullopt;
+
+        for (auto* i : header->instructions()) {
+            if (i == c.compare or i == br) continue;
+            auto* phi = cast<PhiInst>(i);
+            if (not phi or not is<IntegerType>(phi->type())) return std::nullopt;
+            auto* next = cast<BinaryInst>(phi->get_incoming(c.body));
+            if (not next or next->block() != c.body or next->users().size() != 1) return std::nullopt;
+
+            if (phi == c.induction) {
+                /// Constants end up on either side of an add.
+                auto* one = cast<IntegerConstant>(next->lhs() == phi ? next->rhs() : next->lhs());
+                if (not is<AddInst>(next) or (next->lhs() != phi and next->rhs() != phi)) return std::nullopt;
+                if (not one or one->value() != 1) return std::nullopt;
+                c.step = as<AddInst>(next);
+                continue;
+            }
+
+            if (not is<AddInst, AndInst, OrInst, XorInst>(next)) return std::nullopt;
+            if ((next->lhs() == phi) == (next->rhs() == phi)) return std::nullopt;
+            for (auto* u : phi->users())
+                if (u != next and l->contains(u->block()))
+                    return std::nullopt;
+            c.reductions.push_back({phi, next});
+        }
+
+        if (not c.step) return std::nullopt;
+
+        /// Everything in the body must be computed for one lane at a time.
+        std::unordered_set<Value*> defined{};
+        std::vector<Value*> loaded_from{};
+        std::vector<Value*> stored_to{};
+        bool has_mul = false;
+        auto Element = [&](Type* t) {
+            if (not c.element) c.element = cast<IntegerType>(t);
+            return t == c.element;
+        };
+
+        auto Operand = [&](Value* v) {
+            if (not Element(v->type())) return false;
+            return defined.contains(v) or Invariant(v, l);
+        };
+
+        auto IsReductionOf = [&](Inst* i) -> PhiInst* {
+            auto it = rgs::find(c.reductions, i, &Reduction::op);
+            return it == c.reductions.end() ? nullptr : it->phi;
+        };
+
+        for (auto* i : c.body->instructions()) {
+            if (i == c.step or i == c.body->terminator()) continue;
+            if (not IsReductionOf(i))
+                for (auto* u : i->users())
+                    if (u->block() != c.body)
+                        return std::nullopt;
+
+            switch (i->kind()) {
+                default: return std::nullopt;
+
+                /// Only used as the address of loads and stores.
+                case Value::Kind::GetElementPtr: {
+                    auto* gep = as<GEPInst>(i);
+                    if (gep->idx() != c.induction or not Invariant(gep->ptr(), l) or not Element(gep->base_type()))
+                        return std::nullopt;
+                    for (auto* u : gep->users()) {
+                        if (is<LoadInst>(u)) continue;
+                        if (auto* s = cast<StoreInst>(u); s and s->val() != gep) continue;
+                        return std::nullopt;
+                    }
+                } continue;
+
+                case Value::Kind::Load: {
+                    auto* load = as<LoadInst>(i);
+                    auto* gep = cast<GEPInst>(load->ptr());
+                    if (not gep or gep->block() != c.body or not Element(load->type())) return std::nullopt;
+                    loaded_from.push_back(gep->ptr());
+                } break;
+
+                case Value::Kind::Store: {
+                    auto* store = as<StoreInst>(i);
+                    auto* gep = cast<GEPInst>(store->ptr());
+                    if (not gep or gep->block() != c.body or not Operand(store->val())) return std::nullopt;
+                    stored_to.push_back(gep->ptr());
+                } continue;
+
+                case Value::Kind::Mul:
+                    has_mul = true;
+                    [[fallthrough]];
+                case Value::Kind::Add:
+                case Value::Kind::Sub:
+                case Value::Kind::And:
+                case Value::Kind::Or:
+                case Value::Kind::Xor: {
+                    auto* b = as<BinaryInst>(i);
+                    auto* phi = IsReductionOf(b);
+                    if (not Element(b->type())) return std::nullopt;
+                    if (b->lhs() != phi and not Operand(b->lhs())) return std::nullopt;
+                    if (b->rhs() != phi and not Operand(b->rhs())) return std::nullopt;
+                } break;
+            }
+
+            defined.insert(i);
+        }
+
+        /// Only bother if the loop does something with memory.
+        if (not c.element or (loaded_from.empty() and stored_to.empty())) return std::nullopt;
+        auto bits = c.element->bits();
+        if (bits < 8 or bits > vector_bits / 2 or not std::has_single_bit(bits)) return std::nullopt;
+        auto* vector = VectorType::Get(mod->context(), vector_bits / bits, c.element);
+        if (has_mul and not BinaryInst::SupportsVector(Value::Kind::Mul, vector)) return std::nullopt;
+
+        /// Lanes of the same array are accessed in the same order as before,
+        /// but a store to one array could write to an element of another
+        /// that a later lane has already read or written, unless they are
+        /// distinct objects.
+        auto Distinct = [](Value* a, Value* b) {
+            return a == b or (is<AllocaInst, GlobalVariable>(a) and is<AllocaInst, GlobalVariable>(b));
+        };
+
+        for (auto* s : stored_to) {
+            if (not rgs::all_of(stored_to, [&](Value* v) { return Distinct(s, v); })) return std::nullopt;
+            if (not rgs::all_of(loaded_from, [&](Value* v) { return Distinct(s, v); })) return std::nullopt;
+        }
+
+        return c;
+    }
+
+    void Vectorise(Loop* l, const Candidate& c) {
+        auto* header = l->header();
+        auto* f = header->function();
+        auto* pre = c.preheader;
+        auto* entry = f->entry();
+        auto* induction_type = c.induction->type();
+        auto* bound = c.compare->rhs();
+        auto iv_bits = induction_type->bits();
+        auto lanes = vector_bits / c.element->bits();
+        auto* vector = VectorType::Get(mod->context(), lanes, c.element);
+
+        auto NewBlock = [&](std::string block_name) {
+            auto* b = new (*mod) Block(std::move(block_name));
+            f->blocks().insert(rgs::find(f->blocks(), header), b);
+            b->function(f);
+            return b;
+        };
+
+        auto* vheader = NewBlock(fmt::format("{}.vec", header->name()));
+        auto* vcheck = NewBlock(fmt::format("{}.vec.check", header->name()));
+        auto* vbody = NewBlock(fmt::format("{}.vec", c.body->name()));
+        auto* vexit = NewBlock(fmt::format("{}.vec.exit", header->name()));
+
+        /// Vectors are put together and taken apart in this slot.
+        auto* slot = new (*mod) AllocaInst(vector);
+        entry->insert_before(slot, entry->instructions().front());
+        auto Lane = [&](Inst* before, usz lane) {
+            return Insert<GEPInst>(before, c.element, slot, MakeInt(64, lane));
+        };
+
+        auto* pre_branch = pre->terminator();
+        auto Build = [&](auto lane_value) {
+            for (usz lane = 0; lane < lanes; lane++)
+                Insert<StoreInst>(pre_branch, lane_value(lane), Lane(pre_branch, lane));
+            return Insert<LoadInst>(pre_branch, vector, slot);
+        };
+
+        std::unordered_map<Value*, Value*> vectorised{};
+        std::unordered_map<Value*, Value*> splats{};
+        auto Operand = [&](Value* v) -> Value* {
+            if (auto it = vectorised.find(v); it != vectorised.end()) return it->second;
+            auto& splat = splats[v];
+            if (not splat) splat = Build([&](usz) { return v; });
+            return splat;
+        };
+
+        /// The vector loop starts where the original would have, and each
+        /// reduction starts with its initial value in the first lane and
+        /// the identity of its operation in the others.
+        auto* iv = vheader->create_phi(induction_type, c.induction->location());
+        iv->set_incoming(c.induction->get_incoming(pre), pre);
+        for (auto [phi, op] : c.reductions) {
+            u64 identity = is<AndInst>(op) ? ~u64(0) : 0;
+            auto* init = Build([&](usz lane) -> Value* {
+                if (lane == 0) return phi->get_incoming(pre);
+                return MakeInt(c.element->bits(), identity);
+            });
+
+            auto* acc = vheader->create_phi(vector, phi->location());
+            acc->set_incoming(init, pre);
+            vectorised[phi] = acc;
+        }
+
+        /// Keep going while there are at least as many iterations left as
+        /// there are lanes; the difference can’t overflow once we know the
+        /// induction variable is below the bound.
+        auto* in_bounds = vheader->insert(MakeBinary(c.compare->kind(), iv, bound));
+        vheader->insert(new (*mod) CondBranchInst(in_bounds, vcheck, vexit));
+        auto* left = vcheck->insert(new (*mod) SubInst(bound, iv));
+        auto* enough = vcheck->insert(new (*mod) UGeInst(left, MakeInt(iv_bits, lanes)));
+        vcheck->insert(new (*mod) CondBranchInst(enough, vbody, vexit));
+
+        for (auto* i : c.body->instructions()) {
+            if (i == c.step or i == c.body->terminator()) continue;
+            Inst* v{};
+            switch (i->kind()) {
+                case Value::Kind::GetElementPtr: {
+                    auto* gep = as<GEPInst>(i);
+                    v = new (*mod) GEPInst(gep->base_type(), gep->ptr(), iv, gep->location());
+                } break;
+
+                case Value::Kind::Load:
+                    v = new (*mod) LoadInst(vector, vectorised.at(as<LoadInst>(i)->ptr()), i->location());
+                    break;
+
+                case Value::Kind::Store: {
+                    auto* store = as<StoreInst>(i);
+                    v = new (*mod) StoreInst(Operand(store->val()), vectorised.at(store->ptr()), i->location());
+                } break;
+
+                default: {
+                    auto* b = as<BinaryInst>(i);
+                    v = MakeBinary(b->kind(), Operand(b->lhs()), Operand(b->rhs()), b->location());
+                } break;
+            }
+
+            vectorised[i] = vbody->insert(v);
+        }
+
+        auto* iv_next = vbody->insert(new (*mod) AddInst(iv, MakeInt(iv_bits, lanes)));
+        vbody->insert(new (*mod) BranchInst(vheader));
+        iv->set_incoming(iv_next, vbody);
+
+        /// Combine the lanes of each reduction, and continue with the original
+        /// loop from where the vector loop left off.
+        for (auto [phi, op] : c.reductions) {
+            auto* acc = as<PhiInst>(vectorised.at(phi));
+            acc->set_incoming(vectorised.at(op), vbody);
+            vexit->insert(new (*mod) StoreInst(acc, slot));
+
+            Value* result{};
+            for (usz lane = 0; lane < lanes; lane++) {
+                auto* gep = vexit->insert(new (*mod) GEPInst(c.element, slot, MakeInt(64, lane)));
+                auto* value = vexit->insert(new (*mod) LoadInst(c.element, gep));
+                result = result ? vexit->insert(MakeBinary(op->kind(), result, value)) : value;
+            }
+
+            phi->remove_incoming(pre);
+            phi->set_incoming(result, vexit);
+        }
+
+        vexit->insert(new (*mod) BranchInst(header));
+        c.induction->remove_incoming(pre);
+        c.induction->set_incoming(iv, vexit);
+        as<BranchInst>(pre_branch)->target(vheader);
+
+        ++loops_vectorised;
+        SetChanged();
+    }
+
+    /// Create a binary instruction of a given kind.
+    auto MakeBinary(Value::Kind kind, Value* lhs, Value* rhs, Location location = {}) -> Inst* {
+        switch (kind) {
+            case Value::Kind::Add: return new (*mod) AddInst(lhs, rhs, location);
+            case Value::Kind::Sub: return new (*mod) SubInst(lhs, rhs, location);
+            case Value::Kind::Mul: return new (*mod) MulInst(lhs, rhs, location);
+            case Value::Kind::And: return new (*mod) AndInst(lhs, rhs, location);
+            case Value::Kind::Or: return new (*mod) OrInst(lhs, rhs, location);
+            case Value::Kind::Xor: return new (*mod) XorInst(lhs, rhs, location);
+            case Value::Kind::SLt: return new (*mod) SLtInst(lhs, rhs, location);
+            case Value::Kind::ULt: return new (*mod) ULtInst(lhs, rhs, location);
+            default: LCC_UNREACHABLE();
+        }
+    }
+
+    /// Check if a value is the same in every iteration of a loop.
+    static auto Invariant(Value* v, Loop* l) -> bool {
+        auto* i = cast<Inst>(v);
+        return not i or not l->contains(i->block());
+    }
+};
+
+/// CFG simplification pass.
+struct CFGSimplPass : InstructionRewritePass {
+    static constexpr std::string_view name = "cfgs";
+    static inline Statistic merged{name, "merged", "Blocks merged into their only predecessor"};
+    static inline Statistic removed{name, "removed", "Unreachable blocks removed"};
+
+    void run_on_function(Function* f) {
+        /// We start at 1 because the entry block is always reachable.
+        for (usz i = 1; i < f->blocks().size(); /** No increment! **/) {
+            auto* b = f->blocks()[i];
+
+            /// Count how many users of this block are not PHIs.
+            Inst* branch = nullptr;
+            bool several = false;
+            for (auto* u : b->users()) {
+                if (is<PhiInst>(u)) continue;
+                if (branch) {
+                    several = true;
+                    break;
+                }
+                branch = u;
+            }
+
+            if (several) {
+                ++i;
+                continue;
+            }
+
+            /// A block that is only reached from itself is unreachable.
+            if (branch and branch->block() == b) {
+                branch->erase();
+                branch = nullptr;
+            }
+
+            // If there is only one non-PHI user, and that user is a direct branch to
+            // this, inline this block into the block containing that branch
+            if (branch) {
+                if (not is<BranchInst>(branch)) {
+                    ++i;
+                    continue;
+                }
+                branch->block()->merge(b);
+                ++merged;
+            }
+            // Otherwise, the block is unreachable. Remove it from all PHIs.
+            else {
+                for (auto* u : b->users()) {
+                    auto* phi = as<PhiInst>(u);
+                    phi->remove_incoming(b);
+                }
+
+                /// Yeet!
+                b->erase();
+                ++removed;
+            }
+
+            // Don't increment, since we may just have removed this block, and
+            // incrementing would cause use to skip the next one.
+            SetChanged();
+        }
+    }
+};
+
+/// Eliminate instructions whose results are unused if they have no side-effects.
+struct DCEPass : InstructionRewritePass {
+    static constexpr std::string_view name = "dce";
+    static constexpr bool use_worklist = true;
+    static constexpr bool preserves_cfg = true;
+    static inline Statistic erased{name, "erased", "Dead instructions erased"};
+
+    void run_on_instruction(Inst* i) {
+        if (not i->users().empty()) return;
+        switch (i->kind()) {
+            default: return;
+            case Value::Kind::GetElementPtr:
+            case Value::Kind::Load:
+            case Value::Kind::Phi:
+            case Value::Kind::ZExt:
+            case Value::Kind::SExt:
+            case Value::Kind::Trunc:
+            case Value::Kind::Bitcast:
+            case Value::Kind::Neg:
+            case Value::Kind::Copy:
+            case Value::Kind::Compl:
+            case Value::Kind::Add:
+            case Value::Kind::Sub:
+            case Value::Kind::Mul:
+            case Value::Kind::SDiv:
+            case Value::Kind::UDiv:
+            case Value::Kind::SRem:
+            case Value::Kind::URem:
+            case Value::Kind::Shl:
+            case Value::Kind::Sar:
+            case Value::Kind::Shr:
+            case Value::Kind::And:
+            case Value::Kind::Or:
+            case Value::Kind::Xor:
+            case Value::Kind::Eq:
+            case Value::Kind::Ne:
+            case Value::Kind::SLt:
+            case Value::Kind::SLe:
+            case Value::Kind::SGt:
+            case Value::Kind::SGe:
+            case Value::Kind::ULt:
+            case Value::Kind::ULe:
+            case Value::Kind::UGt:
+            case Value::Kind::UGe:
+                /// Our operands may be dead now.
+                for (auto* op : i->children()) Revisit(op);
+                i->erase();
+                ++erased;
+                SetChanged();
+                return;
+        }
+    }
+};
+
+struct GlobalDCEPass : ModuleRewritePass {
+    static constexpr std::string_view name = "gdce";
+    static inline Statistic removed{name, "removed", "Unused functions removed"};
+
+    void run() {
+        auto count = mod->remove_functions_if([](Function* f) {
+            // Do not delete exported functions or used functions.
+            bool exported = rgs::any_of(f->names(), [](const IRName& n) {
+                return IsExportedLinkage(n.linkage);
+            });
+            return not exported and f->users().empty();
+        });
+
+        /// Yeet.
+        if (count) {
+            removed += count;
+            SetChanged();
+        }
+    }
+};
+
+/// Inline direct calls to functions defined in this module.
+///
+/// Calls marked with __builtin_inline are always inlined; from -O2
+/// on, so are calls to callees that are small enough. Callees are
+/// processed before their callers, so anything inlined into a callee
+/// is inlined along with it; calls to a function that is still being
+/// processed, i.e. recursive calls, are never inlined.
+struct InlinePass : ModuleRewritePass {
+    static constexpr std::string_view name = "inline";
+    static inline Statistic inlined{name, "inlined", "Calls inlined"};
+
+    enum struct State {
+        Visiting,
+        Done,
+    };
+
+    int opt_level;
+    std::unordered_map<Function*, State> state{};
+
+    /// Functions that calls have been inlined into.
+    std::unordered_set<Function*> callers{};
+
+    void run() {
+        for (auto* f : mod->code()) Visit(f);
+    }
+
+    [[nodiscard]]
+    auto changed_functions() const -> const std::unordered_set<Function*>& { return callers; }
+
+private:
+    /// Get the maximum number of instructions of a callee that is
+    /// inlined without being asked to.
+    [[nodiscard]]
+    auto Threshold() const -> usz {
+        if (opt_level < 2) return 0;
+        return opt_level == 2 ? 24 : 64;
+    }
+
+    /// How much larger a callee may be if the call is hot.
+    static constexpr usz hot_threshold_scale = 4;
+
+    /// Inline calls in a function, after inlining calls in its callees.
+    void Visit(Function* f) {
+        if (state.contains(f)) return;
+        state[f] = State::Visiting;
+
+        /// Collect the calls up front since inlining splits blocks.
+        std::vector<CallInst*> calls{};
+        for (auto* b : f->blocks())
+            for (auto* i : b->instructions())
+                if (auto* c = cast<CallInst>(i))
+                    calls.push_back(c);
+
+        for (auto* c : calls) {
+            auto* callee = cast<Function>(c->callee());
+            if (not callee or callee->blocks().empty()) continue;
+            Visit(callee);
+            if (not ShouldInline(c, callee)) continue;
+            Inline(c, callee);
+            callers.insert(f);
+            ++inlined;
+            SetChanged();
+        }
+
+        state[f] = State::Done;
+    }
+
+    [[nodiscard]]
+    auto ShouldInline(CallInst* c, Function* callee) const -> bool {
+        /// Variadic arguments have no parameters to map to, and the
+        /// call branches to the entry block, so nothing else can.
+        bool possible = state.at(callee) == State::Done
+                    and not as<FunctionType>(callee->type())->variadic()
+                    and c->args().size() == callee->param_count()
+                    and callee->entry()->predecessor_count() == 0;
+
+        if (c->is_force_inline()) {
+            if (not possible) Diag::Warning(
+                mod->context(),
+                c->location(),
+                "Call to '{}' cannot be inlined",
+                callee->names().at(0).name
+            );
+            return possible;
+        }
+
+        if (not possible) return false;
+        usz size = 0;
+        for (auto* b : callee->blocks()) size += b->instructions().size();
+
+        /// With a profile, don't bother with calls that never ran in a
+        /// function that did, and be more generous with calls that ran
+        /// more often than the function they are in, i.e. in loops.
+        auto count = c->block()->profile_count();
+        auto entry_count = c->block()->function()->entry()->profile_count();
+        if (count and entry_count) {
+            if (*count == 0 and *entry_count != 0) return false;
+            if (*count > *entry_count) return size <= Threshold() * hot_threshold_scale;
+        }
+
+        return size <= Threshold();
+    }
+
+    /// Replace a call with a copy of the body of the callee.
+    void Inline(CallInst* c, Function* callee) {
+        auto* block = c->block();
+        auto* caller = block->function();
+        auto* allocas = caller->entry()->instructions().front();
+        auto location = c->location();
+
+        /// Create a block for everything after the call, and one for
+        /// every block of the callee, and insert them after the block
+        /// containing the call. Block names end up as labels, so they
+        /// have to be unique.
+        auto* cont = new (*mod) Block(fmt::format("{}.cont", block->name()));
+        std::unordered_map<Value*, Value*> map{};
+        std::vector<Block*> clones{};
+        for (auto* b : callee->blocks()) {
+            auto* clone = new (*mod) Block(fmt::format("{}.inl.{}", block->name(), b->name()));
+            map[b] = clone;
+            clones.push_back(clone);
+        }
+
+        auto& blocks = caller->blocks();
+        auto pos = blocks.insert(std::next(rgs::find(blocks, block)), clones.begin(), clones.end());
+        blocks.insert(pos + isz(clones.size()), cont);
+        for (auto* b : clones) b->function(caller);
+        cont->function(caller);
+
+        /// The copies run as often as the originals did per call.
+        if (auto count = block->profile_count()) {
+            cont->profile_count(count);
+            if (auto entry_count = callee->entry()->profile_count(); entry_count and *entry_count) {
+                for (usz bi = 0; bi < clones.size(); bi++)
+                    if (auto n = callee->blocks()[bi]->profile_count())
+                        clones[bi]->profile_count(u64(double(*n) * double(*count) / double(*entry_count)));
+            }
+        }
+
+        /// Move the rest of the block; its successors are now reached
+        /// from the continuation block.
+        while (auto* i = c->next()) {
+            block->instructions().erase(i);
+            cont->insert(i, true);
+        }
+
+        for (auto* s : cont->successors()) {
+            for (auto* i : s->instructions()) {
+                auto* phi = cast<PhiInst>(i);
+                if (not phi) break;
+                if (auto* v = phi->get_incoming(block)) {
+                    phi->remove_incoming(block);
+                    phi->set_incoming(v, cont);
+                }
+            }
+        }
+
+        /// Copy the instructions. Operands may be defined in blocks that
+        /// come later, so they are only remapped once everything has been
+        /// copied. Returns become branches to the continuation block, and
+        /// allocas are hoisted into the entry block so inlining into a
+        /// loop doesn’t grow the stack on every iteration.
+        for (usz i = 0; i < callee->param_count(); i++) map[callee->param(i)] = c->args()[i];
+        std::vector<Inst*> copies{};
+        std::vector<std::pair<PhiInst*, PhiInst*>> phis{};
+        std::vector<PhiInst::IncomingValue> returns{};
+        for (usz bi = 0; bi < clones.size(); bi++) {
+            for (auto* i : callee->blocks()[bi]->instructions()) {
+                if (auto* r = cast<ReturnInst>(i)) {
+                    returns.push_back({r->val(), clones[bi]});
+                    clones[bi]->insert(new (*mod) BranchInst(cont, r->location()));
+                    continue;
+                }
+
+                auto* copy = Clone(i);
+                map[i] = copy;
+                if (auto* phi = cast<PhiInst>(i)) phis.emplace_back(phi, as<PhiInst>(copy));
+                else copies.push_back(copy);
+
+                if (is<AllocaInst>(copy)) allocas->block()->insert_before(copy, allocas);
+                else clones[bi]->insert(copy);
+            }
+        }
+
+        auto Map = [&](Value* v) -> Value* {
+            auto it = map.find(v);
+            return it == map.end() ? v : it->second;
+        };
+
+        for (auto* i : copies) {
+            i->replace_children([&](Value* v) -> Value* {
+                auto it = map.find(v);
+                return it == map.end() ? nullptr : it->second;
+            });
+
+            if (auto* br = cast<BranchInst>(i)) br->target(as<Block>(Map(br->target())));
+            else if (auto* cbr = cast<CondBranchInst>(i)) {
+                cbr->then_block(as<Block>(Map(cbr->then_block())));
+                cbr->else_block(as<Block>(Map(cbr->else_block())));
+            }
+        }
+
+        for (auto [phi, copy] : phis)
+            for (auto [value, from] : phi->operands())
+                copy->set_incoming(Map(value), as<Block>(Map(from)));
+
+        /// Replace the call with the return value, and branch to the
+        /// copy of the entry block instead.
+        if (not c->users().empty()) {
+            Value* result{};
+            if (returns.size() == 1) result = Map(returns.front().value);
+            else if (returns.empty()) result = new (*mod) PoisonValue(c->type());
+            else {
+                auto* phi = cont->create_phi(c->type(), location);
+                for (auto [value, from] : returns) phi->set_incoming(Map(value), from);
+                result = phi;
+            }
+            c->replace_with(result);
+        } else {
+            c->erase();
+        }
+
+        block->insert(new (*mod) BranchInst(clones.front(), location));
+    }
+
+    /// Copy an instruction without inserting it anywhere.
+    [[nodiscard]]
+    auto Clone(Inst* i) const -> Inst* {
+        auto loc = i->location();
+        switch (i->kind()) {
+            case Value::Kind::Block:
+            case Value::Kind::Function:
+            case Value::Kind::IntegerConstant:
+            case Value::Kind::ArrayConstant:
+            case Value::Kind::Poison:
+            case Value::Kind::GlobalVariable:
+            case Value::Kind::Parameter:
+            case Value::Kind::Return:
+                LCC_UNREACHABLE();
+
+            case Value::Kind::Alloca: return new (*mod) AllocaInst(as<AllocaInst>(i)->allocated_type(), loc);
+            case Value::Kind::Call: {
+                auto* c = as<CallInst>(i);
+
+                /// A tail call in the callee is not one in the caller.
+                auto* copy = new (*mod) CallInst(c->callee(), c->function_type(), c->args(), loc, c->call_conv());
+                if (c->is_force_inline()) copy->set_force_inline();
+                return copy;
+            }
+
+            case Value::Kind::GetElementPtr: {
+                auto* gep = as<GEPInst>(i);
+                return new (*mod) GEPInst(gep->base_type(), gep->ptr(), gep->idx(), loc);
+            }
+
+            case Value::Kind::GetMemberPtr: {
+                auto* gmp = as<GetMemberPtrInst>(i);
+                return new (*mod) GetMemberPtrInst(gmp->struct_type(), gmp->ptr(), gmp->idx(), loc);
+            }
+
+            case Value::Kind::Intrinsic: {
+                auto* intrinsic = as<IntrinsicInst>(i);
+                return new (*mod) IntrinsicInst(intrinsic->intrinsic_kind(), intrinsic->operands(), loc);
+            }
+
+            case Value::Kind::Load: return new (*mod) LoadInst(i->type(), as<LoadInst>(i)->ptr(), loc);
+            case Value::Kind::Phi: return new (*mod) PhiInst(i->type(), loc);
+            case Value::Kind::Store: {
+                auto* s = as<StoreInst>(i);
+                return new (*mod) StoreInst(s->val(), s->ptr(), loc);
+            }
+
+            case Value::Kind::Branch: return new (*mod) BranchInst(as<BranchInst>(i)->target(), loc);
+            case Value::Kind::CondBranch: {
+                auto* br = as<CondBranchInst>(i);
+                return new (*mod) CondBranchInst(br->cond(), br->then_block(), br->else_block(), loc);
+            }
+
+            case Value::Kind::Unreachable: return new (*mod) UnreachableInst(loc);
+
+            case Value::Kind::ZExt: return CloneCast<ZExtInst>(i);
+            case Value::Kind::SExt: return CloneCast<SExtInst>(i);
+            case Value::Kind::Trunc: return CloneCast<TruncInst>(i);
+            case Value::Kind::Bitcast: return CloneCast<BitcastInst>(i);
+            case Value::Kind::Neg: return new (*mod) NegInst(as<NegInst>(i)->operand(), loc);
+            case Value::Kind::Copy: return new (*mod) CopyInst(as<CopyInst>(i)->operand(), loc);
+            case Value::Kind::Compl: return new (*mod) ComplInst(as<ComplInst>(i)->operand(), loc);
+
+            case Value::Kind::Add: return CloneBinary<AddInst>(i);
+            case Value::Kind::Sub: return CloneBinary<SubInst>(i);
+            case Value::Kind::Mul: return CloneBinary<MulInst>(i);
+            case Value::Kind::SDiv: return CloneBinary<SDivInst>(i);
+            case Value::Kind::UDiv: return CloneBinary<UDivInst>(i);
+            case Value::Kind::SRem: return CloneBinary<SRemInst>(i);
+            case Value::Kind::URem: return CloneBinary<URemInst>(i);
+            case Value::Kind::Shl: return CloneBinary<ShlInst>(i);
+            case Value::Kind::Sar: return CloneBinary<SarInst>(i);
+            case Value::Kind::Shr: return CloneBinary<ShrInst>(i);
+            case Value::Kind::And: return CloneBinary<AndInst>(i);
+            case Value::Kind::Or: return CloneBinary<OrInst>(i);
+            case Value::Kind::Xor: return CloneBinary<XorInst>(i);
+            case Value::Kind::Eq: return CloneBinary<EqInst>(i);
+            case Value::Kind::Ne: return CloneBinary<NeInst>(i);
+            case Value::Kind::SLt: return CloneBinary<SLtInst>(i);
+            case Value::Kind::SLe: return CloneBinary<SLeInst>(i);
+            case Value::Kind::SGt: return CloneBinary<SGtInst>(i);
+            case Value::Kind::SGe: return CloneBinary<SGeInst>(i);
+            case Value::Kind::ULt: return CloneBinary<ULtInst>(i);
+            case Value::Kind::ULe: return CloneBinary<ULeInst>(i);
+            case Value::Kind::UGt: return CloneBinary<UGtInst>(i);
+            case Value::Kind::UGe: return CloneBinary<UGeInst>(i);
+        }
+
+        LCC_UNREACHABLE();
+    }
+
+    template <typename Instruction>
+    [[nodiscard]]
+    auto CloneCast(Inst* i) const -> Inst* {
+        return new (*mod) Instruction(as<UnaryInstBase>(i)->operand(), i->type(), i->location());
+    }
+
+    template <typename Instruction>
+    [[nodiscard]]
+    auto CloneBinary(Inst* i) const -> Inst* {
+        auto* b = as<BinaryInst>(i);
+        return new (*mod) Instruction(b->lhs(), b->rhs(), i->location());
+    }
+};
+
+/// Mark calls whose result, if any, is returned right away as tail calls,
+/// so the backend can reuse the frame of the caller for the callee.
+///
+/// This is only valid if the callee can’t refer to the frame of the
+/// caller, so nothing is marked in functions that let the address of a
+/// local escape anywhere, be it into a call, a store, or a pointer
+/// computation that we don’t bother to track.
+struct TailCallMarkingPass : InstructionRewritePass {
+    static constexpr std::string_view name = "tailcall";
+    static constexpr bool preserves_cfg = true;
+    static inline Statistic marked{name, "marked", "Calls marked as tail calls"};
+
+    void run_on_function(Function* f) {
+        std::vector<CallInst*> candidates{};
+        for (auto* b : f->blocks()) {
+            for (auto* i : b->instructions()) {
+                if (auto* a = cast<AllocaInst>(i); a and Escapes(a)) return;
+                if (auto* c = cast<CallInst>(i); c and Eligible(f, c))
+                    candidates.push_back(c);
+            }
+        }
+
+        for (auto* c : candidates) {
+            c->set_tail_call();
+            ++marked;
+            SetChanged();
+        }
+    }
+
+private:
+    /// Whether a call is directly followed by a return of its result,
+    /// and calls something that expects to be called like the caller.
+    static bool Eligible(Function* f, CallInst* c) {
+        if (c->is_tail_call() or c->is_force_inline()) return false;
+        if (c->function_type()->variadic() or c->call_conv() != f->call_conv()) return false;
+        if (not c->next() or not is<ReturnInst>(c->next())) return false;
+        auto* ret = as<ReturnInst>(c->next());
+        return ret->has_value() ? ret->val() == c : c->type()->is_void();
+    }
+
+    /// Whether the address of a local is used for anything other than
+    /// loading from or storing to it.
+    static bool Escapes(AllocaInst* a) {
+        for (auto* u : a->users()) {
+            if (is<LoadInst>(u)) continue;
+            if (auto* s = cast<StoreInst>(u); s and s->val() != a) continue;
+            return true;
+        }
+        return false;
+    }
+};
+
+/// Debugging pass to print the dominator tree of a function.
+struct PrintDOMTreePass : InstructionRewritePass {
+    static constexpr std::string_view name = "print-dom";
+    static constexpr bool run_serially = true;
+    static constexpr bool preserves_cfg = true;
+
+    static void run_on_function(Function* f) {
+        fmt::print("{}", DomTree{f, false}.debug());
+    }
+};
+
+/// Statistics that are kept for every pass.
+template <typename Pass>
+struct PassStatistics {
+    static inline Statistic runs{Pass::name, "runs", "Times the pass was run"};
+    static inline Statistic changes{Pass::name, "changes", "Times the pass changed something"};
+    static inline Statistic skipped{Pass::name, "skipped", "Times the pass was skipped since nothing changed"};
+    static inline Statistic replaced{Pass::name, "replaced", "Instructions replaced"};
+
+    static void Record(const OptimisationPass& p) {
+        ++runs;
+        if (p.changed()) ++changes;
+        replaced += p.replaced();
+    }
+};
+
+Statistic function_pass_iterations{"opt", "iterations", "Iterations of the function pass pipelines"};
+
+struct Optimiser {
+    Module* mod;
+
+    int opt_level;
+
+    /// Functions that the function passes have nothing left to do for;
+    /// they are skipped until some other pass changes them.
+    std::unordered_set<Function*> quiescent{};
+
+    /// Analyses of each function, shared by all function passes.
+    std::unordered_map<Function*, FunctionAnalyses> analyses{};
+
+    /// Entry point.
+    ///
+    /// Function passes never look beyond the function they are running
+    /// on, so every function is optimised to a fixpoint on its own, in
+    /// parallel if enabled; global DCE runs between rounds, when no other
+    /// pass is running. The inliner runs once everything is simplified,
+    /// so callees are judged by their optimised size, and the callers it
+    /// changes are simplified again afterwards. Calls are only marked as
+    /// tail calls at the very end, when no more calls are going to be
+    /// inlined and nothing is left between a call and a return that could
+    /// still be optimised away. At -O2 and above, loops are vectorised
+    /// before that, once they are as simple as they are going to get.
+    void run() {
+        Simplify();
+        if (RunPass<InlinePass>(opt_level)) Simplify();
+        if (opt_level >= 2) (void) RunPass<LoopVectorisePass>();
+        (void) RunPass<TailCallMarkingPass>();
+    }
+
+    /// Entry point for running select passes.
+    void run_passes(std::string_view passes) {
+        for (const auto& p : vws::split(passes, ',')) {
+            auto s = std::string_view{p};
             if (s == "sroa") (void) RunPass<SROAPass>();
             else if (s == "sfwd") (void) RunPass<StoreFowardingPass>();
             else if (s == "icmb") (void) RunPass<InstCombinePass>();
             else if (s == "dce") (void) RunPass<DCEPass>();
             else if (s == "gdce") (void) RunPass<GlobalDCEPass>();
+            else if (s == "inline") (void) RunPass<InlinePass>(opt_level);
             else if (s == "ssa") (void) RunPass<SSAConstructionPass>();
+            else if (s == "mfwd") (void) RunPass<MemoryForwardingPass>();
+            else if (s == "dse") (void) RunPass<DeadStoreEliminationPass>();
+            else if (s == "sccp") (void) RunPass<SCCPPass>();
+            else if (s == "gvn") (void) RunPass<GVNPass>();
+            else if (s == "licm") (void) RunPass<LICMPass>();
+            else if (s == "vec") (void) RunPass<LoopVectorisePass>();
             else if (s == "cfgs") (void) RunPass<CFGSimplPass>();
+            else if (s == "tailcall") (void) RunPass<TailCallMarkingPass>();
             else if (s == "print-dom") (void) RunPass<PrintDOMTreePass>();
             else if (s == "*") run();
             else Diag::Fatal("Unknown pass '{}'", s);
@@ -1001,19 +2921,86 @@ struct Optimiser {
     }
 
 private:
+    void Simplify() { // clang-format off
+        do RunFunctionPasses<
+            InstCombinePass,
+            SROAPass,
+            StoreFowardingPass,
+            CFGSimplPass,
+            SSAConstructionPass,
+            MemoryForwardingPass,
+            DeadStoreEliminationPass,
+            SCCPPass,
+            GVNPass,
+            LICMPass,
+            DCEPass
+        >(); while (RunPass<GlobalDCEPass>());
+    } // clang-format on
+
+    /// Run a pipeline of instruction passes on every function until
+    /// none of them change that function anymore.
     template <typename... Passes>
-    void RunPasses() {
-        /// Run all passes so long as at least one of them returns true.
-        while (((unsigned int) (RunPass<Passes>()) | ...)) {}
+    void RunFunctionPasses() {
+        std::vector<Function*> dirty{};
+        for (auto* f : mod->code())
+            if (not quiescent.contains(f))
+                dirty.push_back(f);
+
+        TimeReport::Timer timer{mod->context(), "Function Passes"};
+        CreateAnalyses();
+        ParallelFor(dirty.size(), mod->context()->option_jobs(), [&](usz i) {
+            /// Count the changes made to the function, and remember, for each
+            /// pass, how many there had been when it last ran without doing
+            /// anything. A pass can’t do anything new until some other pass
+            /// has changed the function since then, so it is skipped.
+            usz changes = 0;
+            std::array<usz, sizeof...(Passes)> idle_at;
+            idle_at.fill(usz(-1));
+
+            Trace::Event event{mod->context(), "Optimise Function"};
+            TraceFunction(event, dirty[i]);
+
+            for (bool changed = true; changed;) {
+                TimeReport::Timer iteration{"Iteration", timer};
+                ++function_pass_iterations;
+                changed = false;
+                usz pass = 0;
+                ((RunPassIfStale<Passes>(dirty[i], changes, idle_at[pass++], changed, iteration)), ...);
+            }
+        });
+
+        quiescent.insert(dirty.begin(), dirty.end());
     }
 
+    /// Run a pass on a function unless it has had nothing to do since
+    /// the last change to the function.
     template <typename Pass>
+    void RunPassIfStale(Function* f, usz& changes, usz& idle_at, bool& changed, const TimeReport::Timer& iteration) {
+        if (idle_at == changes) {
+            ++PassStatistics<Pass>::skipped;
+            return;
+        }
+
+        TimeReport::Timer timer{Pass::name, iteration};
+        TraceFunction(timer.event(), f);
+        if (RunPassOnFunction<Pass>(f)) {
+            changes++;
+            changed = true;
+        } else {
+            idle_at = changes;
+        }
+    }
+
+    /// Run a pass; any extra arguments initialise the members of a
+    /// module pass.
+    template <typename Pass, typename... Args>
     [[nodiscard]]
-    auto RunPass() -> bool {
+    auto RunPass(Args&&... args) -> bool {
         if constexpr (std::derived_from<Pass, InstructionRewritePass>) {
+            static_assert(sizeof...(Args) == 0, "Instruction passes take no arguments");
             return RunPassOnInstructions<Pass>();
         } else if constexpr (std::derived_from<Pass, ModuleRewritePass>) {
-            return RunPassOnModule<Pass>();
+            return RunPassOnModule<Pass>(std::forward<Args>(args)...);
         } else {
             static_assert(always_false<Pass>, "Pass must be an InstructionRewritePass or ModuleRewritePass");
         }
@@ -1022,59 +3009,119 @@ private:
     template <typename Pass>
     [[nodiscard]]
     auto RunPassOnInstructions() -> bool {
-        bool changed = false;
-        for (auto* f : mod->code()) {
-            Pass p{{mod}};
-
-            /// Use indices here to avoid iterator invalidation.
-            for (usz bi = 0; bi < f->blocks().size(); bi++) {
-                /// Call enter callback if there is one.
-                if constexpr (requires { &Pass::enter_block; }) p.enter_block(f->blocks()[bi]);
-
-                if constexpr (requires { &Pass::run_on_instruction; }) {
-                    for (usz ii = 0; ii < f->blocks()[bi]->instructions().size(); ii++) {
-                        auto Done = [&] {
-                            return bi >= f->blocks().size()
-                                or ii >= f->blocks()[bi]->instructions().size();
-                        };
-
-                        /// Some passes may end up deleting all remaining instructions,
-                        /// so make sure to check that we still have instructions left
-                        /// after each pass.
-                        if (Done()) break;
-
-                        /// Run the pass on the instruction.
-                        Inst* inst;
-                        do {
-                            inst = f->blocks()[bi]->instructions()[ii];
-                            p.run_on_instruction(inst);
-                        } while (not Done() and inst != f->blocks()[bi]->instructions()[ii]);
+        constexpr bool serial = requires { requires Pass::run_serially; };
+        auto& code = mod->code();
+        std::vector<char> changed(code.size());
+        TimeReport::Timer timer{mod->context(), Pass::name};
+        CreateAnalyses();
+        ParallelFor(code.size(), serial ? 1 : mod->context()->option_jobs(), [&](usz i) {
+            Trace::Event event{timer.event().trace(), Pass::name};
+            TraceFunction(event, code[i]);
+            changed[i] = RunPassOnFunction<Pass>(code[i]);
+        });
+
+        /// Functions changed by this pass may have more work for the others.
+        bool any = false;
+        for (usz i = 0; i < code.size(); i++) {
+            if (not changed[i]) continue;
+            quiescent.erase(code[i]);
+            any = true;
+        }
+        return any;
+    }
+
+    /// Make sure there is an entry for the analyses of every function,
+    /// so that passes running in parallel never insert any.
+    void CreateAnalyses() {
+        for (auto* f : mod->code()) analyses.try_emplace(f, f);
+    }
+
+    template <typename Pass>
+    [[nodiscard]]
+    auto RunPassOnFunction(Function* f) -> bool {
+        auto& cached = analyses.at(f);
+        Pass p{{{mod}, &cached}};
+
+        /// Use indices here to avoid iterator invalidation.
+        for (usz bi = 0; bi < f->blocks().size(); bi++) {
+            /// Call enter callback if there is one.
+            if constexpr (requires { &Pass::enter_block; }) p.enter_block(f->blocks()[bi]);
+
+            if constexpr (requires { &Pass::run_on_instruction; }) {
+                auto* b = f->blocks()[bi];
+                for (auto* inst = b->instructions().front(); inst;) {
+                    /// Run the pass on the instruction.
+                    auto* prev = inst->prev();
+                    p.run_on_instruction(inst);
+
+                    /// Some passes may end up deleting all remaining instructions
+                    /// or the block itself, so make sure to check that we still
+                    /// have instructions left after each pass.
+                    if (bi >= f->blocks().size() or f->blocks()[bi] != b) break;
+
+                    /// If the instruction is still there, move on to the next one.
+                    if (inst->block() == b) {
+                        inst = inst->next();
+                        continue;
                     }
+
+                    /// Otherwise, it was erased or replaced: run the pass on
+                    /// whatever is in its place now. If the instruction before
+                    /// it was erased as well, we have lost our place, so start
+                    /// over at the beginning of the block.
+                    inst = prev and prev->block() == b ? prev->next() : b->instructions().front();
                 }
+            }
 
-                /// Call leave() callback if there is one.
-                if constexpr (requires { &Pass::leave_block; }) p.leave_block(f->blocks()[bi]);
+            /// Call leave() callback if there is one.
+            if constexpr (requires { &Pass::leave_block; }) p.leave_block(f->blocks()[bi]);
 
-                /// Call atfork() callback if there is one and we’re at a fork.
-                if constexpr (requires { &Pass::atfork; }) {
-                    auto b = f->blocks()[bi];
-                    if (b->terminator() and is<CondBranchInst>(b->terminator()))
-                        p.atfork(b);
-                }
+            /// Call atfork() callback if there is one and we’re at a fork.
+            if constexpr (requires { &Pass::atfork; }) {
+                auto b = f->blocks()[bi];
+                if (b->terminator() and is<CondBranchInst>(b->terminator()))
+                    p.atfork(b);
             }
+        }
 
-            /// Call done() callback if there is one.
-            if constexpr (requires { &Pass::run_on_function; }) p.run_on_function(f);
-            changed = p.changed() or changed;
+        /// Revisit instructions whose operands have changed. Skip any that
+        /// have been erased in the meantime.
+        if constexpr (requires { requires Pass::use_worklist; }) {
+            while (auto* inst = p.next_from_worklist())
+                if (inst->block() and inst->block()->function() == f)
+                    p.run_on_instruction(inst);
         }
-        return changed;
+
+        /// Call done() callback if there is one.
+        if constexpr (requires { &Pass::run_on_function; }) p.run_on_function(f);
+
+        PassStatistics<Pass>::Record(p);
+
+        /// Analyses computed before the pass ran may be stale now.
+        constexpr bool preserves_cfg = requires { requires Pass::preserves_cfg; };
+        if (p.changed() and not preserves_cfg) cached.invalidate();
+        return p.changed();
     }
 
-    template <typename Pass>
+    template <typename Pass, typename... Args>
     [[nodiscard]]
-    auto RunPassOnModule() -> bool {
-        Pass p{{mod}};
+    auto RunPassOnModule(Args&&... args) -> bool {
+        TimeReport::Timer timer{mod->context(), Pass::name};
+        Pass p{{mod}, std::forward<Args>(args)...};
         p.run();
+        PassStatistics<Pass>::Record(p);
+
+        /// A module pass may have changed, or deleted, any function, unless
+        /// it tells us which ones it changed.
+        if constexpr (requires { p.changed_functions(); }) {
+            for (auto* f : p.changed_functions()) {
+                quiescent.erase(f);
+                if (auto it = analyses.find(f); it != analyses.end()) it->second.invalidate();
+            }
+        } else if (p.changed()) {
+            analyses.clear();
+        }
+
         return p.changed();
     }
 };
@@ -1083,11 +3130,15 @@ private:
 } // namespace lcc::opt
 
 void lcc::opt::Optimise(Module* module, int opt_level) {
+    TimeReport::Timer timer{module->context(), "Optimisation"};
     Optimiser o{module, opt_level};
     o.run();
+    if (auto* mem = module->context()->mem_report()) mem->count("IR instructions", module->instruction_count());
 }
 
 void lcc::opt::RunPasses(lcc::Module* module, std::string_view passes) {
+    TimeReport::Timer timer{module->context(), "Optimisation"};
     Optimiser o{module, 0};
     o.run_passes(passes);
+    if (auto* mem = module->context()->mem_report()) mem->count("IR instructions", module->instruction_count());
 }
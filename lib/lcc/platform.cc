@@ -12,11 +12,13 @@
 #    define NOMINMAX
 #    include <io.h>
 #    include <Windows.h>
+#    include <Psapi.h>
 #    define isatty _isatty
 #endif
 
 #ifdef __linux__
 #    include <execinfo.h>
+#    include <sys/resource.h>
 #    include <unistd.h>
 #endif
 
@@ -125,3 +127,35 @@ bool lcc::platform::StdoutIsTerminal() {
 bool lcc::platform::StderrIsTerminal() {
     return isatty(fileno(stderr));
 }
+
+auto lcc::platform::ResidentSetSize() -> std::size_t {
+#if defined(__linux__)
+    /// The second field of statm is the number of resident pages.
+    std::unique_ptr<FILE, decltype(&std::fclose)> f{std::fopen("/proc/self/statm", "r"), std::fclose};
+    if (not f) return 0;
+    unsigned long size{}, resident{};
+    if (std::fscanf(f.get(), "%lu %lu", &size, &resident) != 2) return 0;
+    return std::size_t(resident) * std::size_t(sysconf(_SC_PAGESIZE));
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (not GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters)) return 0;
+    return counters.WorkingSetSize;
+#else
+    return 0;
+#endif
+}
+
+auto lcc::platform::PeakResidentSetSize() -> std::size_t {
+#if defined(__linux__)
+    /// ru_maxrss is in kilobytes on Linux.
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return std::size_t(usage.ru_maxrss) * 1024;
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (not GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters)) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,61 @@
+#include <lcc/statistics.hh>
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lcc {
+namespace {
+/// Every statistic, most recently registered first. This is constant-
+/// initialised, so it is usable by statistics that are constructed
+/// before anything else in this file is.
+constinit const Statistic* statistics{};
+constinit std::mutex statistics_mutex{};
+} // namespace
+
+Statistic::Statistic(std::string_view group, std::string_view name, std::string_view description)
+    : _group(group), _name(name), _description(description) {
+    std::unique_lock lock{statistics_mutex};
+    _next = statistics;
+    statistics = this;
+}
+
+auto Statistic::Format() -> std::string {
+    std::vector<const Statistic*> stats{};
+    {
+        std::unique_lock lock{statistics_mutex};
+        for (auto* s = statistics; s; s = s->_next)
+            if (s->value()) stats.push_back(s);
+    }
+
+    rgs::sort(stats, [](const Statistic* a, const Statistic* b) {
+        if (a->_group != b->_group) return a->_group < b->_group;
+        return a->_name < b->_name;
+    });
+
+    usz group_width = 5;
+    usz name_width = 9;
+    for (auto* s : stats) {
+        group_width = std::max(group_width, s->_group.size());
+        name_width = std::max(name_width, s->_name.size());
+    }
+
+    std::string out = "Statistics\n";
+    out += fmt::format("{:>10}  {:<{}}  {:<{}}  {}\n", "Value", "Group", group_width, "Statistic", name_width, "Description");
+    for (auto* s : stats) {
+        out += fmt::format(
+            "{:>10}  {:<{}}  {:<{}}  {}\n",
+            s->value(),
+            s->_group,
+            group_width,
+            s->_name,
+            name_width,
+            s->_description
+        );
+    }
+    return out;
+}
+} // namespace lcc
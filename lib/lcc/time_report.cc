@@ -0,0 +1,167 @@
+#include <lcc/context.hh>
+#include <lcc/time_report.hh>
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lcc {
+namespace {
+/// The innermost timer that is running on this thread.
+thread_local const TimeReport::Timer* current_timer{};
+
+auto Milliseconds(TimeReport::Clock::duration d) -> double {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+auto Name(std::string_view path) -> std::string_view {
+    auto slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+auto Parent(std::string_view path) -> std::string_view {
+    auto slash = path.rfind('/');
+    return slash == std::string_view::npos ? std::string_view{} : path.substr(0, slash);
+}
+} // namespace
+
+TimeReport::Timer::Timer(const Context* ctx, std::string_view name)
+    : report(ctx->time_report()),
+      trace_event(ctx, name),
+      mem_phase(ctx, name) {
+    if (not report) return;
+    outer = current_timer;
+    path = outer and outer->report == report
+             ? fmt::format("{}/{}", outer->path, name)
+             : std::string{name};
+    current_timer = this;
+    start = Clock::now();
+}
+
+TimeReport::Timer::Timer(std::string_view name, const Timer& parent)
+    : report(parent.report),
+      trace_event(parent.trace_event.trace(), name) {
+    if (not report) return;
+    outer = current_timer;
+    path = fmt::format("{}/{}", parent.path, name);
+    current_timer = this;
+    start = Clock::now();
+}
+
+TimeReport::Timer::~Timer() {
+    if (not report) return;
+    report->add(path, Clock::now() - start);
+    current_timer = outer;
+}
+
+void TimeReport::add(const std::string& path, Clock::duration time) {
+    std::unique_lock lock{mutex};
+    auto& e = entries[path];
+    e.time += time;
+    e.count++;
+}
+
+namespace {
+/// A phase in the report, along with its subphases.
+struct Phase {
+    std::string_view path;
+    TimeReport::Clock::duration time;
+    usz count;
+    std::vector<Phase> children;
+};
+
+using Children = std::unordered_map<std::string_view, std::vector<std::string_view>>;
+
+/// Collect the children of the phase `parent`, sorted by the time spent
+/// in them, most first.
+template <typename Entries>
+auto BuildPhases(Entries& entries, Children& children, std::string_view parent) -> std::vector<Phase> {
+    std::vector<Phase> phases{};
+    for (auto path : children[parent]) {
+        auto& e = entries.at(std::string{path});
+        phases.push_back({path, e.time, e.count, BuildPhases(entries, children, path)});
+    }
+    rgs::sort(phases, [](const Phase& a, const Phase& b) {
+        if (a.time != b.time) return a.time > b.time;
+        return a.path < b.path;
+    });
+    return phases;
+}
+
+/// Arrange the entries of a report into a tree.
+template <typename Entries>
+auto BuildTree(Entries& entries) -> std::vector<Phase> {
+    /// Make sure every phase has an entry, even if it was never timed
+    /// itself, so that we can always find our way back to the root.
+    std::vector<std::string> missing{};
+    for (auto& [path, _] : entries)
+        for (auto p = Parent(path); not p.empty() and not entries.contains(std::string{p}); p = Parent(p))
+            missing.emplace_back(p);
+    for (auto& p : missing) (void) entries[std::move(p)];
+
+    Children children{};
+    for (auto& [path, _] : entries) children[Parent(path)].push_back(path);
+    return BuildPhases(entries, children, {});
+}
+
+void PrintPhases(std::string& out, const std::vector<Phase>& phases, TimeReport::Clock::duration total, usz depth) {
+    for (auto& p : phases) {
+        out += fmt::format(
+            "{:>12.3f} {:>6.1f}% {:>7}  {:{}}{}\n",
+            Milliseconds(p.time),
+            100 * Milliseconds(p.time) / Milliseconds(total),
+            p.count,
+            "",
+            2 * depth,
+            Name(p.path)
+        );
+        PrintPhases(out, p.children, total, depth + 1);
+    }
+}
+
+auto FormatPhasesJSON(const std::vector<Phase>& phases) -> std::string {
+    std::vector<std::string> objects{};
+    for (auto& p : phases) {
+        objects.push_back(fmt::format(
+            R"({{"name":"{}","time_ms":{:.3f},"count":{},"phases":{}}})",
+            utils::EscapeJSON(Name(p.path)),
+            Milliseconds(p.time),
+            p.count,
+            FormatPhasesJSON(p.children)
+        ));
+    }
+    return fmt::format("[{}]", fmt::join(objects, ","));
+}
+} // namespace
+
+auto TimeReport::str() -> std::string {
+    std::unique_lock lock{mutex};
+    auto total = Clock::now() - created;
+    std::string out = fmt::format("Time report (total: {:.3f} ms)\n", Milliseconds(total));
+    out += fmt::format("{:>12} {:>7} {:>7}  {}\n", "Time (ms)", "%", "Count", "Phase");
+    PrintPhases(out, BuildTree(entries), total, 0);
+    return out;
+}
+
+auto TimeReport::json() -> std::string {
+    std::unique_lock lock{mutex};
+    auto total = Clock::now() - created;
+    return fmt::format(
+        R"({{"total_ms":{:.3f},"phases":{}}})",
+        Milliseconds(total),
+        FormatPhasesJSON(BuildTree(entries))
+    );
+}
+
+auto TimeReport::times() -> std::vector<std::pair<std::string, Clock::duration>> {
+    std::unique_lock lock{mutex};
+    std::vector<std::pair<std::string, Clock::duration>> out{};
+    for (auto& [path, e] : entries) out.emplace_back(path, e.time);
+    rgs::sort(out);
+    return out;
+}
+} // namespace lcc
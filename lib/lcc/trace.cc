@@ -0,0 +1,77 @@
+#include <lcc/context.hh>
+#include <lcc/trace.hh>
+
+#include <atomic>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lcc {
+namespace {
+/// Threads are numbered in the order in which they first record an
+/// event; the ids the OS hands out are neither small nor stable.
+std::atomic<usz> thread_count{};
+thread_local usz thread_id = thread_count++;
+
+auto Microseconds(Trace::Clock::duration d) -> double {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+} // namespace
+
+Trace::Event::Event(const Context* ctx, std::string_view name)
+    : Event(ctx->trace(), name) {}
+
+Trace::Event::Event(Trace* trace, std::string_view name)
+    : trace_(trace) {
+    if (not trace_) return;
+    event_name = name;
+    start = Clock::now();
+}
+
+Trace::Event::~Event() {
+    if (not trace_) return;
+    auto end = Clock::now();
+    trace_->add({
+        std::move(event_name),
+        std::move(args),
+        thread_id,
+        start - trace_->created,
+        end - start,
+    });
+}
+
+void Trace::Event::arg(std::string_view key, std::string_view value) {
+    if (not trace_) return;
+    if (not args.empty()) args += ',';
+    args += fmt::format(R"("{}":"{}")", utils::EscapeJSON(key), utils::EscapeJSON(value));
+}
+
+void Trace::Event::arg(std::string_view key, usz value) {
+    if (not trace_) return;
+    if (not args.empty()) args += ',';
+    args += fmt::format(R"("{}":{})", utils::EscapeJSON(key), value);
+}
+
+void Trace::add(Record record) {
+    std::unique_lock lock{mutex};
+    records.push_back(std::move(record));
+}
+
+auto Trace::json() -> std::string {
+    std::unique_lock lock{mutex};
+    std::vector<std::string> events{};
+    events.reserve(records.size());
+    for (auto& r : records) {
+        events.push_back(fmt::format(
+            R"({{"name":"{}","ph":"X","ts":{:.3f},"dur":{:.3f},"pid":1,"tid":{},"args":{{{}}}}})",
+            utils::EscapeJSON(r.name),
+            Microseconds(r.start),
+            Microseconds(r.duration),
+            r.thread,
+            r.args
+        ));
+    }
+    return fmt::format(R"({{"traceEvents":[{}],"displayTimeUnit":"ms"}})", fmt::join(events, ","));
+}
+} // namespace lcc
@@ -1,4 +1,9 @@
 #include <lcc/utils.hh>
+#include <lcc/utils/interned_string.hh>
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
 
 void lcc::utils::ReplaceAll(
     std::string& str,
@@ -10,6 +15,105 @@ void lcc::utils::ReplaceAll(
         str.replace(i, from.length(), to);
 }
 
+auto lcc::utils::EditDistance(
+    std::string_view a,
+    std::string_view b,
+    bool transpositions,
+    usz limit
+) -> usz {
+    // Keep only the last three rows of the matrix, each of which is as
+    // long as the shorter string.
+    if (a.size() < b.size()) std::swap(a, b);
+    if (a.size() - b.size() > limit) return limit + 1;
+    const usz n = b.size() + 1;
+
+    constexpr usz InlineRowSize = 64;
+    usz inline_rows[3 * InlineRowSize];
+    std::vector<usz> heap_rows{};
+    usz* rows = inline_rows;
+    if (n > InlineRowSize) {
+        heap_rows.resize(3 * n);
+        rows = heap_rows.data();
+    }
+
+    usz* before = rows;
+    usz* prev = rows + n;
+    usz* curr = rows + 2 * n;
+    for (usz j = 0; j < n; j++) prev[j] = j;
+
+    usz prev_min = 0;
+    for (usz i = 1; i <= a.size(); i++) {
+        curr[0] = i;
+        usz curr_min = i;
+        for (usz j = 1; j < n; j++) {
+            usz cost = a[i - 1] != b[j - 1];
+            usz d = std::min({prev[j] + 1, curr[j - 1] + 1, prev[j - 1] + cost});
+            if (transpositions and i > 1 and j > 1 and a[i - 1] == b[j - 2] and a[i - 2] == b[j - 1])
+                d = std::min(d, before[j - 2] + 1);
+            curr[j] = d;
+            curr_min = std::min(curr_min, d);
+        }
+
+        // No entry in a row is smaller than the smallest one in the row
+        // before it or, through a transposition, in the one before that.
+        if (std::min(curr_min, prev_min) > limit) return limit + 1;
+        prev_min = curr_min;
+        std::swap(before, prev);
+        std::swap(prev, curr);
+    }
+
+    return prev[n - 1];
+}
+
+auto lcc::utils::EscapeJSON(std::string_view str) -> std::string {
+    std::string escaped{};
+    for (char c : str) {
+        if (c == '"' or c == '\\') escaped += '\\';
+        if (u8(c) < 0x20) escaped += fmt::format("\\u{:04x}", u8(c));
+        else escaped += c;
+    }
+    return escaped;
+}
+
 auto lcc::utils::NumberWidth(usz number, usz base) -> usz {
     return number == 0 ? 1 : usz(std::log(number) / std::log(base) + 1);
 }
+
+namespace {
+/// The strings are stored in a deque so that the views held by handles
+/// and used as keys in the map are never invalidated.
+struct InternTable {
+    std::mutex mutex;
+    std::deque<std::string> strings{""};
+    std::unordered_map<std::string_view, lcc::u32> ids{{strings.front(), 0}};
+};
+
+auto Interned() -> InternTable& {
+    static InternTable table;
+    return table;
+}
+} // namespace
+
+lcc::InternedString::InternedString(std::string_view text) {
+    auto& table = Interned();
+    std::lock_guard _{table.mutex};
+    auto it = table.ids.find(text);
+    if (it != table.ids.end()) {
+        *this = InternedString{it->first, it->second};
+        return;
+    }
+
+    LCC_ASSERT(table.strings.size() <= std::numeric_limits<u32>::max(), "Too many symbols");
+    auto id = u32(table.strings.size());
+    auto& str = table.strings.emplace_back(text);
+    table.ids.emplace(str, id);
+    *this = InternedString{str, id};
+}
+
+auto lcc::InternedString::Find(std::string_view text) -> std::optional<InternedString> {
+    auto& table = Interned();
+    std::lock_guard _{table.mutex};
+    auto it = table.ids.find(text);
+    if (it == table.ids.end()) return std::nullopt;
+    return InternedString{it->first, it->second};
+}
@@ -1,12 +1,24 @@
 #include <lcc/utils.hh>
+#include <object/coff.h>
 #include <object/elf.h>
 #include <object/generic.hh>
 
 #include <algorithm>
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#ifndef _WIN32
+#    include <sys/uio.h>
+#    include <unistd.h>
+#endif
+
 namespace lcc {
 
 // Don't forget to eventually set e_shnum and e_shstrndx
@@ -36,40 +48,229 @@ constexpr auto default_header() -> elf64_header {
     return hdr;
 }
 
-/// Append string to given byte buffer and return the index at the
-/// beginning of it.
-auto elf_add_string(std::vector<u8>& string_table, const char* new_string) {
-    LCC_ASSERT(new_string, "Invalid argument (cannot add NULL string to ELF string table)");
-    usz out = string_table.size();
-    while (*new_string)
-        string_table.push_back(u8(*new_string++));
-    string_table.push_back(0); // NULL terminator
-    return u32(out);
-}
-auto elf_add_string(std::vector<u8>& string_table, std::string_view new_string) {
-    usz out = string_table.size();
-    string_table.reserve(new_string.size());
-    string_table.insert(string_table.end(), new_string.begin(), new_string.end());
-    string_table.push_back(0); // NULL terminator
-    return u32(out);
-}
+/// Builds the contents of an ELF (or COFF) string table.
+///
+/// Strings are deduplicated, and a string that is a suffix of another
+/// shares the tail of that one rather than being stored separately
+/// (e.g. "bar" is the last four bytes of "_Z3bar"). Where a string ends
+/// up is only known once all of them have been added, so add() returns
+/// a handle, which offset() turns into the offset of the string after
+/// finalise() has been called.
+class StringTable {
+    /// Unique strings, by handle. Handle 0 is the empty string, which is
+    /// at offset 0.
+    std::vector<std::string_view> _strings{""};
+    std::unordered_map<std::string_view, u32> _handles{{"", 0}};
+    std::vector<u32> _offsets{};
+    std::vector<u8> _data{};
+
+public:
+    /// Add a string, if it isn't already in the table. The string is not
+    /// copied, so it must outlive the table.
+    auto add(std::string_view string) -> u32 {
+        LCC_ASSERT(_offsets.empty(), "Cannot add strings to a finalised string table");
+        LCC_ASSERT(not string.contains('\0'), "Cannot add string containing NUL to string table");
+        auto [it, inserted] = _handles.try_emplace(string, u32(_strings.size()));
+        if (inserted) _strings.push_back(string);
+        return it->second;
+    }
+
+    /// Lay out the table.
+    ///
+    /// Sorting the strings by their reversed contents puts every string
+    /// right before the ones that it is a suffix of, if there are any.
+    /// So, going through them in reverse, every string either is a
+    /// suffix of the string just before it (which is either stored or a
+    /// suffix of one that is), or needs to be stored itself.
+    void finalise() {
+        std::vector<u32> order(_strings.size() - 1);
+        for (auto [i, handle] : vws::enumerate(order)) handle = u32(i) + 1;
+        rgs::sort(order, [&](u32 lhs, u32 rhs) {
+            return rgs::lexicographical_compare(_strings[lhs] | vws::reverse, _strings[rhs] | vws::reverse);
+        });
+
+        // The empty string at offset 0.
+        _offsets.resize(_strings.size());
+        _data.push_back(0);
+
+        std::string_view previous{};
+        u32 previous_offset{};
+        for (auto handle : order | vws::reverse) {
+            auto string = _strings[handle];
+            if (previous.ends_with(string)) {
+                _offsets[handle] = previous_offset + u32(previous.size() - string.size());
+                continue;
+            }
+
+            _offsets[handle] = u32(_data.size());
+            _data.insert(_data.end(), string.begin(), string.end());
+            _data.push_back(0);
+            previous = string;
+            previous_offset = _offsets[handle];
+        }
+    }
+
+    /// The offset of a string in the table.
+    [[nodiscard]]
+    auto offset(u32 handle) const -> u32 {
+        LCC_ASSERT(not _offsets.empty(), "String table must be finalised before looking up offsets");
+        return _offsets[handle];
+    }
+
+    /// The contents of the table.
+    [[nodiscard]]
+    auto data() const -> std::span<const u8> {
+        LCC_ASSERT(not _offsets.empty(), "String table must be finalised before writing it");
+        return _data;
+    }
+};
 
 } // namespace
 
+namespace detail {
+/// Writes consecutive pieces of a file with as few system calls as
+/// possible, by collecting them into an I/O vector that is written out
+/// with writev() whenever it fills up. Pieces may also be collected into
+/// a buffer in memory instead.
+class ObjectWriter {
+    FILE* _file{};
+    std::vector<u8>* _buffer{};
+    usz _offset{};
+
+#ifndef _WIN32
+    std::vector<iovec> _pending{};
+    usz _max_pending = usz(sysconf(_SC_IOV_MAX) > 0 ? sysconf(_SC_IOV_MAX) : 16);
+#endif
+
+public:
+    explicit ObjectWriter(FILE* file) : _file{file} {
+        // Anything buffered must go out before we write around it.
+        std::fflush(_file);
+    }
+
+    explicit ObjectWriter(std::vector<u8>& buffer) : _buffer{&buffer} {
+        _buffer->clear();
+    }
+
+    /// Write \p data, which must start at \p offset into the file.
+    void write(usz offset, std::span<const u8> data) {
+        LCC_ASSERT(offset == _offset, "Object file pieces must be written in order and without gaps");
+        _offset += data.size();
+        if (data.empty()) return;
+        if (_buffer) {
+            _buffer->insert(_buffer->end(), data.begin(), data.end());
+            return;
+        }
+#ifndef _WIN32
+        if (_pending.size() == _max_pending) flush();
+        _pending.push_back({const_cast<u8*>(data.data()), data.size()});
+#else
+        if (std::fwrite(data.data(), 1, data.size(), _file) != data.size())
+            Diag::Fatal("Could not write object file: {}", std::strerror(errno));
+#endif
+    }
+
+    /// Write everything that is still pending.
+    void flush() {
+        if (_buffer) return;
+#ifndef _WIN32
+        int fd = fileno(_file);
+        auto* iov = _pending.data();
+        auto count = _pending.size();
+        while (count) {
+            auto n = ::writev(fd, iov, int(count));
+            if (n < 0 and errno == EINTR) continue;
+            if (n < 0) Diag::Fatal("Could not write object file: {}", std::strerror(errno));
+
+            // Skip what has been written, which may end in the middle of
+            // a piece.
+            auto written = usz(n);
+            while (count and written >= iov->iov_len) {
+                written -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count) {
+                iov->iov_base = static_cast<u8*>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            }
+        }
+        _pending.clear();
+#else
+        std::fflush(_file);
+#endif
+    }
+};
+} // namespace detail
+
 void GenericObject::as_elf(FILE* f) {
+    detail::ObjectWriter writer{f};
+    write_elf(writer);
+}
+
+void GenericObject::as_elf(std::vector<u8>& out) {
+    detail::ObjectWriter writer{out};
+    write_elf(writer);
+}
+
+void GenericObject::as_coff(FILE* f) {
+    detail::ObjectWriter writer{f};
+    write_coff(writer);
+}
+
+void GenericObject::as_coff(std::vector<u8>& out) {
+    detail::ObjectWriter writer{out};
+    write_coff(writer);
+}
+
+void GenericObject::write_elf(detail::ObjectWriter& writer) {
+    // Relocations go into a relocation section for the section they apply
+    // to, named after it (".rela.text" for ".text"). There always is one
+    // for .text, even if it's empty.
+    struct RelocationSection {
+        usz section_index;
+        std::string name;
+        std::vector<const Relocation*> relocations{};
+    };
+    std::vector<RelocationSection> relocation_sections{};
+    {
+        std::unordered_map<std::string_view, usz> section_indices{};
+        for (auto [i, section] : vws::enumerate(sections))
+            section_indices.try_emplace(section.name, usz(i));
+
+        std::vector<std::vector<const Relocation*>> relocations_by_section(sections.size());
+        for (auto& reloc : relocations) {
+            auto found = section_indices.find(reloc.symbol.section_name);
+            if (found == section_indices.end()) Diag::ICE(
+                "[GObj]: Could not find section {} mentioned by relocation of {}",
+                reloc.symbol.section_name,
+                reloc.symbol.name
+            );
+            relocations_by_section[found->second].push_back(&reloc);
+        }
+
+        // Reserve so that the names don't move; the string table refers
+        // to them.
+        relocation_sections.reserve(sections.size());
+        for (auto [i, section] : vws::enumerate(sections)) {
+            auto& section_relocations = relocations_by_section[usz(i)];
+            if (section.name != ".text" and section_relocations.empty()) continue;
+            relocation_sections.push_back({usz(i), ".rela" + section.name, std::move(section_relocations)});
+        }
+    }
+
     elf64_header hdr = default_header();
     // Section header table entry count
-    // NULL entry + GObj sections + ".strtab" + ".symtab" + ".rela.text"
-    hdr.e_shnum = u16(sections.size() + 4);
+    // NULL entry + GObj sections + ".symtab" + ".rela*" + ".strtab"
+    hdr.e_shnum = u16(sections.size() + relocation_sections.size() + 3);
     // Index of the section header table entry that contains the section
     // names.
     // Set down below.
     hdr.e_shstrndx = 0;
 
-    // Build string table
-    std::vector<u8> string_table;
-    // NULL entry
-    string_table.push_back(0);
+    // Build string table. The names of sections and symbols are handles
+    // into it until it has been laid out, and are patched up afterwards.
+    StringTable string_table{};
 
     using Attr = Section::Attribute;
     // Section headers go in here.
@@ -101,7 +302,7 @@ void GenericObject::as_elf(FILE* f) {
             shdr.sh_size = section.length();
         } else {
             shdr.sh_type = SHT_PROGBITS;
-            shdr.sh_size = section.contents().size();
+            shdr.sh_size = section.bytes().size();
             shdr.sh_offset = data_offset;
             data_offset += shdr.sh_size;
         }
@@ -112,8 +313,12 @@ void GenericObject::as_elf(FILE* f) {
             shdr.sh_flags |= SHF_EXECINSTR;
         if (section.attribute(Attr::LOAD))
             shdr.sh_flags |= SHF_ALLOC;
+        if (section.attribute(Attr::MERGE_STRINGS)) {
+            shdr.sh_flags |= SHF_MERGE | SHF_STRINGS;
+            shdr.sh_entsize = 1;
+        }
 
-        shdr.sh_name = elf_add_string(string_table, section.name);
+        shdr.sh_name = string_table.add(section.name);
 
         // Create symbol for this section
         {
@@ -129,7 +334,7 @@ void GenericObject::as_elf(FILE* f) {
 
     for (auto& sym : symbols) {
         elf64_sym elf_sym{};
-        elf_sym.st_name = elf_add_string(string_table, sym.name);
+        elf_sym.st_name = string_table.add(sym.name);
 
         if (sym.kind != Symbol::Kind::EXTERNAL) {
             // Get index of section by name
@@ -181,15 +386,16 @@ void GenericObject::as_elf(FILE* f) {
 
     // Index needed by relocation section header(s)
     usz symbol_table_sh_index = shdrs.size();
-    // Skip NULL entry and symbol table entry in section header table.
-    usz string_table_sh_index = sections.size() + 3;
+    // Skip NULL entry, symbol table entry, and relocation section entries
+    // in section header table.
+    usz string_table_sh_index = sections.size() + relocation_sections.size() + 2;
 
     // Symbol Table Section Header
     // shoutout https://stackoverflow.com/q/62497285
     {
         elf64_shdr shdr{};
         shdr.sh_type = SHT_SYMTAB;
-        shdr.sh_name = elf_add_string(string_table, ".symtab");
+        shdr.sh_name = string_table.add(".symtab");
         shdr.sh_size = syms.size() * sizeof(elf64_sym);
         shdr.sh_offset = data_offset;
 
@@ -208,11 +414,11 @@ void GenericObject::as_elf(FILE* f) {
         data_offset += shdr.sh_size;
     }
 
-    // ".text" relocations section headaer: ".rela.text"
-    {
+    // Relocation section headers, e.g. ".rela.text"
+    for (auto& relocation_section : relocation_sections) {
         elf64_shdr shdr{};
         shdr.sh_type = SHT_RELA;
-        shdr.sh_name = elf_add_string(string_table, ".rela.text");
+        shdr.sh_name = string_table.add(relocation_section.name);
         // "If the file has a loadable segment that includes relocation,
         // the sections’ attributes will include the SHF_ALLOC bit;
         // otherwise, that bit will be off."
@@ -221,11 +427,10 @@ void GenericObject::as_elf(FILE* f) {
         /// The section header index of the associated symbol table.
         shdr.sh_link = (uint32_t) symbol_table_sh_index;
         /// The section header index of the section to which the relocation
-        // applies. (.text in GenericObjectFile is always at index 0, so it's
-        // guaranteed that section 1 (first section) is ".text").
-        shdr.sh_info = 1;
+        // applies (skipping the NULL entry).
+        shdr.sh_info = u32(relocation_section.section_index + 1);
 
-        shdr.sh_size = relocations.size() * sizeof(elf64_rela);
+        shdr.sh_size = relocation_section.relocations.size() * sizeof(elf64_rela);
         shdr.sh_offset = data_offset;
         shdr.sh_entsize = sizeof(elf64_rela);
 
@@ -237,10 +442,9 @@ void GenericObject::as_elf(FILE* f) {
     {
         elf64_shdr shdr = {};
         shdr.sh_type = SHT_STRTAB;
-        shdr.sh_name = elf_add_string(string_table, ".strtab");
-        // FIXME: Ensure no more strings are added to table after this.
-        // TODO: Locking vector sort of container needed here as well.
-        shdr.sh_size = string_table.size();
+        shdr.sh_name = string_table.add(".strtab");
+        string_table.finalise();
+        shdr.sh_size = string_table.data().size();
         shdr.sh_offset = data_offset;
         hdr.e_shstrndx = u16(shdrs.size());
 
@@ -248,12 +452,14 @@ void GenericObject::as_elf(FILE* f) {
         data_offset += shdr.sh_size;
     }
 
+    for (auto& shdr : shdrs) shdr.sh_name = string_table.offset(shdr.sh_name);
+    for (auto& elf_sym : syms) elf_sym.st_name = string_table.offset(elf_sym.st_name);
+
     // Build elf64_rela relocations
-    std::vector<elf64_rela> elf_relocations{};
-    for (auto& reloc : relocations) {
+    auto elf_relocation = [&](const Relocation& reloc) {
         // Find symbol with matching name.
         auto found = std::find_if(syms.begin(), syms.end(), [&](elf64_sym elf_sym) {
-            char* sym_name = (char*) string_table.data() + elf_sym.st_name;
+            auto* sym_name = (const char*) string_table.data().data() + elf_sym.st_name;
             return strcmp(sym_name, reloc.symbol.name.data()) == 0;
         });
         if (found == syms.end()) Diag::ICE(
@@ -266,7 +472,7 @@ void GenericObject::as_elf(FILE* f) {
         elf_reloc.r_offset = reloc.symbol.byte_offset;
         switch (reloc.kind) {
             case Relocation::Kind::DISPLACEMENT32_PCREL: {
-                auto found_symbol = std::find_if(symbols.begin(), symbols.end(), [&](Symbol& symbol) {
+                auto found_symbol = std::find_if(symbols.begin(), symbols.end(), [&](const Symbol& symbol) {
                     return symbol.name == reloc.symbol.name;
                 });
                 if (found_symbol == symbols.end()) Diag::ICE(
@@ -287,32 +493,268 @@ void GenericObject::as_elf(FILE* f) {
                 elf_reloc.r_info = ELF64_R_INFO(sym_index, R_X86_64_32);
                 break;
 
+            case Relocation::Kind::PCREL32:
+                elf_reloc.r_info = ELF64_R_INFO(sym_index, R_X86_64_PC32);
+                elf_reloc.r_addend = reloc.addend;
+                break;
+
             default: LCC_UNREACHABLE();
         }
-        elf_relocations.push_back(elf_reloc);
+        return elf_reloc;
+    };
+    std::vector<std::vector<elf64_rela>> elf_relocations{};
+    for (auto& relocation_section : relocation_sections) {
+        auto& section_relocations = elf_relocations.emplace_back();
+        for (auto* reloc : relocation_section.relocations)
+            section_relocations.push_back(elf_relocation(*reloc));
     }
 
-    // Write ELF header
-    fwrite(&hdr, 1, sizeof(hdr), f);
-    // Write section header table
-    for (auto& shdr : shdrs)
-        fwrite(&shdr, 1, sizeof(shdr), f);
-    // Write section's data
-    for (auto& section : sections) {
-        if (section.is_fill) {
-            // Skips .bss
-            if (section.attribute(Attr::LOAD)) {
-                for (usz n = section.length(); n; --n)
-                    fwrite(&section.value(), 1, 1, f);
-            }
-        } else fwrite(section.contents().data(), 1, section.contents().size(), f);
+    // Everything has been laid out at precomputed offsets by now. Write
+    // the pieces straight from wherever they live, in order, without
+    // gathering them into one buffer first. NOBITS sections, like .bss,
+    // take up no space in the file.
+    writer.write(0, {reinterpret_cast<const u8*>(&hdr), sizeof(hdr)});
+    writer.write(hdr.e_shoff, {reinterpret_cast<const u8*>(shdrs.data()), shdrs.size() * sizeof(elf64_shdr)});
+    for (auto [i, section] : vws::enumerate(sections)) {
+        if (section.is_fill) continue;
+        writer.write(shdrs[usz(i) + 1].sh_offset, section.bytes());
     }
     // Write symbol table ".symtab"
-    fwrite(syms.data(), sizeof(*syms.data()), syms.size(), f);
-    // Write text section relocations ".rela.text"
-    fwrite(elf_relocations.data(), sizeof(*elf_relocations.data()), elf_relocations.size(), f);
+    writer.write(shdrs[symbol_table_sh_index].sh_offset, {reinterpret_cast<const u8*>(syms.data()), syms.size() * sizeof(elf64_sym)});
+    // Write relocation sections, e.g. ".rela.text"
+    for (auto [i, section_relocations] : vws::enumerate(elf_relocations)) {
+        writer.write(
+            shdrs[symbol_table_sh_index + 1 + usz(i)].sh_offset,
+            {reinterpret_cast<const u8*>(section_relocations.data()), section_relocations.size() * sizeof(elf64_rela)}
+        );
+    }
     // Write string table ".strtab"
-    fwrite(string_table.data(), 1, string_table.size(), f);
+    writer.write(shdrs[string_table_sh_index].sh_offset, string_table.data());
+    writer.flush();
+}
+
+void GenericObject::write_coff(detail::ObjectWriter& writer) {
+    static_assert(sizeof(coff_header) == 20);
+    static_assert(sizeof(coff_shdr) == 40);
+    static_assert(sizeof(coff_sym) == 18);
+    static_assert(sizeof(coff_aux_section) == sizeof(coff_sym));
+    static_assert(sizeof(coff_reloc) == 10);
+
+    using Attr = Section::Attribute;
+
+    // .note.GNU-stack only means something to ELF linkers.
+    std::vector<Section*> coff_sections{};
+    for (auto& section : sections)
+        if (section.name != ".note.GNU-stack") coff_sections.push_back(&section);
+    if (coff_sections.size() > usz(std::numeric_limits<i16>::max()))
+        Diag::Fatal("Too many sections for a COFF object: {}", coff_sections.size());
+
+    // One-based, like the section numbers of COFF symbols.
+    std::unordered_map<std::string_view, i16> section_numbers{};
+    for (auto [i, section] : vws::enumerate(coff_sections))
+        section_numbers.try_emplace(section->name, i16(i + 1));
+    auto section_number = [&](std::string_view name, std::string_view mentioned_by) -> i16 {
+        auto found = section_numbers.find(name);
+        if (found == section_numbers.end()) Diag::ICE(
+            "[GObj]: Could not find section {} mentioned by {}",
+            name,
+            mentioned_by
+        );
+        return found->second;
+    };
+
+    // Relocations are stored along with the section they apply to.
+    std::vector<std::vector<const Relocation*>> relocations_by_section(coff_sections.size());
+    for (auto& reloc : relocations)
+        relocations_by_section[usz(section_number(reloc.symbol.section_name, reloc.symbol.name) - 1)].push_back(&reloc);
+
+    // Names of more than eight bytes go into the string table, which
+    // follows the symbol table. They are patched into the section
+    // headers and symbols once it has been laid out.
+    StringTable string_table{};
+    std::vector<std::pair<usz, u32>> long_section_names{};
+    std::vector<std::pair<usz, u32>> long_symbol_names{};
+
+    coff_header hdr{};
+    hdr.Machine = IMAGE_FILE_MACHINE_AMD64;
+    hdr.NumberOfSections = u16(coff_sections.size());
+
+    // Section contents and their relocations go right after the section
+    // table, in order.
+    usz data_offset = sizeof(coff_header) + sizeof(coff_shdr) * coff_sections.size();
+
+    std::vector<coff_shdr> shdrs{};
+    std::vector<std::vector<coff_reloc>> coff_relocations(coff_sections.size());
+    for (auto [i, section] : vws::enumerate(coff_sections)) {
+        coff_shdr shdr{};
+        if (section->name.size() <= sizeof(shdr.Name))
+            std::memcpy(shdr.Name, section->name.data(), section->name.size());
+        else long_section_names.emplace_back(usz(i), string_table.add(section->name));
+
+        if (section->is_fill) {
+            shdr.SizeOfRawData = u32(section->length());
+            shdr.Characteristics |= IMAGE_SCN_CNT_UNINITIALIZED_DATA;
+        } else {
+            shdr.SizeOfRawData = u32(section->bytes().size());
+            if (shdr.SizeOfRawData) shdr.PointerToRawData = u32(data_offset);
+            data_offset += shdr.SizeOfRawData;
+            shdr.Characteristics |= section->attribute(Attr::EXECUTABLE)
+                                      ? IMAGE_SCN_CNT_CODE
+                                      : IMAGE_SCN_CNT_INITIALIZED_DATA;
+        }
+
+        shdr.Characteristics |= IMAGE_SCN_MEM_READ;
+        if (section->attribute(Attr::WRITABLE))
+            shdr.Characteristics |= IMAGE_SCN_MEM_WRITE;
+        if (section->attribute(Attr::EXECUTABLE))
+            shdr.Characteristics |= IMAGE_SCN_MEM_EXECUTE;
+        if (section->attribute(Attr::LOAD))
+            shdr.Characteristics |= IMAGE_SCN_ALIGN_16BYTES;
+        else shdr.Characteristics |= IMAGE_SCN_ALIGN_1BYTES | IMAGE_SCN_MEM_DISCARDABLE;
+
+        // If there are too many relocations to count in 16 bits, the
+        // actual count goes into an extra relocation in front.
+        auto relocation_count = relocations_by_section[usz(i)].size();
+        if (relocation_count) {
+            shdr.PointerToRelocations = u32(data_offset);
+            if (relocation_count >= 0xffff) {
+                shdr.Characteristics |= IMAGE_SCN_LNK_NRELOC_OVFL;
+                shdr.NumberOfRelocations = 0xffff;
+                coff_relocations[usz(i)].push_back({u32(relocation_count + 1), 0, 0});
+            } else shdr.NumberOfRelocations = u16(relocation_count);
+            data_offset += sizeof(coff_reloc) * (coff_relocations[usz(i)].size() + relocation_count);
+        }
+
+        shdrs.push_back(shdr);
+    }
+
+    // Every section gets a symbol, followed by an auxiliary record
+    // describing the section.
+    std::vector<coff_sym> syms{};
+    std::unordered_map<std::string_view, u32> symbol_indices{};
+    auto add_symbol = [&](std::string_view name, coff_sym sym) {
+        if (name.size() <= sizeof(sym.Name.ShortName))
+            std::memcpy(sym.Name.ShortName, name.data(), name.size());
+        else long_symbol_names.emplace_back(syms.size(), string_table.add(name));
+        syms.push_back(sym);
+    };
+
+    for (auto [i, section] : vws::enumerate(coff_sections)) {
+        coff_sym sym{};
+        sym.SectionNumber = i16(i + 1);
+        sym.StorageClass = IMAGE_SYM_CLASS_STATIC;
+        sym.NumberOfAuxSymbols = 1;
+        add_symbol(section->name, sym);
+
+        coff_aux_section aux{};
+        aux.Length = shdrs[usz(i)].SizeOfRawData;
+        aux.NumberOfRelocations = shdrs[usz(i)].NumberOfRelocations;
+        std::memcpy(&syms.emplace_back(), &aux, sizeof(aux));
+    }
+
+    for (auto& sym : symbols) {
+        symbol_indices.try_emplace(sym.name, u32(syms.size()));
+
+        coff_sym coff_symbol{};
+        coff_symbol.Value = u32(sym.byte_offset);
+        switch (sym.kind) {
+            case Symbol::Kind::STATIC:
+                coff_symbol.SectionNumber = section_number(sym.section_name, sym.name);
+                coff_symbol.StorageClass = IMAGE_SYM_CLASS_STATIC;
+                break;
+
+            case Symbol::Kind::EXPORT:
+                coff_symbol.SectionNumber = section_number(sym.section_name, sym.name);
+                coff_symbol.StorageClass = IMAGE_SYM_CLASS_EXTERNAL;
+                break;
+
+            case Symbol::Kind::FUNCTION:
+                coff_symbol.SectionNumber = section_number(sym.section_name, sym.name);
+                coff_symbol.Type = IMAGE_SYM_TYPE_FUNCTION;
+                coff_symbol.StorageClass = IMAGE_SYM_CLASS_EXTERNAL;
+                break;
+
+            case Symbol::Kind::EXTERNAL:
+                coff_symbol.SectionNumber = IMAGE_SYM_UNDEFINED;
+                coff_symbol.Value = 0;
+                coff_symbol.StorageClass = IMAGE_SYM_CLASS_EXTERNAL;
+                break;
+
+            case Symbol::Kind::NONE: LCC_UNREACHABLE();
+        }
+        add_symbol(sym.name, coff_symbol);
+    }
+
+    // Relocations may refer to sections by name, too.
+    for (auto [i, section] : vws::enumerate(coff_sections))
+        symbol_indices.try_emplace(section->name, u32(2 * usz(i)));
+
+    // COFF relocations have no addend; the linker adds whatever is stored
+    // at the relocated location instead, which is always zero here. So,
+    // REL32 is relative to the end of the displacement, just like the
+    // PC32 and PLT32 relocations with an addend of -4 in the ELF output.
+    for (auto [i, section_relocations] : vws::enumerate(relocations_by_section)) {
+        for (auto* reloc : section_relocations) {
+            auto found = symbol_indices.find(reloc->symbol.name);
+            if (found == symbol_indices.end()) Diag::ICE(
+                "Could not find symbol {} referenced by relocation",
+                reloc->symbol.name
+            );
+
+            coff_reloc coff_relocation{};
+            coff_relocation.VirtualAddress = u32(reloc->symbol.byte_offset);
+            coff_relocation.SymbolTableIndex = found->second;
+            switch (reloc->kind) {
+                case Relocation::Kind::DISPLACEMENT32_PCREL:
+                    coff_relocation.Type = IMAGE_REL_AMD64_REL32;
+                    break;
+
+                case Relocation::Kind::DISPLACEMENT32:
+                    coff_relocation.Type = IMAGE_REL_AMD64_ADDR32;
+                    break;
+
+                // REL32 can't express an offset from the relocated location
+                // itself without an addend stored in the section.
+                case Relocation::Kind::PCREL32:
+                    Diag::ICE("COFF output cannot represent relocation of {} relative to itself", reloc->symbol.name);
+
+                default: LCC_UNREACHABLE();
+            }
+            coff_relocations[usz(i)].push_back(coff_relocation);
+        }
+    }
+
+    hdr.PointerToSymbolTable = u32(data_offset);
+    hdr.NumberOfSymbols = u32(syms.size());
+
+    // The string table starts with its own size, which offsets count.
+    string_table.finalise();
+    u32 string_table_size = u32(sizeof(u32) + string_table.data().size());
+    for (auto [index, handle] : long_section_names) {
+        auto offset = fmt::format("/{}", sizeof(u32) + string_table.offset(handle));
+        if (offset.size() > sizeof(coff_shdr::Name))
+            Diag::Fatal("COFF string table is too large to refer to section {}", coff_sections[index]->name);
+        std::memcpy(shdrs[index].Name, offset.data(), offset.size());
+    }
+    for (auto [index, handle] : long_symbol_names) {
+        syms[index].Name.LongName.Zeroes = 0;
+        syms[index].Name.LongName.Offset = u32(sizeof(u32) + string_table.offset(handle));
+    }
+
+    writer.write(0, {reinterpret_cast<const u8*>(&hdr), sizeof(hdr)});
+    writer.write(sizeof(hdr), {reinterpret_cast<const u8*>(shdrs.data()), shdrs.size() * sizeof(coff_shdr)});
+    for (auto [i, section] : vws::enumerate(coff_sections)) {
+        auto& shdr = shdrs[usz(i)];
+        if (shdr.PointerToRawData) writer.write(shdr.PointerToRawData, section->bytes());
+        if (shdr.PointerToRelocations) writer.write(
+            shdr.PointerToRelocations,
+            {reinterpret_cast<const u8*>(coff_relocations[usz(i)].data()), coff_relocations[usz(i)].size() * sizeof(coff_reloc)}
+        );
+    }
+    writer.write(hdr.PointerToSymbolTable, {reinterpret_cast<const u8*>(syms.data()), syms.size() * sizeof(coff_sym)});
+    writer.write(hdr.PointerToSymbolTable + syms.size() * sizeof(coff_sym), {reinterpret_cast<const u8*>(&string_table_size), sizeof(string_table_size)});
+    writer.write(hdr.PointerToSymbolTable + syms.size() * sizeof(coff_sym) + sizeof(string_table_size), string_table.data());
+    writer.flush();
 }
 
 } // namespace lcc
@@ -0,0 +1,499 @@
+#include <lcc/utils.hh>
+#include <object/elf.h>
+#include <object/generic.hh>
+#include <object/linker.hh>
+
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace lcc::elf {
+namespace {
+/// Where the start of the file, and with it the first segment, is
+/// mapped. The code we generate refers to data by 32-bit absolute
+/// addresses, so everything has to be mapped below 4 GiB, which rules
+/// out position independent executables.
+constexpr u64 base_address = 0x400000;
+constexpr u64 page_size = 0x1000;
+constexpr u64 section_alignment = 16;
+constexpr u64 plt_stub_size = 8;
+
+constexpr std::string_view interpreter{"/lib64/ld-linux-x86-64.so.2"};
+constexpr std::string_view libc{"libc.so.6"};
+
+using Attr = Section::Attribute;
+
+/// Where a symbol is defined: at an offset into a section of an object.
+struct Definition {
+    usz object;
+    std::string_view section;
+    u64 offset;
+};
+
+/// Where a section that is loaded ended up.
+struct Placement {
+    u64 address;
+    /// Offset into the file; meaningless for fill sections.
+    u64 offset;
+};
+
+auto FindSection(GenericObject& object, std::string_view name) -> Section* {
+    auto found = rgs::find_if(object.sections, [&](const Section& s) { return s.name == name; });
+    return found == object.sections.end() ? nullptr : &*found;
+}
+
+template <typename T>
+void Put(std::vector<u8>& out, u64 offset, const T& value) {
+    std::memcpy(out.data() + offset, &value, sizeof value);
+}
+
+/// Append a displacement from the end of the 32-bit displacement that
+/// is being appended to \p code, which starts at \p address, to \p target.
+void Rel32(std::vector<u8>& code, u64 address, u64 target) {
+    auto displacement = i64(target) - i64(address + code.size() + 4);
+    LCC_ASSERT(
+        displacement >= std::numeric_limits<i32>::min() and displacement <= std::numeric_limits<i32>::max(),
+        "Entry point is out of range of what it calls"
+    );
+    auto value = u32(i32(displacement));
+    for (usz i = 0; i < 4; ++i) code.push_back(u8(value >> (i * 8)));
+}
+
+/// The entry point of a dynamically linked executable, which leaves it
+/// to the C library to set everything up and call main; this is what
+/// crt1.o does.
+auto DynamicStart(u64 address, u64 main, u64 libc_start_main_slot) -> std::vector<u8> {
+    std::vector<u8> code{
+        0x31, 0xed,             // xor %ebp, %ebp
+        0x49, 0x89, 0xd1,       // mov %rdx, %r9 (rtld_fini)
+        0x5e,                   // pop %rsi (argc)
+        0x48, 0x89, 0xe2,       // mov %rsp, %rdx (argv)
+        0x48, 0x83, 0xe4, 0xf0, // and $-16, %rsp
+        0x50,                   // push %rax
+        0x54,                   // push %rsp (stack_end)
+        0x45, 0x31, 0xc0,       // xor %r8d, %r8d (fini)
+        0x31, 0xc9,             // xor %ecx, %ecx (init)
+        0x48, 0x8d, 0x3d,       // lea main(%rip), %rdi
+    };
+    Rel32(code, address, main);
+    code.insert(code.end(), {0xff, 0x15}); // call *__libc_start_main@GOT(%rip)
+    Rel32(code, address, libc_start_main_slot);
+    code.push_back(0xf4); // hlt
+    return code;
+}
+
+/// The entry point of a statically linked executable, which calls main
+/// and exits with what it returns.
+auto StaticStart(u64 address, u64 main) -> std::vector<u8> {
+    std::vector<u8> code{
+        0x31, 0xed,                   // xor %ebp, %ebp
+        0x48, 0x8b, 0x3c, 0x24,       // mov (%rsp), %rdi (argc)
+        0x48, 0x8d, 0x74, 0x24, 0x08, // lea 8(%rsp), %rsi (argv)
+        0x48, 0x83, 0xe4, 0xf0,       // and $-16, %rsp
+        0xe8,                         // call main
+    };
+    Rel32(code, address, main);
+    code.insert(
+        code.end(),
+        {
+            0x89, 0xc7,                   // mov %eax, %edi
+            0xb8, 0x3c, 0x00, 0x00, 0x00, // mov $60, %eax (exit)
+            0x0f, 0x05,                   // syscall
+            0xf4,                         // hlt
+        }
+    );
+    return code;
+}
+
+/// Both entry points are always the same size.
+constexpr u64 dynamic_start_size = 34;
+constexpr u64 static_start_size = 30;
+} // namespace
+
+auto link_executable(std::span<GenericObject> objects) -> std::optional<std::vector<u8>> {
+    bool ok = true;
+
+    // Symbols of an object, along with its sections, which relocations
+    // may refer to by name as well; and the symbols that other objects
+    // can refer to.
+    std::vector<std::unordered_map<std::string_view, Definition>> locals(objects.size());
+    std::unordered_map<std::string_view, std::vector<Definition>> globals{};
+    for (usz i = 0; i < objects.size(); ++i) {
+        for (auto& sym : objects[i].symbols) {
+            if (sym.kind == Symbol::Kind::EXTERNAL) continue;
+            Definition def{i, sym.section_name, sym.byte_offset};
+            locals[i].try_emplace(sym.name, def);
+            if (sym.kind == Symbol::Kind::FUNCTION or sym.kind == Symbol::Kind::EXPORT)
+                globals[sym.name].push_back(def);
+        }
+        for (auto& section : objects[i].sections)
+            locals[i].try_emplace(section.name, Definition{i, section.name, 0});
+    }
+
+    // Internal functions are global symbols too, so it's only an error
+    // for a symbol to be defined more than once if something that isn't
+    // defining it refers to it.
+    std::unordered_set<std::string_view> reported{};
+    auto FindGlobal = [&](std::string_view name) -> const Definition* {
+        auto global = globals.find(name);
+        if (global == globals.end()) return nullptr;
+        if (global->second.size() > 1 and reported.insert(name).second) {
+            Diag::Error("Symbol `{}` is defined in more than one object", name);
+            ok = false;
+        }
+        return &global->second.front();
+    };
+
+    auto Find = [&](usz object, std::string_view name) -> const Definition* {
+        auto local = locals[object].find(name);
+        if (local != locals[object].end()) return &local->second;
+        return FindGlobal(name);
+    };
+
+    // Everything that isn't defined anywhere is imported from libc.
+    std::vector<std::string_view> imports{};
+    std::unordered_map<std::string_view, usz> import_indices{};
+    auto Import = [&](std::string_view name) {
+        if (import_indices.try_emplace(name, imports.size()).second)
+            imports.push_back(name);
+    };
+
+    auto IsLoaded = [](Section* section) {
+        return section and section->attribute(Attr::LOAD);
+    };
+
+    for (usz i = 0; i < objects.size(); ++i) {
+        for (auto& reloc : objects[i].relocations) {
+            if (not IsLoaded(FindSection(objects[i], reloc.symbol.section_name))) continue;
+            if (not Find(i, reloc.symbol.name)) Import(reloc.symbol.name);
+        }
+    }
+
+    const bool dynamic = not imports.empty();
+    const Definition* start = FindGlobal("_start");
+    const Definition* main{};
+    if (not start) {
+        main = FindGlobal("main");
+        if (not main) {
+            Diag::Error("Cannot link executable: there is no `main` function for it to start at");
+            ok = false;
+        }
+        if (dynamic) Import("__libc_start_main");
+    }
+
+    if (not ok) return std::nullopt;
+
+    // Program headers: PT_PHDR, PT_INTERP, and PT_DYNAMIC if the
+    // executable is dynamically linked, and two PT_LOAD and PT_GNU_STACK
+    // always.
+    const usz phnum = dynamic ? 6 : 3;
+    u64 offset = sizeof(elf64_header) + phnum * sizeof(elf64_phdr);
+
+    // Everything the dynamic linker needs to know about the executable,
+    // which goes first, right after the headers.
+    u64 interp_offset{};
+    u64 hash_offset{};
+    u64 dynsym_offset{};
+    u64 rela_offset{};
+    u64 dynstr_offset{};
+    std::vector<u8> dynstr{0};
+    u32 libc_name{};
+    std::vector<u32> import_names{};
+    if (dynamic) {
+        auto AddString = [&](std::string_view string) {
+            auto at = u32(dynstr.size());
+            dynstr.insert(dynstr.end(), string.begin(), string.end());
+            dynstr.push_back(0);
+            return at;
+        };
+
+        libc_name = AddString(libc);
+        for (auto name : imports) import_names.push_back(AddString(name));
+
+        interp_offset = offset;
+        offset += interpreter.size() + 1;
+        offset = utils::AlignTo(offset, u64(8));
+        hash_offset = offset;
+        offset += (3 + imports.size() + 1) * sizeof(u32);
+        offset = utils::AlignTo(offset, u64(8));
+        dynsym_offset = offset;
+        offset += (imports.size() + 1) * sizeof(elf64_sym);
+        rela_offset = offset;
+        offset += imports.size() * sizeof(elf64_rela);
+        dynstr_offset = offset;
+        offset += dynstr.size();
+    }
+
+    // Lay out sections, along with the code we generate, the entry point
+    // and a stub per imported function. Fill sections go last, after the
+    // end of the file.
+    std::vector<std::unordered_map<std::string_view, Placement>> placements(objects.size());
+    auto Place = [&](bool writable) {
+        for (usz i = 0; i < objects.size(); ++i) {
+            for (auto& section : objects[i].sections) {
+                if (not section.attribute(Attr::LOAD) or section.is_fill) continue;
+                if (section.attribute(Attr::WRITABLE) != writable) continue;
+                offset = utils::AlignTo(offset, section_alignment);
+                placements[i].try_emplace(section.name, Placement{base_address + offset, offset});
+                offset += section.bytes().size();
+            }
+        }
+    };
+
+    Place(false);
+    offset = utils::AlignTo(offset, section_alignment);
+    const u64 start_offset = offset;
+    if (not start) offset += dynamic ? dynamic_start_size : static_start_size;
+    offset = utils::AlignTo(offset, section_alignment);
+    const u64 plt_offset = offset;
+    offset += imports.size() * plt_stub_size;
+    const u64 text_end = offset;
+
+    offset = utils::AlignTo(offset, page_size);
+    const u64 data_offset = offset;
+    Place(true);
+    offset = utils::AlignTo(offset, u64(8));
+    const u64 got_offset = offset;
+    offset += imports.size() * sizeof(u64);
+    const u64 dynamic_offset = offset;
+    std::vector<elf64_dyn> dynamic_entries{};
+    if (dynamic) {
+        dynamic_entries = {
+            {DT_NEEDED, libc_name},
+            {DT_HASH, base_address + hash_offset},
+            {DT_STRTAB, base_address + dynstr_offset},
+            {DT_SYMTAB, base_address + dynsym_offset},
+            {DT_STRSZ, dynstr.size()},
+            {DT_SYMENT, sizeof(elf64_sym)},
+            {DT_RELA, base_address + rela_offset},
+            {DT_RELASZ, imports.size() * sizeof(elf64_rela)},
+            {DT_RELAENT, sizeof(elf64_rela)},
+            {DT_FLAGS, DF_BIND_NOW},
+            {DT_DEBUG, 0},
+            {DT_NULL, 0},
+        };
+        offset += dynamic_entries.size() * sizeof(elf64_dyn);
+    }
+    const u64 file_size = offset;
+
+    u64 memory_end = file_size;
+    for (usz i = 0; i < objects.size(); ++i) {
+        for (auto& section : objects[i].sections) {
+            if (not section.attribute(Attr::LOAD) or not section.is_fill) continue;
+            memory_end = utils::AlignTo(memory_end, section_alignment);
+            placements[i].try_emplace(section.name, Placement{base_address + memory_end, 0});
+            memory_end += section.length();
+        }
+    }
+
+    auto Address = [&](const Definition& def) -> std::optional<u64> {
+        auto placed = placements[def.object].find(def.section);
+        if (placed == placements[def.object].end()) return std::nullopt;
+        return placed->second.address + def.offset;
+    };
+
+    auto PltAddress = [&](std::string_view name) {
+        return base_address + plt_offset + import_indices.at(name) * plt_stub_size;
+    };
+
+    auto GotAddress = [&](std::string_view name) {
+        return base_address + got_offset + import_indices.at(name) * sizeof(u64);
+    };
+
+    std::vector<u8> out(file_size);
+
+    // Headers.
+    {
+        elf64_header hdr{};
+        hdr.e_ident[EI_MAG0] = 0x7f;
+        hdr.e_ident[EI_MAG1] = 'E';
+        hdr.e_ident[EI_MAG2] = 'L';
+        hdr.e_ident[EI_MAG3] = 'F';
+        hdr.e_ident[EI_CLASS] = EI_CLASS_64BIT;
+        hdr.e_ident[EI_DATA] = EI_DATA_LITTLE_ENDIAN;
+        hdr.e_ident[EI_VERSION] = 1;
+        hdr.e_ident[EI_OSABI] = EI_OSABI_SYSV;
+        hdr.e_type = ET_EXEC;
+        hdr.e_machine = EM_X86_64;
+        hdr.e_version = 1;
+        hdr.e_entry = start ? *Address(*start) : base_address + start_offset;
+        hdr.e_phoff = sizeof(elf64_header);
+        hdr.e_ehsize = sizeof(elf64_header);
+        hdr.e_phentsize = sizeof(elf64_phdr);
+        hdr.e_phnum = u16(phnum);
+        Put(out, 0, hdr);
+
+        std::vector<elf64_phdr> phdrs{};
+        auto Segment = [&](u32 type, u32 flags, u64 at, u64 size, u64 memory_size, u64 align) {
+            elf64_phdr phdr{};
+            phdr.p_type = type;
+            phdr.p_flags = flags;
+            phdr.p_offset = at;
+            phdr.p_vaddr = base_address + at;
+            phdr.p_paddr = base_address + at;
+            phdr.p_filesz = size;
+            phdr.p_memsz = memory_size;
+            phdr.p_align = align;
+            phdrs.push_back(phdr);
+        };
+
+        const u64 phdrs_size = phnum * sizeof(elf64_phdr);
+        if (dynamic) {
+            Segment(PT_PHDR, PF_R, sizeof(elf64_header), phdrs_size, phdrs_size, 8);
+            Segment(PT_INTERP, PF_R, interp_offset, interpreter.size() + 1, interpreter.size() + 1, 1);
+        }
+        Segment(PT_LOAD, PF_R | PF_X, 0, text_end, text_end, page_size);
+        Segment(PT_LOAD, PF_R | PF_W, data_offset, file_size - data_offset, memory_end - data_offset, page_size);
+        if (dynamic) {
+            const u64 dynamic_size = dynamic_entries.size() * sizeof(elf64_dyn);
+            Segment(PT_DYNAMIC, PF_R | PF_W, dynamic_offset, dynamic_size, dynamic_size, 8);
+        }
+        Segment(PT_GNU_STACK, PF_R | PF_W, 0, 0, 0, 16);
+
+        for (auto [i, phdr] : vws::enumerate(phdrs))
+            Put(out, sizeof(elf64_header) + usz(i) * sizeof(elf64_phdr), phdr);
+    }
+
+    // Dynamic linking information. Every imported function is bound when
+    // the executable is loaded, by a GLOB_DAT relocation of its GOT slot.
+    if (dynamic) {
+        std::memcpy(out.data() + interp_offset, interpreter.data(), interpreter.size());
+
+        // A single bucket, whose chain has every symbol.
+        const auto nchain = u32(imports.size() + 1);
+        Put(out, hash_offset, u32(1));
+        Put(out, hash_offset + 4, nchain);
+        Put(out, hash_offset + 8, u32(imports.size()));
+        for (u32 i = 0; i < nchain; ++i)
+            Put(out, hash_offset + 12 + i * sizeof(u32), i == 0 ? u32(0) : i - 1);
+
+        for (auto [i, name] : vws::enumerate(import_names)) {
+            elf64_sym sym{};
+            sym.st_name = name;
+            sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+            Put(out, dynsym_offset + (usz(i) + 1) * sizeof(elf64_sym), sym);
+
+            elf64_rela rela{};
+            rela.r_offset = base_address + got_offset + usz(i) * sizeof(u64);
+            rela.r_info = ELF64_R_INFO(u64(i) + 1, R_X86_64_GLOB_DAT);
+            Put(out, rela_offset + usz(i) * sizeof(elf64_rela), rela);
+        }
+
+        std::memcpy(out.data() + dynstr_offset, dynstr.data(), dynstr.size());
+
+        for (auto [i, entry] : vws::enumerate(dynamic_entries))
+            Put(out, dynamic_offset + usz(i) * sizeof(elf64_dyn), entry);
+    }
+
+    // Sections, and the code we generate.
+    for (usz i = 0; i < objects.size(); ++i) {
+        for (auto& section : objects[i].sections) {
+            if (section.is_fill) continue;
+            auto placed = placements[i].find(section.name);
+            if (placed == placements[i].end()) continue;
+            auto bytes = section.bytes();
+            if (not bytes.empty()) std::memcpy(out.data() + placed->second.offset, bytes.data(), bytes.size());
+        }
+    }
+
+    if (not start) {
+        const u64 address = base_address + start_offset;
+        auto code = dynamic
+                      ? DynamicStart(address, *Address(*main), GotAddress("__libc_start_main"))
+                      : StaticStart(address, *Address(*main));
+        LCC_ASSERT(code.size() == (dynamic ? dynamic_start_size : static_start_size));
+        std::memcpy(out.data() + start_offset, code.data(), code.size());
+    }
+
+    for (auto name : imports) {
+        // jmp *name@GOT(%rip), then padding.
+        const u64 address = PltAddress(name);
+        std::vector<u8> code{0xff, 0x25};
+        Rel32(code, address, GotAddress(name));
+        code.resize(plt_stub_size, 0xcc);
+        std::memcpy(out.data() + (address - base_address), code.data(), code.size());
+    }
+
+    // Relocations.
+    for (usz i = 0; i < objects.size(); ++i) {
+        for (auto& reloc : objects[i].relocations) {
+            auto* section = FindSection(objects[i], reloc.symbol.section_name);
+            if (not section) Diag::ICE(
+                "[Link]: Could not find section {} mentioned by relocation of {}",
+                reloc.symbol.section_name,
+                reloc.symbol.name
+            );
+
+            auto placed = placements[i].find(section->name);
+            if (placed == placements[i].end()) continue;
+            if (section->is_fill or reloc.symbol.byte_offset + 4 > section->bytes().size()) Diag::ICE(
+                "[Link]: Relocation of {} is out of bounds of section {}",
+                reloc.symbol.name,
+                section->name
+            );
+
+            u64 target{};
+            if (auto* def = Find(i, reloc.symbol.name)) {
+                auto address = Address(*def);
+                if (not address) {
+                    Diag::Error(
+                        "Cannot link executable: `{}` refers to `{}`, which is in section `{}` that is not loaded",
+                        section->name,
+                        reloc.symbol.name,
+                        def->section
+                    );
+                    ok = false;
+                    continue;
+                }
+                target = *address;
+            } else {
+                target = PltAddress(reloc.symbol.name);
+            }
+
+            const auto place = i64(placed->second.address + reloc.symbol.byte_offset);
+            i64 value{};
+            bool in_range{};
+            switch (reloc.kind) {
+                case Relocation::Kind::NONE: continue;
+
+                case Relocation::Kind::DISPLACEMENT32_PCREL:
+                    value = i64(target) - place - 4;
+                    in_range = value >= std::numeric_limits<i32>::min() and value <= std::numeric_limits<i32>::max();
+                    break;
+
+                case Relocation::Kind::PCREL32:
+                    value = i64(target) + reloc.addend - place;
+                    in_range = value >= std::numeric_limits<i32>::min() and value <= std::numeric_limits<i32>::max();
+                    break;
+
+                case Relocation::Kind::DISPLACEMENT32:
+                    value = i64(target);
+                    in_range = target <= std::numeric_limits<u32>::max();
+                    break;
+            }
+
+            if (not in_range) {
+                Diag::Error(
+                    "Cannot link executable: reference to `{}` from `{}` is out of range",
+                    reloc.symbol.name,
+                    section->name
+                );
+                ok = false;
+                continue;
+            }
+
+            Put(out, placed->second.offset + reloc.symbol.byte_offset, u32(value));
+        }
+    }
+
+    if (not ok) return std::nullopt;
+    return out;
+}
+
+} // namespace lcc::elf
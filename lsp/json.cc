@@ -0,0 +1,236 @@
+#include <json.hh>
+
+#include <lcc/utils.hh>
+
+#include <charconv>
+#include <cmath>
+#include <fmt/format.h>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lsp::json {
+namespace {
+const Value Null{};
+const Array EmptyArray{};
+
+template <typename... Fs>
+struct Overloaded : Fs... {
+    using Fs::operator()...;
+};
+
+class Parser {
+    std::string_view text;
+    lcc::usz pos = 0;
+
+public:
+    explicit Parser(std::string_view source) : text(source) {}
+
+    auto parse_document() -> std::optional<Value> {
+        auto v = parse_value();
+        skip_whitespace();
+        if (not v or pos != text.size()) return std::nullopt;
+        return v;
+    }
+
+private:
+    void skip_whitespace() {
+        while (pos < text.size() and (text[pos] == ' ' or text[pos] == '\t' or text[pos] == '\n' or text[pos] == '\r'))
+            pos++;
+    }
+
+    auto consume(std::string_view s) -> bool {
+        if (not text.substr(pos).starts_with(s)) return false;
+        pos += s.size();
+        return true;
+    }
+
+    auto parse_value() -> std::optional<Value> {
+        skip_whitespace();
+        if (pos == text.size()) return std::nullopt;
+        switch (text[pos]) {
+            case '{': return parse_object();
+            case '[': return parse_array();
+            case '"': {
+                auto s = parse_string();
+                if (not s) return std::nullopt;
+                return Value{std::move(*s)};
+            }
+            case 't': return consume("true") ? std::optional<Value>{true} : std::nullopt;
+            case 'f': return consume("false") ? std::optional<Value>{false} : std::nullopt;
+            case 'n': return consume("null") ? std::optional<Value>{nullptr} : std::nullopt;
+            default: return parse_number();
+        }
+    }
+
+    auto parse_number() -> std::optional<Value> {
+        double n{};
+        auto [ptr, ec] = std::from_chars(text.data() + pos, text.data() + text.size(), n);
+        if (ec != std::errc()) return std::nullopt;
+        pos = lcc::usz(ptr - text.data());
+        return Value{n};
+    }
+
+    /// Append a code point to a string as UTF-8.
+    static void Append(std::string& s, char32_t c) {
+        if (c < 0x80) {
+            s += char(c);
+        } else if (c < 0x800) {
+            s += char(0xC0 | (c >> 6));
+            s += char(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            s += char(0xE0 | (c >> 12));
+            s += char(0x80 | ((c >> 6) & 0x3F));
+            s += char(0x80 | (c & 0x3F));
+        } else {
+            s += char(0xF0 | (c >> 18));
+            s += char(0x80 | ((c >> 12) & 0x3F));
+            s += char(0x80 | ((c >> 6) & 0x3F));
+            s += char(0x80 | (c & 0x3F));
+        }
+    }
+
+    auto parse_hex4() -> std::optional<char32_t> {
+        if (pos + 4 > text.size()) return std::nullopt;
+        unsigned n{};
+        auto [ptr, ec] = std::from_chars(text.data() + pos, text.data() + pos + 4, n, 16);
+        if (ec != std::errc() or ptr != text.data() + pos + 4) return std::nullopt;
+        pos += 4;
+        return char32_t(n);
+    }
+
+    auto parse_string() -> std::optional<std::string> {
+        pos++;
+        std::string s{};
+        while (pos < text.size() and text[pos] != '"') {
+            char c = text[pos++];
+            if (c != '\\') {
+                s += c;
+                continue;
+            }
+
+            if (pos == text.size()) return std::nullopt;
+            switch (text[pos++]) {
+                case '"': s += '"'; break;
+                case '\\': s += '\\'; break;
+                case '/': s += '/'; break;
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'n': s += '\n'; break;
+                case 'r': s += '\r'; break;
+                case 't': s += '\t'; break;
+                case 'u': {
+                    auto c1 = parse_hex4();
+                    if (not c1) return std::nullopt;
+
+                    /// Characters outside the BMP are escaped as surrogate pairs.
+                    if (*c1 >= 0xD800 and *c1 < 0xDC00 and consume("\\u")) {
+                        auto c2 = parse_hex4();
+                        if (not c2) return std::nullopt;
+                        *c1 = 0x10000 + ((*c1 - 0xD800) << 10) + (*c2 - 0xDC00);
+                    }
+                    Append(s, *c1);
+                } break;
+                default: return std::nullopt;
+            }
+        }
+
+        if (not consume("\"")) return std::nullopt;
+        return s;
+    }
+
+    auto parse_array() -> std::optional<Value> {
+        pos++;
+        Array a{};
+        skip_whitespace();
+        if (consume("]")) return Value{std::move(a)};
+        for (;;) {
+            auto v = parse_value();
+            if (not v) return std::nullopt;
+            a.push_back(std::move(*v));
+            skip_whitespace();
+            if (consume("]")) return Value{std::move(a)};
+            if (not consume(",")) return std::nullopt;
+        }
+    }
+
+    auto parse_object() -> std::optional<Value> {
+        pos++;
+        Object o{};
+        skip_whitespace();
+        if (consume("}")) return Value{std::move(o)};
+        for (;;) {
+            skip_whitespace();
+            if (pos == text.size() or text[pos] != '"') return std::nullopt;
+            auto key = parse_string();
+            if (not key) return std::nullopt;
+            skip_whitespace();
+            if (not consume(":")) return std::nullopt;
+            auto v = parse_value();
+            if (not v) return std::nullopt;
+            o.emplace_back(std::move(*key), std::move(*v));
+            skip_whitespace();
+            if (consume("}")) return Value{std::move(o)};
+            if (not consume(",")) return std::nullopt;
+        }
+    }
+};
+} // namespace
+
+auto Value::as_int() const -> lcc::i64 {
+    if (auto* n = std::get_if<double>(&data)) return lcc::i64(*n);
+    return 0;
+}
+
+auto Value::as_string() const -> std::string_view {
+    if (auto* s = std::get_if<std::string>(&data)) return *s;
+    return {};
+}
+
+auto Value::as_array() const -> const Array& {
+    if (auto* a = std::get_if<Array>(&data)) return *a;
+    return EmptyArray;
+}
+
+auto Value::operator[](std::string_view key) const -> const Value& {
+    if (auto* o = std::get_if<Object>(&data))
+        for (auto& [k, v] : *o)
+            if (k == key) return v;
+    return Null;
+}
+
+auto Value::str() const -> std::string {
+    return std::visit(
+        Overloaded{
+            [](std::nullptr_t) -> std::string { return "null"; },
+            [](bool b) -> std::string { return b ? "true" : "false"; },
+            [](double n) -> std::string {
+                if (n == std::trunc(n) and std::abs(n) < 1e15) return fmt::format("{}", lcc::i64(n));
+                return fmt::format("{}", n);
+            },
+            [](const std::string& s) { return fmt::format("\"{}\"", lcc::utils::EscapeJSON(s)); },
+            [](const Array& a) {
+                std::string out = "[";
+                for (auto& v : a) {
+                    if (out.size() > 1) out += ',';
+                    out += v.str();
+                }
+                return out + "]";
+            },
+            [](const Object& o) {
+                std::string out = "{";
+                for (auto& [k, v] : o) {
+                    if (out.size() > 1) out += ',';
+                    out += fmt::format("\"{}\":{}", lcc::utils::EscapeJSON(k), v.str());
+                }
+                return out + "}";
+            },
+        },
+        data
+    );
+}
+
+auto Parse(std::string_view text) -> std::optional<Value> {
+    return Parser{text}.parse_document();
+}
+} // namespace lsp::json
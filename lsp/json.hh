@@ -0,0 +1,61 @@
+#ifndef LCC_LSP_JSON_HH
+#define LCC_LSP_JSON_HH
+
+#include <lcc/utils.hh>
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/// Just enough JSON for the language server protocol.
+namespace lsp::json {
+class Value;
+using Array = std::vector<Value>;
+
+/// Members are kept in the order in which they were added.
+using Object = std::vector<std::pair<std::string, Value>>;
+
+class Value {
+    std::variant<std::nullptr_t, bool, double, std::string, Array, Object> data;
+
+public:
+    Value() : data(nullptr) {}
+    Value(std::nullptr_t) : data(nullptr) {}
+    Value(bool b) : data(b) {}
+    Value(std::integral auto n) requires (not std::same_as<decltype(n), bool>) : data(double(n)) {}
+    Value(double n) : data(n) {}
+    Value(std::string s) : data(std::move(s)) {}
+    Value(std::string_view s) : data(std::string{s}) {}
+    Value(const char* s) : data(std::string{s}) {}
+    Value(Array a) : data(std::move(a)) {}
+    Value(Object o) : data(std::move(o)) {}
+
+    [[nodiscard]] auto is_null() const -> bool { return std::holds_alternative<std::nullptr_t>(data); }
+    [[nodiscard]] auto is_number() const -> bool { return std::holds_alternative<double>(data); }
+    [[nodiscard]] auto is_string() const -> bool { return std::holds_alternative<std::string>(data); }
+    [[nodiscard]] auto is_array() const -> bool { return std::holds_alternative<Array>(data); }
+    [[nodiscard]] auto is_object() const -> bool { return std::holds_alternative<Object>(data); }
+
+    /// Get the value as a number, string, or array; if it is something
+    /// else, this returns zero or an empty string or array.
+    [[nodiscard]] auto as_int() const -> lcc::i64;
+    [[nodiscard]] auto as_string() const -> std::string_view;
+    [[nodiscard]] auto as_array() const -> const Array&;
+
+    /// Get a member of an object, or null if there is no such member or
+    /// this isn't an object.
+    [[nodiscard]] auto operator[](std::string_view key) const -> const Value&;
+
+    /// Serialise the value.
+    [[nodiscard]] auto str() const -> std::string;
+};
+
+/// Parse a JSON document.
+[[nodiscard]]
+auto Parse(std::string_view text) -> std::optional<Value>;
+} // namespace lsp::json
+
+#endif // LCC_LSP_JSON_HH
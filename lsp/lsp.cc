@@ -0,0 +1,463 @@
+/// A language server for Glint.
+///
+/// USAGE: lcc-lsp [-I DIR]... [-j JOBS]
+///
+/// This speaks the Language Server Protocol over standard input and
+/// output, and serves diagnostics, go-to-definition, and hover types for
+/// Glint files. Every open document keeps the context and module of its
+/// last check resident, and is checked again with an incremental checker
+/// whenever it changes, so only the function bodies an edit can affect
+/// are analysed again.
+///
+/// Messages are read on a thread of their own so that requests can be
+/// cancelled while the server is busy. Whatever arrived in the meantime
+/// is then handled at once: documents that changed several times are
+/// only checked in their latest state, and requests that were cancelled
+/// are answered as such without doing any work.
+#include <json.hh>
+
+#include <lcc/context.hh>
+#include <lcc/diags.hh>
+#include <lcc/file.hh>
+#include <lcc/format.hh>
+#include <lcc/target.hh>
+#include <lcc/utils.hh>
+
+#include <glint/ast.hh>
+#include <glint/incremental.hh>
+
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fmt/format.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace lcc;
+namespace json = lsp::json;
+
+/// JSON-RPC error codes.
+constexpr i64 MethodNotFound = -32601;
+constexpr i64 RequestCancelled = -32800;
+
+struct Config {
+    std::vector<std::string> include_directories{};
+    usz jobs = 1;
+};
+
+[[noreturn]] void Usage(std::string_view error) {
+    fmt::print(stderr, "{}\n", error);
+    fmt::print(stderr, "USAGE: lcc-lsp [-I DIR]... [-j JOBS]\n");
+    std::exit(2);
+}
+
+auto ParseArgs(int argc, const char** argv) -> Config {
+    Config cfg{};
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+        auto Next = [&]() -> std::string_view {
+            if (i + 1 >= argc) Usage(fmt::format("Expected argument after {}", arg));
+            return argv[++i];
+        };
+
+        if (arg == "-I") cfg.include_directories.emplace_back(Next());
+        else if (arg == "-j") {
+            auto str = Next();
+            auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), cfg.jobs);
+            if (ec != std::errc() or ptr != str.data() + str.size())
+                Usage(fmt::format("Invalid number of jobs {}", str));
+        } else Usage(fmt::format("Unknown option {}", arg));
+    }
+    return cfg;
+}
+
+/// Standard output, which only the protocol may write to.
+FILE* protocol_out{};
+
+void Send(const json::Value& message) {
+    auto body = message.str();
+    fmt::print(protocol_out, "Content-Length: {}\r\n\r\n{}", body.size(), body);
+    std::fflush(protocol_out);
+}
+
+void Reply(const json::Value& id, json::Value result) {
+    Send(json::Object{{"jsonrpc", "2.0"}, {"id", id}, {"result", std::move(result)}});
+}
+
+void ReplyError(const json::Value& id, i64 code, std::string_view message) {
+    Send(json::Object{
+        {"jsonrpc", "2.0"},
+        {"id", id},
+        {"error", json::Object{{"code", code}, {"message", message}}},
+    });
+}
+
+void Notify(std::string_view method, json::Value params) {
+    Send(json::Object{{"jsonrpc", "2.0"}, {"method", method}, {"params", std::move(params)}});
+}
+
+/// Read a message from standard input.
+auto ReadMessage() -> std::optional<std::string> {
+    usz length = 0;
+    std::string line{};
+    for (;;) {
+        if (not std::getline(std::cin, line)) return std::nullopt;
+        if (not line.empty() and line.back() == '\r') line.pop_back();
+        if (line.empty()) break;
+        if (line.starts_with("Content-Length:")) {
+            std::string_view n{line};
+            n.remove_prefix(n.find_first_not_of(' ', 15));
+            std::from_chars(n.data(), n.data() + n.size(), length);
+        }
+    }
+
+    std::string body(length, '\0');
+    if (not std::cin.read(body.data(), std::streamsize(length))) return std::nullopt;
+    return body;
+}
+
+/// Messages that were read but not handled yet.
+struct Inbox {
+    std::mutex mutex{};
+    std::condition_variable cv{};
+    std::deque<json::Value> messages{};
+
+    /// Ids of requests that were cancelled, serialised.
+    std::unordered_set<std::string> cancelled{};
+    bool closed = false;
+
+    /// Read messages until standard input is closed.
+    void read() {
+        while (auto text = ReadMessage()) {
+            auto message = json::Parse(*text);
+            if (not message) continue;
+            std::unique_lock lock{mutex};
+            if ((*message)["method"].as_string() == "$/cancelRequest") {
+                cancelled.insert((*message)["params"]["id"].str());
+                continue;
+            }
+
+            messages.push_back(std::move(*message));
+            cv.notify_one();
+        }
+
+        std::unique_lock lock{mutex};
+        closed = true;
+        cv.notify_one();
+    }
+};
+
+/// Convert between byte offsets and LSP positions, whose characters are
+/// counted in UTF-16 code units.
+auto PositionOf(const File& file, usz offset) -> json::Value {
+    offset = std::min(offset, file.size());
+    auto line = file.line_index(offset);
+    usz character = 0;
+    for (auto i = file.line_starts()[line]; i < offset; i++) {
+        auto c = u8(file.data()[i]);
+        if ((c & 0xC0) != 0x80) character++;
+        if (c >= 0xF0) character++;
+    }
+    return json::Object{{"line", line}, {"character", character}};
+}
+
+auto OffsetOf(const File& file, const json::Value& position) -> usz {
+    auto& starts = file.line_starts();
+    auto line = usz(std::max<i64>(position["line"].as_int(), 0));
+    if (line >= starts.size()) return file.size();
+
+    auto offset = starts[line];
+    for (auto character = position["character"].as_int(); character > 0 and offset < file.size();) {
+        auto c = u8(file.data()[offset]);
+        if (c == '\n') break;
+        offset++;
+        while (offset < file.size() and (u8(file.data()[offset]) & 0xC0) == 0x80) offset++;
+        character -= c >= 0xF0 ? 2 : 1;
+    }
+    return offset;
+}
+
+auto URIOf(const fs::path& path) -> std::string {
+    return fmt::format("file://{}", path.string());
+}
+
+auto PathOf(std::string_view uri) -> fs::path {
+    if (uri.starts_with("file://")) uri.remove_prefix(7);
+    std::string path{};
+    for (usz i = 0; i < uri.size(); i++) {
+        unsigned c{};
+        if (uri[i] == '%' and i + 2 < uri.size() and std::from_chars(uri.data() + i + 1, uri.data() + i + 3, c, 16).ec == std::errc()) {
+            path += char(c);
+            i += 2;
+        } else {
+            path += uri[i];
+        }
+    }
+    return path;
+}
+
+class Server {
+    struct Document {
+        std::string uri;
+        std::string text;
+        std::unique_ptr<glint::IncrementalChecker> checker;
+    };
+
+    Config cfg;
+    std::unordered_map<std::string, Document> documents{};
+    bool shutting_down = false;
+
+public:
+    explicit Server(Config config) : cfg(std::move(config)) {}
+
+    /// Handle messages until the client exits, and return the exit code.
+    auto run(Inbox& inbox) -> int;
+
+private:
+    auto make_context() const -> std::unique_ptr<Context>;
+
+    void check(Document& doc);
+    auto location(const Document& doc, Location l) const -> json::Value;
+    auto expression_at(const Document& doc, const json::Value& params) const -> glint::Expr*;
+    auto definition(const json::Value& params) -> json::Value;
+    auto hover(const json::Value& params) -> json::Value;
+};
+
+auto Server::make_context() const -> std::unique_ptr<Context> {
+    auto ctx = std::make_unique<Context>(
+        Target::x86_64_linux,
+        Format::gnu_as_att_assembly,
+        Context::Options{
+            Context::DoNotUseColour,
+            Context::DoNotPrintAST,
+            Context::DoNotStopatSyntax,
+            Context::StopatSema,
+            Context::DoNotPrintMIR,
+            Context::DoNotStopatMIR,
+            cfg.jobs,
+        }
+    );
+    for (const auto& dir : cfg.include_directories) ctx->add_include_directory(dir);
+    return ctx;
+}
+
+auto Server::location(const Document& doc, Location l) const -> json::Value {
+    auto* ctx = doc.checker->context();
+    if (not ctx or not l.seekable(ctx)) return nullptr;
+    auto& file = *ctx->files()[l.file_id];
+    return json::Object{
+        {"uri", file.path() == PathOf(doc.uri) ? doc.uri : URIOf(file.path())},
+        {"range", json::Object{{"start", PositionOf(file, l.pos)}, {"end", PositionOf(file, l.pos + l.len)}}},
+    };
+}
+
+void Server::check(Document& doc) {
+    json::Array diagnostics{};
+    for (auto& d : doc.checker->check(doc.text)) {
+        auto severity = [&] {
+            switch (d.severity()) {
+                case Diag::Kind::Warning: return 2;
+                case Diag::Kind::Note: return 3;
+                default: return 1;
+            }
+        }();
+
+        json::Array related{};
+        for (const auto& [attached, _] : d.attachments())
+            if (auto where = location(doc, attached.location()); not where.is_null())
+                related.emplace_back(json::Object{{"location", std::move(where)}, {"message", attached.text()}});
+
+        auto where = location(doc, d.location());
+        auto range = where.is_null()
+                       ? json::Value{json::Object{
+                             {"start", json::Object{{"line", 0}, {"character", 0}}},
+                             {"end", json::Object{{"line", 0}, {"character", 0}}},
+                         }}
+                       : where["range"];
+
+        diagnostics.emplace_back(json::Object{
+            {"range", range},
+            {"severity", severity},
+            {"source", "lcc"},
+            {"message", d.text()},
+            {"relatedInformation", std::move(related)},
+        });
+        d.suppress();
+    }
+
+    Notify("textDocument/publishDiagnostics", json::Object{{"uri", doc.uri}, {"diagnostics", std::move(diagnostics)}});
+}
+
+auto Server::expression_at(const Document& doc, const json::Value& params) const -> glint::Expr* {
+    auto* mod = doc.checker->module();
+    auto* ctx = doc.checker->context();
+    if (not mod or not ctx) return nullptr;
+    auto& file = *ctx->files().back();
+    auto offset = OffsetOf(file, params["position"]);
+
+    /// Find the innermost expression that contains the offset. Locations
+    /// are clamped in length, so don't rely on them being nested.
+    glint::Expr* best{};
+    auto Visit = [&](auto& self, glint::Expr* e) -> void {
+        if (not e) return;
+        auto l = e->location();
+        if (
+            l.is_valid()
+            and l.file_id == file.file_id()
+            and l.pos <= offset
+            and offset < l.pos + l.len
+            and (not best or l.len <= best->location().len)
+        ) best = e;
+
+        /// Don't follow names to what they refer to.
+        if (is<glint::NameRefExpr, glint::FuncDecl>(e)) return;
+        for (auto* child : e->children()) self(self, child);
+    };
+
+    for (auto* func : mod->functions()) {
+        Visit(Visit, func);
+        for (auto* param : func->param_decls()) Visit(Visit, param);
+        Visit(Visit, func->body());
+    }
+    return best;
+}
+
+auto Server::definition(const json::Value& params) -> json::Value {
+    auto doc = documents.find(std::string{params["textDocument"]["uri"].as_string()});
+    if (doc == documents.end()) return nullptr;
+    auto* name = cast<glint::NameRefExpr>(expression_at(doc->second, params));
+    if (not name or not name->target()) return nullptr;
+    return location(doc->second, name->target()->location());
+}
+
+auto Server::hover(const json::Value& params) -> json::Value {
+    auto doc = documents.find(std::string{params["textDocument"]["uri"].as_string()});
+    if (doc == documents.end()) return nullptr;
+    auto* e = expression_at(doc->second, params);
+    if (not e or not e->ok()) return nullptr;
+
+    std::string text{};
+    if (auto* name = cast<glint::NameRefExpr>(e)) text = fmt::format("{} : {}", name->name(), e->type()->string());
+    else if (auto* decl = cast<glint::Decl>(e)) text = fmt::format("{} : {}", decl->name(), e->type()->string());
+    else text = e->type()->string();
+
+    auto result = json::Object{{"contents", json::Object{{"kind", "plaintext"}, {"value", text}}}};
+    if (auto where = location(doc->second, e->location()); not where.is_null())
+        result.emplace_back("range", where["range"]);
+    return result;
+}
+
+auto Server::run(Inbox& inbox) -> int {
+    for (;;) {
+        std::deque<json::Value> batch{};
+        {
+            std::unique_lock lock{inbox.mutex};
+            inbox.cv.wait(lock, [&] { return not inbox.messages.empty() or inbox.closed; });
+            if (inbox.messages.empty()) return 1;
+            std::swap(batch, inbox.messages);
+        }
+
+        /// Bring the documents up to date first, so that each is checked
+        /// at most once, in its latest state.
+        std::unordered_set<std::string> changed{};
+        for (auto& message : batch) {
+            auto method = message["method"].as_string();
+            auto& params = message["params"];
+            std::string uri{params["textDocument"]["uri"].as_string()};
+            if (method == "textDocument/didOpen") {
+                auto path = PathOf(uri);
+                documents[uri] = Document{
+                    uri,
+                    std::string{params["textDocument"]["text"].as_string()},
+                    std::make_unique<glint::IncrementalChecker>(path, [this] { return make_context(); }),
+                };
+                changed.insert(uri);
+            } else if (method == "textDocument/didChange") {
+                auto doc = documents.find(uri);
+                if (doc == documents.end()) continue;
+
+                /// We ask for the full text on every change.
+                auto& changes = params["contentChanges"].as_array();
+                if (changes.empty()) continue;
+                doc->second.text = changes.back()["text"].as_string();
+                changed.insert(uri);
+            } else if (method == "textDocument/didClose") {
+                documents.erase(uri);
+                changed.erase(uri);
+                Notify("textDocument/publishDiagnostics", json::Object{{"uri", uri}, {"diagnostics", json::Array{}}});
+            } else if (method == "exit") {
+                return shutting_down ? 0 : 1;
+            }
+        }
+
+        for (auto& uri : changed) check(documents.at(uri));
+
+        /// Then answer the requests.
+        for (auto& message : batch) {
+            auto& id = message["id"];
+            if (id.is_null()) continue;
+
+            bool cancelled{};
+            {
+                std::unique_lock lock{inbox.mutex};
+                cancelled = inbox.cancelled.erase(id.str()) != 0;
+            }
+            if (cancelled) {
+                ReplyError(id, RequestCancelled, "Request cancelled");
+                continue;
+            }
+
+            auto method = message["method"].as_string();
+            auto& params = message["params"];
+            if (method == "initialize") {
+                Reply(id, json::Object{
+                    {"capabilities", json::Object{
+                        {"textDocumentSync", 1},
+                        {"definitionProvider", true},
+                        {"hoverProvider", true},
+                    }},
+                    {"serverInfo", json::Object{{"name", "lcc-lsp"}}},
+                });
+            } else if (method == "shutdown") {
+                shutting_down = true;
+                Reply(id, nullptr);
+            } else if (method == "textDocument/definition") {
+                Reply(id, definition(params));
+            } else if (method == "textDocument/hover") {
+                Reply(id, hover(params));
+            } else {
+                ReplyError(id, MethodNotFound, fmt::format("Unsupported method {}", method));
+            }
+        }
+    }
+}
+} // namespace
+
+auto main(int argc, const char** argv) -> int {
+    auto cfg = ParseArgs(argc, argv);
+
+    /// Keep standard output for the protocol, and send anything else
+    /// that would be printed there, e.g. by Sema, to standard error.
+    protocol_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (not protocol_out) Usage("Cannot duplicate standard output");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    Inbox inbox{};
+    std::thread reader{[&] { inbox.read(); }};
+    reader.detach();
+
+    Server server{std::move(cfg)};
+    return server.run(inbox);
+}
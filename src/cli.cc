@@ -2,6 +2,7 @@
 
 #include <lcc/utils/twocolumnlayouthelper.hh>
 
+#include <charconv>
 #include <cstdlib>
 #include <fmt/format.h>
 #include <string>
@@ -10,6 +11,9 @@
 
 namespace cli {
 
+/// Profile used by -fprofile-generate and -fprofile-use without a file.
+constexpr std::string_view default_profile = "default.lccprof";
+
 [[noreturn]]
 void help() {
     // clang-format off
@@ -24,17 +28,42 @@ void help() {
         {"  --stopat-sema", "Request language does not process input further than semantic analysis\n"},
         {"  --stopat-ir", "Do not process input further than LCC's intermediate representation (IR)\n"},
         {"  --stopat-mir", "Do not process input further than LCC's machine instruction representation (MIR)\n"},
+        {"  --batch", "Compile all source files in one process and in parallel (see -j); -o names an output directory\n"},
+        {"  -flto", "Link the IR of all source files into one module, optimise it as a whole, and generate a single output from it\n"},
+        {"  -ffunction-sections", "Put every function into a section of its own, e.g. for linking with --gc-sections\n"},
+        {"  -fdata-sections", "Put every global variable into a section of its own, e.g. for linking with --gc-sections\n"},
+        {"  -fomit-frame-pointer", "Address stack frames relative to RSP, which frees RBP for register allocation\n"},
+        {"  -fno-omit-frame-pointer", "Keep RBP as the frame pointer (default)\n"},
+        {"  --time-report", "Print how long each phase of compilation took\n"},
+        {"  --mem-report", "Print peak memory use, allocations, and data structure sizes for each phase of compilation\n"},
+        {"  --codegen-report", "Print instruction counts, register allocation, frame size, and code size of every function\n"},
+        {"  --stats", "Print statistics on what the optimiser did, e.g. how many instructions each pass erased\n"},
+        {"  --run", "Compile the source file in memory and run its main function in-process; arguments after -- are passed to it\n"},
         {"  --aluminium", "That special something to spice up your compilation\n"},
     }}.get());
     fmt::print("OPTIONS:\n");
     fmt::print("{}", TwoColumnLayoutHelper{{
+        {"  --server", "Listen on a Unix socket and serve compile requests (must come first)\n"},
+        {"  --connect", "Have the server at a Unix socket compile with the remaining arguments (must come first)\n"},
         {"  -I", "Add a directory to the include search paths\n"},
-        {"  -o", "Path to the output filepath where target code will be stored\n"},
+        {"  --module-cache", "Directory in which to cache metadata of modules imported from object files\n"},
+        {"  --codegen-cache", "Directory in which to cache the machine code of functions emitted into object files; may also be given as --codegen-cache=DIR\n"},
+        {"  -o", "Path to the output filepath where target code will be stored; with more than one source file (and neither --batch nor -flto), the executable they are linked into\n"},
+        {"  --time-report-json", "Path to write how long each phase of compilation took to, as JSON (implies --time-report)\n"},
+        {"  --trace", "Path to write a trace of compilation to, in the Chrome trace event format; may also be given as --trace=FILE\n"},
+        {"  -fprofile-generate", "Count how often each block runs and append the counts to a profile when main returns; may be given as -fprofile-generate=FILE (default: default.lccprof)\n"},
+        {"  -fprofile-use", "Optimise using the counts of a profile; may be given as -fprofile-use=FILE (default: default.lccprof)\n"},
         {"  -O", "Set optimisation level (default 0)\n"},
         {"", "    0, 1, 2, 3\n"},
         {"  --passes", "Comma-separated list of optimisation passes to run\n"},
+        {"  -j", "Number of threads to use for optimisation and code generation, or for compiling files in batch mode (default 1; 0 means one per core)\n"},
+        {"  --regalloc", "Which register allocator to use (default: graph)\n"},
+        {"", "    graph, linear\n"},
         {"  --color", "Whether to include colors colours in the output (default: auto)\n"},
         {"", "    always, auto, never\n"},
+        {"  -ferror-limit=N", "Stop compiling once N errors have been printed; 0 means no limit (default 0)\n"},
+        {"  -fdiagnostics-format=FORMAT", "How to print diagnostics (default: text)\n"},
+        {"", "    text, json (one object per line, e.g. for editors)\n"},
         {"  -x", "What language to parse input code as (default: extension based)\n"},
         {"", "    glint, ir\n"},
         {"  -f", "What format to emit code in (default: asm)\n"},
@@ -43,7 +72,7 @@ void help() {
         // compiled for.
         {"", "    asm: gnu-as-att,\n"},
         {"", "    obj: elf, coff,\n"},
-        {"", "    IR: ir, llvm\n"},
+        {"", "    IR: ir, lccbc, llvm\n"},
     }}.get());
     // clang-format on
     std::exit(0);
@@ -85,15 +114,62 @@ auto parse(int argc, const char** argv) -> Options {
             o.mir = lcc::Context::PrintMIR;
         else if (arg == "--stopat-mir")
             o.stopat_mir = lcc::Context::StopatMIR;
+        else if (arg == "--batch")
+            o.batch = true;
+        else if (arg == "-flto")
+            o.lto = true;
+        else if (arg == "-ffunction-sections")
+            o.function_sections = lcc::Context::FunctionSections;
+        else if (arg == "-fdata-sections")
+            o.data_sections = lcc::Context::DataSections;
+        else if (arg == "-fomit-frame-pointer")
+            o.frame_pointer = lcc::Context::OmitFramePointer;
+        else if (arg == "-fno-omit-frame-pointer")
+            o.frame_pointer = lcc::Context::KeepFramePointer;
+        else if (arg == "--time-report")
+            o.time_report = lcc::Context::ReportTime;
+        else if (arg == "--mem-report")
+            o.mem_report = lcc::Context::ReportMemory;
+        else if (arg == "--codegen-report")
+            o.codegen_report = lcc::Context::ReportCodegen;
+        else if (arg == "--stats")
+            o.stats = true;
+        else if (arg == "--run")
+            o.run = true;
+        else if (arg == "--") {
+            // Everything after this goes to the program being run
+            o.run_arguments.assign(argv + i + 1, argv + argc);
+            break;
+        }
 
         else if (arg == "-I") {
             // Add a directory to the include search paths
             auto include_dir = next_arg();
             o.include_directories.emplace_back(include_dir);
+        } else if (arg == "--module-cache") {
+            // Directory in which to cache metadata of imported modules
+            o.module_cache_directory = next_arg();
+        } else if (arg == "--codegen-cache" or arg.starts_with("--codegen-cache=")) {
+            // Directory in which to cache the machine code of functions
+            o.codegen_cache_directory = arg == "--codegen-cache" ? std::string{next_arg()} : std::string{arg.substr(16)};
         } else if (arg == "-o") {
             // Path to the output filepath where target code will be stored
             auto output_path = next_arg();
             o.output_filepath = std::string(output_path);
+        } else if (arg == "--time-report-json") {
+            // Path to write the time report to, as JSON
+            o.time_report_json_filepath = next_arg();
+            o.time_report = lcc::Context::ReportTime;
+        } else if (arg == "--trace" or arg.starts_with("--trace=")) {
+            // Path to write a trace of compilation to
+            o.trace_filepath = arg == "--trace" ? std::string{next_arg()} : std::string{arg.substr(8)};
+            o.trace = lcc::Context::RecordTrace;
+        } else if (arg == "-fprofile-generate" or arg.starts_with("-fprofile-generate=")) {
+            // Path of the profile that instrumented code appends to
+            o.profile_generate_filepath = arg == "-fprofile-generate" ? std::string{default_profile} : std::string{arg.substr(19)};
+        } else if (arg == "-fprofile-use" or arg.starts_with("-fprofile-use=")) {
+            // Path of the profile to optimise with
+            o.profile_use_filepath = arg == "-fprofile-use" ? std::string{default_profile} : std::string{arg.substr(14)};
         } else if (arg == "-O") {
             // Set optimisation level (default: 0)
             auto o_level_str = next_arg();
@@ -117,6 +193,27 @@ auto parse(int argc, const char** argv) -> Options {
             // Comma-separated list of optimisation passes to run
             auto passes = next_arg();
             o.optimisation_passes = passes;
+        } else if (arg == "-j") {
+            // Number of threads the backend (or batch mode) may use
+            auto jobs_str = next_arg();
+            lcc::usz jobs{};
+            auto [ptr, ec] = std::from_chars(jobs_str.data(), jobs_str.data() + jobs_str.size(), jobs);
+            if (ec != std::errc() or ptr != jobs_str.data() + jobs_str.size()) {
+                fmt::print("CLI ERROR: Invalid job count {}\n", jobs_str);
+                std::exit(1);
+            }
+            o.jobs = jobs;
+        } else if (arg == "--regalloc") {
+            // Which register allocator to use
+            auto allocator = next_arg();
+            if (allocator == "graph")
+                o.register_allocator = lcc::Context::GraphColouringAllocator;
+            else if (allocator == "linear")
+                o.register_allocator = lcc::Context::LinearScanAllocator;
+            else {
+                fmt::print("CLI ERROR: Invalid register allocator {}\n", allocator);
+                std::exit(1);
+            }
         } else if (arg == "--color") {
             // Whether to include colours in the output
             auto color = next_arg();
@@ -125,6 +222,24 @@ auto parse(int argc, const char** argv) -> Options {
                 std::exit(1);
             }
             o.color = color;
+        } else if (arg.starts_with("-ferror-limit=")) {
+            // Stop compiling after this many errors
+            auto limit_str = arg.substr(14);
+            lcc::usz limit{};
+            auto [ptr, ec] = std::from_chars(limit_str.data(), limit_str.data() + limit_str.size(), limit);
+            if (ec != std::errc() or ptr != limit_str.data() + limit_str.size()) {
+                fmt::print("CLI ERROR: Invalid error limit {}\n", limit_str);
+                std::exit(1);
+            }
+            o.error_limit = limit;
+        } else if (arg.starts_with("-fdiagnostics-format=")) {
+            // How to print diagnostics
+            auto format = arg.substr(21);
+            if (format != "text" and format != "json") {
+                fmt::print("CLI ERROR: Invalid diagnostics format {}\n", format);
+                std::exit(1);
+            }
+            o.diagnostics_format = format;
         } else if (arg == "-x") {
             // What language to parse input code as
             auto lang = next_arg();
@@ -139,7 +254,7 @@ auto parse(int argc, const char** argv) -> Options {
             if (
                 format != "asm" and format != "gnu-as-att"
                 and format != "obj" and format != "elf" and format != "coff"
-                and format != "IR" and format != "ir" and format != "llvm"
+                and format != "IR" and format != "ir" and format != "lccbc" and format != "llvm"
             ) {
                 fmt::print("CLI ERROR: Invalid format {}\n", format);
                 std::exit(1);
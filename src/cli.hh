@@ -14,18 +14,40 @@ struct Options {
     bool aluminium{false};
     bool ir{false};
     bool stopat_ir{false};
+    bool batch{false};
+    bool lto{false};
+    bool stats{false};
+    bool run{false};
     lcc::Context::OptionPrintAST ast{false};
     lcc::Context::OptionPrintMIR mir{false};
     lcc::Context::OptionStopatSyntax stopat_syntax{false};
     lcc::Context::OptionStopatSema stopat_sema{false};
     lcc::Context::OptionStopatMIR stopat_mir{false};
+    lcc::Context::OptionRegisterAllocator register_allocator{false};
+    lcc::Context::OptionFunctionSections function_sections{false};
+    lcc::Context::OptionDataSections data_sections{false};
+    lcc::Context::OptionTimeReport time_report{false};
+    lcc::Context::OptionTrace trace{false};
+    lcc::Context::OptionMemReport mem_report{false};
+    lcc::Context::OptionCodegenReport codegen_report{false};
+    lcc::Context::OptionFramePointer frame_pointer{false};
 
     std::vector<std::string> input_files{};
+    std::vector<std::string> run_arguments{};
     std::vector<std::string> include_directories{};
+    std::string module_cache_directory{};
+    std::string codegen_cache_directory{};
     std::string output_filepath{};
+    std::string time_report_json_filepath{};
+    std::string trace_filepath{};
+    std::string profile_generate_filepath{};
+    std::string profile_use_filepath{};
     int optimisation{0};
+    lcc::usz jobs{1};
+    lcc::usz error_limit{0};
     std::string optimisation_passes{};
     std::string color{"auto"};
+    std::string diagnostics_format{"text"};
     std::string language{"default"};
     std::string format{"default"};
 };
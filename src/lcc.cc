@@ -1,25 +1,39 @@
 #include <cli.hh>
+#include <server.hh>
 
+#include <lcc/codegen/codegen_report.hh>
+#include <lcc/codegen/x86_64/jit.hh>
 #include <lcc/context.hh>
 #include <lcc/diags.hh>
 #include <lcc/format.hh>
 #include <lcc/ir/module.hh>
+#include <lcc/ir/profile.hh>
 #include <lcc/lcc-c.h>
+#include <lcc/mem_report.hh>
 #include <lcc/opt/opt.hh>
+#include <lcc/statistics.hh>
 #include <lcc/target.hh>
+#include <lcc/time_report.hh>
+#include <lcc/trace.hh>
 #include <lcc/utils.hh>
+#include <lcc/utils/macros.hh>
+#include <lcc/utils/parallel.hh>
 #include <lcc/utils/platform.hh>
 
 #include <glint/driver.hh>
+#include <glint/module_cache.hh>
+
+#include <object/generic.hh>
+#include <object/linker.hh>
 
-#include <cstdio>  // fopen and friends
 #include <cstdlib> // system
-#include <cstring> // strerror
 #include <filesystem>
 #include <fmt/format.h>
 #include <format>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 #include <vector>
 
 void aluminium_handler() {
@@ -48,62 +62,7 @@ const lcc::Target* const default_target =
 /// Default format
 const lcc::Format* const default_format = lcc::Format::gnu_as_att_assembly;
 
-[[nodiscard]] auto read_file_contents(
-    lcc::Context* context,
-    std::string_view input_filepath
-) -> lcc::Result<std::vector<char>> {
-    std::filesystem::path path{input_filepath};
-    // Don't use input_file since it may be moved from.
-    auto path_str = path.lexically_normal().string();
-
-    if (not std::filesystem::exists(path)) {
-        return lcc::Diag::Error(
-            "Input file does not exist: {}",
-            path.lexically_normal().string()
-        );
-    }
-    if (not std::filesystem::is_regular_file(path)) {
-        return lcc::Diag::Error(
-            "Input file exists, but is not a regular file: {}",
-            path.lexically_normal().string()
-        );
-    }
-
-    auto* f = fopen(path.string().data(), "rb");
-    if (not f) {
-        lcc::Diag::Fatal(
-            "Could not open file at {}: {}",
-            path.lexically_normal().string(),
-            std::strerror(errno)
-        );
-        LCC_UNREACHABLE();
-    }
-
-    // Get size of file, restoring cursor to beginning.
-    fseek(f, 0, SEEK_END);
-    size_t fsize = size_t(ftell(f));
-    fseek(f, 0, SEEK_SET);
-
-    std::vector<char> contents{};
-    contents.resize(fsize);
-    auto nread = fread(contents.data(), 1, fsize, f);
-    if (nread != fsize) {
-        fclose(f);
-        lcc::Diag::Fatal(
-            "ERROR reading file {}\n"
-            "    Got {} bytes, expected {}\n",
-            path.lexically_normal().string(),
-            nread,
-            fsize
-        );
-        LCC_UNREACHABLE();
-    }
-    fclose(f);
-
-    return contents;
-}
-
-auto main(int argc, const char** argv) -> int {
+auto compile(int argc, const char** argv) -> int {
     auto options = cli::parse(argc, argv);
 
     if (options.aluminium) {
@@ -119,6 +78,9 @@ auto main(int argc, const char** argv) -> int {
     else if (colour_opt == "never") use_colour = false;
     else use_colour = lcc::platform::StdoutIsTerminal() or lcc::platform::StderrIsTerminal();
 
+    if (options.diagnostics_format == "json")
+        lcc::Diag::SetOutputFormat(lcc::Diag::OutputFormat::JSON);
+
     /// Get input files
     auto& input_files = options.input_files;
     if (options.verbose) {
@@ -151,10 +113,36 @@ auto main(int argc, const char** argv) -> int {
         format = lcc::Format::elf_object;
     } else if (options.format == "coff") {
         format = lcc::Format::coff_object;
+    } else if (options.format == "lccbc") {
+        format = lcc::Format::lcc_bitcode;
     } else if (options.format == "llvm") {
         format = lcc::Format::llvm_textual_ir;
     } else LCC_ASSERT(false, "Unhandled format");
 
+    if (options.lto and options.batch)
+        lcc::Diag::Fatal("-flto and --batch can not be used together");
+
+    // Several source files and a single output make an executable, which
+    // is linked from the objects that they compile to.
+    const bool link_executable = not options.batch
+                             and not options.lto
+                             and options.input_files.size() > 1
+                             and not options.output_filepath.empty();
+    if (link_executable) {
+        if (default_target->is_platform_windows())
+            lcc::Diag::Fatal("Linking executables is only supported on Linux; consider --batch to compile to objects instead");
+        if (options.format == "default") format = lcc::Format::elf_object;
+        else if (format != lcc::Format::elf_object)
+            lcc::Diag::Fatal("Linking an executable requires object output; consider --batch to compile to separate outputs instead");
+    }
+
+    // Code that is run in-process is loaded straight from the object.
+    if (options.run) {
+        if (options.batch or options.input_files.size() != 1)
+            lcc::Diag::Fatal("--run takes exactly one source file");
+        format = lcc::Format::elf_object;
+    }
+
     lcc::Context context{
         default_target,
         format,
@@ -164,8 +152,50 @@ auto main(int argc, const char** argv) -> int {
             options.stopat_syntax,
             options.stopat_sema,
             options.mir,
-            options.stopat_mir //
-        }                      //
+            options.stopat_mir,
+            // In batch mode, the threads go to compiling files in parallel
+            // instead.
+            options.batch ? 1 : options.jobs,
+            options.register_allocator,
+            options.function_sections,
+            options.data_sections,
+            options.time_report,
+            options.trace,
+            options.mem_report,
+            options.codegen_report,
+            options.frame_pointer //
+        }                         //
+    };
+
+    /// Report the time spent in each phase once we're done, however that
+    /// turns out.
+    defer {
+        auto* report = context.time_report();
+        if (not report) return;
+        fmt::print(stderr, "{}", report->str());
+        if (not options.time_report_json_filepath.empty()) {
+            auto json = report->json();
+            lcc::File::WriteOrTerminate(json.data(), json.size(), options.time_report_json_filepath);
+        }
+    };
+
+    defer {
+        if (auto* mem = context.mem_report()) fmt::print(stderr, "{}", mem->str());
+    };
+
+    defer {
+        if (auto* codegen = context.codegen_report()) fmt::print(stderr, "{}", codegen->str());
+    };
+
+    defer {
+        if (options.stats) fmt::print(stderr, "{}", lcc::Statistic::Format());
+    };
+
+    defer {
+        auto* trace = context.trace();
+        if (not trace) return;
+        auto json = trace->json();
+        lcc::File::WriteOrTerminate(json.data(), json.size(), options.trace_filepath);
     };
 
     context.add_include_directory(".");
@@ -173,23 +203,49 @@ auto main(int argc, const char** argv) -> int {
         if (options.verbose) fmt::print("Added input directory: {}\n", dir);
         context.add_include_directory(dir);
     }
+    context.module_cache_directory(options.module_cache_directory);
+    context.codegen_cache_directory(options.codegen_cache_directory);
+    context.error_limit(options.error_limit);
 
     auto ConvertFileExtensionToOutputFormat = [&](const std::string& path_string) {
         const char* replacement = ".s";
+        if (context.format()->format() == lcc::Format::LCC_IR)
+            replacement = ".lcc";
         if (context.format()->format() == lcc::Format::LLVM_TEXTUAL_IR)
             replacement = ".ll";
+        if (context.format()->format() == lcc::Format::LCC_BITCODE)
+            replacement = ".lccb";
         if (context.format()->format() == lcc::Format::ELF_OBJECT or context.format()->format() == lcc::Format::COFF_OBJECT)
             replacement = ".o";
 
-        return std::filesystem::path{path_string}
-            .replace_extension(replacement)
-            .string();
+        /// Don't overwrite the input, e.g. when emitting IR for IR.
+        auto path = std::filesystem::path{path_string}.replace_extension(replacement);
+        if (path == std::filesystem::path{path_string})
+            path.replace_extension(fmt::format(".out{}", replacement));
+        return path.string();
     };
 
+    /// What main returned, with --run.
+    int run_status = 0;
+
     /// Common path after IR gen.
-    auto EmitModule = [&](lcc::Module* m, std::string_view input_file_path, std::string_view output_file_path) {
+    /// If \p object is given, the module is emitted into it rather than
+    /// to the output file.
+    auto EmitModule = [&](
+                          lcc::Module* m,
+                          std::string_view input_file_path,
+                          std::string_view output_file_path,
+                          lcc::GenericObject* object = nullptr
+                      ) {
         if (not m) return;
 
+        // Profiles refer to the blocks as IR generation created them, so
+        // deal with them before anything else changes the IR.
+        if (not options.profile_generate_filepath.empty())
+            lcc::profile::Instrument(m, options.profile_generate_filepath);
+        if (not options.profile_use_filepath.empty())
+            lcc::profile::Apply(m, options.profile_use_filepath);
+
         if (not options.optimisation_passes.empty()) {
             lcc::opt::RunPasses(m, options.optimisation_passes);
             if (options.ir) m->print_ir(use_colour);
@@ -199,8 +255,12 @@ auto main(int argc, const char** argv) -> int {
             m->print_ir(use_colour);
 
         // NOTE: Only apply full optimisation if specific passes were not requested.
-        if (options.optimisation and options.optimisation_passes.empty())
-            lcc::opt::Optimise(m, int(options.optimisation));
+        if (options.optimisation_passes.empty()) {
+            if (options.optimisation) lcc::opt::Optimise(m, int(options.optimisation));
+
+            /// Calls marked with __builtin_inline are inlined regardless.
+            else lcc::opt::RunPasses(m, "inline");
+        }
 
         if (options.ir) {
             fmt::print("\nAfter Optimisations:\n");
@@ -216,6 +276,18 @@ auto main(int argc, const char** argv) -> int {
 
         if (options.stopat_ir) return;
 
+        if (options.run) {
+            std::vector<std::string> args{std::string{input_file_path}};
+            args.insert(args.end(), options.run_arguments.begin(), options.run_arguments.end());
+            run_status = lcc::x86_64::RunMain(m, args).value_or(1);
+            return;
+        }
+
+        if (object) {
+            *object = m->emit_object();
+            return;
+        }
+
         m->emit(output_file_path);
 
         if (options.verbose)
@@ -224,53 +296,49 @@ auto main(int argc, const char** argv) -> int {
 
     // NOTE: Moves the input file, so, uhh, don't use that after passing it to
     // this.
-    auto specified_language = options.language;
-    auto GenerateOutputFile = [&](std::string& input_file, std::string_view output_file_path) {
+    auto LoadInputFile = [&](std::string& input_file) -> lcc::File* {
         std::filesystem::path path{input_file};
-        // Don't use input_file since it may be moved from.
-        auto path_str = path.lexically_normal().string();
 
         if (not std::filesystem::exists(path)) {
             lcc::Diag::Error(
                 "Input file does not exist: {}",
                 path.lexically_normal().string()
             );
-            return;
+            return nullptr;
         }
-        if (not std::filesystem::is_regular_file(path)) {
+        if (std::filesystem::is_directory(path)) {
             lcc::Diag::Error(
-                "Input file exists, but is not a regular file: {}",
+                "Input file exists, but is a directory: {}",
                 path.lexically_normal().string()
             );
-            return;
+            return nullptr;
         }
 
-        auto contents = read_file_contents(&context, input_file);
-        if (not contents) return;
+        // Regular files are mapped into memory rather than copied; pipes
+        // and the like are read.
+        return &context.get_or_load_file(std::move(input_file));
+    };
 
-        auto& file = context.create_file(
-            std::move(input_file),
-            std::move(*contents)
-        );
+    auto specified_language = options.language;
+    auto ProduceModule = [&](lcc::File& file) -> std::unique_ptr<lcc::Module> {
+        auto path_str = file.path().lexically_normal().string();
 
         if (
             specified_language == "ir"
-            or (specified_language == "default" and path_str.ends_with(".lcc"))
+            or (specified_language == "default" and (path_str.ends_with(".lcc") or path_str.ends_with(".lccb")))
         ) {
-            auto mod = lcc::Module::Parse(&context, file);
-            if (context.has_error()) return; // the error condition is handled by the caller already
-            EmitModule(mod.get(), path_str, output_file_path);
-            return;
+            std::string_view contents{file.data(), file.size()};
+            auto mod = lcc::Module::IsBitcode(contents)
+                         ? lcc::Module::ParseBitcode(&context, contents)
+                         : lcc::Module::Parse(&context, file);
+            if (context.has_error()) return {}; // the error condition is handled by the caller already
+            return mod;
         }
 
         if (
             specified_language == "glint"
             or (specified_language == "default" and path_str.ends_with(".g"))
-        ) {
-            auto* ir = lcc::glint::produce_module(&context, file);
-            EmitModule(ir, path_str, output_file_path);
-            return;
-        }
+        ) return std::unique_ptr<lcc::Module>{lcc::glint::produce_module(&context, file)};
 
         lcc::Diag::Fatal(
             "Unrecognised input file type: consider passing `-x <lang>' to force a specific language.\n"
@@ -278,14 +346,63 @@ auto main(int argc, const char** argv) -> int {
         );
     };
 
+    auto CompileFile = [&](lcc::File& file, std::string_view output_file_path) {
+        auto mod = ProduceModule(file);
+        EmitModule(mod.get(), file.path().lexically_normal().string(), output_file_path);
+    };
+
+    // NOTE: Moves the input file, see LoadInputFile().
+    auto GenerateOutputFile = [&](std::string& input_file, std::string_view output_file_path) {
+        if (auto* file = LoadInputFile(input_file))
+            CompileFile(*file, output_file_path);
+    };
+
     auto configured_output_file_path = options.output_filepath;
-    if (input_files.size() == 1) {
+    if (options.batch) {
+        // Compile every input file with the same context, so that they share
+        // the target setup, IR types, and imported modules, and compile them
+        // in parallel. If given, -o is the directory to put the outputs in;
+        // otherwise, each output goes next to its input.
+        std::filesystem::path output_directory{configured_output_file_path};
+        if (not output_directory.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(output_directory, ec);
+            if (ec) lcc::Diag::Fatal("Could not create output directory {}: {}", output_directory.string(), ec.message());
+        }
+
+        // Load all input files up front, since files may not be added to
+        // the context while other threads are compiling.
+        std::vector<lcc::File*> files{};
+        std::vector<std::string> output_file_paths{};
+        std::unordered_set<std::string> distinct_output_file_paths{};
+        for (auto& input_file : input_files) {
+            std::string output_file_path = ConvertFileExtensionToOutputFormat(input_file);
+            if (not output_directory.empty()) {
+                output_file_path = (output_directory / std::filesystem::path{output_file_path}.filename()).string();
+            }
+
+            if (not distinct_output_file_paths.insert(output_file_path).second)
+                lcc::Diag::Fatal("More than one input file would be compiled to {}", output_file_path);
+
+            auto* file = LoadInputFile(input_file);
+            if (not file) continue;
+            files.push_back(file);
+            output_file_paths.push_back(std::move(output_file_path));
+        }
+
+        lcc::ParallelFor(files.size(), options.jobs, [&](lcc::usz i) {
+            CompileFile(*files[i], output_file_paths[i]);
+        });
+        if (context.has_error()) return 1;
+
+    } else if (input_files.size() == 1) {
         std::string output_file_path = configured_output_file_path;
         if (output_file_path.empty())
             output_file_path = ConvertFileExtensionToOutputFormat(input_files[0]);
 
         GenerateOutputFile(input_files[0], output_file_path);
         if (context.has_error()) return 1;
+        if (options.run) return run_status;
 
         if (
             options.verbose
@@ -297,14 +414,67 @@ auto main(int argc, const char** argv) -> int {
             )
         ) fmt::print("Generated final output at {}\n", output_file_path);
 
-    } else {
-        if (not configured_output_file_path.empty()) {
-            lcc::Diag::Fatal(
-                "Cannot specify -o when generating multiple output files (would overwrite the same file with every output).\n"
-                "If you have a suggestion of how you think this should behave, let a developer know.\n"
-            );
+    } else if (options.lto) {
+        // Link the IR of every input file into one module, so that it is
+        // optimised as a whole and its code is generated in one go. The
+        // output goes next to the first input file, unless -o says
+        // otherwise.
+        std::string input_file_path = input_files[0];
+        std::string output_file_path = configured_output_file_path;
+        if (output_file_path.empty())
+            output_file_path = ConvertFileExtensionToOutputFormat(input_file_path);
+
+        std::unique_ptr<lcc::Module> linked{};
+        for (auto& input_file : input_files) {
+            auto* file = LoadInputFile(input_file);
+            if (not file) continue;
+            auto mod = ProduceModule(*file);
+            if (not mod) continue;
+            if (linked) linked->link(std::move(mod));
+            else linked = std::move(mod);
         }
+        if (context.has_error()) return 1;
+
+        EmitModule(linked.get(), input_file_path, output_file_path);
+        if (context.has_error()) return 1;
+
+        if (options.verbose and not options.stopat_ir and not options.stopat_mir)
+            fmt::print("Generated final output at {}\n", output_file_path);
 
+    } else if (link_executable) {
+        // Compile every input file to an object in memory, and link those
+        // into an executable. Objects may borrow sections from the module
+        // they were emitted from, so keep the modules around until then.
+        std::vector<std::unique_ptr<lcc::Module>> modules{};
+        std::vector<lcc::GenericObject> objects{};
+        for (auto& input_file : input_files) {
+            auto* file = LoadInputFile(input_file);
+            if (not file) continue;
+            auto mod = ProduceModule(*file);
+            if (not mod) continue;
+            EmitModule(mod.get(), file->path().lexically_normal().string(), configured_output_file_path, &objects.emplace_back());
+            modules.push_back(std::move(mod));
+        }
+        if (context.has_error()) return 1;
+        if (options.stopat_syntax or options.stopat_sema or options.stopat_ir or options.stopat_mir) return 0;
+
+        auto executable = lcc::elf::link_executable(objects);
+        if (not executable) return 1;
+        lcc::File::WriteOrTerminate(executable->data(), executable->size(), configured_output_file_path);
+
+        std::error_code ec;
+        std::filesystem::permissions(
+            configured_output_file_path,
+            std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec | std::filesystem::perms::others_exec,
+            std::filesystem::perm_options::add,
+            ec
+        );
+        if (ec) lcc::Diag::Warning("Could not make {} executable: {}", configured_output_file_path, ec.message());
+
+        if (options.verbose)
+            fmt::print("Linked executable at {}\n", configured_output_file_path);
+
+    } else {
         for (auto& input_file : input_files) {
             std::string input_file_path = input_file;
             std::string output_file_path = ConvertFileExtensionToOutputFormat(input_file_path);
@@ -314,3 +484,25 @@ auto main(int argc, const char** argv) -> int {
 
     return 0;
 }
+
+auto main(int argc, const char** argv) -> int {
+    // `lcc --server SOCKET` compiles whatever `lcc --connect SOCKET ...`
+    // asks it to, in place of the latter.
+    if (argc >= 3 and std::string_view{argv[1]} == "--server") {
+        // Initialise everything that is shared by all contexts up front so
+        // that every request starts out with it. Imported modules are read
+        // into the server as compilations report having needed them.
+        { lcc::Context warm_up{default_target, default_format, {}}; }
+        return server::serve(
+            argv[2],
+            compile,
+            lcc::glint::ImportCache::take_stored_paths,
+            [](std::string_view path) { (void) lcc::glint::ImportCache::warm(path); }
+        );
+    }
+
+    if (argc >= 3 and std::string_view{argv[1]} == "--connect")
+        return server::request(argv[2], argc - 3, argv + 3);
+
+    return compile(argc, argv);
+}
@@ -0,0 +1,300 @@
+#include <server.hh>
+
+#include <lcc/diags.hh>
+#include <lcc/utils.hh>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#    include <climits>
+#    include <csignal>
+#    include <fcntl.h>
+#    include <poll.h>
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/un.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+#endif
+
+namespace server {
+
+#ifndef _WIN32
+namespace {
+using lcc::i32;
+using lcc::u32;
+using lcc::usz;
+
+/// A request is the size of what follows as a u32, sent along with the
+/// standard output and error of the client, followed by NUL-terminated
+/// strings: the working directory, and then the arguments. The reply is
+/// the exit status as an i32.
+constexpr u32 max_request_size = 1 << 20;
+constexpr usz passed_descriptors = 2;
+
+auto Address(std::string_view socket_path) -> sockaddr_un {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof address.sun_path)
+        lcc::Diag::Fatal("Socket path is too long: {}", socket_path);
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    return address;
+}
+
+/// Read exactly \p size bytes; returns false on error or end of file.
+auto ReadAll(int fd, void* data, usz size) -> bool {
+    auto* ptr = static_cast<char*>(data);
+    while (size) {
+        auto n = ::read(fd, ptr, size);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) return false;
+        ptr += n;
+        size -= usz(n);
+    }
+    return true;
+}
+
+/// Write exactly \p size bytes; returns false on error.
+auto WriteAll(int fd, const void* data, usz size) -> bool {
+    auto* ptr = static_cast<const char*>(data);
+    while (size) {
+        auto n = ::write(fd, ptr, size);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) return false;
+        ptr += n;
+        size -= usz(n);
+    }
+    return true;
+}
+
+/// Receive a request, compile it in a child process, and send back the
+/// exit status of that child. The child reports what it read to the
+/// server through \p reports.
+void HandleRequest(int connection, int reports, CompileFunction compile, ReportFunction report) {
+    u32 size{};
+    iovec io{&size, sizeof size};
+    alignas(cmsghdr) char control[CMSG_SPACE(passed_descriptors * sizeof(int))]{};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof control;
+
+    ssize_t n{};
+    do n = ::recvmsg(connection, &message, 0);
+    while (n < 0 and errno == EINTR);
+    if (n <= 0 or not ReadAll(connection, reinterpret_cast<char*>(&size) + n, sizeof size - usz(n)))
+        return;
+
+    auto* header = CMSG_FIRSTHDR(&message);
+    if (
+        not header
+        or header->cmsg_level != SOL_SOCKET
+        or header->cmsg_type != SCM_RIGHTS
+        or header->cmsg_len != CMSG_LEN(passed_descriptors * sizeof(int))
+    ) return;
+    int descriptors[passed_descriptors]{};
+    std::memcpy(descriptors, CMSG_DATA(header), sizeof descriptors);
+
+    // The working directory, followed by the arguments.
+    std::string request(size, '\0');
+    if (size > max_request_size or not ReadAll(connection, request.data(), size)) return;
+    if (request.empty() or request.back() != '\0') return;
+    std::vector<const char*> strings{};
+    for (usz i = 0; i < request.size(); i += std::strlen(request.data() + i) + 1)
+        strings.push_back(request.data() + i);
+
+    auto pid = ::fork();
+    if (pid == 0) {
+        ::dup2(descriptors[0], STDOUT_FILENO);
+        ::dup2(descriptors[1], STDERR_FILENO);
+        for (int fd : descriptors) ::close(fd);
+        ::close(connection);
+
+        if (::chdir(strings[0]) != 0)
+            lcc::Diag::Fatal("Could not change to directory {}: {}", strings[0], std::strerror(errno));
+
+        std::vector<const char*> argv{"lcc"};
+        argv.insert(argv.end(), strings.begin() + 1, strings.end());
+        argv.push_back(nullptr);
+        auto status = compile(int(argv.size() - 1), argv.data());
+
+        // Writes of up to PIPE_BUF bytes are atomic, so reports from
+        // concurrent compilations don't interleave. If the pipe is full,
+        // the server just misses out on this one.
+        for (auto& line : report()) {
+            line += '\n';
+            if (line.size() <= PIPE_BUF) (void) ::write(reports, line.data(), line.size());
+        }
+        std::exit(status);
+    }
+    for (int fd : descriptors) ::close(fd);
+
+    i32 status = 1;
+    int wait_status{};
+    if (pid > 0) {
+        while (::waitpid(pid, &wait_status, 0) < 0 and errno == EINTR);
+        status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : 128 + WTERMSIG(wait_status);
+    }
+    (void) WriteAll(connection, &status, sizeof status);
+}
+
+/// Pass every complete line reported by compilations so far to \p warm.
+void ReadReports(int reports, std::string& pending, WarmFunction warm) {
+    char buffer[PIPE_BUF];
+    for (;;) {
+        auto n = ::read(reports, buffer, sizeof buffer);
+        if (n < 0 and errno == EINTR) continue;
+        if (n <= 0) break;
+        pending.append(buffer, usz(n));
+    }
+
+    usz start = 0;
+    for (auto end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', start)) {
+        warm(std::string_view{pending}.substr(start, end - start));
+        start = end + 1;
+    }
+    pending.erase(0, start);
+}
+} // namespace
+
+auto serve(
+    std::string_view socket_path,
+    CompileFunction compile,
+    ReportFunction report,
+    WarmFunction warm
+) -> int {
+    auto address = Address(socket_path);
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) lcc::Diag::Fatal("Could not create socket: {}", std::strerror(errno));
+
+    // Replace a socket left behind by an earlier server, but nothing else.
+    struct stat st {};
+    if (::lstat(address.sun_path, &st) == 0 and S_ISSOCK(st.st_mode))
+        ::unlink(address.sun_path);
+
+    if (
+        ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0
+        or ::listen(listener, SOMAXCONN) < 0
+    ) lcc::Diag::Fatal("Could not listen on {}: {}", socket_path, std::strerror(errno));
+
+    // Clients may go away at any time; don't die writing to them. The
+    // processes handling requests are reaped automatically.
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGCHLD, SIG_IGN);
+
+    // Compilations report what they read through this pipe. Neither end
+    // ever blocks: the server reads whatever is there, and compilations
+    // drop reports rather than wait for it.
+    int reports[2]{};
+    if (::pipe(reports) < 0) lcc::Diag::Fatal("Could not create pipe: {}", std::strerror(errno));
+    for (int fd : reports) {
+        ::fcntl(fd, F_SETFL, O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    std::string pending{};
+
+    for (;;) {
+        pollfd fds[2]{{listener, POLLIN, 0}, {reports[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            lcc::Diag::Error("Could not wait for requests on {}: {}", socket_path, std::strerror(errno));
+            return 1;
+        }
+
+        // Load what earlier compilations read before forking for the
+        // next request, so that it starts out with it.
+        if (fds[1].revents & POLLIN) ReadReports(reports[0], pending, warm);
+        if (not(fds[0].revents & POLLIN)) continue;
+
+        int connection = ::accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR or errno == ECONNABORTED) continue;
+            lcc::Diag::Error("Could not accept connection on {}: {}", socket_path, std::strerror(errno));
+            return 1;
+        }
+
+        // Handle each request in its own process so that the server can
+        // accept the next one right away.
+        auto pid = ::fork();
+        if (pid == 0) {
+            ::close(listener);
+            ::close(reports[0]);
+            std::signal(SIGCHLD, SIG_DFL);
+            HandleRequest(connection, reports[1], compile, report);
+            ::_exit(0);
+        }
+        if (pid < 0) lcc::Diag::Error("Could not fork to handle request: {}", std::strerror(errno));
+        ::close(connection);
+    }
+}
+
+auto request(std::string_view socket_path, int argc, const char** argv) -> int {
+    std::signal(SIGPIPE, SIG_IGN);
+
+    auto address = Address(socket_path);
+    int connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (
+        connection < 0
+        or ::connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof address) < 0
+    ) lcc::Diag::Fatal("Could not connect to compile server at {}: {}", socket_path, std::strerror(errno));
+
+    std::string request = std::filesystem::current_path().string();
+    request += '\0';
+    for (int i = 0; i < argc; ++i) {
+        request += argv[i];
+        request += '\0';
+    }
+    if (request.size() > max_request_size) lcc::Diag::Fatal("Command line is too long for the compile server");
+
+    // Send the size along with our standard output and error.
+    auto size = u32(request.size());
+    iovec io{&size, sizeof size};
+    alignas(cmsghdr) char control[CMSG_SPACE(passed_descriptors * sizeof(int))]{};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof control;
+
+    int descriptors[passed_descriptors]{STDOUT_FILENO, STDERR_FILENO};
+    auto* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof descriptors);
+    std::memcpy(CMSG_DATA(header), descriptors, sizeof descriptors);
+
+    ssize_t n{};
+    do n = ::sendmsg(connection, &message, 0);
+    while (n < 0 and errno == EINTR);
+    if (n != sizeof size or not WriteAll(connection, request.data(), request.size()))
+        lcc::Diag::Fatal("Could not send request to compile server at {}: {}", socket_path, std::strerror(errno));
+
+    i32 status{};
+    if (not ReadAll(connection, &status, sizeof status))
+        lcc::Diag::Fatal("Compile server at {} did not reply", socket_path);
+
+    ::close(connection);
+    return status;
+}
+
+#else
+
+auto serve(std::string_view, CompileFunction, ReportFunction, WarmFunction) -> int {
+    lcc::Diag::Fatal("The compile server is not supported on this platform");
+}
+
+auto request(std::string_view, int, const char**) -> int {
+    lcc::Diag::Fatal("The compile server is not supported on this platform");
+}
+
+#endif
+
+} // namespace server
@@ -0,0 +1,53 @@
+#ifndef LCC_DRIVER_SERVER_HH
+#define LCC_DRIVER_SERVER_HH
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// A compile server, which saves build systems that run the compiler
+/// over and over again from starting a new process each time.
+///
+/// The server listens on a Unix socket. A request consists of the
+/// working directory and command line of a compilation, along with the
+/// standard output and error of the client, which the compilation
+/// prints its output and diagnostics to directly. The reply is the exit
+/// status of the compilation.
+///
+/// Every request is compiled in a process forked off the server, so
+/// compilations are isolated from one another (and may exit at any
+/// time, e.g. on a fatal error) while starting out with everything the
+/// server has already loaded and initialised. Nothing a compilation
+/// loads flows back by itself, so each one reports what it had to read
+/// (e.g. imported modules), and the server reads that in turn to keep
+/// its caches warm for the requests after it.
+namespace server {
+
+/// Compile with the given command line, and return the exit status.
+using CompileFunction = int (*)(int argc, const char** argv);
+
+/// Called after a compilation; returns what it read that the server
+/// should load too, as strings without newlines.
+using ReportFunction = std::vector<std::string> (*)();
+
+/// Called in the server with each string reported by a compilation.
+using WarmFunction = void (*)(std::string_view);
+
+/// Listen on the Unix socket at \p socket_path, and use \p compile to
+/// compile every request sent to it; \p report and \p warm keep the
+/// server's caches filled. This only returns on error.
+auto serve(
+    std::string_view socket_path,
+    CompileFunction compile,
+    ReportFunction report,
+    WarmFunction warm
+) -> int;
+
+/// Have the server listening at \p socket_path compile with the given
+/// arguments (excluding the program name) in the current directory,
+/// and return the exit status of the compilation.
+auto request(std::string_view socket_path, int argc, const char** argv) -> int;
+
+} // namespace server
+
+#endif /* LCC_DRIVER_SERVER_HH */
@@ -0,0 +1,10 @@
+;; Changing the layout of a struct without changing the IR of the
+;; functions that use it must not reuse their cached machine code.
+;;
+;; R rm -rf %s.cache && %lcc %s -f obj --codegen-cache %s.cache -o %s.o > /dev/null && sed 's/a : int /a : i32 /' %s > %s.i32.g && %lcc %s.i32.g -f obj --codegen-cache %s.cache -o %s.cached.o > /dev/null && %lcc %s.i32.g -f obj -o %s.uncached.o > /dev/null && cmp %s.cached.o %s.uncached.o && echo same
+
+;; * same
+
+pair : struct { a : int  b : byte };
+second : byte(p : pair.ref) { return p.b; };
+0;
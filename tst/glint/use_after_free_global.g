@@ -0,0 +1,14 @@
+;; Freeing a global in a function makes it no longer viable in the
+;; functions after it, no matter how many threads analyse them.
+;;
+;; R %lcc %s --stopat-sema -j 1
+;; R %lcc %s --stopat-sema -j 4
+
+;; * use_after_free_global.g:12:12: Error: Reference to a name, xs, that is no longer viable; probably a use-after-free thing
+;; * use_after_free_global.g:13:14: Error: Reference to a name, xs, that is no longer viable; probably a use-after-free thing
+
+external xs : [int];
+f : void() { -xs; };
+g : int() { xs.size; };
+h : void() { -xs; };
+0;
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <cstring>
@@ -12,6 +13,7 @@
 #include <regex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #ifdef _WIN32
 #    define PLATFORM_EXE_SUFFIX "exe"
@@ -322,52 +324,49 @@ auto delete_file(const fs::path& path) {
     if (fs::exists(path)) fs::remove(path);
 }
 
-int main(int argc_, char **argv_) {
-    /// Disable abort popup on Windows.
-#if defined(_WIN32) && !defined(__MINGW32__)
-    _set_abort_behavior(0, _WRITE_ABORT_MSG | _CALL_REPORTFAULT);
-#endif
+/// Everything needed to run a test that is the same for every test.
+struct test_config {
+    std::string target;
+    fs::path intcpath;
+    fs::path ldpath;
+    bool optimise{};
+};
 
-    if (argc_ < 5) fatal("Usage: test_instantiator <target> <test> <intc> <ld> [-O]");
-    std::string target = argv_[1];
-    std::string test = argv_[2];
-    std::string intc = argv_[3];
-    std::string ld = argv_[4];
-    bool optimise = argc_ >= 6 and argv_[5] == "-O"sv;
+/// The outcome of a single test. Tests may run on several threads at
+/// once, so failures are collected here and printed by the caller in
+/// the order the tests were given, rather than as they happen.
+struct test_result {
+    bool passed{};
+    std::string message{};
+};
 
-    fs::path testpath{test};
-    fs::path intcpath{intc};
-    fs::path ldpath{ld};
+/// Like ASSERT, but fail the current test instead of exiting.
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (not(cond)) return test_result{false, fmt::format(__VA_ARGS__)}; \
+    } while (0)
 
-    ASSERT(fs::exists(testpath), "Sorry, but the test specified at \"{}\" does not exist", testpath);
+/// Compile, link, and run a single test.
+///
+/// \param workdir A directory private to the calling worker; all
+///        intermediate files are created in it.
+auto run_test(const test_config& cfg, const fs::path& testpath, const fs::path& workdir) -> test_result {
+    CHECK(fs::exists(testpath), "Sorry, but the test specified at \"{}\" does not exist", testpath);
     //VERBOSE("Found test file at {}", testpath);
 
-    /// Account for executable suffix stupidity.
-    const auto find_exe = [](fs::path& path) {
-        if (fs::exists(path)) return true;
-        if (path.extension() == PLATFORM_EXE_SUFFIX) return false;
-        path.replace_extension(PLATFORM_EXE_SUFFIX);
-        return fs::exists(path);
-    };
-
-    ASSERT(find_exe(intcpath), "Sorry, but the intc compiler specified at \"{}\" does not exist", intcpath);
-    //VERBOSE("Using Intercept compiler at {}", intcpath);
-    ASSERT(find_exe(ldpath), "Sorry, but the linker specified at \"{}\" does not exist", ldpath);
-    //VERBOSE("Using linker at {}", ldpath);
-
     // Parse expected test results
     std::ifstream testfile(testpath);
     std::string line{};
-    ASSERT(std::getline(testfile, line), "Sorry, but the test file at \"{}\" appears to be empty", testpath);
+    CHECK(std::getline(testfile, line), "Sorry, but the test file at \"{}\" appears to be empty", testpath);
     while (line.starts_with(";; LABELS")) {
-        ASSERT(
+        CHECK(
             std::getline(testfile, line),
             "Sorry, but the test file at \"{}\" appears to be malformed (LABELS nonsense)",
             testpath
         );
     }
 
-    ASSERT(
+    CHECK(
         line.starts_with(";; "),
         "Sorry, but the test file at \"{}\" appears to be a malformed test.\n"
         "There must be a \";; \" at the beginning of the first line followed by either\n"
@@ -379,7 +378,7 @@ int main(int argc_, char **argv_) {
     int expected_status{0};
     if (line == ";; SKIP") {
         //VERBOSE("Skipping test {}", testpath);
-        return 0;
+        return {true};
     }
 
     if (line == ";; ERROR") {
@@ -389,7 +388,7 @@ int main(int argc_, char **argv_) {
         char *end;
         errno = 0;
         expected_status = (int) std::strtoull(line.c_str() + 3, &end, 10);
-        ASSERT(
+        CHECK(
             errno == 0,
             "Expected exit code must be an integer, but was \"{}\"",
             std::string_view{line}.substr(3)
@@ -408,19 +407,19 @@ int main(int argc_, char **argv_) {
     //VERBOSE("Expected output: {:?}", expected_output);
 
     /// Construct Intercept compiler invocation.
-    fs::path intc_outpath{}, intc_logpath = temppath("log");
-    if (target.starts_with("asm")) intc_outpath = temppath("s");
-    else intc_outpath = temppath(target == "llvm" ? "ll" : "o");
+    fs::path intc_outpath = workdir / "test", intc_logpath = workdir / "intc.log";
+    if (cfg.target.starts_with("asm")) intc_outpath += ".s";
+    else intc_outpath += cfg.target == "llvm" ? ".ll" : ".o";
     auto intc_status = run_command(
-        intcpath,
+        cfg.intcpath,
         "-cc",
         CALLING_CONVENTION,
         "-t",
-        target,
+        cfg.target,
         "-o",
         intc_outpath.string(),
         testpath.string(),
-        optimise ? "-O" : ARG_NONE,
+        cfg.optimise ? "-O" : ARG_NONE,
         ARG_NO_ESCAPE ">",
         intc_logpath.string(),
         ARG_NO_ESCAPE "2>&1"
@@ -434,7 +433,7 @@ int main(int argc_, char **argv_) {
 
     /// Check for ICEs.
     std::string log = map_file(intc_logpath.string());
-    ASSERT(
+    CHECK(
         log.find("Internal Compiler Error") == std::string::npos,
         "Intercept compiler suffered Internal Compiler Error: {}",
         log
@@ -442,7 +441,7 @@ int main(int argc_, char **argv_) {
 
     /// If we were expecting an error, check for that.
     if (expected_error) {
-        ASSERT(
+        CHECK(
             !intc_status.success,
             "FAILURE: Intercept compiler returned successful exit code but an error was expected\n"
             "  intc_invocation: {}",
@@ -450,11 +449,11 @@ int main(int argc_, char **argv_) {
         );
 
         /// If unsuccessful and error was expected, we good.
-        return 0;
+        return {true};
     }
 
     /// Otherwise, the compiler invocation should have succeeded.
-    ASSERT(
+    CHECK(
         intc_status.success,
         "FAILURE: intc did not exit successfully\n"
         "  intc_invocation:   {}\n"
@@ -466,16 +465,17 @@ int main(int argc_, char **argv_) {
     );
 
     /// Run linker.
-    auto ld_outpath = temppath(PLATFORM_EXE_SUFFIX);
+    auto ld_outpath = workdir / "test.exe";
+    ld_outpath.replace_extension(PLATFORM_EXE_SUFFIX);
     auto ld_status = run_command(
-        ldpath.string(),
+        cfg.ldpath.string(),
         "-o",
         ld_outpath.string(),
         intc_outpath.string()
     );
     defer { delete_file(ld_outpath); };
     //VERBOSE("Linker command line is: {}", ld_status.escaped_command_line);
-    ASSERT(
+    CHECK(
         ld_status.success,
         "FAILURE: Linker errored\n"
         "  intc_invocation:   {}\n"
@@ -487,7 +487,7 @@ int main(int argc_, char **argv_) {
     );
 
     /// Run the test.
-    fs::path outpath = temppath("txt");
+    fs::path outpath = workdir / "output.txt";
     auto test_status = run_command(
         ld_outpath.is_absolute() ? ld_outpath : fs::current_path() / ld_outpath,
         ARG_NO_ESCAPE ">",
@@ -499,7 +499,7 @@ int main(int argc_, char **argv_) {
 
 #ifdef __linux__
     /// Check for signals on Linux.
-    ASSERT(
+    CHECK(
         test_status.exited,
         "FAILURE: Test was terminated by signal\n"
         "  intc_invocation:   {}\n"
@@ -514,7 +514,7 @@ int main(int argc_, char **argv_) {
 #endif
 
     /// Check status code.
-    ASSERT(
+    CHECK(
         test_status.code == expected_status,
         "FAILURE: Test returned unexpected exit code\n"
         "  intc_invocation:   {}\n"
@@ -540,7 +540,7 @@ int main(int argc_, char **argv_) {
     while (expected_output.ends_with("\n")) expected_output.pop_back();
 
     /// Check output.
-    ASSERT(
+    CHECK(
         output == expected_output,
         "FAILURE: Test generated unexpected output\n"
         "  Output:          {:?}\n"
@@ -554,4 +554,89 @@ int main(int argc_, char **argv_) {
         ld_status.escaped_command_line,
         test_status.escaped_command_line
     );
+
+    return {true};
+}
+
+int main(int argc_, char **argv_) {
+    /// Disable abort popup on Windows.
+#if defined(_WIN32) && !defined(__MINGW32__)
+    _set_abort_behavior(0, _WRITE_ABORT_MSG | _CALL_REPORTFAULT);
+#endif
+
+    if (argc_ < 5) fatal("Usage: test_instantiator <target> <test> <intc> <ld> [-O] [-j <jobs>] [<test>...]");
+    test_config cfg;
+    cfg.target = argv_[1];
+    std::vector<fs::path> tests{argv_[2]};
+    cfg.intcpath = argv_[3];
+    cfg.ldpath = argv_[4];
+
+    /// Any further arguments are options or additional tests. Tests
+    /// are run on up to <jobs> threads; zero means one per hardware
+    /// thread.
+    std::size_t jobs = 1;
+    for (int i = 5; i < argc_; i++) {
+        std::string_view arg = argv_[i];
+        if (arg == "-O") cfg.optimise = true;
+        else if (arg.starts_with("-j")) {
+            if (arg == "-j") {
+                ASSERT(i + 1 < argc_, "Option -j requires a job count");
+                arg = argv_[++i];
+            } else {
+                arg.remove_prefix(2);
+            }
+            errno = 0;
+            char *end;
+            jobs = std::strtoull(arg.data(), &end, 10);
+            ASSERT(errno == 0 and *end == 0, "Invalid job count \"{}\"", arg);
+            if (jobs == 0) jobs = std::max(std::size_t(std::thread::hardware_concurrency()), std::size_t(1));
+        } else {
+            tests.emplace_back(arg);
+        }
+    }
+
+    /// Account for executable suffix stupidity.
+    const auto find_exe = [](fs::path& path) {
+        if (fs::exists(path)) return true;
+        if (path.extension() == PLATFORM_EXE_SUFFIX) return false;
+        path.replace_extension(PLATFORM_EXE_SUFFIX);
+        return fs::exists(path);
+    };
+
+    ASSERT(find_exe(cfg.intcpath), "Sorry, but the intc compiler specified at \"{}\" does not exist", cfg.intcpath);
+    //VERBOSE("Using Intercept compiler at {}", cfg.intcpath);
+    ASSERT(find_exe(cfg.ldpath), "Sorry, but the linker specified at \"{}\" does not exist", cfg.ldpath);
+    //VERBOSE("Using linker at {}", cfg.ldpath);
+
+    /// Hand out tests one at a time from a shared counter. Each worker
+    /// gets its own temporary directory, so the intermediate files of
+    /// tests running at the same time never collide.
+    std::vector<test_result> results(tests.size());
+    std::atomic<std::size_t> next{0};
+    auto worker = [&] {
+        auto workdir = temppath("");
+        fs::create_directories(workdir);
+        defer { fs::remove_all(workdir); };
+        for (auto i = next++; i < tests.size(); i = next++)
+            results[i] = run_test(cfg, tests[i], workdir);
+    };
+
+    jobs = std::min(jobs, tests.size());
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t i = 1; i < jobs; i++) threads.emplace_back(worker);
+        worker();
+    }
+
+    /// Report failures in the order the tests were given.
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < tests.size(); i++) {
+        if (results[i].passed) continue;
+        failed++;
+        if (tests.size() > 1) fmt::print(stderr, "{}:\n", tests[i]);
+        fmt::print(stderr, "{}\n", results[i].message);
+    }
+
+    if (tests.size() > 1) fmt::print("{}/{} tests passed\n", tests.size() - failed, tests.size());
+    return failed ? 127 : 0;
 }